@@ -75,6 +75,12 @@
 #ifndef APPCONF_CAN_STATUS_MSGS_R2
 #define APPCONF_CAN_STATUS_MSGS_R2			0
 #endif
+#ifndef APPCONF_CAN_STATUS_ON_CHANGE
+#define APPCONF_CAN_STATUS_ON_CHANGE		false
+#endif
+#ifndef APPCONF_CAN_STATUS_BUDGET
+#define APPCONF_CAN_STATUS_BUDGET			0.25
+#endif
 
 // The default app is UART in case the UART port is used for
 // firmware updates.
@@ -122,6 +122,7 @@ static void terminal_plot(int argc, const char **argv);
 static void terminal_info(int argc, const char **argv);
 static void terminal_mon(int argc, const char **argv);
 static void terminal_restore_settings(int argc, const char **argv);
+static can_status_msg *first_vesc(void);
 
 static lbm_value ext_pedal_rpm(lbm_value *args, lbm_uint argn) {
 	(void)args; (void)argn;
@@ -349,8 +350,8 @@ static THD_FUNCTION(my_thread, arg) {
 	for(;;) {
 
 #if !IS_STANDALONE
-		io_board_adc_values *io_v1 = comm_can_get_io_board_adc_1_4_index(0);
-		io_board_adc_values *io_v2 = comm_can_get_io_board_adc_5_8_index(0);
+		io_board_adc_values *io_v1 = comm_can_get_io_board_adc_1_4_id(255);
+		io_board_adc_values *io_v2 = comm_can_get_io_board_adc_5_8_id(255);
 
 		if (io_v1 && io_v2 && UTILS_AGE_S(io_v1->rx_time) < 1.0 && UTILS_AGE_S(io_v2->rx_time) < 1.0) {
 			m_brake_rear = io_v2->adc_voltages[3] > 6.0;
@@ -367,8 +368,8 @@ static THD_FUNCTION(my_thread, arg) {
 		}
 
 		float kmh_now = -1.0;
-		can_status_msg *msg = comm_can_get_status_msg_index(0);
-		if (msg->id >= 0 && UTILS_AGE_S(msg->rx_time) < 0.5) {
+		can_status_msg *msg = first_vesc();
+		if (msg && UTILS_AGE_S(msg->rx_time) < 0.5) {
 			float rpm = fabsf(msg->rpm / (poles / 2.0));
 			kmh_now = ((rpm / 60.0) * wheel_d * M_PI / gearing) * 3.6;
 		}
@@ -503,8 +504,9 @@ static THD_FUNCTION(my_thread, arg) {
 				LED_ECO_OFF();
 			}
 
-			can_status_msg_4 *msg4 = comm_can_get_status_msg_4_index(0);
-			if (msg4->id >= 0 && UTILS_AGE_S(msg4->rx_time) < 0.5) {
+			can_status_msg *vesc = first_vesc();
+			can_status_msg_4 *msg4 = vesc ? comm_can_get_status_msg_4_id(vesc->id) : 0;
+			if (msg4 && UTILS_AGE_S(msg4->rx_time) < 0.5) {
 				if (msg4->temp_fet > 88.0 || msg4->temp_motor > 100.0) {
 					LED_FAULT_ON();
 				} else {
@@ -512,8 +514,8 @@ static THD_FUNCTION(my_thread, arg) {
 				}
 			}
 
-			can_status_msg_5 *msg5 = comm_can_get_status_msg_5_index(0);
-			if (msg5->id >= 0 && UTILS_AGE_S(msg5->rx_time) < 0.5) {
+			can_status_msg_5 *msg5 = vesc ? comm_can_get_status_msg_5_id(vesc->id) : 0;
+			if (msg5 && UTILS_AGE_S(msg5->rx_time) < 0.5) {
 				static float v_batt_filter = 0.0;
 				UTILS_LP_FAST(v_batt_filter, msg5->v_in, 0.01);
 
@@ -608,6 +610,21 @@ static THD_FUNCTION(my_thread, arg) {
 	}
 }
 
+/*
+ * The VESC that sent status first. The status tables are indexed by node,
+ * so the entries of a message type can have gaps.
+ */
+static can_status_msg *first_vesc(void) {
+	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
+		can_status_msg *msg = comm_can_get_status_msg_index(i);
+		if (msg->id >= 0) {
+			return msg;
+		}
+	}
+
+	return 0;
+}
+
 static void process_custom_app_data(unsigned char *data, unsigned int len) {
 	(void)len;
 
@@ -3,6 +3,9 @@ CSRC += \
 	comm/comm_usb_serial.c \
 	comm/comm_usb.c \
 	comm/comm_can.c \
+	comm/comm_can_xfer.c \
+	comm/comm_can_pub.c \
+	comm/comm_can_fd.c \
 	comm/packet.c \
 	comm/log.c
 
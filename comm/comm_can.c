@@ -48,20 +48,59 @@
 #endif
 
 // Settings
-#define RX_FRAMES_SIZE	50
+#define RX_FRAMES_SIZE	64 // Must be a power of two
 #define RX_BUFFER_NUM	3
 #define RX_BUFFER_SIZE	PACKET_MAX_PL_LEN
+#define RX_FILTER_HOLD	2.0 // Time to keep accepting all frames after the last user of them [s]
+#define XFER_SLOT_WAIT	50 // Time to wait for a free transfer slot before sending the legacy way [ms]
+#define XFER_PING_INTERVAL	0.1 // Shortest time between pings asking for transfer support [s]
+#define STATUS_MAX_INTERVAL_FAST	0.05 // STATUS to STATUS_4 are used for up to 0.1 s by the receivers [s]
+#define STATUS_MAX_INTERVAL_SLOW	0.25 // STATUS_5 and STATUS_6 [s]
+#define FD_RX_FRAMES_SIZE	8 // Must be a power of two
+#define FD_NOMINAL_SAMPLE_POINT	0.8
+#define FD_DATA_SAMPLE_POINT	0.75
 
 #if CAN_ENABLE
 
 typedef struct {
-	CANRxFrame rx_frames[RX_FRAMES_SIZE];
-	int frame_read;
-	int frame_write;
+	CANRxFrame frame;
+	bool decoded; // Already applied by the read thread
+} rx_entry;
+
+/*
+ * Single producer, single consumer ring. The read thread is the only writer
+ * of head and the consumer, which is the process thread or the UAVCAN driver
+ * in UAVCAN mode, is the only writer of tail.
+ */
+typedef struct {
+	rx_entry rx_frames[RX_FRAMES_SIZE];
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	can_rx_stats stats;
 } rx_state;
 
+// Hardware filter banks in 32 bit mask mode, per interface
+#define RX_FILTER_BANKS		8
+#define RX_FILTER_IDE		0x04
+#define RX_FILTER_EID(eid)	(((uint32_t)(eid) << 3) | RX_FILTER_IDE)
+
+/*
+ * Packet types decoded from any sender, as aligned blocks of 2^bits types.
+ * They cover STATUS to STATUS_6 and the IO-board, PSW, GNSS, BMS and
+ * UPDATE_BAUD packets.
+ */
+static const struct {
+	uint8_t first;
+	uint8_t bits;
+} rx_filter_types[] = {
+		{CAN_PACKET_STATUS & ~0x07, 3},
+		{CAN_PACKET_STATUS_4, 4},
+		{CAN_PACKET_IO_BOARD_ADC_1_TO_4, 5},
+		{CAN_PACKET_BMS_STATUS_1, 3},
+};
+
 // Threads
-__attribute__((section(".ram4"))) static THD_WORKING_AREA(cancom_read_thread_wa, 256);
+__attribute__((section(".ram4"))) static THD_WORKING_AREA(cancom_read_thread_wa, 512);
 __attribute__((section(".ram4"))) static THD_WORKING_AREA(cancom_process_thread_wa, 2048);
 __attribute__((section(".ram4"))) static THD_WORKING_AREA(cancom_status_thread_wa, 512);
 __attribute__((section(".ram4"))) static THD_WORKING_AREA(cancom_status_thread_2_wa, 512);
@@ -76,7 +115,6 @@ static THD_WORKING_AREA(cancom_status_internal_thread_wa, 512);
 #endif
 
 static mutex_t can_mtx;
-static mutex_t can_rx_mtx;
 static uint8_t rx_buffer[RX_BUFFER_NUM][RX_BUFFER_SIZE];
 static int rx_buffer_offset[RX_BUFFER_NUM];
 static volatile unsigned int rx_buffer_last_id;
@@ -86,6 +124,88 @@ static rx_state m_rx_state;
 static rx_state m_rx_state2;
 #endif
 
+static bool rx_filter_all = true;
+static int rx_filter_id1 = -1;
+static int rx_filter_id2 = -1;
+static systime_t rx_filter_all_last = 0;
+
+// Windowed buffer transfers. The sending side is locked by xfer_mtx, the
+// receiving side is only used from the process thread. xfer_support is
+// only written by the process thread. m_xfer takes about 4.6 KB of RAM,
+// most of it the CAN_XFER_SLOTS + CAN_XFER_RX_NUM buffers of
+// CAN_XFER_MAX_LEN bytes.
+typedef enum {
+	XFER_SUPPORT_UNKNOWN = 0,
+	XFER_SUPPORT_NO,
+	XFER_SUPPORT_YES
+} XFER_SUPPORT;
+
+static mutex_t xfer_mtx;
+static can_xfer_t m_xfer;
+static uint8_t xfer_support[256];
+static volatile bool xfer_support_reset = false;
+static systime_t xfer_ping_last = 0;
+
+// Status message scheduler, shared by the status threads
+static mutex_t pub_mtx;
+static can_pub_t m_pub;
+
+/*
+ * Fields of CAN_PACKET_STATUS to CAN_PACKET_STATUS_6 as
+ * {min interval [s], max interval [s], deadband [sent units]}
+ */
+static const can_pub_msg_conf status_pub_conf[CAN_PUB_MSGS] = {
+		{3, 8, { // ERPM, current * 10, duty * 1000
+				{0.0, STATUS_MAX_INTERVAL_FAST, 20},
+				{0.0, STATUS_MAX_INTERVAL_FAST, 2},
+				{0.0, STATUS_MAX_INTERVAL_FAST, 2}}},
+		{2, 8, { // Ah * 1e4, Ah charged * 1e4
+				{0.0, STATUS_MAX_INTERVAL_FAST, 10},
+				{0.0, STATUS_MAX_INTERVAL_FAST, 10}}},
+		{2, 8, { // Wh * 1e4, Wh charged * 1e4
+				{0.0, STATUS_MAX_INTERVAL_FAST, 100},
+				{0.0, STATUS_MAX_INTERVAL_FAST, 100}}},
+		{4, 8, { // Temp FET * 10, temp motor * 10, input current * 10, PID pos * 50
+				{0.1, STATUS_MAX_INTERVAL_FAST, 5},
+				{0.1, STATUS_MAX_INTERVAL_FAST, 5},
+				{0.0, STATUS_MAX_INTERVAL_FAST, 2},
+				{0.0, STATUS_MAX_INTERVAL_FAST, 25}}},
+		{2, 8, { // Tachometer, input voltage * 10
+				{0.0, STATUS_MAX_INTERVAL_SLOW, 6},
+				{0.0, STATUS_MAX_INTERVAL_SLOW, 2}}},
+		{4, 8, { // ADC1 - 3 * 1000, PPM * 1000
+				{0.0, STATUS_MAX_INTERVAL_SLOW, 10},
+				{0.0, STATUS_MAX_INTERVAL_SLOW, 10},
+				{0.0, STATUS_MAX_INTERVAL_SLOW, 10},
+				{0.0, STATUS_MAX_INTERVAL_SLOW, 5}}},
+};
+
+#ifdef HW_HAS_CAN_FD
+/*
+ * CAN-FD frames from the driver, in a ring like rx_state with the driver
+ * as the producer and the process thread as the consumer. Sending buffers
+ * is locked by fd_mtx. The ring takes about 0.6 KB of RAM and m_fd about
+ * 2.1 KB for its CAN_FD_RX_NUM buffers.
+ */
+typedef struct {
+	uint32_t eid;
+	uint8_t data[CAN_FD_FRAME_LEN];
+	uint8_t len;
+} fd_frame;
+
+static fd_frame fd_rx_frames[FD_RX_FRAMES_SIZE];
+static volatile uint32_t fd_rx_head = 0;
+static volatile uint32_t fd_rx_tail = 0;
+static volatile uint32_t fd_rx_overflows = 0;
+static mutex_t fd_mtx;
+static can_fd_t m_fd;
+static bool fd_support[256];
+static volatile bool fd_enabled = false;
+static volatile bool fd_brs = false;
+static volatile int fd_data_kbits = 0;
+static volatile CAN_BAUD fd_baud = CAN_BAUD_500K;
+#endif
+
 static thread_t *process_tp = 0;
 static thread_t *ping_tp = 0;
 static volatile HW_TYPE ping_hw_last = HW_TYPE_VESC;
@@ -93,17 +213,36 @@ static volatile int ping_hw_last_id = -1;
 static volatile bool init_done = false;
 #endif
 
+/*
+ * All status messages from one node. The messages keep their own id, which
+ * is -1 until the node has sent that type.
+ */
+typedef struct {
+	int id;
+	can_status_msg status;
+	can_status_msg_2 status_2;
+	can_status_msg_3 status_3;
+	can_status_msg_4 status_4;
+	can_status_msg_5 status_5;
+	can_status_msg_6 status_6;
+	io_board_adc_values io_board_adc_1_4;
+	io_board_adc_values io_board_adc_5_8;
+	io_board_digial_inputs io_board_digital_in;
+	psw_status psw_stat;
+} can_node;
+
+#if CAN_STATUS_MSGS_TO_STORE > 255
+#error "node_index cannot hold more than 255 nodes"
+#endif
+
+static const uint8_t status_packet_ids[CAN_PUB_MSGS] = {
+		CAN_PACKET_STATUS, CAN_PACKET_STATUS_2, CAN_PACKET_STATUS_3,
+		CAN_PACKET_STATUS_4, CAN_PACKET_STATUS_5, CAN_PACKET_STATUS_6
+};
+
 // Variables
-static can_status_msg stat_msgs[CAN_STATUS_MSGS_TO_STORE];
-static can_status_msg_2 stat_msgs_2[CAN_STATUS_MSGS_TO_STORE];
-static can_status_msg_3 stat_msgs_3[CAN_STATUS_MSGS_TO_STORE];
-static can_status_msg_4 stat_msgs_4[CAN_STATUS_MSGS_TO_STORE];
-static can_status_msg_5 stat_msgs_5[CAN_STATUS_MSGS_TO_STORE];
-static can_status_msg_6 stat_msgs_6[CAN_STATUS_MSGS_TO_STORE];
-static io_board_adc_values io_board_adc_1_4[CAN_STATUS_MSGS_TO_STORE];
-static io_board_adc_values io_board_adc_5_8[CAN_STATUS_MSGS_TO_STORE];
-static io_board_digial_inputs io_board_digital_in[CAN_STATUS_MSGS_TO_STORE];
-static psw_status psw_stat[CAN_STATUS_MSGS_TO_STORE];
+static can_node nodes[CAN_STATUS_MSGS_TO_STORE];
+static uint8_t node_index[256]; // Index in nodes + 1 by controller id, 0 if none
 static unsigned int detect_all_foc_res_index = 0;
 static int8_t detect_all_foc_res[50];
 
@@ -120,9 +259,43 @@ static CANConfig cancfg = {
 
 // Private functions
 static void set_timing(int brp, int ts1, int ts2);
+static void node_clear(can_node *node);
+static can_node *node_get(int id);
+static void status_values(int msg, int32_t *value);
+static int32_t status_pack(int msg, const int32_t *value, uint8_t *buffer);
+static void status_transmit(int msg, uint8_t id, const int32_t *value, bool replace);
+static void send_status(int msg, uint8_t id, bool replace);
 #if CAN_ENABLE
+static void send_can_status(uint8_t msgs, uint8_t id, float period);
+static void publish_status(uint8_t msgs, int src, uint8_t id, float period, bool on_change);
 static void send_packet_wrapper(unsigned char *data, unsigned int len);
 static void decode_msg(uint32_t eid, uint8_t *data8, int len, bool is_replaced);
+static bool decode_control(CAN_PACKET_ID cmd, const uint8_t *data8, int len);
+static bool rx_push(rx_state *s, const CANRxFrame *frame, bool decoded);
+static bool rx_pop(rx_state *s, CANRxFrame *frame, bool *decoded);
+static bool rx_get(int interface, CANRxFrame *frame, bool *decoded);
+static bool rx_fast_path(const CANRxFrame *frame);
+static void rx_receive(CANDriver *canp, rx_state *s);
+static void rx_filter_update(void);
+static bool rx_filter_program(bool accept_all, int id1, int id2);
+static void process_buffer(unsigned int last_id, uint8_t commands_send,
+		unsigned char *data, unsigned int len, bool is_replaced);
+static bool xfer_send(uint8_t controller_id, uint8_t *data, unsigned int len, uint8_t send);
+static void xfer_decode(uint32_t eid, const uint8_t *data8, int len);
+static void xfer_poll(void);
+static uint32_t time_us(void *arg);
+static void xfer_send_frame(uint32_t eid, const uint8_t *data, uint8_t len, void *arg);
+static void xfer_deliver(uint8_t src, uint8_t dest, uint8_t send,
+		uint8_t *data, unsigned int len, void *arg);
+static can_node *node_add(int id);
+#ifdef HW_HAS_CAN_FD
+static bool fd_configure(void);
+static bool fd_send(uint8_t controller_id, uint8_t *data, unsigned int len, uint8_t send);
+static void fd_send_frame(uint32_t eid, const uint8_t *data, uint8_t len, void *arg);
+static void fd_deliver(uint8_t src, uint8_t send, uint8_t *data, unsigned int len, void *arg);
+static void fd_decode_status(uint8_t id, const uint8_t *data8, int len);
+static void fd_rx_process(void);
+#endif
 #endif
 
 // Function pointers
@@ -131,25 +304,21 @@ static bool(*eid_callback)(uint32_t id, uint8_t *data, uint8_t len) = 0;
 
 void comm_can_init(void) {
 	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		stat_msgs[i].id = -1;
-		stat_msgs_2[i].id = -1;
-		stat_msgs_3[i].id = -1;
-		stat_msgs_4[i].id = -1;
-		stat_msgs_5[i].id = -1;
-		stat_msgs_6[i].id = -1;
-
-		io_board_adc_1_4[i].id = -1;
-		io_board_adc_5_8[i].id = -1;
-		io_board_digital_in[i].id = -1;
-
-		psw_stat[i].id = -1;
+		node_clear(&nodes[i]);
 	}
 
 #if CAN_ENABLE
 	memset(&m_rx_state, 0, sizeof(m_rx_state));
 
 	chMtxObjectInit(&can_mtx);
-	chMtxObjectInit(&can_rx_mtx);
+	chMtxObjectInit(&xfer_mtx);
+	comm_can_xfer_init(&m_xfer, time_us, xfer_send_frame, xfer_deliver, 0);
+	chMtxObjectInit(&pub_mtx);
+	comm_can_pub_init(&m_pub, status_pub_conf, 0.0, time_us(0));
+#ifdef HW_HAS_CAN_FD
+	chMtxObjectInit(&fd_mtx);
+	comm_can_fd_init(&m_fd, fd_send_frame, fd_deliver, 0);
+#endif
 
 	palSetPadMode(HW_CANRX_PORT, HW_CANRX_PIN,
 			PAL_MODE_ALTERNATE(HW_CAN_GPIO_AF) |
@@ -223,6 +392,25 @@ CAN_BAUD comm_can_kbits_to_baud(int kbits) {
 	return new_baud;
 }
 
+/**
+ * @return
+ * The bit rate of baud in kbit/s, 0 if it is invalid.
+ */
+int comm_can_baud_to_kbits(CAN_BAUD baud) {
+	switch (baud) {
+	case CAN_BAUD_125K: return 125;
+	case CAN_BAUD_250K: return 250;
+	case CAN_BAUD_500K: return 500;
+	case CAN_BAUD_1M: return 1000;
+	case CAN_BAUD_10K: return 10;
+	case CAN_BAUD_20K: return 20;
+	case CAN_BAUD_50K: return 50;
+	case CAN_BAUD_75K: return 75;
+	case CAN_BAUD_100K: return 100;
+	default: return 0;
+	}
+}
+
 void comm_can_set_baud(CAN_BAUD baud, int delay_msec) {
 	if (baud == CAN_BAUD_INVALID) {
 		return;
@@ -251,6 +439,109 @@ void comm_can_set_baud(CAN_BAUD baud, int delay_msec) {
 	case CAN_BAUD_100K:	set_timing(29, 10, 1); break;
 	default: break;
 	}
+
+#if CAN_ENABLE && defined(HW_HAS_CAN_FD)
+	// The arbitration phase of FD frames runs at this rate as well
+	fd_baud = baud;
+	if (fd_enabled) {
+		fd_configure();
+	}
+#endif
+}
+
+/**
+ * Switch CAN-FD frames on or off. comm_can_set_baud sets the rate of the
+ * arbitration phase, and with bit rate switching the data phase runs at
+ * data_kbits. Only enable this when all nodes on the bus have CAN-FD
+ * controllers, as classic controllers take FD frames as errors.
+ *
+ * With FD frames, buffers to nodes that answered a ping with CAN_FD_PONG_CAP
+ * are sent in 64 byte frames, and the status messages of each motor are
+ * merged into one CAN_PACKET_STATUS_FD frame.
+ *
+ * @param enable
+ * Use FD frames.
+ *
+ * @param data_kbits
+ * Rate of the data phase [kbit/s].
+ *
+ * @param brs
+ * Switch to data_kbits in the data phase. Without it the whole frame runs
+ * at the arbitration rate.
+ *
+ * @return
+ * false if the hardware has no CAN-FD or its clock cannot make the rates.
+ */
+bool comm_can_set_fd(bool enable, int data_kbits, bool brs) {
+#if CAN_ENABLE && defined(HW_HAS_CAN_FD)
+	const bool enabled_last = fd_enabled;
+	const int data_kbits_last = fd_data_kbits;
+	const bool brs_last = fd_brs;
+
+	fd_enabled = enable;
+	fd_data_kbits = data_kbits;
+	fd_brs = brs;
+
+	if (!fd_configure()) {
+		fd_enabled = enabled_last;
+		fd_data_kbits = data_kbits_last;
+		fd_brs = brs_last;
+		return false;
+	}
+
+	// Ask the nodes again, as FD support is in the same pong as transfer
+	// support. That is done by the process thread, which writes the
+	// support the other times.
+	xfer_support_reset = true;
+	if (process_tp) {
+		chEvtSignal(process_tp, (eventmask_t) 1);
+	}
+	return true;
+#else
+	(void)enable;
+	(void)data_kbits;
+	(void)brs;
+	return false;
+#endif
+}
+
+/**
+ * @return
+ * true if CAN-FD frames are in use.
+ */
+bool comm_can_fd_active(void) {
+#if CAN_ENABLE && defined(HW_HAS_CAN_FD)
+	return fd_enabled;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Get the CAN-FD settings.
+ *
+ * @param data_kbits
+ * Rate of the data phase [kbit/s], can be 0.
+ *
+ * @param brs
+ * Bit rate switching, can be 0.
+ */
+void comm_can_get_fd(int *data_kbits, bool *brs) {
+#if CAN_ENABLE && defined(HW_HAS_CAN_FD)
+	if (data_kbits) {
+		*data_kbits = fd_data_kbits;
+	}
+	if (brs) {
+		*brs = fd_brs;
+	}
+#else
+	if (data_kbits) {
+		*data_kbits = 0;
+	}
+	if (brs) {
+		*brs = false;
+	}
+#endif
 }
 
 /**
@@ -351,6 +642,77 @@ msg_t comm_can_transmit_eid_if(uint32_t id, const uint8_t *data, uint8_t len, in
 	return comm_can_transmit_eid_replace(id, data, len, false, interface);
 }
 
+/**
+ * Transmit a CAN-FD frame with extended ID. The frame is padded with zeros
+ * to the next length a DLC can encode.
+ *
+ * @param len
+ * Length of data, max 64 bytes.
+ *
+ * @return
+ * MSG_OK for success, MSG_RESET if FD frames are not in use.
+ */
+msg_t comm_can_transmit_eid_fd(uint32_t id, const uint8_t *data, uint8_t len) {
+#if CAN_ENABLE && defined(HW_HAS_CAN_FD)
+	if (!init_done || !fd_enabled) {
+		return MSG_RESET;
+	}
+
+	if (len > CAN_FD_FRAME_LEN) {
+		len = CAN_FD_FRAME_LEN;
+	}
+
+	uint8_t frame[CAN_FD_FRAME_LEN];
+	const unsigned int frame_len = comm_can_fd_frame_len(len);
+	memcpy(frame, data, len);
+	memset(frame + len, 0, frame_len - len);
+
+	chMtxLock(&can_mtx);
+	msg_t ret = HW_CAN_FD_TRANSMIT(id, frame, frame_len);
+	chMtxUnlock(&can_mtx);
+	return ret;
+#else
+	(void)id;
+	(void)data;
+	(void)len;
+	return MSG_RESET;
+#endif
+}
+
+/**
+ * Called by the driver of CAN-FD hardware for every received FD frame. The
+ * frames are decoded by the process thread. Must only be called from one
+ * thread.
+ */
+void comm_can_fd_frame_received(uint32_t eid, const uint8_t *data, uint8_t len) {
+#if CAN_ENABLE && defined(HW_HAS_CAN_FD)
+	if (len > CAN_FD_FRAME_LEN) {
+		len = CAN_FD_FRAME_LEN;
+	}
+
+	const uint32_t head = fd_rx_head;
+
+	if ((head - __atomic_load_n(&fd_rx_tail, __ATOMIC_ACQUIRE)) >= FD_RX_FRAMES_SIZE) {
+		fd_rx_overflows++;
+		return;
+	}
+
+	fd_frame *f = &fd_rx_frames[head & (FD_RX_FRAMES_SIZE - 1)];
+	f->eid = eid;
+	memcpy(f->data, data, len);
+	f->len = len;
+	__atomic_store_n(&fd_rx_head, head + 1, __ATOMIC_RELEASE);
+
+	if (process_tp) {
+		chEvtSignal(process_tp, (eventmask_t) 1);
+	}
+#else
+	(void)eid;
+	(void)data;
+	(void)len;
+#endif
+}
+
 msg_t comm_can_transmit_sid(uint32_t id, const uint8_t *data, uint8_t len) {
 	if (len > 8) {
 		len = 8;
@@ -443,6 +805,18 @@ void comm_can_set_eid_rx_callback(bool (*p_func)(uint32_t id, uint8_t *data, uin
 void comm_can_send_buffer(uint8_t controller_id, uint8_t *data, unsigned int len, uint8_t send) {
 	uint8_t send_buffer[8];
 
+#if CAN_ENABLE
+#ifdef HW_HAS_CAN_FD
+	if (len > 6 && fd_send(controller_id, data, len, send)) {
+		return;
+	}
+#endif
+
+	if (len > 6 && xfer_send(controller_id, data, len, send)) {
+		return;
+	}
+#endif
+
 	if (len <= 6) {
 		uint32_t ind = 0;
 		send_buffer[ind++] = app_get_configuration()->controller_id;
@@ -833,14 +1207,15 @@ void comm_can_send_update_baud(int kbits, int delay_msec) {
  * Get status message by index.
  *
  * @param index
- * Index in the array
+ * Index in the node table. Nodes that did not send this message have id -1
+ * in it, so there can be gaps.
  *
  * @return
  * The message or 0 for an invalid index.
  */
 can_status_msg *comm_can_get_status_msg_index(int index) {
-	if (index < CAN_STATUS_MSGS_TO_STORE) {
-		return &stat_msgs[index];
+	if (index >= 0 && index < CAN_STATUS_MSGS_TO_STORE) {
+		return &nodes[index].status;
 	} else {
 		return 0;
 	}
@@ -856,10 +1231,9 @@ can_status_msg *comm_can_get_status_msg_index(int index) {
  * The message or 0 for an invalid id.
  */
 can_status_msg *comm_can_get_status_msg_id(int id) {
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (stat_msgs[i].id == id) {
-			return &stat_msgs[i];
-		}
+	can_node *node = node_get(id);
+	if (node && node->status.id >= 0) {
+		return &node->status;
 	}
 
 	return 0;
@@ -869,14 +1243,15 @@ can_status_msg *comm_can_get_status_msg_id(int id) {
  * Get status message 2 by index.
  *
  * @param index
- * Index in the array
+ * Index in the node table. Nodes that did not send this message have id -1
+ * in it, so there can be gaps.
  *
  * @return
  * The message or 0 for an invalid index.
  */
 can_status_msg_2 *comm_can_get_status_msg_2_index(int index) {
-	if (index < CAN_STATUS_MSGS_TO_STORE) {
-		return &stat_msgs_2[index];
+	if (index >= 0 && index < CAN_STATUS_MSGS_TO_STORE) {
+		return &nodes[index].status_2;
 	} else {
 		return 0;
 	}
@@ -892,10 +1267,9 @@ can_status_msg_2 *comm_can_get_status_msg_2_index(int index) {
  * The message or 0 for an invalid id.
  */
 can_status_msg_2 *comm_can_get_status_msg_2_id(int id) {
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (stat_msgs_2[i].id == id) {
-			return &stat_msgs_2[i];
-		}
+	can_node *node = node_get(id);
+	if (node && node->status_2.id >= 0) {
+		return &node->status_2;
 	}
 
 	return 0;
@@ -905,14 +1279,15 @@ can_status_msg_2 *comm_can_get_status_msg_2_id(int id) {
  * Get status message 3 by index.
  *
  * @param index
- * Index in the array
+ * Index in the node table. Nodes that did not send this message have id -1
+ * in it, so there can be gaps.
  *
  * @return
  * The message or 0 for an invalid index.
  */
 can_status_msg_3 *comm_can_get_status_msg_3_index(int index) {
-	if (index < CAN_STATUS_MSGS_TO_STORE) {
-		return &stat_msgs_3[index];
+	if (index >= 0 && index < CAN_STATUS_MSGS_TO_STORE) {
+		return &nodes[index].status_3;
 	} else {
 		return 0;
 	}
@@ -928,10 +1303,9 @@ can_status_msg_3 *comm_can_get_status_msg_3_index(int index) {
  * The message or 0 for an invalid id.
  */
 can_status_msg_3 *comm_can_get_status_msg_3_id(int id) {
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (stat_msgs_3[i].id == id) {
-			return &stat_msgs_3[i];
-		}
+	can_node *node = node_get(id);
+	if (node && node->status_3.id >= 0) {
+		return &node->status_3;
 	}
 
 	return 0;
@@ -941,14 +1315,15 @@ can_status_msg_3 *comm_can_get_status_msg_3_id(int id) {
  * Get status message 4 by index.
  *
  * @param index
- * Index in the array
+ * Index in the node table. Nodes that did not send this message have id -1
+ * in it, so there can be gaps.
  *
  * @return
  * The message or 0 for an invalid index.
  */
 can_status_msg_4 *comm_can_get_status_msg_4_index(int index) {
-	if (index < CAN_STATUS_MSGS_TO_STORE) {
-		return &stat_msgs_4[index];
+	if (index >= 0 && index < CAN_STATUS_MSGS_TO_STORE) {
+		return &nodes[index].status_4;
 	} else {
 		return 0;
 	}
@@ -964,10 +1339,9 @@ can_status_msg_4 *comm_can_get_status_msg_4_index(int index) {
  * The message or 0 for an invalid id.
  */
 can_status_msg_4 *comm_can_get_status_msg_4_id(int id) {
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (stat_msgs_4[i].id == id) {
-			return &stat_msgs_4[i];
-		}
+	can_node *node = node_get(id);
+	if (node && node->status_4.id >= 0) {
+		return &node->status_4;
 	}
 
 	return 0;
@@ -977,14 +1351,15 @@ can_status_msg_4 *comm_can_get_status_msg_4_id(int id) {
  * Get status message 5 by index.
  *
  * @param index
- * Index in the array
+ * Index in the node table. Nodes that did not send this message have id -1
+ * in it, so there can be gaps.
  *
  * @return
  * The message or 0 for an invalid index.
  */
 can_status_msg_5 *comm_can_get_status_msg_5_index(int index) {
-	if (index < CAN_STATUS_MSGS_TO_STORE) {
-		return &stat_msgs_5[index];
+	if (index >= 0 && index < CAN_STATUS_MSGS_TO_STORE) {
+		return &nodes[index].status_5;
 	} else {
 		return 0;
 	}
@@ -1000,10 +1375,9 @@ can_status_msg_5 *comm_can_get_status_msg_5_index(int index) {
  * The message or 0 for an invalid id.
  */
 can_status_msg_5 *comm_can_get_status_msg_5_id(int id) {
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (stat_msgs_5[i].id == id) {
-			return &stat_msgs_5[i];
-		}
+	can_node *node = node_get(id);
+	if (node && node->status_5.id >= 0) {
+		return &node->status_5;
 	}
 
 	return 0;
@@ -1013,14 +1387,15 @@ can_status_msg_5 *comm_can_get_status_msg_5_id(int id) {
  * Get status message 6 by index.
  *
  * @param index
- * Index in the array
+ * Index in the node table. Nodes that did not send this message have id -1
+ * in it, so there can be gaps.
  *
  * @return
  * The message or 0 for an invalid index.
  */
 can_status_msg_6 *comm_can_get_status_msg_6_index(int index) {
-	if (index < CAN_STATUS_MSGS_TO_STORE) {
-		return &stat_msgs_6[index];
+	if (index >= 0 && index < CAN_STATUS_MSGS_TO_STORE) {
+		return &nodes[index].status_6;
 	} else {
 		return 0;
 	}
@@ -1036,76 +1411,96 @@ can_status_msg_6 *comm_can_get_status_msg_6_index(int index) {
  * The message or 0 for an invalid id.
  */
 can_status_msg_6 *comm_can_get_status_msg_6_id(int id) {
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (stat_msgs_6[i].id == id) {
-			return &stat_msgs_6[i];
-		}
+	can_node *node = node_get(id);
+	if (node && node->status_6.id >= 0) {
+		return &node->status_6;
 	}
 
 	return 0;
 }
 
 io_board_adc_values *comm_can_get_io_board_adc_1_4_index(int index) {
-	if (index < CAN_STATUS_MSGS_TO_STORE && io_board_adc_1_4[index].id >= 0) {
-		return &io_board_adc_1_4[index];
+	if (index >= 0 && index < CAN_STATUS_MSGS_TO_STORE && nodes[index].io_board_adc_1_4.id >= 0) {
+		return &nodes[index].io_board_adc_1_4;
 	} else {
 		return 0;
 	}
 }
 
+/*
+ * id 255 gives the first IO-board in the table.
+ */
 io_board_adc_values *comm_can_get_io_board_adc_1_4_id(int id) {
-	if (id == 255 && io_board_adc_1_4[0].id >= 0) {
-		return &io_board_adc_1_4[0];
+	if (id == 255) {
+		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
+			if (nodes[i].io_board_adc_1_4.id >= 0) {
+				return &nodes[i].io_board_adc_1_4;
+			}
+		}
+		return 0;
 	}
 
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (io_board_adc_1_4[i].id == id) {
-			return &io_board_adc_1_4[i];
-		}
+	can_node *node = node_get(id);
+	if (node && node->io_board_adc_1_4.id >= 0) {
+		return &node->io_board_adc_1_4;
 	}
 
 	return 0;
 }
 
 io_board_adc_values *comm_can_get_io_board_adc_5_8_index(int index) {
-	if (index < CAN_STATUS_MSGS_TO_STORE && io_board_adc_5_8[index].id >= 0) {
-		return &io_board_adc_5_8[index];
+	if (index >= 0 && index < CAN_STATUS_MSGS_TO_STORE && nodes[index].io_board_adc_5_8.id >= 0) {
+		return &nodes[index].io_board_adc_5_8;
 	} else {
 		return 0;
 	}
 }
 
+/*
+ * id 255 gives the first IO-board in the table.
+ */
 io_board_adc_values *comm_can_get_io_board_adc_5_8_id(int id) {
-	if (id == 255 && io_board_adc_5_8[0].id >= 0) {
-		return &io_board_adc_5_8[0];
+	if (id == 255) {
+		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
+			if (nodes[i].io_board_adc_5_8.id >= 0) {
+				return &nodes[i].io_board_adc_5_8;
+			}
+		}
+		return 0;
 	}
 
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (io_board_adc_5_8[i].id == id) {
-			return &io_board_adc_5_8[i];
-		}
+	can_node *node = node_get(id);
+	if (node && node->io_board_adc_5_8.id >= 0) {
+		return &node->io_board_adc_5_8;
 	}
 
 	return 0;
 }
 
 io_board_digial_inputs *comm_can_get_io_board_digital_in_index(int index) {
-	if (index < CAN_STATUS_MSGS_TO_STORE) {
-		return &io_board_digital_in[index];
+	if (index >= 0 && index < CAN_STATUS_MSGS_TO_STORE) {
+		return &nodes[index].io_board_digital_in;
 	} else {
 		return 0;
 	}
 }
 
+/*
+ * id 255 gives the first IO-board in the table.
+ */
 io_board_digial_inputs *comm_can_get_io_board_digital_in_id(int id) {
-	if (id == 255 && io_board_digital_in[0].id >= 0) {
-		return &io_board_digital_in[0];
+	if (id == 255) {
+		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
+			if (nodes[i].io_board_digital_in.id >= 0) {
+				return &nodes[i].io_board_digital_in;
+			}
+		}
+		return 0;
 	}
 
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (io_board_digital_in[i].id == id) {
-			return &io_board_digital_in[i];
-		}
+	can_node *node = node_get(id);
+	if (node && node->io_board_digital_in.id >= 0) {
+		return &node->io_board_digital_in;
 	}
 
 	return 0;
@@ -1135,18 +1530,17 @@ void comm_can_io_board_set_output_pwm(int id, int channel, float duty) {
 }
 
 psw_status *comm_can_get_psw_status_index(int index) {
-	if (index < CAN_STATUS_MSGS_TO_STORE) {
-		return &psw_stat[index];
+	if (index >= 0 && index < CAN_STATUS_MSGS_TO_STORE) {
+		return &nodes[index].psw_stat;
 	} else {
 		return 0;
 	}
 }
 
 psw_status *comm_can_get_psw_status_id(int id) {
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (psw_stat[i].id == id) {
-			return &psw_stat[i];
-		}
+	can_node *node = node_get(id);
+	if (node && node->psw_stat.id >= 0) {
+		return &node->psw_stat;
 	}
 
 	return 0;
@@ -1175,37 +1569,42 @@ void comm_can_update_pid_pos_offset(int id, float angle_now, bool store) {
 }
 
 /*
- * Get frame from RX buffer. Interface is the CAN-interface to read from. If
- * no frames are available NULL is returned.
+ * Get frame from RX buffer. Interface is the CAN-interface to read from. The
+ * frame is copied to frame, and false is returned if no frames are available.
+ * Only one consumer may read at a time, which is the process thread, or the
+ * UAVCAN driver in UAVCAN mode.
  *
  * Interface: 0: Any interface, 1: CAN1, 2: CAN2
  */
-CANRxFrame *comm_can_get_rx_frame(int interface) {
-	CANRxFrame *res = NULL;
-
+bool comm_can_get_rx_frame(int interface, CANRxFrame *frame) {
 #if CAN_ENABLE
-	chMtxLock(&can_rx_mtx);
-	if (!res && interface != 2) {
-		if (m_rx_state.frame_read != m_rx_state.frame_write) {
-			res = &m_rx_state.rx_frames[m_rx_state.frame_read++];
+	return rx_get(interface, frame, 0);
+#else
+	(void)interface;
+	(void)frame;
+	return false;
+#endif
+}
 
-			if (m_rx_state.frame_read == RX_FRAMES_SIZE) {
-				m_rx_state.frame_read = 0;
-			}
-		}
+/**
+ * Get the receive statistics of a CAN-interface.
+ *
+ * @param interface
+ * 1: CAN1, 2: CAN2
+ */
+can_rx_stats comm_can_get_rx_stats(int interface) {
+	can_rx_stats res;
+	memset(&res, 0, sizeof(res));
+
+#if CAN_ENABLE
+	if (interface == 1) {
+		res = m_rx_state.stats;
 	}
 #ifdef HW_CAN2_DEV
-	if (!res && interface != 1) {
-		if (m_rx_state2.frame_read != m_rx_state2.frame_write) {
-			res = &m_rx_state2.rx_frames[m_rx_state2.frame_read++];
-
-			if (m_rx_state2.frame_read == RX_FRAMES_SIZE) {
-				m_rx_state2.frame_read = 0;
-			}
-		}
+	if (interface == 2) {
+		res = m_rx_state2.stats;
 	}
 #endif
-	chMtxUnlock(&can_rx_mtx);
 #else
 	(void)interface;
 #endif
@@ -1213,64 +1612,92 @@ CANRxFrame *comm_can_get_rx_frame(int interface) {
 	return res;
 }
 
+/**
+ * @return
+ * true if the hardware filters only let the frames this VESC decodes
+ * through, false if they accept everything.
+ */
+bool comm_can_rx_filter_active(void) {
+#if CAN_ENABLE
+	return !rx_filter_all;
+#else
+	return false;
+#endif
+}
+
+can_xfer_stats_t comm_can_get_xfer_stats(void) {
+#if CAN_ENABLE
+	return m_xfer.stats;
+#else
+	can_xfer_stats_t res;
+	memset(&res, 0, sizeof(res));
+	return res;
+#endif
+}
+
+/**
+ * Get the CAN-FD buffer statistics.
+ *
+ * @param rx_overflows
+ * FD frames dropped as the process thread was behind, can be 0.
+ */
+can_fd_stats_t comm_can_get_fd_stats(uint32_t *rx_overflows) {
+	can_fd_stats_t res;
+	memset(&res, 0, sizeof(res));
+	uint32_t overflows = 0;
+
+#if CAN_ENABLE && defined(HW_HAS_CAN_FD)
+	chMtxLock(&fd_mtx);
+	res = m_fd.stats;
+	chMtxUnlock(&fd_mtx);
+	overflows = fd_rx_overflows;
+#endif
+
+	if (rx_overflows) {
+		*rx_overflows = overflows;
+	}
+
+	return res;
+}
+
 void comm_can_send_status1(uint8_t id, bool replace) {
-	int32_t send_index = 0;
-	uint8_t buffer[8];
-	buffer_append_int32(buffer, (int32_t)mc_interface_get_rpm(), &send_index);
-	buffer_append_int16(buffer, (int16_t)(mc_interface_get_tot_current_filtered() * 1e1), &send_index);
-	buffer_append_int16(buffer, (int16_t)(mc_interface_get_duty_cycle_now() * 1e3), &send_index);
-	comm_can_transmit_eid_replace(id | ((uint32_t)CAN_PACKET_STATUS << 8),
-			buffer, send_index, replace, 0);
+	send_status(0, id, replace);
 }
 
 void comm_can_send_status2(uint8_t id, bool replace) {
-	int32_t send_index = 0;
-	uint8_t buffer[8];
-	buffer_append_int32(buffer, (int32_t)(mc_interface_get_amp_hours(false) * 1e4), &send_index);
-	buffer_append_int32(buffer, (int32_t)(mc_interface_get_amp_hours_charged(false) * 1e4), &send_index);
-	comm_can_transmit_eid_replace(id | ((uint32_t)CAN_PACKET_STATUS_2 << 8),
-			buffer, send_index, replace, 0);
+	send_status(1, id, replace);
 }
 
 void comm_can_send_status3(uint8_t id, bool replace) {
-	int32_t send_index = 0;
-	uint8_t buffer[8];
-	buffer_append_int32(buffer, (int32_t)(mc_interface_get_watt_hours(false) * 1e4), &send_index);
-	buffer_append_int32(buffer, (int32_t)(mc_interface_get_watt_hours_charged(false) * 1e4), &send_index);
-	comm_can_transmit_eid_replace(id | ((uint32_t)CAN_PACKET_STATUS_3 << 8),
-			buffer, send_index, replace, 0);
+	send_status(2, id, replace);
 }
 
 void comm_can_send_status4(uint8_t id, bool replace) {
-	int32_t send_index = 0;
-	uint8_t buffer[8];
-	buffer_append_int16(buffer, (int16_t)(mc_interface_temp_fet_filtered() * 1e1), &send_index);
-	buffer_append_int16(buffer, (int16_t)(mc_interface_temp_motor_filtered() * 1e1), &send_index);
-	buffer_append_int16(buffer, (int16_t)(mc_interface_get_tot_current_in_filtered() * 1e1), &send_index);
-	buffer_append_int16(buffer, (int16_t)(mc_interface_get_pid_pos_now() * 50.0), &send_index);
-	comm_can_transmit_eid_replace(id | ((uint32_t)CAN_PACKET_STATUS_4 << 8),
-			buffer, send_index, replace, 0);
+	send_status(3, id, replace);
 }
 
 void comm_can_send_status5(uint8_t id, bool replace) {
-	int32_t send_index = 0;
-	uint8_t buffer[8];
-	buffer_append_int32(buffer, mc_interface_get_tachometer_value(false), &send_index);
-	buffer_append_int16(buffer, (int16_t)(mc_interface_get_input_voltage_filtered() * 1e1), &send_index);
-	buffer_append_int16(buffer, 0, &send_index); // Reserved for now
-	comm_can_transmit_eid_replace(id | ((uint32_t)CAN_PACKET_STATUS_5 << 8),
-			buffer, send_index, replace, 0);
+	send_status(4, id, replace);
 }
 
 void comm_can_send_status6(uint8_t id, bool replace) {
-	int32_t send_index = 0;
-	uint8_t buffer[8];
-	buffer_append_float16(buffer, ADC_VOLTS(ADC_IND_EXT), 1e3, &send_index);
-	buffer_append_float16(buffer, ADC_VOLTS(ADC_IND_EXT2), 1e3, &send_index);
-	buffer_append_float16(buffer, ADC_VOLTS(ADC_IND_EXT3), 1e3, &send_index);
-	buffer_append_float16(buffer, servodec_get_servo(0), 1e3, &send_index);
-	comm_can_transmit_eid_replace(id | ((uint32_t)CAN_PACKET_STATUS_6 << 8),
-			buffer, send_index, replace, 0);
+	send_status(5, id, replace);
+}
+
+/**
+ * Get the statistics of the status message scheduler.
+ */
+can_pub_stats_t comm_can_get_status_pub_stats(void) {
+#if CAN_ENABLE
+	chMtxLock(&pub_mtx);
+	can_pub_stats_t res = m_pub.stats;
+	chMtxUnlock(&pub_mtx);
+	return res;
+#else
+	can_pub_stats_t res;
+	memset(&res, 0, sizeof(res));
+	return res;
+#endif
 }
 
 #if CAN_ENABLE
@@ -1279,7 +1706,6 @@ static THD_FUNCTION(cancom_read_thread, arg) {
 	chRegSetThreadName("CAN read");
 
 	event_listener_t el;
-	CANRxFrame rxmsg;
 
 	chEvtRegister(&HW_CAN_DEV.rxfull_event, &el, 0);
 #ifdef HW_CAN2_DEV
@@ -1290,41 +1716,16 @@ static THD_FUNCTION(cancom_read_thread, arg) {
 	while(!chThdShouldTerminateX()) {
 		// Feed watchdog
 		timeout_feed_WDT(THREAD_CANBUS);
-        
-		if (chEvtWaitAnyTimeout(ALL_EVENTS, MS2ST(10)) == 0) {
-			continue;
-		}
-
-		msg_t result = canReceive(&HW_CAN_DEV, CAN_ANY_MAILBOX, &rxmsg, TIME_IMMEDIATE);
-
-		while (result == MSG_OK) {
-			chMtxLock(&can_rx_mtx);
-			m_rx_state.rx_frames[m_rx_state.frame_write++] = rxmsg;
-			if (m_rx_state.frame_write == RX_FRAMES_SIZE) {
-				m_rx_state.frame_write = 0;
-			}
-			chMtxUnlock(&can_rx_mtx);
 
-			chEvtSignal(process_tp, (eventmask_t) 1);
+		rx_filter_update();
 
-			result = canReceive(&HW_CAN_DEV, CAN_ANY_MAILBOX, &rxmsg, TIME_IMMEDIATE);
+		if (chEvtWaitAnyTimeout(ALL_EVENTS, MS2ST(10)) == 0) {
+			continue;
 		}
 
+		rx_receive(&HW_CAN_DEV, &m_rx_state);
 #ifdef HW_CAN2_DEV
-		result = canReceive(&HW_CAN2_DEV, CAN_ANY_MAILBOX, &rxmsg, TIME_IMMEDIATE);
-
-		while (result == MSG_OK) {
-			chMtxLock(&can_rx_mtx);
-			m_rx_state2.rx_frames[m_rx_state2.frame_write++] = rxmsg;
-			if (m_rx_state2.frame_write == RX_FRAMES_SIZE) {
-				m_rx_state2.frame_write = 0;
-			}
-			chMtxUnlock(&can_rx_mtx);
-
-			chEvtSignal(process_tp, (eventmask_t) 1);
-
-			result = canReceive(&HW_CAN2_DEV, CAN_ANY_MAILBOX, &rxmsg, TIME_IMMEDIATE);
-		}
+		rx_receive(&HW_CAN2_DEV, &m_rx_state2);
 #endif
 	}
 
@@ -1341,16 +1742,15 @@ static THD_FUNCTION(cancom_process_thread, arg) {
 	process_tp = chThdGetSelfX();
 
 	for(;;) {
-		chEvtWaitAny((eventmask_t)1);
+		// Woken up by frames, and regularly for the transfer timeouts
+		chEvtWaitAnyTimeout((eventmask_t)1, MS2ST(5));
 
 		if (app_get_configuration()->can_mode == CAN_MODE_UAVCAN) {
 			continue;
 		} else if (app_get_configuration()->can_mode == CAN_MODE_COMM_BRIDGE ||
 				app_get_configuration()->can_mode == CAN_MODE_UNUSED) {
-			CANRxFrame *rxmsg_tmp;
-			while ((rxmsg_tmp = comm_can_get_rx_frame(0)) != 0) {
-				CANRxFrame rxmsg = *rxmsg_tmp;
-
+			CANRxFrame rxmsg;
+			while (comm_can_get_rx_frame(0, &rxmsg)) {
 				if (app_get_configuration()->can_mode == CAN_MODE_COMM_BRIDGE) {
 					commands_fwd_can_frame(rxmsg.DLC, rxmsg.data8,
 							rxmsg.IDE == CAN_IDE_EXT ? rxmsg.EID : rxmsg.SID,
@@ -1386,11 +1786,29 @@ static THD_FUNCTION(cancom_process_thread, arg) {
 			continue;
 		}
 
-		CANRxFrame *rxmsg_tmp;
-		while ((rxmsg_tmp = comm_can_get_rx_frame(0)) != 0) {
-			CANRxFrame rxmsg = *rxmsg_tmp;
+		if (xfer_support_reset) {
+			xfer_support_reset = false;
+			memset(xfer_support, 0, sizeof(xfer_support));
+		}
+
+		xfer_poll();
+#ifdef HW_HAS_CAN_FD
+		fd_rx_process();
+#endif
 
+		CANRxFrame rxmsg;
+		bool decoded;
+		while (rx_get(0, &rxmsg, &decoded)) {
 			if (rxmsg.IDE == CAN_IDE_EXT) {
+				if (decoded) {
+					// A control command applied by the read thread. That is only
+					// done without an EID callback, and the BMS does not use them.
+#ifdef USE_LISPBM
+					lispif_process_can(rxmsg.EID, rxmsg.data8, rxmsg.DLC, true);
+#endif
+					continue;
+				}
+
 				bool eid_cb_used = false;
 				if (eid_callback) {
 					eid_cb_used = eid_callback(rxmsg.EID, rxmsg.data8, rxmsg.DLC);
@@ -1447,60 +1865,82 @@ static THD_FUNCTION(cancom_status_internal_thread, arg) {
 }
 #endif
 
-static void send_can_status(uint8_t msgs, uint8_t id) {
-	if ((msgs >> 0) & 1) {
-		mc_interface_select_motor_thread(1);
-		comm_can_send_status1(id, false);
-#ifdef HW_HAS_DUAL_MOTORS
-		mc_interface_select_motor_thread(2);
-		comm_can_send_status1(utils_second_motor_id(), false);
-#endif
+/*
+ * Send the enabled status messages. With can_status_on_change the publish
+ * scheduler only lets the ones through that changed or are due for a
+ * refresh, otherwise all of them are sent every time.
+ *
+ * period: Time until the next call [s]
+ */
+static void send_can_status(uint8_t msgs, uint8_t id, float period) {
+	const app_configuration *conf = app_get_configuration();
+	const bool on_change = conf->can_status_on_change;
+
+	if (on_change) {
+		float share = conf->can_status_budget;
+		utils_truncate_number(&share, 0.0, 1.0);
+
+		chMtxLock(&pub_mtx);
+		comm_can_pub_set_budget(&m_pub, share *
+				(float)comm_can_baud_to_kbits(conf->can_baud_rate) * 1000.0);
+		chMtxUnlock(&pub_mtx);
 	}
 
-	if ((msgs >> 1) & 1) {
-		mc_interface_select_motor_thread(1);
-		comm_can_send_status2(id, false);
+	mc_interface_select_motor_thread(1);
+	publish_status(msgs, 0, id, period, on_change);
 #ifdef HW_HAS_DUAL_MOTORS
-		mc_interface_select_motor_thread(2);
-		comm_can_send_status2(utils_second_motor_id(), false);
+	mc_interface_select_motor_thread(2);
+	publish_status(msgs, 1, utils_second_motor_id(), period, on_change);
 #endif
-	}
+}
 
-	if ((msgs >> 2) & 1) {
-		mc_interface_select_motor_thread(1);
-		comm_can_send_status3(id, false);
-#ifdef HW_HAS_DUAL_MOTORS
-		mc_interface_select_motor_thread(2);
-		comm_can_send_status3(utils_second_motor_id(), false);
+/*
+ * Send the messages of one motor that are due. With CAN-FD they go out
+ * together in one CAN_PACKET_STATUS_FD frame.
+ */
+static void publish_status(uint8_t msgs, int src, uint8_t id, float period, bool on_change) {
+#ifdef HW_HAS_CAN_FD
+	const bool fd = fd_enabled;
+	uint8_t fd_status[CAN_FD_STATUS_MSGS][CAN_FD_STATUS_MSG_LEN];
+	uint8_t fd_mask = 0;
 #endif
-	}
 
-	if ((msgs >> 3) & 1) {
-		mc_interface_select_motor_thread(1);
-		comm_can_send_status4(id, false);
-#ifdef HW_HAS_DUAL_MOTORS
-		mc_interface_select_motor_thread(2);
-		comm_can_send_status4(utils_second_motor_id(), false);
-#endif
-	}
+	for (int i = 0;i < CAN_PUB_MSGS;i++) {
+		if (!((msgs >> i) & 1)) {
+			continue;
+		}
 
-	if ((msgs >> 4) & 1) {
-		mc_interface_select_motor_thread(1);
-		comm_can_send_status5(id, false);
-#ifdef HW_HAS_DUAL_MOTORS
-		mc_interface_select_motor_thread(2);
-		comm_can_send_status5(utils_second_motor_id(), false);
+		int32_t value[CAN_PUB_FIELDS];
+		status_values(i, value);
+
+		if (on_change) {
+			chMtxLock(&pub_mtx);
+			bool send = comm_can_pub_check(&m_pub, src, i, value, period, time_us(0));
+			chMtxUnlock(&pub_mtx);
+
+			if (!send) {
+				continue;
+			}
+		}
+
+#ifdef HW_HAS_CAN_FD
+		if (fd) {
+			status_pack(i, value, fd_status[i]);
+			fd_mask |= 1 << i;
+			continue;
+		}
 #endif
+
+		status_transmit(i, id, value, false);
 	}
 
-	if ((msgs >> 5) & 1) {
-		mc_interface_select_motor_thread(1);
-		comm_can_send_status6(id, false);
-#ifdef HW_HAS_DUAL_MOTORS
-		mc_interface_select_motor_thread(2);
-		comm_can_send_status6(utils_second_motor_id(), false);
-#endif
+#ifdef HW_HAS_CAN_FD
+	if (fd_mask) {
+		uint8_t frame[CAN_FD_FRAME_LEN];
+		const unsigned int len = comm_can_fd_status_pack(frame, fd_mask, fd_status);
+		comm_can_transmit_eid_fd(id | ((uint32_t)CAN_PACKET_STATUS_FD << 8), frame, len);
 	}
+#endif
 }
 
 static THD_FUNCTION(cancom_status_thread, arg) {
@@ -1511,7 +1951,8 @@ static THD_FUNCTION(cancom_status_thread, arg) {
 		const app_configuration *conf = app_get_configuration();
 
 		if (conf->can_mode == CAN_MODE_VESC) {
-			send_can_status(conf->can_status_msgs_r1, conf->controller_id);
+			send_can_status(conf->can_status_msgs_r1, conf->controller_id,
+					conf->can_status_rate_1 > 0 ? 1.0 / (float)conf->can_status_rate_1 : 0.0);
 		}
 
 		while (conf->can_status_rate_1 == 0) {
@@ -1536,7 +1977,8 @@ static THD_FUNCTION(cancom_status_thread_2, arg) {
 		const app_configuration *conf = app_get_configuration();
 
 		if (conf->can_mode == CAN_MODE_VESC) {
-			send_can_status(conf->can_status_msgs_r2, conf->controller_id);
+			send_can_status(conf->can_status_msgs_r2, conf->controller_id,
+					conf->can_status_rate_2 > 0 ? 1.0 / (float)conf->can_status_rate_2 : 0.0);
 		}
 
 		while (conf->can_status_rate_2 == 0) {
@@ -1557,6 +1999,53 @@ static void send_packet_wrapper(unsigned char *data, unsigned int len) {
 	comm_can_send_buffer(rx_buffer_last_id, data, len, rx_buffer_response_type);
 }
 
+/*
+ * Process a complete buffer from the legacy or the windowed transport.
+ *
+ * @param last_id
+ * ID of the sender, where the answers of commands go.
+ *
+ * @param commands_send
+ * Send mode, as in comm_can_send_buffer.
+ */
+static void process_buffer(unsigned int last_id, uint8_t commands_send,
+		unsigned char *data, unsigned int len, bool is_replaced) {
+	if (commands_send == 0 || commands_send == 3) {
+		rx_buffer_last_id = last_id;
+	}
+
+	if (commands_send == 3) {
+		rx_buffer_response_type = 0;
+	} else {
+		rx_buffer_response_type = 1;
+	}
+
+	if (is_replaced) {
+		if (data[0] == COMM_JUMP_TO_BOOTLOADER ||
+				data[0] == COMM_ERASE_NEW_APP ||
+				data[0] == COMM_WRITE_NEW_APP_DATA ||
+				data[0] == COMM_WRITE_NEW_APP_DATA_LZO ||
+				data[0] == COMM_ERASE_BOOTLOADER) {
+			return;
+		}
+	}
+
+	switch (commands_send) {
+	case 0:
+	case 3:
+		commands_process_packet(data, len, send_packet_wrapper);
+		break;
+	case 1:
+		commands_send_packet_can_last(data, len);
+		break;
+	case 2:
+		commands_process_packet(data, len, 0);
+		break;
+	default:
+		break;
+	}
+}
+
 static void decode_msg(uint32_t eid, uint8_t *data8, int len, bool is_replaced) {
 	int32_t ind = 0;
 	uint8_t crc_low;
@@ -1580,43 +2069,31 @@ static void decode_msg(uint32_t eid, uint8_t *data8, int len, bool is_replaced)
 	int id2 = id1;
 #endif
 
+	if (comm_can_xfer_is_frame(eid)) {
+		if (!is_replaced && (id == id1 || id == id2)) {
+			xfer_decode(eid, data8, len);
+		}
+
+#ifdef HW_HAS_DUAL_MOTORS
+		mc_interface_select_motor_thread(motor_last);
+#endif
+		return;
+	}
+
 	// The packets here are addressed to this VESC or to all VESCs (id=255)
 
 	if (id == 255 || id == id1 || id == id2) {
 		switch (cmd) {
 		case CAN_PACKET_SET_DUTY:
-			ind = 0;
-			mc_interface_set_duty(buffer_get_float32(data8, 1e5, &ind));
-			timeout_reset();
-			break;
-
 		case CAN_PACKET_SET_CURRENT:
-			ind = 0;
-			if (len >= 6) {
-				mc_interface_set_current_off_delay(buffer_get_float16(data8, 1e3, &ind));
-			}
-
-			mc_interface_set_current(buffer_get_float32(data8, 1e3, &ind));
-
-			timeout_reset();
-			break;
-
 		case CAN_PACKET_SET_CURRENT_BRAKE:
-			ind = 0;
-			mc_interface_set_brake_current(buffer_get_float32(data8, 1e3, &ind));
-			timeout_reset();
-			break;
-
 		case CAN_PACKET_SET_RPM:
-			ind = 0;
-			mc_interface_set_pid_speed(buffer_get_float32(data8, 1e0, &ind));
-			timeout_reset();
-			break;
-
 		case CAN_PACKET_SET_POS:
-			ind = 0;
-			mc_interface_set_pid_pos(buffer_get_float32(data8, 1e6, &ind));
-			timeout_reset();
+		case CAN_PACKET_SET_CURRENT_REL:
+		case CAN_PACKET_SET_CURRENT_BRAKE_REL:
+		case CAN_PACKET_SET_CURRENT_HANDBRAKE:
+		case CAN_PACKET_SET_CURRENT_HANDBRAKE_REL:
+			decode_control(cmd, data8, len);
 			break;
 
 		case CAN_PACKET_FILL_RX_BUFFER: {
@@ -1677,16 +2154,6 @@ static void decode_msg(uint32_t eid, uint8_t *data8, int len, bool is_replaced)
 			unsigned int last_id = data8[ind++];
 			commands_send = data8[ind++];
 
-			if (commands_send == 0 || commands_send == 3) {
-				rx_buffer_last_id = last_id;
-			}
-
-			if (commands_send == 3) {
-				rx_buffer_response_type = 0;
-			} else {
-				rx_buffer_response_type = 1;
-			}
-
 			int rxbuf_len = (int)data8[ind++] << 8;
 			rxbuf_len |= (int)data8[ind++];
 
@@ -1718,31 +2185,7 @@ static void decode_msg(uint32_t eid, uint8_t *data8, int len, bool is_replaced)
 			if (crc16(rx_buffer[buf_ind], rxbuf_len)
 					== ((unsigned short) crc_high << 8
 							| (unsigned short) crc_low)) {
-
-				if (is_replaced) {
-					if (rx_buffer[buf_ind][0] == COMM_JUMP_TO_BOOTLOADER ||
-							rx_buffer[buf_ind][0] == COMM_ERASE_NEW_APP ||
-							rx_buffer[buf_ind][0] == COMM_WRITE_NEW_APP_DATA ||
-							rx_buffer[buf_ind][0] == COMM_WRITE_NEW_APP_DATA_LZO ||
-							rx_buffer[buf_ind][0] == COMM_ERASE_BOOTLOADER) {
-						break;
-					}
-				}
-
-				switch (commands_send) {
-				case 0:
-				case 3:
-					commands_process_packet(rx_buffer[buf_ind], rxbuf_len, send_packet_wrapper);
-					break;
-				case 1:
-					commands_send_packet_can_last(rx_buffer[buf_ind], rxbuf_len);
-					break;
-				case 2:
-					commands_process_packet(rx_buffer[buf_ind], rxbuf_len, 0);
-					break;
-				default:
-					break;
-				}
+				process_buffer(last_id, commands_send, rx_buffer[buf_ind], rxbuf_len, is_replaced);
 			}
 		} break;
 
@@ -1750,81 +2193,42 @@ static void decode_msg(uint32_t eid, uint8_t *data8, int len, bool is_replaced)
 			ind = 0;
 			unsigned int last_id = data8[ind++];
 			commands_send = data8[ind++];
-
-			if (commands_send == 0 || commands_send == 3) {
-				rx_buffer_last_id = last_id;
-			}
-
-			if (commands_send == 3) {
-				rx_buffer_response_type = 0;
-			} else {
-				rx_buffer_response_type = 1;
-			}
-
-			if (is_replaced) {
-				if (data8[ind] == COMM_JUMP_TO_BOOTLOADER ||
-						data8[ind] == COMM_ERASE_NEW_APP ||
-						data8[ind] == COMM_WRITE_NEW_APP_DATA ||
-						data8[ind] == COMM_WRITE_NEW_APP_DATA_LZO ||
-						data8[ind] == COMM_ERASE_BOOTLOADER) {
-					break;
-				}
-			}
-
-			switch (commands_send) {
-			case 0:
-			case 3:
-				commands_process_packet(data8 + ind, len - ind, send_packet_wrapper);
-				break;
-			case 1:
-				commands_send_packet_can_last(data8 + ind, len - ind);
-				break;
-			case 2:
-				commands_process_packet(data8 + ind, len - ind, 0);
-				break;
-			default:
-				break;
-			}
+			process_buffer(last_id, commands_send, data8 + ind, len - ind, is_replaced);
 		} break;
 
-		case CAN_PACKET_SET_CURRENT_REL:
-			ind = 0;
-			mc_interface_set_current_rel(buffer_get_float32(data8, 1e5, &ind));
-
-			if (len >= 6) {
-				mc_interface_set_current_off_delay(buffer_get_float16(data8, 1e3, &ind));
+#ifdef HW_HAS_CAN_FD
+		case CAN_PACKET_BUFFER_FD:
+			if (!is_replaced && id != 255 && len > 0) {
+				// Only nodes that decode FD packets send them
+				fd_support[data8[0]] = true;
+				comm_can_fd_rx_frame(&m_fd, eid, data8, len);
 			}
-
-			timeout_reset();
-			break;
-
-		case CAN_PACKET_SET_CURRENT_BRAKE_REL:
-			ind = 0;
-			mc_interface_set_brake_current_rel(buffer_get_float32(data8, 1e5, &ind));
-			timeout_reset();
-			break;
-
-		case CAN_PACKET_SET_CURRENT_HANDBRAKE:
-			ind = 0;
-			mc_interface_set_handbrake(buffer_get_float32(data8, 1e3, &ind));
-			timeout_reset();
-			break;
-
-		case CAN_PACKET_SET_CURRENT_HANDBRAKE_REL:
-			ind = 0;
-			mc_interface_set_handbrake_rel(buffer_get_float32(data8, 1e5, &ind));
-			timeout_reset();
 			break;
+#endif
 
 		case CAN_PACKET_PING: {
-			uint8_t buffer[2];
+			// The third byte tells that windowed buffer transfers are supported
+			uint8_t buffer[3];
 			buffer[0] = is_replaced ? utils_second_motor_id() : id;
 			buffer[1] = HW_TYPE_VESC;
+			buffer[2] = CAN_XFER_PONG_CAP;
+#ifdef HW_HAS_CAN_FD
+			if (fd_enabled) {
+				buffer[2] |= CAN_FD_PONG_CAP;
+			}
+#endif
 			comm_can_transmit_eid_replace(data8[0] |
-					((uint32_t)CAN_PACKET_PONG << 8), buffer, 2, true, 0);
+					((uint32_t)CAN_PACKET_PONG << 8), buffer, 3, true, 0);
 		} break;
 
 		case CAN_PACKET_PONG:
+			// Older firmware answers with two bytes
+			xfer_support[data8[0]] = (len >= 3 && (data8[2] & CAN_XFER_PONG_CAP)) ?
+					XFER_SUPPORT_YES : XFER_SUPPORT_NO;
+#ifdef HW_HAS_CAN_FD
+			fd_support[data8[0]] = len >= 3 && (data8[2] & CAN_FD_PONG_CAP);
+#endif
+
 			if (ping_tp && ping_hw_last_id == data8[0]) {
 				if (len >= 2) {
 					ping_hw_last = data8[1];
@@ -2012,165 +2416,171 @@ static void decode_msg(uint32_t eid, uint8_t *data8, int len, bool is_replaced)
 	// The packets below are addressed to all devices, mainly containing status information.
 
 	switch (cmd) {
-	case CAN_PACKET_STATUS:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			can_status_msg *stat_tmp = &stat_msgs[i];
-			if (stat_tmp->id == id || stat_tmp->id == -1) {
-				ind = 0;
-				stat_tmp->id = id;
-				stat_tmp->rx_time = chVTGetSystemTimeX();
-				stat_tmp->rpm = (float)buffer_get_int32(data8, &ind);
-				stat_tmp->current = (float)buffer_get_int16(data8, &ind) / 10.0;
-				stat_tmp->duty = (float)buffer_get_int16(data8, &ind) / 1000.0;
-				break;
-			}
-		}
+#ifdef HW_HAS_CAN_FD
+	case CAN_PACKET_STATUS_FD:
+		fd_decode_status(id, data8, len);
 		break;
+#endif
 
-	case CAN_PACKET_STATUS_2:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			can_status_msg_2 *stat_tmp_2 = &stat_msgs_2[i];
-			if (stat_tmp_2->id == id || stat_tmp_2->id == -1) {
-				ind = 0;
-				stat_tmp_2->id = id;
-				stat_tmp_2->rx_time = chVTGetSystemTimeX();
-				stat_tmp_2->amp_hours = (float)buffer_get_int32(data8, &ind) / 1e4;
-				stat_tmp_2->amp_hours_charged = (float)buffer_get_int32(data8, &ind) / 1e4;
-				break;
-			}
+	case CAN_PACKET_STATUS: {
+		can_node *node = node_add(id);
+		if (!node) {
+			break;
 		}
-		break;
 
-	case CAN_PACKET_STATUS_3:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			can_status_msg_3 *stat_tmp_3 = &stat_msgs_3[i];
-			if (stat_tmp_3->id == id || stat_tmp_3->id == -1) {
-				ind = 0;
-				stat_tmp_3->id = id;
-				stat_tmp_3->rx_time = chVTGetSystemTimeX();
-				stat_tmp_3->watt_hours = (float)buffer_get_int32(data8, &ind) / 1e4;
-				stat_tmp_3->watt_hours_charged = (float)buffer_get_int32(data8, &ind) / 1e4;
-				break;
-			}
+		can_status_msg *stat_tmp = &node->status;
+		ind = 0;
+		stat_tmp->id = id;
+		stat_tmp->rx_time = chVTGetSystemTimeX();
+		stat_tmp->rpm = (float)buffer_get_int32(data8, &ind);
+		stat_tmp->current = (float)buffer_get_int16(data8, &ind) / 10.0;
+		stat_tmp->duty = (float)buffer_get_int16(data8, &ind) / 1000.0;
+	} break;
+
+	case CAN_PACKET_STATUS_2: {
+		can_node *node = node_add(id);
+		if (!node) {
+			break;
 		}
-		break;
 
-	case CAN_PACKET_STATUS_4:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			can_status_msg_4 *stat_tmp_4 = &stat_msgs_4[i];
-			if (stat_tmp_4->id == id || stat_tmp_4->id == -1) {
-				ind = 0;
-				stat_tmp_4->id = id;
-				stat_tmp_4->rx_time = chVTGetSystemTimeX();
-				stat_tmp_4->temp_fet = (float)buffer_get_int16(data8, &ind) / 10.0;
-				stat_tmp_4->temp_motor = (float)buffer_get_int16(data8, &ind) / 10.0;
-				stat_tmp_4->current_in = (float)buffer_get_int16(data8, &ind) / 10.0;
-				stat_tmp_4->pid_pos_now = (float)buffer_get_int16(data8, &ind) / 50.0;
-				break;
-			}
+		can_status_msg_2 *stat_tmp_2 = &node->status_2;
+		ind = 0;
+		stat_tmp_2->id = id;
+		stat_tmp_2->rx_time = chVTGetSystemTimeX();
+		stat_tmp_2->amp_hours = (float)buffer_get_int32(data8, &ind) / 1e4;
+		stat_tmp_2->amp_hours_charged = (float)buffer_get_int32(data8, &ind) / 1e4;
+	} break;
+
+	case CAN_PACKET_STATUS_3: {
+		can_node *node = node_add(id);
+		if (!node) {
+			break;
 		}
-		break;
 
-	case CAN_PACKET_STATUS_5:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			can_status_msg_5 *stat_tmp_5 = &stat_msgs_5[i];
-			if (stat_tmp_5->id == id || stat_tmp_5->id == -1) {
-				ind = 0;
-				stat_tmp_5->id = id;
-				stat_tmp_5->rx_time = chVTGetSystemTimeX();
-				stat_tmp_5->tacho_value = buffer_get_int32(data8, &ind);
-				stat_tmp_5->v_in = (float)buffer_get_int16(data8, &ind) / 1e1;
-				break;
-			}
+		can_status_msg_3 *stat_tmp_3 = &node->status_3;
+		ind = 0;
+		stat_tmp_3->id = id;
+		stat_tmp_3->rx_time = chVTGetSystemTimeX();
+		stat_tmp_3->watt_hours = (float)buffer_get_int32(data8, &ind) / 1e4;
+		stat_tmp_3->watt_hours_charged = (float)buffer_get_int32(data8, &ind) / 1e4;
+	} break;
+
+	case CAN_PACKET_STATUS_4: {
+		can_node *node = node_add(id);
+		if (!node) {
+			break;
 		}
-		break;
 
-	case CAN_PACKET_STATUS_6:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			can_status_msg_6 *stat_tmp_6 = &stat_msgs_6[i];
-			if (stat_tmp_6->id == id || stat_tmp_6->id == -1) {
-				ind = 0;
-				stat_tmp_6->id = id;
-				stat_tmp_6->rx_time = chVTGetSystemTimeX();
-				stat_tmp_6->adc_1 = buffer_get_float16(data8, 1e3, &ind);
-				stat_tmp_6->adc_2 = buffer_get_float16(data8, 1e3, &ind);
-				stat_tmp_6->adc_3 = buffer_get_float16(data8, 1e3, &ind);
-				stat_tmp_6->ppm = buffer_get_float16(data8, 1e3, &ind);
-				break;
-			}
+		can_status_msg_4 *stat_tmp_4 = &node->status_4;
+		ind = 0;
+		stat_tmp_4->id = id;
+		stat_tmp_4->rx_time = chVTGetSystemTimeX();
+		stat_tmp_4->temp_fet = (float)buffer_get_int16(data8, &ind) / 10.0;
+		stat_tmp_4->temp_motor = (float)buffer_get_int16(data8, &ind) / 10.0;
+		stat_tmp_4->current_in = (float)buffer_get_int16(data8, &ind) / 10.0;
+		stat_tmp_4->pid_pos_now = (float)buffer_get_int16(data8, &ind) / 50.0;
+	} break;
+
+	case CAN_PACKET_STATUS_5: {
+		can_node *node = node_add(id);
+		if (!node) {
+			break;
 		}
-		break;
 
-	case CAN_PACKET_IO_BOARD_ADC_1_TO_4:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			io_board_adc_values *msg = &io_board_adc_1_4[i];
-			if (msg->id == id || msg->id == -1) {
-				ind = 0;
-				msg->id = id;
-				msg->rx_time = chVTGetSystemTimeX();
-				ind = 0;
-				int j = 0;
-				while (ind < len) {
-					msg->adc_voltages[j++] = buffer_get_float16(data8, 1e2, &ind);
-				}
-				break;
-			}
+		can_status_msg_5 *stat_tmp_5 = &node->status_5;
+		ind = 0;
+		stat_tmp_5->id = id;
+		stat_tmp_5->rx_time = chVTGetSystemTimeX();
+		stat_tmp_5->tacho_value = buffer_get_int32(data8, &ind);
+		stat_tmp_5->v_in = (float)buffer_get_int16(data8, &ind) / 1e1;
+	} break;
+
+	case CAN_PACKET_STATUS_6: {
+		can_node *node = node_add(id);
+		if (!node) {
+			break;
 		}
-		break;
 
-	case CAN_PACKET_IO_BOARD_ADC_5_TO_8:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			io_board_adc_values *msg = &io_board_adc_5_8[i];
-			if (msg->id == id || msg->id == -1) {
-				ind = 0;
-				msg->id = id;
-				msg->rx_time = chVTGetSystemTimeX();
-				ind = 0;
-				int j = 0;
-				while (ind < len) {
-					msg->adc_voltages[j++] = buffer_get_float16(data8, 1e2, &ind);
-				}
-				break;
-			}
+		can_status_msg_6 *stat_tmp_6 = &node->status_6;
+		ind = 0;
+		stat_tmp_6->id = id;
+		stat_tmp_6->rx_time = chVTGetSystemTimeX();
+		stat_tmp_6->adc_1 = buffer_get_float16(data8, 1e3, &ind);
+		stat_tmp_6->adc_2 = buffer_get_float16(data8, 1e3, &ind);
+		stat_tmp_6->adc_3 = buffer_get_float16(data8, 1e3, &ind);
+		stat_tmp_6->ppm = buffer_get_float16(data8, 1e3, &ind);
+	} break;
+
+	case CAN_PACKET_IO_BOARD_ADC_1_TO_4: {
+		can_node *node = node_add(id);
+		if (!node) {
+			break;
 		}
-		break;
 
-	case CAN_PACKET_IO_BOARD_DIGITAL_IN:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			io_board_digial_inputs *msg = &io_board_digital_in[i];
-			if (msg->id == id || msg->id == -1) {
-				ind = 0;
-				msg->id = id;
-				msg->rx_time = chVTGetSystemTimeX();
-				msg->inputs = 0;
-				ind = 0;
-				while (ind < len) {
-					msg->inputs |= (uint64_t)data8[ind] << (ind * 8);
-					ind++;
-				}
-				break;
-			}
+		io_board_adc_values *msg = &node->io_board_adc_1_4;
+		ind = 0;
+		msg->id = id;
+		msg->rx_time = chVTGetSystemTimeX();
+		ind = 0;
+		int j = 0;
+		while (ind < len) {
+			msg->adc_voltages[j++] = buffer_get_float16(data8, 1e2, &ind);
 		}
-		break;
+	} break;
+
+	case CAN_PACKET_IO_BOARD_ADC_5_TO_8: {
+		can_node *node = node_add(id);
+		if (!node) {
+			break;
+		}
+
+		io_board_adc_values *msg = &node->io_board_adc_5_8;
+		ind = 0;
+		msg->id = id;
+		msg->rx_time = chVTGetSystemTimeX();
+		ind = 0;
+		int j = 0;
+		while (ind < len) {
+			msg->adc_voltages[j++] = buffer_get_float16(data8, 1e2, &ind);
+		}
+	} break;
+
+	case CAN_PACKET_IO_BOARD_DIGITAL_IN: {
+		can_node *node = node_add(id);
+		if (!node) {
+			break;
+		}
+
+		io_board_digial_inputs *msg = &node->io_board_digital_in;
+		ind = 0;
+		msg->id = id;
+		msg->rx_time = chVTGetSystemTimeX();
+		msg->inputs = 0;
+		ind = 0;
+		while (ind < len) {
+			msg->inputs |= (uint64_t)data8[ind] << (ind * 8);
+			ind++;
+		}
+	} break;
 
 	case CAN_PACKET_PSW_STAT: {
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			psw_status *msg = &psw_stat[i];
-			if (msg->id == id || msg->id == -1) {
-				ind = 0;
-				msg->id = id;
-				msg->rx_time = chVTGetSystemTimeX();
-
-				msg->v_in = buffer_get_float16(data8, 10.0, &ind);
-				msg->v_out = buffer_get_float16(data8, 10.0, &ind);
-				msg->temp = buffer_get_float16(data8, 10.0, &ind);
-				msg->is_out_on = (data8[ind] >> 0) & 1;
-				msg->is_pch_on = (data8[ind] >> 1) & 1;
-				msg->is_dsc_on = (data8[ind] >> 2) & 1;
-				ind++;
-				break;
-			}
+		can_node *node = node_add(id);
+		if (!node) {
+			break;
 		}
+
+		psw_status *msg = &node->psw_stat;
+		ind = 0;
+		msg->id = id;
+		msg->rx_time = chVTGetSystemTimeX();
+
+		msg->v_in = buffer_get_float16(data8, 10.0, &ind);
+		msg->v_out = buffer_get_float16(data8, 10.0, &ind);
+		msg->temp = buffer_get_float16(data8, 10.0, &ind);
+		msg->is_out_on = (data8[ind] >> 0) & 1;
+		msg->is_pch_on = (data8[ind] >> 1) & 1;
+		msg->is_dsc_on = (data8[ind] >> 2) & 1;
+		ind++;
 	} break;
 
 	case CAN_PACKET_GNSS_TIME: {
@@ -2242,8 +2652,656 @@ static void decode_msg(uint32_t eid, uint8_t *data8, int len, bool is_replaced)
 #endif
 }
 
+/*
+ * Motor control commands. They only set the motor and reset the timeout, so
+ * the read thread applies them as soon as the frame arrives.
+ *
+ * @return
+ * true if cmd is a control command.
+ */
+static bool decode_control(CAN_PACKET_ID cmd, const uint8_t *data8, int len) {
+	int32_t ind = 0;
+
+	switch (cmd) {
+	case CAN_PACKET_SET_DUTY:
+		mc_interface_set_duty(buffer_get_float32(data8, 1e5, &ind));
+		break;
+
+	case CAN_PACKET_SET_CURRENT:
+		if (len >= 6) {
+			mc_interface_set_current_off_delay(buffer_get_float16(data8, 1e3, &ind));
+		}
+
+		mc_interface_set_current(buffer_get_float32(data8, 1e3, &ind));
+		break;
+
+	case CAN_PACKET_SET_CURRENT_BRAKE:
+		mc_interface_set_brake_current(buffer_get_float32(data8, 1e3, &ind));
+		break;
+
+	case CAN_PACKET_SET_RPM:
+		mc_interface_set_pid_speed(buffer_get_float32(data8, 1e0, &ind));
+		break;
+
+	case CAN_PACKET_SET_POS:
+		mc_interface_set_pid_pos(buffer_get_float32(data8, 1e6, &ind));
+		break;
+
+	case CAN_PACKET_SET_CURRENT_REL:
+		mc_interface_set_current_rel(buffer_get_float32(data8, 1e5, &ind));
+
+		if (len >= 6) {
+			mc_interface_set_current_off_delay(buffer_get_float16(data8, 1e3, &ind));
+		}
+		break;
+
+	case CAN_PACKET_SET_CURRENT_BRAKE_REL:
+		mc_interface_set_brake_current_rel(buffer_get_float32(data8, 1e5, &ind));
+		break;
+
+	case CAN_PACKET_SET_CURRENT_HANDBRAKE:
+		mc_interface_set_handbrake(buffer_get_float32(data8, 1e3, &ind));
+		break;
+
+	case CAN_PACKET_SET_CURRENT_HANDBRAKE_REL:
+		mc_interface_set_handbrake_rel(buffer_get_float32(data8, 1e5, &ind));
+		break;
+
+	default:
+		return false;
+	}
+
+	timeout_reset();
+	return true;
+}
+
+// Called from the read thread only
+static bool rx_push(rx_state *s, const CANRxFrame *frame, bool decoded) {
+	const uint32_t head = s->head;
+
+	if ((head - __atomic_load_n(&s->tail, __ATOMIC_ACQUIRE)) >= RX_FRAMES_SIZE) {
+		s->stats.overflows++;
+		return false;
+	}
+
+	rx_entry *e = &s->rx_frames[head & (RX_FRAMES_SIZE - 1)];
+	e->frame = *frame;
+	e->decoded = decoded;
+	__atomic_store_n(&s->head, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+// Called from the consumer only
+static bool rx_pop(rx_state *s, CANRxFrame *frame, bool *decoded) {
+	const uint32_t tail = s->tail;
+
+	if (tail == __atomic_load_n(&s->head, __ATOMIC_ACQUIRE)) {
+		return false;
+	}
+
+	const rx_entry *e = &s->rx_frames[tail & (RX_FRAMES_SIZE - 1)];
+	*frame = e->frame;
+	if (decoded) {
+		*decoded = e->decoded;
+	}
+	__atomic_store_n(&s->tail, tail + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+static bool rx_get(int interface, CANRxFrame *frame, bool *decoded) {
+	if (interface != 2 && rx_pop(&m_rx_state, frame, decoded)) {
+		return true;
+	}
+
+#ifdef HW_CAN2_DEV
+	if (interface != 1 && rx_pop(&m_rx_state2, frame, decoded)) {
+		return true;
+	}
+#endif
+
+	return false;
+}
+
+/*
+ * Apply control commands addressed to this VESC right away instead of
+ * waiting for the process thread to get through the frames before them.
+ * Not done with an EID callback, as it must see the frames first.
+ */
+static bool rx_fast_path(const CANRxFrame *frame) {
+	if (frame->IDE != CAN_IDE_EXT || eid_callback ||
+			app_get_configuration()->can_mode != CAN_MODE_VESC) {
+		return false;
+	}
+
+	const int id = frame->EID & 0xFF;
+	const int id1 = app_get_configuration()->controller_id;
+
+#ifdef HW_HAS_DUAL_MOTORS
+	const int id2 = utils_second_motor_id();
+	mc_interface_select_motor_thread(id == id2 ? 2 : 1);
+#else
+	const int id2 = id1;
+#endif
+
+	if (id != 255 && id != id1 && id != id2) {
+		return false;
+	}
+
+	return decode_control(frame->EID >> 8, frame->data8, frame->DLC);
+}
+
+// Read all frames the hardware has received on an interface
+static void rx_receive(CANDriver *canp, rx_state *s) {
+	CANRxFrame rxmsg;
+	bool pushed = false;
+
+	while (canReceive(canp, CAN_ANY_MAILBOX, &rxmsg, TIME_IMMEDIATE) == MSG_OK) {
+		s->stats.frames++;
+
+		const bool decoded = rx_fast_path(&rxmsg);
+		if (decoded) {
+			s->stats.fast++;
+#ifndef USE_LISPBM
+			// Nothing else uses control commands
+			continue;
+#endif
+		}
+
+		pushed |= rx_push(s, &rxmsg, decoded);
+	}
+
+	if (pushed && process_tp) {
+		chEvtSignal(process_tp, (eventmask_t) 1);
+	}
+}
+
+/*
+ * In VESC mode without anything else that reads frames, the hardware filters
+ * only let the frames this VESC decodes through. That removes commands and
+ * buffer transfers between other nodes before they reach the ring.
+ */
+static void rx_filter_update(void) {
+	const app_configuration *conf = app_get_configuration();
+	const int id1 = conf->controller_id;
+#ifdef HW_HAS_DUAL_MOTORS
+	const int id2 = utils_second_motor_id();
+#else
+	const int id2 = id1;
+#endif
+
+	bool accept_all = conf->can_mode != CAN_MODE_VESC || eid_callback;
+#ifdef USE_LISPBM
+	accept_all = accept_all || lispif_can_eid_used();
+#endif
+
+	if (accept_all) {
+		rx_filter_all_last = chVTGetSystemTimeX();
+	} else if (UTILS_AGE_S(rx_filter_all_last) < RX_FILTER_HOLD) {
+		// can-recv-eid in LispBM only waits between the frames it reads
+		accept_all = true;
+	}
+
+	if (accept_all == rx_filter_all &&
+			(accept_all || (id1 == rx_filter_id1 && id2 == rx_filter_id2))) {
+		return;
+	}
+
+	if (rx_filter_program(accept_all, id1, id2)) {
+		rx_filter_all = accept_all;
+		rx_filter_id1 = id1;
+		rx_filter_id2 = id2;
+	}
+}
+
+/*
+ * Write the filter banks of both interfaces, using 32 bit mask mode. The
+ * banks are in CAN1, so it must be running. Filter initialization mode
+ * stops reception only while the registers are written, so the interfaces
+ * do not have to be stopped.
+ *
+ * @return
+ * false if CAN1 was not running, so nothing was written.
+ */
+static bool rx_filter_program(bool accept_all, int id1, int id2) {
+	if (CAND1.state != CAN_READY) {
+		return false;
+	}
+
+	uint32_t fr[RX_FILTER_BANKS][2];
+	int banks = 0;
+
+	if (accept_all) {
+		fr[banks][0] = 0;
+		fr[banks][1] = 0;
+		banks++;
+	} else {
+		// All standard frames, they are cheap to leave to the callbacks
+		fr[banks][0] = 0;
+		fr[banks][1] = RX_FILTER_IDE;
+		banks++;
+
+		// Addressed to this VESC or to all of them
+		const int ids[3] = {id1, id2, 255};
+		for (int i = 0;i < 3;i++) {
+			fr[banks][0] = RX_FILTER_EID(ids[i]);
+			fr[banks][1] = RX_FILTER_EID(0xFF);
+			banks++;
+		}
+
+		// Decoded from any sender
+		for (unsigned int i = 0;i < sizeof(rx_filter_types) / sizeof(rx_filter_types[0]);i++) {
+			fr[banks][0] = RX_FILTER_EID((uint32_t)rx_filter_types[i].first << 8);
+			fr[banks][1] = RX_FILTER_EID(0x1FFFFFFF & ~((1 << (8 + rx_filter_types[i].bits)) - 1));
+			banks++;
+		}
+	}
+
+	const uint32_t bank_start[2] = {0, (CAN1->FMR >> 8) & 0x3F};
+
+	chSysLock();
+	CAN1->FMR |= CAN_FMR_FINIT;
+
+	for (int i = 0;i < 2;i++) {
+		for (int j = 0;j < RX_FILTER_BANKS;j++) {
+			const uint32_t bank = bank_start[i] + j;
+			const uint32_t mask = 1 << bank;
+
+			CAN1->FA1R &= ~mask;
+
+			if (j < banks) {
+				CAN1->FM1R &= ~mask;
+				CAN1->FS1R |= mask;
+				CAN1->FFA1R &= ~mask;
+				CAN1->sFilterRegister[bank].FR1 = fr[j][0];
+				CAN1->sFilterRegister[bank].FR2 = fr[j][1];
+				CAN1->FA1R |= mask;
+			}
+		}
+	}
+
+	CAN1->FMR &= ~CAN_FMR_FINIT;
+	chSysUnlock();
+
+	return true;
+}
+
+/*
+ * Send a buffer with a windowed transfer when the receiver supports them.
+ * Support is asked for with a ping the first time, and the buffer is sent
+ * the legacy way until the answer is there.
+ *
+ * @return
+ * false if the buffer has to be sent the legacy way.
+ */
+static bool xfer_send(uint8_t controller_id, uint8_t *data, unsigned int len, uint8_t send) {
+	const app_configuration *conf = app_get_configuration();
+
+	if (!init_done || conf->can_mode != CAN_MODE_VESC || len > CAN_XFER_MAX_LEN ||
+			controller_id == 255 || controller_id == conf->controller_id) {
+		return false;
+	}
+
+#ifdef HW_HAS_DUAL_MOTORS
+	if (controller_id == utils_second_motor_id()) {
+		return false;
+	}
+#endif
+
+	if (xfer_support[controller_id] == XFER_SUPPORT_UNKNOWN) {
+		// comm_can_ping waits for the answer, which the process thread cannot do
+		if (UTILS_AGE_S(xfer_ping_last) > XFER_PING_INTERVAL) {
+			xfer_ping_last = chVTGetSystemTimeX();
+			uint8_t buffer[1];
+			buffer[0] = conf->controller_id;
+			comm_can_transmit_eid(controller_id |
+					((uint32_t)CAN_PACKET_PING << 8), buffer, 1);
+		}
+		return false;
+	}
+
+	if (xfer_support[controller_id] != XFER_SUPPORT_YES) {
+		return false;
+	}
+
+	// The ACKs that free the slots are handled by the process thread, so it
+	// cannot wait for them
+	const bool wait = chThdGetSelfX() != process_tp;
+
+	for (int i = 0;;i++) {
+		chMtxLock(&xfer_mtx);
+		bool ok = comm_can_xfer_send(&m_xfer, conf->controller_id, controller_id, send, data, len);
+		chMtxUnlock(&xfer_mtx);
+
+		if (ok) {
+			return true;
+		}
+
+		if (!wait || i >= XFER_SLOT_WAIT) {
+			return false;
+		}
+
+		chThdSleepMilliseconds(1);
+	}
+}
+
+static void xfer_decode(uint32_t eid, const uint8_t *data8, int len) {
+	// Only nodes that support transfers send them
+	xfer_support[(eid >> 16) & 0xFF] = XFER_SUPPORT_YES;
+
+	if (((eid >> 8) & 0xFF) == CAN_PACKET_BUFFER_XFER_DATA) {
+		comm_can_xfer_rx_frame(&m_xfer, eid, data8, len);
+	} else {
+		chMtxLock(&xfer_mtx);
+		comm_can_xfer_tx_ack(&m_xfer, eid, data8, len);
+		chMtxUnlock(&xfer_mtx);
+	}
+}
+
+/*
+ * Transfer timeouts. A node that stops answering transfers might have been
+ * updated to firmware without them, so its support is asked for again.
+ * Nodes that answer with ACKs support them, even when a transfer to them
+ * fails.
+ */
+static void xfer_poll(void) {
+	uint8_t failed[CAN_XFER_SLOTS];
+
+	chMtxLock(&xfer_mtx);
+	const int failed_num = comm_can_xfer_tx_poll(&m_xfer, failed);
+	chMtxUnlock(&xfer_mtx);
+
+	for (int i = 0;i < failed_num;i++) {
+		xfer_support[failed[i]] = XFER_SUPPORT_UNKNOWN;
+	}
+}
+
+static uint32_t time_us(void *arg) {
+	(void)arg;
+	// Wraps around like the system time
+	return (uint32_t)chVTGetSystemTimeX() * (1000000 / CH_CFG_ST_FREQUENCY);
+}
+
+static void xfer_send_frame(uint32_t eid, const uint8_t *data, uint8_t len, void *arg) {
+	(void)arg;
+	comm_can_transmit_eid(eid, data, len);
+}
+
+// Called from decode_msg, where the motor of dest is selected already
+static void xfer_deliver(uint8_t src, uint8_t dest, uint8_t send,
+		uint8_t *data, unsigned int len, void *arg) {
+	(void)dest;
+	(void)arg;
+	process_buffer(src, send, data, len, false);
+}
+
+#ifdef HW_HAS_CAN_FD
+/*
+ * Apply the FD settings and the arbitration rate to the hardware.
+ *
+ * @return
+ * false if the clock cannot make the rates.
+ */
+static bool fd_configure(void) {
+	const int nominal_kbits = comm_can_baud_to_kbits(fd_baud);
+	can_fd_timing nominal, data;
+
+	if (!comm_can_fd_calc_timing(HW_CAN_FD_CLOCK, (uint32_t)nominal_kbits * 1000,
+			FD_NOMINAL_SAMPLE_POINT, false, &nominal)) {
+		return false;
+	}
+
+	data = nominal;
+	const bool brs = fd_enabled && fd_brs;
+
+	if (brs) {
+		if (fd_data_kbits < nominal_kbits ||
+				!comm_can_fd_calc_timing(HW_CAN_FD_CLOCK, (uint32_t)fd_data_kbits * 1000,
+						FD_DATA_SAMPLE_POINT, true, &data)) {
+			return false;
+		}
+	}
+
+	HW_CAN_FD_SET_MODE(fd_enabled, brs, &nominal, &data);
+	return true;
+}
+
+/*
+ * Send a buffer in FD frames to a node that has told that it decodes them.
+ * xfer_send asks the nodes, as both are in the pong.
+ *
+ * @return
+ * false if the buffer has to be sent in another way.
+ */
+static bool fd_send(uint8_t controller_id, uint8_t *data, unsigned int len, uint8_t send) {
+	const app_configuration *conf = app_get_configuration();
+
+	if (!init_done || !fd_enabled || conf->can_mode != CAN_MODE_VESC || len > CAN_FD_MAX_LEN ||
+			controller_id == 255 || controller_id == conf->controller_id ||
+			!fd_support[controller_id]) {
+		return false;
+	}
+
+#ifdef HW_HAS_DUAL_MOTORS
+	if (controller_id == utils_second_motor_id()) {
+		return false;
+	}
+#endif
+
+	chMtxLock(&fd_mtx);
+	bool ok = comm_can_fd_send_buffer(&m_fd, conf->controller_id, controller_id, send, data, len);
+	chMtxUnlock(&fd_mtx);
+
+	return ok;
+}
+
+static void fd_send_frame(uint32_t eid, const uint8_t *data, uint8_t len, void *arg) {
+	(void)arg;
+	comm_can_transmit_eid_fd(eid, data, len);
+}
+
+// Called from decode_msg, where the motor of the receiver is selected already
+static void fd_deliver(uint8_t src, uint8_t send, uint8_t *data, unsigned int len, void *arg) {
+	(void)arg;
+	process_buffer(src, send, data, len, false);
+}
+
+// Decode the messages in a CAN_PACKET_STATUS_FD frame as if they came one by one
+static void fd_decode_status(uint8_t id, const uint8_t *data8, int len) {
+	for (int i = 0;i < CAN_FD_STATUS_MSGS;i++) {
+		const uint8_t *msg = comm_can_fd_status_get(data8, len, i);
+		if (!msg) {
+			continue;
+		}
+
+		uint8_t buffer[CAN_FD_STATUS_MSG_LEN];
+		memcpy(buffer, msg, CAN_FD_STATUS_MSG_LEN);
+		decode_msg(id | ((uint32_t)status_packet_ids[i] << 8), buffer, CAN_FD_STATUS_MSG_LEN, false);
+	}
+}
+
+/*
+ * Decode the FD frames from the driver. They do not go to the EID callback,
+ * the BMS or LispBM, which handle classic frames only.
+ */
+static void fd_rx_process(void) {
+	for (;;) {
+		const uint32_t tail = fd_rx_tail;
+
+		if (tail == __atomic_load_n(&fd_rx_head, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+
+		fd_frame *f = &fd_rx_frames[tail & (FD_RX_FRAMES_SIZE - 1)];
+		decode_msg(f->eid, f->data, f->len, false);
+		__atomic_store_n(&fd_rx_tail, tail + 1, __ATOMIC_RELEASE);
+	}
+}
+#endif
+
+/*
+ * The node with this id, which is added to a free entry if it is new.
+ * Entries are never given to another node, as callers keep pointers to
+ * the messages in them.
+ *
+ * @return
+ * The node, or 0 if the table is full.
+ */
+static can_node *node_add(int id) {
+	can_node *node = node_get(id);
+
+	if (node) {
+		return node;
+	}
+
+	if (id < 0 || id > 255) {
+		return 0;
+	}
+
+	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
+		if (nodes[i].id < 0) {
+			node = &nodes[i];
+			break;
+		}
+	}
+
+	if (!node) {
+		return 0;
+	}
+
+	node_clear(node);
+	node->id = id;
+	node_index[id] = node - nodes + 1;
+
+	return node;
+}
+
 #endif
 
+/*
+ * Fields of a status message in the units they are sent in.
+ */
+static void status_values(int msg, int32_t *value) {
+	memset(value, 0, sizeof(int32_t) * CAN_PUB_FIELDS);
+
+	switch (msg) {
+	case 0:
+		value[0] = (int32_t)mc_interface_get_rpm();
+		value[1] = (int16_t)(mc_interface_get_tot_current_filtered() * 1e1);
+		value[2] = (int16_t)(mc_interface_get_duty_cycle_now() * 1e3);
+		break;
+
+	case 1:
+		value[0] = (int32_t)(mc_interface_get_amp_hours(false) * 1e4);
+		value[1] = (int32_t)(mc_interface_get_amp_hours_charged(false) * 1e4);
+		break;
+
+	case 2:
+		value[0] = (int32_t)(mc_interface_get_watt_hours(false) * 1e4);
+		value[1] = (int32_t)(mc_interface_get_watt_hours_charged(false) * 1e4);
+		break;
+
+	case 3:
+		value[0] = (int16_t)(mc_interface_temp_fet_filtered() * 1e1);
+		value[1] = (int16_t)(mc_interface_temp_motor_filtered() * 1e1);
+		value[2] = (int16_t)(mc_interface_get_tot_current_in_filtered() * 1e1);
+		value[3] = (int16_t)(mc_interface_get_pid_pos_now() * 50.0);
+		break;
+
+	case 4:
+		value[0] = mc_interface_get_tachometer_value(false);
+		value[1] = (int16_t)(mc_interface_get_input_voltage_filtered() * 1e1);
+		break;
+
+	case 5:
+		value[0] = (int16_t)(ADC_VOLTS(ADC_IND_EXT) * 1e3);
+		value[1] = (int16_t)(ADC_VOLTS(ADC_IND_EXT2) * 1e3);
+		value[2] = (int16_t)(ADC_VOLTS(ADC_IND_EXT3) * 1e3);
+		value[3] = (int16_t)(servodec_get_servo(0) * 1e3);
+		break;
+
+	default:
+		break;
+	}
+}
+
+/*
+ * Encode a status message into 8 bytes.
+ *
+ * @return
+ * The length.
+ */
+static int32_t status_pack(int msg, const int32_t *value, uint8_t *buffer) {
+	int32_t send_index = 0;
+
+	switch (msg) {
+	case 0:
+		buffer_append_int32(buffer, value[0], &send_index);
+		buffer_append_int16(buffer, (int16_t)value[1], &send_index);
+		buffer_append_int16(buffer, (int16_t)value[2], &send_index);
+		break;
+
+	case 1:
+	case 2:
+		buffer_append_int32(buffer, value[0], &send_index);
+		buffer_append_int32(buffer, value[1], &send_index);
+		break;
+
+	case 4:
+		buffer_append_int32(buffer, value[0], &send_index);
+		buffer_append_int16(buffer, (int16_t)value[1], &send_index);
+		buffer_append_int16(buffer, 0, &send_index); // Reserved for now
+		break;
+
+	default:
+		for (int i = 0;i < 4;i++) {
+			buffer_append_int16(buffer, (int16_t)value[i], &send_index);
+		}
+		break;
+	}
+
+	return send_index;
+}
+
+static void status_transmit(int msg, uint8_t id, const int32_t *value, bool replace) {
+	if (msg < 0 || msg >= CAN_PUB_MSGS) {
+		return;
+	}
+
+	uint8_t buffer[8];
+	const int32_t len = status_pack(msg, value, buffer);
+	comm_can_transmit_eid_replace(id | ((uint32_t)status_packet_ids[msg] << 8),
+			buffer, len, replace, 0);
+}
+
+static void send_status(int msg, uint8_t id, bool replace) {
+	int32_t value[CAN_PUB_FIELDS];
+	status_values(msg, value);
+	status_transmit(msg, id, value, replace);
+}
+
+static void node_clear(can_node *node) {
+	memset(node, 0, sizeof(can_node));
+	node->id = -1;
+	node->status.id = -1;
+	node->status_2.id = -1;
+	node->status_3.id = -1;
+	node->status_4.id = -1;
+	node->status_5.id = -1;
+	node->status_6.id = -1;
+	node->io_board_adc_1_4.id = -1;
+	node->io_board_adc_5_8.id = -1;
+	node->io_board_digital_in.id = -1;
+	node->psw_stat.id = -1;
+}
+
+static can_node *node_get(int id) {
+	if (id < 0 || id > 255 || node_index[id] == 0) {
+		return 0;
+	}
+
+	return &nodes[node_index[id] - 1];
+}
+
 /**
  * Set the CAN timing. The CAN is clocked at 42 MHz, and the baud rate can be
  * calculated with
@@ -22,16 +22,27 @@
 
 #include "conf_general.h"
 #include "hal.h"
+#include "comm_can_xfer.h"
+#include "comm_can_pub.h"
+#include "comm_can_fd.h"
 
-// Settings
-#define CAN_STATUS_MSGS_TO_STORE	10
+// Settings, can be overridden by the hardware configuration
+#ifndef CAN_STATUS_MSGS_TO_STORE
+#define CAN_STATUS_MSGS_TO_STORE	10 // Nodes to store status messages from
+#endif
 
 // Functions
 void comm_can_init(void);
 CAN_BAUD comm_can_kbits_to_baud(int kbits);
+int comm_can_baud_to_kbits(CAN_BAUD baud);
 void comm_can_set_baud(CAN_BAUD baud, int delay_msec);
+bool comm_can_set_fd(bool enable, int data_kbits, bool brs);
+bool comm_can_fd_active(void);
+void comm_can_get_fd(int *data_kbits, bool *brs);
 msg_t comm_can_transmit_eid(uint32_t id, const uint8_t *data, uint8_t len);
 msg_t comm_can_transmit_eid_if(uint32_t id, const uint8_t *data, uint8_t len, int interface);
+msg_t comm_can_transmit_eid_fd(uint32_t id, const uint8_t *data, uint8_t len);
+void comm_can_fd_frame_received(uint32_t eid, const uint8_t *data, uint8_t len);
 msg_t comm_can_transmit_eid_replace(uint32_t id, const uint8_t *data, uint8_t len, bool replace, int interface);
 msg_t comm_can_transmit_sid(uint32_t id, const uint8_t *data, uint8_t len);
 void comm_can_set_sid_rx_callback(bool (*p_func)(uint32_t id, uint8_t *data, uint8_t len));
@@ -88,7 +99,12 @@ psw_status *comm_can_get_psw_status_id(int id);
 void comm_can_psw_switch(int id, bool is_on, bool plot);
 void comm_can_update_pid_pos_offset(int id, float angle_now, bool store);
 
-CANRxFrame *comm_can_get_rx_frame(int interface);
+bool comm_can_get_rx_frame(int interface, CANRxFrame *frame);
+can_rx_stats comm_can_get_rx_stats(int interface);
+bool comm_can_rx_filter_active(void);
+can_xfer_stats_t comm_can_get_xfer_stats(void);
+can_fd_stats_t comm_can_get_fd_stats(uint32_t *rx_overflows);
+can_pub_stats_t comm_can_get_status_pub_stats(void);
 
 void comm_can_send_status1(uint8_t id, bool replace);
 void comm_can_send_status2(uint8_t id, bool replace);
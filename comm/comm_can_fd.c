@@ -0,0 +1,340 @@
+/*
+	Copyright 2026 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "comm_can_fd.h"
+#include "datatypes.h"
+#include "crc.h"
+#include <string.h>
+#include <math.h>
+
+// Settings
+#define DATA_BRP_MAX			32
+#define DATA_TS1_MAX			32
+#define DATA_TS2_MAX			16
+#define NOMINAL_BRP_MAX			512
+#define NOMINAL_TS1_MAX			256
+#define NOMINAL_TS2_MAX			128
+#define TQ_MIN					5		// Fewer time quanta per bit leave no room for the sample point
+
+// Data length by DLC
+static const uint8_t dlc_len[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64};
+
+// Private functions
+static can_fd_rx_t *rx_find(can_fd_t *f, uint8_t src, uint8_t dest);
+static can_fd_rx_t *rx_alloc(can_fd_t *f);
+
+void comm_can_fd_init(can_fd_t *f, can_fd_send_func send_frame,
+		can_fd_deliver_func deliver, void *arg) {
+	memset(f, 0, sizeof(can_fd_t));
+	f->send_frame = send_frame;
+	f->deliver = deliver;
+	f->arg = arg;
+}
+
+/**
+ * @return
+ * The DLC of the shortest frame that fits len bytes.
+ */
+uint8_t comm_can_fd_len_to_dlc(unsigned int len) {
+	for (int i = 0;i < 16;i++) {
+		if (dlc_len[i] >= len) {
+			return i;
+		}
+	}
+
+	return 15;
+}
+
+unsigned int comm_can_fd_dlc_to_len(uint8_t dlc) {
+	return dlc_len[dlc & 0x0F];
+}
+
+/**
+ * @return
+ * len rounded up to a length a frame can have.
+ */
+unsigned int comm_can_fd_frame_len(unsigned int len) {
+	return comm_can_fd_dlc_to_len(comm_can_fd_len_to_dlc(len));
+}
+
+/**
+ * Send a buffer. The frames are sent from the calling thread with the send
+ * function.
+ *
+ * @return
+ * false if the length is 0 or too long.
+ */
+bool comm_can_fd_send_buffer(can_fd_t *f, uint8_t src, uint8_t dest, uint8_t send,
+		const uint8_t *data, unsigned int len) {
+	if (len == 0 || len > CAN_FD_MAX_LEN) {
+		return false;
+	}
+
+	const uint16_t crc = crc16((unsigned char*)data, len);
+	uint8_t frame[CAN_FD_FRAME_LEN];
+	unsigned int offset = 0;
+
+	while (offset < len) {
+		unsigned int ind = 0;
+		frame[ind++] = src;
+		frame[ind++] = offset >> 8;
+		frame[ind++] = offset & 0xFF;
+
+		if (offset == 0) {
+			frame[ind++] = send;
+			frame[ind++] = len >> 8;
+			frame[ind++] = len & 0xFF;
+			frame[ind++] = crc >> 8;
+			frame[ind++] = crc & 0xFF;
+		}
+
+		unsigned int n = len - offset;
+		if (n > (CAN_FD_FRAME_LEN - ind)) {
+			n = CAN_FD_FRAME_LEN - ind;
+		}
+
+		memcpy(frame + ind, data + offset, n);
+		ind += n;
+		offset += n;
+
+		const unsigned int frame_len = comm_can_fd_frame_len(ind);
+		memset(frame + ind, 0, frame_len - ind);
+
+		f->send_frame((uint32_t)dest | ((uint32_t)CAN_PACKET_BUFFER_FD << 8),
+				frame, frame_len, f->arg);
+		f->stats.tx_frames++;
+	}
+
+	f->stats.tx_buffers++;
+	return true;
+}
+
+/**
+ * Handle a CAN_PACKET_BUFFER_FD frame addressed to this node. Complete
+ * buffers go to the deliver function.
+ */
+void comm_can_fd_rx_frame(can_fd_t *f, uint32_t eid, const uint8_t *data, unsigned int len) {
+	if (len < CAN_FD_DATA_HEADER_LEN) {
+		f->stats.rx_dropped++;
+		return;
+	}
+
+	const uint8_t src = data[0];
+	const uint8_t dest = eid & 0xFF;
+	const unsigned int offset = ((unsigned int)data[1] << 8) | data[2];
+	can_fd_rx_t *r = rx_find(f, src, dest);
+	unsigned int ind;
+
+	if (offset == 0) {
+		const unsigned int buf_len = ((unsigned int)data[4] << 8) | data[5];
+		if (len < CAN_FD_HEADER_LEN || buf_len == 0 || buf_len > CAN_FD_MAX_LEN) {
+			f->stats.rx_dropped++;
+			return;
+		}
+
+		if (!r) {
+			r = rx_alloc(f);
+		}
+
+		r->used = true;
+		r->src = src;
+		r->dest = dest;
+		r->send = data[3];
+		r->len = buf_len;
+		r->crc = ((uint16_t)data[6] << 8) | data[7];
+		r->offset = 0;
+		ind = CAN_FD_HEADER_LEN;
+	} else {
+		if (!r || r->offset != offset) {
+			// A frame was lost, so the rest of the buffer is of no use
+			if (r) {
+				r->used = false;
+			}
+			f->stats.rx_dropped++;
+			return;
+		}
+
+		ind = CAN_FD_DATA_HEADER_LEN;
+	}
+
+	// The last frame can have padding
+	unsigned int n = len - ind;
+	if (n > (unsigned int)(r->len - r->offset)) {
+		n = r->len - r->offset;
+	}
+
+	memcpy(r->data + r->offset, data + ind, n);
+	r->offset += n;
+	r->last_seq = ++f->rx_seq;
+
+	if (r->offset == r->len) {
+		if (crc16(r->data, r->len) == r->crc) {
+			f->stats.rx_done++;
+			f->deliver(r->src, r->send, r->data, r->len, f->arg);
+		} else {
+			f->stats.rx_crc_errors++;
+		}
+
+		r->used = false;
+	}
+}
+
+/**
+ * Put status messages in a CAN_PACKET_STATUS_FD frame.
+ *
+ * @param mask
+ * Bit n set when CAN_PACKET_STATUS_(n + 1) is included, where bit 0 is
+ * CAN_PACKET_STATUS.
+ *
+ * @param status
+ * The data of the messages, only the ones in mask are used.
+ *
+ * @return
+ * The frame length, including padding.
+ */
+unsigned int comm_can_fd_status_pack(uint8_t *frame, uint8_t mask,
+		const uint8_t status[CAN_FD_STATUS_MSGS][CAN_FD_STATUS_MSG_LEN]) {
+	unsigned int ind = 0;
+	mask &= (1 << CAN_FD_STATUS_MSGS) - 1;
+	frame[ind++] = mask;
+
+	for (int i = 0;i < CAN_FD_STATUS_MSGS;i++) {
+		if ((mask >> i) & 1) {
+			memcpy(frame + ind, status[i], CAN_FD_STATUS_MSG_LEN);
+			ind += CAN_FD_STATUS_MSG_LEN;
+		}
+	}
+
+	const unsigned int frame_len = comm_can_fd_frame_len(ind);
+	memset(frame + ind, 0, frame_len - ind);
+	return frame_len;
+}
+
+/**
+ * @return
+ * The data of status message msg in a CAN_PACKET_STATUS_FD frame, or 0 if
+ * the frame does not have it.
+ */
+const uint8_t *comm_can_fd_status_get(const uint8_t *frame, unsigned int len, int msg) {
+	if (len < 1 || msg < 0 || msg >= CAN_FD_STATUS_MSGS || !((frame[0] >> msg) & 1)) {
+		return 0;
+	}
+
+	unsigned int ind = 1;
+	for (int i = 0;i < msg;i++) {
+		if ((frame[0] >> i) & 1) {
+			ind += CAN_FD_STATUS_MSG_LEN;
+		}
+	}
+
+	if ((ind + CAN_FD_STATUS_MSG_LEN) > len) {
+		return 0;
+	}
+
+	return frame + ind;
+}
+
+/**
+ * Find a bit timing with as many time quanta as possible.
+ *
+ * @param clock
+ * Clock of the CAN controller [Hz].
+ *
+ * @param bitrate
+ * [bit/s]
+ *
+ * @param sample_point
+ * Sample point as a share of the bit, e.g. 0.8.
+ *
+ * @param data_phase
+ * Use the limits of the data phase instead of the arbitration phase.
+ *
+ * @return
+ * false if the clock cannot be divided to the bit rate.
+ */
+bool comm_can_fd_calc_timing(uint32_t clock, uint32_t bitrate, float sample_point,
+		bool data_phase, can_fd_timing *t) {
+	const uint32_t brp_max = data_phase ? DATA_BRP_MAX : NOMINAL_BRP_MAX;
+	const uint32_t ts1_max = data_phase ? DATA_TS1_MAX : NOMINAL_TS1_MAX;
+	const uint32_t ts2_max = data_phase ? DATA_TS2_MAX : NOMINAL_TS2_MAX;
+
+	if (bitrate == 0) {
+		return false;
+	}
+
+	for (uint32_t brp = 1;brp <= brp_max;brp++) {
+		if ((clock % (brp * bitrate)) != 0) {
+			continue;
+		}
+
+		const uint32_t tq = clock / (brp * bitrate);
+		if (tq < TQ_MIN || tq > (1 + ts1_max + ts2_max)) {
+			continue;
+		}
+
+		uint32_t ts2 = (uint32_t)roundf((float)tq * (1.0 - sample_point));
+		if (ts2 < 1) {
+			ts2 = 1;
+		} else if (ts2 > ts2_max) {
+			ts2 = ts2_max;
+		}
+
+		const uint32_t ts1 = tq - 1 - ts2;
+		if (ts1 < 1 || ts1 > ts1_max) {
+			continue;
+		}
+
+		t->brp = brp;
+		t->ts1 = ts1;
+		t->ts2 = ts2;
+		t->sjw = ts2;
+		return true;
+	}
+
+	return false;
+}
+
+static can_fd_rx_t *rx_find(can_fd_t *f, uint8_t src, uint8_t dest) {
+	for (int i = 0;i < CAN_FD_RX_NUM;i++) {
+		can_fd_rx_t *r = &f->rx[i];
+		if (r->used && r->src == src && r->dest == dest) {
+			return r;
+		}
+	}
+
+	return 0;
+}
+
+// A free buffer, or else the one that has waited the longest for a frame
+static can_fd_rx_t *rx_alloc(can_fd_t *f) {
+	can_fd_rx_t *oldest = &f->rx[0];
+
+	for (int i = 0;i < CAN_FD_RX_NUM;i++) {
+		can_fd_rx_t *r = &f->rx[i];
+		if (!r->used) {
+			return r;
+		}
+
+		if ((f->rx_seq - r->last_seq) > (f->rx_seq - oldest->last_seq)) {
+			oldest = r;
+		}
+	}
+
+	return oldest;
+}
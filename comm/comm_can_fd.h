@@ -0,0 +1,119 @@
+/*
+	Copyright 2026 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef COMM_CAN_FD_H_
+#define COMM_CAN_FD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Framing for CAN-FD frames with up to 64 bytes.
+ *
+ * Buffers are sent as CAN_PACKET_BUFFER_FD frames to the receiver. Each
+ * frame starts with the source and the offset of its data in the buffer.
+ * The frame at offset 0 also has the send mode, the length and the CRC16
+ * of the buffer. Frames from one node arrive in order, so the receiver
+ * appends them and delivers the buffer once it is complete and the CRC
+ * matches.
+ *
+ * CAN_PACKET_STATUS_FD has any of CAN_PACKET_STATUS to CAN_PACKET_STATUS_6
+ * in one frame, as a bitmask of the messages followed by their 8 bytes each.
+ *
+ * Frames are padded to the next length a DLC can encode. FD frames only
+ * work when every controller on the bus is FD capable, as classic
+ * controllers take them as errors. Nodes that decode the FD packets tell
+ * so with CAN_FD_PONG_CAP.
+ *
+ * The receiving side is used from one thread only. The sending side keeps
+ * no state besides the statistics, but frames of buffers to the same node
+ * must not be mixed, so sending must be locked by the caller.
+ */
+
+// Settings
+#define CAN_FD_FRAME_LEN		64
+#define CAN_FD_MAX_LEN			512
+#define CAN_FD_RX_NUM			4		// Buffers received at the same time
+#define CAN_FD_HEADER_LEN		8		// First frame of a buffer
+#define CAN_FD_DATA_HEADER_LEN	3		// Following frames
+#define CAN_FD_STATUS_MSGS		6		// CAN_PACKET_STATUS to CAN_PACKET_STATUS_6
+#define CAN_FD_STATUS_MSG_LEN	8
+
+// Bit in the third byte of CAN_PACKET_PONG
+#define CAN_FD_PONG_CAP			(1 << 1)
+
+typedef void (*can_fd_send_func)(uint32_t eid, const uint8_t *data, uint8_t len, void *arg);
+typedef void (*can_fd_deliver_func)(uint8_t src, uint8_t send, uint8_t *data,
+		unsigned int len, void *arg);
+
+/*
+ * Bit timing, where a bit is 1 + ts1 + ts2 time quanta of brp clock
+ * cycles each.
+ */
+typedef struct {
+	uint16_t brp;
+	uint16_t ts1;
+	uint16_t ts2;
+	uint16_t sjw;
+} can_fd_timing;
+
+typedef struct {
+	uint8_t data[CAN_FD_MAX_LEN];
+	uint16_t len;
+	uint16_t crc;
+	uint16_t offset;		// Bytes received
+	uint8_t src, dest;
+	uint8_t send;
+	bool used;
+	uint32_t last_seq;		// Order of the last frame, for reuse of the oldest buffer
+} can_fd_rx_t;
+
+typedef struct {
+	uint32_t tx_buffers;
+	uint32_t tx_frames;
+	uint32_t rx_done;
+	uint32_t rx_crc_errors;
+	uint32_t rx_dropped;	// Frames that did not continue a buffer
+} can_fd_stats_t;
+
+typedef struct {
+	can_fd_send_func send_frame;
+	can_fd_deliver_func deliver;
+	void *arg;
+	can_fd_rx_t rx[CAN_FD_RX_NUM];
+	uint32_t rx_seq;
+	can_fd_stats_t stats;
+} can_fd_t;
+
+// Functions
+void comm_can_fd_init(can_fd_t *f, can_fd_send_func send_frame,
+		can_fd_deliver_func deliver, void *arg);
+uint8_t comm_can_fd_len_to_dlc(unsigned int len);
+unsigned int comm_can_fd_dlc_to_len(uint8_t dlc);
+unsigned int comm_can_fd_frame_len(unsigned int len);
+bool comm_can_fd_send_buffer(can_fd_t *f, uint8_t src, uint8_t dest, uint8_t send,
+		const uint8_t *data, unsigned int len);
+void comm_can_fd_rx_frame(can_fd_t *f, uint32_t eid, const uint8_t *data, unsigned int len);
+unsigned int comm_can_fd_status_pack(uint8_t *frame, uint8_t mask,
+		const uint8_t status[CAN_FD_STATUS_MSGS][CAN_FD_STATUS_MSG_LEN]);
+const uint8_t *comm_can_fd_status_get(const uint8_t *frame, unsigned int len, int msg);
+bool comm_can_fd_calc_timing(uint32_t clock, uint32_t bitrate, float sample_point,
+		bool data_phase, can_fd_timing *t);
+
+#endif /* COMM_CAN_FD_H_ */
@@ -0,0 +1,163 @@
+/*
+	Copyright 2026 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "comm_can_pub.h"
+#include <string.h>
+#include <stdlib.h>
+
+// Private functions
+static void update_time(can_pub_t *p, uint32_t now);
+static void truncate_tokens(can_pub_t *p);
+
+/**
+ * @param conf
+ * Fields of the CAN_PUB_MSGS messages.
+ *
+ * @param budget
+ * Bus load all status messages of the node may use [bit/s], 0 for no limit.
+ *
+ * @param now
+ * Time that may wrap around [us].
+ */
+void comm_can_pub_init(can_pub_t *p, const can_pub_msg_conf *conf, float budget, uint32_t now) {
+	memset(p, 0, sizeof(can_pub_t));
+	memcpy(p->msg, conf, sizeof(p->msg));
+	p->token_time = now;
+	p->window_start = now;
+	comm_can_pub_set_budget(p, budget);
+	p->tokens = p->budget * CAN_PUB_BURST_TIME;
+}
+
+void comm_can_pub_set_budget(can_pub_t *p, float budget) {
+	p->budget = budget > 0.0 ? budget : 0.0;
+	truncate_tokens(p);
+}
+
+/**
+ * Decide if a status message should be sent now. When it should, the
+ * values are taken as the ones the receivers have.
+ *
+ * @param src
+ * Motor the message is about, 0 or 1.
+ *
+ * @param msg
+ * Message, 0 for CAN_PACKET_STATUS to 5 for CAN_PACKET_STATUS_6.
+ *
+ * @param value
+ * The fields, in the units they are sent in.
+ *
+ * @param period
+ * Time until the message is checked again [s].
+ *
+ * @param now
+ * Time that may wrap around [us].
+ *
+ * @return
+ * true if the message should be sent.
+ */
+bool comm_can_pub_check(can_pub_t *p, int src, int msg, const int32_t *value,
+		float period, uint32_t now) {
+	if (src < 0 || src >= CAN_PUB_SOURCES || msg < 0 || msg >= CAN_PUB_MSGS) {
+		return true;
+	}
+
+	update_time(p, now);
+
+	const can_pub_msg_conf *conf = &p->msg[msg];
+	can_pub_last_t *last = &p->last[src][msg];
+	const int bits = comm_can_pub_frame_bits(conf->len);
+	const float age = (float)(now - last->time) * 1.0e-6;
+
+	p->window_bits_fixed += bits;
+
+	bool refresh = !last->sent;
+	bool changed = false;
+
+	for (int i = 0;i < conf->fields && !refresh;i++) {
+		const can_pub_field_conf *f = &conf->field[i];
+
+		if ((age + period) > f->max_interval) {
+			refresh = true;
+		} else if ((age + 0.5 * period) >= f->min_interval &&
+				llabs((int64_t)value[i] - (int64_t)last->value[i]) > f->deadband) {
+			// The checks are about one period apart, so half a period of
+			// jitter is allowed on the min interval
+			changed = true;
+		}
+	}
+
+	bool send = refresh;
+	if (!send && changed) {
+		if (p->budget <= 0.0 || p->tokens >= (float)bits) {
+			send = true;
+		} else {
+			p->stats.over_budget++;
+		}
+	}
+
+	if (!send) {
+		p->stats.suppressed[msg]++;
+		return false;
+	}
+
+	memcpy(last->value, value, sizeof(int32_t) * conf->fields);
+	last->time = now;
+	last->sent = true;
+
+	p->stats.sent[msg]++;
+	p->window_bits += bits;
+	p->tokens -= (float)bits;
+	truncate_tokens(p);
+
+	return true;
+}
+
+/**
+ * Estimated bits on the bus for an extended frame, with a stuff bit for
+ * about every ten bits from the start of frame to the CRC.
+ */
+int comm_can_pub_frame_bits(int len) {
+	return 67 + 8 * len + (54 + 8 * len) / 10;
+}
+
+static void update_time(can_pub_t *p, uint32_t now) {
+	p->tokens += p->budget * (float)(now - p->token_time) * 1.0e-6;
+	p->token_time = now;
+	truncate_tokens(p);
+
+	const float window = (float)(now - p->window_start) * 1.0e-6;
+	if (window >= CAN_PUB_LOAD_WINDOW) {
+		p->stats.load = (float)p->window_bits / window;
+		p->stats.load_fixed = (float)p->window_bits_fixed / window;
+		p->window_bits = 0;
+		p->window_bits_fixed = 0;
+		p->window_start = now;
+	}
+}
+
+// The refreshes can take the tokens below zero, but not further than a
+// burst, so that changes go out again soon after the load drops
+static void truncate_tokens(can_pub_t *p) {
+	const float burst = p->budget * CAN_PUB_BURST_TIME;
+	if (p->tokens > burst) {
+		p->tokens = burst;
+	} else if (p->tokens < -burst) {
+		p->tokens = -burst;
+	}
+}
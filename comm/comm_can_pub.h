@@ -0,0 +1,95 @@
+/*
+	Copyright 2026 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef COMM_CAN_PUB_H_
+#define COMM_CAN_PUB_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Publish scheduler for the CAN status messages.
+ *
+ * The status threads check the messages at their configured rate, and a
+ * message only goes out when a field has changed by more than its deadband
+ * since it was sent last, or when a field would get older than its max
+ * interval before the next check. Changes are held back until the min
+ * interval of the field has passed and while the node is over its bus load
+ * budget, which is a token bucket in bits per second. Refreshes at the max
+ * interval are always sent, so that receivers that check the age of the
+ * messages keep working.
+ *
+ * Fields are compared in the integer units they are sent in. The scheduler
+ * is not locked, the caller must make sure that only one thread uses it at
+ * a time.
+ */
+
+// Settings
+#define CAN_PUB_MSGS			6		// CAN_PACKET_STATUS to CAN_PACKET_STATUS_6
+#define CAN_PUB_FIELDS			4
+#define CAN_PUB_SOURCES			2		// Motors
+#define CAN_PUB_BURST_TIME		0.1		// Budget that can be saved up [s]
+#define CAN_PUB_LOAD_WINDOW		1.0		// Time the bus load is measured over [s]
+
+typedef struct {
+	float min_interval;		// [s]
+	float max_interval;		// [s]
+	int32_t deadband;		// In the units the field is sent in
+} can_pub_field_conf;
+
+typedef struct {
+	uint8_t fields;
+	uint8_t len;			// Frame data bytes
+	can_pub_field_conf field[CAN_PUB_FIELDS];
+} can_pub_msg_conf;
+
+typedef struct {
+	int32_t value[CAN_PUB_FIELDS];
+	uint32_t time;			// [us]
+	bool sent;
+} can_pub_last_t;
+
+typedef struct {
+	uint32_t sent[CAN_PUB_MSGS];
+	uint32_t suppressed[CAN_PUB_MSGS];
+	uint32_t over_budget;	// Changes held back by the budget
+	float load;				// Status frames sent in the last window [bit/s]
+	float load_fixed;		// Sending at every check would have taken [bit/s]
+} can_pub_stats_t;
+
+typedef struct {
+	can_pub_msg_conf msg[CAN_PUB_MSGS];
+	can_pub_last_t last[CAN_PUB_SOURCES][CAN_PUB_MSGS];
+	float budget;			// [bit/s], 0 for no limit
+	float tokens;			// [bit]
+	uint32_t token_time;	// [us]
+	uint32_t window_start;	// [us]
+	uint32_t window_bits;
+	uint32_t window_bits_fixed;
+	can_pub_stats_t stats;
+} can_pub_t;
+
+// Functions
+void comm_can_pub_init(can_pub_t *p, const can_pub_msg_conf *conf, float budget, uint32_t now);
+void comm_can_pub_set_budget(can_pub_t *p, float budget);
+bool comm_can_pub_check(can_pub_t *p, int src, int msg, const int32_t *value,
+		float period, uint32_t now);
+int comm_can_pub_frame_bits(int len);
+
+#endif /* COMM_CAN_PUB_H_ */
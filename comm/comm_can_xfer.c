@@ -0,0 +1,489 @@
+/*
+	Copyright 2026 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "comm_can_xfer.h"
+#include "datatypes.h"
+#include "crc.h"
+#include <string.h>
+
+// Settings
+#define ACK_TIMEOUT				10000	// Time to wait for an ACK before asking again [us]
+#define RX_TIMEOUT				500000	// Unfinished transfers can be dropped after this time [us]
+#define MAX_TRIES				10		// Rounds of sending before a transfer is given up
+#define MAX_POLLS				10		// Polls without an answer before a transfer is given up
+#define ACK_MAP_FRAMES			48		// Frames in the bitmap of an ACK
+#define SEQ_ACK_REQ				0x80
+
+#define XFER_EID(dest, type, src, slot, gen)	((uint32_t)(dest) | ((uint32_t)(type) << 8) | \
+		((uint32_t)(src) << 16) | ((uint32_t)(slot) << 24) | ((uint32_t)(gen) << 26))
+#define XFER_FRAMES(len)		(1 + ((len) + CAN_XFER_FRAME_BYTES - 1) / CAN_XFER_FRAME_BYTES)
+
+// Private functions
+static void tx_frame(can_xfer_t *x, int slot, int seq, bool ack_req);
+static void tx_all(can_xfer_t *x, int slot);
+static can_xfer_rx_t *rx_find(can_xfer_t *x, uint8_t src, uint8_t dest, uint8_t slot,
+		uint8_t gen, uint32_t now);
+static void rx_ack(can_xfer_t *x, const can_xfer_rx_t *r, CAN_XFER_ACK state);
+static bool map_get(const uint8_t *map, int ind);
+
+/**
+ * @param time_now
+ * Present time. Called after frames are sent, so the ACK timeout starts
+ * when they have been queued.
+ *
+ * @param send_frame
+ * Send an extended frame. Can block until there is room for it.
+ *
+ * @param deliver
+ * Called with every complete buffer.
+ */
+void comm_can_xfer_init(can_xfer_t *x, can_xfer_time_func time_now,
+		can_xfer_send_func send_frame, can_xfer_deliver_func deliver, void *arg) {
+	memset(x, 0, sizeof(can_xfer_t));
+	x->time_now = time_now;
+	x->send_frame = send_frame;
+	x->deliver = deliver;
+	x->arg = arg;
+}
+
+/**
+ * @return
+ * true if eid is a data or ACK frame of a buffer transfer.
+ */
+bool comm_can_xfer_is_frame(uint32_t eid) {
+	const uint8_t type = (eid >> 8) & 0xFF;
+	return type == CAN_PACKET_BUFFER_XFER_DATA || type == CAN_PACKET_BUFFER_XFER_ACK;
+}
+
+/**
+ * Start a transfer. The buffer is copied, so it can be reused right away.
+ *
+ * @param src
+ * ID of this node.
+ *
+ * @param send
+ * Send mode, as in comm_can_send_buffer.
+ *
+ * @return
+ * false if len is too long or all slots are in use.
+ */
+bool comm_can_xfer_send(can_xfer_t *x, uint8_t src, uint8_t dest, uint8_t send,
+		const uint8_t *data, unsigned int len) {
+	if (len == 0 || len > CAN_XFER_MAX_LEN) {
+		return false;
+	}
+
+	for (int i = 0;i < CAN_XFER_SLOTS;i++) {
+		can_xfer_tx_t *t = &x->tx[i];
+		if (t->used) {
+			continue;
+		}
+
+		memcpy(t->data, data, len);
+		t->len = len;
+		t->crc = crc16(t->data, len);
+		t->src = src;
+		t->dest = dest;
+		t->send = send;
+		t->gen = x->gen_next[dest]++ & 0x07;
+		t->tries = 0;
+		t->polls = 0;
+		t->used = true;
+
+		x->stats.tx_started++;
+		tx_all(x, i);
+		return true;
+	}
+
+	return false;
+}
+
+int comm_can_xfer_in_flight(const can_xfer_t *x) {
+	int res = 0;
+	for (int i = 0;i < CAN_XFER_SLOTS;i++) {
+		if (x->tx[i].used) {
+			res++;
+		}
+	}
+	return res;
+}
+
+/**
+ * Handle an ACK addressed to this node.
+ */
+void comm_can_xfer_tx_ack(can_xfer_t *x, uint32_t eid, const uint8_t *data, int len) {
+	if (len < 1) {
+		return;
+	}
+
+	const uint8_t dest = eid & 0xFF;
+	const uint8_t src = (eid >> 16) & 0xFF;
+	const int slot = (eid >> 24) & 0x03;
+	const uint8_t gen = (eid >> 26) & 0x07;
+
+	can_xfer_tx_t *t = &x->tx[slot];
+	if (!t->used || t->src != dest || t->dest != src || t->gen != gen) {
+		return;
+	}
+
+	t->polls = 0;
+
+	switch (data[0]) {
+	case CAN_XFER_ACK_DONE:
+		if (len >= 3 && ((uint16_t)data[1] << 8 | data[2]) == t->crc) {
+			t->used = false;
+			x->stats.tx_done++;
+			break;
+		}
+
+		// The receiver has finished an earlier transfer with this slot and
+		// generation, so start over with a new generation
+		t->gen = x->gen_next[t->dest]++ & 0x07;
+		/* fall through */
+
+	case CAN_XFER_ACK_FAIL:
+		if (t->tries >= MAX_TRIES) {
+			t->used = false;
+			x->stats.tx_failed++;
+		} else {
+			tx_all(x, slot);
+		}
+		break;
+
+	case CAN_XFER_ACK_PARTIAL: {
+		if (len < 2) {
+			break;
+		}
+
+		if (t->tries >= MAX_TRIES) {
+			t->used = false;
+			x->stats.tx_failed++;
+			break;
+		}
+
+		const int frames = XFER_FRAMES(t->len);
+		const int base = data[1];
+		const int map_frames = (len - 2) * 8;
+
+		// The last frame sent asks for the next ACK
+		int last = -1;
+		for (int seq = base;seq < frames;seq++) {
+			const int ind = seq - base;
+			if (ind == 0 || ind >= map_frames || ind >= ACK_MAP_FRAMES || !map_get(data + 2, ind)) {
+				last = seq;
+			}
+		}
+
+		for (int seq = base;seq < frames;seq++) {
+			const int ind = seq - base;
+			if (ind == 0 || ind >= map_frames || ind >= ACK_MAP_FRAMES || !map_get(data + 2, ind)) {
+				tx_frame(x, slot, seq, seq == last);
+				x->stats.tx_resent++;
+			}
+		}
+
+		if (last < 0) {
+			tx_frame(x, slot, 0, true);
+		}
+
+		t->tries++;
+		t->last_time = x->time_now(x->arg);
+	} break;
+
+	default:
+		// Busy, the receiver is asked again after the timeout
+		break;
+	}
+}
+
+/**
+ * Ask for an ACK again where it did not come in time, and give up
+ * transfers that have been tried too many times. Should be called every
+ * few milliseconds.
+ *
+ * ACKs can also be late because the frames of other transfers from this
+ * node win the arbitration, so polls are counted separately from the
+ * rounds of sending data.
+ *
+ * @param failed
+ * Destinations of the transfers given up because the receiver did not
+ * answer, room for CAN_XFER_SLOTS. Can be null.
+ *
+ * @return
+ * Number of transfers given up.
+ */
+int comm_can_xfer_tx_poll(can_xfer_t *x, uint8_t *failed) {
+	const uint32_t now = x->time_now(x->arg);
+	int failed_num = 0;
+
+	for (int i = 0;i < CAN_XFER_SLOTS;i++) {
+		can_xfer_tx_t *t = &x->tx[i];
+		if (!t->used || (now - t->last_time) < ACK_TIMEOUT) {
+			continue;
+		}
+
+		if (t->polls >= MAX_POLLS) {
+			t->used = false;
+			x->stats.tx_failed++;
+			if (failed) {
+				failed[failed_num] = t->dest;
+			}
+			failed_num++;
+			continue;
+		}
+
+		// The header is small and the receiver answers it with what it has
+		tx_frame(x, i, 0, true);
+		t->polls++;
+		t->last_time = x->time_now(x->arg);
+	}
+
+	return failed_num;
+}
+
+/**
+ * Handle a data frame addressed to this node. Complete buffers are
+ * delivered from here.
+ */
+void comm_can_xfer_rx_frame(can_xfer_t *x, uint32_t eid, const uint8_t *data, int len) {
+	if (len < 1) {
+		return;
+	}
+
+	const uint32_t now = x->time_now(x->arg);
+	const uint8_t dest = eid & 0xFF;
+	const uint8_t src = (eid >> 16) & 0xFF;
+	const uint8_t slot = (eid >> 24) & 0x03;
+	const uint8_t gen = (eid >> 26) & 0x07;
+	const int seq = data[0] & ~SEQ_ACK_REQ;
+	const bool ack_req = data[0] & SEQ_ACK_REQ;
+
+	if (seq >= CAN_XFER_MAX_FRAMES) {
+		return;
+	}
+
+	can_xfer_rx_t *r = rx_find(x, src, dest, slot, gen, now);
+	if (!r) {
+		x->stats.rx_busy++;
+		if (ack_req) {
+			can_xfer_rx_t tmp;
+			tmp.src = src;
+			tmp.dest = dest;
+			tmp.slot = slot;
+			tmp.gen = gen;
+			rx_ack(x, &tmp, CAN_XFER_ACK_BUSY);
+		}
+		return;
+	}
+
+	r->last_time = now;
+
+	if (r->done) {
+		// The ACK got lost
+		if (ack_req) {
+			rx_ack(x, r, CAN_XFER_ACK_DONE);
+		}
+		return;
+	}
+
+	if (seq == 0) {
+		if (len < 6) {
+			return;
+		}
+
+		r->len = (uint16_t)data[1] << 8 | data[2];
+		r->crc = (uint16_t)data[3] << 8 | data[4];
+		r->send = data[5];
+		r->header = true;
+
+		if (r->len == 0 || r->len > CAN_XFER_MAX_LEN) {
+			rx_ack(x, r, CAN_XFER_ACK_FAIL);
+			r->used = false;
+			return;
+		}
+	} else {
+		const int offset = (seq - 1) * CAN_XFER_FRAME_BYTES;
+		const int bytes = len - 1;
+		if ((offset + bytes) > CAN_XFER_MAX_LEN) {
+			return;
+		}
+		memcpy(r->data + offset, data + 1, bytes);
+	}
+
+	r->map[seq / 8] |= 1 << (seq % 8);
+
+	const int frames = r->header ? XFER_FRAMES(r->len) : CAN_XFER_MAX_FRAMES;
+	int missing = -1;
+	for (int i = 0;i < frames;i++) {
+		if (!map_get(r->map, i)) {
+			missing = i;
+			break;
+		}
+	}
+
+	if (missing < 0) {
+		if (crc16(r->data, r->len) == r->crc) {
+			r->done = true;
+			x->stats.rx_done++;
+			rx_ack(x, r, CAN_XFER_ACK_DONE);
+			x->deliver(r->src, r->dest, r->send, r->data, r->len, x->arg);
+		} else {
+			// Start over, there is no way to tell which frame was wrong
+			x->stats.rx_crc_errors++;
+			memset(r->map, 0, sizeof(r->map));
+			r->header = false;
+			rx_ack(x, r, CAN_XFER_ACK_FAIL);
+		}
+	} else if (ack_req) {
+		rx_ack(x, r, CAN_XFER_ACK_PARTIAL);
+	}
+}
+
+static void tx_frame(can_xfer_t *x, int slot, int seq, bool ack_req) {
+	const can_xfer_tx_t *t = &x->tx[slot];
+	uint8_t buffer[8];
+	int ind = 0;
+
+	buffer[ind++] = seq | (ack_req ? SEQ_ACK_REQ : 0);
+
+	if (seq == 0) {
+		buffer[ind++] = t->len >> 8;
+		buffer[ind++] = t->len & 0xFF;
+		buffer[ind++] = t->crc >> 8;
+		buffer[ind++] = t->crc & 0xFF;
+		buffer[ind++] = t->send;
+	} else {
+		const int offset = (seq - 1) * CAN_XFER_FRAME_BYTES;
+		int bytes = t->len - offset;
+		if (bytes > CAN_XFER_FRAME_BYTES) {
+			bytes = CAN_XFER_FRAME_BYTES;
+		}
+		memcpy(buffer + ind, t->data + offset, bytes);
+		ind += bytes;
+	}
+
+	x->send_frame(XFER_EID(t->dest, CAN_PACKET_BUFFER_XFER_DATA, t->src, slot, t->gen),
+			buffer, ind, x->arg);
+	x->stats.tx_frames++;
+}
+
+static void tx_all(can_xfer_t *x, int slot) {
+	can_xfer_tx_t *t = &x->tx[slot];
+	const int frames = XFER_FRAMES(t->len);
+
+	for (int seq = 0;seq < frames;seq++) {
+		tx_frame(x, slot, seq, seq == (frames - 1));
+	}
+
+	t->tries++;
+	t->last_time = x->time_now(x->arg);
+}
+
+/*
+ * The transfer a frame belongs to. A new generation in the same slot
+ * replaces the previous transfer, as the sender only reuses a slot when it
+ * is done with it. New transfers take a free buffer, then the oldest
+ * finished one and then the oldest that has not seen a frame for
+ * RX_TIMEOUT.
+ */
+static can_xfer_rx_t *rx_find(can_xfer_t *x, uint8_t src, uint8_t dest, uint8_t slot,
+		uint8_t gen, uint32_t now) {
+	can_xfer_rx_t *res = 0;
+
+	for (int i = 0;i < CAN_XFER_RX_NUM;i++) {
+		can_xfer_rx_t *r = &x->rx[i];
+		if (r->used && r->src == src && r->dest == dest && r->slot == slot) {
+			if (r->gen == gen) {
+				return r;
+			}
+			res = r;
+			break;
+		}
+	}
+
+	if (!res) {
+		uint32_t age_max = 0;
+		for (int i = 0;i < CAN_XFER_RX_NUM;i++) {
+			can_xfer_rx_t *r = &x->rx[i];
+			if (!r->used) {
+				res = r;
+				break;
+			}
+
+			// Finished transfers are preferred by adding RX_TIMEOUT to their age
+			const uint32_t age = (now - r->last_time) + (r->done ? RX_TIMEOUT : 0);
+			if (age >= RX_TIMEOUT && age >= age_max) {
+				age_max = age;
+				res = r;
+			}
+		}
+	}
+
+	if (res) {
+		memset(res->map, 0, sizeof(res->map));
+		res->src = src;
+		res->dest = dest;
+		res->slot = slot;
+		res->gen = gen;
+		res->len = 0;
+		res->header = false;
+		res->done = false;
+		res->used = true;
+		res->last_time = now;
+	}
+
+	return res;
+}
+
+static void rx_ack(can_xfer_t *x, const can_xfer_rx_t *r, CAN_XFER_ACK state) {
+	uint8_t buffer[8];
+	int ind = 0;
+
+	buffer[ind++] = state;
+
+	if (state == CAN_XFER_ACK_PARTIAL) {
+		int base = 0;
+		while (map_get(r->map, base)) {
+			base++;
+		}
+
+		buffer[ind++] = base;
+		memset(buffer + ind, 0, ACK_MAP_FRAMES / 8);
+		for (int i = 0;i < ACK_MAP_FRAMES;i++) {
+			if (map_get(r->map, base + i)) {
+				buffer[ind + i / 8] |= 1 << (i % 8);
+			}
+		}
+		ind += ACK_MAP_FRAMES / 8;
+	} else if (state == CAN_XFER_ACK_DONE) {
+		buffer[ind++] = r->crc >> 8;
+		buffer[ind++] = r->crc & 0xFF;
+	}
+
+	x->send_frame(XFER_EID(r->src, CAN_PACKET_BUFFER_XFER_ACK, r->dest, r->slot, r->gen),
+			buffer, ind, x->arg);
+}
+
+static bool map_get(const uint8_t *map, int ind) {
+	if (ind >= CAN_XFER_MAX_FRAMES) {
+		return false;
+	}
+
+	return map[ind / 8] & (1 << (ind % 8));
+}
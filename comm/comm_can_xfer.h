@@ -0,0 +1,142 @@
+/*
+	Copyright 2026 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef COMM_CAN_XFER_H_
+#define COMM_CAN_XFER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Buffer transfers over CAN with selective retransmission.
+ *
+ * A transfer is a header frame followed by data frames with 7 bytes each,
+ * all numbered. The receiver keeps a bitmap of the frames it has and
+ * answers with the first missing frame and the bitmap after it, so that
+ * only lost frames are sent again. Up to CAN_XFER_SLOTS transfers can be
+ * in flight at the same time, also to the same node.
+ *
+ * The extended ID of the frames is
+ *
+ * bits 0 - 7:   Destination
+ * bits 8 - 15:  CAN_PACKET_BUFFER_XFER_DATA or CAN_PACKET_BUFFER_XFER_ACK
+ * bits 16 - 23: Source
+ * bits 24 - 25: Slot
+ * bits 26 - 28: Generation, which is incremented for every transfer to a node
+ *
+ * Nodes that decode the packet type as eid >> 8 ignore these frames, as the
+ * upper bits make it unknown.
+ *
+ * Data frames start with the frame number, where the highest bit asks the
+ * receiver for an ACK. Frame 0 is the header with the length, CRC16 and
+ * send mode of the buffer. The ACK contains the state, and then the first
+ * missing frame and a bitmap of the 48 frames after it for partial
+ * transfers, or the CRC of the buffer for finished ones. The CRC tells late
+ * ACKs of an earlier transfer with the same slot and generation apart.
+ *
+ * The receiving side is used from one thread only, and the sending side
+ * must be locked by the caller, as transfers are started from any thread.
+ * Transfers in flight at the same time may be delivered out of order.
+ */
+
+// Settings
+#define CAN_XFER_SLOTS			4		// Transfers in flight, set by the slot bits
+#define CAN_XFER_RX_NUM			4		// Transfers received at the same time
+#define CAN_XFER_MAX_LEN		512
+#define CAN_XFER_FRAME_BYTES	7
+#define CAN_XFER_MAX_FRAMES		(1 + (CAN_XFER_MAX_LEN + CAN_XFER_FRAME_BYTES - 1) / CAN_XFER_FRAME_BYTES)
+#define CAN_XFER_MAP_BYTES		((CAN_XFER_MAX_FRAMES + 7) / 8)
+
+// Bits in the third byte of CAN_PACKET_PONG
+#define CAN_XFER_PONG_CAP		(1 << 0)
+
+typedef enum {
+	CAN_XFER_ACK_PARTIAL = 0,
+	CAN_XFER_ACK_DONE,
+	CAN_XFER_ACK_FAIL,
+	CAN_XFER_ACK_BUSY
+} CAN_XFER_ACK;
+
+// Time in microseconds, which may wrap around
+typedef uint32_t (*can_xfer_time_func)(void *arg);
+typedef void (*can_xfer_send_func)(uint32_t eid, const uint8_t *data, uint8_t len, void *arg);
+typedef void (*can_xfer_deliver_func)(uint8_t src, uint8_t dest, uint8_t send,
+		uint8_t *data, unsigned int len, void *arg);
+
+typedef struct {
+	uint8_t data[CAN_XFER_MAX_LEN];
+	uint16_t len;
+	uint16_t crc;
+	uint8_t src, dest;
+	uint8_t send;
+	uint8_t gen;
+	bool used;
+	uint8_t tries;			// Rounds of sending data
+	uint8_t polls;			// Polls without an answer
+	uint32_t last_time;		// Last frame that asked for an ACK was queued [us]
+} can_xfer_tx_t;
+
+typedef struct {
+	uint8_t data[CAN_XFER_MAX_LEN];
+	uint8_t map[CAN_XFER_MAP_BYTES];
+	uint16_t len;
+	uint16_t crc;
+	uint8_t src, dest;
+	uint8_t slot, gen;
+	uint8_t send;
+	bool used;
+	bool header;
+	bool done;
+	uint32_t last_time;		// Last frame [us]
+} can_xfer_rx_t;
+
+typedef struct {
+	uint32_t tx_started;
+	uint32_t tx_done;
+	uint32_t tx_failed;
+	uint32_t tx_frames;
+	uint32_t tx_resent;		// Frames sent again
+	uint32_t rx_done;
+	uint32_t rx_crc_errors;
+	uint32_t rx_busy;		// Transfers refused for lack of receive buffers
+} can_xfer_stats_t;
+
+typedef struct {
+	can_xfer_time_func time_now;
+	can_xfer_send_func send_frame;
+	can_xfer_deliver_func deliver;
+	void *arg;
+	can_xfer_tx_t tx[CAN_XFER_SLOTS];
+	can_xfer_rx_t rx[CAN_XFER_RX_NUM];
+	uint8_t gen_next[256];
+	can_xfer_stats_t stats;
+} can_xfer_t;
+
+// Functions
+void comm_can_xfer_init(can_xfer_t *x, can_xfer_time_func time_now,
+		can_xfer_send_func send_frame, can_xfer_deliver_func deliver, void *arg);
+bool comm_can_xfer_is_frame(uint32_t eid);
+bool comm_can_xfer_send(can_xfer_t *x, uint8_t src, uint8_t dest, uint8_t send,
+		const uint8_t *data, unsigned int len);
+int comm_can_xfer_in_flight(const can_xfer_t *x);
+void comm_can_xfer_tx_ack(can_xfer_t *x, uint32_t eid, const uint8_t *data, int len);
+int comm_can_xfer_tx_poll(can_xfer_t *x, uint8_t *failed);
+void comm_can_xfer_rx_frame(can_xfer_t *x, uint32_t eid, const uint8_t *data, int len);
+
+#endif /* COMM_CAN_XFER_H_ */
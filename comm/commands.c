@@ -30,6 +30,7 @@
 #include "hw.h"
 #include "mcpwm.h"
 #include "mcpwm_foc.h"
+#include "foc_stage_prof.h"
 #include "app.h"
 #include "timeout.h"
 #include "servo_dec.h"
@@ -687,7 +688,53 @@ void commands_process_packet(unsigned char *data, unsigned int len,
 			raw = data[ind++];
 		}
 
-		mc_interface_sample_print_data(mode, sample_len, decimation, raw, send_func);
+		// Channels of the continuous stream, currents and phase voltages by default
+		uint16_t channels = 0x3F;
+		if (len >= (uint32_t)ind + 2) {
+			channels = buffer_get_uint16(data, &ind);
+		}
+
+		mc_interface_sample_print_data(mode, sample_len, decimation, raw, channels, send_func);
+	} break;
+
+	case COMM_CAPTURE_ARM: {
+		if (len < 26) {
+			break;
+		}
+
+		int32_t ind = 0;
+		mc_capture_config conf;
+		conf.conditions = buffer_get_uint16(data, &ind);
+		conf.channels = buffer_get_uint16(data, &ind);
+		conf.pre_samples = buffer_get_uint16(data, &ind);
+		conf.post_samples = buffer_get_uint16(data, &ind);
+		conf.decimation = data[ind++];
+		conf.current_above = buffer_get_float32_auto(data, &ind);
+		conf.erpm_below = buffer_get_float32_auto(data, &ind);
+		conf.erpm_above = buffer_get_float32_auto(data, &ind);
+		conf.angle_jump = buffer_get_float32_auto(data, &ind);
+		conf.fault_code = data[ind++];
+
+		bool ok = mc_interface_capture_arm(&conf);
+
+		ind = 0;
+		uint8_t send_buffer[8];
+		send_buffer[ind++] = packet_id;
+		send_buffer[ind++] = ok;
+		reply_func(send_buffer, ind);
+	} break;
+
+	case COMM_CAPTURE_GET: {
+		int32_t ind = 0;
+		uint16_t offset = 0;
+		uint16_t count = 0;
+
+		if (len >= 4) {
+			offset = buffer_get_uint16(data, &ind);
+			count = buffer_get_uint16(data, &ind);
+		}
+
+		mc_interface_capture_send(offset, count, reply_func);
 	} break;
 
 	case COMM_REBOOT:
@@ -1286,21 +1333,22 @@ void commands_process_packet(unsigned char *data, unsigned int len,
 		bool by_id = data[ind++];
 		int id_ind = buffer_get_int16(data, &ind);
 
+		// The table is indexed by node and can have gaps, so the index
+		// counts the power switches only
+		psw_status *stat = 0;
 		int psws_num = 0;
 		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			psw_status *stat = comm_can_get_psw_status_index(i);
-			if (stat->id >= 0) {
+			psw_status *s = comm_can_get_psw_status_index(i);
+			if (s->id >= 0) {
+				if (!by_id && psws_num == id_ind) {
+					stat = s;
+				}
 				psws_num++;
-			} else {
-				break;
 			}
 		}
 
-		psw_status *stat = 0;
 		if (by_id) {
 			stat = comm_can_get_psw_status_id(id_ind);
-		} else if (id_ind < psws_num) {
-			stat = comm_can_get_psw_status_index(id_ind);
 		}
 
 		if (stat) {
@@ -1651,6 +1699,58 @@ void commands_process_packet(unsigned char *data, unsigned int len,
 		mc_interface_release_motor_override_both();
 	} break;
 
+	case COMM_GET_FOC_STAGE_PROF: {
+		// Request: motor (1 or 2), reset after reading
+		int motor = len > 0 ? data[0] : 1;
+		bool reset = len > 1 ? data[1] : false;
+
+		foc_stage_prof_process();
+
+		foc_stage_prof_info_t info;
+		foc_stage_prof_get_info(motor, &info);
+
+		foc_stage_stats_t total;
+		foc_stage_prof_get_stats(motor, FOC_STAGE_TOTAL, &total);
+
+		uint8_t *send_buffer_global = mempools_get_packet_buffer();
+		int32_t ind = 0;
+		send_buffer_global[ind++] = packet_id;
+		send_buffer_global[ind++] = foc_stage_prof_enabled();
+		send_buffer_global[ind++] = motor;
+		buffer_append_uint32(send_buffer_global, FOC_STAGE_PROF_TICKS_PER_SEC, &ind);
+		buffer_append_uint32(send_buffer_global, info.samples, &ind);
+		buffer_append_uint32(send_buffer_global, info.dropped, &ind);
+		buffer_append_float32_auto(send_buffer_global,
+				info.elapsed > 0 ? (float)total.sum / (float)info.elapsed : 0.0, &ind);
+		send_buffer_global[ind++] = FOC_STAGE_NUM;
+		send_buffer_global[ind++] = FOC_STAGE_PROF_HIST_BINS;
+
+		// Per stage: min, avg and max in ticks, then the histogram as a fraction
+		// of the samples scaled to 65535.
+		for (int i = 0;i < FOC_STAGE_NUM;i++) {
+			foc_stage_stats_t s;
+			foc_stage_prof_get_stats(motor, i, &s);
+
+			buffer_append_uint32(send_buffer_global, s.min, &ind);
+			buffer_append_float32_auto(send_buffer_global,
+					info.samples > 0 ? (float)s.sum / (float)info.samples : 0.0, &ind);
+			buffer_append_uint32(send_buffer_global, s.max, &ind);
+
+			for (int j = 0;j < FOC_STAGE_PROF_HIST_BINS;j++) {
+				uint32_t frac = info.samples > 0 ?
+						(uint32_t)(((uint64_t)s.hist[j] * 65535) / info.samples) : 0;
+				buffer_append_uint16(send_buffer_global, frac, &ind);
+			}
+		}
+
+		reply_func(send_buffer_global, ind);
+		mempools_free_packet_buffer(send_buffer_global);
+
+		if (reset) {
+			foc_stage_prof_reset();
+		}
+	} break;
+
 	// Blocking commands. Only one of them runs at any given time, in their
 	// own thread. If other blocking commands come before the previous one has
 	// finished, they are discarded.
@@ -1712,6 +1812,7 @@ int commands_printf(const char* format, ...) {
 	return len_to_print - 1;
 }
 
+#ifdef USE_LISPBM
 int commands_printf_lisp(const char* format, ...) {
 	chMtxLock(&print_mutex);
 
@@ -1771,6 +1872,7 @@ int commands_printf_lisp(const char* format, ...) {
 
 	return len_to_print - 1;
 }
+#endif
 
 void commands_send_rotor_pos(float rotor_pos) {
 	uint8_t buffer[5];
@@ -53,6 +53,8 @@
 #define EEPROM_BASE_CUSTOM		4000
 #define EEPROM_BASE_MCCONF_2	5000
 #define EEPROM_BASE_BACKUP		6000
+#define EEPROM_BASE_MOTOR_LUT	7000
+#define EEPROM_BASE_MOTOR_LUT_2	7500
 
 // Global variables
 uint16_t VirtAddVarTab[NB_OF_VAR];
@@ -88,6 +90,11 @@ __attribute__((section(".text2"))) void conf_general_init(void) {
 		VirtAddVarTab[ind++] = EEPROM_BASE_BACKUP + i;
 	}
 
+	for (unsigned int i = 0;i < ((sizeof(motor_lut_data) + 1) / 2);i++) {
+		VirtAddVarTab[ind++] = EEPROM_BASE_MOTOR_LUT + i;
+		VirtAddVarTab[ind++] = EEPROM_BASE_MOTOR_LUT_2 + i;
+	}
+
 	FLASH_Unlock();
 	FLASH_ClearFlag(FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR |
 			FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
@@ -511,6 +518,81 @@ __attribute__((section(".text2"))) bool conf_general_store_mc_configuration(mc_c
 	return is_ok;
 }
 
+/**
+ * Read the saturation-aware motor model from EEPROM.
+ *
+ * @param lut
+ * The table to write to. It is cleared when no valid table is stored.
+ *
+ * @return
+ * true if a valid table was read.
+ */
+__attribute__((section(".text2"))) bool conf_general_read_motor_lut(motor_lut_data *lut, bool is_motor_2) {
+	uint8_t *lut_addr = (uint8_t*)lut;
+	uint16_t var;
+	unsigned int base = is_motor_2 ? EEPROM_BASE_MOTOR_LUT_2 : EEPROM_BASE_MOTOR_LUT;
+
+	memset(lut, 0, sizeof(motor_lut_data));
+
+	for (unsigned int i = 0;i < (sizeof(motor_lut_data) / 2);i++) {
+		if (EE_ReadVariable(base + i, &var) == 0) {
+			lut_addr[2 * i] = (var >> 8) & 0xFF;
+			lut_addr[2 * i + 1] = var & 0xFF;
+		} else {
+			memset(lut, 0, sizeof(motor_lut_data));
+			return false;
+		}
+	}
+
+	if (!foc_motor_lut_check(lut)) {
+		memset(lut, 0, sizeof(motor_lut_data));
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Write the saturation-aware motor model to EEPROM. Pass a cleared table
+ * to remove it.
+ */
+__attribute__((section(".text2"))) bool conf_general_store_motor_lut(motor_lut_data *lut, bool is_motor_2) {
+	mc_interface_ignore_input_both(5000);
+	mc_interface_release_motor_override_both();
+
+	if (!mc_interface_wait_for_motor_release_both(3.0)) {
+		return false;
+	}
+
+	utils_sys_lock_cnt();
+	timeout_configure_IWDT_slowest();
+
+	bool is_ok = true;
+	uint8_t *lut_addr = (uint8_t*)lut;
+	unsigned int base = is_motor_2 ? EEPROM_BASE_MOTOR_LUT_2 : EEPROM_BASE_MOTOR_LUT;
+
+	FLASH_Unlock();
+	FLASH_ClearFlag(FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR |
+			FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+
+	for (unsigned int i = 0;i < (sizeof(motor_lut_data) / 2);i++) {
+		uint16_t var = (lut_addr[2 * i] << 8) & 0xFF00;
+		var |= lut_addr[2 * i + 1] & 0xFF;
+
+		if (EE_WriteVariable(base + i, var) != FLASH_COMPLETE) {
+			is_ok = false;
+			break;
+		}
+	}
+
+	FLASH_Lock();
+	timeout_configure_IWDT();
+	mc_interface_ignore_input_both(100);
+	utils_sys_unlock_cnt();
+
+	return is_ok;
+}
+
 __attribute__((section(".text2"))) bool conf_general_detect_motor_param(float current, float min_rpm, float low_duty,
 		float *int_limit, float *bemf_coupling_k, int8_t *hall_table, int *hall_res) {
 
@@ -214,6 +214,9 @@ extern foc_profile g_foc_profile;
 #define FOC_PROFILE_LINE_FINE()
 #endif
 
+// Continuous cycle budget of the FOC ISR stages, see motor/foc_stage_prof.h
+//#define FOC_STAGE_PROF_EN
+
 // Functions
 void conf_general_init(void);
 bool conf_general_store_backup_data(void);
@@ -225,6 +228,8 @@ void conf_general_read_app_configuration(app_configuration *conf);
 bool conf_general_store_app_configuration(app_configuration *conf);
 void conf_general_read_mc_configuration(mc_configuration *conf, bool is_motor_2);
 bool conf_general_store_mc_configuration(mc_configuration *conf, bool is_motor_2);
+bool conf_general_read_motor_lut(motor_lut_data *lut, bool is_motor_2);
+bool conf_general_store_motor_lut(motor_lut_data *lut, bool is_motor_2);
 bool conf_general_detect_motor_param(float current, float min_rpm, float low_duty,
 									 float *int_limit, float *bemf_coupling_k, int8_t *hall_table, int *hall_res);
 bool conf_general_measure_flux_linkage(float current, float duty,
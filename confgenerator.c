@@ -893,6 +893,8 @@ void confgenerator_set_defaults_appconf(app_configuration *conf) {
 	conf->can_status_rate_2 = APPCONF_CAN_STATUS_RATE_2;
 	conf->can_status_msgs_r1 = APPCONF_CAN_STATUS_MSGS_R1;
 	conf->can_status_msgs_r2 = APPCONF_CAN_STATUS_MSGS_R2;
+	conf->can_status_on_change = APPCONF_CAN_STATUS_ON_CHANGE;
+	conf->can_status_budget = APPCONF_CAN_STATUS_BUDGET;
 	conf->can_baud_rate = APPCONF_CAN_BAUD_RATE;
 	conf->pairing_done = APPCONF_PAIRING_DONE;
 	conf->permanent_uart_enabled = APPCONF_PERMANENT_UART_ENABLED;
@@ -132,6 +132,7 @@ typedef enum {
 	FOC_OBSERVER_MXV,
 	FOC_OBSERVER_MXV_LAMBDA_COMP,
 	FOC_OBSERVER_MXV_LAMBDA_COMP_LIN,
+	FOC_OBSERVER_EKF,
 } mc_foc_observer_type;
 
 typedef enum {
@@ -242,9 +243,28 @@ typedef enum {
 	DEBUG_SAMPLING_TRIGGER_START_NOSEND,
 	DEBUG_SAMPLING_TRIGGER_FAULT_NOSEND,
 	DEBUG_SAMPLING_SEND_LAST_SAMPLES,
-	DEBUG_SAMPLING_SEND_SINGLE_SAMPLE
+	DEBUG_SAMPLING_SEND_SINGLE_SAMPLE,
+	DEBUG_SAMPLING_STREAM_START,
+	DEBUG_SAMPLING_STREAM_STOP
 } debug_sampling_mode;
 
+// Channels of the continuous sample stream. The stream carries the channels
+// selected by a bit mask (1 << channel) in this order.
+typedef enum {
+	DEBUG_SAMPLING_CH_CURR0 = 0,
+	DEBUG_SAMPLING_CH_CURR1,
+	DEBUG_SAMPLING_CH_CURR2,
+	DEBUG_SAMPLING_CH_PH1,
+	DEBUG_SAMPLING_CH_PH2,
+	DEBUG_SAMPLING_CH_PH3,
+	DEBUG_SAMPLING_CH_VZERO,
+	DEBUG_SAMPLING_CH_CURR_FIR,
+	DEBUG_SAMPLING_CH_F_SW,
+	DEBUG_SAMPLING_CH_STATUS,
+	DEBUG_SAMPLING_CH_PHASE,
+	DEBUG_SAMPLING_CH_NUM
+} debug_sampling_channel;
+
 typedef enum {
 	CAN_BAUD_125K = 0,
 	CAN_BAUD_250K,
@@ -267,7 +287,10 @@ typedef enum {
 typedef enum {
 	HFI_SAMPLES_8 = 0,
 	HFI_SAMPLES_16,
-	HFI_SAMPLES_32
+	HFI_SAMPLES_32,
+	HFI_SAMPLES_24,
+	HFI_SAMPLES_48,
+	HFI_SAMPLES_64
 } foc_hfi_samples;
 
 typedef enum {
@@ -362,7 +385,8 @@ typedef enum {
 typedef enum {
 	MTPA_MODE_OFF = 0,
 	MTPA_MODE_IQ_TARGET,
-	MTPA_MODE_IQ_MEASURED
+	MTPA_MODE_IQ_MEASURED,
+	MTPA_MODE_TABLE // Precomputed MTPA, field weakening and MTPV trajectory
 } MTPA_MODE;
 
 typedef enum {
@@ -895,6 +919,8 @@ typedef struct {
 	uint8_t can_status_msgs_r1;
 	uint32_t can_status_rate_2;
 	uint8_t can_status_msgs_r2;
+	bool can_status_on_change;
+	float can_status_budget;
 	CAN_BAUD can_baud_rate;
 	bool pairing_done;
 	bool permanent_uart_enabled;
@@ -1127,6 +1153,13 @@ typedef enum {
 	COMM_CAN_UPDATE_BAUD_ALL				= 158,
 
 	COMM_MOTOR_ESTOP						= 159,
+
+	COMM_GET_FOC_STAGE_PROF					= 160,
+
+	COMM_SAMPLE_STREAM						= 161,
+
+	COMM_CAPTURE_ARM						= 162,
+	COMM_CAPTURE_GET						= 163,
 } COMM_PACKET_ID;
 
 // CAN commands
@@ -1200,6 +1233,10 @@ typedef enum {
 	CAN_PACKET_BMS_STATUS_3					= 66,
 	CAN_PACKET_BMS_STATUS_4					= 67,
 	CAN_PACKET_BMS_STATUS_5					= 68,
+	CAN_PACKET_BUFFER_XFER_DATA				= 69,
+	CAN_PACKET_BUFFER_XFER_ACK				= 70,
+	CAN_PACKET_BUFFER_FD					= 71,
+	CAN_PACKET_STATUS_FD					= 72,
 	CAN_PACKET_MAKE_ENUM_32_BITS = 0xFFFFFFFF,
 } CAN_PACKET_ID;
 
@@ -1321,6 +1358,12 @@ typedef struct {
 	bool is_dsc_on;
 } psw_status;
 
+typedef struct {
+	uint32_t frames;	// Let through by the hardware filters
+	uint32_t fast;		// Control commands applied by the read thread
+	uint32_t overflows;	// Dropped because the receive ring was full
+} can_rx_stats;
+
 typedef struct {
 	uint8_t js_x;
 	uint8_t js_y;
@@ -1454,4 +1497,21 @@ typedef struct __attribute__((packed)) {
 	uint8_t dummy;
 } backup_data;
 
+// Saturation-aware motor model, stored in flash next to the motor configuration.
+// The grid spans id = -i_max .. 0 and |iq| = 0 .. i_max in equal steps.
+#define MOTOR_LUT_ID_POINTS					5
+#define MOTOR_LUT_IQ_POINTS					5
+#define MOTOR_LUT_INIT_CODE					20261018
+
+typedef struct __attribute__((packed)) {
+	uint32_t init_flag;
+	float i_max;
+	float l_scale; // H per count
+	float lambda_scale; // Wb per count
+	uint16_t ld[MOTOR_LUT_ID_POINTS][MOTOR_LUT_IQ_POINTS];
+	uint16_t lq[MOTOR_LUT_ID_POINTS][MOTOR_LUT_IQ_POINTS];
+	uint16_t lambda[MOTOR_LUT_ID_POINTS][MOTOR_LUT_IQ_POINTS];
+	uint16_t crc;
+} motor_lut_data;
+
 #endif /* DATATYPES_H_ */
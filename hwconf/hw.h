@@ -170,6 +170,26 @@
  * The hardware is missing CAN-bus.
  */
 
+/*
+ * #define HW_HAS_CAN_FD
+ *
+ * The CAN controller and transceiver can send and receive CAN-FD frames.
+ * FD frames are only used after comm_can_set_fd, as all nodes on the bus
+ * must support them. Requires defining:
+ *
+ * #define HW_CAN_FD_CLOCK				80000000 // Clock of the CAN controller [Hz]
+ * #define HW_CAN_FD_SET_MODE(fd, brs, nominal, data)
+ *   Switch between classic and FD frames, with bit rate switching when brs is
+ *   set. nominal and data are const can_fd_timing * for the arbitration and
+ *   the data phase.
+ * #define HW_CAN_FD_TRANSMIT(eid, data, len)
+ *   Send an extended FD frame, where len is a valid FD length. Evaluates to
+ *   a msg_t.
+ *
+ * The driver must call comm_can_fd_frame_received for the FD frames it
+ * receives. Classic frames still go through the ChibiOS CAN driver.
+ */
+
 /*
  * Define these to enable MPU9150 or MPU9250 support
  * on these pins.
@@ -46,6 +46,7 @@ float lispif_get_ppm(void);
 void lispif_process_cmd(unsigned char *data, unsigned int len,
 		void(*reply_func)(unsigned char *data, unsigned int len));
 void lispif_process_can(uint32_t can_id, uint8_t *data8, int len, bool is_ext);
+bool lispif_can_eid_used(void);
 void lispif_process_custom_app_data(unsigned char *data, unsigned int len);
 void lispif_process_shutdown(void);
 void lispif_process_rmsg(int slot, unsigned char *data, unsigned int len);
@@ -2104,6 +2104,34 @@ static lbm_value ext_foc_hfi_res(lbm_value *args, lbm_uint argn) {
 	return hfi_data;
 }
 
+// Without arguments (valid i-max psi-max), with a current and flux the
+// interpolated (id iq) from the MTPA table.
+static lbm_value ext_foc_mtpa_table(lbm_value *args, lbm_uint argn) {
+	LBM_CHECK_NUMBER_ALL();
+	const foc_mtpa_table_t *table = mcpwm_foc_get_mtpa_table();
+
+	if (argn == 0) {
+		lbm_value res = ENC_SYM_NIL;
+		res = lbm_cons(lbm_enc_float(table->psi_max), res);
+		res = lbm_cons(lbm_enc_float(table->i_max), res);
+		res = lbm_cons(table->valid ? ENC_SYM_TRUE : ENC_SYM_NIL, res);
+		return res;
+	} else if (argn == 2) {
+		if (!table->valid) {
+			return ENC_SYM_EERROR;
+		}
+
+		float id, iq;
+		foc_mtpa_table_lookup_psi(table, lbm_dec_as_float(args[0]), lbm_dec_as_float(args[1]), &id, &iq);
+		lbm_value res = ENC_SYM_NIL;
+		res = lbm_cons(lbm_enc_float(iq), res);
+		res = lbm_cons(lbm_enc_float(id), res);
+		return res;
+	} else {
+		return ENC_SYM_EERROR;
+	}
+}
+
 static lbm_value ext_get_duty(lbm_value *args, lbm_uint argn) {
 	(void)args; (void)argn;
 	return lbm_enc_float(mc_interface_get_duty_cycle_now());
@@ -2727,22 +2755,14 @@ static int cmp_int (const void * a, const void * b) {
 static lbm_value ext_can_list_devs(lbm_value *args, lbm_uint argn) {
 	(void)args; (void)argn;
 
+	// The table is indexed by node and can have gaps
+	int devs[CAN_STATUS_MSGS_TO_STORE];
 	int dev_num = 0;
-	can_status_msg *msg = comm_can_get_status_msg_index(dev_num);
 
-	while (msg && msg->id >= 0) {
-		dev_num++;
-		msg = comm_can_get_status_msg_index(dev_num);
-	}
-
-	int devs[dev_num];
-
-	for (int i = 0;i < dev_num;i++) {
-		msg = comm_can_get_status_msg_index(i);
-		if (msg) {
-			devs[i] = msg->id;
-		} else {
-			devs[i] = -1;
+	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
+		can_status_msg *msg = comm_can_get_status_msg_index(i);
+		if (msg && msg->id >= 0) {
+			devs[dev_num++] = msg->id;
 		}
 	}
 
@@ -6133,6 +6153,7 @@ void lispif_load_vesc_extensions(bool main_found) {
 		lbm_add_extension("get-est-res", ext_foc_est_res);
 		lbm_add_extension("get-est-ind", ext_foc_est_ind);
 		lbm_add_extension("get-hfi-res", ext_foc_hfi_res);
+		lbm_add_extension("get-mtpa-table", ext_foc_mtpa_table);
 		lbm_add_extension("get-duty", ext_get_duty);
 		lbm_add_extension("get-rpm", ext_get_rpm);
 		lbm_add_extension("get-rpm-fast", ext_get_rpm_fast);
@@ -6340,6 +6361,10 @@ void lispif_load_vesc_extensions(bool main_found) {
 	lbm_set_dynamic_load_callback(dynamic_loader);
 }
 
+bool lispif_can_eid_used(void) {
+	return can_recv_eid_cid >= 0 || event_can_eid_en;
+}
+
 void lispif_process_can(uint32_t can_id, uint8_t *data8, int len, bool is_ext) {
 	if (is_ext) {
 		if (can_recv_eid_cid < 0 && !event_can_eid_en)  {
@@ -0,0 +1,137 @@
+/*
+	Copyright 2026 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "foc_dt_comp.h"
+#include "utils_math.h"
+#include <math.h>
+
+// Private functions
+static int map_point(const foc_dt_comp_t *map, float i, float *frac);
+
+/**
+ * Start over from the fixed dead time model, where the applied voltage
+ * lags the command by err_fixed against the direction of the current.
+ * Learning and the enabled state are kept.
+ *
+ * @param i_range
+ * Current span of the map [A].
+ *
+ * @param err_fixed
+ * Error of the fixed model in modulation units, foc_dt_us * 1e-6 * foc_f_zv.
+ */
+void foc_dt_comp_reset(foc_dt_comp_t *map, float i_range, float err_fixed) {
+	if (i_range < 0.1) {
+		i_range = 0.1;
+	}
+
+	map->i_range = i_range;
+	map->i_scale = (float)(FOC_DT_COMP_POINTS - 1) / (2.0 * i_range);
+
+	for (int ph = 0;ph < 3;ph++) {
+		for (int i = 0;i < FOC_DT_COMP_POINTS;i++) {
+			map->err[ph][i] = -SIGN(foc_dt_comp_grid_current(map, i)) * err_fixed;
+			map->hits[ph][i] = 0;
+		}
+	}
+}
+
+/**
+ * Phase current of map point ind [A].
+ */
+float foc_dt_comp_grid_current(const foc_dt_comp_t *map, int ind) {
+	return -map->i_range + (float)ind / map->i_scale;
+}
+
+/**
+ * Compensation for the phase currents, in modulation units. Add it to the
+ * modulation that goes to foc_svm to get the commanded voltage on the motor.
+ */
+void foc_dt_comp_get(const foc_dt_comp_t *map, float ia, float ib, float ic, float *mod_alpha, float *mod_beta) {
+	float f;
+	int k;
+
+	k = map_point(map, ia, &f);
+	const float ea = map->err[0][k] + f * (map->err[0][k + 1] - map->err[0][k]);
+	k = map_point(map, ib, &f);
+	const float eb = map->err[1][k] + f * (map->err[1][k + 1] - map->err[1][k]);
+	k = map_point(map, ic, &f);
+	const float ec = map->err[2][k] + f * (map->err[2][k + 1] - map->err[2][k]);
+
+	// alpha = 2/3*a - 1/3*b - 1/3*c
+	// beta  = 1/sqrt(3)*b - 1/sqrt(3)*c
+	*mod_alpha = -(1.0 / 3.0) * (2.0 * ea - eb - ec);
+	*mod_beta = -ONE_BY_SQRT3 * (eb - ec);
+}
+
+/**
+ * Move the map towards an observed voltage error. Called from the ISR.
+ *
+ * @param res_alpha, res_beta
+ * Error left after the compensation in modulation units, the voltage the
+ * motor model needs minus what the current controller commands.
+ *
+ * @param gain
+ * Fraction of the error taken over per call.
+ */
+void foc_dt_comp_learn(foc_dt_comp_t *map, float ia, float ib, float ic,
+		float res_alpha, float res_beta, float gain) {
+	const float res[3] = {
+			res_alpha,
+			-0.5 * res_alpha + SQRT3_BY_2 * res_beta,
+			-0.5 * res_alpha - SQRT3_BY_2 * res_beta
+	};
+	const float i[3] = {ia, ib, ic};
+
+	for (int ph = 0;ph < 3;ph++) {
+		float f;
+		const int k = map_point(map, i[ph], &f);
+		map->err[ph][k] += gain * (1.0 - f) * res[ph];
+		map->err[ph][k + 1] += gain * f * res[ph];
+		map->hits[ph][f < 0.5 ? k : k + 1]++;
+	}
+}
+
+/**
+ * Change the fixed dead time part of the map and keep what was learned on
+ * top of it, e.g. when the switching frequency changes. Called from the ISR.
+ *
+ * @param err_fixed_diff
+ * Change of the err_fixed the map was reset with.
+ */
+void foc_dt_comp_move_fixed(foc_dt_comp_t *map, float err_fixed_diff) {
+	for (int ph = 0;ph < 3;ph++) {
+		for (int i = 0;i < FOC_DT_COMP_POINTS;i++) {
+			map->err[ph][i] -= SIGN(foc_dt_comp_grid_current(map, i)) * err_fixed_diff;
+		}
+	}
+}
+
+// Lower map point and the fraction towards the next one
+static int map_point(const foc_dt_comp_t *map, float i, float *frac) {
+	float x = (i + map->i_range) * map->i_scale;
+	utils_truncate_number(&x, 0.0, (float)(FOC_DT_COMP_POINTS - 1));
+
+	int k = (int)x;
+	if (k > FOC_DT_COMP_POINTS - 2) {
+		k = FOC_DT_COMP_POINTS - 2;
+	}
+
+	*frac = x - (float)k;
+	return k;
+}
@@ -0,0 +1,63 @@
+/*
+	Copyright 2026 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef MOTOR_FOC_DT_COMP_H_
+#define MOTOR_FOC_DT_COMP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Dead time and switch voltage drop compensation.
+ *
+ * For every phase the map holds the error between the commanded and the
+ * applied phase voltage as a function of the phase current, from -i_range
+ * to i_range. Beyond that the edge values are used. The error is stored in
+ * the same unit as the modulation, where 1 is 2/3 of the bus voltage, so
+ * that the dead time part stays valid when the bus voltage changes.
+ *
+ * The map starts from the fixed model given by foc_dt_us and is learned
+ * while the motor runs slowly: the voltage the current controller needs
+ * beyond what the motor model explains is taken as the inverter error and
+ * moves the two map points around each phase current towards it. Only the
+ * difference between the phases is observable, which is also all that
+ * reaches the motor.
+ */
+
+#define FOC_DT_COMP_POINTS			16
+#define FOC_DT_COMP_RANGE_FACTOR	0.25 // i_range relative to l_current_max
+
+typedef struct {
+	bool enabled;
+	bool learn;
+	float i_range;			// [A]
+	float i_scale;			// Map steps per A
+	float err[3][FOC_DT_COMP_POINTS];
+	uint32_t hits[3][FOC_DT_COMP_POINTS];
+} foc_dt_comp_t;
+
+// Functions
+void foc_dt_comp_reset(foc_dt_comp_t *map, float i_range, float err_fixed);
+float foc_dt_comp_grid_current(const foc_dt_comp_t *map, int ind);
+void foc_dt_comp_get(const foc_dt_comp_t *map, float ia, float ib, float ic, float *mod_alpha, float *mod_beta);
+void foc_dt_comp_learn(foc_dt_comp_t *map, float ia, float ib, float ic,
+		float res_alpha, float res_beta, float gain);
+void foc_dt_comp_move_fixed(foc_dt_comp_t *map, float err_fixed_diff);
+
+#endif /* MOTOR_FOC_DT_COMP_H_ */
@@ -0,0 +1,220 @@
+/*
+	Copyright 2026 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "foc_fsw_adapt.h"
+#include "utils_math.h"
+#include <math.h>
+#include <string.h>
+
+// Settings
+#define LEARN_PERIOD			0.1		// Model update period [s]
+#define FORGET					0.998	// Per model update
+#define P_INIT					1.0e4	// Initial covariance [degC^2]
+#define VALID_UPDATES			50		// Model updates before the model is used
+#define VALID_BOUND				0.2		// Largest loss coefficient bound relative to the coefficient
+#define RDS_TEMPCO				0.005	// On-resistance increase per degC
+#define HYSTERESIS				0.1		// Relative frequency change that is acted on
+#define HOLD_TIME				0.2		// Shortest time between changes [s]
+
+// Private functions
+static void loss_terms(const foc_fsw_adapt_t *fa, float i_abs, float v_bus, float l,
+		float f, float temp_fet, float *cond, float *sw);
+static float coeff_bound(const foc_fsw_adapt_t *fa, int ind);
+static void rls_update(foc_fsw_adapt_t *fa, const float *phi, float y);
+
+/**
+ * Start without a model, at f_max.
+ *
+ * @param i_ref
+ * Current the loss terms are scaled to, e.g. l_current_max [A].
+ *
+ * @param v_ref
+ * Voltage the switching loss term is scaled to, e.g. l_max_vin [V].
+ *
+ * @param tau
+ * Thermal time constant from the losses to the FET temperature reading [s].
+ */
+void foc_fsw_adapt_init(foc_fsw_adapt_t *fa, float f_min, float f_max,
+		float i_ref, float v_ref, float tau) {
+	memset(fa, 0, sizeof(foc_fsw_adapt_t));
+
+	fa->f_min = f_min;
+	fa->f_max = f_max;
+	fa->i_ref = i_ref;
+	fa->v_ref = v_ref;
+	fa->tau = tau;
+	fa->f_now = f_max;
+
+	for (int i = 0;i < FOC_FSW_ADAPT_PARAMS;i++) {
+		fa->P[i][i] = P_INIT;
+	}
+}
+
+/**
+ * Add a sample of the operating point and the FET temperature. Called
+ * from a thread.
+ *
+ * @param l
+ * Motor inductance [H].
+ *
+ * @param f
+ * Present zero vector frequency [Hz].
+ */
+void foc_fsw_adapt_learn(foc_fsw_adapt_t *fa, float i_abs, float v_bus, float l,
+		float f, float temp_fet, float dt) {
+	if (f <= 0.0 || l <= 0.0) {
+		return;
+	}
+
+	float cond, sw;
+	loss_terms(fa, i_abs, v_bus, l, f, temp_fet, &cond, &sw);
+
+	if (fa->updates == 0 && fa->learn_time == 0.0) {
+		// Assume that the temperature has settled at the first sample
+		fa->cond_lp = cond;
+		fa->sw_lp = sw;
+		fa->theta[0] = temp_fet;
+	}
+
+	const float alpha = fminf(dt / fa->tau, 1.0);
+	UTILS_LP_FAST(fa->cond_lp, cond, alpha);
+	UTILS_LP_FAST(fa->sw_lp, sw, alpha);
+
+	fa->learn_time += dt;
+	if (fa->learn_time >= LEARN_PERIOD) {
+		fa->learn_time -= LEARN_PERIOD;
+		const float phi[FOC_FSW_ADAPT_PARAMS] = {1.0, fa->cond_lp, fa->sw_lp};
+		rls_update(fa, phi, temp_fet);
+		fa->updates++;
+	}
+}
+
+/**
+ * The model is used once both loss coefficients are positive and the data
+ * has narrowed them down.
+ */
+bool foc_fsw_adapt_model_valid(const foc_fsw_adapt_t *fa) {
+	return fa->updates >= VALID_UPDATES &&
+			fa->theta[1] > 0.0 && fa->theta[2] > 0.0 &&
+			coeff_bound(fa, 1) < (VALID_BOUND * fa->theta[1]) &&
+			coeff_bound(fa, 2) < (VALID_BOUND * fa->theta[2]);
+}
+
+/**
+ * Frequency with the lowest FET losses at an operating point, within
+ * f_min and f_max. f_max without a valid model.
+ */
+float foc_fsw_adapt_optimum(const foc_fsw_adapt_t *fa, float i_abs, float v_bus, float l,
+		float temp_fet) {
+	if (!foc_fsw_adapt_model_valid(fa) || i_abs <= 0.0 || v_bus <= 0.0 || l <= 0.0) {
+		return fa->f_max;
+	}
+
+	const float k_cond = fa->theta[1] * (1.0 + RDS_TEMPCO * (temp_fet - 25.0)) / SQ(fa->i_ref);
+	const float k_sw = fa->theta[2] / (fa->v_ref * fa->i_ref * fa->f_max);
+	const float ripple_f = v_bus / (2.0 * l); // Ripple times frequency [A/s]
+
+	float f = cbrtf(k_cond * SQ(ripple_f) / (6.0 * k_sw * v_bus * i_abs));
+	utils_truncate_number(&f, fa->f_min, fa->f_max);
+	return f;
+}
+
+/**
+ * Move towards a target frequency. Changes smaller than the hysteresis,
+ * and changes within the hold time after the previous one, are ignored.
+ * Leaving the limits or the floor is corrected right away.
+ *
+ * @param f_floor
+ * Lowest frequency the controller needs now, e.g. for the electrical
+ * frequency [Hz]. Followed right away.
+ *
+ * @return
+ * The frequency to run at [Hz].
+ */
+float foc_fsw_adapt_update(foc_fsw_adapt_t *fa, float f_target, float f_floor, float dt) {
+	f_target = fmaxf(f_target, f_floor);
+	utils_truncate_number(&f_target, fa->f_min, fa->f_max);
+
+	fa->hold = fmaxf(fa->hold - dt, 0.0);
+
+	if (fa->f_now < f_floor || fa->f_now > fa->f_max || fa->f_now < fa->f_min) {
+		fa->f_now = f_target;
+		fa->hold = HOLD_TIME;
+	} else if (fa->hold <= 0.0 && fabsf(f_target - fa->f_now) > (HYSTERESIS * fa->f_now)) {
+		fa->f_now = f_target;
+		fa->hold = HOLD_TIME;
+	}
+
+	return fa->f_now;
+}
+
+static void loss_terms(const foc_fsw_adapt_t *fa, float i_abs, float v_bus, float l,
+		float f, float temp_fet, float *cond, float *sw) {
+	const float ripple = v_bus / (2.0 * l * f);
+	*cond = (1.0 + RDS_TEMPCO * (temp_fet - 25.0)) * (SQ(i_abs) + SQ(ripple) / 12.0) / SQ(fa->i_ref);
+	*sw = v_bus * i_abs * f / (fa->v_ref * fa->i_ref * fa->f_max);
+}
+
+// Two standard deviations, where the part of the initial uncertainty that
+// the data has not removed yet counts as well
+static float coeff_bound(const foc_fsw_adapt_t *fa, int ind) {
+	const float p = fa->P[ind][ind];
+	return 2.0 * fmaxf(sqrtf(p * fa->res_var), p / sqrtf(P_INIT));
+}
+
+static void rls_update(foc_fsw_adapt_t *fa, const float *phi, float y) {
+	float p_phi[FOC_FSW_ADAPT_PARAMS];
+	float den = FORGET;
+	float pred = 0.0;
+	for (int i = 0;i < FOC_FSW_ADAPT_PARAMS;i++) {
+		p_phi[i] = 0.0;
+		for (int j = 0;j < FOC_FSW_ADAPT_PARAMS;j++) {
+			p_phi[i] += fa->P[i][j] * phi[j];
+		}
+		den += phi[i] * p_phi[i];
+		pred += phi[i] * fa->theta[i];
+	}
+
+	const float err = y - pred;
+
+	fa->res_weight = FORGET * fa->res_weight + 1.0;
+	fa->res_var += (err * err - fa->res_var) / fa->res_weight;
+
+	float p_max = 0.0;
+	for (int i = 0;i < FOC_FSW_ADAPT_PARAMS;i++) {
+		fa->theta[i] += p_phi[i] / den * err;
+
+		for (int j = i;j < FOC_FSW_ADAPT_PARAMS;j++) {
+			fa->P[i][j] -= p_phi[i] * p_phi[j] / den;
+			fa->P[j][i] = fa->P[i][j];
+		}
+
+		p_max = fmaxf(p_max, fa->P[i][i]);
+	}
+
+	// Forget only while no variance is above its initial size, as it would
+	// grow without limit at a constant operating point
+	if (p_max < P_INIT) {
+		for (int i = 0;i < FOC_FSW_ADAPT_PARAMS;i++) {
+			for (int j = 0;j < FOC_FSW_ADAPT_PARAMS;j++) {
+				fa->P[i][j] /= FORGET;
+			}
+		}
+	}
+}
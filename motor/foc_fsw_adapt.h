@@ -0,0 +1,86 @@
+/*
+	Copyright 2026 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef MOTOR_FOC_FSW_ADAPT_H_
+#define MOTOR_FOC_FSW_ADAPT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Switching frequency from a loss model of the inverter.
+ *
+ * The FET losses at the zero vector frequency f are modeled as
+ *
+ * P = k_cond * (1 + alpha * (T - 25)) * (I^2 + di^2 / 12) + k_sw * V * I * f
+ *
+ * with the peak to peak current ripple di = V / (2 * L * f) and the FET
+ * temperature T. The first term is conduction in the on-resistance, which
+ * rises with the temperature, the second the switching losses. k_cond and
+ * k_sw depend on the hardware, so they are fitted to the measured FET
+ * temperature as
+ *
+ * T = t_amb + k_cond * cond + k_sw * sw
+ *
+ * where cond and sw are the two loss terms filtered with the thermal time
+ * constant. The coefficients include the thermal resistance, which does
+ * not matter as only their ratio sets the frequency with the lowest loss.
+ * That is where the ripple loss that falls with f meets the switching loss
+ * that rises with it:
+ *
+ * f^3 = k_cond * (1 + alpha * (T - 25)) * (V / (2 * L))^2 / (6 * k_sw * V * I)
+ *
+ * At low current that is above f_max, so standstill and light load run at
+ * the highest frequency and the lowest ripple.
+ *
+ * The model is used once both coefficients are positive and their
+ * confidence bounds, from the covariance and the variance of the
+ * prediction error, are narrow compared to them. Until then the frequency
+ * stays at f_max.
+ */
+
+#define FOC_FSW_ADAPT_PARAMS		3
+
+typedef struct {
+	float f_min, f_max;		// [Hz]
+	float i_ref, v_ref;		// Scale of the loss terms [A], [V]
+	float tau;				// Thermal time constant [s]
+	float cond_lp;			// Loss terms through the thermal time constant, relative
+	float sw_lp;			// to i_ref^2 and v_ref * i_ref * f_max
+	float theta[FOC_FSW_ADAPT_PARAMS]; // t_amb, k_cond, k_sw [degC]
+	float P[FOC_FSW_ADAPT_PARAMS][FOC_FSW_ADAPT_PARAMS];
+	float res_var;			// Prediction error variance [degC^2]
+	float res_weight;		// Weight the variance is averaged over
+	float learn_time;		// Since the last model update [s]
+	uint32_t updates;
+	float f_now;			// [Hz]
+	float hold;				// Time left before the next change [s]
+} foc_fsw_adapt_t;
+
+// Functions
+void foc_fsw_adapt_init(foc_fsw_adapt_t *fa, float f_min, float f_max,
+		float i_ref, float v_ref, float tau);
+void foc_fsw_adapt_learn(foc_fsw_adapt_t *fa, float i_abs, float v_bus, float l,
+		float f, float temp_fet, float dt);
+bool foc_fsw_adapt_model_valid(const foc_fsw_adapt_t *fa);
+float foc_fsw_adapt_optimum(const foc_fsw_adapt_t *fa, float i_abs, float v_bus, float l,
+		float temp_fet);
+float foc_fsw_adapt_update(foc_fsw_adapt_t *fa, float f_target, float f_floor, float dt);
+
+#endif /* MOTOR_FOC_FSW_ADAPT_H_ */
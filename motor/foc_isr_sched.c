@@ -0,0 +1,191 @@
+/*
+	Copyright 2026 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "foc_isr_sched.h"
+#include "foc_stage_prof.h"
+#include <string.h>
+
+// Private functions
+static uint32_t us_to_ticks(float us);
+
+/**
+ * Start with no tasks.
+ *
+ * @param budget_us
+ * Time all tasks of one ISR cycle may take together [us].
+ */
+void foc_isr_sched_init(foc_isr_sched_t *sched, float budget_us) {
+	memset(sched, 0, sizeof(foc_isr_sched_t));
+	sched->budget = us_to_ticks(budget_us);
+
+	// The tasks are timed with the same counter as the stage profiler,
+	// which only starts it when it is enabled.
+#ifndef USE_PC_BUILD
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+/**
+ * Add a task. Do this before the ISR starts calling foc_isr_sched_run.
+ *
+ * @param period
+ * Run the task every period ISR cycles. Must be a power of two up to
+ * FOC_ISR_SCHED_MAX_PERIOD.
+ *
+ * @param cost_us
+ * Declared worst case duration of one run [us].
+ *
+ * @return
+ * The index of the task, or -1 if the period is invalid or there is no
+ * room for more tasks.
+ */
+int foc_isr_sched_add(foc_isr_sched_t *sched, const char *name, foc_isr_task_func func,
+		int period, float cost_us) {
+	if (sched->task_num >= FOC_ISR_SCHED_MAX_TASKS || period < 1 ||
+			period > FOC_ISR_SCHED_MAX_PERIOD || (period & (period - 1)) != 0) {
+		return -1;
+	}
+
+	const uint32_t cost = us_to_ticks(cost_us);
+
+	// Phase with the lowest worst case in the cycles the task would run in
+	int phase_best = 0;
+	uint32_t worst_best = UINT32_MAX;
+	for (int phase = 0;phase < period;phase++) {
+		uint32_t worst = 0;
+		for (int cycle = phase;cycle < FOC_ISR_SCHED_MAX_PERIOD;cycle += period) {
+			const uint32_t slot = foc_isr_sched_slot_cost(sched, cycle);
+			if (slot > worst) {
+				worst = slot;
+			}
+		}
+
+		if (worst < worst_best) {
+			worst_best = worst;
+			phase_best = phase;
+		}
+	}
+
+	foc_isr_task_t *t = &sched->tasks[sched->task_num];
+	memset(t, 0, sizeof(foc_isr_task_t));
+	t->name = name;
+	t->func = func;
+	t->period = period;
+	t->phase = phase_best;
+	t->cost = cost;
+
+	return sched->task_num++;
+}
+
+/**
+ * Run the tasks that are due in this cycle. Called once per ISR.
+ *
+ * @param arg
+ * Passed on to the tasks.
+ *
+ * @param dt
+ * Time of one ISR cycle [s].
+ */
+void foc_isr_sched_run(foc_isr_sched_t *sched, void *arg, float dt) {
+	const uint32_t cycle = sched->cycle++;
+	uint32_t total = 0;
+	bool ran = false;
+
+	for (int i = 0;i < sched->task_num;i++) {
+		foc_isr_task_t *t = &sched->tasks[i];
+		if ((cycle & (t->period - 1)) != t->phase) {
+			continue;
+		}
+
+		const uint32_t start = foc_stage_prof_now();
+		t->func(arg, dt * (float)t->period);
+		const uint32_t ticks = foc_stage_prof_now() - start;
+
+		t->runs++;
+		if (ticks > t->max) {
+			t->max = ticks;
+		}
+		if (ticks > t->cost) {
+			t->overruns++;
+		}
+
+		total += ticks;
+		ran = true;
+	}
+
+	if (ran) {
+		sched->cycles++;
+		if (total > sched->max) {
+			sched->max = total;
+		}
+		if (total > sched->budget) {
+			sched->overruns++;
+		}
+	}
+}
+
+/**
+ * Declared cost of the tasks that run in a cycle [ticks].
+ */
+uint32_t foc_isr_sched_slot_cost(const foc_isr_sched_t *sched, int cycle) {
+	uint32_t cost = 0;
+	for (int i = 0;i < sched->task_num;i++) {
+		const foc_isr_task_t *t = &sched->tasks[i];
+		if ((cycle & (t->period - 1)) == t->phase) {
+			cost += t->cost;
+		}
+	}
+	return cost;
+}
+
+/**
+ * Highest declared cost of any cycle [ticks]. Compare it with the budget
+ * to see if the schedule fits.
+ */
+uint32_t foc_isr_sched_worst_slot(const foc_isr_sched_t *sched) {
+	uint32_t worst = 0;
+	for (int cycle = 0;cycle < FOC_ISR_SCHED_MAX_PERIOD;cycle++) {
+		const uint32_t cost = foc_isr_sched_slot_cost(sched, cycle);
+		if (cost > worst) {
+			worst = cost;
+		}
+	}
+	return worst;
+}
+
+void foc_isr_sched_reset_stats(foc_isr_sched_t *sched) {
+	for (int i = 0;i < sched->task_num;i++) {
+		sched->tasks[i].runs = 0;
+		sched->tasks[i].overruns = 0;
+		sched->tasks[i].max = 0;
+	}
+
+	sched->cycles = 0;
+	sched->overruns = 0;
+	sched->max = 0;
+}
+
+float foc_isr_sched_ticks_to_us(uint32_t ticks) {
+	return (float)ticks * (1.0e6 / (float)FOC_STAGE_PROF_TICKS_PER_SEC);
+}
+
+static uint32_t us_to_ticks(float us) {
+	return (uint32_t)(us * ((float)FOC_STAGE_PROF_TICKS_PER_SEC / 1.0e6));
+}
@@ -0,0 +1,78 @@
+/*
+	Copyright 2026 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef MOTOR_FOC_ISR_SCHED_H_
+#define MOTOR_FOC_ISR_SCHED_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Multi-rate tasks in the FOC ADC ISR.
+ *
+ * Work that does not need the full control rate runs every period ISR
+ * cycles, where the period is a power of two. When a task is added it gets
+ * the phase within its period where the declared worst case costs of all
+ * tasks that can run in the same cycle add up to the least, so that the
+ * load is spread over the cycles. The schedule only depends on the order
+ * the tasks are added in.
+ *
+ * Every run is timed. A run that takes longer than the declared cost of
+ * the task and a cycle where all tasks together take longer than the
+ * budget are counted as overruns.
+ */
+
+#define FOC_ISR_SCHED_MAX_TASKS		8
+#define FOC_ISR_SCHED_MAX_PERIOD	64 // Power of two
+
+// Called with the time since the previous run, period * the ISR dt
+typedef void (*foc_isr_task_func)(void *arg, float dt);
+
+typedef struct {
+	const char *name;
+	foc_isr_task_func func;
+	uint16_t period;		// ISR cycles
+	uint16_t phase;			// Cycle within the period the task runs in
+	uint32_t cost;			// Declared worst case [ticks]
+	uint32_t runs;
+	uint32_t overruns;		// Runs longer than the declared cost
+	uint32_t max;			// Longest run [ticks]
+} foc_isr_task_t;
+
+typedef struct {
+	foc_isr_task_t tasks[FOC_ISR_SCHED_MAX_TASKS];
+	int task_num;
+	uint32_t cycle;
+	uint32_t budget;		// All tasks of one cycle together [ticks]
+	uint32_t cycles;		// Cycles where at least one task ran
+	uint32_t overruns;		// Cycles over the budget
+	uint32_t max;			// Longest cycle [ticks]
+} foc_isr_sched_t;
+
+// Functions
+void foc_isr_sched_init(foc_isr_sched_t *sched, float budget_us);
+int foc_isr_sched_add(foc_isr_sched_t *sched, const char *name, foc_isr_task_func func,
+		int period, float cost_us);
+void foc_isr_sched_run(foc_isr_sched_t *sched, void *arg, float dt);
+uint32_t foc_isr_sched_slot_cost(const foc_isr_sched_t *sched, int cycle);
+uint32_t foc_isr_sched_worst_slot(const foc_isr_sched_t *sched);
+void foc_isr_sched_reset_stats(foc_isr_sched_t *sched);
+float foc_isr_sched_ticks_to_us(uint32_t ticks);
+
+#endif /* MOTOR_FOC_ISR_SCHED_H_ */
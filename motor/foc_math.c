@@ -20,6 +20,11 @@
 #include "foc_math.h"
 #include "utils_math.h"
 #include <math.h>
+#include <string.h>
+
+// Private functions
+static float observer_ekf_update(float v_alpha, float v_beta, float i_alpha, float i_beta,
+		float dt, float R, float L, float lambda, observer_state *state);
 
 // See http://cas.ensmp.fr/~praly/Telechargement/Journaux/2010-IEEE_TPEL-Lee-Hong-Nam-Ortega-Praly-Astolfi.pdf
 void foc_observer_update(float v_alpha, float v_beta, float i_alpha, float i_beta,
@@ -71,6 +76,16 @@ void foc_observer_update(float v_alpha, float v_beta, float i_alpha, float i_bet
 	}
 
 	float ld_lq_diff = conf_now->foc_motor_ld_lq_diff;
+
+	// The online estimates belong to the present operating point and
+	// temperature, so they replace both compensations above.
+	if (motor->m_param_est_active) {
+		R = motor->m_param_est_now.r;
+		L = 0.5 * (motor->m_param_est_now.ld + motor->m_param_est_now.lq);
+		lambda = motor->m_param_est_now.lambda;
+		ld_lq_diff = motor->m_param_est_now.lq - motor->m_param_est_now.ld;
+	}
+
 	float id = motor->m_motor_state.id;
 	float iq = motor->m_motor_state.iq;
 
@@ -84,6 +99,7 @@ void foc_observer_update(float v_alpha, float v_beta, float i_alpha, float i_bet
 	const float R_ia = R * i_alpha;
 	const float R_ib = R * i_beta;
 	const float gamma_half = motor->m_gamma_now * 0.5;
+	float ekf_theta = 0.0;
 
 	switch (conf_now->foc_observer_type) {
 	case FOC_OBSERVER_ORTEGA_ORIGINAL: {
@@ -195,6 +211,17 @@ void foc_observer_update(float v_alpha, float v_beta, float i_alpha, float i_bet
 		}
 		break;
 
+	case FOC_OBSERVER_EKF:
+		ekf_theta = observer_ekf_update(v_alpha, v_beta, i_alpha, i_beta, dt, R, L, lambda, state);
+
+		// Keep the rotor flux in x1 and x2 for the code that uses them
+		utils_fast_sincos_better(ekf_theta, &state->x2, &state->x1);
+		state->x1 *= lambda;
+		state->x2 *= lambda;
+		L_ia = 0.0;
+		L_ib = 0.0;
+		break;
+
 	default:
 		break;
 	}
@@ -213,7 +240,11 @@ void foc_observer_update(float v_alpha, float v_beta, float i_alpha, float i_bet
 	}
 
 	if (phase) {
-		*phase = utils_fast_atan2(state->x2 - L_ib, state->x1 - L_ia);
+		if (conf_now->foc_observer_type == FOC_OBSERVER_EKF) {
+			*phase = ekf_theta;
+		} else {
+			*phase = utils_fast_atan2(state->x2 - L_ib, state->x1 - L_ia);
+		}
 	}
 
 	// Can we clamp the flux in dq with q flux = 0 and d flux is lambda
@@ -221,6 +252,144 @@ void foc_observer_update(float v_alpha, float v_beta, float i_alpha, float i_bet
 	// The d flux each time would have a residual after transform from ab to dq. This can be used as an input to the flux estimator
 }
 
+/*
+ * Set the rotor flux of the observer from outside, e.g. from an open loop
+ * or HFI angle. The EKF keeps its own angle and only reads x1 and x2 when
+ * it starts, so its angle is seeded from the flux as well.
+ */
+void foc_observer_set_flux(float x1, float x2, observer_state *state) {
+	state->x1 = x1;
+	state->x2 = x2;
+
+	if (state->ekf_init) {
+		state->ekf_x[3] = utils_fast_atan2(x2, x1);
+	}
+}
+
+/*
+ * Extended Kalman filter on the stator current model in the alpha-beta frame
+ * with the states x = [i_alpha, i_beta, omega, theta]:
+ *
+ * di_alpha/dt = (v_alpha - R * i_alpha + omega * lambda * sin(theta)) / L
+ * di_beta/dt  = (v_beta  - R * i_beta  - omega * lambda * cos(theta)) / L
+ * domega/dt   = 0 (the load shows up as process noise)
+ * dtheta/dt   = omega
+ *
+ * The measured currents are the first two states, so the update only needs
+ * a 2x2 inverse. All matrices are fixed size and F is written out with its
+ * zeros and ones, which keeps this cheap enough for the ISR. Returns theta.
+ */
+static float observer_ekf_update(float v_alpha, float v_beta, float i_alpha, float i_beta,
+		float dt, float R, float L, float lambda, observer_state *state) {
+	float *x = state->ekf_x;
+	float (*P)[4] = state->ekf_p;
+
+	if (!state->ekf_init) {
+		memset(x, 0, sizeof(state->ekf_x));
+		memset(P, 0, sizeof(state->ekf_p));
+
+		// Start from the flux of the previous observer if there is one
+		x[0] = i_alpha;
+		x[1] = i_beta;
+		if (NORM2_f(state->x1, state->x2) > (lambda * 0.5)) {
+			x[3] = utils_fast_atan2(state->x2 - L * i_beta, state->x1 - L * i_alpha);
+		}
+
+		P[0][0] = SQ(FOC_EKF_I_NOISE);
+		P[1][1] = SQ(FOC_EKF_I_NOISE);
+		P[2][2] = SQ(FOC_EKF_ACC_NOISE * 0.01);
+		P[3][3] = SQ(M_PI);
+		state->ekf_init = true;
+	}
+
+	const float dt_L = dt / L;
+	const float w = x[2];
+
+	// The voltage is held over the period while the rotor turns, so the
+	// back EMF is taken at the middle of it. Otherwise the estimate lags by
+	// half a period at speed.
+	float s, c;
+	utils_fast_sincos_better(x[3] + 0.5 * w * dt, &s, &c);
+
+	// Prediction
+	x[0] += (v_alpha - R * x[0] + w * lambda * s) * dt_L;
+	x[1] += (v_beta - R * x[1] - w * lambda * c) * dt_L;
+	x[3] += w * dt;
+	utils_norm_angle_rad(&x[3]);
+
+	// F = [a 0 f02 f03; 0 a f12 f13; 0 0 1 0; 0 0 dt 1]
+	const float a = 1.0 - R * dt_L;
+	const float f02 = lambda * s * dt_L;
+	const float f03 = w * lambda * c * dt_L;
+	const float f12 = -lambda * c * dt_L;
+	const float f13 = w * lambda * s * dt_L;
+
+	// P = F * P * F' + Q
+	float FP[4][4];
+	for (int j = 0;j < 4;j++) {
+		FP[0][j] = a * P[0][j] + f02 * P[2][j] + f03 * P[3][j];
+		FP[1][j] = a * P[1][j] + f12 * P[2][j] + f13 * P[3][j];
+		FP[2][j] = P[2][j];
+		FP[3][j] = dt * P[2][j] + P[3][j];
+	}
+
+	for (int i = 0;i < 4;i++) {
+		P[i][0] = a * FP[i][0] + f02 * FP[i][2] + f03 * FP[i][3];
+		P[i][1] = a * FP[i][1] + f12 * FP[i][2] + f13 * FP[i][3];
+		P[i][2] = FP[i][2];
+		P[i][3] = dt * FP[i][2] + FP[i][3];
+	}
+
+	const float q_i = SQ(FOC_EKF_V_NOISE * dt_L);
+	P[0][0] += q_i;
+	P[1][1] += q_i;
+	P[2][2] += SQ(FOC_EKF_ACC_NOISE * dt);
+
+	// K = P * H' * (H * P * H' + R_meas)^-1, with H selecting the currents
+	const float r = SQ(FOC_EKF_I_NOISE);
+	const float s00 = P[0][0] + r;
+	const float s01 = 0.5 * (P[0][1] + P[1][0]);
+	const float s11 = P[1][1] + r;
+	const float det_inv = 1.0 / (s00 * s11 - s01 * s01);
+
+	float K[4][2];
+	for (int i = 0;i < 4;i++) {
+		K[i][0] = (P[i][0] * s11 - P[i][1] * s01) * det_inv;
+		K[i][1] = (P[i][1] * s00 - P[i][0] * s01) * det_inv;
+	}
+
+	// Update
+	const float e0 = i_alpha - x[0];
+	const float e1 = i_beta - x[1];
+	for (int i = 0;i < 4;i++) {
+		x[i] += K[i][0] * e0 + K[i][1] * e1;
+	}
+	utils_norm_angle_rad(&x[3]);
+
+	// P = (I - K * H) * P, kept symmetric
+	float P0[4], P1[4];
+	for (int j = 0;j < 4;j++) {
+		P0[j] = P[0][j];
+		P1[j] = P[1][j];
+	}
+
+	for (int i = 0;i < 4;i++) {
+		for (int j = i;j < 4;j++) {
+			P[i][j] -= K[i][0] * P0[j] + K[i][1] * P1[j];
+			P[j][i] = P[i][j];
+		}
+	}
+
+	// Start over if the filter diverged
+	const float chk = x[2] + x[3] + P[2][2] + P[3][3];
+	if (!UTILS_IS_NAN(chk) && !UTILS_IS_INF(chk)) {
+		return x[3];
+	}
+
+	state->ekf_init = false;
+	return 0.0;
+}
+
 void foc_pll_run(float phase, float dt, float *phase_var,
 					float *speed_var, mc_configuration *conf) {
 	UTILS_NAN_ZERO(*phase_var);
@@ -700,6 +869,12 @@ float foc_correct_hall(float angle, float dt, motor_all_state_t *motor, int hall
 }
 
 void foc_run_fw(motor_all_state_t *motor, float dt) {
+	// The MTPA table already contains field weakening
+	if (motor->m_conf->foc_mtpa_mode == MTPA_MODE_TABLE && motor->m_mtpa_table.valid) {
+		motor->m_i_fw_set = 0.0;
+		return;
+	}
+
 	if (motor->m_conf->foc_fw_current_max < fmaxf(motor->m_conf->cc_min_current, 0.001)) {
 		return;
 	}
@@ -763,4 +938,16 @@ void foc_precalc_values(motor_all_state_t *motor) {
 	motor->p_v2_v3_inv_avg_half = (0.5 / motor->p_lq + 0.5 / motor->p_ld) * 0.9; // With the 0.9 we undo the adjustment from the detection
 	motor->m_observer_state.lambda_est = conf_now->foc_motor_flux_linkage;
 	motor->p_duty_norm = TWO_BY_SQRT3 / conf_now->foc_overmod_factor;
+	foc_motor_lut_precalc(&motor->m_lut, &motor->m_lut_data, conf_now);
+	motor->m_lut_now_valid = false;
+
+	motor->p_mtpa_v_scale = ONE_BY_SQRT3 * conf_now->l_max_duty *
+			conf_now->foc_overmod_factor * FOC_MTPA_TABLE_V_MARGIN;
+
+	if (conf_now->foc_mtpa_mode == MTPA_MODE_TABLE) {
+		foc_mtpa_table_generate(&motor->m_mtpa_table, motor->p_ld, motor->p_lq,
+				conf_now->foc_motor_flux_linkage, conf_now->l_current_max);
+	} else {
+		motor->m_mtpa_table.valid = false;
+	}
 }
@@ -21,6 +21,13 @@
 #define FOC_MATH_H_
 
 #include "datatypes.h"
+#include "foc_motor_lut.h"
+#include "foc_mtpa_table.h"
+#include "foc_dt_comp.h"
+#include "foc_isr_sched.h"
+#include "foc_param_est.h"
+#include "foc_fsw_adapt.h"
+#include "utils_math.h"
 
 // Types
 typedef struct {
@@ -72,14 +79,11 @@ typedef struct {
 } mc_sample_t;
 
 typedef struct {
-	void(*fft_bin0_func)(float*, float*, float*);
-	void(*fft_bin1_func)(float*, float*, float*);
-	void(*fft_bin2_func)(float*, float*, float*);
+	utils_dft_t dft; // Also the injection directions, one per sample
 
 	int samples;
-	int table_fact;
-	float buffer[32];
-	float buffer_current[32];
+	float buffer[UTILS_DFT_MAX_LEN];
+	float buffer_current[UTILS_DFT_MAX_LEN];
 	bool ready;
 	int ind;
 	bool is_samp_n;
@@ -100,8 +104,24 @@ typedef struct {
 	float lambda_est;
 	float i_alpha_last;
 	float i_beta_last;
+
+	// FOC_OBSERVER_EKF
+	bool ekf_init;
+	float ekf_x[4];		// i_alpha, i_beta, omega, theta
+	float ekf_p[4][4];	// Error covariance
 } observer_state;
 
+// Noise levels for FOC_OBSERVER_EKF, can be overridden with build defines
+#ifndef FOC_EKF_V_NOISE
+#define FOC_EKF_V_NOISE			0.5		// Voltage model error per sample [V]
+#endif
+#ifndef FOC_EKF_I_NOISE
+#define FOC_EKF_I_NOISE			0.2		// Current measurement noise [A]
+#endif
+#ifndef FOC_EKF_ACC_NOISE
+#define FOC_EKF_ACC_NOISE		2e5		// Electrical acceleration the speed has to follow [rad/s^2]
+#endif
+
 #define MC_AUDIO_CHANNELS	4
 
 typedef enum {
@@ -242,11 +262,65 @@ typedef struct {
 	float p_inv_ld_lq; // (1.0/lq - 1.0/ld)
 	float p_v2_v3_inv_avg_half; // (0.5/ld + 0.5/lq)
 	float p_duty_norm;
+	float p_mtpa_v_scale; // Voltage the MTPA table may use per volt bus voltage
+
+	// Saturation-aware motor model
+	motor_lut_data m_lut_data;
+	foc_motor_lut_t m_lut;
+	foc_motor_lut_point m_lut_now; // At the present operating point, valid while m_lut_active
+	bool m_lut_now_valid; // m_lut_now was looked up in the present table
+	bool m_lut_active;
+	foc_motor_lut_probe_t m_lut_probe;
+	bool m_lut_probe_q; // Probe the q axis instead of the d axis
+
+	// MTPA, field weakening and MTPV trajectory
+	foc_mtpa_table_t m_mtpa_table;
+
+	// Inverter nonlinearity compensation
+	foc_dt_comp_t m_dt_comp;
+	float m_dt_comp_i_max; // l_current_max, foc_dt_us and switching frequency the map is for
+	float m_dt_comp_dt_us;
+	float m_dt_comp_f_zv;
+	bool m_dt_comp_active; // The modulation of this period includes the compensation below
+	float m_dt_comp_mod_alpha;
+	float m_dt_comp_mod_beta;
+	bool m_dt_comp_learn_now; // Learn from the state of this period
+
+	// Tasks in the ISR that run slower than the current control
+	foc_isr_sched_t m_isr_sched;
+
+	// Online estimation of R, Ld, Lq and the flux linkage
+	foc_param_est_t m_param_est; // Updated from the timer thread only
+	foc_param_est_ring_t m_param_est_ring;
+	foc_param_est_sample_t m_param_est_prev; // Period the next sample starts with
+	bool m_param_est_prev_valid;
+	int m_param_est_decim; // Periods since the last sample
+	float m_param_est_angle; // Frame rotation since the last sample
+	foc_param_est_sample_t m_param_est_pending; // Waits for the rest of its speed window
+	bool m_param_est_pending_valid;
+	float m_param_est_angle_pending; // Frame rotation over the window before the pending sample
+	float m_param_est_phase_last;
+	bool m_param_est_enabled;
+	bool m_param_est_apply;
+	bool m_param_est_reset; // Start over in the timer thread
+	foc_param_est_point m_param_est_now; // Used instead of the configuration while m_param_est_active, written under lock
+	bool m_param_est_active;
+
+	// Switching frequency
+	float m_f_zv; // Zero vector frequency the timer runs at [Hz]
+	float m_f_zv_conf; // foc_f_zv the timer was last set up for [Hz]
+	foc_fsw_adapt_t m_fsw; // Updated from the timer thread only
+	bool m_fsw_enabled;
+	bool m_fsw_reset; // Start over in the timer thread
+	float m_fsw_f_min_set, m_fsw_f_max_set; // As requested, 0 for the defaults [Hz]
+	volatile uint32_t m_fsw_top_next; // Timer top for the ISR to switch to, 0 for none
+	volatile float m_fsw_f_next;
 } motor_all_state_t;
 
 // Functions
 void foc_observer_update(float v_alpha, float v_beta, float i_alpha, float i_beta,
 		float dt, observer_state *state, float *phase, motor_all_state_t *motor);
+void foc_observer_set_flux(float x1, float x2, observer_state *state);
 void foc_pll_run(float phase, float dt, float *phase_var,
 		float *speed_var, mc_configuration *conf);
 void foc_svm(float alpha, float beta, float max_mod, uint32_t PWMFullDutyCycle,
@@ -0,0 +1,287 @@
+/*
+	Copyright 2026 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "foc_motor_lut.h"
+#include "utils_math.h"
+#include "crc.h"
+#include <string.h>
+#include <math.h>
+
+// Private functions
+static uint16_t calc_crc(const motor_lut_data *data);
+static uint16_t to_counts(float value, float scale);
+static float table_max(float table[MOTOR_LUT_ID_POINTS][MOTOR_LUT_IQ_POINTS]);
+
+/**
+ * Check that data holds a table that was stored by foc_motor_lut_pack.
+ */
+bool foc_motor_lut_check(const motor_lut_data *data) {
+	return data->init_flag == MOTOR_LUT_INIT_CODE &&
+			data->crc == calc_crc(data) &&
+			data->i_max > 0.0 &&
+			data->l_scale > 0.0 &&
+			data->lambda_scale > 0.0;
+}
+
+/**
+ * Quantize a measured table for storage.
+ *
+ * @param i_max
+ * The current the grid spans, see foc_motor_lut_grid_id and
+ * foc_motor_lut_grid_iq.
+ *
+ * @param ld, lq, lambda
+ * Values at the grid points [H] and [Wb].
+ */
+void foc_motor_lut_pack(motor_lut_data *data, float i_max,
+		float ld[MOTOR_LUT_ID_POINTS][MOTOR_LUT_IQ_POINTS],
+		float lq[MOTOR_LUT_ID_POINTS][MOTOR_LUT_IQ_POINTS],
+		float lambda[MOTOR_LUT_ID_POINTS][MOTOR_LUT_IQ_POINTS]) {
+	memset(data, 0, sizeof(motor_lut_data));
+
+	data->init_flag = MOTOR_LUT_INIT_CODE;
+	data->i_max = i_max;
+	data->l_scale = fmaxf(table_max(ld), table_max(lq)) / 65535.0;
+	data->lambda_scale = table_max(lambda) / 65535.0;
+
+	if (data->l_scale <= 0.0) {
+		data->l_scale = 1e-12;
+	}
+
+	if (data->lambda_scale <= 0.0) {
+		data->lambda_scale = 1e-12;
+	}
+
+	for (int i = 0;i < MOTOR_LUT_ID_POINTS;i++) {
+		for (int j = 0;j < MOTOR_LUT_IQ_POINTS;j++) {
+			data->ld[i][j] = to_counts(ld[i][j], data->l_scale);
+			data->lq[i][j] = to_counts(lq[i][j], data->l_scale);
+			data->lambda[i][j] = to_counts(lambda[i][j], data->lambda_scale);
+		}
+	}
+
+	data->crc = calc_crc(data);
+}
+
+/**
+ * Expand a stored table for the control loop. The proportional current
+ * controller gains are scaled with the inductance at every point, so that
+ * the loop bandwidth tuned for foc_motor_l holds over the whole table.
+ * The table stays disabled when data is not valid.
+ */
+void foc_motor_lut_precalc(foc_motor_lut_t *lut, const motor_lut_data *data, const mc_configuration *conf) {
+	lut->valid = false;
+
+	if (!foc_motor_lut_check(data) || conf->foc_motor_l <= 0.0) {
+		return;
+	}
+
+	const float kp_per_l = conf->foc_current_kp / conf->foc_motor_l;
+
+	for (int i = 0;i < MOTOR_LUT_ID_POINTS;i++) {
+		for (int j = 0;j < MOTOR_LUT_IQ_POINTS;j++) {
+			foc_motor_lut_point *p = &lut->p[i][j];
+			p->ld = (float)data->ld[i][j] * data->l_scale;
+			p->lq = (float)data->lq[i][j] * data->l_scale;
+			p->lambda = (float)data->lambda[i][j] * data->lambda_scale;
+			p->kp_d = kp_per_l * p->ld;
+			p->kp_q = kp_per_l * p->lq;
+		}
+	}
+
+	lut->i_max = data->i_max;
+	lut->id_scale = (float)(MOTOR_LUT_ID_POINTS - 1) / data->i_max;
+	lut->iq_scale = (float)(MOTOR_LUT_IQ_POINTS - 1) / data->i_max;
+	lut->valid = true;
+}
+
+/**
+ * Bilinear interpolation at an operating point. Currents outside the
+ * grid use its edge, positive id the id = 0 column and negative iq the
+ * same point as positive iq.
+ */
+void foc_motor_lut_lookup(const foc_motor_lut_t *lut, float id, float iq, foc_motor_lut_point *res) {
+	float x = (id + lut->i_max) * lut->id_scale;
+	float y = fabsf(iq) * lut->iq_scale;
+	utils_truncate_number(&x, 0.0, (float)(MOTOR_LUT_ID_POINTS - 1));
+	utils_truncate_number(&y, 0.0, (float)(MOTOR_LUT_IQ_POINTS - 1));
+
+	int xi = (int)x;
+	int yi = (int)y;
+	if (xi > MOTOR_LUT_ID_POINTS - 2) {
+		xi = MOTOR_LUT_ID_POINTS - 2;
+	}
+	if (yi > MOTOR_LUT_IQ_POINTS - 2) {
+		yi = MOTOR_LUT_IQ_POINTS - 2;
+	}
+
+	const float fx = x - (float)xi;
+	const float fy = y - (float)yi;
+	const float w00 = (1.0 - fx) * (1.0 - fy);
+	const float w01 = (1.0 - fx) * fy;
+	const float w10 = fx * (1.0 - fy);
+	const float w11 = fx * fy;
+
+	const foc_motor_lut_point *p00 = &lut->p[xi][yi];
+	const foc_motor_lut_point *p01 = &lut->p[xi][yi + 1];
+	const foc_motor_lut_point *p10 = &lut->p[xi + 1][yi];
+	const foc_motor_lut_point *p11 = &lut->p[xi + 1][yi + 1];
+
+	res->ld = w00 * p00->ld + w01 * p01->ld + w10 * p10->ld + w11 * p11->ld;
+	res->lq = w00 * p00->lq + w01 * p01->lq + w10 * p10->lq + w11 * p11->lq;
+	res->lambda = w00 * p00->lambda + w01 * p01->lambda + w10 * p10->lambda + w11 * p11->lambda;
+	res->kp_d = w00 * p00->kp_d + w01 * p01->kp_d + w10 * p10->kp_d + w11 * p11->kp_d;
+	res->kp_q = w00 * p00->kp_q + w01 * p01->kp_q + w10 * p10->kp_q + w11 * p11->kp_q;
+}
+
+/**
+ * D axis current of grid row ind, from -i_max to 0.
+ */
+float foc_motor_lut_grid_id(float i_max, int ind) {
+	return -i_max + i_max * (float)ind / (float)(MOTOR_LUT_ID_POINTS - 1);
+}
+
+/**
+ * Q axis current of grid column ind, from 0 to i_max.
+ */
+float foc_motor_lut_grid_iq(float i_max, int ind) {
+	return i_max * (float)ind / (float)(MOTOR_LUT_IQ_POINTS - 1);
+}
+
+/**
+ * Start an inductance measurement. Previous results are discarded.
+ *
+ * @param v_inj
+ * Amplitude of the square wave [V].
+ *
+ * @param half_len
+ * Length of each half wave in control periods.
+ *
+ * @param skip
+ * Periods after each edge that are left out, to cover the delay between
+ * computing a voltage and the current responding to it.
+ */
+void foc_motor_lut_probe_start(foc_motor_lut_probe_t *probe, float v_inj, int half_len, int skip) {
+	probe->active = false;
+
+	probe->v_inj = v_inj;
+	probe->half_len = half_len;
+	probe->skip = skip;
+	probe->cnt = 0;
+	probe->sign_last = 0;
+	probe->use_last = false;
+	probe->i_last = 0.0;
+	for (int i = 0;i < 2;i++) {
+		probe->v_sum[i] = 0.0;
+		probe->di_sum[i] = 0.0;
+		probe->num[i] = 0;
+	}
+
+	probe->active = true;
+}
+
+/**
+ * Run the probe for one control period. Called from the ISR.
+ *
+ * @param i_meas
+ * Current of the probed axis, sampled at the end of the last period.
+ *
+ * @param v_applied
+ * Voltage on the probed axis over the last period, including the injection.
+ *
+ * @return
+ * The injection voltage to add to the probed axis for the next period.
+ */
+float foc_motor_lut_probe_step(foc_motor_lut_probe_t *probe, float i_meas, float v_applied, float dt) {
+	if (!probe->active) {
+		return 0.0;
+	}
+
+	if (probe->use_last) {
+		const int half = probe->sign_last > 0 ? 0 : 1;
+		probe->v_sum[half] += v_applied;
+		probe->di_sum[half] += (i_meas - probe->i_last) / dt;
+		probe->num[half]++;
+	}
+
+	const bool first_half = probe->cnt < probe->half_len;
+	const int pos = first_half ? probe->cnt : probe->cnt - probe->half_len;
+
+	probe->sign_last = first_half ? 1 : -1;
+	probe->use_last = pos >= probe->skip;
+	probe->i_last = i_meas;
+
+	probe->cnt++;
+	if (probe->cnt >= 2 * probe->half_len) {
+		probe->cnt = 0;
+	}
+
+	return (float)probe->sign_last * probe->v_inj;
+}
+
+/**
+ * Periods collected so far, the smaller count of both half waves.
+ */
+int foc_motor_lut_probe_samples(const foc_motor_lut_probe_t *probe) {
+	return probe->num[0] < probe->num[1] ? probe->num[0] : probe->num[1];
+}
+
+/**
+ * Incremental inductance from the collected periods.
+ *
+ * @return
+ * false if there is not enough data or the current did not respond.
+ */
+bool foc_motor_lut_probe_result(const foc_motor_lut_probe_t *probe, float *inductance) {
+	if (foc_motor_lut_probe_samples(probe) == 0) {
+		return false;
+	}
+
+	const float v_diff = probe->v_sum[0] / (float)probe->num[0] - probe->v_sum[1] / (float)probe->num[1];
+	const float di_diff = probe->di_sum[0] / (float)probe->num[0] - probe->di_sum[1] / (float)probe->num[1];
+
+	if (di_diff <= 0.0 || v_diff <= 0.0) {
+		return false;
+	}
+
+	*inductance = v_diff / di_diff;
+	return true;
+}
+
+static uint16_t calc_crc(const motor_lut_data *data) {
+	return crc16((unsigned char*)data, sizeof(motor_lut_data) - sizeof(data->crc));
+}
+
+static uint16_t to_counts(float value, float scale) {
+	float counts = value / scale + 0.5;
+	utils_truncate_number(&counts, 0.0, 65535.0);
+	return (uint16_t)counts;
+}
+
+static float table_max(float table[MOTOR_LUT_ID_POINTS][MOTOR_LUT_IQ_POINTS]) {
+	float max = 0.0;
+	for (int i = 0;i < MOTOR_LUT_ID_POINTS;i++) {
+		for (int j = 0;j < MOTOR_LUT_IQ_POINTS;j++) {
+			if (table[i][j] > max) {
+				max = table[i][j];
+			}
+		}
+	}
+	return max;
+}
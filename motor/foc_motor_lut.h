@@ -0,0 +1,92 @@
+/*
+	Copyright 2026 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef MOTOR_FOC_MOTOR_LUT_H_
+#define MOTOR_FOC_MOTOR_LUT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "datatypes.h"
+
+/*
+ * Saturation-aware motor model.
+ *
+ * Ld, Lq and the flux linkage are stored as a function of the operating point
+ * in motor_lut_data. When the table is loaded, every grid point is expanded
+ * to floats together with the current controller gains scaled for the local
+ * inductance, so the control loop only interpolates between four points.
+ *
+ * The probe measures the incremental inductance of one axis while the
+ * current controller holds a bias current. It adds a square wave voltage
+ * above the current controller bandwidth and compares the current slopes
+ * of both half periods:
+ *
+ * L = (v_pos - v_neg) / (di/dt_pos - di/dt_neg)
+ *
+ * The resistive drop and the controller output cancel as they are the same
+ * in both halves.
+ */
+
+typedef struct {
+	float ld;
+	float lq;
+	float lambda;
+	float kp_d;
+	float kp_q;
+} foc_motor_lut_point;
+
+typedef struct {
+	bool valid;
+	float i_max;
+	float id_scale; // Grid steps per A
+	float iq_scale;
+	foc_motor_lut_point p[MOTOR_LUT_ID_POINTS][MOTOR_LUT_IQ_POINTS];
+} foc_motor_lut_t;
+
+typedef struct {
+	volatile bool active;
+	float v_inj;
+	int half_len;			// Periods per half wave
+	int skip;				// Periods after each edge that are not used
+	int cnt;
+	int sign_last;
+	bool use_last;
+	float i_last;
+	float v_sum[2];
+	float di_sum[2];
+	volatile int num[2];
+} foc_motor_lut_probe_t;
+
+// Functions
+bool foc_motor_lut_check(const motor_lut_data *data);
+void foc_motor_lut_pack(motor_lut_data *data, float i_max,
+		float ld[MOTOR_LUT_ID_POINTS][MOTOR_LUT_IQ_POINTS],
+		float lq[MOTOR_LUT_ID_POINTS][MOTOR_LUT_IQ_POINTS],
+		float lambda[MOTOR_LUT_ID_POINTS][MOTOR_LUT_IQ_POINTS]);
+void foc_motor_lut_precalc(foc_motor_lut_t *lut, const motor_lut_data *data, const mc_configuration *conf);
+void foc_motor_lut_lookup(const foc_motor_lut_t *lut, float id, float iq, foc_motor_lut_point *res);
+float foc_motor_lut_grid_id(float i_max, int ind);
+float foc_motor_lut_grid_iq(float i_max, int ind);
+
+void foc_motor_lut_probe_start(foc_motor_lut_probe_t *probe, float v_inj, int half_len, int skip);
+float foc_motor_lut_probe_step(foc_motor_lut_probe_t *probe, float i_meas, float v_applied, float dt);
+int foc_motor_lut_probe_samples(const foc_motor_lut_probe_t *probe);
+bool foc_motor_lut_probe_result(const foc_motor_lut_probe_t *probe, float *inductance);
+
+#endif /* MOTOR_FOC_MOTOR_LUT_H_ */
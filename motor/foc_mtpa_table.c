@@ -0,0 +1,239 @@
+/*
+	Copyright 2026 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "foc_mtpa_table.h"
+#include "utils_math.h"
+#include <math.h>
+
+// Settings
+#define BISECT_ITERATIONS		30
+#define GOLDEN_ITERATIONS		40
+
+typedef struct {
+	float ld;
+	float lq;
+	float lambda;
+} motor_params;
+
+// Private functions
+static float torque(const motor_params *p, float id, float iq);
+static float flux(const motor_params *p, float id, float iq);
+static void mtpa_point(const motor_params *p, float i, float *id, float *iq);
+
+/**
+ * Find the operating point with the most torque within the current and
+ * voltage limit, see foc_mtpa_table.h. Torque is positive, the caller
+ * applies the sign.
+ *
+ * @param i
+ * Current limit [A].
+ *
+ * @param psi
+ * Flux limit, available voltage over electrical speed [Wb].
+ *
+ * @param id, iq
+ * The operating point. When the limits do not overlap this is the full
+ * current on the d axis, which is as close to the voltage limit as the
+ * current limit allows.
+ */
+void foc_mtpa_table_solve(float ld, float lq, float lambda, float i, float psi, float *id, float *iq) {
+	const motor_params p = {ld, lq, lambda};
+
+	*id = 0.0;
+	*iq = 0.0;
+
+	if (i <= 0.0) {
+		return;
+	}
+
+	float id_mtpa, iq_mtpa;
+	mtpa_point(&p, i, &id_mtpa, &iq_mtpa);
+	if (flux(&p, id_mtpa, iq_mtpa) <= psi) {
+		*id = id_mtpa;
+		*iq = iq_mtpa;
+		return;
+	}
+
+	*id = -i;
+	float torque_best = -1.0;
+
+	// Field weakening on the current limit, with s = -id / i. From the MTPA
+	// point the flux decreases along the circle up to s = 1 when lq >= ld,
+	// otherwise it has its minimum where the derivative is zero.
+	float s_min = -id_mtpa / i;
+	float s_max = 1.0;
+	if (ld > lq) {
+		const float s_flux_min = ld * lambda / (i * (SQ(ld) - SQ(lq)));
+		if (s_flux_min < 1.0) {
+			s_max = s_flux_min;
+		}
+	}
+
+	if (s_max > s_min && flux(&p, -i * s_max, i * sqrtf(1.0 - SQ(s_max))) <= psi) {
+		for (int k = 0;k < BISECT_ITERATIONS;k++) {
+			const float s = 0.5 * (s_min + s_max);
+			if (flux(&p, -i * s, i * sqrtf(1.0 - SQ(s))) > psi) {
+				s_min = s;
+			} else {
+				s_max = s;
+			}
+		}
+
+		*id = -i * s_max;
+		*iq = i * sqrtf(1.0 - SQ(s_max));
+		torque_best = torque(&p, *id, *iq);
+	}
+
+	// Maximum torque per voltage on the voltage limit, parametrized as
+	// ld * id + lambda = psi * cos(t), lq * iq = psi * sin(t)
+	float a = 0.0;
+	float b = M_PI;
+	for (int k = 0;k < GOLDEN_ITERATIONS;k++) {
+		const float c = b - 0.618034 * (b - a);
+		const float d = a + 0.618034 * (b - a);
+		const float tc = torque(&p, (psi * cosf(c) - lambda) / ld, psi * sinf(c) / lq);
+		const float td = torque(&p, (psi * cosf(d) - lambda) / ld, psi * sinf(d) / lq);
+		if (tc > td) {
+			b = d;
+		} else {
+			a = c;
+		}
+	}
+
+	const float t = 0.5 * (a + b);
+	const float id_mtpv = (psi * cosf(t) - lambda) / ld;
+	const float iq_mtpv = psi * sinf(t) / lq;
+	if ((SQ(id_mtpv) + SQ(iq_mtpv)) <= SQ(i) * 1.0001 && torque(&p, id_mtpv, iq_mtpv) > torque_best) {
+		*id = id_mtpv;
+		*iq = iq_mtpv;
+	}
+}
+
+/**
+ * Fill a table for currents up to i_max. Takes some milliseconds, so call
+ * it from a thread. The table is invalid while it is generated and is only
+ * generated again when the parameters changed.
+ */
+void foc_mtpa_table_generate(foc_mtpa_table_t *table, float ld, float lq, float lambda, float i_max) {
+	if (table->valid && table->ld == ld && table->lq == lq &&
+			table->lambda == lambda && table->i_max == i_max) {
+		return;
+	}
+
+	table->valid = false;
+
+	if (ld <= 0.0 || lq <= 0.0 || lambda <= 0.0 || i_max <= 0.0) {
+		return;
+	}
+
+	const motor_params p = {ld, lq, lambda};
+	float id_mtpa, iq_mtpa;
+	mtpa_point(&p, i_max, &id_mtpa, &iq_mtpa);
+
+	table->ld = ld;
+	table->lq = lq;
+	table->lambda = lambda;
+	table->i_max = i_max;
+	table->psi_max = flux(&p, id_mtpa, iq_mtpa) * 1.001;
+	table->i_scale = (float)(FOC_MTPA_TABLE_I_POINTS - 1) / i_max;
+	table->psi_scale = (float)(FOC_MTPA_TABLE_PSI_POINTS - 1) / table->psi_max;
+
+	for (int i = 0;i < FOC_MTPA_TABLE_I_POINTS;i++) {
+		for (int j = 0;j < FOC_MTPA_TABLE_PSI_POINTS;j++) {
+			foc_mtpa_table_solve(ld, lq, lambda,
+					(float)i / table->i_scale, (float)j / table->psi_scale,
+					&table->id[i][j], &table->iq[i][j]);
+		}
+	}
+
+	table->valid = true;
+}
+
+/**
+ * Operating point for a current command in the control loop.
+ *
+ * @param i
+ * Commanded current magnitude [A].
+ *
+ * @param v_avail
+ * Voltage available for the back EMF and the inductive drop [V].
+ *
+ * @param we
+ * Electrical speed [rad/s].
+ */
+void foc_mtpa_table_lookup(const foc_mtpa_table_t *table, float i, float v_avail, float we, float *id, float *iq) {
+	float psi = table->psi_max;
+	const float we_abs = fabsf(we);
+	if (we_abs * psi > v_avail) {
+		psi = v_avail > 0.0 ? v_avail / we_abs : 0.0;
+	}
+
+	foc_mtpa_table_lookup_psi(table, i, psi, id, iq);
+}
+
+/**
+ * Bilinear interpolation in the table. Values beyond the grid use its edge.
+ */
+void foc_mtpa_table_lookup_psi(const foc_mtpa_table_t *table, float i, float psi, float *id, float *iq) {
+	float x = i * table->i_scale;
+	float y = psi * table->psi_scale;
+	utils_truncate_number(&x, 0.0, (float)(FOC_MTPA_TABLE_I_POINTS - 1));
+	utils_truncate_number(&y, 0.0, (float)(FOC_MTPA_TABLE_PSI_POINTS - 1));
+
+	int xi = (int)x;
+	int yi = (int)y;
+	if (xi > FOC_MTPA_TABLE_I_POINTS - 2) {
+		xi = FOC_MTPA_TABLE_I_POINTS - 2;
+	}
+	if (yi > FOC_MTPA_TABLE_PSI_POINTS - 2) {
+		yi = FOC_MTPA_TABLE_PSI_POINTS - 2;
+	}
+
+	const float fx = x - (float)xi;
+	const float fy = y - (float)yi;
+	const float w00 = (1.0 - fx) * (1.0 - fy);
+	const float w01 = (1.0 - fx) * fy;
+	const float w10 = fx * (1.0 - fy);
+	const float w11 = fx * fy;
+
+	*id = w00 * table->id[xi][yi] + w01 * table->id[xi][yi + 1] +
+			w10 * table->id[xi + 1][yi] + w11 * table->id[xi + 1][yi + 1];
+	*iq = w00 * table->iq[xi][yi] + w01 * table->iq[xi][yi + 1] +
+			w10 * table->iq[xi + 1][yi] + w11 * table->iq[xi + 1][yi + 1];
+}
+
+// Torque without the constant 1.5 * pole pairs
+static float torque(const motor_params *p, float id, float iq) {
+	return iq * (p->lambda + (p->ld - p->lq) * id);
+}
+
+static float flux(const motor_params *p, float id, float iq) {
+	return sqrtf(SQ(p->ld * id + p->lambda) + SQ(p->lq * iq));
+}
+
+// Same as the MTPA in mcpwm_foc.c. See: https://github.com/vedderb/bldc/pull/179
+static void mtpa_point(const motor_params *p, float i, float *id, float *iq) {
+	const float ld_lq_diff = p->lq - p->ld;
+
+	*id = 0.0;
+	if (ld_lq_diff != 0.0) {
+		*id = (p->lambda - sqrtf(SQ(p->lambda) + 8.0 * SQ(ld_lq_diff * i))) / (4.0 * ld_lq_diff);
+	}
+	*iq = sqrtf(fmaxf(SQ(i) - SQ(*id), 0.0));
+}
@@ -0,0 +1,68 @@
+/*
+	Copyright 2026 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef MOTOR_FOC_MTPA_TABLE_H_
+#define MOTOR_FOC_MTPA_TABLE_H_
+
+#include <stdbool.h>
+
+/*
+ * Precomputed current trajectory for MTPA_MODE_TABLE.
+ *
+ * For a commanded current magnitude i and the flux the inverter can still
+ * produce, psi = v_avail / we, the optimal operating point is the one with
+ * the most torque that satisfies
+ *
+ * id^2 + iq^2 <= i^2                       (current limit)
+ * (ld * id + lambda)^2 + (lq * iq)^2 <= psi^2  (voltage limit)
+ *
+ * This is the MTPA point while the voltage suffices, the intersection of
+ * both limits in field weakening and the maximum torque per voltage point
+ * once that lies inside the current limit. Bus voltage and speed only enter
+ * through psi, so the table is two dimensional. It is generated when the
+ * configuration is applied and the control loop interpolates in it. With
+ * the table in use the duty cycle based field weakening in foc_run_fw is
+ * not needed and stays off.
+ */
+
+#define FOC_MTPA_TABLE_I_POINTS		16
+#define FOC_MTPA_TABLE_PSI_POINTS	16
+
+// Fraction of the largest output voltage the trajectory may use. The rest
+// is left to the current controller for transients.
+#define FOC_MTPA_TABLE_V_MARGIN		0.95
+
+typedef struct {
+	bool valid;
+	float i_max;
+	float psi_max;	// Flux of the MTPA point at i_max, above it nothing is voltage limited
+	float i_scale;	// Grid steps per A
+	float psi_scale;	// Grid steps per Wb
+	float ld, lq, lambda;	// Parameters the table was generated with
+	float id[FOC_MTPA_TABLE_I_POINTS][FOC_MTPA_TABLE_PSI_POINTS];
+	float iq[FOC_MTPA_TABLE_I_POINTS][FOC_MTPA_TABLE_PSI_POINTS];
+} foc_mtpa_table_t;
+
+// Functions
+void foc_mtpa_table_solve(float ld, float lq, float lambda, float i, float psi, float *id, float *iq);
+void foc_mtpa_table_generate(foc_mtpa_table_t *table, float ld, float lq, float lambda, float i_max);
+void foc_mtpa_table_lookup(const foc_mtpa_table_t *table, float i, float v_avail, float we, float *id, float *iq);
+void foc_mtpa_table_lookup_psi(const foc_mtpa_table_t *table, float i, float psi, float *id, float *iq);
+
+#endif /* MOTOR_FOC_MTPA_TABLE_H_ */
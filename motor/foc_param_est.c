@@ -0,0 +1,218 @@
+/*
+	Copyright 2026 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "foc_param_est.h"
+#include <math.h>
+#include <string.h>
+
+// Private functions
+static void rls_update(foc_param_est_t *est, const float *phi, float y);
+
+/**
+ * Start over from the nominal parameters.
+ *
+ * @param forget
+ * Forgetting factor per equation, two equations are used per sample. The
+ * estimate follows changes over about 1 / (1 - forget) equations.
+ *
+ * @param p_init
+ * Initial covariance of the relative parameters. sqrt(p_init) is about how
+ * far off the nominal values may be, relative to themselves.
+ */
+void foc_param_est_init(foc_param_est_t *est, float r, float ld, float lq, float lambda,
+		float forget, float p_init) {
+	memset(est, 0, sizeof(foc_param_est_t));
+
+	est->scale[FOC_PARAM_EST_R] = r;
+	est->scale[FOC_PARAM_EST_LD] = ld;
+	est->scale[FOC_PARAM_EST_LQ] = lq;
+	est->scale[FOC_PARAM_EST_LAMBDA] = lambda;
+	est->scale[FOC_PARAM_EST_LAMBDA_Q] = lambda;
+
+	for (int i = 0;i < FOC_PARAM_EST_NUM;i++) {
+		est->theta[i] = 1.0;
+		est->P[i][i] = p_init;
+	}
+
+	// Starting from a frame on the rotor
+	est->theta[FOC_PARAM_EST_LAMBDA_Q] = 0.0;
+
+	est->p_init = p_init;
+	est->forget = forget;
+}
+
+/**
+ * Add one pair of control periods. Called from a thread.
+ */
+void foc_param_est_update(foc_param_est_t *est, const foc_param_est_sample_t *s) {
+	if (s->dt <= 0.0) {
+		return;
+	}
+
+	// The currents were sampled half a period before the frame they are in.
+	// Turn them back to the rotor frame at their sampling instants, so that
+	// their difference is the change in the rotating frame.
+	const float half = 0.5 * s->we * s->dt;
+	const float c = cosf(half);
+	const float sn = sinf(half);
+	const float id0 = c * s->id0 - sn * s->iq0;
+	const float iq0 = c * s->iq0 + sn * s->id0;
+	const float id1 = c * s->id1 - sn * s->iq1;
+	const float iq1 = c * s->iq1 + sn * s->id1;
+
+	const float id = 0.5 * (id0 + id1);
+	const float iq = 0.5 * (iq0 + iq1);
+	const float did = (id1 - id0) / s->dt;
+	const float diq = (iq1 - iq0) / s->dt;
+	const float vd = s->vd;
+	const float vq = s->vq;
+
+	const float phi_d[FOC_PARAM_EST_NUM] = {id, did, -s->we * iq, 0.0, -s->we};
+	const float phi_q[FOC_PARAM_EST_NUM] = {iq, s->we * id, diq, s->we, 0.0};
+
+	rls_update(est, phi_d, vd);
+	rls_update(est, phi_q, vq);
+	est->updates++;
+}
+
+/**
+ * Present estimate of a parameter.
+ *
+ * @param bound
+ * Two standard deviations of the estimate, in the unit of the parameter.
+ * Can be null.
+ */
+float foc_param_est_get(const foc_param_est_t *est, foc_param_est_ind ind, float *bound) {
+	if (bound) {
+		// The covariance times the error variance is how much the data
+		// leaves open. It says nothing while the data has not reduced the
+		// covariance yet, so the part of the initial uncertainty that is
+		// left also counts.
+		const float p = est->P[ind][ind];
+		const float from_data = sqrtf(p * est->res_var);
+		const float from_init = p / sqrtf(est->p_init);
+		*bound = 2.0 * est->scale[ind] * fmaxf(from_data, from_init);
+	}
+
+	return est->theta[ind] * est->scale[ind];
+}
+
+/**
+ * Empty the ring. Called from the consumer thread only, the dropped count
+ * is kept by the ISR and only restarts from here.
+ */
+void foc_param_est_ring_reset(foc_param_est_ring_t *ring) {
+	__atomic_store_n(&ring->tail, __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+	ring->dropped_reset = ring->dropped;
+}
+
+/**
+ * Hand a sample over to the consumer. Called from the ISR only, so the head
+ * index has one writer.
+ *
+ * @return
+ * False if the ring was full and the sample was dropped.
+ */
+bool foc_param_est_ring_push(foc_param_est_ring_t *ring, const foc_param_est_sample_t *s) {
+	const uint32_t head = ring->head;
+
+	if ((head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) >= FOC_PARAM_EST_RING_LEN) {
+		ring->dropped++;
+		return false;
+	}
+
+	ring->buf[head & (FOC_PARAM_EST_RING_LEN - 1)] = *s;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+/**
+ * Take the oldest sample. Called from the consumer thread only.
+ *
+ * @return
+ * False if the ring was empty.
+ */
+bool foc_param_est_ring_pop(foc_param_est_ring_t *ring, foc_param_est_sample_t *s) {
+	const uint32_t tail = ring->tail;
+
+	if (tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+		return false;
+	}
+
+	*s = ring->buf[tail & (FOC_PARAM_EST_RING_LEN - 1)];
+	__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+/**
+ * Samples dropped since the last reset.
+ */
+uint32_t foc_param_est_ring_dropped(const foc_param_est_ring_t *ring) {
+	return ring->dropped - ring->dropped_reset;
+}
+
+// One scalar equation y = phi' * theta, with the parameters relative to scale
+static void rls_update(foc_param_est_t *est, const float *phi, float y) {
+	float phi_s[FOC_PARAM_EST_NUM];
+	for (int i = 0;i < FOC_PARAM_EST_NUM;i++) {
+		phi_s[i] = phi[i] * est->scale[i];
+	}
+
+	float p_phi[FOC_PARAM_EST_NUM];
+	float den = est->forget;
+	float pred = 0.0;
+	for (int i = 0;i < FOC_PARAM_EST_NUM;i++) {
+		p_phi[i] = 0.0;
+		for (int j = 0;j < FOC_PARAM_EST_NUM;j++) {
+			p_phi[i] += est->P[i][j] * phi_s[j];
+		}
+		den += phi_s[i] * p_phi[i];
+		pred += phi_s[i] * est->theta[i];
+	}
+
+	const float err = y - pred;
+
+	// Weighted average of the squared prediction error over the same window
+	// as the parameters
+	est->res_weight = est->forget * est->res_weight + 1.0;
+	est->res_var += (err * err - est->res_var) / est->res_weight;
+
+	float p_max = 0.0;
+	for (int i = 0;i < FOC_PARAM_EST_NUM;i++) {
+		est->theta[i] += p_phi[i] / den * err;
+
+		for (int j = i;j < FOC_PARAM_EST_NUM;j++) {
+			est->P[i][j] -= p_phi[i] * p_phi[j] / den;
+			est->P[j][i] = est->P[i][j];
+		}
+
+		p_max = fmaxf(p_max, est->P[i][i]);
+	}
+
+	// Only forget while no variance is above its initial size. The variance
+	// of a parameter without excitation would otherwise grow without limit.
+	if (p_max < est->p_init) {
+		const float f_inv = 1.0 / est->forget;
+		for (int i = 0;i < FOC_PARAM_EST_NUM;i++) {
+			for (int j = 0;j < FOC_PARAM_EST_NUM;j++) {
+				est->P[i][j] *= f_inv;
+			}
+		}
+	}
+}
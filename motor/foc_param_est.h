@@ -0,0 +1,119 @@
+/*
+	Copyright 2026 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef MOTOR_FOC_PARAM_EST_H_
+#define MOTOR_FOC_PARAM_EST_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Online estimation of R, Ld, Lq and the flux linkage.
+ *
+ * The ISR hands pairs of consecutive control periods over to a thread
+ * through a single producer, single consumer ring. Each pair gives the
+ * two equations of the motor in the rotor frame at the middle of the
+ * period:
+ *
+ * vd = R * id + Ld * did/dt - we * Lq * iq
+ * vq = R * iq + Lq * diq/dt + we * Ld * id + we * lambda
+ *
+ * The frame of a sensorless controller is a bit off the rotor, by an angle
+ * that changes with the operating point. The magnet flux then shows up on
+ * the q axis of the frame as well, which is estimated as lambda_q with
+ *
+ * vd = ... - we * lambda_q
+ *
+ * as it would otherwise end up in the other parameters. The equations are
+ * solved with recursive least squares with exponential forgetting. The
+ * parameters are estimated relative to the nominal values so that all
+ * regressors are voltages of similar size, which keeps the covariance well
+ * conditioned in float.
+ *
+ * The confidence bound of a parameter comes from the covariance and the
+ * variance of the prediction error, and from the initial uncertainty as
+ * long as the data has not reduced it much. A parameter the operation does
+ * not excite, such as Ld while id stays constant, keeps a wide bound. The
+ * forgetting is stopped while any variance is at its initial size, so that
+ * the covariance cannot wind up then.
+ */
+
+#define FOC_PARAM_EST_RING_LEN		32 // Power of two
+
+typedef enum {
+	FOC_PARAM_EST_R = 0,
+	FOC_PARAM_EST_LD,
+	FOC_PARAM_EST_LQ,
+	FOC_PARAM_EST_LAMBDA,
+	FOC_PARAM_EST_LAMBDA_Q,
+	FOC_PARAM_EST_NUM
+} foc_param_est_ind;
+
+// Two consecutive control periods. As in the current controller, every
+// period is in the rotor frame at the middle of it, which is half a period
+// ahead of the instant the currents were sampled at.
+typedef struct {
+	float id0, iq0;		// Current at the start of the period [A]
+	float id1, iq1;		// Current at the end of the period, in the frame of the next one [A]
+	float vd, vq;		// Voltage applied during the period [V]
+	float we;			// Electrical speed [rad/s]
+	float dt;			// Length of the period [s]
+} foc_param_est_sample_t;
+
+typedef struct {
+	foc_param_est_sample_t buf[FOC_PARAM_EST_RING_LEN];
+	volatile uint32_t head; // Written by the ISR only
+	volatile uint32_t tail; // Written by the consumer only
+	volatile uint32_t dropped; // Written by the ISR only
+	uint32_t dropped_reset; // dropped at the last reset, written by the consumer only
+} foc_param_est_ring_t;
+
+typedef struct {
+	float scale[FOC_PARAM_EST_NUM];	// Nominal values, lambda for lambda_q
+	float theta[FOC_PARAM_EST_NUM];	// Estimates relative to the nominal values
+	float P[FOC_PARAM_EST_NUM][FOC_PARAM_EST_NUM];
+	float p_init;					// Initial covariance diagonal
+	float forget;					// Forgetting factor per equation
+	float res_var;					// Prediction error variance [V^2]
+	float res_weight;				// Weight the variance is averaged over
+	uint32_t updates;
+} foc_param_est_t;
+
+// Parameters the current controller and the observer use
+typedef struct {
+	float r;
+	float ld;
+	float lq;
+	float lambda;
+	float ki;
+	float kp_d;
+	float kp_q;
+} foc_param_est_point;
+
+// Functions
+void foc_param_est_init(foc_param_est_t *est, float r, float ld, float lq, float lambda,
+		float forget, float p_init);
+void foc_param_est_update(foc_param_est_t *est, const foc_param_est_sample_t *s);
+float foc_param_est_get(const foc_param_est_t *est, foc_param_est_ind ind, float *bound);
+void foc_param_est_ring_reset(foc_param_est_ring_t *ring);
+bool foc_param_est_ring_push(foc_param_est_ring_t *ring, const foc_param_est_sample_t *s);
+bool foc_param_est_ring_pop(foc_param_est_ring_t *ring, foc_param_est_sample_t *s);
+uint32_t foc_param_est_ring_dropped(const foc_param_est_ring_t *ring);
+
+#endif /* MOTOR_FOC_PARAM_EST_H_ */
@@ -0,0 +1,334 @@
+/*
+	Copyright 2026 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "foc_stage_prof.h"
+#include "ch.h"
+#include "terminal.h"
+#include "commands.h"
+#include <string.h>
+#include <stdlib.h>
+
+// Settings
+#define MOTOR_NUM				2
+
+// Private types
+typedef struct {
+	uint32_t t_start;
+	uint8_t motor;
+	uint16_t ticks[FOC_STAGE_NUM]; // Saturated
+} prof_record_t;
+
+typedef struct {
+	foc_stage_prof_info_t info;
+	foc_stage_stats_t stage[FOC_STAGE_NUM];
+	uint32_t t_prev;
+	bool has_prev;
+} prof_motor_t;
+
+// Private variables
+static prof_record_t m_ring[FOC_STAGE_PROF_RING_LEN];
+static volatile uint32_t m_head = 0; // Written by the ISR only
+static volatile uint32_t m_tail = 0; // Written by the consumer only
+static volatile uint32_t m_dropped[MOTOR_NUM]; // Written by the ISR only
+static uint32_t m_dropped_reset[MOTOR_NUM]; // m_dropped at the last reset, written by the consumer only
+
+// ISR side state of the record in progress
+static uint32_t m_t_start;
+static uint32_t m_t_last;
+static uint32_t m_acc[FOC_STAGE_NUM];
+
+static prof_motor_t m_motors[MOTOR_NUM];
+static mutex_t m_mtx;
+static bool m_init_done = false;
+
+static const char *m_stage_names[FOC_STAGE_NUM] = {
+		"Currents",
+		"Observer",
+		"PLL",
+		"Ctrl cur",
+		"HFI",
+		"SVM",
+		"MC iface",
+		"Other",
+		"Total"
+};
+
+// Private functions
+static void reset_stats(void);
+static void terminal_print(int argc, const char **argv);
+
+void foc_stage_prof_init(void) {
+	if (!m_init_done) {
+		chMtxObjectInit(&m_mtx);
+		m_init_done = true;
+	}
+
+#if defined(FOC_STAGE_PROF_EN) && !defined(USE_PC_BUILD)
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
+	foc_stage_prof_reset();
+
+	terminal_register_command_callback(
+			"foc_isr_prof",
+			"Print the cycle budget of the FOC ISR stages. Add 1 to reset the statistics afterwards.",
+			"[reset]",
+			terminal_print);
+}
+
+void foc_stage_prof_begin(void) {
+	m_t_start = foc_stage_prof_now();
+	m_t_last = m_t_start;
+	memset(m_acc, 0, sizeof(m_acc));
+}
+
+void foc_stage_prof_mark(foc_stage_t stage) {
+	uint32_t now = foc_stage_prof_now();
+	m_acc[stage] += now - m_t_last;
+	m_t_last = now;
+}
+
+/**
+ * Finish the record started by foc_stage_prof_begin and hand it over to the
+ * consumer. Called from the ISR only, so the head index has one writer.
+ *
+ * @param motor
+ * Motor the ISR ran for, 1 or 2.
+ */
+void foc_stage_prof_end(int motor) {
+	uint32_t now = foc_stage_prof_now();
+	m_acc[FOC_STAGE_OTHER] += now - m_t_last;
+	m_acc[FOC_STAGE_TOTAL] = now - m_t_start;
+
+	int m = motor == 2 ? 1 : 0;
+	uint32_t head = m_head;
+
+	if ((head - __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE)) >= FOC_STAGE_PROF_RING_LEN) {
+		m_dropped[m]++;
+		return;
+	}
+
+	prof_record_t *r = &m_ring[head & (FOC_STAGE_PROF_RING_LEN - 1)];
+	r->t_start = m_t_start;
+	r->motor = m;
+	for (int i = 0;i < FOC_STAGE_NUM;i++) {
+		r->ticks[i] = m_acc[i] > 0xFFFF ? 0xFFFF : m_acc[i];
+	}
+
+	__atomic_store_n(&m_head, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Drain the ring into the statistics. Called from the FOC timer thread,
+ * often enough for the ring not to fill up at the highest ISR rate.
+ */
+void foc_stage_prof_process(void) {
+	if (!m_init_done) {
+		return;
+	}
+
+	chMtxLock(&m_mtx);
+
+	uint32_t head = __atomic_load_n(&m_head, __ATOMIC_ACQUIRE);
+	uint32_t tail = m_tail;
+
+	while (tail != head) {
+		const prof_record_t *r = &m_ring[tail & (FOC_STAGE_PROF_RING_LEN - 1)];
+		prof_motor_t *pm = &m_motors[r->motor];
+
+		for (int i = 0;i < FOC_STAGE_NUM;i++) {
+			uint32_t t = r->ticks[i];
+			foc_stage_stats_t *s = &pm->stage[i];
+
+			if (t < s->min) {
+				s->min = t;
+			}
+			if (t > s->max) {
+				s->max = t;
+			}
+			s->sum += t;
+
+			int bin = t == 0 ? 0 : 32 - __builtin_clz(t);
+			if (bin >= FOC_STAGE_PROF_HIST_BINS) {
+				bin = FOC_STAGE_PROF_HIST_BINS - 1;
+			}
+			s->hist[bin]++;
+		}
+
+		// The time between the ISRs of the same motor, for the load. Gaps longer
+		// than a few ms mean that records were dropped or the ISR was stopped.
+		uint32_t diff = r->t_start - pm->t_prev;
+		if (pm->has_prev && diff < (FOC_STAGE_PROF_TICKS_PER_SEC / 200)) {
+			pm->info.elapsed += diff;
+		}
+		pm->t_prev = r->t_start;
+		pm->has_prev = true;
+
+		pm->info.samples++;
+		tail++;
+	}
+
+	__atomic_store_n(&m_tail, tail, __ATOMIC_RELEASE);
+
+	for (int i = 0;i < MOTOR_NUM;i++) {
+		m_motors[i].info.dropped = m_dropped[i] - m_dropped_reset[i];
+	}
+
+	chMtxUnlock(&m_mtx);
+}
+
+void foc_stage_prof_reset(void) {
+	if (!m_init_done) {
+		return;
+	}
+
+	chMtxLock(&m_mtx);
+	__atomic_store_n(&m_tail, __atomic_load_n(&m_head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+	reset_stats();
+	chMtxUnlock(&m_mtx);
+}
+
+bool foc_stage_prof_enabled(void) {
+#ifdef FOC_STAGE_PROF_EN
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Get the sample count of a motor.
+ *
+ * @param motor
+ * Motor, 1 or 2.
+ */
+void foc_stage_prof_get_info(int motor, foc_stage_prof_info_t *info) {
+	memset(info, 0, sizeof(*info));
+
+	if (!m_init_done) {
+		return;
+	}
+
+	chMtxLock(&m_mtx);
+	*info = m_motors[motor == 2 ? 1 : 0].info;
+	chMtxUnlock(&m_mtx);
+}
+
+/**
+ * Get the statistics of one stage. min is 0 when there are no samples.
+ *
+ * @param motor
+ * Motor, 1 or 2.
+ */
+void foc_stage_prof_get_stats(int motor, foc_stage_t stage, foc_stage_stats_t *stats) {
+	memset(stats, 0, sizeof(*stats));
+
+	if (!m_init_done || stage >= FOC_STAGE_NUM) {
+		return;
+	}
+
+	chMtxLock(&m_mtx);
+	const prof_motor_t *pm = &m_motors[motor == 2 ? 1 : 0];
+	*stats = pm->stage[stage];
+	if (pm->info.samples == 0) {
+		stats->min = 0;
+	}
+	chMtxUnlock(&m_mtx);
+}
+
+const char *foc_stage_prof_stage_name(foc_stage_t stage) {
+	if (stage >= FOC_STAGE_NUM) {
+		return "Unknown";
+	}
+
+	return m_stage_names[stage];
+}
+
+static void reset_stats(void) {
+	memset(m_motors, 0, sizeof(m_motors));
+
+	for (int i = 0;i < MOTOR_NUM;i++) {
+		m_dropped_reset[i] = m_dropped[i];
+		for (int j = 0;j < FOC_STAGE_NUM;j++) {
+			m_motors[i].stage[j].min = UINT32_MAX;
+		}
+	}
+}
+
+static void terminal_print(int argc, const char **argv) {
+	if (!foc_stage_prof_enabled()) {
+		commands_printf("FOC stage profiling is not enabled in this build (FOC_STAGE_PROF_EN)\n");
+		return;
+	}
+
+	foc_stage_prof_process();
+
+	const float us_per_tick = 1.0e6 / (float)FOC_STAGE_PROF_TICKS_PER_SEC;
+
+	for (int motor = 1;motor <= MOTOR_NUM;motor++) {
+		foc_stage_prof_info_t info;
+		foc_stage_prof_get_info(motor, &info);
+
+		if (info.samples == 0) {
+			continue;
+		}
+
+		foc_stage_stats_t total;
+		foc_stage_prof_get_stats(motor, FOC_STAGE_TOTAL, &total);
+
+		commands_printf("Motor %d: %u samples, %u dropped, ISR load %.1f %%",
+				motor, (unsigned int)info.samples, (unsigned int)info.dropped,
+				info.elapsed > 0 ? (double)(100.0 * (float)total.sum / (float)info.elapsed) : 0.0);
+		commands_printf("Stage     min [us] avg [us] max [us] share");
+
+		for (int i = 0;i < FOC_STAGE_NUM;i++) {
+			foc_stage_stats_t s;
+			foc_stage_prof_get_stats(motor, i, &s);
+
+			float avg = (float)s.sum / (float)info.samples;
+			commands_printf("%-9s %8.2f %8.2f %8.2f %4.1f %%",
+					foc_stage_prof_stage_name(i),
+					(double)((float)s.min * us_per_tick),
+					(double)(avg * us_per_tick),
+					(double)((float)s.max * us_per_tick),
+					total.sum > 0 ? (double)(100.0 * (float)s.sum / (float)total.sum) : 0.0);
+		}
+
+		// Histogram of the whole ISR, one line per non-empty bin
+		commands_printf("ISR duration histogram:");
+		for (int i = 0;i < FOC_STAGE_PROF_HIST_BINS;i++) {
+			if (total.hist[i] == 0) {
+				continue;
+			}
+
+			uint32_t lo = i == 0 ? 0 : (1u << (i - 1));
+			commands_printf("  >= %8.2f us: %u",
+					(double)((float)lo * us_per_tick), (unsigned int)total.hist[i]);
+		}
+
+		commands_printf(" ");
+	}
+
+	if (argc == 2 && atoi(argv[1]) == 1) {
+		foc_stage_prof_reset();
+		commands_printf("Statistics reset\n");
+	}
+}
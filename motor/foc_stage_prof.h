@@ -0,0 +1,115 @@
+/*
+	Copyright 2026 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef MOTOR_FOC_STAGE_PROF_H_
+#define MOTOR_FOC_STAGE_PROF_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "conf_general.h"
+
+/*
+ * Cycle budget of the FOC ADC ISR, split into stages.
+ *
+ * The ISR calls FOC_STAGE_PROF_BEGIN() first and then
+ * FOC_STAGE_PROF_MARK(stage) at the end of each stage, which books the time
+ * since the previous mark on that stage. FOC_STAGE_PROF_END(motor) books the
+ * rest on FOC_STAGE_OTHER and pushes one record into a lock-free single
+ * producer ring. The FOC timer thread drains the ring every millisecond
+ * into min/avg/max and log2 histograms per motor and stage, so the ISR
+ * only pays for reading the cycle counter.
+ *
+ * The time base is the DWT cycle counter on the MCU and clock_gettime() in
+ * nanoseconds on the PC build. Everything compiles away unless
+ * FOC_STAGE_PROF_EN is defined, see conf_general.h.
+ */
+
+typedef enum {
+	FOC_STAGE_CURRENTS = 0,		// ADC read, offsets, shunt selection and Clarke transform
+	FOC_STAGE_OBSERVER,			// Observer update and phase lag compensation
+	FOC_STAGE_PLL,				// Speed PLL
+	FOC_STAGE_CONTROL_CURRENT,	// Current controllers in control_current
+	FOC_STAGE_HFI,				// HFI angle tracking, injection and restore
+	FOC_STAGE_SVM,				// Space vector modulation and timer update
+	FOC_STAGE_MC_IF,			// mc_interface hook: debug sampling, stream and capture
+	FOC_STAGE_OTHER,			// Everything not covered above
+	FOC_STAGE_TOTAL,			// Whole ISR
+	FOC_STAGE_NUM
+} foc_stage_t;
+
+#define FOC_STAGE_PROF_HIST_BINS	16
+#define FOC_STAGE_PROF_RING_LEN		128 // Must be a power of two
+
+typedef struct {
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	// Bin n counts durations in [2^(n-1), 2^n) ticks, the last bin also everything above
+	uint32_t hist[FOC_STAGE_PROF_HIST_BINS];
+} foc_stage_stats_t;
+
+typedef struct {
+	uint32_t samples;
+	uint32_t dropped;		// Records lost because the ring was full
+	uint64_t elapsed;		// Ticks covered by the samples, for the ISR load
+} foc_stage_prof_info_t;
+
+#ifdef USE_PC_BUILD
+#include <time.h>
+
+#define FOC_STAGE_PROF_TICKS_PER_SEC	1000000000
+
+static inline uint32_t foc_stage_prof_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec);
+}
+#else
+#include "stm32f4xx.h"
+
+#define FOC_STAGE_PROF_TICKS_PER_SEC	SYSTEM_CORE_CLOCK
+
+static inline uint32_t foc_stage_prof_now(void) {
+	return DWT->CYCCNT;
+}
+#endif
+
+// Functions
+void foc_stage_prof_init(void);
+void foc_stage_prof_begin(void);
+void foc_stage_prof_mark(foc_stage_t stage);
+void foc_stage_prof_end(int motor);
+void foc_stage_prof_process(void);
+void foc_stage_prof_reset(void);
+bool foc_stage_prof_enabled(void);
+void foc_stage_prof_get_info(int motor, foc_stage_prof_info_t *info);
+void foc_stage_prof_get_stats(int motor, foc_stage_t stage, foc_stage_stats_t *stats);
+const char *foc_stage_prof_stage_name(foc_stage_t stage);
+
+#ifdef FOC_STAGE_PROF_EN
+#define FOC_STAGE_PROF_BEGIN()			foc_stage_prof_begin()
+#define FOC_STAGE_PROF_MARK(stage)		foc_stage_prof_mark(stage)
+#define FOC_STAGE_PROF_END(motor)		foc_stage_prof_end(motor)
+#else
+#define FOC_STAGE_PROF_BEGIN()
+#define FOC_STAGE_PROF_MARK(stage)
+#define FOC_STAGE_PROF_END(motor)
+#endif
+
+#endif /* MOTOR_FOC_STAGE_PROF_H_ */
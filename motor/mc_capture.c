@@ -0,0 +1,258 @@
+/*
+	Copyright 2026 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "mc_capture.h"
+#include "utils_math.h"
+#include <string.h>
+#include <math.h>
+
+// Private functions
+static bool check_trigger(mc_capture_t *cap, const mc_capture_input *in, float dt);
+
+/**
+ * Initialize a capture. It stays idle until it is armed.
+ *
+ * @param buffer
+ * Frame storage, owned by the caller.
+ *
+ * @param buffer_len
+ * Size of buffer in int16 words.
+ */
+void mc_capture_init(mc_capture_t *cap, int16_t *buffer, uint32_t buffer_len) {
+	memset(cap, 0, sizeof(mc_capture_t));
+	cap->buffer = buffer;
+	cap->buffer_len = buffer_len;
+	cap->state = MC_CAPTURE_IDLE;
+}
+
+/**
+ * Arm the capture with a new configuration. The previous capture is
+ * discarded. Must not run concurrently with mc_capture_sample, so disarm
+ * the capture first when called outside the ISR.
+ *
+ * @return
+ * false if the configuration does not fit in the buffer or selects no
+ * channel or condition.
+ */
+bool mc_capture_arm(mc_capture_t *cap, const mc_capture_config *conf) {
+	uint16_t channels = conf->channels & ((1 << DEBUG_SAMPLING_CH_NUM) - 1);
+	uint16_t conditions = conf->conditions & ((1 << MC_CAPTURE_COND_NUM) - 1);
+
+	int ch_num = 0;
+	for (int i = 0;i < DEBUG_SAMPLING_CH_NUM;i++) {
+		if (channels & (1 << i)) {
+			ch_num++;
+		}
+	}
+
+	uint32_t depth = (uint32_t)conf->pre_samples + (uint32_t)conf->post_samples;
+
+	if (ch_num == 0 || conditions == 0 || conf->post_samples == 0 ||
+			depth * (uint32_t)ch_num > cap->buffer_len) {
+		return false;
+	}
+
+	cap->state = MC_CAPTURE_IDLE;
+	cap->conf = *conf;
+	cap->conf.channels = channels;
+	cap->conf.conditions = conditions;
+	if (cap->conf.decimation == 0) {
+		cap->conf.decimation = 1;
+	}
+
+	cap->ch_num = ch_num;
+	cap->depth = depth;
+	cap->write = 0;
+	cap->filled = 0;
+	cap->post_left = 0;
+	cap->dec_cnt = 0;
+	cap->dt_acc = 0.0;
+	cap->angle_valid = false;
+	cap->fault_pending = false;
+	cap->trigger_fault = FAULT_CODE_NONE;
+	cap->state = MC_CAPTURE_ARMED;
+
+	return true;
+}
+
+void mc_capture_disarm(mc_capture_t *cap) {
+	cap->state = MC_CAPTURE_IDLE;
+}
+
+/**
+ * Report a fault to the capture. It is evaluated with the next sample.
+ * Can be called from any context.
+ */
+void mc_capture_fault(mc_capture_t *cap, mc_fault_code fault) {
+	if (cap->state != MC_CAPTURE_ARMED || fault == FAULT_CODE_NONE) {
+		return;
+	}
+
+	cap->fault_pending_code = fault;
+	cap->fault_pending = true;
+}
+
+/**
+ * mc_capture_tick() and mc_capture_write() in one call, for callers that
+ * have the channels at hand anyway.
+ */
+void mc_capture_sample(mc_capture_t *cap, const int16_t *ch, const mc_capture_input *in) {
+	if (mc_capture_tick(cap, in->dt)) {
+		mc_capture_write(cap, ch, in);
+	}
+}
+
+/**
+ * Record one frame and evaluate the trigger. Called from the ISR when
+ * mc_capture_tick() returns true.
+ *
+ * @param ch
+ * Channels indexed by debug_sampling_channel, only the selected ones are
+ * read.
+ *
+ * @param in
+ * Trigger inputs, dt is taken from the ticks since the previous frame.
+ */
+void mc_capture_write(mc_capture_t *cap, const int16_t *ch, const mc_capture_input *in) {
+	if (!mc_capture_is_recording(cap)) {
+		return;
+	}
+
+	const float dt = cap->dt_acc;
+	cap->dt_acc = 0.0;
+
+	int16_t *frame = cap->buffer + cap->write * cap->ch_num;
+	const uint16_t channels = cap->conf.channels;
+	for (int i = 0;i < DEBUG_SAMPLING_CH_NUM;i++) {
+		if (channels & (1 << i)) {
+			*frame++ = ch[i];
+		}
+	}
+
+	cap->write++;
+	if (cap->write >= cap->depth) {
+		cap->write = 0;
+	}
+
+	if (cap->filled < cap->depth) {
+		cap->filled++;
+	}
+
+	if (cap->state == MC_CAPTURE_ARMED) {
+		if (check_trigger(cap, in, dt)) {
+			cap->post_left = cap->conf.post_samples;
+			cap->state = MC_CAPTURE_TRIGGERED;
+		}
+	}
+
+	if (cap->state == MC_CAPTURE_TRIGGERED) {
+		cap->post_left--;
+		if (cap->post_left == 0) {
+			cap->state = MC_CAPTURE_DONE;
+		}
+	}
+}
+
+/**
+ * Number of frames that can be read, fewer than pre_samples + post_samples
+ * if the trigger came before the ring was full.
+ */
+uint32_t mc_capture_get_len(const mc_capture_t *cap) {
+	return cap->filled;
+}
+
+/**
+ * Index of the trigger frame, or -1 while not triggered.
+ */
+int mc_capture_get_trigger_index(const mc_capture_t *cap) {
+	if (cap->state != MC_CAPTURE_DONE) {
+		return -1;
+	}
+
+	return (int)cap->filled - (int)cap->conf.post_samples;
+}
+
+/**
+ * Read one frame, oldest first.
+ *
+ * @param frame
+ * Receives ch_num values in channel order.
+ *
+ * @return
+ * false if index is out of range.
+ */
+bool mc_capture_get_frame(const mc_capture_t *cap, uint32_t index, int16_t *frame) {
+	if (index >= cap->filled) {
+		return false;
+	}
+
+	uint32_t start = cap->filled < cap->depth ? 0 : cap->write;
+	uint32_t ind = start + index;
+	if (ind >= cap->depth) {
+		ind -= cap->depth;
+	}
+
+	memcpy(frame, cap->buffer + ind * cap->ch_num, cap->ch_num * sizeof(int16_t));
+	return true;
+}
+
+static bool check_trigger(mc_capture_t *cap, const mc_capture_input *in, float dt) {
+	const uint16_t cond = cap->conf.conditions;
+	bool trigger = true;
+
+	if (cond & (1 << MC_CAPTURE_COND_CURRENT_ABOVE)) {
+		trigger = trigger && fabsf(in->current) > cap->conf.current_above;
+	}
+
+	if (cond & (1 << MC_CAPTURE_COND_ERPM_BELOW)) {
+		trigger = trigger && fabsf(in->erpm) < cap->conf.erpm_below;
+	}
+
+	if (cond & (1 << MC_CAPTURE_COND_ERPM_ABOVE)) {
+		trigger = trigger && fabsf(in->erpm) > cap->conf.erpm_above;
+	}
+
+	if (cond & (1 << MC_CAPTURE_COND_ANGLE_JUMP)) {
+		// The angle is expected to advance with the speed, anything beyond
+		// that is a jump. The first sample after arming has no reference.
+		bool jump = false;
+		if (cap->angle_valid) {
+			float predicted = cap->angle_prev + in->erpm * (360.0 / 60.0) * dt;
+			jump = fabsf(utils_angle_difference(in->angle, predicted)) > cap->conf.angle_jump;
+		}
+		cap->angle_prev = in->angle;
+		cap->angle_valid = true;
+		trigger = trigger && jump;
+	}
+
+	if (cond & (1 << MC_CAPTURE_COND_FAULT)) {
+		bool fault = false;
+		if (cap->fault_pending) {
+			mc_fault_code code = cap->fault_pending_code;
+			fault = cap->conf.fault_code == FAULT_CODE_NONE || code == cap->conf.fault_code;
+			if (fault) {
+				cap->trigger_fault = code;
+			}
+			cap->fault_pending = false;
+		}
+		trigger = trigger && fault;
+	}
+
+	return trigger;
+}
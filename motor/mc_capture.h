@@ -0,0 +1,141 @@
+/*
+	Copyright 2026 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef MOTOR_MC_CAPTURE_H_
+#define MOTOR_MC_CAPTURE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "datatypes.h"
+
+/*
+ * Pre-trigger ring capture for fault forensics.
+ *
+ * While armed, every (decimated) sample writes one frame of the selected
+ * debug sampling channels into a ring of pre_samples + post_samples frames
+ * and evaluates the trigger conditions. All enabled conditions have to hold
+ * at the same sample. After the trigger another post_samples - 1 frames
+ * are recorded and the capture is frozen until it is armed again, so the
+ * result holds pre_samples frames before the trigger sample and
+ * post_samples frames from it on.
+ *
+ * The ISR calls mc_capture_tick() every sample and only reads the channels
+ * and calls mc_capture_write() when it returns true, so idle, frozen and
+ * decimated samples cost one check.
+ */
+
+typedef enum {
+	MC_CAPTURE_COND_CURRENT_ABOVE = 0,	// |current| > current_above
+	MC_CAPTURE_COND_ERPM_BELOW,			// |erpm| < erpm_below
+	MC_CAPTURE_COND_ERPM_ABOVE,			// |erpm| > erpm_above
+	MC_CAPTURE_COND_ANGLE_JUMP,			// Observer angle off its speed prediction by more than angle_jump
+	MC_CAPTURE_COND_FAULT,				// fault_code occurred, any fault for FAULT_CODE_NONE
+	MC_CAPTURE_COND_NUM
+} mc_capture_cond;
+
+typedef enum {
+	MC_CAPTURE_IDLE = 0,
+	MC_CAPTURE_ARMED,
+	MC_CAPTURE_TRIGGERED,
+	MC_CAPTURE_DONE
+} mc_capture_state;
+
+typedef struct {
+	uint16_t conditions;		// Mask of (1 << mc_capture_cond)
+	uint16_t channels;			// Mask of (1 << debug_sampling_channel)
+	uint16_t pre_samples;
+	uint16_t post_samples;		// Including the trigger sample, at least 1
+	uint8_t decimation;
+	float current_above;		// [A]
+	float erpm_below;
+	float erpm_above;
+	float angle_jump;			// [deg]
+	mc_fault_code fault_code;
+} mc_capture_config;
+
+// What the trigger conditions look at, one per sample
+typedef struct {
+	float current;				// [A]
+	float erpm;
+	float angle;				// Observer angle [deg]
+	float dt;					// Time since the previous call [s]
+} mc_capture_input;
+
+typedef struct {
+	mc_capture_config conf;
+	volatile mc_capture_state state;
+	int16_t *buffer;
+	uint32_t buffer_len;		// [int16 words]
+	int ch_num;
+	uint32_t depth;				// Frames in the ring, pre_samples + post_samples
+	uint32_t write;				// Next frame to write
+	uint32_t filled;			// Frames written since arming, up to depth
+	uint32_t post_left;
+	uint32_t dec_cnt;
+	float dt_acc;
+	float angle_prev;
+	bool angle_valid;
+	volatile bool fault_pending;
+	volatile mc_fault_code fault_pending_code;
+	mc_fault_code trigger_fault;
+} mc_capture_t;
+
+// Functions
+void mc_capture_init(mc_capture_t *cap, int16_t *buffer, uint32_t buffer_len);
+bool mc_capture_arm(mc_capture_t *cap, const mc_capture_config *conf);
+void mc_capture_disarm(mc_capture_t *cap);
+void mc_capture_fault(mc_capture_t *cap, mc_fault_code fault);
+void mc_capture_sample(mc_capture_t *cap, const int16_t *ch, const mc_capture_input *in);
+void mc_capture_write(mc_capture_t *cap, const int16_t *ch, const mc_capture_input *in);
+uint32_t mc_capture_get_len(const mc_capture_t *cap);
+int mc_capture_get_trigger_index(const mc_capture_t *cap);
+bool mc_capture_get_frame(const mc_capture_t *cap, uint32_t index, int16_t *frame);
+
+/**
+ * True while the ring still records, i.e. before the capture is frozen.
+ */
+static inline bool mc_capture_is_recording(const mc_capture_t *cap) {
+	return cap->state == MC_CAPTURE_ARMED || cap->state == MC_CAPTURE_TRIGGERED;
+}
+
+/**
+ * Count one sample towards the decimation.
+ *
+ * @param dt
+ * Time since the previous call [s].
+ *
+ * @return
+ * true if a frame is due, which the caller then reads and passes to
+ * mc_capture_write().
+ */
+static inline bool mc_capture_tick(mc_capture_t *cap, float dt) {
+	if (!mc_capture_is_recording(cap)) {
+		return false;
+	}
+
+	cap->dt_acc += dt;
+	if (++cap->dec_cnt < cap->conf.decimation) {
+		return false;
+	}
+
+	cap->dec_cnt = 0;
+	return true;
+}
+
+#endif /* MOTOR_MC_CAPTURE_H_ */
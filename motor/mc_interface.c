@@ -38,6 +38,7 @@
 #include "shutdown.h"
 #include "app.h"
 #include "mempools.h"
+#include "packet.h"
 #include "crc.h"
 #include "bms.h"
 #include "events.h"
@@ -128,6 +129,38 @@ static volatile int m_sample_now;
 static volatile int m_sample_trigger;
 static volatile float m_last_adc_duration_sample;
 static volatile bool m_sample_is_second_motor;
+
+// Continuous streaming. The ISR writes frames of the selected channels into a
+// single producer, single consumer ring of int16 words and the sample thread
+// drains it in packets as fast as the link takes them.
+#ifndef ADC_STREAM_BUFFER_LEN
+#define ADC_STREAM_BUFFER_LEN	4096 // int16 words, must be a power of two
+#endif
+#define ADC_STREAM_HEADER_LEN	25 // Bytes in front of the frames of each packet
+static volatile int16_t m_stream_buffer[ADC_STREAM_BUFFER_LEN];
+static volatile uint32_t m_stream_head; // Written by the ISR only
+static volatile uint32_t m_stream_tail; // Written by the sample thread only
+static volatile bool m_stream_active;
+static volatile bool m_stream_raw;
+static volatile bool m_stream_is_second_motor;
+static volatile uint16_t m_stream_channels;
+static volatile int m_stream_ch_num;
+static volatile int m_stream_int;
+static volatile int m_stream_packet_frames;
+static volatile uint32_t m_stream_frames; // Frames written to the ring
+static volatile uint32_t m_stream_dropped; // Frames lost because the ring was full
+static uint32_t m_stream_sent; // Frames sent, sample thread only
+static uint8_t m_stream_packet[PACKET_MAX_PL_LEN];
+
+// Pre-trigger ring capture, always armed for faults by default
+#ifndef ADC_CAPTURE_BUFFER_LEN
+#define ADC_CAPTURE_BUFFER_LEN	2048 // int16 words
+#endif
+#define ADC_CAPTURE_HEADER_LEN	32 // Bytes in front of the frames of each packet
+static int16_t m_capture_buffer[ADC_CAPTURE_BUFFER_LEN];
+static mc_capture_t m_capture;
+static volatile bool m_capture_is_second_motor;
+
 static volatile gnss_data m_gnss = {0};
 static volatile bool m_wheel_speed_override = false;
 static volatile float m_wheel_speed_override_value = 0.0;
@@ -148,6 +181,11 @@ static void run_timer_tasks(volatile motor_if_state_t *motor);
 static void update_stats(volatile motor_if_state_t *motor);
 static volatile motor_if_state_t *motor_now(void);
 static void send_sample_block(int ind, int offset);
+static void read_sample_channels(volatile motor_if_state_t *motor, bool is_second_motor,
+		mc_state state, float current, float t_samp, int decimation, bool raw, uint16_t channels,
+		int16_t *ch);
+static void stream_sample(int16_t *ch);
+static void send_stream_packets(void);
 
 // Function pointers
 static void(*pwn_done_func)(void) = 0;
@@ -191,6 +229,19 @@ void mc_interface_init(void) {
 	m_sample_mode_last = DEBUG_SAMPLING_OFF;
 	m_sample_offset_last = 0;
 	m_sample_is_second_motor = false;
+	m_stream_active = false;
+
+	mc_capture_init(&m_capture, m_capture_buffer, ADC_CAPTURE_BUFFER_LEN);
+	m_capture_is_second_motor = false;
+
+	mc_capture_config capture_conf = {0};
+	capture_conf.conditions = 1 << MC_CAPTURE_COND_FAULT;
+	capture_conf.channels = 0x3F; // Currents and phase voltages
+	capture_conf.pre_samples = 256;
+	capture_conf.post_samples = 64;
+	capture_conf.decimation = 1;
+	capture_conf.fault_code = FAULT_CODE_NONE;
+	mc_capture_arm(&m_capture, &capture_conf);
 
 	mc_interface_stat_reset();
 
@@ -1489,11 +1540,46 @@ float mc_interface_get_last_sample_adc_isr_duration(void) {
 	return m_last_adc_duration_sample;
 }
 
-void mc_interface_sample_print_data(debug_sampling_mode mode, uint16_t len, uint8_t decimation, bool raw, 
-		void(*reply_func)(unsigned char *data, unsigned int len)) {
+void mc_interface_sample_print_data(debug_sampling_mode mode, uint16_t len, uint8_t decimation, bool raw,
+		uint16_t channels, void(*reply_func)(unsigned char *data, unsigned int len)) {
+
+	if (mode == DEBUG_SAMPLING_STREAM_STOP) {
+		// Let the sample thread flush what is left in the ring
+		m_stream_active = false;
+		chEvtSignal(sample_send_tp, (eventmask_t) 2);
+		return;
+	}
 
 	send_func_sample = reply_func;
 
+	if (mode == DEBUG_SAMPLING_STREAM_START) {
+		channels &= (1 << DEBUG_SAMPLING_CH_NUM) - 1;
+		if (channels == 0) {
+			return;
+		}
+
+		int ch_num = 0;
+		for (int i = 0;i < DEBUG_SAMPLING_CH_NUM;i++) {
+			if (channels & (1 << i)) {
+				ch_num++;
+			}
+		}
+
+		m_stream_active = false;
+		m_stream_channels = channels;
+		m_stream_ch_num = ch_num;
+		m_stream_int = decimation > 0 ? decimation : 1;
+		m_stream_raw = raw;
+		m_stream_packet_frames = (PACKET_MAX_PL_LEN - ADC_STREAM_HEADER_LEN) / (2 * ch_num);
+#ifdef HW_HAS_DUAL_MOTORS
+		m_stream_is_second_motor = motor_now() == &m_motor_2;
+#endif
+
+		// The sample thread owns the tail, so it empties the ring and starts the stream
+		chEvtSignal(sample_send_tp, (eventmask_t) 4);
+		return;
+	}
+
 	if (len > ADC_SAMPLE_MAX_LEN) {
 		len = ADC_SAMPLE_MAX_LEN;
 	}
@@ -1515,6 +1601,90 @@ void mc_interface_sample_print_data(debug_sampling_mode mode, uint16_t len, uint
 	}
 }
 
+/**
+ * Arm the pre-trigger capture with a new configuration for the current
+ * motor. The previous capture is discarded.
+ *
+ * @return
+ * false if the configuration does not fit in the capture buffer.
+ */
+bool mc_interface_capture_arm(const mc_capture_config *conf) {
+	chSysLock();
+	mc_capture_disarm(&m_capture);
+#ifdef HW_HAS_DUAL_MOTORS
+	m_capture_is_second_motor = motor_now() == &m_motor_2;
+#endif
+	bool res = mc_capture_arm(&m_capture, conf);
+	chSysUnlock();
+	return res;
+}
+
+/**
+ * Send the capture state and frames [offset, offset + count) as a
+ * COMM_CAPTURE_GET packet. Frames are only sent once the capture is frozen;
+ * count is reduced to what fits in one packet.
+ *
+ * Packet: COMM_CAPTURE_GET, state, motor, conditions, channels,
+ * pre_samples, post_samples, decimation, frames available, trigger frame
+ * index (-1 if not triggered), trigger fault, sample rate [Hz], current
+ * scale [A/LSB], voltage scale [V/LSB], offset, count, then count frames
+ * of int16 values in channel order.
+ */
+void mc_interface_capture_send(uint16_t offset, uint16_t count,
+		void(*reply_func)(unsigned char *data, unsigned int len)) {
+	const mc_capture_t *cap = &m_capture;
+	bool done = cap->state == MC_CAPTURE_DONE;
+	uint32_t len = done ? mc_capture_get_len(cap) : 0;
+
+	if (offset >= len) {
+		count = 0;
+	} else if ((uint32_t)offset + count > len) {
+		count = len - offset;
+	}
+
+	int max_frames = cap->ch_num > 0 ? (PACKET_MAX_PL_LEN - ADC_CAPTURE_HEADER_LEN) / (2 * cap->ch_num) : 0;
+	if (count > max_frames) {
+		count = max_frames;
+	}
+
+	volatile motor_if_state_t *motor = &m_motor_1;
+#ifdef HW_HAS_DUAL_MOTORS
+	if (m_capture_is_second_motor) {
+		motor = &m_motor_2;
+	}
+#endif
+
+	uint8_t *buffer = mempools_get_packet_buffer();
+	int32_t index = 0;
+	buffer[index++] = COMM_CAPTURE_GET;
+	buffer[index++] = cap->state;
+	buffer[index++] = m_capture_is_second_motor ? 2 : 1;
+	buffer_append_uint16(buffer, cap->conf.conditions, &index);
+	buffer_append_uint16(buffer, cap->conf.channels, &index);
+	buffer_append_uint16(buffer, cap->conf.pre_samples, &index);
+	buffer_append_uint16(buffer, cap->conf.post_samples, &index);
+	buffer[index++] = cap->conf.decimation;
+	buffer_append_uint16(buffer, len, &index);
+	buffer_append_int16(buffer, mc_capture_get_trigger_index(cap), &index);
+	buffer[index++] = cap->trigger_fault;
+	buffer_append_float32_auto(buffer, motor->m_f_samp_now / (float)cap->conf.decimation, &index);
+	buffer_append_float32_auto(buffer, FAC_CURRENT / 8.0, &index);
+	buffer_append_float32_auto(buffer, V_REG / 4096.0 * ((VIN_R1 + VIN_R2) / VIN_R2) * ADC_VOLTS_PH_FACTOR, &index);
+	buffer_append_uint16(buffer, offset, &index);
+	buffer[index++] = count;
+
+	int16_t frame[DEBUG_SAMPLING_CH_NUM];
+	for (int i = 0;i < count;i++) {
+		mc_capture_get_frame(cap, offset + i, frame);
+		for (int j = 0;j < cap->ch_num;j++) {
+			buffer_append_int16(buffer, frame[j], &index);
+		}
+	}
+
+	reply_func(buffer, index);
+	mempools_free_packet_buffer(buffer);
+}
+
 /**
  * Get filtered MOSFET temperature. The temperature is pre-calculated, so this
  * functions is fast.
@@ -1847,6 +2017,10 @@ void mc_interface_fault_stop(mc_fault_code fault, bool is_second_motor, bool is_
 	m_fault_data.fault_code = fault;
 	m_fault_data.is_second_motor = is_second_motor;
 
+	if (is_second_motor == m_capture_is_second_motor) {
+		mc_capture_fault(&m_capture, fault);
+	}
+
 	if (is_isr) {
 		chSysLockFromISR();
 		chEvtSignalI(fault_stop_tp, (eventmask_t) 1);
@@ -2121,72 +2295,199 @@ void mc_interface_mc_timer_isr(bool is_second_motor) {
 				m_sample_now = 0;
 			}
 
-			int16_t zero;
-			if (conf_now->motor_type == MOTOR_TYPE_FOC) {
-				if (is_second_motor) {
-					zero = (ADC_V_L4 + ADC_V_L5 + ADC_V_L6) / 3;
-				} else {
-					zero = (ADC_V_L1 + ADC_V_L2 + ADC_V_L3) / 3;
-				}
-				m_phase_samples[m_sample_now] = (uint8_t)(mcpwm_foc_get_phase() / 360.0 * 250.0);
-//				m_phase_samples[m_sample_now] = (uint8_t)(mcpwm_foc_get_phase_observer() / 360.0 * 250.0);
-//				float ang = utils_angle_difference(mcpwm_foc_get_phase_observer(), mcpwm_foc_get_phase_encoder()) + 180.0;
-//				m_phase_samples[m_sample_now] = (uint8_t)(ang / 360.0 * 250.0);
+			int16_t ch[DEBUG_SAMPLING_CH_NUM];
+			read_sample_channels(motor, is_second_motor, state, current, t_samp, m_sample_int, m_sample_raw,
+					(1 << DEBUG_SAMPLING_CH_NUM) - 1, ch);
+
+			m_curr0_samples[m_sample_now] = ch[DEBUG_SAMPLING_CH_CURR0];
+			m_curr1_samples[m_sample_now] = ch[DEBUG_SAMPLING_CH_CURR1];
+			m_curr2_samples[m_sample_now] = ch[DEBUG_SAMPLING_CH_CURR2];
+			m_ph1_samples[m_sample_now] = ch[DEBUG_SAMPLING_CH_PH1];
+			m_ph2_samples[m_sample_now] = ch[DEBUG_SAMPLING_CH_PH2];
+			m_ph3_samples[m_sample_now] = ch[DEBUG_SAMPLING_CH_PH3];
+			m_vzero_samples[m_sample_now] = ch[DEBUG_SAMPLING_CH_VZERO];
+			m_curr_fir_samples[m_sample_now] = ch[DEBUG_SAMPLING_CH_CURR_FIR];
+			m_f_sw_samples[m_sample_now] = ch[DEBUG_SAMPLING_CH_F_SW];
+			m_status_samples[m_sample_now] = ch[DEBUG_SAMPLING_CH_STATUS];
+			m_phase_samples[m_sample_now] = ch[DEBUG_SAMPLING_CH_PHASE];
+
+			m_sample_now++;
+
+			m_last_adc_duration_sample = mc_interface_get_last_inj_adc_isr_duration();
+		}
+	}
+
+	if (m_stream_active && m_stream_is_second_motor == is_second_motor) {
+		static int a_stream = 0;
+		a_stream++;
+
+		if (a_stream >= m_stream_int) {
+			a_stream = 0;
+
+			int16_t ch[DEBUG_SAMPLING_CH_NUM];
+			read_sample_channels(motor, is_second_motor, state, current, t_samp, m_stream_int, m_stream_raw,
+					m_stream_channels, ch);
+			stream_sample(ch);
+		}
+	}
+
+	// Only the decimated samples of a recording capture read the channels
+	if (m_capture_is_second_motor == is_second_motor && mc_capture_tick(&m_capture, t_samp)) {
+		int16_t ch[DEBUG_SAMPLING_CH_NUM];
+		read_sample_channels(motor, is_second_motor, state, current, t_samp,
+				m_capture.conf.decimation, false, m_capture.conf.channels, ch);
+
+		mc_capture_input in;
+		in.current = abs_current;
+		in.dt = t_samp;
+		if (conf_now->motor_type == MOTOR_TYPE_FOC) {
+			in.erpm = mcpwm_foc_get_rpm_fast();
+			in.angle = mcpwm_foc_get_phase_observer();
+		} else {
+			in.erpm = mcpwm_get_rpm();
+			in.angle = 0.0;
+		}
+
+		mc_capture_write(&m_capture, ch, &in);
+	}
+}
+
+/**
+ * Read debug sampling channels in the fixed point format of the sample
+ * buffers.
+ *
+ * @param channels
+ * Mask of (1 << debug_sampling_channel) to read, the others are left as
+ * they are.
+ */
+static void read_sample_channels(volatile motor_if_state_t *motor, bool is_second_motor,
+		mc_state state, float current, float t_samp, int decimation, bool raw, uint16_t channels,
+		int16_t *ch) {
+	const uint16_t curr_mask = (1 << DEBUG_SAMPLING_CH_CURR0) | (1 << DEBUG_SAMPLING_CH_CURR1) |
+			(1 << DEBUG_SAMPLING_CH_CURR2);
+	const uint16_t ph_mask = (1 << DEBUG_SAMPLING_CH_PH1) | (1 << DEBUG_SAMPLING_CH_PH2) |
+			(1 << DEBUG_SAMPLING_CH_PH3);
+	const bool foc = motor->m_conf.motor_type == MOTOR_TYPE_FOC;
+
+	int16_t zero = 0;
+	if (channels & (ph_mask | (1 << DEBUG_SAMPLING_CH_VZERO))) {
+		if (foc) {
+			if (is_second_motor) {
+				zero = (ADC_V_L4 + ADC_V_L5 + ADC_V_L6) / 3;
 			} else {
-				zero = mcpwm_vzero;
-				m_phase_samples[m_sample_now] = 0;
+				zero = (ADC_V_L1 + ADC_V_L2 + ADC_V_L3) / 3;
 			}
+		} else {
+			zero = mcpwm_vzero;
+		}
+	}
+
+	if (channels & (1 << DEBUG_SAMPLING_CH_PHASE)) {
+		if (foc) {
+			ch[DEBUG_SAMPLING_CH_PHASE] = (uint8_t)(mcpwm_foc_get_phase() / 360.0 * 250.0);
+//			ch[DEBUG_SAMPLING_CH_PHASE] = (uint8_t)(mcpwm_foc_get_phase_observer() / 360.0 * 250.0);
+//			float ang = utils_angle_difference(mcpwm_foc_get_phase_observer(), mcpwm_foc_get_phase_encoder()) + 180.0;
+//			ch[DEBUG_SAMPLING_CH_PHASE] = (uint8_t)(ang / 360.0 * 250.0);
+		} else {
+			ch[DEBUG_SAMPLING_CH_PHASE] = 0;
+		}
+	}
 
-			if (state == MC_STATE_DETECTING) {
-				m_curr0_samples[m_sample_now] = (int16_t)(mcpwm_detect_currents[mcpwm_get_comm_step() - 1] * (8.0 / FAC_CURRENT));
-				m_curr1_samples[m_sample_now] = (int16_t)(mcpwm_detect_currents_diff[mcpwm_get_comm_step() - 1] * (8.0 / FAC_CURRENT));
-				m_curr2_samples[m_sample_now] = 0;
+	if (state == MC_STATE_DETECTING) {
+		if (channels & curr_mask) {
+			ch[DEBUG_SAMPLING_CH_CURR0] = (int16_t)(mcpwm_detect_currents[mcpwm_get_comm_step() - 1] * (8.0 / FAC_CURRENT));
+			ch[DEBUG_SAMPLING_CH_CURR1] = (int16_t)(mcpwm_detect_currents_diff[mcpwm_get_comm_step() - 1] * (8.0 / FAC_CURRENT));
+			ch[DEBUG_SAMPLING_CH_CURR2] = 0;
+		}
 
-				m_ph1_samples[m_sample_now] = (int16_t)mcpwm_detect_voltages[0];
-				m_ph2_samples[m_sample_now] = (int16_t)mcpwm_detect_voltages[1];
-				m_ph3_samples[m_sample_now] = (int16_t)mcpwm_detect_voltages[2];
-			} else {
-				if (is_second_motor) {
-					if (m_sample_raw) {
-						m_curr0_samples[m_sample_now] = ADC_curr_raw[3];
-						m_curr1_samples[m_sample_now] = ADC_curr_raw[4];
-						m_curr2_samples[m_sample_now] = ADC_curr_raw[5];
-					} else {
-						m_curr0_samples[m_sample_now] = ADC_curr_norm_value[3] * (8.0 / FAC_CURRENT);
-						m_curr1_samples[m_sample_now] = ADC_curr_norm_value[4] * (8.0 / FAC_CURRENT);
-						m_curr2_samples[m_sample_now] = ADC_curr_norm_value[5] * (8.0 / FAC_CURRENT);	
-					}
-
-					m_ph1_samples[m_sample_now] = ADC_V_L4 - zero;
-					m_ph2_samples[m_sample_now] = ADC_V_L5 - zero;
-					m_ph3_samples[m_sample_now] = ADC_V_L6 - zero;
+		if (channels & ph_mask) {
+			ch[DEBUG_SAMPLING_CH_PH1] = (int16_t)mcpwm_detect_voltages[0];
+			ch[DEBUG_SAMPLING_CH_PH2] = (int16_t)mcpwm_detect_voltages[1];
+			ch[DEBUG_SAMPLING_CH_PH3] = (int16_t)mcpwm_detect_voltages[2];
+		}
+	} else {
+		if (is_second_motor) {
+			if (channels & curr_mask) {
+				if (raw) {
+					ch[DEBUG_SAMPLING_CH_CURR0] = ADC_curr_raw[3];
+					ch[DEBUG_SAMPLING_CH_CURR1] = ADC_curr_raw[4];
+					ch[DEBUG_SAMPLING_CH_CURR2] = ADC_curr_raw[5];
+				} else {
+					ch[DEBUG_SAMPLING_CH_CURR0] = ADC_curr_norm_value[3] * (8.0 / FAC_CURRENT);
+					ch[DEBUG_SAMPLING_CH_CURR1] = ADC_curr_norm_value[4] * (8.0 / FAC_CURRENT);
+					ch[DEBUG_SAMPLING_CH_CURR2] = ADC_curr_norm_value[5] * (8.0 / FAC_CURRENT);
+				}
+			}
+
+			if (channels & ph_mask) {
+				ch[DEBUG_SAMPLING_CH_PH1] = ADC_V_L4 - zero;
+				ch[DEBUG_SAMPLING_CH_PH2] = ADC_V_L5 - zero;
+				ch[DEBUG_SAMPLING_CH_PH3] = ADC_V_L6 - zero;
+			}
+		} else {
+			if (channels & curr_mask) {
+				if (raw) {
+					ch[DEBUG_SAMPLING_CH_CURR0] = ADC_curr_raw[0];
+					ch[DEBUG_SAMPLING_CH_CURR1] = ADC_curr_raw[1];
+					ch[DEBUG_SAMPLING_CH_CURR2] = ADC_curr_raw[2];
 				} else {
-					if (m_sample_raw) {
-						m_curr0_samples[m_sample_now] = ADC_curr_raw[0];
-						m_curr1_samples[m_sample_now] = ADC_curr_raw[1];
-						m_curr2_samples[m_sample_now] = ADC_curr_raw[2];
-					} else {
-						m_curr0_samples[m_sample_now] = ADC_curr_norm_value[0] * (8.0 / FAC_CURRENT);
-						m_curr1_samples[m_sample_now] = ADC_curr_norm_value[1] * (8.0 / FAC_CURRENT);
-						m_curr2_samples[m_sample_now] = ADC_curr_norm_value[2] * (8.0 / FAC_CURRENT);
-					}					
-
-					m_ph1_samples[m_sample_now] = ADC_V_L1 - zero;
-					m_ph2_samples[m_sample_now] = ADC_V_L2 - zero;
-					m_ph3_samples[m_sample_now] = ADC_V_L3 - zero;
+					ch[DEBUG_SAMPLING_CH_CURR0] = ADC_curr_norm_value[0] * (8.0 / FAC_CURRENT);
+					ch[DEBUG_SAMPLING_CH_CURR1] = ADC_curr_norm_value[1] * (8.0 / FAC_CURRENT);
+					ch[DEBUG_SAMPLING_CH_CURR2] = ADC_curr_norm_value[2] * (8.0 / FAC_CURRENT);
 				}
 			}
 
-			m_vzero_samples[m_sample_now] = zero;
-			m_curr_fir_samples[m_sample_now] = (int16_t)(current * (8.0 / FAC_CURRENT));
-			m_f_sw_samples[m_sample_now] = (int16_t)(0.1 / t_samp / m_sample_int);
-			m_status_samples[m_sample_now] = mcpwm_get_comm_step() | (mcpwm_read_hall_phase() << 3);
+			if (channels & ph_mask) {
+				ch[DEBUG_SAMPLING_CH_PH1] = ADC_V_L1 - zero;
+				ch[DEBUG_SAMPLING_CH_PH2] = ADC_V_L2 - zero;
+				ch[DEBUG_SAMPLING_CH_PH3] = ADC_V_L3 - zero;
+			}
+		}
+	}
 
-			m_sample_now++;
+	ch[DEBUG_SAMPLING_CH_VZERO] = zero;
+	ch[DEBUG_SAMPLING_CH_CURR_FIR] = (int16_t)(current * (8.0 / FAC_CURRENT));
 
-			m_last_adc_duration_sample = mc_interface_get_last_inj_adc_isr_duration();
+	if (channels & (1 << DEBUG_SAMPLING_CH_F_SW)) {
+		ch[DEBUG_SAMPLING_CH_F_SW] = (int16_t)(0.1 / t_samp / decimation);
+	}
+
+	// Reads the hall sensor GPIOs
+	if (channels & (1 << DEBUG_SAMPLING_CH_STATUS)) {
+		ch[DEBUG_SAMPLING_CH_STATUS] = mcpwm_get_comm_step() | (mcpwm_read_hall_phase() << 3);
+	}
+}
+
+/**
+ * Push one frame of the selected channels into the stream ring. Called from
+ * the ISR only, so the head index has one writer. The sample thread is woken
+ * up once per packet worth of frames.
+ */
+static void stream_sample(int16_t *ch) {
+	const uint32_t ch_num = m_stream_ch_num;
+	uint32_t head = m_stream_head;
+
+	if ((ADC_STREAM_BUFFER_LEN - (head - __atomic_load_n(&m_stream_tail, __ATOMIC_ACQUIRE))) < ch_num) {
+		m_stream_dropped++;
+		return;
+	}
+
+	const uint16_t channels = m_stream_channels;
+	for (int i = 0;i < DEBUG_SAMPLING_CH_NUM;i++) {
+		if (channels & (1 << i)) {
+			m_stream_buffer[head & (ADC_STREAM_BUFFER_LEN - 1)] = ch[i];
+			head++;
 		}
 	}
+
+	__atomic_store_n(&m_stream_head, head, __ATOMIC_RELEASE);
+
+	m_stream_frames++;
+	if ((m_stream_frames % m_stream_packet_frames) == 0) {
+		chSysLockFromISR();
+		chEvtSignalI(sample_send_tp, (eventmask_t) 2);
+		chSysUnlockFromISR();
+	}
 }
 
 void mc_interface_adc_inj_int_handler(void) {
@@ -2861,6 +3162,64 @@ static void send_sample_block(int ind, int offset) {
 	send_func_sample(buffer, index);
 }
 
+/**
+ * Send all complete packets in the stream ring, and the remainder when the
+ * stream has been stopped.
+ *
+ * Packet: COMM_SAMPLE_STREAM, index of the first frame (uint32), frames
+ * dropped so far (uint32), channel mask (uint16), raw (uint8), frame count
+ * (uint8), sample rate [Hz], current scale [A/LSB] and voltage scale
+ * [V/LSB] (float32_auto), then the frames as int16.
+ */
+static void send_stream_packets(void) {
+	const int ch_num = m_stream_ch_num;
+
+	for (;;) {
+		uint32_t tail = m_stream_tail;
+		uint32_t frames = (__atomic_load_n(&m_stream_head, __ATOMIC_ACQUIRE) - tail) / ch_num;
+
+		if (frames == 0 || (m_stream_active && frames < (uint32_t)m_stream_packet_frames)) {
+			break;
+		}
+
+		if (frames > (uint32_t)m_stream_packet_frames) {
+			frames = m_stream_packet_frames;
+		}
+
+		volatile motor_if_state_t *motor = &m_motor_1;
+#ifdef HW_HAS_DUAL_MOTORS
+		if (m_stream_is_second_motor) {
+			motor = &m_motor_2;
+		}
+#endif
+
+		uint8_t *buffer = m_stream_packet;
+		int32_t index = 0;
+		buffer[index++] = COMM_SAMPLE_STREAM;
+		buffer_append_uint32(buffer, m_stream_sent, &index);
+		buffer_append_uint32(buffer, m_stream_dropped, &index);
+		buffer_append_uint16(buffer, m_stream_channels, &index);
+		buffer[index++] = m_stream_raw;
+		buffer[index++] = frames;
+		buffer_append_float32_auto(buffer, motor->m_f_samp_now / (float)m_stream_int, &index);
+		buffer_append_float32_auto(buffer, m_stream_raw ? 1.0 : FAC_CURRENT / 8.0, &index);
+		buffer_append_float32_auto(buffer, m_stream_raw ? 1.0 :
+				V_REG / 4096.0 * ((VIN_R1 + VIN_R2) / VIN_R2) * ADC_VOLTS_PH_FACTOR, &index);
+
+		for (uint32_t i = 0;i < frames * ch_num;i++) {
+			buffer_append_int16(buffer, m_stream_buffer[tail & (ADC_STREAM_BUFFER_LEN - 1)], &index);
+			tail++;
+		}
+
+		__atomic_store_n(&m_stream_tail, tail, __ATOMIC_RELEASE);
+		m_stream_sent += frames;
+
+		if (send_func_sample) {
+			send_func_sample(buffer, index);
+		}
+	}
+}
+
 static THD_FUNCTION(sample_send_thread, arg) {
 	(void)arg;
 
@@ -2868,7 +3227,23 @@ static THD_FUNCTION(sample_send_thread, arg) {
 	sample_send_tp = chThdGetSelfX();
 
 	for(;;) {
-		chEvtWaitAny((eventmask_t) 1);
+		eventmask_t evt = chEvtWaitAny((eventmask_t) 7);
+
+		if (evt & (eventmask_t) 4) {
+			m_stream_tail = m_stream_head;
+			m_stream_frames = 0;
+			m_stream_dropped = 0;
+			m_stream_sent = 0;
+			m_stream_active = true;
+		}
+
+		if (evt & (eventmask_t) 2) {
+			send_stream_packets();
+		}
+
+		if (!(evt & (eventmask_t) 1)) {
+			continue;
+		}
 
 		int len = 0;
 		int offset = 0;
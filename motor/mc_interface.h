@@ -23,6 +23,7 @@
 #include "conf_general.h"
 #include "hw.h"
 #include "datatypes.h"
+#include "mc_capture.h"
 
 // Functions
 void mc_interface_init(void);
@@ -88,7 +89,10 @@ float mc_interface_get_pid_pos_set(void);
 float mc_interface_get_pid_pos_now(void);
 void mc_interface_update_pid_pos_offset(float angle_now, bool store);
 float mc_interface_get_last_sample_adc_isr_duration(void);
-void mc_interface_sample_print_data(debug_sampling_mode mode, uint16_t len, uint8_t decimation, bool raw, 
+void mc_interface_sample_print_data(debug_sampling_mode mode, uint16_t len, uint8_t decimation, bool raw,
+		uint16_t channels, void(*reply_func)(unsigned char *data, unsigned int len));
+bool mc_interface_capture_arm(const mc_capture_config *conf);
+void mc_interface_capture_send(uint16_t offset, uint16_t count,
 		void(*reply_func)(unsigned char *data, unsigned int len));
 float mc_interface_temp_fet_filtered(void);
 float mc_interface_temp_motor_filtered(void);
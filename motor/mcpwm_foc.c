@@ -41,6 +41,7 @@
 #include <stdio.h>
 #include "virtual_motor.h"
 #include "foc_math.h"
+#include "foc_stage_prof.h"
 
 // Private variables
 static volatile bool m_dccal_done = false;
@@ -54,14 +55,30 @@ static volatile int m_isr_motor = 0;
 // Private functions
 static void control_current(motor_all_state_t *motor, float dt);
 static void update_valpha_vbeta(motor_all_state_t *motor, float mod_alpha, float mod_beta);
+static void dt_comp_reset(motor_all_state_t *motor);
+static void dt_comp_update(motor_all_state_t *motor);
+static void isr_sched_init(motor_all_state_t *motor);
+static void isr_task_motor_lut(void *arg, float dt);
+static void isr_task_dt_comp_learn(void *arg, float dt);
+static void isr_task_param_est(void *arg, float dt);
+static void param_est_reset(motor_all_state_t *motor);
+static bool param_est_take(const foc_param_est_t *est, foc_param_est_ind ind, float *value);
+static void param_est_publish(motor_all_state_t *motor, const foc_param_est_point *p, bool active);
+static void param_est_run(motor_all_state_t *motor);
+static void fsw_adapt_limits(const motor_all_state_t *motor, float *f_min, float *f_max);
+static void fsw_adapt_reset(motor_all_state_t *motor);
+static void fsw_adapt_run(motor_all_state_t *motor, float dt);
+static uint32_t fsw_take_top(motor_all_state_t *motor);
 static void stop_pwm_hw(motor_all_state_t *motor);
 static void start_pwm_hw(motor_all_state_t *motor);
 static void full_brake_hw(motor_all_state_t *motor);
 static void terminal_plot_hfi(int argc, const char **argv);
 static void timer_update(motor_all_state_t *motor, float dt);
 static void hfi_update(volatile motor_all_state_t *motor, float dt);
+static int measure_lut_axis(volatile motor_all_state_t *motor, float v_inj, bool q_axis, float *inductance);
 
 // Threads
+#ifndef USE_PC_BUILD
 static THD_WORKING_AREA(timer_thread_wa, 512);
 static THD_FUNCTION(timer_thread, arg);
 static volatile bool timer_thd_stop;
@@ -73,6 +90,7 @@ static volatile bool hfi_thd_stop;
 static THD_WORKING_AREA(pid_thread_wa, 256);
 static THD_FUNCTION(pid_thread, arg);
 static volatile bool pid_thd_stop;
+#endif
 
 // Macros
 #ifdef HW_HAS_3_SHUNTS
@@ -130,35 +148,58 @@ static volatile bool pid_thd_stop;
 #define M_MOTOR(is_second_motor)  (((void)is_second_motor), &m_motor_1)
 #endif
 
+// Inductance table measurement
+#define LUT_PROBE_HALF_LEN		4		// Control periods per half wave
+#define LUT_PROBE_SKIP			1		// Periods after each edge that are not used
+#define LUT_PROBE_SAMPLES		3000	// Periods per half wave to average
+#define LUT_PROBE_RIPPLE		0.05	// Current ripple relative to i_max
+
+// Inverter nonlinearity compensation
+#define DT_COMP_LEARN_TIME		0.05	// Time constant of the map learning [s]
+#define DT_COMP_LEARN_MAX_V		0.9		// Only learn below this fraction of the output voltage
+
+// Tasks of the ISR scheduler. The costs are declared worst cases at 168 MHz.
+#define ISR_SCHED_BUDGET_US		2.0		// All tasks of one ISR together
+#define ISR_TASK_LUT_PERIOD		4
+#define ISR_TASK_LUT_COST_US	1.5
+#define ISR_TASK_DT_PERIOD		2
+#define ISR_TASK_DT_COST_US		1.0
+#define ISR_TASK_PARAM_EST_PERIOD	1
+#define ISR_TASK_PARAM_EST_COST_US	0.3
+
+// Online parameter estimation
+#define PARAM_EST_DECIMATION	8		// Control periods per sample
+#define PARAM_EST_FORGET		0.9998	// Per equation, two equations per sample
+#define PARAM_EST_P_INIT		1.0		// Initial uncertainty, about 100 % of the nominal values
+#define PARAM_EST_MIN_CURRENT	0.05	// Only sample above this fraction of l_current_max
+#define PARAM_EST_MAX_V			0.9		// Only sample below this fraction of the output voltage
+#define PARAM_EST_APPLY_BOUND	0.1		// Apply an estimate once its bound is below this fraction of it
+#define PARAM_EST_APPLY_RANGE	2.0		// Applied estimates stay within this factor of the configuration
+
+// Switching frequency adaptation
+#define FSW_ADAPT_MIN_FACTOR	0.4		// Default lowest frequency relative to foc_f_zv
+#define FSW_ADAPT_F_LOWEST		3.0e3	// [Hz]
+#define FSW_ADAPT_THERMAL_TAU	2.0		// From the losses to the FET temperature reading [s]
+#define FSW_ADAPT_SAMPLES_REV	30.0	// Control periods per electrical revolution at least
+
+static int hfi_samples_num(foc_hfi_samples samples) {
+	switch (samples) {
+	case HFI_SAMPLES_8: return 8;
+	case HFI_SAMPLES_16: return 16;
+	case HFI_SAMPLES_32: return 32;
+	case HFI_SAMPLES_24: return 24;
+	case HFI_SAMPLES_48: return 48;
+	case HFI_SAMPLES_64: return 64;
+	default: return 16;
+	}
+}
+
 static void update_hfi_samples(foc_hfi_samples samples, volatile motor_all_state_t *motor) {
 	utils_sys_lock_cnt();
 
 	memset((void*)&motor->m_hfi, 0, sizeof(motor->m_hfi));
-	switch (samples) {
-	case HFI_SAMPLES_8:
-		motor->m_hfi.samples = 8;
-		motor->m_hfi.table_fact = 4;
-		motor->m_hfi.fft_bin0_func = utils_fft8_bin0;
-		motor->m_hfi.fft_bin1_func = utils_fft8_bin1;
-		motor->m_hfi.fft_bin2_func = utils_fft8_bin2;
-		break;
-
-	case HFI_SAMPLES_16:
-		motor->m_hfi.samples = 16;
-		motor->m_hfi.table_fact = 2;
-		motor->m_hfi.fft_bin0_func = utils_fft16_bin0;
-		motor->m_hfi.fft_bin1_func = utils_fft16_bin1;
-		motor->m_hfi.fft_bin2_func = utils_fft16_bin2;
-		break;
-
-	case HFI_SAMPLES_32:
-		motor->m_hfi.samples = 32;
-		motor->m_hfi.table_fact = 1;
-		motor->m_hfi.fft_bin0_func = utils_fft32_bin0;
-		motor->m_hfi.fft_bin1_func = utils_fft32_bin1;
-		motor->m_hfi.fft_bin2_func = utils_fft32_bin2;
-		break;
-	}
+	motor->m_hfi.samples = hfi_samples_num(samples);
+	utils_dft_init((utils_dft_t*)&motor->m_hfi.dft, motor->m_hfi.samples);
 
 	utils_sys_unlock_cnt();
 }
@@ -371,7 +412,14 @@ void mcpwm_foc_init(mc_configuration *conf_m1, mc_configuration *conf_m2) {
 	m_motor_1.m_hall_dt_diff_last = 1.0;
 	m_motor_1.m_hall_dt_diff_now = 1.0;
 	m_motor_1.m_ang_hall_int_prev = -1;
+	conf_general_read_motor_lut((motor_lut_data*)&m_motor_1.m_lut_data, false);
 	foc_precalc_values((motor_all_state_t*)&m_motor_1);
+	m_motor_1.m_f_zv = m_motor_1.m_conf->foc_f_zv;
+	m_motor_1.m_f_zv_conf = m_motor_1.m_conf->foc_f_zv;
+	dt_comp_reset((motor_all_state_t*)&m_motor_1);
+	param_est_reset((motor_all_state_t*)&m_motor_1);
+	fsw_adapt_reset((motor_all_state_t*)&m_motor_1);
+	isr_sched_init((motor_all_state_t*)&m_motor_1);
 	update_hfi_samples(m_motor_1.m_conf->foc_hfi_samples, &m_motor_1);
 	init_audio_state(&m_motor_1.m_audio);
 
@@ -383,7 +431,14 @@ void mcpwm_foc_init(mc_configuration *conf_m1, mc_configuration *conf_m2) {
 	m_motor_2.m_hall_dt_diff_last = 1.0;
 	m_motor_2.m_hall_dt_diff_now = 1.0;
 	m_motor_2.m_ang_hall_int_prev = -1;
+	conf_general_read_motor_lut((motor_lut_data*)&m_motor_2.m_lut_data, true);
 	foc_precalc_values((motor_all_state_t*)&m_motor_2);
+	m_motor_2.m_f_zv = m_motor_2.m_conf->foc_f_zv;
+	m_motor_2.m_f_zv_conf = m_motor_2.m_conf->foc_f_zv;
+	dt_comp_reset((motor_all_state_t*)&m_motor_2);
+	param_est_reset((motor_all_state_t*)&m_motor_2);
+	fsw_adapt_reset((motor_all_state_t*)&m_motor_2);
+	isr_sched_init((motor_all_state_t*)&m_motor_2);
 	update_hfi_samples(m_motor_2.m_conf->foc_hfi_samples, &m_motor_2);
 	init_audio_state(&m_motor_2.m_audio);
 #endif
@@ -566,6 +621,7 @@ void mcpwm_foc_init(mc_configuration *conf_m1, mc_configuration *conf_m2) {
 		m_dccal_done = true;
 	}
 #endif
+#ifndef USE_PC_BUILD
 	// Start threads
 	timer_thd_stop = false;
 	chThdCreateStatic(timer_thread_wa, sizeof(timer_thread_wa), NORMALPRIO, timer_thread, NULL);
@@ -575,6 +631,7 @@ void mcpwm_foc_init(mc_configuration *conf_m1, mc_configuration *conf_m2) {
 
 	pid_thd_stop = false;
 	chThdCreateStatic(pid_thread_wa, sizeof(pid_thread_wa), NORMALPRIO, pid_thread, NULL);
+#endif
 
 	// Check if the system has resumed from IWDG reset and generate fault if it has. This can be used to
 	// tell if some frozen thread caused a watchdog reset. Note that this also will trigger after running
@@ -583,6 +640,8 @@ void mcpwm_foc_init(mc_configuration *conf_m1, mc_configuration *conf_m2) {
 		mc_interface_fault_stop(FAULT_CODE_BOOTING_FROM_WATCHDOG_RESET, false, false);
 	}
 
+	foc_stage_prof_init();
+
 	terminal_register_command_callback(
 			"foc_plot_hfi_en",
 			"Enable HFI plotting. 0: off, 1: DFT, 2: Raw",
@@ -599,6 +658,7 @@ void mcpwm_foc_deinit(void) {
 
 	m_init_done = false;
 
+#ifndef USE_PC_BUILD
 	timer_thd_stop = true;
 	while (timer_thd_stop) {
 		chThdSleepMilliseconds(1);
@@ -613,6 +673,7 @@ void mcpwm_foc_deinit(void) {
 	while (pid_thd_stop) {
 		chThdSleepMilliseconds(1);
 	}
+#endif
 
 	TIM_DeInit(TIM1);
 	TIM_DeInit(TIM2);
@@ -638,11 +699,21 @@ bool mcpwm_foc_init_done(void) {
 void mcpwm_foc_set_configuration(mc_configuration *configuration) {
 	get_motor_now()->m_conf = configuration;
 	foc_precalc_values((motor_all_state_t*)get_motor_now());
+	get_motor_now()->m_param_est_reset = true;
 
 	// Below we check if anything in the configuration changed that requires stopping the motor.
 
 	uint32_t top = SYSTEM_CORE_CLOCK / (int)configuration->foc_f_zv;
-	if (TIM1->ARR != top) {
+
+	// While the switching frequency is adapted the timer runs at another
+	// top. That is not a reason to stop, as long as foc_f_zv is the same.
+	bool fsw_adapted = false;
+#ifndef HW_HAS_DUAL_MOTORS
+	fsw_adapted = get_motor_now()->m_state == MC_STATE_RUNNING &&
+			get_motor_now()->m_f_zv_conf == configuration->foc_f_zv;
+#endif
+
+	if (TIM1->ARR != top && !fsw_adapted) {
 #ifdef HW_HAS_DUAL_MOTORS
 		m_motor_1.m_control_mode = CONTROL_MODE_NONE;
 		m_motor_1.m_state = MC_STATE_OFF;
@@ -653,6 +724,8 @@ void mcpwm_foc_set_configuration(mc_configuration *configuration) {
 		stop_pwm_hw((motor_all_state_t*)&m_motor_2);
 
 		timer_reinit((int)configuration->foc_f_zv);
+		m_motor_1.m_f_zv = configuration->foc_f_zv;
+		m_motor_2.m_f_zv = configuration->foc_f_zv;
 #else
 		get_motor_now()->m_control_mode = CONTROL_MODE_NONE;
 		get_motor_now()->m_state = MC_STATE_OFF;
@@ -664,13 +737,25 @@ void mcpwm_foc_set_configuration(mc_configuration *configuration) {
 #endif
 	}
 
-	if (((1 << get_motor_now()->m_conf->foc_hfi_samples) * 8) != get_motor_now()->m_hfi.samples) {
+	if (!fsw_adapted) {
+		get_motor_now()->m_fsw_top_next = 0;
+		get_motor_now()->m_f_zv = configuration->foc_f_zv;
+	}
+	get_motor_now()->m_f_zv_conf = configuration->foc_f_zv;
+
+	if (hfi_samples_num(get_motor_now()->m_conf->foc_hfi_samples) != get_motor_now()->m_hfi.samples) {
 		get_motor_now()->m_control_mode = CONTROL_MODE_NONE;
 		get_motor_now()->m_state = MC_STATE_OFF;
 		stop_pwm_hw((motor_all_state_t*)get_motor_now());
 		update_hfi_samples(get_motor_now()->m_conf->foc_hfi_samples, get_motor_now());
 	}
 
+	// A new switching frequency reaches both motors of a dual motor setup
+	dt_comp_update((motor_all_state_t*)&m_motor_1);
+#ifdef HW_HAS_DUAL_MOTORS
+	dt_comp_update((motor_all_state_t*)&m_motor_2);
+#endif
+
 	virtual_motor_set_configuration(configuration);
 }
 
@@ -1051,7 +1136,7 @@ float mcpwm_foc_get_pid_pos_now(void) {
  * The switching frequency in Hz.
  */
 float mcpwm_foc_get_switching_frequency_now(void) {
-	return get_motor_now()->m_conf->foc_f_zv;
+	return get_motor_now()->m_f_zv;
 }
 
 /**
@@ -1063,12 +1148,12 @@ float mcpwm_foc_get_switching_frequency_now(void) {
 float mcpwm_foc_get_sampling_frequency_now(void) {
 #ifdef HW_HAS_PHASE_SHUNTS
 	if (get_motor_now()->m_conf->foc_control_sample_mode == FOC_CONTROL_SAMPLE_MODE_V0_V7) {
-		return get_motor_now()->m_conf->foc_f_zv;
+		return get_motor_now()->m_f_zv;
 	} else {
-		return get_motor_now()->m_conf->foc_f_zv / 2.0;
+		return get_motor_now()->m_f_zv / 2.0;
 	}
 #else
-	return get_motor_now()->m_conf->foc_f_zv / 2.0;
+	return get_motor_now()->m_f_zv / 2.0;
 #endif
 }
 
@@ -1078,12 +1163,12 @@ float mcpwm_foc_get_sampling_frequency_now(void) {
 float mcpwm_foc_get_ts(void) {
 #ifdef HW_HAS_PHASE_SHUNTS
 	if (get_motor_now()->m_conf->foc_control_sample_mode == FOC_CONTROL_SAMPLE_MODE_V0_V7) {
-		return (1.0 / get_motor_now()->m_conf->foc_f_zv) ;
+		return (1.0 / get_motor_now()->m_f_zv) ;
 	} else {
-		return (1.0 / (get_motor_now()->m_conf->foc_f_zv / 2.0));
+		return (1.0 / (get_motor_now()->m_f_zv / 2.0));
 	}
 #else
-	return (1.0 / get_motor_now()->m_conf->foc_f_zv) ;
+	return (1.0 / get_motor_now()->m_f_zv) ;
 #endif
 }
 
@@ -1458,8 +1543,8 @@ float mcpwm_foc_get_est_res(void) {
 float mcpwm_foc_get_est_ind(void) {
 	float real_bin0, imag_bin0;
 	float real_bin2, imag_bin2;
-	get_motor_now()->m_hfi.fft_bin0_func((float*)get_motor_now()->m_hfi.buffer, &real_bin0, &imag_bin0); // real_bin0 contains the average of the inverse of the inductance
-	get_motor_now()->m_hfi.fft_bin0_func((float*)get_motor_now()->m_hfi.buffer, &real_bin2, &imag_bin2); // real_bin2 (cosine) and imag_bin2 (sine) contain the magnitude of the measured 2nd harmonic. Note: dual sided and length normalized FFT, so signal magnitude is twice the bin value.
+	utils_dft_bin((utils_dft_t*)&get_motor_now()->m_hfi.dft, (float*)get_motor_now()->m_hfi.buffer, 0, &real_bin0, &imag_bin0); // real_bin0 contains the average of the inverse of the inductance
+	utils_dft_bin((utils_dft_t*)&get_motor_now()->m_hfi.dft, (float*)get_motor_now()->m_hfi.buffer, 2, &real_bin2, &imag_bin2); // real_bin2 (cosine) and imag_bin2 (sine) contain the magnitude of the measured 2nd harmonic. Note: dual sided and length normalized FFT, so signal magnitude is twice the bin value.
 	float offset = real_bin0;
 	float amplitude = NORM2_f(real_bin2, imag_bin2) * 2.0;
 	float Ld_est = 1.0 / (offset + amplitude);
@@ -1984,9 +2069,9 @@ int mcpwm_foc_measure_inductance(float duty, int samples, float *curr, float *ld
 		float real_bin2, imag_bin2;
 		float real_bin0_i, imag_bin0_i;
 
-		motor->m_hfi.fft_bin0_func((float*)motor->m_hfi.buffer, &real_bin0, &imag_bin0); // real_bin0 contains the average of the inverse of the inductance
-		motor->m_hfi.fft_bin2_func((float*)motor->m_hfi.buffer, &real_bin2, &imag_bin2); // real_bin2 (cosine) and imag_bin2 (sine) contain the magnitude of the measured 2nd harmonic. Note: dual sided and length normalized FFT, so signal magnitude is twice the bin value.
-		motor->m_hfi.fft_bin0_func((float*)motor->m_hfi.buffer_current, &real_bin0_i, &imag_bin0_i); // real_bin0_i contains the average delta current
+		utils_dft_bin((utils_dft_t*)&motor->m_hfi.dft, (float*)motor->m_hfi.buffer, 0, &real_bin0, &imag_bin0); // real_bin0 contains the average of the inverse of the inductance
+		utils_dft_bin((utils_dft_t*)&motor->m_hfi.dft, (float*)motor->m_hfi.buffer, 2, &real_bin2, &imag_bin2); // real_bin2 (cosine) and imag_bin2 (sine) contain the magnitude of the measured 2nd harmonic. Note: dual sided and length normalized FFT, so signal magnitude is twice the bin value.
+		utils_dft_bin((utils_dft_t*)&motor->m_hfi.dft, (float*)motor->m_hfi.buffer_current, 0, &real_bin0_i, &imag_bin0_i); // real_bin0_i contains the average delta current
 
 		//l_sum += real_bin0;
 		//i_sum += real_bin0_i;
@@ -2085,6 +2170,292 @@ int mcpwm_foc_measure_inductance_current(float curr_goal, int samples, float *cu
 	return fault;
 }
 
+/**
+ * Measure the saturation-aware motor model of the current motor. At every
+ * grid point the current controller holds the bias current of that point
+ * while the incremental inductance of both axes is measured, see
+ * foc_motor_lut.h. The flux linkage cannot be measured at standstill, so
+ * the configured value is used at all points.
+ *
+ * The rotor is aligned to the d axis first and then has to be locked
+ * mechanically, as the q axis points produce torque up to i_max.
+ *
+ * @param i_max
+ * The current the grid spans. Points above the motor current limit take
+ * the values of their neighbor towards id = 0.
+ *
+ * @param lut
+ * The measured table. It is not applied or stored.
+ *
+ * @return
+ * The fault code
+ */
+int mcpwm_foc_measure_inductance_lut(float i_max, motor_lut_data *lut) {
+	float ld[MOTOR_LUT_ID_POINTS][MOTOR_LUT_IQ_POINTS];
+	float lq[MOTOR_LUT_ID_POINTS][MOTOR_LUT_IQ_POINTS];
+	float lambda[MOTOR_LUT_ID_POINTS][MOTOR_LUT_IQ_POINTS];
+
+	// The small-signal inductance sizes the injection and fills points where the probe fails
+	float ind = 0.0;
+	int fault = mcpwm_foc_measure_inductance_current(i_max * 0.25, 100, 0, 0, &ind);
+	if (fault != FAULT_CODE_NONE) {
+		return fault;
+	}
+
+	volatile motor_all_state_t *motor = get_motor_now();
+	const float l_nom = ind * 1e-6;
+	const float t_half = (float)LUT_PROBE_HALF_LEN / motor->m_conf->foc_f_zv;
+	float v_inj = LUT_PROBE_RIPPLE * i_max * l_nom / t_half;
+	utils_truncate_number(&v_inj, 0.0, 0.1 * mc_interface_get_input_voltage_filtered());
+	const float i_lim = motor->m_conf->lo_current_max;
+
+	mc_interface_lock();
+
+	motor->m_lut_probe.active = false;
+	motor->m_phase_override = true;
+	motor->m_phase_now_override = 0.0;
+	motor->m_id_set = 0.0;
+	motor->m_iq_set = 0.0;
+	motor->m_control_mode = CONTROL_MODE_CURRENT;
+	motor->m_motor_released = false;
+	motor->m_state = MC_STATE_RUNNING;
+
+	// MTPA overrides id target
+	MTPA_MODE mtpa_old = motor->m_conf->foc_mtpa_mode;
+	motor->m_conf->foc_mtpa_mode = MTPA_MODE_OFF;
+
+	// Disable timeout
+	systime_t tout = timeout_get_timeout_msec();
+	float tout_c = timeout_get_brake_current();
+	KILL_SW_MODE tout_ksw = timeout_get_kill_sw_mode();
+	timeout_reset();
+	timeout_configure(60000, 0.0, KILL_SW_MODE_DISABLED);
+
+	// Align the rotor
+	for (int i = 0;i < 1000;i++) {
+		motor->m_id_set = (float)i * i_max * 0.3 / 1000.0;
+		fault = mc_interface_get_fault();
+		if (fault != FAULT_CODE_NONE) {
+			goto exit_measure_lut;
+		}
+		chThdSleepMilliseconds(1);
+	}
+
+	for (int j = 0;j < MOTOR_LUT_IQ_POINTS;j++) {
+		for (int i = MOTOR_LUT_ID_POINTS - 1;i >= 0;i--) {
+			const float id = foc_motor_lut_grid_id(i_max, i);
+			const float iq = foc_motor_lut_grid_iq(i_max, j);
+			lambda[i][j] = motor->m_conf->foc_motor_flux_linkage;
+
+			if ((SQ(id) + SQ(iq)) > SQ(i_lim) && i < (MOTOR_LUT_ID_POINTS - 1)) {
+				ld[i][j] = ld[i + 1][j];
+				lq[i][j] = lq[i + 1][j];
+				continue;
+			}
+
+			while (fabsf(motor->m_id_set - id) > 0.001 || fabsf(motor->m_iq_set - iq) > 0.001) {
+				utils_step_towards((float*)&motor->m_id_set, id, i_max / 500.0);
+				utils_step_towards((float*)&motor->m_iq_set, iq, i_max / 500.0);
+				fault = mc_interface_get_fault();
+				if (fault != FAULT_CODE_NONE) {
+					goto exit_measure_lut;
+				}
+				chThdSleepMilliseconds(1);
+			}
+
+			// Let the current settle
+			chThdSleepMilliseconds(50);
+
+			ld[i][j] = l_nom;
+			lq[i][j] = l_nom;
+
+			fault = measure_lut_axis(motor, v_inj, false, &ld[i][j]);
+			if (fault != FAULT_CODE_NONE) {
+				goto exit_measure_lut;
+			}
+
+			fault = measure_lut_axis(motor, v_inj, true, &lq[i][j]);
+			if (fault != FAULT_CODE_NONE) {
+				goto exit_measure_lut;
+			}
+		}
+	}
+
+	foc_motor_lut_pack(lut, i_max, ld, lq, lambda);
+
+	exit_measure_lut:
+	motor->m_lut_probe.active = false;
+	motor->m_id_set = 0.0;
+	motor->m_iq_set = 0.0;
+	motor->m_phase_override = false;
+	motor->m_control_mode = CONTROL_MODE_NONE;
+	motor->m_state = MC_STATE_OFF;
+	stop_pwm_hw((motor_all_state_t*)motor);
+	motor->m_conf->foc_mtpa_mode = mtpa_old;
+	timeout_configure(tout, tout_c, tout_ksw);
+	mc_interface_unlock();
+
+	return fault;
+}
+
+/**
+ * Use a saturation-aware motor model for the current motor. An invalid or
+ * cleared table goes back to the configured motor parameters.
+ */
+void mcpwm_foc_set_motor_lut(const motor_lut_data *lut) {
+	volatile motor_all_state_t *motor = get_motor_now();
+
+	motor->m_lut.valid = false;
+	motor->m_lut_data = *lut;
+	foc_precalc_values((motor_all_state_t*)motor);
+}
+
+const motor_lut_data *mcpwm_foc_get_motor_lut(void) {
+	return (const motor_lut_data*)&get_motor_now()->m_lut_data;
+}
+
+const foc_mtpa_table_t *mcpwm_foc_get_mtpa_table(void) {
+	return (const foc_mtpa_table_t*)&get_motor_now()->m_mtpa_table;
+}
+
+/**
+ * Enable the inverter nonlinearity compensation.
+ *
+ * @param enabled
+ * Add the compensation to the output voltage.
+ *
+ * @param learn
+ * Learn the map at low speed while it is enabled.
+ */
+void mcpwm_foc_set_dt_comp(bool enabled, bool learn) {
+	volatile motor_all_state_t *motor = get_motor_now();
+	motor->m_dt_comp.learn = learn;
+	motor->m_dt_comp.enabled = enabled;
+}
+
+/**
+ * Forget what was learned and start over from the fixed dead time model.
+ */
+void mcpwm_foc_reset_dt_comp(void) {
+	volatile motor_all_state_t *motor = get_motor_now();
+	const bool enabled = motor->m_dt_comp.enabled;
+	motor->m_dt_comp.enabled = false;
+	dt_comp_reset((motor_all_state_t*)motor);
+	motor->m_dt_comp.enabled = enabled;
+}
+
+const foc_dt_comp_t *mcpwm_foc_get_dt_comp(void) {
+	return (const foc_dt_comp_t*)&get_motor_now()->m_dt_comp;
+}
+
+const foc_isr_sched_t *mcpwm_foc_get_isr_sched(bool is_second_motor) {
+	return (const foc_isr_sched_t*)&M_MOTOR(is_second_motor)->m_isr_sched;
+}
+
+/**
+ * Estimate R, Ld, Lq and the flux linkage while the motor runs.
+ *
+ * @param enabled
+ * Sample the control periods and update the estimates.
+ *
+ * @param apply
+ * Use the estimates that are confident enough in the observer and the
+ * current controller instead of the configuration.
+ */
+void mcpwm_foc_set_param_est(bool enabled, bool apply) {
+	volatile motor_all_state_t *motor = get_motor_now();
+	motor->m_param_est_apply = enabled && apply;
+	motor->m_param_est_enabled = enabled;
+}
+
+/**
+ * Start over from the configured parameters.
+ */
+void mcpwm_foc_reset_param_est(void) {
+	get_motor_now()->m_param_est_reset = true;
+}
+
+const foc_param_est_t *mcpwm_foc_get_param_est(void) {
+	return (const foc_param_est_t*)&get_motor_now()->m_param_est;
+}
+
+/**
+ * Copy the parameters the observer and the current controller use.
+ *
+ * @param p
+ * Filled in while the estimates are applied.
+ *
+ * @return
+ * true if the estimates are applied.
+ */
+bool mcpwm_foc_get_param_est_applied(foc_param_est_point *p) {
+	volatile motor_all_state_t *motor = get_motor_now();
+
+	utils_sys_lock_cnt();
+	const bool active = motor->m_param_est_active;
+	if (active) {
+		*p = *(foc_param_est_point*)&motor->m_param_est_now;
+	}
+	utils_sys_unlock_cnt();
+
+	return active;
+}
+
+uint32_t mcpwm_foc_get_param_est_dropped(void) {
+	return foc_param_est_ring_dropped((foc_param_est_ring_t*)&get_motor_now()->m_param_est_ring);
+}
+
+/**
+ * Run at the switching frequency with the lowest inverter losses for the
+ * operating point, from a loss model that is learned from the FET
+ * temperature. Not available with dual motors.
+ *
+ * @param enabled
+ * Adapt the frequency. When disabled it goes back to foc_f_zv.
+ *
+ * @param f_min
+ * Lowest zero vector frequency [Hz], 0 for a default relative to foc_f_zv.
+ *
+ * @param f_max
+ * Highest zero vector frequency [Hz], 0 for foc_f_zv. It is never above
+ * foc_f_zv.
+ *
+ * @return
+ * False if the hardware does not support it.
+ */
+bool mcpwm_foc_set_fsw_adapt(bool enabled, float f_min, float f_max) {
+#ifdef HW_HAS_DUAL_MOTORS
+	(void)enabled;
+	(void)f_min;
+	(void)f_max;
+	return false;
+#else
+	volatile motor_all_state_t *motor = get_motor_now();
+	motor->m_fsw_f_min_set = f_min;
+	motor->m_fsw_f_max_set = f_max;
+	if (enabled && !motor->m_fsw_enabled) {
+		motor->m_fsw_reset = true;
+	}
+	motor->m_fsw_enabled = enabled;
+	return true;
+#endif
+}
+
+bool mcpwm_foc_get_fsw_adapt(void) {
+	return get_motor_now()->m_fsw_enabled;
+}
+
+const foc_fsw_adapt_t *mcpwm_foc_get_fsw_model(void) {
+	return (const foc_fsw_adapt_t*)&get_motor_now()->m_fsw;
+}
+
+void mcpwm_foc_reset_isr_sched_stats(void) {
+	foc_isr_sched_reset_stats((foc_isr_sched_t*)&m_motor_1.m_isr_sched);
+#ifdef HW_HAS_DUAL_MOTORS
+	foc_isr_sched_reset_stats((foc_isr_sched_t*)&m_motor_2.m_isr_sched);
+#endif
+}
+
 bool mcpwm_foc_beep(float freq, float time, float voltage) {
 	if (mc_interface_get_fault() != FAULT_CODE_NONE) {
 		return false;
@@ -2848,6 +3219,7 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 	bool is_v7 = !(TIM1->CR1 & TIM_CR1_DIR);
 
 	FOC_PROFILE_BEGIN();
+	FOC_STAGE_PROF_BEGIN();
 
 	bool is_second_motor = false;
 	int norm_curr_ofs = 0;
@@ -2928,12 +3300,12 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 #ifdef HW_HAS_PHASE_SHUNTS
 	float dt;
 	if (conf_now->foc_control_sample_mode == FOC_CONTROL_SAMPLE_MODE_V0_V7) {
-		dt = 1.0 / conf_now->foc_f_zv;
+		dt = 1.0 / motor_now->m_f_zv;
 	} else {
-		dt = 1.0 / (conf_now->foc_f_zv / 2.0);
+		dt = 1.0 / (motor_now->m_f_zv / 2.0);
 	}
 #else
-	float dt = 1.0 / (conf_now->foc_f_zv / 2.0);
+	float dt = 1.0 / (motor_now->m_f_zv / 2.0);
 #endif
 
 	if (conf_other->foc_control_sample_mode == FOC_CONTROL_SAMPLE_MODE_V0_V7_INTERPOL && !skip_interpolation) {
@@ -2990,6 +3362,8 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 	dt *= (float)FOC_CONTROL_LOOP_FREQ_DIVIDER;
 #endif
 
+	FOC_STAGE_PROF_MARK(FOC_STAGE_OTHER);
+
 	// Reset the watchdog
 	timeout_feed_WDT(THREAD_MCPWM);
 
@@ -3289,6 +3663,7 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 			motor_now->m_i_alpha_beta_has_offset = false;
 		}
 
+		FOC_STAGE_PROF_MARK(FOC_STAGE_CURRENTS);
 		FOC_PROFILE_LINE_FINE();
 
 		const float duty_now = motor_now->m_motor_state.duty_now;
@@ -3428,6 +3803,7 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 		}
 
 		FOC_PROFILE_LINE_FINE();
+		FOC_STAGE_PROF_MARK(FOC_STAGE_OTHER);
 
 		// Set motor phase
 		{
@@ -3442,6 +3818,7 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 				utils_norm_angle_rad((float*)&motor_now->m_phase_now_observer);
 			}
 
+			FOC_STAGE_PROF_MARK(FOC_STAGE_OBSERVER);
 			FOC_PROFILE_LINE_FINE();
 
 			switch (conf_now->foc_sensor_mode) {
@@ -3473,8 +3850,8 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 			case FOC_SENSOR_MODE_SENSORLESS:
 				if (motor_now->m_phase_observer_override) {
 					motor_now->m_motor_state.phase = motor_now->m_phase_now_observer_override;
-					motor_now->m_observer_state.x1 = motor_now->m_observer_x1_override;
-					motor_now->m_observer_state.x2 = motor_now->m_observer_x2_override;
+					foc_observer_set_flux(motor_now->m_observer_x1_override, motor_now->m_observer_x2_override,
+							&motor_now->m_observer_state);
 					iq_set_tmp += conf_now->foc_sl_openloop_boost_q * SIGN(iq_set_tmp);
 					if (conf_now->foc_sl_openloop_max_q > conf_now->cc_min_current) {
 						utils_truncate_number_abs(&iq_set_tmp, conf_now->foc_sl_openloop_max_q);
@@ -3513,6 +3890,8 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 			case FOC_SENSOR_MODE_HFI_V3:
 			case FOC_SENSOR_MODE_HFI_V4:
 			case FOC_SENSOR_MODE_HFI_V5:
+				FOC_STAGE_PROF_MARK(FOC_STAGE_OTHER);
+
 				if (fabsf(RADPS2RPM_f(motor_now->m_speed_est_fast)) > conf_now->foc_sl_erpm_hfi) {
 					motor_now->m_hfi.observer_zero_time = 0;
 				} else {
@@ -3534,6 +3913,8 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 				if (!motor_now->m_phase_override && motor_now->m_control_mode != CONTROL_MODE_OPENLOOP_PHASE) {
 					id_set_tmp = 0.0;
 				}
+
+				FOC_STAGE_PROF_MARK(FOC_STAGE_HFI);
 				break;
 			}
 
@@ -3561,12 +3942,33 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 
 		FOC_PROFILE_LINE_FINE();
 
+		// Motor parameters at the present operating point, looked up from the ISR
+		// scheduler. The measurements run with the phase override and must see the
+		// configured motor.
+		motor_now->m_lut_active = motor_now->m_lut.valid && motor_now->m_lut_now_valid &&
+				!motor_now->m_phase_override;
+
 		// Apply MTPA. See: https://github.com/vedderb/bldc/pull/179
-		const float ld_lq_diff = conf_now->foc_motor_ld_lq_diff;
-		if (conf_now->foc_mtpa_mode != MTPA_MODE_OFF && ld_lq_diff != 0.0 &&
-				motor_now->m_control_mode != CONTROL_MODE_OPENLOOP_PHASE) {
-			const float lambda = conf_now->foc_motor_flux_linkage;
+		float ld_lq_diff = conf_now->foc_motor_ld_lq_diff;
+		float lambda = conf_now->foc_motor_flux_linkage;
+		if (motor_now->m_lut_active) {
+			ld_lq_diff = motor_now->m_lut_now.lq - motor_now->m_lut_now.ld;
+			lambda = motor_now->m_lut_now.lambda;
+		}
 
+		if (conf_now->foc_mtpa_mode == MTPA_MODE_TABLE && motor_now->m_mtpa_table.valid &&
+				motor_now->m_control_mode != CONTROL_MODE_OPENLOOP_PHASE) {
+			// The table also covers field weakening and MTPV. The resistive drop is
+			// taken off the available voltage at the commanded current.
+			const float i_ref = fabsf(iq_set_tmp);
+			const float v_avail = motor_now->p_mtpa_v_scale * motor_now->m_motor_state.v_bus -
+					conf_now->foc_motor_r * i_ref;
+			float iq_table;
+			foc_mtpa_table_lookup(&motor_now->m_mtpa_table, i_ref, v_avail,
+					motor_now->m_speed_est_fast, &id_set_tmp, &iq_table);
+			iq_set_tmp = SIGN(iq_set_tmp) * iq_table;
+		} else if (conf_now->foc_mtpa_mode != MTPA_MODE_OFF && ld_lq_diff != 0.0 &&
+				motor_now->m_control_mode != CONTROL_MODE_OPENLOOP_PHASE) {
 			float iq_ref = iq_set_tmp;
 			if (conf_now->foc_mtpa_mode == MTPA_MODE_IQ_MEASURED) {
 				iq_ref = utils_min_abs(iq_set_tmp, motor_now->m_motor_state.iq_filter);
@@ -3610,10 +4012,23 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 		motor_now->m_motor_state.iq_target = iq_set_tmp;
 
 		FOC_PROFILE_LINE_FINE();
+		FOC_STAGE_PROF_MARK(FOC_STAGE_OTHER);
 		control_current(motor_now, dt);
+		FOC_STAGE_PROF_MARK(FOC_STAGE_CONTROL_CURRENT);
 		FOC_PROFILE_LINE_FINE();
 	} else {
 		// Motor is not running
+		FOC_STAGE_PROF_MARK(FOC_STAGE_CURRENTS);
+
+#ifndef HW_HAS_DUAL_MOTORS
+		const uint32_t top_next = fsw_take_top(motor_now);
+		if (top_next != 0) {
+			TIMER_UPDATE_SAMP_TOP_M1(MCPWM_FOC_CURRENT_SAMP_OFFSET, top_next);
+#ifdef HW_HAS_DUAL_PARALLEL
+			TIMER_UPDATE_SAMP_TOP_M2(MCPWM_FOC_CURRENT_SAMP_OFFSET, top_next);
+#endif
+		}
+#endif
 
 		// The current is 0 when the motor is undriven
 		motor_now->m_motor_state.i_alpha = 0.0;
@@ -3649,6 +4064,8 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 		motor_now->m_x1_prev = motor_now->m_observer_state.x1;
 		motor_now->m_x2_prev = motor_now->m_observer_state.x2;
 
+		FOC_STAGE_PROF_MARK(FOC_STAGE_OBSERVER);
+
 		// Set motor phase
 		{
 			switch (conf_now->foc_sensor_mode) {
@@ -3687,6 +4104,8 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 					(float*)&motor_now->m_motor_state.phase_cos);
 		}
 
+		FOC_STAGE_PROF_MARK(FOC_STAGE_OTHER);
+
 		// HFI Restore
 #ifdef HW_HAS_DUAL_MOTORS
 		if (is_second_motor) {
@@ -3709,6 +4128,8 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 		motor_now->m_hfi.angle = motor_now->m_motor_state.phase;
 		motor_now->m_hfi.double_integrator = -motor_now->m_speed_est_fast;
 
+		FOC_STAGE_PROF_MARK(FOC_STAGE_HFI);
+
 		float s = motor_now->m_motor_state.phase_sin;
 		float c = motor_now->m_motor_state.phase_cos;
 
@@ -3759,9 +4180,13 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 		break;
 	};
 
+	FOC_STAGE_PROF_MARK(FOC_STAGE_OTHER);
+
 	// Run PLL for speed estimation
 	foc_pll_run(phase_for_speed_est, dt, &motor_now->m_pll_phase, &motor_now->m_pll_speed, conf_now);
 
+	FOC_STAGE_PROF_MARK(FOC_STAGE_PLL);
+
 	FOC_PROFILE_LINE_FINE();
 
 	// Low latency speed estimation, for e.g. HFI and speed control.
@@ -3845,7 +4270,10 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 	palSetPad(AD2S1205_SAMPLE_GPIO, AD2S1205_SAMPLE_PIN);
 #endif
 
+	foc_isr_sched_run(&motor_now->m_isr_sched, motor_now, dt);
+
 	FOC_PROFILE_LINE();
+	FOC_STAGE_PROF_MARK(FOC_STAGE_OTHER);
 
 #ifdef HW_HAS_DUAL_MOTORS
 	mc_interface_mc_timer_isr(is_second_motor);
@@ -3853,7 +4281,9 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 	mc_interface_mc_timer_isr(false);
 #endif
 
+	FOC_STAGE_PROF_MARK(FOC_STAGE_MC_IF);
 	FOC_PROFILE_LINE();
+	FOC_STAGE_PROF_END(m_isr_motor);
 
 	m_isr_motor = 0;
 }
@@ -3864,6 +4294,8 @@ void mcpwm_foc_adc_int_handler(void *p, uint32_t flags) {
 
 static void timer_update(motor_all_state_t *motor, float dt) {
 	foc_run_fw(motor, dt);
+	param_est_run(motor);
+	fsw_adapt_run(motor, dt);
 
 	const mc_configuration *conf_now = motor->m_conf;
 
@@ -4109,6 +4541,7 @@ static void timer_update(motor_all_state_t *motor, float dt) {
 	}
 }
 
+#ifndef USE_PC_BUILD
 static THD_FUNCTION(timer_thread, arg) {
 	(void)arg;
 
@@ -4127,6 +4560,8 @@ static THD_FUNCTION(timer_thread, arg) {
 		timer_update((motor_all_state_t*)&m_motor_2, dt);
 #endif
 
+		foc_stage_prof_process();
+
 #ifdef HW_HAS_INPUT_CURRENT_SENSOR
 		static uint16_t delay_current_offset_measurement = 0;
 
@@ -4143,6 +4578,7 @@ static THD_FUNCTION(timer_thread, arg) {
 		chThdSleepMilliseconds(1);
 	}
 }
+#endif
 
 static void hfi_update(volatile motor_all_state_t *motor, float dt) {
 	(void)dt;
@@ -4186,8 +4622,8 @@ static void hfi_update(volatile motor_all_state_t *motor, float dt) {
 		} else {
 			if (motor->m_conf->foc_hfi_amb_mode == FOC_AMB_MODE_SIX_VECTOR || est_done) {
 				float real_bin1, imag_bin1, real_bin2, imag_bin2;
-				motor->m_hfi.fft_bin1_func((float*)motor->m_hfi.buffer, &real_bin1, &imag_bin1);
-				motor->m_hfi.fft_bin2_func((float*)motor->m_hfi.buffer, &real_bin2, &imag_bin2);
+				utils_dft_bin((utils_dft_t*)&motor->m_hfi.dft, (float*)motor->m_hfi.buffer, 1, &real_bin1, &imag_bin1);
+				utils_dft_bin((utils_dft_t*)&motor->m_hfi.dft, (float*)motor->m_hfi.buffer, 2, &real_bin2, &imag_bin2);
 
 				float mag_bin_1 = NORM2_f(imag_bin1, real_bin1);
 				float angle_bin_1 = -utils_fast_atan2(imag_bin1, real_bin1);
@@ -4199,9 +4635,9 @@ static void hfi_update(volatile motor_all_state_t *motor, float dt) {
 				// we should lag 1/2 HFI buffer behind in phase. Compensate for that here.
 				float dt_sw;
 				if (motor->m_conf->foc_control_sample_mode == FOC_CONTROL_SAMPLE_MODE_V0_V7) {
-					dt_sw = 1.0 / motor->m_conf->foc_f_zv;
+					dt_sw = 1.0 / motor->m_f_zv;
 				} else {
-					dt_sw = 1.0 / (motor->m_conf->foc_f_zv / 2.0);
+					dt_sw = 1.0 / (motor->m_f_zv / 2.0);
 				}
 				angle_bin_2 += motor->m_pll_speed * ((float)motor->m_hfi.samples / 2.0) * dt_sw;
 
@@ -4227,8 +4663,8 @@ static void hfi_update(volatile motor_all_state_t *motor, float dt) {
 					if (motor->m_conf->foc_sensor_mode == FOC_SENSOR_MODE_HFI_START) {
 						float s, c;
 						utils_fast_sincos_better(angle_bin_2, &s, &c);
-						motor->m_observer_state.x1 = c * motor->m_conf->foc_motor_flux_linkage;
-						motor->m_observer_state.x2 = s * motor->m_conf->foc_motor_flux_linkage;
+						foc_observer_set_flux(c * motor->m_conf->foc_motor_flux_linkage,
+								s * motor->m_conf->foc_motor_flux_linkage, (observer_state*)&motor->m_observer_state);
 					}
 				}
 
@@ -4247,7 +4683,7 @@ static void hfi_update(volatile motor_all_state_t *motor, float dt) {
 						hfi_plot_div = 0;
 
 						float real_bin0, imag_bin0;
-						motor->m_hfi.fft_bin0_func((float*)motor->m_hfi.buffer, &real_bin0, &imag_bin0);
+						utils_dft_bin((utils_dft_t*)&motor->m_hfi.dft, (float*)motor->m_hfi.buffer, 0, &real_bin0, &imag_bin0);
 						float offset = real_bin0;
 						float amplitude = NORM2_f(real_bin2, imag_bin2) * 2.0;
 						float Ld_est = 1.0 / (offset + amplitude);
@@ -4404,6 +4840,7 @@ static void hfi_update(volatile motor_all_state_t *motor, float dt) {
 	}
 }
 
+#ifndef USE_PC_BUILD
 static THD_FUNCTION(hfi_thread, arg) {
 	(void)arg;
 
@@ -4466,6 +4903,38 @@ static THD_FUNCTION(pid_thread, arg) {
 #endif
 	}
 }
+#else
+/*
+ * On the PC the threads above are not built. The HIL harness calls these
+ * with the simulated time step instead, so that no wall-clock sleeps are
+ * involved.
+ */
+void mcpwm_foc_pc_run_timer(float dt) {
+	timer_update((motor_all_state_t*)&m_motor_1, dt);
+#ifdef HW_HAS_DUAL_MOTORS
+	timer_update((motor_all_state_t*)&m_motor_2, dt);
+#endif
+
+	foc_stage_prof_process();
+}
+
+void mcpwm_foc_pc_run_hfi(float dt) {
+	hfi_update(&m_motor_1, dt);
+#ifdef HW_HAS_DUAL_MOTORS
+	hfi_update(&m_motor_2, dt);
+#endif
+}
+
+void mcpwm_foc_pc_run_pid(float dt) {
+	bool index_found = encoder_index_found();
+	foc_run_pid_control_pos(index_found, dt, (motor_all_state_t*)&m_motor_1);
+	foc_run_pid_control_speed(index_found, dt, (motor_all_state_t*)&m_motor_1);
+#ifdef HW_HAS_DUAL_MOTORS
+	foc_run_pid_control_pos(index_found, dt, (motor_all_state_t*)&m_motor_2);
+	foc_run_pid_control_speed(index_found, dt, (motor_all_state_t*)&m_motor_2);
+#endif
+}
+#endif
 
 /**
  * Run the current control loop.
@@ -4560,6 +5029,16 @@ static void control_current(motor_all_state_t *motor, float dt) {
 	UTILS_LP_FAST(state_m->id_filter, state_m->id, conf_now->foc_current_filter_const);
 	UTILS_LP_FAST(state_m->iq_filter, state_m->iq, conf_now->foc_current_filter_const);
 
+	// Inductance measurement. state_m->vd and vq still hold the voltage of the last period.
+	float v_probe = 0.0;
+	if (motor->m_lut_probe.active) {
+		if (motor->m_lut_probe_q) {
+			v_probe = foc_motor_lut_probe_step(&motor->m_lut_probe, state_m->iq, state_m->vq, dt);
+		} else {
+			v_probe = foc_motor_lut_probe_step(&motor->m_lut_probe, state_m->id, state_m->vd, dt);
+		}
+	}
+
 	float Ierr_d = state_m->id_target - state_m->id;
 	float Ierr_q = state_m->iq_target - state_m->iq;
 
@@ -4568,12 +5047,33 @@ static void control_current(motor_all_state_t *motor, float dt) {
 		ki = motor->m_current_ki_temp_comp;
 	}
 
+	// The proportional gain follows the inductance at the operating point
+	float kp_d = conf_now->foc_current_kp;
+	float kp_q = conf_now->foc_current_kp;
+	float p_ld = motor->p_ld;
+	float p_lq = motor->p_lq;
+	float lambda = conf_now->foc_motor_flux_linkage;
+	if (motor->m_lut_active) {
+		kp_d = motor->m_lut_now.kp_d;
+		kp_q = motor->m_lut_now.kp_q;
+		p_ld = motor->m_lut_now.ld;
+		p_lq = motor->m_lut_now.lq;
+		lambda = motor->m_lut_now.lambda;
+	} else if (motor->m_param_est_active) {
+		ki = motor->m_param_est_now.ki;
+		kp_d = motor->m_param_est_now.kp_d;
+		kp_q = motor->m_param_est_now.kp_q;
+		p_ld = motor->m_param_est_now.ld;
+		p_lq = motor->m_param_est_now.lq;
+		lambda = motor->m_param_est_now.lambda;
+	}
+
 	state_m->vd_int += Ierr_d * (ki * dt);
 	state_m->vq_int += Ierr_q * (ki * dt);
 
 	// Feedback (PI controller). No D action needed because the plant is a first order system (tf = 1/(Ls+R))
-	state_m->vd = state_m->vd_int + Ierr_d * conf_now->foc_current_kp;
-	state_m->vq = state_m->vq_int + Ierr_q * conf_now->foc_current_kp;
+	state_m->vd = state_m->vd_int + Ierr_d * kp_d;
+	state_m->vq = state_m->vq_int + Ierr_q * kp_q;
 
 	// Decoupling. Using feedforward this compensates for the fact that the equations of a PMSM
 	// are not really decoupled (the d axis current has impact on q axis voltage and visa-versa):
@@ -4589,18 +5089,18 @@ static void control_current(motor_all_state_t *motor, float dt) {
 	if (motor->m_control_mode < CONTROL_MODE_HANDBRAKE && conf_now->foc_cc_decoupling != FOC_CC_DECOUPLING_DISABLED) {
 		switch (conf_now->foc_cc_decoupling) {
 		case FOC_CC_DECOUPLING_CROSS:
-			dec_vd = state_m->iq_filter * motor->m_speed_est_fast * motor->p_lq; // m_speed_est_fast is ωe in [rad/s]
-			dec_vq = state_m->id_filter * motor->m_speed_est_fast * motor->p_ld;
+			dec_vd = state_m->iq_filter * motor->m_speed_est_fast * p_lq; // m_speed_est_fast is ωe in [rad/s]
+			dec_vq = state_m->id_filter * motor->m_speed_est_fast * p_ld;
 			break;
 
 		case FOC_CC_DECOUPLING_BEMF:
-			dec_bemf = motor->m_speed_est_fast * conf_now->foc_motor_flux_linkage;
+			dec_bemf = motor->m_speed_est_fast * lambda;
 			break;
 
 		case FOC_CC_DECOUPLING_CROSS_BEMF:
-			dec_vd = state_m->iq_filter * motor->m_speed_est_fast * motor->p_lq;
-			dec_vq = state_m->id_filter * motor->m_speed_est_fast * motor->p_ld;
-			dec_bemf = motor->m_speed_est_fast * conf_now->foc_motor_flux_linkage;
+			dec_vd = state_m->iq_filter * motor->m_speed_est_fast * p_lq;
+			dec_vq = state_m->id_filter * motor->m_speed_est_fast * p_ld;
+			dec_bemf = motor->m_speed_est_fast * lambda;
 			break;
 
 		default:
@@ -4611,6 +5111,12 @@ static void control_current(motor_all_state_t *motor, float dt) {
 	state_m->vd -= dec_vd; //Negative sign as in the PMSM equations
 	state_m->vq += dec_vq + dec_bemf;
 
+	if (motor->m_lut_probe_q) {
+		state_m->vq += v_probe;
+	} else {
+		state_m->vd += v_probe;
+	}
+
 	// Calculate the max length of the voltage space vector without overmodulation.
 	// Is simply 1/sqrt(3) * v_bus. See https://microchipdeveloper.com/mct5001:start. Adds margin with max_duty.
 	float max_v_mag = ONE_BY_SQRT3 * max_duty * state_m->v_bus * conf_now->foc_overmod_factor;
@@ -4662,6 +5168,29 @@ static void control_current(motor_all_state_t *motor, float dt) {
 	state_m->mod_alpha_raw = c * state_m->mod_d - s * state_m->mod_q;
 	state_m->mod_beta_raw  = c * state_m->mod_q + s * state_m->mod_d;
 
+	// Inverter nonlinearity compensation. The map is learned at low speed, where the voltage
+	// error is large compared to the back-EMF and the motor model explains the rest well.
+	motor->m_dt_comp_active = motor->m_dt_comp.enabled;
+	motor->m_dt_comp_learn_now = false;
+	if (motor->m_dt_comp_active) {
+		const float i_alpha_filter = c * state_m->id_filter - s * state_m->iq_filter;
+		const float i_beta_filter = c * state_m->iq_filter + s * state_m->id_filter;
+		const float ia_filter = i_alpha_filter;
+		const float ib_filter = -0.5 * i_alpha_filter + SQRT3_BY_2 * i_beta_filter;
+		const float ic_filter = -0.5 * i_alpha_filter - SQRT3_BY_2 * i_beta_filter;
+
+		// The learning itself runs from the ISR scheduler
+		motor->m_dt_comp_learn_now = motor->m_dt_comp.learn && !do_hfi && !motor->m_phase_override &&
+				!motor->m_lut_probe.active && motor->m_audio.mode == MC_AUDIO_OFF &&
+				abs_rpm < conf_now->foc_sl_erpm &&
+				NORM2_f(state_m->vd, state_m->vq) < (DT_COMP_LEARN_MAX_V * max_v_mag);
+
+		foc_dt_comp_get(&motor->m_dt_comp, ia_filter, ib_filter, ic_filter,
+				&motor->m_dt_comp_mod_alpha, &motor->m_dt_comp_mod_beta);
+		state_m->mod_alpha_raw += motor->m_dt_comp_mod_alpha;
+		state_m->mod_beta_raw += motor->m_dt_comp_mod_beta;
+	}
+
 	FOC_PROFILE_LINE_FINE();
 
 	update_valpha_vbeta(motor, state_m->mod_alpha_raw, state_m->mod_beta_raw);
@@ -4727,6 +5256,7 @@ static void control_current(motor_all_state_t *motor, float dt) {
 	}
 
 	FOC_PROFILE_LINE_FINE();
+	FOC_STAGE_PROF_MARK(FOC_STAGE_CONTROL_CURRENT);
 
 	// HFI
 	if (do_hfi) {
@@ -4779,7 +5309,7 @@ static void control_current(motor_all_state_t *motor, float dt) {
 					}
 #endif
 					foc_hfi_adjust_angle(
-							(di * conf_now->foc_f_zv) / (hfi_voltage * motor->p_inv_ld_lq),
+							(di * motor->m_f_zv) / (hfi_voltage * motor->p_inv_ld_lq),
 							motor, hfi_dt
 					);
 				}
@@ -4833,7 +5363,7 @@ static void control_current(motor_all_state_t *motor, float dt) {
 					}
 #endif
 					foc_hfi_adjust_angle(
-							motor->m_hfi.sign_last_sample * ((conf_now->foc_f_zv * di) /
+							motor->m_hfi.sign_last_sample * ((motor->m_f_zv * di) /
 									hfi_voltage - motor->p_v2_v3_inv_avg_half) / motor->p_inv_ld_lq,
 							motor, hfi_dt
 					);
@@ -4878,14 +5408,14 @@ static void control_current(motor_all_state_t *motor, float dt) {
 			}
 		} else {
 			if (motor->m_hfi.is_samp_n) {
-				float sample_now = (utils_tab_cos_32_1[motor->m_hfi.ind * motor->m_hfi.table_fact] * state_m->i_alpha +
-						utils_tab_sin_32_1[motor->m_hfi.ind * motor->m_hfi.table_fact] * state_m->i_beta);
+				float sample_now = (motor->m_hfi.dft.cos_tab[motor->m_hfi.ind] * state_m->i_alpha +
+						motor->m_hfi.dft.sin_tab[motor->m_hfi.ind] * state_m->i_beta);
 				float di = (sample_now - motor->m_hfi.prev_sample);
 
 				motor->m_hfi.buffer_current[motor->m_hfi.ind] = di;
 
 				if (di > 0.01) {
-					motor->m_hfi.buffer[motor->m_hfi.ind] = (conf_now->foc_f_zv * di) / hfi_voltage; //Changed to inverse of inductance. This is what is needed for the FFT, not the inductance itself. This is because the measurement has a dc offset, which will leak into other bins when the inverse is takes first.
+					motor->m_hfi.buffer[motor->m_hfi.ind] = (motor->m_f_zv * di) / hfi_voltage; //Changed to inverse of inductance. This is what is needed for the FFT, not the inductance itself. This is because the measurement has a dc offset, which will leak into other bins when the inverse is takes first.
 				}
 
 				motor->m_hfi.ind++;
@@ -4894,14 +5424,14 @@ static void control_current(motor_all_state_t *motor, float dt) {
 					motor->m_hfi.ready = true;
 				}
 
-				mod_alpha_v7 += hfi_voltage * utils_tab_cos_32_1[motor->m_hfi.ind * motor->m_hfi.table_fact] * voltage_normalize;
-				mod_beta_v7  += hfi_voltage * utils_tab_sin_32_1[motor->m_hfi.ind * motor->m_hfi.table_fact] * voltage_normalize;
+				mod_alpha_v7 += hfi_voltage * motor->m_hfi.dft.cos_tab[motor->m_hfi.ind] * voltage_normalize;
+				mod_beta_v7  += hfi_voltage * motor->m_hfi.dft.sin_tab[motor->m_hfi.ind] * voltage_normalize;
 			} else {
-				motor->m_hfi.prev_sample = utils_tab_cos_32_1[motor->m_hfi.ind * motor->m_hfi.table_fact] * state_m->i_alpha +
-						utils_tab_sin_32_1[motor->m_hfi.ind * motor->m_hfi.table_fact] * state_m->i_beta;
+				motor->m_hfi.prev_sample = motor->m_hfi.dft.cos_tab[motor->m_hfi.ind] * state_m->i_alpha +
+						motor->m_hfi.dft.sin_tab[motor->m_hfi.ind] * state_m->i_beta;
 
-				mod_alpha_v7 -= hfi_voltage * utils_tab_cos_32_1[motor->m_hfi.ind * motor->m_hfi.table_fact] * voltage_normalize;
-				mod_beta_v7  -= hfi_voltage * utils_tab_sin_32_1[motor->m_hfi.ind * motor->m_hfi.table_fact] * voltage_normalize;
+				mod_alpha_v7 -= hfi_voltage * motor->m_hfi.dft.cos_tab[motor->m_hfi.ind] * voltage_normalize;
+				mod_beta_v7  -= hfi_voltage * motor->m_hfi.dft.sin_tab[motor->m_hfi.ind] * voltage_normalize;
 			}
 		}
 
@@ -4949,10 +5479,26 @@ static void control_current(motor_all_state_t *motor, float dt) {
 		motor->m_hfi.double_integrator = 0.0;
 	}
 
+	FOC_STAGE_PROF_MARK(FOC_STAGE_HFI);
 	FOC_PROFILE_LINE_FINE();
 
 	// Set output (HW Dependent)
 	uint32_t duty1, duty2, duty3, top;
+
+#ifndef HW_HAS_DUAL_MOTORS
+	// A new switching frequency is written in the same update disabled window
+	// as the duty cycles for it, so that both take effect at the same update.
+	const uint32_t top_next = fsw_take_top(motor);
+	if (top_next != 0) {
+		TIM1->CR1 |= TIM_CR1_UDIS;
+		TIM1->ARR = top_next;
+#ifdef HW_HAS_DUAL_PARALLEL
+		TIM8->CR1 |= TIM_CR1_UDIS;
+		TIM8->ARR = top_next;
+#endif
+	}
+#endif
+
 	top = TIM1->ARR;
 
 	// Calculate the duty cycles for all the phases. This also injects a zero modulation signal to
@@ -4973,6 +5519,7 @@ static void control_current(motor_all_state_t *motor, float dt) {
 #endif
 	}
 
+	FOC_STAGE_PROF_MARK(FOC_STAGE_SVM);
 	FOC_PROFILE_LINE_FINE();
 
 	if (virtual_motor_is_connected() == false) {
@@ -4992,6 +5539,366 @@ static void control_current(motor_all_state_t *motor, float dt) {
 	}
 }
 
+static void dt_comp_reset(motor_all_state_t *motor) {
+	motor->m_dt_comp_i_max = motor->m_conf->l_current_max;
+	motor->m_dt_comp_dt_us = motor->m_conf->foc_dt_us;
+	motor->m_dt_comp_f_zv = motor->m_f_zv;
+
+	foc_dt_comp_reset(&motor->m_dt_comp,
+			motor->m_dt_comp_i_max * FOC_DT_COMP_RANGE_FACTOR,
+			motor->m_dt_comp_dt_us * 1e-6 * motor->m_dt_comp_f_zv);
+}
+
+/*
+ * Start the map over when the current range or the fixed dead time model
+ * it is built on changed. What was learned does not fit the new grid or
+ * model anymore.
+ */
+static void dt_comp_update(motor_all_state_t *motor) {
+	if (motor->m_conf->l_current_max == motor->m_dt_comp_i_max &&
+			motor->m_conf->foc_dt_us == motor->m_dt_comp_dt_us &&
+			motor->m_f_zv == motor->m_dt_comp_f_zv) {
+		return;
+	}
+
+	const bool enabled = motor->m_dt_comp.enabled;
+	motor->m_dt_comp.enabled = false;
+	dt_comp_reset(motor);
+	motor->m_dt_comp.enabled = enabled;
+}
+
+static void isr_sched_init(motor_all_state_t *motor) {
+	foc_isr_sched_init(&motor->m_isr_sched, ISR_SCHED_BUDGET_US);
+	foc_isr_sched_add(&motor->m_isr_sched, "motor_lut", isr_task_motor_lut,
+			ISR_TASK_LUT_PERIOD, ISR_TASK_LUT_COST_US);
+	foc_isr_sched_add(&motor->m_isr_sched, "dt_comp_learn", isr_task_dt_comp_learn,
+			ISR_TASK_DT_PERIOD, ISR_TASK_DT_COST_US);
+	foc_isr_sched_add(&motor->m_isr_sched, "param_est", isr_task_param_est,
+			ISR_TASK_PARAM_EST_PERIOD, ISR_TASK_PARAM_EST_COST_US);
+}
+
+// The filtered currents change slowly enough for the motor parameters to
+// be a few periods old.
+static void isr_task_motor_lut(void *arg, float dt) {
+	(void)dt;
+	motor_all_state_t *motor = (motor_all_state_t*)arg;
+
+	if (motor->m_lut.valid) {
+		foc_motor_lut_lookup(&motor->m_lut, motor->m_motor_state.id_filter,
+				motor->m_motor_state.iq_filter, &motor->m_lut_now);
+		motor->m_lut_now_valid = true;
+	} else {
+		motor->m_lut_now_valid = false;
+	}
+}
+
+// Runs in the same ISR as control_current, so the state below belongs to
+// the period the learning was allowed in.
+static void isr_task_dt_comp_learn(void *arg, float dt) {
+	motor_all_state_t *motor = (motor_all_state_t*)arg;
+	motor_state_t *state_m = &motor->m_motor_state;
+
+	if (!motor->m_dt_comp_learn_now) {
+		return;
+	}
+
+	motor->m_dt_comp_learn_now = false;
+
+	float p_ld = motor->p_ld;
+	float p_lq = motor->p_lq;
+	float lambda = motor->m_conf->foc_motor_flux_linkage;
+	if (motor->m_lut_active) {
+		p_ld = motor->m_lut_now.ld;
+		p_lq = motor->m_lut_now.lq;
+		lambda = motor->m_lut_now.lambda;
+	}
+
+	const float s = state_m->phase_sin;
+	const float c = state_m->phase_cos;
+	const float i_alpha_filter = c * state_m->id_filter - s * state_m->iq_filter;
+	const float i_beta_filter = c * state_m->iq_filter + s * state_m->id_filter;
+	const float ia_filter = i_alpha_filter;
+	const float ib_filter = -0.5 * i_alpha_filter + SQRT3_BY_2 * i_beta_filter;
+	const float ic_filter = -0.5 * i_alpha_filter - SQRT3_BY_2 * i_beta_filter;
+
+	const float voltage_normalize = 1.5 / state_m->v_bus;
+	const float we = motor->m_speed_est_fast;
+	const float res = motor->m_res_temp_comp;
+	const float res_d = (res * state_m->id_filter - we * p_lq * state_m->iq_filter - state_m->vd) * voltage_normalize;
+	const float res_q = (res * state_m->iq_filter + we * (p_ld * state_m->id_filter + lambda) - state_m->vq) * voltage_normalize;
+	foc_dt_comp_learn(&motor->m_dt_comp, ia_filter, ib_filter, ic_filter,
+			c * res_d - s * res_q, c * res_q + s * res_d, dt / DT_COMP_LEARN_TIME);
+}
+
+// Runs every control period and pairs it with the previous one. The voltage
+// of a period is applied until the currents of the next one are sampled.
+// The speed is the rotation of the frame over a window centered on the
+// pair, so a pair is handed over one decimation window after it was taken.
+// The filtered speed estimates lag too much while the motor accelerates,
+// which the estimator would take for a resistance.
+static void isr_task_param_est(void *arg, float dt) {
+	motor_all_state_t *motor = (motor_all_state_t*)arg;
+	motor_state_t *state_m = &motor->m_motor_state;
+	mc_configuration *conf_now = motor->m_conf;
+	foc_param_est_sample_t *prev = &motor->m_param_est_prev;
+	foc_param_est_sample_t *pending = &motor->m_param_est_pending;
+
+	const float max_v_mag = ONE_BY_SQRT3 * fabsf(state_m->max_duty) *
+			state_m->v_bus * conf_now->foc_overmod_factor;
+
+	if (!motor->m_param_est_enabled || motor->m_state != MC_STATE_RUNNING ||
+			motor->m_cc_was_hfi || motor->m_phase_override || motor->m_lut_probe.active ||
+			motor->m_audio.mode != MC_AUDIO_OFF ||
+			(conf_now->foc_sensor_mode == FOC_SENSOR_MODE_SENSORLESS &&
+					fabsf(RADPS2RPM_f(motor->m_speed_est_fast)) < conf_now->foc_sl_erpm) ||
+			state_m->i_abs_filter < (PARAM_EST_MIN_CURRENT * conf_now->l_current_max) ||
+			NORM2_f(state_m->vd, state_m->vq) > (PARAM_EST_MAX_V * max_v_mag)) {
+		motor->m_param_est_prev_valid = false;
+		motor->m_param_est_pending_valid = false;
+		return;
+	}
+
+	if (motor->m_param_est_prev_valid) {
+		motor->m_param_est_angle += utils_angle_difference_rad(state_m->phase, motor->m_param_est_phase_last);
+		motor->m_param_est_decim++;
+
+		if (motor->m_param_est_decim >= PARAM_EST_DECIMATION) {
+			if (motor->m_param_est_pending_valid) {
+				pending->we = (motor->m_param_est_angle_pending + motor->m_param_est_angle) /
+						(2.0 * (float)PARAM_EST_DECIMATION * dt);
+				foc_param_est_ring_push(&motor->m_param_est_ring, pending);
+			}
+
+			*pending = *prev;
+			pending->id1 = state_m->id;
+			pending->iq1 = state_m->iq;
+			pending->dt = dt;
+			motor->m_param_est_angle_pending = motor->m_param_est_angle;
+			motor->m_param_est_pending_valid = true;
+
+			motor->m_param_est_angle = 0.0;
+			motor->m_param_est_decim = 0;
+		}
+	} else {
+		motor->m_param_est_angle = 0.0;
+		motor->m_param_est_decim = 0;
+	}
+
+	// Applied voltage after the dead time compensation
+	const float s = state_m->phase_sin;
+	const float c = state_m->phase_cos;
+	const float v_per_mod = (2.0 / 3.0) * state_m->v_bus;
+	const float v_alpha = state_m->mod_alpha_measured * v_per_mod;
+	const float v_beta = state_m->mod_beta_measured * v_per_mod;
+
+	prev->id0 = state_m->id;
+	prev->iq0 = state_m->iq;
+	prev->vd = c * v_alpha + s * v_beta;
+	prev->vq = c * v_beta - s * v_alpha;
+	motor->m_param_est_phase_last = state_m->phase;
+	motor->m_param_est_prev_valid = true;
+}
+
+static void param_est_reset(motor_all_state_t *motor) {
+	const mc_configuration *conf_now = motor->m_conf;
+	foc_param_est_point p;
+
+	motor->m_param_est_reset = false;
+
+	foc_param_est_init(&motor->m_param_est, conf_now->foc_motor_r, motor->p_ld, motor->p_lq,
+			conf_now->foc_motor_flux_linkage, PARAM_EST_FORGET, PARAM_EST_P_INIT);
+	foc_param_est_ring_reset(&motor->m_param_est_ring);
+
+	p.r = conf_now->foc_motor_r;
+	p.ld = motor->p_ld;
+	p.lq = motor->p_lq;
+	p.lambda = conf_now->foc_motor_flux_linkage;
+	p.ki = conf_now->foc_current_ki;
+	p.kp_d = conf_now->foc_current_kp;
+	p.kp_q = conf_now->foc_current_kp;
+	param_est_publish(motor, &p, false);
+}
+
+/*
+ * Hand the parameters over to the current controller. The ISR reads the
+ * whole point, so it must never see half of an update.
+ */
+static void param_est_publish(motor_all_state_t *motor, const foc_param_est_point *p, bool active) {
+	utils_sys_lock_cnt();
+	motor->m_param_est_now = *p;
+	motor->m_param_est_active = active;
+	utils_sys_unlock_cnt();
+}
+
+// Estimate that is confident and plausible enough to be used for control
+static bool param_est_take(const foc_param_est_t *est, foc_param_est_ind ind, float *value) {
+	float bound;
+	const float est_now = foc_param_est_get(est, ind, &bound);
+	const float nominal = est->scale[ind];
+
+	if (bound < (PARAM_EST_APPLY_BOUND * est_now) &&
+			est_now > (nominal / PARAM_EST_APPLY_RANGE) &&
+			est_now < (nominal * PARAM_EST_APPLY_RANGE)) {
+		*value = est_now;
+		return true;
+	}
+
+	return false;
+}
+
+// Called from the timer thread, which owns the estimator
+static void param_est_run(motor_all_state_t *motor) {
+	if (motor->m_param_est_reset) {
+		param_est_reset(motor);
+	}
+
+	foc_param_est_sample_t sample;
+	while (foc_param_est_ring_pop(&motor->m_param_est_ring, &sample)) {
+		foc_param_est_update(&motor->m_param_est, &sample);
+	}
+
+	// Only this thread writes the point, so it can be read without the lock
+	foc_param_est_point p = motor->m_param_est_now;
+
+	if (!motor->m_param_est_apply) {
+		if (motor->m_param_est_active) {
+			param_est_publish(motor, &p, false);
+		}
+		return;
+	}
+
+	// Every parameter keeps the last applied value until its own estimate
+	// is good enough. The gains follow the parameters they were tuned for.
+	const mc_configuration *conf_now = motor->m_conf;
+	const foc_param_est_t *est = &motor->m_param_est;
+
+	param_est_take(est, FOC_PARAM_EST_R, &p.r);
+	param_est_take(est, FOC_PARAM_EST_LD, &p.ld);
+	param_est_take(est, FOC_PARAM_EST_LQ, &p.lq);
+	param_est_take(est, FOC_PARAM_EST_LAMBDA, &p.lambda);
+
+	if (conf_now->foc_motor_r > 0.0) {
+		p.ki = conf_now->foc_current_ki * p.r / conf_now->foc_motor_r;
+	}
+
+	if (conf_now->foc_motor_l > 0.0) {
+		const float kp_per_l = conf_now->foc_current_kp / conf_now->foc_motor_l;
+		p.kp_d = kp_per_l * p.ld;
+		p.kp_q = kp_per_l * p.lq;
+	}
+
+	param_est_publish(motor, &p, true);
+}
+
+// The frequency never goes above foc_f_zv, as the ISR is sized for that.
+static void fsw_adapt_limits(const motor_all_state_t *motor, float *f_min, float *f_max) {
+	const float f_conf = motor->m_conf->foc_f_zv;
+
+	*f_max = f_conf;
+	if (motor->m_fsw_f_max_set > 0.0) {
+		*f_max = fminf(motor->m_fsw_f_max_set, f_conf);
+	}
+
+	*f_min = FSW_ADAPT_MIN_FACTOR * f_conf;
+	if (motor->m_fsw_f_min_set > 0.0) {
+		*f_min = motor->m_fsw_f_min_set;
+	}
+
+	utils_truncate_number(f_max, FSW_ADAPT_F_LOWEST, f_conf);
+	utils_truncate_number(f_min, FSW_ADAPT_F_LOWEST, *f_max);
+}
+
+static void fsw_adapt_reset(motor_all_state_t *motor) {
+	const mc_configuration *conf_now = motor->m_conf;
+
+	motor->m_fsw_reset = false;
+
+	float f_min, f_max;
+	fsw_adapt_limits(motor, &f_min, &f_max);
+	foc_fsw_adapt_init(&motor->m_fsw, f_min, f_max, conf_now->l_current_max,
+			conf_now->l_max_vin, FSW_ADAPT_THERMAL_TAU);
+}
+
+static void fsw_adapt_run(motor_all_state_t *motor, float dt) {
+#ifdef HW_HAS_DUAL_MOTORS
+	// The timers of the two motors run half a period apart
+	(void)motor;
+	(void)dt;
+#else
+	const mc_configuration *conf_now = motor->m_conf;
+	motor_state_t *state_m = &motor->m_motor_state;
+	foc_fsw_adapt_t *fa = &motor->m_fsw;
+
+	if (motor->m_fsw_reset) {
+		fsw_adapt_reset(motor);
+	}
+
+	float f = conf_now->foc_f_zv;
+
+	if (motor->m_fsw_enabled) {
+		fsw_adapt_limits(motor, &fa->f_min, &fa->f_max);
+
+		// Nothing switches while the motor is not running
+		const bool running = motor->m_state == MC_STATE_RUNNING;
+		const float i_abs = running ? state_m->i_abs_filter : 0.0;
+		const float v_bus = running ? state_m->v_bus : 0.0;
+		const float l = 0.5 * (motor->p_ld + motor->p_lq);
+		const float temp = mc_interface_temp_fet_filtered();
+
+		foc_fsw_adapt_learn(fa, i_abs, v_bus, l, motor->m_f_zv, temp, dt);
+
+		// HFI, the probes and the audio inject at frequencies that are
+		// set up for foc_f_zv.
+		float f_target = fa->f_max;
+		float f_floor = fa->f_max;
+		if (running && !motor->m_cc_was_hfi && !motor->m_phase_override &&
+				!motor->m_lut_probe.active && motor->m_audio.mode == MC_AUDIO_OFF) {
+			f_target = foc_fsw_adapt_optimum(fa, i_abs, v_bus, l, temp);
+
+			// Enough control periods per electrical revolution
+			f_floor = FSW_ADAPT_SAMPLES_REV * fabsf(motor->m_speed_est_fast) / (2.0 * M_PI);
+#ifdef HW_HAS_PHASE_SHUNTS
+			if (conf_now->foc_control_sample_mode != FOC_CONTROL_SAMPLE_MODE_V0_V7) {
+				f_floor *= 2.0;
+			}
+#else
+			f_floor *= 2.0;
+#endif
+		}
+
+		f = foc_fsw_adapt_update(fa, f_target, f_floor, dt);
+	}
+
+	// The ISR takes the request at its next output
+	if (f != motor->m_f_zv && motor->m_fsw_top_next == 0) {
+		motor->m_fsw_f_next = f;
+		motor->m_fsw_top_next = SYSTEM_CORE_CLOCK / (int)f;
+	}
+#endif
+}
+
+/*
+ * Take a new timer top from the timer thread, or 0 if there is none. Called
+ * from the ISR right before the top is written.
+ */
+static uint32_t fsw_take_top(motor_all_state_t *motor) {
+	const uint32_t top = motor->m_fsw_top_next;
+	if (top == 0) {
+		return 0;
+	}
+
+	const float f = motor->m_fsw_f_next;
+
+	// The dead time is a fixed time, so its share of the period follows the
+	// frequency. The switch voltage drops stay as they are.
+	foc_dt_comp_move_fixed(&motor->m_dt_comp, motor->m_conf->foc_dt_us * 1e-6 * (f - motor->m_f_zv));
+	motor->m_dt_comp_f_zv = f;
+	motor->m_f_zv = f;
+	motor->m_fsw_top_next = 0;
+
+	return top;
+}
+
 static void update_valpha_vbeta(motor_all_state_t *motor, float mod_alpha, float mod_beta) {
 	motor_state_t *state_m = &motor->m_motor_state;
 	mc_configuration *conf_now = motor->m_conf;
@@ -5050,9 +5957,16 @@ static void update_valpha_vbeta(motor_all_state_t *motor, float mod_alpha, float
 	const float mod_alpha_filter_sgn = (1.0 / 3.0) * (2.0 * SIGN(ia_filter) - SIGN(ib_filter) - SIGN(ic_filter));
 	const float mod_beta_filter_sgn = ONE_BY_SQRT3 * (SIGN(ib_filter) - SIGN(ic_filter));
 
-	const float mod_comp_fact = conf_now->foc_dt_us * 1e-6 * conf_now->foc_f_zv;
-	const float mod_alpha_comp = mod_alpha_filter_sgn * mod_comp_fact;
-	const float mod_beta_comp = mod_beta_filter_sgn * mod_comp_fact;
+	const float mod_comp_fact = conf_now->foc_dt_us * 1e-6 * motor->m_f_zv;
+	float mod_alpha_comp = mod_alpha_filter_sgn * mod_comp_fact;
+	float mod_beta_comp = mod_beta_filter_sgn * mod_comp_fact;
+
+	// With the learned compensation in the output the motor gets the voltage
+	// from before the compensation was added.
+	if (motor->m_state == MC_STATE_RUNNING && motor->m_dt_comp_active) {
+		mod_alpha_comp = motor->m_dt_comp_mod_alpha;
+		mod_beta_comp = motor->m_dt_comp_mod_beta;
+	}
 
 	mod_alpha -= mod_alpha_comp;
 	mod_beta -= mod_beta_comp;
@@ -5340,6 +6254,33 @@ static void full_brake_hw(motor_all_state_t *motor) {
 	motor->m_pwm_mode = FOC_PWM_FULL_BRAKE;
 }
 
+static int measure_lut_axis(volatile motor_all_state_t *motor, float v_inj, bool q_axis, float *inductance) {
+	int fault = FAULT_CODE_NONE;
+
+	motor->m_lut_probe_q = q_axis;
+	foc_motor_lut_probe_start((foc_motor_lut_probe_t*)&motor->m_lut_probe,
+			v_inj, LUT_PROBE_HALF_LEN, LUT_PROBE_SKIP);
+
+	for (int i = 0;i < 2000;i++) {
+		chThdSleepMilliseconds(1);
+		fault = mc_interface_get_fault();
+		if (fault != FAULT_CODE_NONE ||
+				foc_motor_lut_probe_samples((foc_motor_lut_probe_t*)&motor->m_lut_probe) >= LUT_PROBE_SAMPLES) {
+			break;
+		}
+	}
+
+	motor->m_lut_probe.active = false;
+
+	// Keep the fallback value when the current did not respond
+	float l;
+	if (fault == FAULT_CODE_NONE && foc_motor_lut_probe_result((foc_motor_lut_probe_t*)&motor->m_lut_probe, &l)) {
+		*inductance = l;
+	}
+
+	return fault;
+}
+
 static void terminal_plot_hfi(int argc, const char **argv) {
 	if (argc == 2) {
 		int d = -1;
@@ -97,6 +97,23 @@ int mcpwm_foc_encoder_detect(float current, bool print, float *offset, float *ra
 int mcpwm_foc_measure_resistance(float current, int samples, bool stop_after, float *resistance);
 int mcpwm_foc_measure_inductance(float duty, int samples, float *curr, float *ld_lq_diff, float *inductance);
 int mcpwm_foc_measure_inductance_current(float curr_goal, int samples, float *curr, float *ld_lq_diff, float *inductance);
+int mcpwm_foc_measure_inductance_lut(float i_max, motor_lut_data *lut);
+void mcpwm_foc_set_motor_lut(const motor_lut_data *lut);
+const motor_lut_data *mcpwm_foc_get_motor_lut(void);
+const foc_mtpa_table_t *mcpwm_foc_get_mtpa_table(void);
+void mcpwm_foc_set_dt_comp(bool enabled, bool learn);
+void mcpwm_foc_reset_dt_comp(void);
+const foc_dt_comp_t *mcpwm_foc_get_dt_comp(void);
+const foc_isr_sched_t *mcpwm_foc_get_isr_sched(bool is_second_motor);
+void mcpwm_foc_reset_isr_sched_stats(void);
+void mcpwm_foc_set_param_est(bool enabled, bool apply);
+void mcpwm_foc_reset_param_est(void);
+const foc_param_est_t *mcpwm_foc_get_param_est(void);
+bool mcpwm_foc_get_param_est_applied(foc_param_est_point *p);
+uint32_t mcpwm_foc_get_param_est_dropped(void);
+bool mcpwm_foc_set_fsw_adapt(bool enabled, float f_min, float f_max);
+bool mcpwm_foc_get_fsw_adapt(void);
+const foc_fsw_adapt_t *mcpwm_foc_get_fsw_model(void);
 
 // Audio
 bool mcpwm_foc_beep(float freq, float time, float voltage);
@@ -153,6 +170,13 @@ mc_state mcpwm_foc_get_state_motor(bool is_second_motor);
 void mcpwm_foc_tim_sample_int_handler(void);
 void mcpwm_foc_adc_int_handler(void *p, uint32_t flags);
 
+#ifdef USE_PC_BUILD
+// Thread bodies, stepped in simulated time by the PC HIL harness
+void mcpwm_foc_pc_run_timer(float dt);
+void mcpwm_foc_pc_run_hfi(float dt);
+void mcpwm_foc_pc_run_pid(float dt);
+#endif
+
 // Defines
 #ifndef MCPWM_FOC_CURRENT_SAMP_OFFSET
 #define MCPWM_FOC_CURRENT_SAMP_OFFSET				(2) // Offset from timer top for ADC samples
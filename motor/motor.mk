@@ -1,5 +1,13 @@
 CSRC += \
+	motor/foc_dt_comp.c \
+	motor/foc_fsw_adapt.c \
+	motor/foc_isr_sched.c \
 	motor/foc_math.c \
+	motor/foc_motor_lut.c \
+	motor/foc_mtpa_table.c \
+	motor/foc_param_est.c \
+	motor/foc_stage_prof.c \
+	motor/mc_capture.c \
 	motor/mc_interface.c \
 	motor/mcpwm.c \
 	motor/mcpwm_foc.c \
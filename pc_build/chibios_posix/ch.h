@@ -8,6 +8,8 @@
  * - Semaphores (sem_t)
  * - Events (condition variables)
  * - Virtual timers (timer_t)
+ *
+ * Optionally runs in a deterministic virtual-time mode, see chSysInitVirtual().
  */
 
 #ifndef _CH_H_
@@ -107,7 +109,8 @@ struct port_intctx {
 /* Thread types                                                              */
 /*===========================================================================*/
 
-typedef void* (*tfunc_t)(void* arg);
+typedef void (*tfunc_t)(void* arg);
+typedef int tprio_t;
 
 typedef enum {
     CH_STATE_READY = 0,
@@ -129,6 +132,17 @@ typedef struct thread {
     pthread_mutex_t evt_mutex;     /* Mutex for event operations */
     pthread_cond_t  evt_cond;      /* Condition variable for event wait */
     stkalign_t     *p_stklimit;    /* Stack limit pointer (for utils_sys.c) */
+
+    /* Virtual time scheduling state (unused in real-time mode) */
+    tprio_t         prio;
+    pthread_cond_t  vt_cond;       /* Signalled when the thread gets the CPU */
+    struct thread  *vt_reg_next;   /* Registry of live threads */
+    struct thread  *vt_rdy_next;   /* Ready queue */
+    const void     *vt_wait_obj;   /* Object the thread is blocked on */
+    uint32_t        vt_wait_seq;   /* Invalidates stale timeout entries */
+    bool            vt_waiting;
+    bool            vt_timed_out;
+    bool            vt_exited;
 } thread_t;
 
 /* Thread reference for chThdWait */
@@ -137,11 +151,9 @@ typedef thread_t* thread_reference_t;
 /* Thread working area - on PC just allocate heap, no static sizing needed */
 #define THD_WORKING_AREA_SIZE(n)    (sizeof(thread_t) + (n))
 #define THD_WORKING_AREA(name, n)   uint8_t name[THD_WORKING_AREA_SIZE(n)]
-#define THD_FUNCTION(name, arg)     void* name(void* arg)
+#define THD_FUNCTION(name, arg)     void name(void* arg)
 
 /* Priority levels (mapped to nice values or ignored on POSIX) */
-typedef int tprio_t;
-
 #define NORMALPRIO      128
 #define LOWPRIO         1
 #define HIGHPRIO        255
@@ -216,6 +228,7 @@ typedef struct virtual_timer {
     vtfunc_t            func;
     void               *par;
     timer_t             timer_id;
+    uint32_t            vt_gen;    /* Invalidates stale expiries (virtual time) */
 } virtual_timer_t;
 
 #define _VT_DATA(name)      { NULL, NULL, 0, NULL, NULL }
@@ -274,6 +287,23 @@ void chSysUnlock(void);
 void chSysLockFromISR(void);
 void chSysUnlockFromISR(void);
 
+/*
+ * Virtual time mode. Call chSysInitVirtual() from main() instead of
+ * chSysInit(), before any thread is created. Afterwards only one ChibiOS
+ * thread runs at a time: the running thread keeps the CPU until it blocks
+ * (sleep, semaphore, mutex, event or thread wait), then the highest priority
+ * ready thread runs, FIFO within a priority. When every thread is blocked the
+ * system time jumps to the earliest timeout or virtual timer. Runs are
+ * therefore reproducible and take no wall-clock time for sleeps.
+ *
+ * All ChibiOS calls must come from main() or from threads created with
+ * chThdCreateStatic(). Virtual timer callbacks run with the scheduler lock
+ * held and may only use I-class functions.
+ */
+void chSysInitVirtual(void);
+bool chSysIsVirtual(void);
+uint64_t chVTGetVirtualTimeUs(void);
+
 static inline bool chSysIsCounterWithinX(systime_t cnt, systime_t start, systime_t end) {
     return (bool)((systime_t)(cnt - start) < (systime_t)(end - start));
 }
@@ -24,6 +24,232 @@ static void _create_thread_key(void) {
     pthread_key_create(&_current_thread_key, NULL);
 }
 
+/*===========================================================================*/
+/* Virtual time scheduler                                                    */
+/*===========================================================================*/
+
+#define VT_NEVER    UINT64_MAX
+
+/* Timeout or virtual timer expiry, ordered by (when, seq) */
+typedef struct {
+    uint64_t         when;
+    uint64_t         seq;
+    thread_t        *tp;
+    virtual_timer_t *vtp;
+    uint32_t         gen;
+} vt_entry_t;
+
+static bool _vt_enabled = false;
+static pthread_mutex_t _vt_mutex;
+static uint64_t _vt_now_us = 0;
+static uint64_t _vt_seq = 0;
+static thread_t *_vt_current = NULL;
+static thread_t *_vt_registry = NULL;
+static thread_t *_vt_ready = NULL;
+static thread_t _vt_main_thread;
+
+static vt_entry_t *_vt_heap = NULL;
+static size_t _vt_heap_len = 0;
+static size_t _vt_heap_cap = 0;
+
+static bool _vt_entry_before(const vt_entry_t *a, const vt_entry_t *b) {
+    return a->when < b->when || (a->when == b->when && a->seq < b->seq);
+}
+
+static void _vt_heap_push(uint64_t when, thread_t *tp, virtual_timer_t *vtp, uint32_t gen) {
+    if (_vt_heap_len == _vt_heap_cap) {
+        _vt_heap_cap = _vt_heap_cap ? _vt_heap_cap * 2 : 64;
+        _vt_heap = realloc(_vt_heap, _vt_heap_cap * sizeof(vt_entry_t));
+        if (!_vt_heap) {
+            chSysHalt("virtual time: out of memory");
+        }
+    }
+
+    vt_entry_t e = { when, _vt_seq++, tp, vtp, gen };
+    size_t i = _vt_heap_len++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!_vt_entry_before(&e, &_vt_heap[parent])) {
+            break;
+        }
+        _vt_heap[i] = _vt_heap[parent];
+        i = parent;
+    }
+    _vt_heap[i] = e;
+}
+
+static vt_entry_t _vt_heap_pop(void) {
+    vt_entry_t top = _vt_heap[0];
+    vt_entry_t last = _vt_heap[--_vt_heap_len];
+    size_t i = 0;
+
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= _vt_heap_len) {
+            break;
+        }
+        if (child + 1 < _vt_heap_len && _vt_entry_before(&_vt_heap[child + 1], &_vt_heap[child])) {
+            child++;
+        }
+        if (!_vt_entry_before(&_vt_heap[child], &last)) {
+            break;
+        }
+        _vt_heap[i] = _vt_heap[child];
+        i = child;
+    }
+
+    if (_vt_heap_len > 0) {
+        _vt_heap[i] = last;
+    }
+    return top;
+}
+
+/* Insert behind all ready threads of the same or higher priority */
+static void _vt_ready_push(thread_t *tp) {
+    thread_t **pp = &_vt_ready;
+    while (*pp && (*pp)->prio >= tp->prio) {
+        pp = &(*pp)->vt_rdy_next;
+    }
+    tp->vt_rdy_next = *pp;
+    *pp = tp;
+}
+
+static thread_t *_vt_ready_pop(void) {
+    thread_t *tp = _vt_ready;
+    if (tp) {
+        _vt_ready = tp->vt_rdy_next;
+        tp->vt_rdy_next = NULL;
+    }
+    return tp;
+}
+
+static thread_t *_vt_self(void) {
+    thread_t *tp = (thread_t*)pthread_getspecific(_current_thread_key);
+    if (!tp) {
+        chSysHalt("virtual time: caller is not a ChibiOS thread");
+    }
+    return tp;
+}
+
+/* Make every thread blocked on obj ready. Waiters re-check their condition. */
+static void _vt_wake_locked(const void *obj) {
+    for (thread_t *tp = _vt_registry; tp; tp = tp->vt_reg_next) {
+        if (tp->vt_waiting && tp->vt_wait_obj == obj) {
+            tp->vt_waiting = false;
+            _vt_ready_push(tp);
+        }
+    }
+}
+
+/* Advance time to the earliest pending expiry and process it */
+static void _vt_fire_next_locked(void) {
+    vt_entry_t e = _vt_heap_pop();
+
+    if (e.when > _vt_now_us) {
+        _vt_now_us = e.when;
+    }
+
+    if (e.tp) {
+        if (e.tp->vt_waiting && e.tp->vt_wait_seq == e.gen) {
+            e.tp->vt_waiting = false;
+            e.tp->vt_timed_out = true;
+            _vt_ready_push(e.tp);
+        }
+    } else if (e.vtp->func && e.vtp->vt_gen == e.gen) {
+        vtfunc_t fn = e.vtp->func;
+        e.vtp->func = NULL;
+        fn(e.vtp->par);
+    }
+}
+
+/* Hand the CPU to the next ready thread, advancing time if there is none */
+static void _vt_dispatch_locked(void) {
+    for (;;) {
+        thread_t *next = _vt_ready_pop();
+        if (next) {
+            _vt_current = next;
+            pthread_cond_signal(&next->vt_cond);
+            return;
+        }
+
+        if (_vt_heap_len == 0) {
+            chSysHalt("virtual time: all threads blocked forever");
+        }
+        _vt_fire_next_locked();
+    }
+}
+
+static void _vt_switch_locked(thread_t *self) {
+    _vt_dispatch_locked();
+    while (_vt_current != self) {
+        pthread_cond_wait(&self->vt_cond, &_vt_mutex);
+    }
+}
+
+/*
+ * Block the calling thread on obj until woken or until the absolute
+ * deadline. obj == NULL is a plain sleep. Returns false on timeout.
+ */
+static bool _vt_wait_locked(thread_t *self, const void *obj, uint64_t deadline) {
+    self->vt_wait_obj = obj;
+    self->vt_waiting = true;
+    self->vt_timed_out = false;
+    self->vt_wait_seq++;
+
+    if (deadline != VT_NEVER) {
+        _vt_heap_push(deadline, self, NULL, self->vt_wait_seq);
+    }
+
+    _vt_switch_locked(self);
+    return !self->vt_timed_out;
+}
+
+static uint64_t _vt_deadline(sysinterval_t timeout) {
+    if (timeout == TIME_INFINITE) {
+        return VT_NEVER;
+    }
+    return _vt_now_us + (uint64_t)timeout * (1000000 / CH_CFG_ST_FREQUENCY);
+}
+
+static void _vt_sleep_us(uint64_t usec) {
+    thread_t *self = _vt_self();
+    pthread_mutex_lock(&_vt_mutex);
+    _vt_wait_locked(self, NULL, usec == VT_NEVER ? VT_NEVER : _vt_now_us + usec);
+    pthread_mutex_unlock(&_vt_mutex);
+}
+
+static void _vt_thread_init(thread_t *tp, tprio_t prio) {
+    tp->prio = prio;
+    pthread_cond_init(&tp->vt_cond, NULL);
+    tp->vt_rdy_next = NULL;
+    tp->vt_waiting = false;
+    tp->vt_exited = false;
+
+    thread_t **pp = &_vt_registry;
+    while (*pp) {
+        pp = &(*pp)->vt_reg_next;
+    }
+    tp->vt_reg_next = NULL;
+    *pp = tp;
+}
+
+static void _vt_thread_exit(thread_t *tp) {
+    pthread_mutex_lock(&_vt_mutex);
+
+    thread_t **pp = &_vt_registry;
+    while (*pp && *pp != tp) {
+        pp = &(*pp)->vt_reg_next;
+    }
+    if (*pp) {
+        *pp = tp->vt_reg_next;
+    }
+
+    tp->vt_exited = true;
+    _vt_wake_locked(tp);
+    _vt_dispatch_locked();
+    pthread_mutex_unlock(&_vt_mutex);
+}
+
 /*===========================================================================*/
 /* System functions                                                          */
 /*===========================================================================*/
@@ -41,14 +267,54 @@ void chSysHalt(const char *reason) {
     abort();
 }
 
+void chSysInitVirtual(void) {
+    chSysInit();
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&_vt_mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    /* The calling thread becomes the first scheduled thread */
+    memset(&_vt_main_thread, 0, sizeof(thread_t));
+    _vt_main_thread.name = "main";
+    _vt_main_thread.state = CH_STATE_CURRENT;
+    pthread_mutex_init(&_vt_main_thread.evt_mutex, NULL);
+    pthread_cond_init(&_vt_main_thread.evt_cond, NULL);
+    _vt_registry = NULL;
+    _vt_ready = NULL;
+    _vt_thread_init(&_vt_main_thread, NORMALPRIO);
+    pthread_setspecific(_current_thread_key, &_vt_main_thread);
+
+    _vt_heap_len = 0;
+    _vt_now_us = 0;
+    _vt_seq = 0;
+    _vt_current = &_vt_main_thread;
+    _vt_enabled = true;
+}
+
+bool chSysIsVirtual(void) {
+    return _vt_enabled;
+}
+
+/*
+ * In virtual time only one thread runs at a time, so the lock is just a
+ * nesting counter. Blocking with it held behaves like the S-class calls
+ * in ChibiOS, which release it while the thread sleeps.
+ */
 void chSysLock(void) {
-    pthread_mutex_lock(&_ch_sys_lock);
+    if (!_vt_enabled) {
+        pthread_mutex_lock(&_ch_sys_lock);
+    }
     _ch_lock_cnt++;
 }
 
 void chSysUnlock(void) {
     _ch_lock_cnt--;
-    pthread_mutex_unlock(&_ch_sys_lock);
+    if (!_vt_enabled) {
+        pthread_mutex_unlock(&_ch_sys_lock);
+    }
 }
 
 void chSysLockFromISR(void) {
@@ -63,7 +329,15 @@ void chSysUnlockFromISR(void) {
 /* Time functions                                                            */
 /*===========================================================================*/
 
+uint64_t chVTGetVirtualTimeUs(void) {
+    return _vt_now_us;
+}
+
 systime_t chVTGetSystemTime(void) {
+    if (_vt_enabled) {
+        return (systime_t)((_vt_now_us / (1000000 / CH_CFG_ST_FREQUENCY)) & 0xFFFFFFFF);
+    }
+
     struct timespec now;
     clock_gettime(CLOCK_MONOTONIC, &now);
     int64_t diff_ms = (now.tv_sec - _sys_start_time.tv_sec) * 1000 +
@@ -94,6 +368,11 @@ systime_t chTimeAddX(systime_t systime, sysinterval_t interval) {
 
 void chThdSleep(sysinterval_t time) {
     if (time == TIME_IMMEDIATE) return;
+    if (_vt_enabled) {
+        _vt_sleep_us(time == TIME_INFINITE ? VT_NEVER :
+                     (uint64_t)time * (1000000 / CH_CFG_ST_FREQUENCY));
+        return;
+    }
     if (time == TIME_INFINITE) {
         while (1) { sleep(3600); }
     }
@@ -108,6 +387,10 @@ void chThdSleepMilliseconds(uint32_t msec) {
 }
 
 void chThdSleepMicroseconds(uint32_t usec) {
+    if (_vt_enabled) {
+        _vt_sleep_us(usec);
+        return;
+    }
     struct timespec ts;
     ts.tv_sec = usec / 1000000;
     ts.tv_nsec = (usec % 1000000) * 1000;
@@ -120,6 +403,15 @@ void chThdSleepSeconds(uint32_t sec) {
 
 void chThdSleepUntil(systime_t time) {
     systime_t now = chVTGetSystemTime();
+    if (_vt_enabled) {
+        /* Wake at the start of the target tick, not relative to now */
+        if ((int32_t)(time - now) > 0) {
+            uint64_t tick_us = 1000000 / CH_CFG_ST_FREQUENCY;
+            uint64_t tick_start = _vt_now_us - (_vt_now_us % tick_us);
+            _vt_sleep_us(tick_start + (uint64_t)(time - now) * tick_us - _vt_now_us);
+        }
+        return;
+    }
     if ((int32_t)(time - now) > 0) {
         chThdSleep(time - now);
     }
@@ -137,15 +429,24 @@ void chThdSleepUntilWindowed(systime_t prev, systime_t next) {
 static void* _thread_wrapper(void* arg) {
     thread_t *tp = (thread_t*)arg;
     pthread_setspecific(_current_thread_key, tp);
+    if (_vt_enabled) {
+        pthread_mutex_lock(&_vt_mutex);
+        while (_vt_current != tp) {
+            pthread_cond_wait(&tp->vt_cond, &_vt_mutex);
+        }
+        pthread_mutex_unlock(&_vt_mutex);
+    }
     tp->state = CH_STATE_CURRENT;
-    void* result = tp->func(tp->arg);
+    tp->func(tp->arg);
     tp->state = CH_STATE_FINAL;
-    return result;
+    if (_vt_enabled) {
+        _vt_thread_exit(tp);
+    }
+    return NULL;
 }
 
 thread_t *chThdCreateStatic(void *wsp, size_t size, tprio_t prio, tfunc_t pf, void *arg) {
     (void)size;
-    (void)prio;
     
     thread_t *tp = (thread_t*)wsp;
     memset(tp, 0, sizeof(thread_t));
@@ -156,6 +457,14 @@ thread_t *chThdCreateStatic(void *wsp, size_t size, tprio_t prio, tfunc_t pf, vo
     pthread_mutex_init(&tp->evt_mutex, NULL);
     pthread_cond_init(&tp->evt_cond, NULL);
     
+    if (_vt_enabled) {
+        /* Starts running when the creator blocks, like a same-priority thread */
+        pthread_mutex_lock(&_vt_mutex);
+        _vt_thread_init(tp, prio);
+        _vt_ready_push(tp);
+        pthread_mutex_unlock(&_vt_mutex);
+    }
+    
     pthread_attr_t attr;
     pthread_attr_init(&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
@@ -186,11 +495,16 @@ bool chThdShouldTerminateX(void) {
 }
 
 void chThdSetPriority(tprio_t newprio) {
-    (void)newprio;
     /* Priority not supported on POSIX without privileges */
+    if (_vt_enabled) {
+        _vt_self()->prio = newprio;
+    }
 }
 
 tprio_t chThdGetPriorityX(void) {
+    if (_vt_enabled) {
+        return _vt_self()->prio;
+    }
     return NORMALPRIO;
 }
 
@@ -222,6 +536,14 @@ void chThdResume(thread_reference_t *trp, msg_t msg) {
 
 msg_t chThdWait(thread_t *tp) {
     if (tp == NULL) return MSG_OK;
+    if (_vt_enabled) {
+        thread_t *self = _vt_self();
+        pthread_mutex_lock(&_vt_mutex);
+        while (!tp->vt_exited) {
+            _vt_wait_locked(self, tp, VT_NEVER);
+        }
+        pthread_mutex_unlock(&_vt_mutex);
+    }
     void *retval;
     pthread_join(tp->pthread, &retval);
     return tp->exitcode;
@@ -232,6 +554,9 @@ void chThdExit(msg_t msg) {
     if (tp) {
         tp->exitcode = msg;
         tp->state = CH_STATE_FINAL;
+        if (_vt_enabled) {
+            _vt_thread_exit(tp);
+        }
     }
     pthread_exit((void*)(intptr_t)msg);
 }
@@ -241,6 +566,16 @@ void chThdExitS(msg_t msg) {
 }
 
 void chThdYield(void) {
+    if (_vt_enabled) {
+        thread_t *self = _vt_self();
+        pthread_mutex_lock(&_vt_mutex);
+        if (_vt_ready) {
+            _vt_ready_push(self);
+            _vt_switch_locked(self);
+        }
+        pthread_mutex_unlock(&_vt_mutex);
+        return;
+    }
     sched_yield();
 }
 
@@ -265,6 +600,17 @@ void chMtxObjectInit(mutex_t *mp) {
 }
 
 void chMtxLock(mutex_t *mp) {
+    if (_vt_enabled) {
+        thread_t *self = _vt_self();
+        pthread_mutex_lock(&_vt_mutex);
+        while (mp->owner && mp->owner != self) {
+            _vt_wait_locked(self, mp, VT_NEVER);
+        }
+        mp->owner = self;
+        mp->cnt++;
+        pthread_mutex_unlock(&_vt_mutex);
+        return;
+    }
     pthread_mutex_lock(&mp->mutex);
     mp->owner = chThdGetSelfX();
     mp->cnt++;
@@ -275,6 +621,15 @@ void chMtxLockS(mutex_t *mp) {
 }
 
 bool chMtxTryLock(mutex_t *mp) {
+    if (_vt_enabled) {
+        thread_t *self = _vt_self();
+        if (mp->owner && mp->owner != self) {
+            return false;
+        }
+        mp->owner = self;
+        mp->cnt++;
+        return true;
+    }
     if (pthread_mutex_trylock(&mp->mutex) == 0) {
         mp->owner = chThdGetSelfX();
         mp->cnt++;
@@ -288,6 +643,15 @@ bool chMtxTryLockS(mutex_t *mp) {
 }
 
 void chMtxUnlock(mutex_t *mp) {
+    if (_vt_enabled) {
+        pthread_mutex_lock(&_vt_mutex);
+        if (--mp->cnt == 0) {
+            mp->owner = NULL;
+            _vt_wake_locked(mp);
+        }
+        pthread_mutex_unlock(&_vt_mutex);
+        return;
+    }
     mp->cnt--;
     if (mp->cnt == 0) {
         mp->owner = NULL;
@@ -318,6 +682,13 @@ void chSemObjectInit(semaphore_t *sp, cnt_t n) {
 }
 
 void chSemReset(semaphore_t *sp, cnt_t n) {
+    if (_vt_enabled) {
+        pthread_mutex_lock(&_vt_mutex);
+        sp->cnt = n;
+        _vt_wake_locked(sp);
+        pthread_mutex_unlock(&_vt_mutex);
+        return;
+    }
     sem_destroy(&sp->sem);
     sem_init(&sp->sem, 0, (unsigned int)n);
     sp->cnt = n;
@@ -328,6 +699,9 @@ void chSemResetI(semaphore_t *sp, cnt_t n) {
 }
 
 msg_t chSemWait(semaphore_t *sp) {
+    if (_vt_enabled) {
+        return chSemWaitTimeout(sp, TIME_INFINITE);
+    }
     if (sem_wait(&sp->sem) == 0) {
         sp->cnt--;
         return MSG_OK;
@@ -340,6 +714,23 @@ msg_t chSemWaitS(semaphore_t *sp) {
 }
 
 msg_t chSemWaitTimeout(semaphore_t *sp, sysinterval_t timeout) {
+    if (_vt_enabled) {
+        thread_t *self = _vt_self();
+        msg_t res = MSG_OK;
+        pthread_mutex_lock(&_vt_mutex);
+        uint64_t deadline = _vt_deadline(timeout);
+        while (sp->cnt <= 0) {
+            if (timeout == TIME_IMMEDIATE || !_vt_wait_locked(self, sp, deadline)) {
+                res = MSG_TIMEOUT;
+                break;
+            }
+        }
+        if (res == MSG_OK) {
+            sp->cnt--;
+        }
+        pthread_mutex_unlock(&_vt_mutex);
+        return res;
+    }
     if (timeout == TIME_IMMEDIATE) {
         if (sem_trywait(&sp->sem) == 0) {
             sp->cnt--;
@@ -372,6 +763,13 @@ msg_t chSemWaitTimeoutS(semaphore_t *sp, sysinterval_t timeout) {
 }
 
 void chSemSignal(semaphore_t *sp) {
+    if (_vt_enabled) {
+        pthread_mutex_lock(&_vt_mutex);
+        sp->cnt++;
+        _vt_wake_locked(sp);
+        pthread_mutex_unlock(&_vt_mutex);
+        return;
+    }
     sp->cnt++;
     sem_post(&sp->sem);
 }
@@ -381,6 +779,13 @@ void chSemSignalI(semaphore_t *sp) {
 }
 
 void chSemAddCounterI(semaphore_t *sp, cnt_t n) {
+    if (_vt_enabled) {
+        pthread_mutex_lock(&_vt_mutex);
+        sp->cnt += n;
+        _vt_wake_locked(sp);
+        pthread_mutex_unlock(&_vt_mutex);
+        return;
+    }
     sp->cnt += n;
     for (cnt_t i = 0; i < n; i++) {
         sem_post(&sp->sem);
@@ -395,6 +800,32 @@ cnt_t chSemGetCounterI(const semaphore_t *sp) {
 /* Event functions (minimal implementation)                                  */
 /*===========================================================================*/
 
+/*
+ * Thread-directed events are only implemented in virtual time, where they
+ * wait on the events pending for the calling thread.
+ */
+static eventmask_t _vt_evt_wait(eventmask_t events, sysinterval_t timeout, bool all) {
+    thread_t *self = _vt_self();
+    eventmask_t m = 0;
+
+    pthread_mutex_lock(&_vt_mutex);
+    uint64_t deadline = _vt_deadline(timeout);
+    for (;;) {
+        m = self->events & events;
+        if (all ? (m == events) : (m != 0)) {
+            break;
+        }
+        if (timeout == TIME_IMMEDIATE || !_vt_wait_locked(self, &self->events, deadline)) {
+            m = 0;
+            break;
+        }
+    }
+    self->events &= ~m;
+    pthread_mutex_unlock(&_vt_mutex);
+
+    return m;
+}
+
 void chEvtObjectInit(event_source_t *esp) {
     esp->next = NULL;
     pthread_mutex_init(&esp->mutex, NULL);
@@ -414,6 +845,12 @@ void chEvtUnregister(event_source_t *esp, event_listener_t *elp) {
 }
 
 eventmask_t chEvtGetAndClearEventsI(eventmask_t events) {
+    if (_vt_enabled) {
+        thread_t *self = _vt_self();
+        eventmask_t m = self->events & events;
+        self->events &= ~m;
+        return m;
+    }
     (void)events;
     return 0;
 }
@@ -423,7 +860,10 @@ eventmask_t chEvtGetAndClearEvents(eventmask_t events) {
 }
 
 eventmask_t chEvtAddEvents(eventmask_t events) {
-    (void)events;
+    if (_vt_enabled) {
+        thread_t *self = _vt_self();
+        return self->events |= events;
+    }
     return events;
 }
 
@@ -451,31 +891,47 @@ void chEvtBroadcastFlagsI(event_source_t *esp, eventflags_t flags) {
 }
 
 eventmask_t chEvtWaitOne(eventmask_t events) {
-    (void)events;
-    return 0;
+    return chEvtWaitOneTimeout(events, TIME_INFINITE);
 }
 
 eventmask_t chEvtWaitAny(eventmask_t events) {
-    (void)events;
-    return 0;
+    return chEvtWaitAnyTimeout(events, TIME_INFINITE);
 }
 
 eventmask_t chEvtWaitAll(eventmask_t events) {
-    (void)events;
+    if (_vt_enabled) {
+        return _vt_evt_wait(events, TIME_INFINITE, true);
+    }
     return events;
 }
 
 eventmask_t chEvtWaitOneTimeout(eventmask_t events, sysinterval_t timeout) {
+    if (_vt_enabled) {
+        thread_t *self = _vt_self();
+        eventmask_t m = _vt_evt_wait(events, timeout, false);
+        /* Only consume the lowest pending event */
+        eventmask_t one = m & (~m + 1);
+        pthread_mutex_lock(&_vt_mutex);
+        self->events |= m & ~one;
+        pthread_mutex_unlock(&_vt_mutex);
+        return one;
+    }
     (void)events; (void)timeout;
     return 0;
 }
 
 eventmask_t chEvtWaitAnyTimeout(eventmask_t events, sysinterval_t timeout) {
+    if (_vt_enabled) {
+        return _vt_evt_wait(events, timeout, false);
+    }
     (void)events; (void)timeout;
     return 0;
 }
 
 eventmask_t chEvtWaitAllTimeout(eventmask_t events, sysinterval_t timeout) {
+    if (_vt_enabled) {
+        return _vt_evt_wait(events, timeout, true);
+    }
     (void)events; (void)timeout;
     return 0;
 }
@@ -501,6 +957,14 @@ void chEvtDispatch(const evhandler_t *handlers, eventmask_t events) {
 void chEvtSignal(thread_t *tp, eventmask_t events) {
     if (!tp) return;
     
+    if (_vt_enabled) {
+        pthread_mutex_lock(&_vt_mutex);
+        tp->events |= events;
+        _vt_wake_locked(&tp->events);
+        pthread_mutex_unlock(&_vt_mutex);
+        return;
+    }
+    
     pthread_mutex_lock(&tp->evt_mutex);
     tp->events |= events;
     pthread_cond_broadcast(&tp->evt_cond);
@@ -513,7 +977,7 @@ void chEvtSignalI(thread_t *tp, eventmask_t events) {
 }
 
 /*===========================================================================*/
-/* Virtual timer functions (stub implementation)                             */
+/* Virtual timer functions (stub implementation, except in virtual time)     */
 /*===========================================================================*/
 
 void chVTObjectInit(virtual_timer_t *vtp) {
@@ -521,6 +985,17 @@ void chVTObjectInit(virtual_timer_t *vtp) {
 }
 
 void chVTSet(virtual_timer_t *vtp, sysinterval_t delay, vtfunc_t vtfunc, void *par) {
+    if (_vt_enabled) {
+        pthread_mutex_lock(&_vt_mutex);
+        vtp->func = vtfunc;
+        vtp->par = par;
+        vtp->vt_gen++;
+        if (delay != TIME_INFINITE) {
+            _vt_heap_push(_vt_deadline(delay), NULL, vtp, vtp->vt_gen);
+        }
+        pthread_mutex_unlock(&_vt_mutex);
+        return;
+    }
     (void)vtp; (void)delay; (void)vtfunc; (void)par;
     /* Timer functionality not fully implemented for PC */
 }
@@ -530,6 +1005,13 @@ void chVTSetI(virtual_timer_t *vtp, sysinterval_t delay, vtfunc_t vtfunc, void *
 }
 
 void chVTReset(virtual_timer_t *vtp) {
+    if (_vt_enabled) {
+        pthread_mutex_lock(&_vt_mutex);
+        vtp->func = NULL;
+        vtp->vt_gen++;
+        pthread_mutex_unlock(&_vt_mutex);
+        return;
+    }
     (void)vtp;
 }
 
@@ -0,0 +1,8 @@
+/**
+ * @file chsystypes.h
+ * @brief ChibiOS chsystypes.h shim for PC build
+ *
+ * Firmware headers include this directly; all types live in ch.h.
+ */
+
+#include "ch.h"
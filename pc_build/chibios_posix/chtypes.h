@@ -0,0 +1,8 @@
+/**
+ * @file chtypes.h
+ * @brief ChibiOS chtypes.h shim for PC build
+ *
+ * Firmware headers include this directly; all types live in ch.h.
+ */
+
+#include "ch.h"
@@ -50,6 +50,9 @@ typedef uint32_t iomode_t;
 #define PAL_MODE_ALTERNATE(n)           (16U | (n))
 #define PAL_STM32_OSPEED_HIGHEST        3U
 
+/* GPIO register block; only ever handled through pointers by firmware code */
+typedef void stm32_gpio_t;
+
 #define palSetPad(port, pad)            ((void)0)
 #define palClearPad(port, pad)          ((void)0)
 #define palTogglePad(port, pad)         ((void)0)
@@ -205,6 +208,13 @@ struct SerialDriver {
     halstate_t              state;
 };
 
+typedef struct {
+    uint32_t                speed;
+    uint16_t                cr1;
+    uint16_t                cr2;
+    uint16_t                cr3;
+} SerialConfig;
+
 struct UARTDriver {
     halstate_t              state;
 };
@@ -243,6 +253,13 @@ struct SPIDriver {
     halstate_t              state;
 };
 
+typedef struct {
+    void                    (*end_cb)(SPIDriver *spip);
+    ioportid_t              ssport;
+    uint16_t                sspad;
+    uint16_t                cr1;
+} SPIConfig;
+
 extern SPIDriver SPID1;
 extern SPIDriver SPID2;
 extern SPIDriver SPID3;
@@ -283,6 +300,7 @@ typedef uint32_t canmbx_t;
 
 typedef struct {
     uint32_t                EID;
+    uint32_t                SID;
     uint32_t                IDE;
     uint32_t                RTR;
     uint8_t                 DLC;
@@ -291,6 +309,7 @@ typedef struct {
 
 typedef struct {
     uint32_t                EID;
+    uint32_t                SID;
     uint32_t                IDE;
     uint32_t                RTR;
     uint8_t                 DLC;
@@ -301,15 +320,36 @@ typedef struct {
 
 struct CANDriver {
     halstate_t              state;
+    event_source_t          rxfull_event;
 };
 
+typedef struct {
+    uint32_t                mcr;
+    uint32_t                btr;
+} CANConfig;
+
+#define CAN_MCR_ABOM                    (1U << 0)
+#define CAN_MCR_AWUM                    (1U << 1)
+#define CAN_MCR_TXFP                    (1U << 2)
+#define CAN_BTR_SJW(n)                  ((uint32_t)(n) << 24)
+#define CAN_BTR_TS2(n)                  ((uint32_t)(n) << 20)
+#define CAN_BTR_TS1(n)                  ((uint32_t)(n) << 16)
+#define CAN_BTR_BRP(n)                  ((uint32_t)(n))
+#define CAN_FMR_FINIT                   (1U << 0)
+
+#define CAN_IDE_STD                     0U
+#define CAN_IDE_EXT                     1U
+#define CAN_RTR_DATA                    0U
+
+#define CAN_READY                       HAL_READY
+
 extern CANDriver CAND1;
 extern CANDriver CAND2;
 
 #define canStart(canp, config)          ((canp)->state = HAL_READY)
 #define canStop(canp)                   ((canp)->state = HAL_STOP)
 #define canTransmit(canp, mailbox, ctfp, timeout) MSG_OK
-#define canReceive(canp, mailbox, crfp, timeout) MSG_TIMEOUT
+#define canReceive(canp, mailbox, crfp, timeout) ((void)(canp), MSG_TIMEOUT)
 #define canTryReceiveI(canp, mailbox, crfp) false
 
 #define CAN_ANY_MAILBOX                 0U
@@ -399,6 +439,11 @@ typedef void (*stm32_dmaisr_t)(void *p, uint32_t flags);
 #define dmaStreamDisable(dmastp)        ((void)0)
 #define dmaStreamClearInterrupt(dmastp) ((void)0)
 #define dmaStreamGetTransactionSize(dmastp) (0U)
+#define dmaStreamAllocate(dmastp, priority, func, param) ((void)0)
+#define dmaStreamRelease(dmastp)        ((void)0)
+
+#define STM32_DMA_STREAM_ID(dma, stream) ((((dma) - 1) * 8) + (stream))
+#define STM32_DMA_STREAM(id)            ((void*)(uintptr_t)((id) + 1))
 
 #define STM32_DMA_CR_PL(n)              (0U)
 #define STM32_DMA_CR_MSIZE_BYTE         (0U)
@@ -438,6 +483,9 @@ void halStart(void);
 #define OSAL_IRQ_EPILOGUE()             do {} while(0)
 #define OSAL_IRQ_HANDLER(name)          void name(void)
 
+#define nvicEnableVector(n, prio)       ((void)(n), (void)(prio))
+#define nvicDisableVector(n)            ((void)(n))
+
 /* Port / Line macros */
 #define LINE_LED                        0U
 #define PAL_LINE(port, pad)             (((uint32_t)(uintptr_t)(port) << 16) | (pad))
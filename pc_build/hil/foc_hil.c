@@ -0,0 +1,283 @@
+/**
+ * @file foc_hil.c
+ * @brief PC hardware-in-the-loop harness for the production FOC ISR
+ */
+
+#include <math.h>
+#include <string.h>
+#include "foc_hil.h"
+#include "conf_general.h"
+#include "mc_interface.h"
+#include "mcpwm_foc.h"
+#include "stm32f4xx_conf.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Rate of TIM5, see driver/timer.c
+#define HIL_TIM5_HZ             14e6
+
+// Background thread periods, see timer_thread and hfi_thread in mcpwm_foc.c
+#define HIL_TIMER_PERIOD        0.001
+#define HIL_HFI_PERIOD          0.0005
+
+// ADC midpoint used as current offset
+#define HIL_CURRENT_OFFSET      2048.0f
+
+// Output compare modes (CCMRx.OCxM)
+#define HIL_OCM_FORCED_LOW      0x40
+#define HIL_OCM_PWM1            0x60
+
+// =============================================================================
+// Private Functions
+// =============================================================================
+
+static uint16_t adc_clamp(float counts) {
+    if (counts < 0.0f) return 0;
+    if (counts > 4095.0f) return 4095;
+    return (uint16_t)(counts + 0.5f);
+}
+
+static float pid_period(const mc_configuration *conf) {
+    switch (conf->sp_pid_loop_rate) {
+    case PID_RATE_25_HZ: return 1.0f / 25.0f;
+    case PID_RATE_50_HZ: return 1.0f / 50.0f;
+    case PID_RATE_100_HZ: return 1.0f / 100.0f;
+    case PID_RATE_250_HZ: return 1.0f / 250.0f;
+    case PID_RATE_500_HZ: return 1.0f / 500.0f;
+    case PID_RATE_1000_HZ: return 1.0f / 1000.0f;
+    case PID_RATE_2500_HZ: return 1.0f / 2500.0f;
+    case PID_RATE_5000_HZ: return 1.0f / 5000.0f;
+    case PID_RATE_10000_HZ: return 1.0f / 10000.0f;
+    }
+    return 1.0f / 1000.0f;
+}
+
+/**
+ * Decode one TIM1 channel into a phase voltage.
+ *
+ * @return false if the phase is floating (both switches off)
+ */
+static bool phase_voltage(uint16_t channel, volatile uint32_t ccr, float v_bus, float *v) {
+    volatile uint32_t ccmr = channel < TIM_Channel_3 ? TIM1->CCMR1 : TIM1->CCMR2;
+    int shift = (channel & TIM_Channel_2) ? 8 : 0;
+    uint32_t mode = (ccmr >> shift) & 0x70;
+    bool high_en = (TIM1->CCER >> channel) & TIM_CCx_Enable;
+    bool low_en = (TIM1->CCER >> channel) & TIM_CCxN_Enable;
+
+    if (mode == HIL_OCM_PWM1 && high_en) {
+        // Center-aligned PWM mode 1: the high side conducts while CNT < CCR
+        float duty = (float)ccr / (float)TIM1->ARR;
+        if (duty > 1.0f) duty = 1.0f;
+        *v = duty * v_bus;
+        return true;
+    }
+
+    if (mode == HIL_OCM_FORCED_LOW && low_en) {
+        *v = 0.0f;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Apply the bridge state to the motor model and integrate over one period.
+ */
+static void run_plant(foc_hil_t *hil, float dt) {
+    float va, vb, vc;
+    bool driven = (TIM1->BDTR & 0x8000) &&
+            phase_voltage(TIM_Channel_1, TIM1->CCR1, hil->v_bus, &va) &&
+            phase_voltage(TIM_Channel_2, TIM1->CCR2, hil->v_bus, &vb) &&
+            phase_voltage(TIM_Channel_3, TIM1->CCR3, hil->v_bus, &vc);
+
+    hil->outputs_floating = !driven;
+
+    if (driven) {
+        hil->vm_io.v_alpha_in = (2.0f * va - vb - vc) / 3.0f;
+        hil->vm_io.v_beta_in = (vb - vc) / sqrtf(3.0f);
+    } else {
+        // Open bridge: below the bus voltage the back-EMF cannot drive any
+        // current through the body diodes, so only the rotor keeps moving.
+        hil->vm.id = 0.0f;
+        hil->vm.iq = 0.0f;
+        hil->vm.id_int = hil->vm.lambda / hil->vm.ld;
+        hil->vm_io.v_alpha_in = -hil->vm.we * hil->vm.lambda * hil->vm.sin_phi;
+        hil->vm_io.v_beta_in = hil->vm.we * hil->vm.lambda * hil->vm.cos_phi;
+    }
+
+    float sub_dt = dt / (float)hil->model_substeps;
+    for (int i = 0; i < hil->model_substeps; i++) {
+        virtual_motor_pc_state_step(&hil->vm, &hil->vm_io, sub_dt);
+    }
+
+    if (!driven) {
+        hil->vm.id = 0.0f;
+        hil->vm.iq = 0.0f;
+        hil->vm.id_int = hil->vm.lambda / hil->vm.ld;
+        hil->vm_io.i_alpha_out = 0.0f;
+        hil->vm_io.i_beta_out = 0.0f;
+
+        // Floating terminals follow the back-EMF around the bus midpoint
+        float ea = hil->vm_io.v_alpha_in;
+        float eb = hil->vm_io.v_beta_in;
+        va = ea + 0.5f * hil->v_bus;
+        vb = -0.5f * ea + 0.5f * sqrtf(3.0f) * eb + 0.5f * hil->v_bus;
+        vc = -0.5f * ea - 0.5f * sqrtf(3.0f) * eb + 0.5f * hil->v_bus;
+    }
+
+    hil->va = va;
+    hil->vb = vb;
+    hil->vc = vc;
+}
+
+/**
+ * Write the sampled plant state into the ADC buffer, as the DMA would.
+ */
+static void sample_adc(foc_hil_t *hil) {
+    float i_alpha = hil->vm_io.i_alpha_out;
+    float i_beta = hil->vm_io.i_beta_out;
+    float ia = i_alpha;
+    float ib = -0.5f * i_alpha + 0.5f * sqrtf(3.0f) * i_beta;
+    float ic = -ia - ib;
+
+    ADC_Value[ADC_IND_CURR1] = adc_clamp(ia / FAC_CURRENT1 + HIL_CURRENT_OFFSET);
+    ADC_Value[ADC_IND_CURR2] = adc_clamp(ib / FAC_CURRENT2 + HIL_CURRENT_OFFSET);
+    ADC_Value[ADC_IND_CURR3] = adc_clamp(ic / FAC_CURRENT3 + HIL_CURRENT_OFFSET);
+
+    ADC_Value[ADC_IND_SENS1] = adc_clamp(hil->va * VOLTAGE_TO_ADC_FACTOR);
+    ADC_Value[ADC_IND_SENS2] = adc_clamp(hil->vb * VOLTAGE_TO_ADC_FACTOR);
+    ADC_Value[ADC_IND_SENS3] = adc_clamp(hil->vc * VOLTAGE_TO_ADC_FACTOR);
+    ADC_Value[ADC_IND_VIN_SENS] = adc_clamp(hil->v_bus * VOLTAGE_TO_ADC_FACTOR);
+
+    // hw_hil.h reads the temperature channels directly in degrees
+    ADC_Value[ADC_IND_TEMP_MOS] = adc_clamp(hil->temp_fet);
+    ADC_Value[ADC_IND_TEMP_MOTOR] = adc_clamp(hil->temp_motor);
+}
+
+static void advance_time(foc_hil_t *hil, float dt) {
+    hil->time += dt;
+
+    double ticks = (double)dt * HIL_TIM5_HZ + hil->tim5_frac;
+    uint32_t whole = (uint32_t)ticks;
+    hil->tim5_frac = ticks - (double)whole;
+    TIM5->CNT += whole;
+}
+
+static void run_threads(foc_hil_t *hil) {
+    while (hil->time >= hil->next_timer_time) {
+        mcpwm_foc_pc_run_timer(HIL_TIMER_PERIOD);
+        hil->next_timer_time += HIL_TIMER_PERIOD;
+    }
+
+    while (hil->time >= hil->next_hfi_time) {
+        mcpwm_foc_pc_run_hfi(HIL_HFI_PERIOD);
+        hil->next_hfi_time += HIL_HFI_PERIOD;
+    }
+
+    float pid_dt = pid_period(hil->conf);
+    while (hil->time >= hil->next_pid_time) {
+        mcpwm_foc_pc_run_pid(pid_dt);
+        hil->next_pid_time += pid_dt;
+    }
+}
+
+// =============================================================================
+// Public API
+// =============================================================================
+
+void foc_hil_init(foc_hil_t *hil, mc_configuration *conf, float v_bus) {
+    if (hil == NULL || conf == NULL) return;
+
+    memset(hil, 0, sizeof(foc_hil_t));
+    for (int i = 0; i < HW_ADC_CHANNELS; i++) {
+        ADC_Value[i] = 0;
+    }
+
+    hil->conf = conf;
+    hil->v_bus = v_bus;
+    hil->temp_fet = 25.0f;
+    hil->temp_motor = 25.0f;
+    hil->model_substeps = 4;
+
+    conf->foc_offsets_cal_mode = 0;
+    for (int i = 0; i < 3; i++) {
+        conf->foc_offsets_current[i] = HIL_CURRENT_OFFSET;
+    }
+
+    // virtual_motor_pc integrates the rotor angle at vm.we but computes the
+    // back-EMF at vm.we * pole_pairs. Run it with one pole pair and the
+    // inertia referred to the electrical frame so that the angle, speed and
+    // back-EMF the observer sees are consistent.
+    virtual_motor_pc_state_init(&hil->vm, conf);
+    hil->pole_pairs = hil->vm.pole_pairs;
+    hil->vm.pole_pairs = 1;
+    hil->vm.km = 1.5f;
+    hil->vm.J /= (float)(hil->pole_pairs * hil->pole_pairs);
+
+    hil->va = hil->vb = hil->vc = 0.5f * v_bus;
+    sample_adc(hil);
+
+    TIM5->CNT = 0;
+    mcpwm_foc_init(conf, conf);
+    foc_hil_clear_fault();
+
+    // Counting down first, so that the first ISR is a V0 sample
+    TIM1->CR1 |= TIM_CR1_DIR;
+
+    hil->next_timer_time = HIL_TIMER_PERIOD;
+    hil->next_hfi_time = HIL_HFI_PERIOD;
+    hil->next_pid_time = pid_period(conf);
+}
+
+void foc_hil_deinit(foc_hil_t *hil) {
+    (void)hil;
+    mcpwm_foc_deinit();
+}
+
+void foc_hil_step(foc_hil_t *hil) {
+    if (hil == NULL) return;
+
+    float dt = foc_hil_get_isr_period(hil);
+
+    run_plant(hil, dt);
+    sample_adc(hil);
+    advance_time(hil, dt);
+
+    TIM1->CR1 ^= TIM_CR1_DIR;
+    mcpwm_foc_adc_int_handler(NULL, 0);
+    hil->isr_count++;
+
+    run_threads(hil);
+}
+
+void foc_hil_run(foc_hil_t *hil, float seconds) {
+    if (hil == NULL) return;
+
+    double t_end = hil->time + (double)seconds;
+    while (hil->time < t_end) {
+        foc_hil_step(hil);
+    }
+}
+
+void foc_hil_set_load_torque(foc_hil_t *hil, float torque_nm) {
+    if (hil == NULL) return;
+    virtual_motor_pc_state_set_load_torque(&hil->vm, torque_nm / (float)hil->pole_pairs);
+}
+
+void foc_hil_set_inertia(foc_hil_t *hil, float J_kgm2) {
+    if (hil == NULL) return;
+    virtual_motor_pc_state_set_inertia(&hil->vm,
+            J_kgm2 / (float)(hil->pole_pairs * hil->pole_pairs));
+}
+
+void foc_hil_set_v_bus(foc_hil_t *hil, float v_bus) {
+    if (hil == NULL) return;
+    hil->v_bus = v_bus;
+}
+
+float foc_hil_get_isr_period(const foc_hil_t *hil) {
+    (void)hil;
+    return (float)TIM1->ARR / (float)SYSTEM_CORE_CLOCK;
+}
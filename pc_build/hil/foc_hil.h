@@ -0,0 +1,142 @@
+/**
+ * @file foc_hil.h
+ * @brief PC hardware-in-the-loop harness for the production FOC ISR
+ *
+ * Runs the unmodified mcpwm_foc_adc_int_handler() from motor/mcpwm_foc.c
+ * against the virtual motor model. Each ISR period the harness
+ *
+ *  1. applies the TIM1 compare values written by the firmware as phase
+ *     voltages and integrates the motor model over the period,
+ *  2. converts the model currents and voltages into raw ADC samples,
+ *  3. toggles the TIM1 count direction (V0/V7) and calls the ISR,
+ *  4. advances the free-running TIM5 timestamp and runs the firmware's
+ *     timer, HFI and speed/position PID thread bodies when they are due.
+ *
+ * Everything runs in simulated time without sleeping, so a simulated
+ * second costs only as much CPU time as the ISR and model need.
+ *
+ * The firmware keeps its state in file-scope variables, so only one
+ * harness instance can be active per process.
+ */
+
+#ifndef FOC_HIL_H_
+#define FOC_HIL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "datatypes.h"
+#include "virtual_motor_pc.h"
+#include "mc_capture.h"
+
+// =============================================================================
+// Types
+// =============================================================================
+
+/**
+ * Harness state
+ */
+typedef struct {
+    mc_configuration *conf;     ///< Firmware configuration (caller-owned)
+    virtual_motor_state_t vm;   ///< Motor model, run in the electrical frame
+    virtual_motor_io_t vm_io;   ///< Motor model I/O
+
+    float v_bus;                ///< DC link voltage [V]
+    float temp_fet;             ///< MOSFET temperature [°C]
+    float temp_motor;           ///< Motor temperature [°C]
+    int model_substeps;         ///< Model integration steps per ISR period
+    int pole_pairs;             ///< Motor pole pairs from the configuration
+
+    double time;                ///< Simulated time [s]
+    uint64_t isr_count;         ///< Number of ISR invocations
+    double next_timer_time;     ///< Next timer_thread iteration [s]
+    double next_hfi_time;       ///< Next hfi_thread iteration [s]
+    double next_pid_time;       ///< Next pid_thread iteration [s]
+    double tim5_frac;           ///< Sub-tick remainder of the TIM5 timestamp
+
+    float va, vb, vc;           ///< Phase voltages applied last period [V]
+    bool outputs_floating;      ///< True if the bridge was switched off
+} foc_hil_t;
+
+// =============================================================================
+// API
+// =============================================================================
+
+/**
+ * Initialize the firmware (mcpwm_foc_init) and the motor model.
+ *
+ * The configuration is modified for the PC: current offset calibration at
+ * start-up is disabled and the offsets are set to the ADC midpoint used by
+ * the harness. It must stay valid while the harness is in use.
+ *
+ * @param hil Harness state
+ * @param conf Motor configuration
+ * @param v_bus DC link voltage [V]
+ */
+void foc_hil_init(foc_hil_t *hil, mc_configuration *conf, float v_bus);
+
+/**
+ * Stop the firmware (mcpwm_foc_deinit).
+ */
+void foc_hil_deinit(foc_hil_t *hil);
+
+/**
+ * Run one ISR period (1 / foc_f_zv).
+ */
+void foc_hil_step(foc_hil_t *hil);
+
+/**
+ * Run for a duration of simulated time.
+ *
+ * @param seconds Simulated time to run [s]
+ */
+void foc_hil_run(foc_hil_t *hil, float seconds);
+
+/**
+ * Set the load torque on the motor model [Nm].
+ */
+void foc_hil_set_load_torque(foc_hil_t *hil, float torque_nm);
+
+/**
+ * Set the rotor inertia of the motor model [kg·m²].
+ */
+void foc_hil_set_inertia(foc_hil_t *hil, float J_kgm2);
+
+/**
+ * Set the DC link voltage [V].
+ */
+void foc_hil_set_v_bus(foc_hil_t *hil, float v_bus);
+
+/**
+ * Get the ISR period currently programmed into TIM1 [s].
+ */
+float foc_hil_get_isr_period(const foc_hil_t *hil);
+
+/**
+ * Clear the latched fault (see hil_fw_stubs.c).
+ */
+void foc_hil_clear_fault(void);
+
+/**
+ * Number of faults reported by the firmware since start.
+ */
+int foc_hil_get_fault_count(void);
+
+/**
+ * Arm the pre-trigger capture that the mc_interface hook of the harness
+ * feeds from the ISR (see hil_fw_stubs.c), like COMM_CAPTURE_ARM does.
+ *
+ * @return false if the configuration does not fit the buffer
+ */
+bool foc_hil_capture_arm(const mc_capture_config *conf);
+
+/**
+ * Stop the capture, so that the hook only checks its state.
+ */
+void foc_hil_capture_disarm(void);
+
+/**
+ * The capture fed by the harness.
+ */
+const mc_capture_t *foc_hil_capture(void);
+
+#endif /* FOC_HIL_H_ */
@@ -0,0 +1,98 @@
+/**
+ * @file hil_can_stubs.c
+ * @brief Firmware modules around comm_can.c, reduced for the PC build
+ *
+ * comm_can.c is linked together with these and the CAN stubs of the POSIX
+ * HAL, so that frames can be looped back through its threads. They do
+ * nothing and return zeros, tests define the functions the decoded frames
+ * end up in and the values of the status messages themselves and leave
+ * them out of here.
+ */
+
+#include <string.h>
+#include "conf_general.h"
+#include "bms.h"
+#include "canard_driver.h"
+#include "commands.h"
+#include "encoder/encoder.h"
+#include "encoder_cfg.h"
+#include "mc_interface.h"
+#include "servo_dec.h"
+#include "timeout.h"
+
+// =============================================================================
+// Shared Variables
+// =============================================================================
+
+volatile uint16_t ADC_Value[HW_ADC_CHANNELS + HW_ADC_CHANNELS_EXTRA];
+TS5700N8501_config_t encoder_cfg_TS5700N8501;
+
+static mc_configuration m_mcconf;
+
+// =============================================================================
+// bms
+// =============================================================================
+
+bool bms_process_can_frame(uint32_t can_id, uint8_t *data8, int len, bool is_ext) { return false; }
+
+// =============================================================================
+// canard_driver
+// =============================================================================
+
+void canard_driver_init(void) {}
+
+// =============================================================================
+// commands
+// =============================================================================
+
+void commands_fwd_can_frame(int len, unsigned char *data, uint32_t id, bool is_extended) {}
+void commands_send_packet_can_last(unsigned char *data, unsigned int len) {}
+
+// =============================================================================
+// conf_general
+// =============================================================================
+
+int conf_general_detect_apply_all_foc(float max_power_loss,
+        bool store_mcconf_on_success, bool send_mcconf_on_success) { return 0; }
+bool conf_general_store_app_configuration(app_configuration *conf) { return false; }
+bool conf_general_store_mc_configuration(mc_configuration *conf, bool is_motor_2) { return false; }
+
+// =============================================================================
+// encoder
+// =============================================================================
+
+float encoder_read_deg(void) { return 0.0f; }
+
+// =============================================================================
+// mc_interface
+// =============================================================================
+
+const volatile mc_configuration* mc_interface_get_configuration(void) { return &m_mcconf; }
+int mc_interface_get_motor_thread(void) { return 1; }
+volatile gnss_data *mc_interface_gnss(void) { return 0; }
+void mc_interface_select_motor_thread(int motor) {}
+void mc_interface_set_brake_current(float current) {}
+void mc_interface_set_brake_current_rel(float val) {}
+void mc_interface_set_configuration(mc_configuration *configuration) {}
+void mc_interface_set_current(float current) {}
+void mc_interface_set_current_off_delay(float delay_sec) {}
+void mc_interface_set_current_rel(float val) {}
+void mc_interface_set_duty(float dutyCycle) {}
+void mc_interface_set_handbrake(float current) {}
+void mc_interface_set_handbrake_rel(float val) {}
+void mc_interface_set_pid_pos(float pos) {}
+void mc_interface_set_pid_speed(float rpm) {}
+void mc_interface_update_pid_pos_offset(float angle_now, bool store) {}
+
+// =============================================================================
+// servo_dec
+// =============================================================================
+
+float servodec_get_servo(int servo_num) { return 0.0f; }
+
+// =============================================================================
+// timeout
+// =============================================================================
+
+void timeout_feed_WDT(uint8_t index) {}
+void timeout_reset(void) {}
@@ -0,0 +1,322 @@
+/**
+ * @file hil_cmd_stubs.c
+ * @brief Firmware modules around commands.c, reduced for the PC build
+ *
+ * commands.c is linked together with these so that packets can be fed
+ * through commands_process_packet(). They do nothing and return zeros,
+ * tests that look at a packet define the functions it ends up in
+ * themselves and leave them out of here.
+ */
+
+#include <string.h>
+#include "conf_general.h"
+#include "app.h"
+#include "bms.h"
+#include "comm_can.h"
+#include "conf_custom.h"
+#include "confgenerator.h"
+#include "shutdown.h"
+#include "encoder/encoder.h"
+#include "flash_helper.h"
+#include "foc_stage_prof.h"
+#include "imu.h"
+#include "main.h"
+#include "mc_interface.h"
+#include "mcpwm_foc.h"
+#include "mcpwm.h"
+#include "nrf_driver.h"
+#include "pwm_servo.h"
+#include "servo_dec.h"
+#include "terminal.h"
+#include "timeout.h"
+#include "bm_if.h"
+#include "minilzo.h"
+
+// =============================================================================
+// Shared Variables
+// =============================================================================
+
+bool conf_general_permanent_nrf_found = false;
+
+static mc_configuration m_mcconf;
+
+int lzo1x_decompress_safe(const lzo_bytep src, lzo_uint src_len, lzo_bytep dst,
+        lzo_uintp dst_len, lzo_voidp wrkmem) {
+    (void)src;
+    (void)src_len;
+    (void)dst;
+    (void)wrkmem;
+    *dst_len = 0;
+    return LZO_E_ERROR;
+}
+
+// =============================================================================
+// app
+// =============================================================================
+
+float app_adc_get_decoded_level(void) { return 0.0f; }
+float app_adc_get_decoded_level2(void) { return 0.0f; }
+float app_adc_get_voltage(void) { return 0.0f; }
+float app_adc_get_voltage2(void) { return 0.0f; }
+float app_nunchuk_get_decoded_y(void) { return 0.0f; }
+void app_nunchuk_update_output(chuck_data *data) {}
+float app_ppm_get_decoded_level(void) { return 0.0f; }
+
+// =============================================================================
+// bm_if
+// =============================================================================
+
+int bm_connect(void) { return 0; }
+void bm_default_swd_pins(void) {}
+void bm_disconnect(void) {}
+int bm_erase_flash_all(void) { return 0; }
+void bm_halt_req(void) {}
+void bm_leave_nrf_debug_mode(void) {}
+int bm_mem_read(uint32_t addr, void *data, uint32_t len) { return 0; }
+int bm_mem_write(uint32_t addr, const void *data, uint32_t len) { return 0; }
+int bm_reboot(void) { return 0; }
+int bm_write_flash(uint32_t addr, const void *data, uint32_t len) { return 0; }
+
+// =============================================================================
+// bms
+// =============================================================================
+
+void bms_process_cmd(unsigned char *data, unsigned int len,
+        void(*reply_func)(unsigned char *data, unsigned int len)) {}
+
+// =============================================================================
+// comm_can
+// =============================================================================
+
+void comm_can_conf_battery_cut(uint8_t controller_id, bool store, float start, float end) {}
+io_board_adc_values *comm_can_get_io_board_adc_1_4_id(int id) { return 0; }
+io_board_adc_values *comm_can_get_io_board_adc_5_8_id(int id) { return 0; }
+io_board_digial_inputs *comm_can_get_io_board_digital_in_id(int id) { return 0; }
+psw_status *comm_can_get_psw_status_id(int id) { return 0; }
+psw_status *comm_can_get_psw_status_index(int index) { return 0; }
+can_status_msg *comm_can_get_status_msg_index(int index) { return 0; }
+void comm_can_io_board_set_output_digital(int id, int channel, bool on) {}
+void comm_can_io_board_set_output_pwm(int id, int channel, float duty) {}
+CAN_BAUD comm_can_kbits_to_baud(int kbits) { return 0; }
+bool comm_can_ping(uint8_t controller_id, HW_TYPE *hw_type) { return false; }
+void comm_can_psw_switch(int id, bool is_on, bool plot) {}
+void comm_can_send_buffer(uint8_t controller_id, uint8_t *data, unsigned int len, uint8_t send) {}
+void comm_can_send_update_baud(int kbits, int delay_msec) {}
+void comm_can_set_baud(CAN_BAUD baud, int delay_msec) {}
+msg_t comm_can_transmit_eid(uint32_t id, const uint8_t *data, uint8_t len) { return 0; }
+msg_t comm_can_transmit_sid(uint32_t id, const uint8_t *data, uint8_t len) { return 0; }
+
+// =============================================================================
+// conf_custom
+// =============================================================================
+
+int conf_custom_cfg_num(void) { return 0; }
+void conf_custom_process_cmd(unsigned char *data, unsigned int len,
+        void(*reply_func)(unsigned char *data, unsigned int len)) {}
+
+// =============================================================================
+// conf_general
+// =============================================================================
+
+int conf_general_detect_apply_all_foc_can(bool detect_can, float max_power_loss,
+        float min_current_in, float max_current_in, float openloop_rpm, float sl_erpm,
+        void(*reply_func)(unsigned char* data, unsigned int len)) { return 0; }
+bool conf_general_detect_motor_param(float current, float min_rpm, float low_duty,
+        float *int_limit, float *bemf_coupling_k, int8_t *hall_table, int *hall_res) { return false; }
+bool conf_general_measure_flux_linkage(float current, float duty, float min_erpm,
+        float res, float *linkage) { return false; }
+int conf_general_measure_flux_linkage_openloop(float current, float duty,
+        float erpm_per_sec, float res, float ind, float *linkage, float *linkage_undriven,
+        float *undriven_samples, bool *result, float *enc_offset, float *enc_ratio,
+        bool *enc_inverted) { return 0; }
+bool conf_general_store_app_configuration(app_configuration *conf) { return false; }
+bool conf_general_store_backup_data(void) { return false; }
+bool conf_general_store_mc_configuration(mc_configuration *conf, bool is_motor_2) { return false; }
+
+// =============================================================================
+// confgenerator
+// =============================================================================
+
+bool confgenerator_deserialize_appconf(const uint8_t *buffer, app_configuration *conf) { return false; }
+bool confgenerator_deserialize_mcconf(const uint8_t *buffer, mc_configuration *conf) { return false; }
+int32_t confgenerator_serialize_appconf(uint8_t *buffer, const app_configuration *conf) { return 0; }
+int32_t confgenerator_serialize_mcconf(uint8_t *buffer, const mc_configuration *conf) { return 0; }
+void confgenerator_set_defaults_appconf(app_configuration *conf) {}
+void confgenerator_set_defaults_mcconf(mc_configuration *conf) {}
+
+// =============================================================================
+// shutdown
+// =============================================================================
+
+bool do_shutdown(bool resample) { return false; }
+void shutdown_reset_timer(void) {}
+
+// =============================================================================
+// encoder
+// =============================================================================
+
+encoder_type_t encoder_is_configured(void) { return 0; }
+
+// =============================================================================
+// flash_helper
+// =============================================================================
+
+uint8_t* flash_helper_code_data(int ind) { return 0; }
+uint16_t flash_helper_code_flags(int ind) { return 0; }
+uint32_t flash_helper_code_size(int ind) { return 0; }
+uint16_t flash_helper_erase_bootloader(void) { return 0; }
+uint16_t flash_helper_erase_code(int ind) { return 0; }
+uint16_t flash_helper_erase_new_app(uint32_t new_app_size) { return 0; }
+void flash_helper_jump_to_bootloader(void) {}
+uint16_t flash_helper_write_code(int ind, uint32_t offset, uint8_t *data, uint32_t len) { return 0; }
+uint16_t flash_helper_write_new_app_data(uint32_t offset, uint8_t *data, uint32_t len) { return 0; }
+
+// =============================================================================
+// foc_stage_prof
+// =============================================================================
+
+bool foc_stage_prof_enabled(void) { return false; }
+void foc_stage_prof_get_info(int motor, foc_stage_prof_info_t *info) {}
+void foc_stage_prof_get_stats(int motor, foc_stage_t stage, foc_stage_stats_t *stats) {}
+void foc_stage_prof_process(void) {}
+void foc_stage_prof_reset(void) {}
+
+// =============================================================================
+// imu
+// =============================================================================
+
+void imu_get_accel(float *accel) {}
+void imu_get_calibration(float yaw, float * imu_cal) {}
+void imu_get_gyro(float *gyro) {}
+void imu_get_mag(float *mag) {}
+void imu_get_quaternions(float *q) {}
+void imu_get_rpy(float *rpy) {}
+
+// =============================================================================
+// lispif
+// =============================================================================
+
+// lispif.h needs the LispBM tree, commands.c uses this one without it
+char *lispif_print_prefix(void);
+char* lispif_print_prefix(void) { return ""; }
+
+// =============================================================================
+// main
+// =============================================================================
+
+uint32_t main_calc_hw_crc(void) { return 0; }
+bool main_init_done(void) { return false; }
+
+// =============================================================================
+// mc_interface
+// =============================================================================
+
+float mc_interface_get_amp_hours(bool reset) { return 0.0f; }
+float mc_interface_get_amp_hours_charged(bool reset) { return 0.0f; }
+float mc_interface_get_battery_level(float *wh_left) { return 0.0f; }
+const volatile mc_configuration* mc_interface_get_configuration(void) { return &m_mcconf; }
+float mc_interface_get_distance(void) { return 0.0f; }
+float mc_interface_get_distance_abs(void) { return 0.0f; }
+float mc_interface_get_duty_cycle_now(void) { return 0.0f; }
+mc_fault_code mc_interface_get_fault(void) { return 0; }
+float mc_interface_get_input_voltage_filtered(void) { return 0.0f; }
+int mc_interface_get_motor_thread(void) { return 0; }
+uint64_t mc_interface_get_odometer(void) { return 0; }
+float mc_interface_get_pid_pos_now(void) { return 0.0f; }
+float mc_interface_get_rpm(void) { return 0.0f; }
+setup_values mc_interface_get_setup_values(void) { setup_values r; memset(&r, 0, sizeof(r)); return r; }
+float mc_interface_get_speed(void) { return 0.0f; }
+int mc_interface_get_tachometer_abs_value(bool reset) { return 0; }
+int mc_interface_get_tachometer_value(bool reset) { return 0; }
+float mc_interface_get_watt_hours(bool reset) { return 0.0f; }
+float mc_interface_get_watt_hours_charged(bool reset) { return 0.0f; }
+volatile gnss_data *mc_interface_gnss(void) { return 0; }
+void mc_interface_ignore_input_both(int time_ms) {}
+float mc_interface_read_reset_avg_id(void) { return 0.0f; }
+float mc_interface_read_reset_avg_input_current(void) { return 0.0f; }
+float mc_interface_read_reset_avg_iq(void) { return 0.0f; }
+float mc_interface_read_reset_avg_motor_current(void) { return 0.0f; }
+float mc_interface_read_reset_avg_vd(void) { return 0.0f; }
+float mc_interface_read_reset_avg_vq(void) { return 0.0f; }
+void mc_interface_release_motor(void) {}
+void mc_interface_release_motor_override_both(void) {}
+void mc_interface_sample_print_data(debug_sampling_mode mode, uint16_t len,
+        uint8_t decimation, bool raw, uint16_t channels,
+        void(*reply_func)(unsigned char *data, unsigned int len)) {}
+void mc_interface_select_motor_thread(int motor) {}
+void mc_interface_set_brake_current(float current) {}
+void mc_interface_set_configuration(mc_configuration *configuration) {}
+void mc_interface_set_current(float current) {}
+void mc_interface_set_current_rel(float val) {}
+void mc_interface_set_duty(float dutyCycle) {}
+void mc_interface_set_handbrake(float current) {}
+void mc_interface_set_odometer(uint64_t new_odometer_meters) {}
+void mc_interface_set_pid_pos(float pos) {}
+void mc_interface_set_pid_speed(float rpm) {}
+float mc_interface_stat_count_time(void) { return 0.0f; }
+float mc_interface_stat_current_avg(void) { return 0.0f; }
+float mc_interface_stat_current_max(void) { return 0.0f; }
+float mc_interface_stat_power_avg(void) { return 0.0f; }
+float mc_interface_stat_power_max(void) { return 0.0f; }
+void mc_interface_stat_reset(void) {}
+float mc_interface_stat_speed_avg(void) { return 0.0f; }
+float mc_interface_stat_speed_max(void) { return 0.0f; }
+float mc_interface_stat_temp_mosfet_avg(void) { return 0.0f; }
+float mc_interface_stat_temp_mosfet_max(void) { return 0.0f; }
+float mc_interface_stat_temp_motor_avg(void) { return 0.0f; }
+float mc_interface_stat_temp_motor_max(void) { return 0.0f; }
+float mc_interface_temp_fet_filtered(void) { return 0.0f; }
+float mc_interface_temp_motor_filtered(void) { return 0.0f; }
+
+// =============================================================================
+// mcpwm_foc
+// =============================================================================
+
+int mcpwm_foc_encoder_detect(float current, bool print, float *offset, float *ratio,
+        bool *inverted) { return 0; }
+int mcpwm_foc_hall_detect(float current, uint8_t *hall_table, bool *result) { return 0; }
+int mcpwm_foc_measure_res_ind(float *res, float *ind, float *ld_lq_diff) { return 0; }
+
+// =============================================================================
+// mcpwm
+// =============================================================================
+
+void mcpwm_set_detect(void) {}
+
+// =============================================================================
+// nrf_driver
+// =============================================================================
+
+bool nrf_driver_ext_nrf_running(void) { return false; }
+void nrf_driver_init_ext_nrf(void) {}
+bool nrf_driver_is_pairing(void) { return false; }
+void nrf_driver_pause(int ms) {}
+void nrf_driver_process_packet(unsigned char *buf, unsigned char len) {}
+void nrf_driver_start_pairing(int ms) {}
+
+// =============================================================================
+// pwm_servo
+// =============================================================================
+
+void pwm_servo_set_servo_out(float output) {}
+
+// =============================================================================
+// servo_dec
+// =============================================================================
+
+float servodec_get_last_pulse_len(int servo_num) { return 0.0f; }
+
+// =============================================================================
+// terminal
+// =============================================================================
+
+void terminal_process_string(char *str) {}
+
+// =============================================================================
+// timeout
+// =============================================================================
+
+void timeout_configure(systime_t timeout, float brake_current, KILL_SW_MODE kill_sw_mode) {}
+bool timeout_has_timeout(void) { return false; }
+bool timeout_kill_sw_active(void) { return false; }
+void timeout_reset(void) {}
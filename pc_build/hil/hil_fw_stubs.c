@@ -0,0 +1,234 @@
+/**
+ * @file hil_fw_stubs.c
+ * @brief Firmware modules around mcpwm_foc.c, reduced for the PC HIL build
+ *
+ * mcpwm_foc.c is linked together with these instead of mc_interface.c,
+ * timeout.c, terminal.c, commands.c and the encoder driver. The ADC sample
+ * buffer lives here and is written by foc_hil.c before each ISR call.
+ * Faults reported by the ISR are latched and stop the PWM, like the real
+ * mc_interface_fault_stop() does. The ISR hook of mc_interface only feeds
+ * the pre-trigger capture, the same way as mc_interface_mc_timer_isr().
+ */
+
+#include <stdarg.h>
+#include <string.h>
+#include "conf_general.h"
+#include "mc_interface.h"
+#include "mcpwm_foc.h"
+#include "terminal.h"
+#include "commands.h"
+#include "timeout.h"
+#include "encoder/encoder.h"
+#include "virtual_motor.h"
+#include "foc_hil.h"
+
+// =============================================================================
+// Shared Variables
+// =============================================================================
+
+volatile uint16_t ADC_Value[HW_ADC_CHANNELS + HW_ADC_CHANNELS_EXTRA];
+volatile float ADC_curr_norm_value[6];
+volatile float ADC_curr_raw[6];
+volatile backup_data g_backup;
+
+// =============================================================================
+// Private Variables
+// =============================================================================
+
+static volatile mc_fault_code m_fault_now = FAULT_CODE_NONE;
+static volatile int m_fault_cnt = 0;
+static int16_t m_capture_buffer[2048];
+static mc_capture_t m_capture;
+static bool m_capture_init_done = false;
+
+// Private functions
+static void read_capture_channels(uint16_t channels, float current, float t_samp,
+        int decimation, int16_t *ch);
+
+// =============================================================================
+// mc_interface
+// =============================================================================
+
+void mc_interface_fault_stop(mc_fault_code fault, bool is_second_motor, bool is_isr) {
+    (void)is_isr;
+
+    if (fault == FAULT_CODE_NONE) {
+        return;
+    }
+
+    m_fault_now = fault;
+    m_fault_cnt++;
+    mc_capture_fault(&m_capture, fault);
+    mcpwm_foc_stop_pwm(is_second_motor);
+}
+
+mc_fault_code mc_interface_get_fault(void) {
+    return m_fault_now;
+}
+
+float mc_interface_get_input_voltage_filtered(void) {
+    return GET_INPUT_VOLTAGE();
+}
+
+float mc_interface_temp_fet_filtered(void) {
+    return NTC_TEMP(ADC_IND_TEMP_MOS);
+}
+
+float mc_interface_temp_motor_filtered(void) {
+    return NTC_TEMP_MOTOR(0);
+}
+
+void mc_interface_lock(void) {}
+void mc_interface_unlock(void) {}
+void mc_interface_mc_timer_isr(bool is_second_motor) {
+    // Only the decimated samples of a recording capture read the channels
+    const float t_samp = 1.0f / mcpwm_foc_get_sampling_frequency_now();
+    if (!mc_capture_tick(&m_capture, t_samp)) {
+        return;
+    }
+
+    int16_t ch[DEBUG_SAMPLING_CH_NUM];
+    read_capture_channels(m_capture.conf.channels, mcpwm_foc_get_tot_current_motor(is_second_motor),
+            t_samp, m_capture.conf.decimation, ch);
+
+    mc_capture_input in;
+    in.current = mcpwm_foc_get_abs_motor_current_motor(is_second_motor);
+    in.dt = t_samp;
+    in.erpm = mcpwm_foc_get_rpm_fast();
+    in.angle = mcpwm_foc_get_phase_observer();
+
+    mc_capture_write(&m_capture, ch, &in);
+}
+
+bool foc_hil_capture_arm(const mc_capture_config *conf) {
+    if (!m_capture_init_done) {
+        mc_capture_init(&m_capture, m_capture_buffer, sizeof(m_capture_buffer) / sizeof(int16_t));
+        m_capture_init_done = true;
+    }
+
+    mc_capture_disarm(&m_capture);
+    return mc_capture_arm(&m_capture, conf);
+}
+
+void foc_hil_capture_disarm(void) {
+    mc_capture_disarm(&m_capture);
+}
+
+const mc_capture_t *foc_hil_capture(void) {
+    return &m_capture;
+}
+
+// read_sample_channels() of mc_interface.c for one FOC motor without halls
+static void read_capture_channels(uint16_t channels, float current, float t_samp,
+        int decimation, int16_t *ch) {
+    const uint16_t curr_mask = (1 << DEBUG_SAMPLING_CH_CURR0) | (1 << DEBUG_SAMPLING_CH_CURR1) |
+            (1 << DEBUG_SAMPLING_CH_CURR2);
+    const uint16_t ph_mask = (1 << DEBUG_SAMPLING_CH_PH1) | (1 << DEBUG_SAMPLING_CH_PH2) |
+            (1 << DEBUG_SAMPLING_CH_PH3);
+
+    int16_t zero = 0;
+    if (channels & (ph_mask | (1 << DEBUG_SAMPLING_CH_VZERO))) {
+        zero = (ADC_V_L1 + ADC_V_L2 + ADC_V_L3) / 3;
+    }
+
+    if (channels & (1 << DEBUG_SAMPLING_CH_PHASE)) {
+        ch[DEBUG_SAMPLING_CH_PHASE] = (uint8_t)(mcpwm_foc_get_phase() / 360.0 * 250.0);
+    }
+
+    if (channels & curr_mask) {
+        ch[DEBUG_SAMPLING_CH_CURR0] = ADC_curr_norm_value[0] * (8.0 / FAC_CURRENT);
+        ch[DEBUG_SAMPLING_CH_CURR1] = ADC_curr_norm_value[1] * (8.0 / FAC_CURRENT);
+        ch[DEBUG_SAMPLING_CH_CURR2] = ADC_curr_norm_value[2] * (8.0 / FAC_CURRENT);
+    }
+
+    if (channels & ph_mask) {
+        ch[DEBUG_SAMPLING_CH_PH1] = ADC_V_L1 - zero;
+        ch[DEBUG_SAMPLING_CH_PH2] = ADC_V_L2 - zero;
+        ch[DEBUG_SAMPLING_CH_PH3] = ADC_V_L3 - zero;
+    }
+
+    ch[DEBUG_SAMPLING_CH_VZERO] = zero;
+    ch[DEBUG_SAMPLING_CH_CURR_FIR] = (int16_t)(current * (8.0 / FAC_CURRENT));
+
+    if (channels & (1 << DEBUG_SAMPLING_CH_F_SW)) {
+        ch[DEBUG_SAMPLING_CH_F_SW] = (int16_t)(0.1 / t_samp / decimation);
+    }
+
+    if (channels & (1 << DEBUG_SAMPLING_CH_STATUS)) {
+        ch[DEBUG_SAMPLING_CH_STATUS] = 0;
+    }
+}
+
+void foc_hil_clear_fault(void) {
+    m_fault_now = FAULT_CODE_NONE;
+}
+
+int foc_hil_get_fault_count(void) {
+    return m_fault_cnt;
+}
+
+// =============================================================================
+// timeout / terminal / commands
+// =============================================================================
+
+void timeout_configure(systime_t timeout, float brake_current, KILL_SW_MODE kill_sw_mode) {
+    (void)timeout;
+    (void)brake_current;
+    (void)kill_sw_mode;
+}
+
+void timeout_reset(void) {}
+void timeout_feed_WDT(uint8_t index) { (void)index; }
+bool timeout_had_IWDG_reset(void) { return false; }
+systime_t timeout_get_timeout_msec(void) { return 0; }
+float timeout_get_brake_current(void) { return 0.0f; }
+KILL_SW_MODE timeout_get_kill_sw_mode(void) { return KILL_SW_MODE_DISABLED; }
+
+void terminal_register_command_callback(const char *command, const char *help,
+        const char *arg_names, void(*cbf)(int argc, const char **argv)) {
+    (void)command;
+    (void)help;
+    (void)arg_names;
+    (void)cbf;
+}
+
+int commands_printf(const char *format, ...) {
+    (void)format;
+    return 0;
+}
+
+void commands_init_plot(const char *namex, const char *namey) { (void)namex; (void)namey; }
+void commands_plot_add_graph(const char *name) { (void)name; }
+void commands_plot_set_graph(int graph) { (void)graph; }
+void commands_send_plot_points(float x, float y) { (void)x; (void)y; }
+
+uint8_t conf_general_calculate_deadtime(float deadtime_ns, float core_clock_freq) {
+    (void)deadtime_ns;
+    (void)core_clock_freq;
+    return 0;
+}
+
+// No motor model table in flash
+bool conf_general_read_motor_lut(motor_lut_data *lut, bool is_motor_2) {
+    (void)is_motor_2;
+    memset(lut, 0, sizeof(motor_lut_data));
+    return false;
+}
+
+void hw_setup_adc_channels(void) {}
+
+// =============================================================================
+// Encoder / firmware virtual motor (not used by the HIL)
+// =============================================================================
+
+encoder_type_t encoder_is_configured(void) { return ENCODER_TYPE_NONE; }
+// No encoder: behaves like encoder.c with ENCODER_TYPE_NONE
+bool encoder_index_found(void) { return true; }
+float encoder_read_deg(void) { return 0.0f; }
+float encoder_read_deg_multiturn(void) { return 0.0f; }
+
+void virtual_motor_init(volatile mc_configuration *conf) { (void)conf; }
+void virtual_motor_set_configuration(volatile mc_configuration *conf) { (void)conf; }
+void virtual_motor_int_handler(float v_alpha, float v_beta) { (void)v_alpha; (void)v_beta; }
+bool virtual_motor_is_connected(void) { return false; }
+float virtual_motor_get_angle_deg(void) { return 0.0f; }
@@ -0,0 +1,150 @@
+/**
+ * @file hil_spl.c
+ * @brief StdPeriph library replacement for the PC HIL build
+ *
+ * Implements the subset of the STM32F4 StdPeriph API used by
+ * motor/mcpwm_foc.c and driver/timer.c. Timer functions update the fields of
+ * the stub register blocks the same way the hardware library does, so that
+ * foc_hil.c can read back the period (ARR), compare values (CCRx), output
+ * compare modes (CCMRx) and output enables (CCER, BDTR) set by the firmware.
+ * ADC, DMA and RCC configuration has no effect on the PC.
+ */
+
+#include <string.h>
+#include "stm32f4xx_conf.h"
+
+#define BDTR_MOE        ((uint32_t)0x8000)
+#define CR1_CMS_MASK    ((uint32_t)0x0060)
+#define CR1_ARPE        ((uint32_t)0x0080)
+
+// =============================================================================
+// Private Functions
+// =============================================================================
+
+static volatile uint32_t *ccmr_reg(TIM_TypeDef *TIMx, uint16_t channel) {
+    return channel < TIM_Channel_3 ? &TIMx->CCMR1 : &TIMx->CCMR2;
+}
+
+static int ccmr_shift(uint16_t channel) {
+    return (channel & TIM_Channel_2) ? 8 : 0;
+}
+
+static void oc_init(TIM_TypeDef *TIMx, uint16_t channel, volatile uint32_t *ccr,
+        TIM_OCInitTypeDef *init) {
+    TIM_SelectOCxM(TIMx, channel, init->TIM_OCMode);
+    TIM_CCxCmd(TIMx, channel, init->TIM_OutputState ? TIM_CCx_Enable : TIM_CCx_Disable);
+    TIM_CCxNCmd(TIMx, channel, init->TIM_OutputNState ? TIM_CCxN_Enable : TIM_CCxN_Disable);
+    *ccr = init->TIM_Pulse;
+}
+
+// =============================================================================
+// TIM
+// =============================================================================
+
+void TIM_DeInit(TIM_TypeDef *TIMx) {
+    memset((void*)TIMx, 0, sizeof(TIM_TypeDef));
+}
+
+void TIM_TimeBaseInit(TIM_TypeDef *TIMx, TIM_TimeBaseInitTypeDef *init) {
+    TIMx->CR1 = (TIMx->CR1 & ~CR1_CMS_MASK) | (init->TIM_CounterMode & CR1_CMS_MASK);
+    TIMx->ARR = init->TIM_Period;
+    TIMx->PSC = init->TIM_Prescaler;
+    TIMx->RCR = init->TIM_RepetitionCounter;
+}
+
+void TIM_OC1Init(TIM_TypeDef *TIMx, TIM_OCInitTypeDef *init) {
+    oc_init(TIMx, TIM_Channel_1, &TIMx->CCR1, init);
+}
+
+void TIM_OC2Init(TIM_TypeDef *TIMx, TIM_OCInitTypeDef *init) {
+    oc_init(TIMx, TIM_Channel_2, &TIMx->CCR2, init);
+}
+
+void TIM_OC3Init(TIM_TypeDef *TIMx, TIM_OCInitTypeDef *init) {
+    oc_init(TIMx, TIM_Channel_3, &TIMx->CCR3, init);
+}
+
+void TIM_OC4Init(TIM_TypeDef *TIMx, TIM_OCInitTypeDef *init) {
+    oc_init(TIMx, TIM_Channel_4, &TIMx->CCR4, init);
+}
+
+void TIM_SelectOCxM(TIM_TypeDef *TIMx, uint16_t TIM_Channel, uint16_t TIM_OCMode) {
+    volatile uint32_t *ccmr = ccmr_reg(TIMx, TIM_Channel);
+    int shift = ccmr_shift(TIM_Channel);
+
+    // Like the library, the channel is disabled while the mode changes
+    TIMx->CCER &= ~((uint32_t)TIM_CCx_Enable << TIM_Channel);
+    *ccmr = (*ccmr & ~((uint32_t)0x70 << shift)) | ((uint32_t)(TIM_OCMode & 0x70) << shift);
+}
+
+void TIM_CCxCmd(TIM_TypeDef *TIMx, uint16_t TIM_Channel, uint16_t TIM_CCx) {
+    TIMx->CCER &= ~((uint32_t)TIM_CCx_Enable << TIM_Channel);
+    TIMx->CCER |= (uint32_t)TIM_CCx << TIM_Channel;
+}
+
+void TIM_CCxNCmd(TIM_TypeDef *TIMx, uint16_t TIM_Channel, uint16_t TIM_CCxN) {
+    TIMx->CCER &= ~((uint32_t)TIM_CCxN_Enable << TIM_Channel);
+    TIMx->CCER |= (uint32_t)TIM_CCxN << TIM_Channel;
+}
+
+void TIM_Cmd(TIM_TypeDef *TIMx, FunctionalState NewState) {
+    if (NewState != DISABLE) {
+        TIMx->CR1 |= TIM_CR1_CEN;
+    } else {
+        TIMx->CR1 &= ~TIM_CR1_CEN;
+    }
+}
+
+void TIM_CtrlPWMOutputs(TIM_TypeDef *TIMx, FunctionalState NewState) {
+    if (NewState != DISABLE) {
+        TIMx->BDTR |= BDTR_MOE;
+    } else {
+        TIMx->BDTR &= ~BDTR_MOE;
+    }
+}
+
+void TIM_ARRPreloadConfig(TIM_TypeDef *TIMx, FunctionalState NewState) {
+    if (NewState != DISABLE) {
+        TIMx->CR1 |= CR1_ARPE;
+    } else {
+        TIMx->CR1 &= ~CR1_ARPE;
+    }
+}
+
+void TIM_BDTRConfig(TIM_TypeDef *TIMx, TIM_BDTRInitTypeDef *init) {
+    TIMx->BDTR = (uint32_t)init->TIM_OSSRState | init->TIM_OSSIState |
+            init->TIM_LOCKLevel | init->TIM_DeadTime | init->TIM_Break |
+            init->TIM_BreakPolarity | init->TIM_AutomaticOutput;
+}
+
+void TIM_OC1PreloadConfig(TIM_TypeDef *TIMx, uint16_t TIM_OCPreload) { (void)TIMx; (void)TIM_OCPreload; }
+void TIM_OC2PreloadConfig(TIM_TypeDef *TIMx, uint16_t TIM_OCPreload) { (void)TIMx; (void)TIM_OCPreload; }
+void TIM_OC3PreloadConfig(TIM_TypeDef *TIMx, uint16_t TIM_OCPreload) { (void)TIMx; (void)TIM_OCPreload; }
+void TIM_OC4PreloadConfig(TIM_TypeDef *TIMx, uint16_t TIM_OCPreload) { (void)TIMx; (void)TIM_OCPreload; }
+void TIM_CCPreloadControl(TIM_TypeDef *TIMx, FunctionalState NewState) { (void)TIMx; (void)NewState; }
+void TIM_ITConfig(TIM_TypeDef *TIMx, uint16_t TIM_IT, FunctionalState NewState) { (void)TIMx; (void)TIM_IT; (void)NewState; }
+void TIM_GenerateEvent(TIM_TypeDef *TIMx, uint16_t TIM_EventSource) { (void)TIMx; (void)TIM_EventSource; }
+void TIM_SelectInputTrigger(TIM_TypeDef *TIMx, uint16_t src) { (void)TIMx; (void)src; }
+void TIM_SelectOutputTrigger(TIM_TypeDef *TIMx, uint16_t src) { (void)TIMx; (void)src; }
+void TIM_SelectSlaveMode(TIM_TypeDef *TIMx, uint16_t mode) { (void)TIMx; (void)mode; }
+void TIM_SelectMasterSlaveMode(TIM_TypeDef *TIMx, uint16_t mode) { (void)TIMx; (void)mode; }
+
+// =============================================================================
+// ADC / DMA / RCC
+// =============================================================================
+
+void ADC_DeInit(void) {}
+void ADC_Init(ADC_TypeDef *ADCx, ADC_InitTypeDef *init) { (void)ADCx; (void)init; }
+void ADC_CommonInit(ADC_CommonInitTypeDef *init) { (void)init; }
+void ADC_Cmd(ADC_TypeDef *ADCx, FunctionalState NewState) { (void)ADCx; (void)NewState; }
+void ADC_TempSensorVrefintCmd(FunctionalState NewState) { (void)NewState; }
+void ADC_MultiModeDMARequestAfterLastTransferCmd(FunctionalState NewState) { (void)NewState; }
+
+void DMA_DeInit(DMA_Stream_TypeDef *stream) { (void)stream; }
+void DMA_Init(DMA_Stream_TypeDef *stream, DMA_InitTypeDef *init) { (void)stream; (void)init; }
+void DMA_Cmd(DMA_Stream_TypeDef *stream, FunctionalState NewState) { (void)stream; (void)NewState; }
+void DMA_ITConfig(DMA_Stream_TypeDef *stream, uint32_t DMA_IT, FunctionalState NewState) { (void)stream; (void)DMA_IT; (void)NewState; }
+
+void RCC_AHB1PeriphClockCmd(uint32_t periph, FunctionalState NewState) { (void)periph; (void)NewState; }
+void RCC_APB1PeriphClockCmd(uint32_t periph, FunctionalState NewState) { (void)periph; (void)NewState; }
+void RCC_APB2PeriphClockCmd(uint32_t periph, FunctionalState NewState) { (void)periph; (void)NewState; }
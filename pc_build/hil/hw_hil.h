@@ -0,0 +1,142 @@
+/**
+ * @file hw_hil.h
+ * @brief Virtual hardware definition for the PC HIL build
+ *
+ * Selected through HW_HEADER when the real motor/mcpwm_foc.c is compiled
+ * for the host. Follows the layout of the hwconf board headers: the ADC
+ * vector is filled by foc_hil.c from the virtual motor model and the
+ * PWM compare registers of TIM1 are read back as the inverter duties.
+ */
+
+#ifndef HW_HIL_H_
+#define HW_HIL_H_
+
+#define HW_NAME					"PC_HIL"
+#define FW_NAME					"pc_hil"
+
+// HW properties
+#define HW_HAS_3_SHUNTS
+
+/*
+ * The CAN-bus is only there with HW_HIL_CAN, where the controller can send
+ * CAN-FD frames. Classic frames go to the ChibiOS CAN stubs, FD frames to
+ * hw_hil_can_fd_transmit, which the test that links comm_can.c defines.
+ */
+#ifdef HW_HIL_CAN
+#define HW_HAS_CAN_FD
+#define HW_CAN_FD_CLOCK			80000000
+#define HW_CAN_FD_SET_MODE(fd, brs, nominal, data)	hw_hil_can_fd_set_mode(fd, brs, nominal, data)
+#define HW_CAN_FD_TRANSMIT(eid, data, len)	hw_hil_can_fd_transmit(eid, data, len)
+#else
+#define HW_HAS_NO_CAN
+#endif
+
+// Macros
+#define LED_GREEN_GPIO			GPIOB
+#define LED_GREEN_PIN			0
+#define LED_RED_GPIO			GPIOB
+#define LED_RED_PIN				1
+
+#define LED_GREEN_ON()
+#define LED_GREEN_OFF()
+#define LED_RED_ON()
+#define LED_RED_OFF()
+
+/*
+ * ADC Vector
+ *
+ * 0:	CURR1
+ * 1:	CURR2
+ * 2:	CURR3
+ * 3:	SENS1
+ * 4:	SENS2
+ * 5:	SENS3
+ * 6:	VIN
+ * 7:	TEMP_MOS
+ * 8:	TEMP_MOTOR
+ * 9:	EXT
+ * 10:	EXT2
+ * 11:	VREFINT
+ */
+
+#define HW_ADC_CHANNELS			12
+#define HW_ADC_INJ_CHANNELS		3
+#define HW_ADC_NBR_CONV			4
+
+// ADC Indexes
+#define ADC_IND_CURR1			0
+#define ADC_IND_CURR2			1
+#define ADC_IND_CURR3			2
+#define ADC_IND_SENS1			3
+#define ADC_IND_SENS2			4
+#define ADC_IND_SENS3			5
+#define ADC_IND_VIN_SENS		6
+#define ADC_IND_TEMP_MOS		7
+#define ADC_IND_TEMP_MOTOR		8
+#define ADC_IND_EXT				9
+#define ADC_IND_EXT2			10
+#define ADC_IND_VREFINT			11
+
+// Component parameters
+#define V_REG					3.3
+#define VIN_R1					39000.0
+#define VIN_R2					2200.0
+#define CURRENT_AMP_GAIN		20.0
+#define CURRENT_SHUNT_RES		0.0005
+
+// Input voltage
+#define GET_INPUT_VOLTAGE()		((V_REG / 4095.0) * (float)ADC_Value[ADC_IND_VIN_SENS] * ((VIN_R1 + VIN_R2) / VIN_R2))
+
+// The harness writes temperatures directly in degrees C
+#define NTC_TEMP(adc_ind)		((float)ADC_Value[adc_ind])
+#define NTC_TEMP_MOTOR(beta)	((float)ADC_Value[ADC_IND_TEMP_MOTOR])
+
+// Voltage on ADC channel
+#define ADC_VOLTS(ch)			((float)ADC_Value[ch] / 4095.0 * V_REG)
+
+// Measurement macros
+#define ADC_V_L1				ADC_Value[ADC_IND_SENS1]
+#define ADC_V_L2				ADC_Value[ADC_IND_SENS2]
+#define ADC_V_L3				ADC_Value[ADC_IND_SENS3]
+#define ADC_V_ZERO				(ADC_Value[ADC_IND_VIN_SENS] / 2)
+
+// Hall sensors are not modelled
+#define READ_HALL1()			0
+#define READ_HALL2()			0
+#define READ_HALL3()			0
+
+// Hall/encoder pins
+#define HW_HALL_ENC_GPIO1		GPIOC
+#define HW_HALL_ENC_PIN1		6
+#define HW_HALL_ENC_GPIO2		GPIOC
+#define HW_HALL_ENC_PIN2		7
+#define HW_HALL_ENC_GPIO3		GPIOC
+#define HW_HALL_ENC_PIN3		8
+
+#define HW_DEAD_TIME_NSEC		200.0
+
+// Default setting overrides
+#ifndef MCCONF_DEFAULT_MOTOR_TYPE
+#define MCCONF_DEFAULT_MOTOR_TYPE		MOTOR_TYPE_FOC
+#endif
+
+// Setting limits
+#define HW_LIM_CURRENT			-150.0, 150.0
+#define HW_LIM_CURRENT_IN		-150.0, 150.0
+#define HW_LIM_CURRENT_ABS		0.0, 200.0
+#define HW_LIM_VIN				6.0, 94.0
+#define HW_LIM_ERPM				-200e3, 200e3
+#define HW_LIM_DUTY_MIN			0.0, 0.1
+#define HW_LIM_DUTY_MAX			0.0, 0.99
+#define HW_LIM_TEMP_FET			-40.0, 110.0
+
+#ifdef HW_HIL_CAN
+#include "ch.h"
+#include "comm_can_fd.h"
+
+// Functions
+void hw_hil_can_fd_set_mode(bool fd, bool brs, const can_fd_timing *nominal, const can_fd_timing *data);
+msg_t hw_hil_can_fd_transmit(uint32_t eid, const uint8_t *data, uint8_t len);
+#endif
+
+#endif /* HW_HIL_H_ */
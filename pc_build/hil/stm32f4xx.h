@@ -0,0 +1,49 @@
+/**
+ * @file stm32f4xx.h
+ * @brief Device header shim for the HIL build
+ *
+ * Lets the unmodified StdPeriph headers from ChibiOS_3.0.5/ext compile
+ * against the peripheral instances in stubs/stm32f4xx_pc.h.
+ */
+
+#ifndef HIL_STM32F4XX_H_
+#define HIL_STM32F4XX_H_
+
+#include "stm32f4xx_pc.h"
+
+// Same spelling as conf_general.h, which also defines it
+#undef SYSTEM_CORE_CLOCK
+#define SYSTEM_CORE_CLOCK			168000000
+
+typedef enum {
+    RESET = 0,
+    SET = !RESET
+} FlagStatus, ITStatus;
+
+typedef enum {
+    DISABLE = 0,
+    ENABLE = !DISABLE
+} FunctionalState;
+#define IS_FUNCTIONAL_STATE(STATE) (((STATE) == DISABLE) || ((STATE) == ENABLE))
+
+typedef enum {
+    ERROR = 0,
+    SUCCESS = !ERROR
+} ErrorStatus;
+
+typedef enum {
+    ADC_IRQn                = 18,
+    EXTI9_5_IRQn            = 23,
+    TIM1_CC_IRQn            = 27,
+    TIM2_IRQn               = 28,
+    TIM3_IRQn               = 29,
+    TIM4_IRQn               = 30,
+    TIM8_CC_IRQn            = 46
+} IRQn_Type;
+
+#define TIM_CR1_CEN         ((uint32_t)0x0001)
+#define TIM_CR1_UDIS        ((uint32_t)0x0002)
+#define TIM_CR1_DIR         ((uint32_t)0x0010)
+#define TIM_CR1_ARPE        ((uint32_t)0x0080)
+
+#endif /* HIL_STM32F4XX_H_ */
@@ -198,6 +198,13 @@ void foc_control_current(motor_all_state_t *motor, float dt) {
     foc_svm(mod_alpha, mod_beta, max_duty, FOC_PWM_PERIOD_DEFAULT,
             &duty1, &duty2, &duty3, &state->svm_sector);
     
+    // Latch duties in the motor state so that each simulation context can
+    // apply them to its own plant without going through the global callback
+    motor->m_duty1_next = (int)duty1;
+    motor->m_duty2_next = (int)duty2;
+    motor->m_duty3_next = (int)duty3;
+    motor->m_duty_next_set = true;
+    
     // Call PWM callback if set
     if (pwm_callback != NULL) {
         pwm_callback(duty1, duty2, duty3);
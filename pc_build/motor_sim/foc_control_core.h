@@ -53,7 +53,9 @@ void foc_update_measurements(motor_all_state_t *motor,
 
 /**
  * Run current control loop
- * Executes PI current controllers and calculates voltage commands
+ * Executes PI current controllers and calculates voltage commands.
+ * The resulting SVM duties are stored in m_duty1_next..m_duty3_next
+ * (m_duty_next_set is raised) and passed to the PWM callback, if any.
  * 
  * @param motor Pointer to motor state structure
  * @param dt Control period [s]
@@ -0,0 +1,316 @@
+/**
+ * @file inverter_model.c
+ * @brief Three-phase inverter and PWM plant model implementation
+ */
+
+#include "inverter_model.h"
+#include "utils_math.h"
+#include <string.h>
+#include <math.h>
+
+#define DEFAULT_V_DIODE     0.7f
+
+// Events closer than this in carrier phase are merged [fraction of a period]
+#define TAU_EPS             1e-9
+
+// Pole states
+#define POLE_LOW            0
+#define POLE_HIGH           1
+#define POLE_DEAD           2
+
+// Phase currents of the motor model, positive out of the inverter
+static void model_phase_currents(const virtual_motor_state_t *vm, float *i) {
+    float i_alpha = vm->cos_phi * vm->id - vm->sin_phi * vm->iq;
+    float i_beta = vm->sin_phi * vm->id + vm->cos_phi * vm->iq;
+
+    i[0] = i_alpha;
+    i[1] = -0.5f * i_alpha + SQRT3_BY_2 * i_beta;
+    i[2] = -i[0] - i[1];
+}
+
+// Dead time as a fraction of the PWM period
+static double dead_fraction(const inverter_state_t *inv) {
+    return (double)inv->cfg.dead_time * (double)inv->cfg.f_zv * 0.5;
+}
+
+static double wrap_tau(double tau) {
+    tau -= floor(tau);
+    return (tau >= 1.0) ? 0.0 : tau;
+}
+
+// Carrier phase since the commanded rising edge of a phase. Over one
+// period the phase is dead for [0, w), high for [w, d), dead again for
+// [d, d + w) and low for the rest.
+static double pole_offset(float d, double tau) {
+    return wrap_tau(tau + 0.5 * (double)d);
+}
+
+static int pole_state(float d, double w, double tau) {
+    if (d <= 0.0f) return POLE_LOW;
+    if (d >= 1.0f) return POLE_HIGH;
+
+    double u = pole_offset(d, tau);
+    if (u < w) return POLE_DEAD;
+    if (u < (double)d) return POLE_HIGH;
+    if (u < (double)d + w) return POLE_DEAD;
+    return POLE_LOW;
+}
+
+// During the dead time the diode of the low side conducts positive
+// current and the diode of the high side negative current
+static float pole_voltage(int state, float i, float v_bus, float v_diode) {
+    switch (state) {
+        case POLE_HIGH: return v_bus;
+        case POLE_LOW: return 0.0f;
+        default: return (i >= 0.0f) ? -v_diode : v_bus + v_diode;
+    }
+}
+
+// Clarke transform of the pole voltages. The common mode, including the
+// zero sequence added by foc_svm(), does not drive current.
+static void pole_to_alpha_beta(const float *v, float *v_alpha, float *v_beta) {
+    *v_alpha = (2.0f * v[0] - v[1] - v[2]) * (1.0f / 3.0f);
+    *v_beta = ONE_BY_SQRT3 * (v[1] - v[2]);
+}
+
+// Distance in carrier phase to the next event after tau, in (0, 1]
+static double event_distance(double event, double tau) {
+    double dist = event - tau;
+    while (dist <= TAU_EPS) dist += 1.0;
+    return dist;
+}
+
+static double next_switching_event(const inverter_state_t *inv, double w) {
+    double next = 1.0;
+
+    for (int k = 0; k < 3; k++) {
+        float d = inv->duty[k];
+        if (d <= 0.0f || d >= 1.0f) continue;
+
+        // Event offsets relative to the commanded rising edge
+        double u = pole_offset(d, inv->tau);
+        double edges[4] = {0.0, w, (double)d, (double)d + w};
+        for (int e = 0; e < 4; e++) {
+            double dist = event_distance(wrap_tau(edges[e]), u);
+            if (dist < next) next = dist;
+        }
+    }
+
+    return next;
+}
+
+static double next_sample_event(const inverter_state_t *inv) {
+    double next = event_distance(0.5, inv->tau);
+    if (inv->cfg.sample_v0_v7) {
+        double v7 = event_distance(0.0, inv->tau);
+        if (v7 < next) next = v7;
+    }
+    return next;
+}
+
+static float adc_convert(inverter_state_t *inv, float i, bool *saturated) {
+    if (inv->cfg.i_adc_max > 0.0f && fabsf(i) > inv->cfg.i_adc_max) {
+        i = copysignf(inv->cfg.i_adc_max, i);
+        *saturated = true;
+    }
+
+    if (inv->cfg.i_adc_lsb > 0.0f) {
+        i = roundf(i / inv->cfg.i_adc_lsb) * inv->cfg.i_adc_lsb;
+    }
+
+    return i;
+}
+
+static void take_sample(inverter_state_t *inv, const virtual_motor_state_t *vm) {
+    float i[3];
+    bool saturated = false;
+
+    model_phase_currents(vm, i);
+    for (int k = 0; k < 3; k++) {
+        inv->i_phase[k] = adc_convert(inv, i[k], &saturated);
+    }
+
+    // Same reconstruction as the firmware, from phases A and B
+    inv->i_alpha_meas = inv->i_phase[0];
+    inv->i_beta_meas = ONE_BY_SQRT3 * inv->i_phase[0] + TWO_BY_SQRT3 * inv->i_phase[1];
+
+    inv->samples++;
+    if (saturated) inv->adc_saturations++;
+}
+
+// Integrate the motor model over h with constant αβ voltage
+static void integrate(inverter_state_t *inv, virtual_motor_state_t *vm,
+                      virtual_motor_io_t *io, float v_alpha, float v_beta,
+                      float h, float model_dt) {
+    int n = (int)ceilf(h / model_dt - 1e-3f);
+    if (n < 1) n = 1;
+
+    io->v_alpha_in = v_alpha;
+    io->v_beta_in = v_beta;
+
+    float sub_h = h / (float)n;
+    for (int i = 0; i < n; i++) {
+        virtual_motor_pc_state_step(vm, io, sub_h);
+    }
+
+    inv->intervals++;
+}
+
+static void step_switching(inverter_state_t *inv, virtual_motor_state_t *vm,
+                           virtual_motor_io_t *io, float v_bus, float dt,
+                           float model_dt, double *va_sum, double *vb_sum) {
+    double T = (double)inverter_pwm_period(inv);
+    double w = dead_fraction(inv);
+    double remaining = (double)dt / T;
+
+    while (remaining > TAU_EPS) {
+        double len = next_switching_event(inv, w);
+        double sample = next_sample_event(inv);
+        bool at_sample = false;
+
+        if (remaining < len) len = remaining;
+        if (sample <= len + TAU_EPS) {
+            len = sample;
+            at_sample = true;
+        }
+
+        // Pole states are constant over the interval, look them up in the middle
+        double tau_mid = wrap_tau(inv->tau + 0.5 * len);
+        float i[3], v[3];
+        model_phase_currents(vm, i);
+        for (int k = 0; k < 3; k++) {
+            v[k] = pole_voltage(pole_state(inv->duty[k], w, tau_mid), i[k], v_bus, inv->cfg.v_diode);
+        }
+
+        float v_alpha, v_beta;
+        pole_to_alpha_beta(v, &v_alpha, &v_beta);
+
+        float h = (float)(len * T);
+        integrate(inv, vm, io, v_alpha, v_beta, h, model_dt);
+        *va_sum += (double)v_alpha * (double)h;
+        *vb_sum += (double)v_beta * (double)h;
+
+        inv->tau = wrap_tau(inv->tau + len);
+        remaining -= len;
+        if (at_sample) {
+            take_sample(inv, vm);
+        }
+    }
+}
+
+// Per-period average of the pole voltages. With positive phase current
+// the dead time after the rising edge keeps the phase on the low-side
+// diode, so the high time shrinks by w and the diode drop is applied for
+// w. Negative current gains w at the falling edge instead.
+static void step_averaged(inverter_state_t *inv, virtual_motor_state_t *vm,
+                          virtual_motor_io_t *io, float v_bus, float dt,
+                          float model_dt, double *va_sum, double *vb_sum) {
+    float w = (float)dead_fraction(inv);
+    int n = (int)ceilf(dt / model_dt - 1e-3f);
+    if (n < 1) n = 1;
+    float h = dt / (float)n;
+
+    for (int s = 0; s < n; s++) {
+        float i[3], v[3];
+        model_phase_currents(vm, i);
+        for (int k = 0; k < 3; k++) {
+            float d = inv->duty[k];
+            if (d <= 0.0f || d >= 1.0f) {
+                v[k] = (d >= 1.0f) ? v_bus : 0.0f;
+                continue;
+            }
+
+            float sign = (i[k] >= 0.0f) ? 1.0f : -1.0f;
+            float d_eff = d - sign * w;
+            utils_truncate_number(&d_eff, 0.0f, 1.0f);
+            v[k] = d_eff * v_bus - sign * fminf(w, 1.0f) * inv->cfg.v_diode;
+        }
+
+        float v_alpha, v_beta;
+        pole_to_alpha_beta(v, &v_alpha, &v_beta);
+        integrate(inv, vm, io, v_alpha, v_beta, h, h);
+        *va_sum += (double)v_alpha * (double)h;
+        *vb_sum += (double)v_beta * (double)h;
+    }
+
+    inv->tau = wrap_tau(inv->tau + (double)dt / (double)inverter_pwm_period(inv));
+    take_sample(inv, vm);
+}
+
+// ==== API Functions ====
+
+void inverter_default_config(inverter_config_t *cfg, const mc_configuration *conf) {
+    if (cfg == NULL || conf == NULL) return;
+
+    memset(cfg, 0, sizeof(inverter_config_t));
+    cfg->mode = INVERTER_MODE_SWITCHING;
+    cfg->f_zv = conf->foc_f_zv;
+    cfg->dead_time = conf->foc_dt_us * 1e-6f;
+    cfg->v_diode = DEFAULT_V_DIODE;
+    cfg->sample_v0_v7 = conf->foc_control_sample_mode != FOC_CONTROL_SAMPLE_MODE_V0;
+}
+
+void inverter_init(inverter_state_t *inv, const inverter_config_t *cfg) {
+    if (inv == NULL || cfg == NULL) return;
+
+    memset(inv, 0, sizeof(inverter_state_t));
+    inv->cfg = *cfg;
+    inverter_reset(inv);
+}
+
+void inverter_reset(inverter_state_t *inv) {
+    if (inv == NULL) return;
+
+    inv->duty[0] = inv->duty[1] = inv->duty[2] = 0.5f;
+    inv->tau = 0.5;
+
+    memset(inv->i_phase, 0, sizeof(inv->i_phase));
+    inv->i_alpha_meas = 0.0f;
+    inv->i_beta_meas = 0.0f;
+    inv->v_alpha_avg = 0.0f;
+    inv->v_beta_avg = 0.0f;
+
+    inv->samples = 0;
+    inv->adc_saturations = 0;
+    inv->intervals = 0;
+}
+
+float inverter_pwm_period(const inverter_state_t *inv) {
+    return 2.0f / inv->cfg.f_zv;
+}
+
+float inverter_sample_period(const inverter_state_t *inv) {
+    float T = inverter_pwm_period(inv);
+    return inv->cfg.sample_v0_v7 ? 0.5f * T : T;
+}
+
+void inverter_set_duty(inverter_state_t *inv, float d1, float d2, float d3) {
+    if (inv == NULL) return;
+
+    utils_truncate_number(&d1, 0.0f, 1.0f);
+    utils_truncate_number(&d2, 0.0f, 1.0f);
+    utils_truncate_number(&d3, 0.0f, 1.0f);
+
+    inv->duty[0] = d1;
+    inv->duty[1] = d2;
+    inv->duty[2] = d3;
+}
+
+void inverter_step(inverter_state_t *inv, virtual_motor_state_t *vm,
+                   virtual_motor_io_t *io, float v_bus, float dt, float model_dt) {
+    if (inv == NULL || vm == NULL || io == NULL || dt <= 0.0f) return;
+    if (model_dt <= 0.0f) model_dt = dt;
+
+    double va_sum = 0.0, vb_sum = 0.0;
+
+    if (inv->cfg.mode == INVERTER_MODE_SWITCHING) {
+        step_switching(inv, vm, io, v_bus, dt, model_dt, &va_sum, &vb_sum);
+    } else {
+        step_averaged(inv, vm, io, v_bus, dt, model_dt, &va_sum, &vb_sum);
+    }
+
+    inv->v_alpha_avg = (float)(va_sum / (double)dt);
+    inv->v_beta_avg = (float)(vb_sum / (double)dt);
+    io->v_alpha_in = inv->v_alpha_avg;
+    io->v_beta_in = inv->v_beta_avg;
+}
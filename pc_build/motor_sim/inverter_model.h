@@ -0,0 +1,135 @@
+/**
+ * @file inverter_model.h
+ * @brief Three-phase inverter and PWM plant model for the PC simulator
+ *
+ * Sits between the duties produced by foc_svm() and the motor model, so
+ * that the simulated plant sees what the power stage really applies
+ * instead of the commanded αβ voltage:
+ *
+ * - Center-aligned PWM at the period of the configured foc_f_zv
+ *   (TIM1 counts up and down, so one PWM period is 2 / foc_f_zv)
+ * - Dead time after every commanded edge, during which the phase voltage
+ *   is set by the freewheeling diode and the sign of the phase current
+ * - Phase currents sampled at the center of V0 (and of V7 with
+ *   foc_control_sample_mode != FOC_CONTROL_SAMPLE_MODE_V0), so that the
+ *   controller sees the switching ripple at the real sample instants
+ * - Phase-shunt range and ADC resolution of the current measurement
+ *
+ * Carrier convention (PWM mode 1): a phase is high while the counter is
+ * below its compare value. The carrier phase tau runs from 0 to 1 over
+ * one PWM period, with the counter at zero (center of V7) at tau = 0 and
+ * at the top (center of V0) at tau = 0.5.
+ *
+ * INVERTER_MODE_SWITCHING integrates the motor model piecewise between
+ * switching events. INVERTER_MODE_AVERAGED applies the per-period average
+ * of the same pole voltages, including the dead-time loss, and is meant
+ * for long runs where the ripple itself does not matter.
+ */
+
+#ifndef INVERTER_MODEL_H_
+#define INVERTER_MODEL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "virtual_motor_pc.h"
+#include "mcconf_stub.h"
+
+typedef enum {
+    INVERTER_MODE_AVERAGED = 0,     // Per-period average of the pole voltages
+    INVERTER_MODE_SWITCHING         // Piecewise integration between switching events
+} inverter_mode_e;
+
+// Inverter configuration
+typedef struct {
+    inverter_mode_e mode;
+    float f_zv;             // Zero vector frequency [Hz], PWM period is 2 / f_zv
+    float dead_time;        // Dead time [s]
+    float v_diode;          // Freewheeling diode forward voltage [V]
+    bool sample_v0_v7;      // Sample currents at V7 as well as at V0
+    float i_adc_max;        // Phase-shunt measurement range [A], 0 = unlimited
+    float i_adc_lsb;        // Current ADC resolution [A], 0 = ideal
+} inverter_config_t;
+
+// Inverter state
+typedef struct {
+    inverter_config_t cfg;
+
+    float duty[3];          // Latched duties [0-1]
+    double tau;             // Carrier phase [0-1)
+
+    // Last current sample
+    float i_phase[3];       // Measured phase currents [A]
+    float i_alpha_meas;     // Measured α current [A]
+    float i_beta_meas;      // Measured β current [A]
+
+    // Average αβ voltage applied during the last step [V]
+    float v_alpha_avg;
+    float v_beta_avg;
+
+    // Statistics
+    uint32_t samples;       // Current samples taken
+    uint32_t adc_saturations; // Samples with at least one phase clipped
+    uint32_t intervals;     // Motor model intervals integrated
+} inverter_state_t;
+
+// ==== API Functions ====
+
+/**
+ * @brief Configuration matching the PWM and sampling setup of conf
+ *
+ * Switching mode, 0.7 V diode drop, unlimited and ideal current ADC.
+ */
+void inverter_default_config(inverter_config_t *cfg, const mc_configuration *conf);
+
+/**
+ * @brief Initialize an inverter with a configuration
+ */
+void inverter_init(inverter_state_t *inv, const inverter_config_t *cfg);
+
+/**
+ * @brief Reset to the center of V0 with 50% duty on all phases
+ */
+void inverter_reset(inverter_state_t *inv);
+
+/**
+ * @brief PWM period [s]
+ */
+float inverter_pwm_period(const inverter_state_t *inv);
+
+/**
+ * @brief Time between two current samples [s]
+ *
+ * This is the control period of the firmware, i.e. what
+ * mcpwm_foc_get_ts() returns for the same configuration.
+ */
+float inverter_sample_period(const inverter_state_t *inv);
+
+/**
+ * @brief Latch new duties, normalized to the PWM period [0-1]
+ *
+ * Like the compare registers, the new values are used from the next
+ * switching event on.
+ */
+void inverter_set_duty(inverter_state_t *inv, float d1, float d2, float d3);
+
+/**
+ * @brief Advance the inverter and the motor model by dt
+ *
+ * The motor model is stepped with at most model_dt per call. In switching
+ * mode the currents are sampled whenever the carrier passes a sample
+ * instant, including one at the very end of the step, so with dt equal to
+ * inverter_sample_period() every step ends with a fresh sample. In
+ * averaged mode the sample is taken at the end of every step.
+ *
+ * @param inv Inverter
+ * @param vm Motor model
+ * @param io Motor model I/O. v_alpha_in and v_beta_in are left at the
+ *           average voltage of the step.
+ * @param v_bus DC bus voltage [V]
+ * @param dt Time to advance [s]
+ * @param model_dt Maximum motor model step [s]
+ */
+void inverter_step(inverter_state_t *inv, virtual_motor_state_t *vm,
+                   virtual_motor_io_t *io, float v_bus, float dt, float model_dt);
+
+#endif // INVERTER_MODEL_H_
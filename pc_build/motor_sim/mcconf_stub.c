@@ -136,7 +136,7 @@ void mcconf_set_defaults(mc_configuration *conf) {
     conf->foc_fw_q_current_factor = 0.02f;
     conf->foc_speed_soure = FOC_SPEED_SRC_CORRECTED;
     conf->foc_short_ls_on_zero_duty = false;
-    conf->foc_overmod_factor = 0.0f;
+    conf->foc_overmod_factor = 1.0f;
     
     // =========================================================================
     // Speed PID
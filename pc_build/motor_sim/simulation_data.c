@@ -8,6 +8,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
+#include <limits.h>
 
 // File handles
 static FILE *write_file = NULL;
@@ -15,6 +16,36 @@ static FILE *read_file = NULL;
 static sim_data_format_e current_format = SIM_FORMAT_CSV;
 static bool header_written = false;
 
+// Columnar traces. The writer is created on the first record, once it is
+// known whether base or extended records are written.
+static char trace_path[512];
+static sim_trace_writer_t *trace_writer = NULL;
+static int trace_columns = 0;
+static sim_trace_t *trace_reader = NULL;
+static int trace_read_chunk = 0;
+static uint32_t trace_read_pos = 0;
+static const float *trace_read_cols[SIM_DATA_NUM_FIELDS];
+
+static const char * const field_names[SIM_DATA_NUM_FIELDS_EXT] = {
+    "time", "id", "iq", "vd", "vq", "theta_e", "omega_e", "omega_m", "torque",
+    "ia", "ib", "ic", "va", "vb", "vc", "p_in", "p_out", "p_loss",
+    "temp_motor", "mod_d", "mod_q"
+};
+
+const char *sim_data_field_name(int field) {
+    if (field < 0 || field >= SIM_DATA_NUM_FIELDS_EXT) return NULL;
+    return field_names[field];
+}
+
+int sim_data_find_field(const char *name) {
+    if (name == NULL) return -1;
+    
+    for (int i = 0; i < SIM_DATA_NUM_FIELDS_EXT; i++) {
+        if (strcmp(field_names[i], name) == 0) return i;
+    }
+    return -1;
+}
+
 // Detect format from filename
 static sim_data_format_e detect_format(const char *filename) {
     const char *ext = strrchr(filename, '.');
@@ -24,18 +55,32 @@ static sim_data_format_e detect_format(const char *filename) {
         return SIM_FORMAT_BINARY;
     } else if (strcmp(ext, ".json") == 0) {
         return SIM_FORMAT_JSON;
+    } else if (strcmp(ext, ".simt") == 0) {
+        return SIM_FORMAT_COLUMNAR;
     }
     return SIM_FORMAT_CSV;
 }
 
 int sim_data_open_write(const char *filename) {
-    if (write_file != NULL) {
-        fclose(write_file);
-    }
+    sim_data_close();
     
     current_format = detect_format(filename);
     header_written = false;
     
+    if (current_format == SIM_FORMAT_COLUMNAR) {
+        // Check that the file can be created, the header follows with the first record
+        if (strlen(filename) >= sizeof(trace_path)) {
+            return -1;
+        }
+        FILE *f = fopen(filename, "wb");
+        if (f == NULL) {
+            return -1;
+        }
+        fclose(f);
+        strcpy(trace_path, filename);
+        return 0;
+    }
+    
     if (current_format == SIM_FORMAT_BINARY) {
         write_file = fopen(filename, "wb");
     } else {
@@ -56,7 +101,24 @@ static void write_csv_header(void) {
     header_written = true;
 }
 
+static int trace_write_row(const float *row, int num_columns) {
+    if (trace_writer == NULL) {
+        if (trace_path[0] == '\0') return -1;
+        trace_writer = sim_trace_writer_open(trace_path, num_columns, field_names, NULL);
+        if (trace_writer == NULL) return -1;
+        trace_path[0] = '\0';
+        trace_columns = num_columns;
+    } else if (num_columns != trace_columns) {
+        return -1;  // Base and extended records cannot be mixed in one trace
+    }
+    
+    return sim_trace_writer_append(trace_writer, row);
+}
+
 int sim_data_write_record(sim_data_record_t *rec) {
+    if (current_format == SIM_FORMAT_COLUMNAR && rec != NULL) {
+        return trace_write_row((const float*)rec, SIM_DATA_NUM_FIELDS);
+    }
     if (write_file == NULL || rec == NULL) return -1;
     
     if (current_format == SIM_FORMAT_CSV) {
@@ -74,6 +136,9 @@ int sim_data_write_record(sim_data_record_t *rec) {
 }
 
 int sim_data_write_record_ext(sim_data_record_ext_t *rec) {
+    if (current_format == SIM_FORMAT_COLUMNAR && rec != NULL) {
+        return trace_write_row((const float*)rec, SIM_DATA_NUM_FIELDS_EXT);
+    }
     if (write_file == NULL || rec == NULL) return -1;
     
     if (current_format == SIM_FORMAT_CSV) {
@@ -105,16 +170,36 @@ void sim_data_close(void) {
         fclose(write_file);
         write_file = NULL;
     }
+    if (trace_writer != NULL) {
+        sim_trace_writer_close(trace_writer);
+        trace_writer = NULL;
+    } else if (trace_path[0] != '\0') {
+        // Nothing was recorded, still leave a valid (empty) trace behind
+        sim_trace_writer_close(sim_trace_writer_open(trace_path, SIM_DATA_NUM_FIELDS,
+                                                     field_names, NULL));
+    }
+    trace_path[0] = '\0';
     header_written = false;
 }
 
 int sim_data_open_read(const char *filename) {
-    if (read_file != NULL) {
-        fclose(read_file);
-    }
+    sim_data_close_read();
     
     current_format = detect_format(filename);
     
+    if (current_format == SIM_FORMAT_COLUMNAR) {
+        trace_reader = sim_trace_open(filename);
+        if (trace_reader == NULL || sim_trace_num_columns(trace_reader) < SIM_DATA_NUM_FIELDS) {
+            sim_data_close_read();
+            return -1;
+        }
+        trace_read_chunk = 0;
+        trace_read_pos = 0;
+        memset(trace_read_cols, 0, sizeof(trace_read_cols));
+        uint64_t n = sim_trace_num_records(trace_reader);
+        return n > INT_MAX ? INT_MAX : (int)n;
+    }
+    
     if (current_format == SIM_FORMAT_BINARY) {
         read_file = fopen(filename, "rb");
     } else {
@@ -146,7 +231,36 @@ int sim_data_open_read(const char *filename) {
     return 0;  // Unknown count for CSV
 }
 
+static int trace_read_record(sim_data_record_t *rec) {
+    while (trace_read_cols[0] == NULL ||
+           trace_read_pos >= sim_trace_chunk_records(trace_reader, trace_read_chunk)) {
+        if (trace_read_cols[0] != NULL) {
+            sim_trace_release_chunk(trace_reader, trace_read_chunk);
+            trace_read_chunk++;
+            trace_read_pos = 0;
+        }
+        if (trace_read_chunk >= sim_trace_num_chunks(trace_reader)) {
+            return 1;  // EOF
+        }
+        for (int j = 0; j < SIM_DATA_NUM_FIELDS; j++) {
+            trace_read_cols[j] = sim_trace_column(trace_reader, trace_read_chunk, j);
+            if (trace_read_cols[j] == NULL) return -1;
+        }
+    }
+    
+    float *vals = (float*)rec;
+    for (int j = 0; j < SIM_DATA_NUM_FIELDS; j++) {
+        vals[j] = trace_read_cols[j][trace_read_pos];
+    }
+    trace_read_pos++;
+    
+    return 0;
+}
+
 int sim_data_read_record(sim_data_record_t *rec) {
+    if (trace_reader != NULL && rec != NULL) {
+        return trace_read_record(rec);
+    }
     if (read_file == NULL || rec == NULL) return -1;
     
     if (current_format == SIM_FORMAT_CSV) {
@@ -171,7 +285,7 @@ int sim_data_read_record(sim_data_record_t *rec) {
 }
 
 int sim_data_read_all(sim_data_record_t *records, int max_records) {
-    if (read_file == NULL || records == NULL) return -1;
+    if ((read_file == NULL && trace_reader == NULL) || records == NULL) return -1;
     
     int count = 0;
     while (count < max_records) {
@@ -188,6 +302,10 @@ void sim_data_close_read(void) {
         fclose(read_file);
         read_file = NULL;
     }
+    if (trace_reader != NULL) {
+        sim_trace_close(trace_reader);
+        trace_reader = NULL;
+    }
 }
 
 int sim_data_export_csv(const char *input_file, const char *output_file) {
@@ -215,45 +333,110 @@ int sim_data_export_csv(const char *input_file, const char *output_file) {
     return 0;
 }
 
+// Running statistics (Welford), accumulated in double so that traces with
+// billions of samples do not lose precision.
+typedef struct {
+    uint64_t count;
+    float min_value;
+    float max_value;
+    double mean;
+    double m2;
+    double sum_sq;
+} stats_acc_t;
+
+static void stats_acc_init(stats_acc_t *acc) {
+    memset(acc, 0, sizeof(*acc));
+}
+
+static inline void stats_acc_add(stats_acc_t *acc, float v) {
+    if (acc->count == 0) {
+        acc->min_value = v;
+        acc->max_value = v;
+    }
+    if (v < acc->min_value) acc->min_value = v;
+    if (v > acc->max_value) acc->max_value = v;
+    
+    acc->count++;
+    double delta = (double)v - acc->mean;
+    acc->mean += delta / (double)acc->count;
+    acc->m2 += delta * ((double)v - acc->mean);
+    acc->sum_sq += (double)v * (double)v;
+}
+
+static int stats_acc_finish(const stats_acc_t *acc, sim_data_stats_t *stats) {
+    if (acc->count == 0) return -1;
+    
+    stats->min_value = acc->min_value;
+    stats->max_value = acc->max_value;
+    stats->mean_value = (float)acc->mean;
+    stats->rms_value = (float)sqrt(acc->sum_sq / (double)acc->count);
+    stats->std_dev = (float)sqrt(acc->m2 / (double)acc->count);
+    
+    return 0;
+}
+
 int sim_data_calc_stats(sim_data_record_t *records, int count,
                         int field_offset, sim_data_stats_t *stats) {
     if (records == NULL || stats == NULL || count <= 0) return -1;
     
-    // Get pointer to field using offset
-    float *first_value = (float*)((char*)&records[0] + field_offset);
-    
-    stats->min_value = *first_value;
-    stats->max_value = *first_value;
-    stats->mean_value = 0.0f;
-    stats->rms_value = 0.0f;
-    
-    float sum = 0.0f;
-    float sum_sq = 0.0f;
+    stats_acc_t acc;
+    stats_acc_init(&acc);
     
     for (int i = 0; i < count; i++) {
+        // Get pointer to field using offset
         float *value = (float*)((char*)&records[i] + field_offset);
-        float v = *value;
-        
-        if (v < stats->min_value) stats->min_value = v;
-        if (v > stats->max_value) stats->max_value = v;
-        
-        sum += v;
-        sum_sq += v * v;
+        stats_acc_add(&acc, *value);
     }
     
-    stats->mean_value = sum / (float)count;
-    stats->rms_value = sqrtf(sum_sq / (float)count);
+    return stats_acc_finish(&acc, stats);
+}
+
+int sim_data_calc_stats_trace(sim_trace_t *trace, int column,
+                              sim_data_stats_t *stats) {
+    if (trace == NULL || stats == NULL ||
+        column < 0 || column >= sim_trace_num_columns(trace)) return -1;
     
-    // Calculate standard deviation
-    float var_sum = 0.0f;
-    for (int i = 0; i < count; i++) {
-        float *value = (float*)((char*)&records[i] + field_offset);
-        float diff = *value - stats->mean_value;
-        var_sum += diff * diff;
+    stats_acc_t acc;
+    stats_acc_init(&acc);
+    
+    for (int c = 0; c < sim_trace_num_chunks(trace); c++) {
+        const float *vals = sim_trace_column(trace, c, column);
+        if (vals == NULL) return -1;
+        
+        uint32_t n = sim_trace_chunk_records(trace, c);
+        for (uint32_t i = 0; i < n; i++) {
+            stats_acc_add(&acc, vals[i]);
+        }
+        sim_trace_release_chunk(trace, c);
     }
-    stats->std_dev = sqrtf(var_sum / (float)count);
     
-    return 0;
+    return stats_acc_finish(&acc, stats);
+}
+
+// Default tolerances if not provided
+static const float default_tol[SIM_DATA_NUM_FIELDS] = {
+    0.0001f,  // time
+    0.1f,     // id
+    0.1f,     // iq
+    0.5f,     // vd
+    0.5f,     // vq
+    0.01f,    // theta_e
+    1.0f,     // omega_e
+    1.0f,     // omega_m
+    0.01f     // torque
+};
+
+// Checks one value and prints it if it is out of tolerance.
+// Returns true when the error limit has been reached.
+static bool compare_value(uint64_t record, int field, float ref, float test,
+                          const float *tol, int *errors, int max_errors) {
+    float diff = fabsf(ref - test);
+    if (diff > tol[field]) {
+        printf("Mismatch at record %llu, field %d: ref=%.6f, test=%.6f, diff=%.6f\n",
+               (unsigned long long)record, field, ref, test, diff);
+        (*errors)++;
+    }
+    return *errors >= max_errors;
 }
 
 int sim_data_compare(sim_data_record_t *ref, 
@@ -264,34 +447,80 @@ int sim_data_compare(sim_data_record_t *ref,
     if (ref == NULL || test == NULL || count <= 0) return -1;
     
     int errors = 0;
-    
-    // Default tolerances if not provided
-    float default_tol[9] = {
-        0.0001f,  // time
-        0.1f,     // id
-        0.1f,     // iq
-        0.5f,     // vd
-        0.5f,     // vq
-        0.01f,    // theta_e
-        1.0f,     // omega_e
-        1.0f,     // omega_m
-        0.01f     // torque
-    };
-    float *tol = tolerances ? tolerances : default_tol;
+    const float *tol = tolerances ? tolerances : default_tol;
     
     for (int i = 0; i < count && errors < max_errors; i++) {
         float *ref_vals = (float*)&ref[i];
         float *test_vals = (float*)&test[i];
         
-        for (int j = 0; j < 9; j++) {
-            float diff = fabsf(ref_vals[j] - test_vals[j]);
-            if (diff > tol[j]) {
-                printf("Mismatch at record %d, field %d: ref=%.6f, test=%.6f, diff=%.6f\n",
-                       i, j, ref_vals[j], test_vals[j], diff);
-                errors++;
-                if (errors >= max_errors) break;
+        for (int j = 0; j < SIM_DATA_NUM_FIELDS; j++) {
+            if (compare_value((uint64_t)i, j, ref_vals[j], test_vals[j],
+                              tol, &errors, max_errors)) {
+                break;
+            }
+        }
+    }
+    
+    return errors;
+}
+
+int sim_data_compare_trace(sim_trace_t *ref,
+                           sim_trace_t *test,
+                           float *tolerances,
+                           int max_errors) {
+    if (ref == NULL || test == NULL ||
+        sim_trace_num_columns(ref) < SIM_DATA_NUM_FIELDS ||
+        sim_trace_num_columns(test) < SIM_DATA_NUM_FIELDS) return -1;
+    
+    uint64_t count = sim_trace_num_records(ref);
+    if (sim_trace_num_records(test) < count) {
+        count = sim_trace_num_records(test);
+    }
+    if (count == 0) return -1;
+    
+    int errors = 0;
+    const float *tol = tolerances ? tolerances : default_tol;
+    
+    // Walk both traces in spans that lie within one chunk of each
+    int rc = 0, tc = 0;
+    uint32_t rpos = 0, tpos = 0;
+    uint64_t record = 0;
+    
+    while (record < count && errors < max_errors) {
+        uint32_t rn = sim_trace_chunk_records(ref, rc);
+        uint32_t tn = sim_trace_chunk_records(test, tc);
+        uint32_t span = rn - rpos;
+        if (tn - tpos < span) span = tn - tpos;
+        if ((uint64_t)span > count - record) span = (uint32_t)(count - record);
+        
+        const float *rv[SIM_DATA_NUM_FIELDS];
+        const float *tv[SIM_DATA_NUM_FIELDS];
+        for (int j = 0; j < SIM_DATA_NUM_FIELDS; j++) {
+            rv[j] = sim_trace_column(ref, rc, j);
+            tv[j] = sim_trace_column(test, tc, j);
+            if (rv[j] == NULL || tv[j] == NULL) return -1;
+        }
+        
+        for (uint32_t i = 0; i < span && errors < max_errors; i++) {
+            for (int j = 0; j < SIM_DATA_NUM_FIELDS; j++) {
+                if (compare_value(record + i, j, rv[j][rpos + i], tv[j][tpos + i],
+                                  tol, &errors, max_errors)) {
+                    break;
+                }
             }
         }
+        
+        record += span;
+        rpos += span;
+        tpos += span;
+        if (rpos == rn) {
+            sim_trace_release_chunk(ref, rc++);
+            rpos = 0;
+        }
+        if (tpos == tn) {
+            sim_trace_release_chunk(test, tc++);
+            tpos = 0;
+        }
     }
     
     return errors;
@@ -4,6 +4,11 @@
  * 
  * Provides functions to record simulation data to files and 
  * read reference data for validation.
+ * 
+ * Files ending in .simt use the chunked columnar format from
+ * simulation_trace.h. Such traces can also be opened directly with
+ * sim_trace_open() and reduced with the *_trace() functions below,
+ * which stream over the mapping one chunk at a time.
  */
 
 #ifndef SIMULATION_DATA_H_
@@ -11,6 +16,8 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include "simulation_trace.h"
 
 // Data record structure (one simulation timestep)
 typedef struct {
@@ -42,9 +49,27 @@ typedef struct {
 typedef enum {
     SIM_FORMAT_CSV = 0,
     SIM_FORMAT_BINARY,
-    SIM_FORMAT_JSON
+    SIM_FORMAT_JSON,
+    SIM_FORMAT_COLUMNAR
 } sim_data_format_e;
 
+// Number of float columns in a record, and column index of a record field
+#define SIM_DATA_NUM_FIELDS         9
+#define SIM_DATA_NUM_FIELDS_EXT     21
+#define SIM_DATA_FIELD_INDEX(field) ((int)(offsetof(sim_data_record_t, field) / sizeof(float)))
+
+/**
+ * @brief Column name of a field, as in the CSV header ("time", "id", ...)
+ * @param field Column index, 0..SIM_DATA_NUM_FIELDS_EXT-1
+ * @return Name, or NULL if the index is out of range
+ */
+const char *sim_data_field_name(int field);
+
+/**
+ * @brief Column index of a field name, or -1 if there is no such field
+ */
+int sim_data_find_field(const char *name);
+
 // ==== Write Functions ====
 
 /**
@@ -136,6 +161,28 @@ int sim_data_compare(sim_data_record_t *ref,
                      float *tolerances,
                      int max_errors);
 
+/**
+ * @brief Statistics of one column of a trace, streamed chunk by chunk
+ * @param trace Trace opened with sim_trace_open()
+ * @param column Column index, e.g. SIM_DATA_FIELD_INDEX(iq)
+ * @return 0 on success, -1 on error or empty trace
+ */
+int sim_data_calc_stats_trace(sim_trace_t *trace, int column,
+                              sim_data_stats_t *stats);
+
+/**
+ * @brief Compare two traces record by record, streamed chunk by chunk
+ * 
+ * Same as sim_data_compare() over the first SIM_DATA_NUM_FIELDS columns
+ * of the shorter trace. The traces may use different chunk sizes and codecs.
+ * 
+ * @return Number of failed comparisons, or -1 on error
+ */
+int sim_data_compare_trace(sim_trace_t *ref,
+                           sim_trace_t *test,
+                           float *tolerances,
+                           int max_errors);
+
 /**
  * @brief Load reference data from MATLAB/Python export
  */
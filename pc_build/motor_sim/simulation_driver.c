@@ -5,6 +5,7 @@
 
 #include "simulation_driver.h"
 #include "simulation_data.h"
+#include "utils_math.h"
 #include <string.h>
 #include <stdio.h>
 #include <time.h>
@@ -20,33 +21,63 @@
 #define DEFAULT_OUTPUT_DT       (1.0f / 1000.0f)   // 1kHz output recording
 #define DEFAULT_DURATION        1.0f               // 1 second default
 
-// PWM handling for closed-loop connection
-static sim_context_t *g_active_context = NULL;
+// Settling band for step response metrics (fraction of the reference)
+#define SETTLING_BAND_REL       0.02f
+#define SETTLING_BAND_MIN       0.01f
 
-static void pwm_callback(uint32_t duty1, uint32_t duty2, uint32_t duty3) {
-    if (g_active_context == NULL) return;
+// Apply the duties latched by foc_control_current() to the motor model of
+// this context. Replaces the global PWM callback so that several contexts
+// can run at the same time.
+static void apply_duty_outputs(sim_context_t *ctx) {
+    motor_all_state_t *motor = &ctx->foc_state;
+    
+    if (!motor->m_duty_next_set) return;
+    motor->m_duty_next_set = false;
     
     // Convert PWM duty cycles to αβ voltages using SVM inverse
-    float v_bus = g_active_context->foc_state.m_motor_state.v_bus;
+    float v_bus = motor->m_motor_state.v_bus;
     float duty_max = (float)FOC_PWM_PERIOD_DEFAULT;
     
     // Normalize duties to 0-1 range
-    float d1 = (float)duty1 / duty_max;
-    float d2 = (float)duty2 / duty_max;
-    float d3 = (float)duty3 / duty_max;
+    float d1 = (float)motor->m_duty1_next / duty_max;
+    float d2 = (float)motor->m_duty2_next / duty_max;
+    float d3 = (float)motor->m_duty3_next / duty_max;
+    
+    if (ctx->inverter_enable) {
+        inverter_set_duty(&ctx->inverter, d1, d2, d3);
+        return;
+    }
     
     // Convert to phase voltages (center-aligned PWM)
     float va = (d1 - 0.5f) * v_bus;
     float vb = (d2 - 0.5f) * v_bus;
     float vc = (d3 - 0.5f) * v_bus;
+    (void)vc;
     
     // Clarke transform to αβ
     float v_alpha = va;
     float v_beta = (va + 2.0f * vb) / 1.73205080757f;  // 1/sqrt(3) * (va + 2*vb)
     
     // Store for motor model
-    g_active_context->vm_io.v_alpha_in = v_alpha;
-    g_active_context->vm_io.v_beta_in = v_beta;
+    ctx->vm_io.v_alpha_in = v_alpha;
+    ctx->vm_io.v_beta_in = v_beta;
+}
+
+static void reset_statistics(sim_context_t *ctx) {
+    ctx->min_id = 1e6f;
+    ctx->max_id = -1e6f;
+    ctx->min_iq = 1e6f;
+    ctx->max_iq = -1e6f;
+    ctx->min_speed = 1e6f;
+    ctx->max_speed = -1e6f;
+    ctx->total_energy_in = 0.0f;
+    ctx->total_energy_out = 0.0f;
+    
+    ctx->resp_sum_sq_error = 0.0f;
+    ctx->resp_peak = 0.0f;
+    ctx->resp_last_unsettled_time = 0.0f;
+    ctx->resp_final_error = 0.0f;
+    ctx->resp_samples = 0;
 }
 
 void sim_init(sim_context_t *ctx) {
@@ -66,14 +97,11 @@ void sim_init(sim_context_t *ctx) {
     mcconf_set_defaults(&ctx->mc_conf);
     
     // Initialize virtual motor with configuration
-    virtual_motor_pc_init(&ctx->mc_conf);
+    virtual_motor_pc_state_init(&ctx->vm, &ctx->mc_conf);
     
     // Initialize FOC state
     foc_motor_state_init(&ctx->foc_state, &ctx->mc_conf);
     
-    // Set up PWM callback for closed-loop
-    foc_set_pwm_callback(pwm_callback);
-    
     // Initialize command (default: current control, zero current)
     ctx->command.mode = SIM_CTRL_CURRENT;
     ctx->command.id_ref = 0.0f;
@@ -83,12 +111,7 @@ void sim_init(sim_context_t *ctx) {
     memset(&ctx->vm_io, 0, sizeof(virtual_motor_io_t));
     
     // Initialize statistics
-    ctx->min_id = 1e6f;
-    ctx->max_id = -1e6f;
-    ctx->min_iq = 1e6f;
-    ctx->max_iq = -1e6f;
-    ctx->min_speed = 1e6f;
-    ctx->max_speed = -1e6f;
+    reset_statistics(ctx);
 }
 
 void sim_set_controller_params(sim_context_t *ctx, mc_configuration *conf) {
@@ -96,7 +119,7 @@ void sim_set_controller_params(sim_context_t *ctx, mc_configuration *conf) {
     
     memcpy(&ctx->mc_conf, conf, sizeof(mc_configuration));
     foc_motor_state_init(&ctx->foc_state, &ctx->mc_conf);
-    virtual_motor_pc_set_configuration(&ctx->mc_conf);
+    virtual_motor_pc_state_set_configuration(&ctx->vm, &ctx->mc_conf);
 }
 
 void sim_set_timing(sim_context_t *ctx, 
@@ -129,12 +152,30 @@ void sim_set_recording(sim_context_t *ctx, sim_recording_t *rec) {
 
 void sim_set_load_torque(sim_context_t *ctx, float torque) {
     if (ctx == NULL) return;
-    virtual_motor_pc_set_load_torque(torque);
+    virtual_motor_pc_state_set_load_torque(&ctx->vm, torque);
 }
 
 void sim_set_inertia(sim_context_t *ctx, float inertia) {
     if (ctx == NULL) return;
-    virtual_motor_pc_set_inertia(inertia);
+    virtual_motor_pc_state_set_inertia(&ctx->vm, inertia);
+}
+
+void sim_set_integrator(sim_context_t *ctx, vm_integrator_t integrator) {
+    if (ctx == NULL) return;
+    virtual_motor_pc_state_set_integrator(&ctx->vm, integrator);
+}
+
+void sim_set_inverter(sim_context_t *ctx, const inverter_config_t *cfg) {
+    if (ctx == NULL) return;
+    
+    if (cfg == NULL) {
+        ctx->inverter_enable = false;
+        return;
+    }
+    
+    inverter_init(&ctx->inverter, cfg);
+    ctx->inverter_enable = true;
+    ctx->time.control_dt = inverter_sample_period(&ctx->inverter);
 }
 
 int sim_start(sim_context_t *ctx) {
@@ -147,20 +188,17 @@ int sim_start(sim_context_t *ctx) {
     
     // Reset states
     foc_motor_state_reset(&ctx->foc_state);
-    virtual_motor_pc_reset();
+    virtual_motor_pc_state_reset(&ctx->vm);
     
     // Reset I/O
     memset(&ctx->vm_io, 0, sizeof(virtual_motor_io_t));
     
+    if (ctx->inverter_enable) {
+        inverter_reset(&ctx->inverter);
+    }
+    
     // Reset statistics
-    ctx->min_id = 1e6f;
-    ctx->max_id = -1e6f;
-    ctx->min_iq = 1e6f;
-    ctx->max_iq = -1e6f;
-    ctx->min_speed = 1e6f;
-    ctx->max_speed = -1e6f;
-    ctx->total_energy_in = 0.0f;
-    ctx->total_energy_out = 0.0f;
+    reset_statistics(ctx);
     
     // Open recording file if enabled
     if (ctx->recording.enable && ctx->recording.filename != NULL) {
@@ -170,9 +208,6 @@ int sim_start(sim_context_t *ctx) {
         }
     }
     
-    // Set active context for callback
-    g_active_context = ctx;
-    
     ctx->state = SIM_STATE_RUNNING;
     return 0;
 }
@@ -185,9 +220,37 @@ static void apply_disturbance(sim_context_t *ctx) {
     // Load torque step
     if (t >= ctx->disturbance.load_time && 
         t < (ctx->disturbance.load_time + ctx->disturbance.load_duration)) {
-        virtual_motor_pc_set_load_torque(ctx->disturbance.load_torque);
+        virtual_motor_pc_state_set_load_torque(&ctx->vm, ctx->disturbance.load_torque);
     } else {
-        virtual_motor_pc_set_load_torque(0.0f);
+        virtual_motor_pc_state_set_load_torque(&ctx->vm, 0.0f);
+    }
+}
+
+// Reference and measured value of the quantity controlled in the current mode
+static bool get_tracked_signal(sim_context_t *ctx, float *ref, float *val) {
+    switch (ctx->command.mode) {
+        case SIM_CTRL_CURRENT:
+            *ref = ctx->command.iq_ref;
+            *val = ctx->foc_state.m_motor_state.iq;
+            return true;
+            
+        case SIM_CTRL_SPEED:
+            *ref = ctx->command.speed_ref;
+            *val = foc_get_erpm(&ctx->foc_state);
+            return true;
+            
+        case SIM_CTRL_POSITION:
+            *ref = ctx->command.position_ref;
+            *val = foc_get_position(&ctx->foc_state);
+            return true;
+            
+        case SIM_CTRL_DUTY:
+            *ref = ctx->command.duty_ref;
+            *val = ctx->foc_state.m_motor_state.duty_now;
+            return true;
+            
+        default:
+            return false;
     }
 }
 
@@ -206,11 +269,36 @@ static void update_statistics(sim_context_t *ctx) {
     // Energy calculations
     float p_in = fabsf(ctx->foc_state.m_motor_state.id * ctx->foc_state.m_motor_state.vd +
                        ctx->foc_state.m_motor_state.iq * ctx->foc_state.m_motor_state.vq);
-    float p_out = fabsf(virtual_motor_pc_get_torque() * virtual_motor_pc_get_omega_e() / 
+    float p_out = fabsf(virtual_motor_pc_state_get_torque(&ctx->vm) * ctx->vm.we / 
                         (float)ctx->mc_conf.si_motor_poles * 2.0f);
     
     ctx->total_energy_in += p_in * ctx->time.control_dt;
     ctx->total_energy_out += p_out * ctx->time.control_dt;
+    
+    // Step response tracking of the controlled quantity
+    float ref, val;
+    if (!get_tracked_signal(ctx, &ref, &val)) return;
+    
+    float error = ref - val;
+    if (ctx->command.mode == SIM_CTRL_POSITION) {
+        utils_norm_angle(&error);
+        if (error > 180.0f) error -= 360.0f;
+    }
+    
+    ctx->resp_sum_sq_error += error * error;
+    ctx->resp_final_error = error;
+    ctx->resp_samples++;
+    
+    // Peak excursion in the direction of the reference
+    float excursion = (ref >= 0.0f) ? val : -val;
+    if (ctx->resp_samples == 1 || excursion > ctx->resp_peak) {
+        ctx->resp_peak = excursion;
+    }
+    
+    float band = fmaxf(fabsf(ref) * SETTLING_BAND_REL, SETTLING_BAND_MIN);
+    if (fabsf(error) > band) {
+        ctx->resp_last_unsettled_time = ctx->time.current_time + ctx->time.control_dt;
+    }
 }
 
 int sim_step(sim_context_t *ctx) {
@@ -227,13 +315,17 @@ int sim_step(sim_context_t *ctx) {
         if (ctx->recording.enable) {
             sim_data_close();
         }
-        g_active_context = NULL;
         return 1;
     }
     
-    // Get motor model outputs (currents in αβ)
+    // Get motor model outputs (currents in αβ), as sampled by the
+    // inverter when there is one
     float i_alpha = ctx->vm_io.i_alpha_out;
     float i_beta = ctx->vm_io.i_beta_out;
+    if (ctx->inverter_enable) {
+        i_alpha = ctx->inverter.i_alpha_meas;
+        i_beta = ctx->inverter.i_beta_meas;
+    }
     
     // Get bus voltage and update measurements
     float v_bus = ctx->foc_state.m_motor_state.v_bus;
@@ -243,7 +335,7 @@ int sim_step(sim_context_t *ctx) {
     foc_run_observer(&ctx->foc_state, dt_ctrl);
     
     // Get electrical angle from motor model for simulation
-    float theta_e = virtual_motor_pc_get_angle_rad();
+    float theta_e = ctx->vm.phi;
     foc_update_phase(&ctx->foc_state, theta_e);
     
     // Apply control based on mode
@@ -274,16 +366,23 @@ int sim_step(sim_context_t *ctx) {
             break;
     }
     
+    // Feed the new duties to the motor model
+    apply_duty_outputs(ctx);
+    
     // Apply disturbances
     apply_disturbance(ctx);
     
     // Step motor model (possibly multiple sub-steps)
-    int model_substeps = (int)(dt_ctrl / dt_model + 0.5f);
-    if (model_substeps < 1) model_substeps = 1;
-    
-    float sub_dt = dt_ctrl / (float)model_substeps;
-    for (int i = 0; i < model_substeps; i++) {
-        virtual_motor_pc_step(&ctx->vm_io, sub_dt);
+    if (ctx->inverter_enable) {
+        inverter_step(&ctx->inverter, &ctx->vm, &ctx->vm_io, v_bus, dt_ctrl, dt_model);
+    } else {
+        int model_substeps = (int)(dt_ctrl / dt_model + 0.5f);
+        if (model_substeps < 1) model_substeps = 1;
+        
+        float sub_dt = dt_ctrl / (float)model_substeps;
+        for (int i = 0; i < model_substeps; i++) {
+            virtual_motor_pc_state_step(&ctx->vm, &ctx->vm_io, sub_dt);
+        }
     }
     
     // Update statistics
@@ -294,15 +393,7 @@ int sim_step(sim_context_t *ctx) {
     uint32_t expected_outputs = (uint32_t)(t / output_interval);
     if (ctx->recording.enable && ctx->time.output_steps <= expected_outputs) {
         sim_data_record_t rec;
-        rec.time = t;
-        rec.id = ctx->foc_state.m_motor_state.id;
-        rec.iq = ctx->foc_state.m_motor_state.iq;
-        rec.vd = ctx->foc_state.m_motor_state.vd;
-        rec.vq = ctx->foc_state.m_motor_state.vq;
-        rec.theta_e = virtual_motor_pc_get_angle_rad();
-        rec.omega_e = virtual_motor_pc_get_omega_e();
-        rec.omega_m = virtual_motor_pc_get_omega_e() / (float)ctx->mc_conf.si_motor_poles * 2.0f;
-        rec.torque = virtual_motor_pc_get_torque();
+        sim_get_record(ctx, &rec);
         
         sim_data_write_record(&rec);
         ctx->time.output_steps++;
@@ -349,7 +440,6 @@ void sim_stop(sim_context_t *ctx) {
     }
     
     ctx->state = SIM_STATE_IDLE;
-    g_active_context = NULL;
 }
 
 void sim_get_summary(sim_context_t *ctx, 
@@ -378,6 +468,48 @@ void sim_get_summary(sim_context_t *ctx,
     }
 }
 
+void sim_get_response_metrics(sim_context_t *ctx, sim_response_metrics_t *metrics) {
+    if (ctx == NULL || metrics == NULL) return;
+    
+    memset(metrics, 0, sizeof(sim_response_metrics_t));
+    
+    float ref, val;
+    if (ctx->resp_samples == 0 || !get_tracked_signal(ctx, &ref, &val)) {
+        metrics->settling_time = -1.0f;
+        return;
+    }
+    
+    metrics->rms_error = sqrtf(ctx->resp_sum_sq_error / (float)ctx->resp_samples);
+    metrics->final_error = ctx->resp_final_error;
+    
+    if (fabsf(ref) > 1e-6f) {
+        float overshoot = (ctx->resp_peak - fabsf(ref)) / fabsf(ref) * 100.0f;
+        metrics->overshoot = fmaxf(overshoot, 0.0f);
+    }
+    
+    // Not settled if the last sample was still outside the band
+    float band = fmaxf(fabsf(ref) * SETTLING_BAND_REL, SETTLING_BAND_MIN);
+    if (fabsf(ctx->resp_final_error) > band) {
+        metrics->settling_time = -1.0f;
+    } else {
+        metrics->settling_time = ctx->resp_last_unsettled_time;
+    }
+}
+
+void sim_get_record(sim_context_t *ctx, sim_data_record_t *rec) {
+    if (ctx == NULL || rec == NULL) return;
+    
+    rec->time = ctx->time.current_time;
+    rec->id = ctx->foc_state.m_motor_state.id;
+    rec->iq = ctx->foc_state.m_motor_state.iq;
+    rec->vd = ctx->foc_state.m_motor_state.vd;
+    rec->vq = ctx->foc_state.m_motor_state.vq;
+    rec->theta_e = ctx->vm.phi;
+    rec->omega_e = ctx->vm.we;
+    rec->omega_m = ctx->vm.we / (float)ctx->mc_conf.si_motor_poles * 2.0f;
+    rec->torque = virtual_motor_pc_state_get_torque(&ctx->vm);
+}
+
 void sim_get_state(sim_context_t *ctx,
                    float *id, float *iq,
                    float *speed, float *position,
@@ -388,9 +520,9 @@ void sim_get_state(sim_context_t *ctx,
     if (iq != NULL) *iq = ctx->foc_state.m_motor_state.iq;
     if (speed != NULL) *speed = foc_get_erpm(&ctx->foc_state);
     if (position != NULL) *position = foc_get_position(&ctx->foc_state);
-    if (torque != NULL) *torque = virtual_motor_pc_get_torque();
+    if (torque != NULL) *torque = virtual_motor_pc_state_get_torque(&ctx->vm);
     if (power != NULL) {
-        float omega_m = virtual_motor_pc_get_omega_e() / (float)ctx->mc_conf.si_motor_poles * 2.0f;
-        *power = virtual_motor_pc_get_torque() * omega_m;
+        float omega_m = ctx->vm.we / (float)ctx->mc_conf.si_motor_poles * 2.0f;
+        *power = virtual_motor_pc_state_get_torque(&ctx->vm) * omega_m;
     }
 }
@@ -10,8 +10,10 @@
 #define SIMULATION_DRIVER_H_
 
 #include "virtual_motor_pc.h"
+#include "inverter_model.h"
 #include "foc_control_core.h"
 #include "mcconf_stub.h"
+#include "simulation_data.h"
 
 // Simulation time management
 typedef struct {
@@ -81,6 +83,15 @@ typedef struct {
     bool record_power;
 } sim_recording_t;
 
+// Step response metrics of the controlled quantity (iq, ERPM, position
+// or duty depending on the control mode)
+typedef struct {
+    float settling_time;    // Time until the error stays within 2% of the reference [s], -1 if not settled
+    float overshoot;        // Peak overshoot relative to the reference [%]
+    float rms_error;        // RMS tracking error over the run [mode units]
+    float final_error;      // Tracking error at the last step [mode units]
+} sim_response_metrics_t;
+
 // Main simulation context
 typedef struct {
     // State
@@ -90,9 +101,14 @@ typedef struct {
     // Configuration
     mc_configuration mc_conf;
     
-    // Virtual motor I/O
+    // Virtual motor model and I/O
+    virtual_motor_state_t vm;
     virtual_motor_io_t vm_io;
     
+    // Optional inverter between the SVM duties and the motor model
+    bool inverter_enable;
+    inverter_state_t inverter;
+    
     // FOC control state
     motor_all_state_t foc_state;
     
@@ -109,6 +125,13 @@ typedef struct {
     float min_speed, max_speed;
     float total_energy_in;
     float total_energy_out;
+    
+    // Step response tracking
+    float resp_sum_sq_error;
+    float resp_peak;
+    float resp_last_unsettled_time;
+    float resp_final_error;
+    uint32_t resp_samples;
 } sim_context_t;
 
 // ==== API Functions ====
@@ -157,6 +180,27 @@ void sim_set_load_torque(sim_context_t *ctx, float torque);
  */
 void sim_set_inertia(sim_context_t *ctx, float inertia);
 
+/**
+ * @brief Select the motor model integrator
+ * 
+ * With VM_INTEGRATOR_RK4 or VM_INTEGRATOR_EXACT a model_dt equal to
+ * control_dt is usually enough. With VM_INTEGRATOR_ADAPTIVE set model_dt
+ * to control_dt and let the integrator pick its own steps.
+ */
+void sim_set_integrator(sim_context_t *ctx, vm_integrator_t integrator);
+
+/**
+ * @brief Drive the motor model through an inverter model
+ * 
+ * The duties from foc_svm() are then applied by the inverter instead of
+ * the ideal αβ voltage, and the controller sees the currents sampled by
+ * the inverter. control_dt is set to the sample period of the inverter,
+ * i.e. the control rate of the firmware for the same foc_f_zv.
+ * 
+ * @param cfg Inverter configuration, or NULL to go back to the ideal plant
+ */
+void sim_set_inverter(sim_context_t *ctx, const inverter_config_t *cfg);
+
 /**
  * @brief Start simulation
  */
@@ -196,6 +240,11 @@ void sim_get_summary(sim_context_t *ctx,
                      float *avg_torque,
                      float *efficiency);
 
+/**
+ * @brief Get step response metrics (settling time, overshoot, RMS error)
+ */
+void sim_get_response_metrics(sim_context_t *ctx, sim_response_metrics_t *metrics);
+
 /**
  * @brief Get current state snapshot
  */
@@ -204,4 +253,10 @@ void sim_get_state(sim_context_t *ctx,
                    float *speed, float *position,
                    float *torque, float *power);
 
+/**
+ * @brief Get the current state as a data record, stamped with the current
+ * simulation time
+ */
+void sim_get_record(sim_context_t *ctx, sim_data_record_t *rec);
+
 #endif // SIMULATION_DRIVER_H_
@@ -0,0 +1,905 @@
+/**
+ * @file simulation_regression.c
+ * @brief Manifest-driven regression runner implementation
+ */
+
+#include "simulation_regression.h"
+#include "simulation_sweep.h"
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+
+#define MANIFEST_MAX_LINE       1024
+#define DEFAULT_MAX_LAG         0.002f
+
+// Envelope floor, so that a zero tolerance means "exact"
+#define ENVELOPE_MIN            1e-12f
+
+// DTW back-pointers
+#define DTW_DIAG                0
+#define DTW_UP                  1
+#define DTW_LEFT                2
+
+static double wall_time_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// ==================== Manifest ====================
+
+typedef struct {
+    const char *name;
+    void (*set_conf)(mc_configuration *conf);
+} preset_entry_t;
+
+static const preset_entry_t presets[] = {
+    {"default", mcconf_set_defaults},
+    {"small",   mcconf_set_small_motor},
+    {"medium",  mcconf_set_medium_motor},
+    {"large",   mcconf_set_large_motor},
+};
+
+static const char * const mode_names[] = {
+    [SIM_CTRL_NONE] = "none",
+    [SIM_CTRL_CURRENT] = "current",
+    [SIM_CTRL_SPEED] = "speed",
+    [SIM_CTRL_POSITION] = "position",
+    [SIM_CTRL_DUTY] = "duty",
+    [SIM_CTRL_OPENLOOP] = "openloop",
+};
+
+static const char * const integrator_names[] = {
+    [VM_INTEGRATOR_EULER] = "euler",
+    [VM_INTEGRATOR_RK4] = "rk4",
+    [VM_INTEGRATOR_EXACT] = "exact",
+    [VM_INTEGRATOR_ADAPTIVE] = "adaptive",
+};
+
+static const char * const align_names[] = {
+    [SIM_REG_ALIGN_NONE] = "none",
+    [SIM_REG_ALIGN_LAG] = "lag",
+    [SIM_REG_ALIGN_DTW] = "dtw",
+};
+
+#define ARRAY_LEN(a)    ((int)(sizeof(a) / sizeof((a)[0])))
+
+static int find_name(const char * const *names, int count, const char *name) {
+    for (int i = 0; i < count; i++) {
+        if (names[i] != NULL && strcmp(names[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) s++;
+
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) end--;
+    *end = '\0';
+
+    return s;
+}
+
+static bool parse_float(const char *s, float *out) {
+    char *end;
+    float v = strtof(s, &end);
+    if (end == s || !isfinite(v)) return false;
+
+    while (isspace((unsigned char)*end)) end++;
+    if (*end != '\0') return false;
+
+    *out = v;
+    return true;
+}
+
+// Splits s in place into whitespace-separated tokens
+static int tokenize(char *s, char **tok, int max_tok) {
+    int n = 0;
+    char *save = NULL;
+
+    for (char *p = strtok_r(s, " \t", &save); p != NULL; p = strtok_r(NULL, " \t", &save)) {
+        if (n == max_tok) return -1;
+        tok[n++] = p;
+    }
+
+    return n;
+}
+
+static bool parse_profile(char *value, sim_reg_profile_t *p) {
+    char *tok[SIM_REG_PROFILE_POINTS + 1];
+    int n = tokenize(value, tok, SIM_REG_PROFILE_POINTS + 1);
+    if (n < 1) return false;
+
+    memset(p, 0, sizeof(sim_reg_profile_t));
+
+    if (n == 1 || strcmp(tok[0], "const") == 0) {
+        p->num_points = 1;
+        return parse_float(tok[n - 1], &p->v[0]) && n <= 2;
+    }
+
+    if (strcmp(tok[0], "step") == 0) {
+        if (n != 4) return false;
+        p->num_points = 2;
+        p->t[0] = 0.0f;
+        return parse_float(tok[1], &p->t[1]) &&
+               parse_float(tok[2], &p->v[0]) &&
+               parse_float(tok[3], &p->v[1]);
+    }
+
+    if (strcmp(tok[0], "ramp") == 0) {
+        if (n != 5) return false;
+        p->num_points = 2;
+        p->linear = true;
+        return parse_float(tok[1], &p->t[0]) &&
+               parse_float(tok[2], &p->t[1]) &&
+               parse_float(tok[3], &p->v[0]) &&
+               parse_float(tok[4], &p->v[1]) &&
+               p->t[1] >= p->t[0];
+    }
+
+    bool pwl = strcmp(tok[0], "pwl") == 0;
+    if (!pwl && strcmp(tok[0], "steps") != 0) return false;
+
+    p->linear = pwl;
+    p->num_points = n - 1;
+    for (int i = 0; i < p->num_points; i++) {
+        char *colon = strchr(tok[i + 1], ':');
+        if (colon == NULL) return false;
+        *colon = '\0';
+
+        if (!parse_float(tok[i + 1], &p->t[i]) || !parse_float(colon + 1, &p->v[i])) {
+            return false;
+        }
+        if (i > 0 && p->t[i] < p->t[i - 1]) return false;
+    }
+
+    return p->num_points > 0;
+}
+
+static bool parse_tolerance(char *value, sim_reg_tolerance_t *tol) {
+    char *tok[3];
+    int n = tokenize(value, tok, 2);
+    if (n < 1) return false;
+
+    tol->enable = true;
+    tol->rel_tol = 0.0f;
+    if (!parse_float(tok[0], &tol->abs_tol) || tol->abs_tol < 0.0f) return false;
+    if (n == 2 && (!parse_float(tok[1], &tol->rel_tol) || tol->rel_tol < 0.0f)) return false;
+
+    return true;
+}
+
+// Applies one key to a scenario. Returns an error message, or NULL.
+static const char *apply_key(sim_reg_scenario_t *scn, const char *key, char *value,
+                             const char *base_dir) {
+    float *num = NULL;
+
+    if (strcmp(key, "preset") == 0) {
+        for (int i = 0; i < ARRAY_LEN(presets); i++) {
+            if (strcmp(presets[i].name, value) == 0) {
+                presets[i].set_conf(&scn->mc_conf);
+                snprintf(scn->preset, sizeof(scn->preset), "%s", value);
+                return NULL;
+            }
+        }
+        return "unknown preset";
+    } else if (strcmp(key, "mode") == 0) {
+        int m = find_name(mode_names, ARRAY_LEN(mode_names), value);
+        if (m < SIM_CTRL_CURRENT || m > SIM_CTRL_DUTY) return "unknown mode";
+        scn->mode = (sim_control_mode_e)m;
+        return NULL;
+    } else if (strcmp(key, "integrator") == 0) {
+        int m = find_name(integrator_names, ARRAY_LEN(integrator_names), value);
+        if (m < 0) return "unknown integrator";
+        scn->integrator = (vm_integrator_t)m;
+        return NULL;
+    } else if (strcmp(key, "inverter") == 0) {
+        if (strcmp(value, "off") == 0) {
+            scn->inverter_enable = false;
+        } else if (strcmp(value, "averaged") == 0) {
+            scn->inverter_enable = true;
+            scn->inverter_mode = INVERTER_MODE_AVERAGED;
+        } else if (strcmp(value, "switching") == 0) {
+            scn->inverter_enable = true;
+            scn->inverter_mode = INVERTER_MODE_SWITCHING;
+        } else {
+            return "unknown inverter mode";
+        }
+        return NULL;
+    } else if (strcmp(key, "align") == 0) {
+        int m = find_name(align_names, ARRAY_LEN(align_names), value);
+        if (m < 0) return "unknown alignment";
+        scn->align = (sim_reg_align_e)m;
+        return NULL;
+    } else if (strcmp(key, "setpoint") == 0) {
+        return parse_profile(value, &scn->setpoint) ? NULL : "bad profile";
+    } else if (strcmp(key, "load") == 0) {
+        return parse_profile(value, &scn->load) ? NULL : "bad profile";
+    } else if (strcmp(key, "reference") == 0) {
+        int len;
+        if (base_dir != NULL && base_dir[0] != '\0' && value[0] != '/') {
+            len = snprintf(scn->reference, sizeof(scn->reference), "%s/%s", base_dir, value);
+        } else {
+            len = snprintf(scn->reference, sizeof(scn->reference), "%s", value);
+        }
+        return (len < (int)sizeof(scn->reference)) ? NULL : "path too long";
+    } else if (strncmp(key, "tol.", 4) == 0) {
+        int field = sim_data_find_field(key + 4);
+        if (field <= 0 || field >= SIM_DATA_NUM_FIELDS) return "unknown signal";
+        return parse_tolerance(value, &scn->tol[field]) ? NULL : "bad tolerance";
+    } else if (strcmp(key, "id_ref") == 0) {
+        num = &scn->id_ref;
+    } else if (strcmp(key, "inertia") == 0) {
+        num = &scn->inertia;
+    } else if (strcmp(key, "control_dt") == 0) {
+        num = &scn->control_dt;
+    } else if (strcmp(key, "model_dt") == 0) {
+        num = &scn->model_dt;
+    } else if (strcmp(key, "output_dt") == 0) {
+        num = &scn->output_dt;
+    } else if (strcmp(key, "duration") == 0) {
+        num = &scn->duration;
+    } else if (strcmp(key, "max_lag") == 0) {
+        num = &scn->max_lag;
+    } else {
+        return "unknown key";
+    }
+
+    float v;
+    if (!parse_float(value, &v)) return "bad number";
+
+    // Everything but id_ref is a positive quantity
+    if (num != &scn->id_ref && (v < 0.0f || (v == 0.0f && num != &scn->max_lag))) {
+        return "value out of range";
+    }
+
+    *num = v;
+    return NULL;
+}
+
+void sim_reg_scenario_init(sim_reg_scenario_t *scn) {
+    if (scn == NULL) return;
+
+    memset(scn, 0, sizeof(sim_reg_scenario_t));
+
+    snprintf(scn->preset, sizeof(scn->preset), "default");
+    mcconf_set_defaults(&scn->mc_conf);
+    scn->mode = SIM_CTRL_CURRENT;
+    scn->inertia = 0.0001f;
+    scn->control_dt = 0.0f;             // Control period of the preset
+    scn->model_dt = 1.0f / 100000.0f;
+    scn->output_dt = 1.0f / 1000.0f;
+    scn->duration = 0.1f;
+    scn->integrator = VM_INTEGRATOR_EULER;
+    scn->align = SIM_REG_ALIGN_LAG;
+    scn->max_lag = DEFAULT_MAX_LAG;
+}
+
+int sim_reg_parse_manifest(const char *text, const char *base_dir,
+                           sim_reg_scenario_t **scenarios,
+                           char *err, size_t err_len) {
+    if (text == NULL || scenarios == NULL) return -1;
+
+    sim_reg_scenario_t *defaults = malloc(sizeof(sim_reg_scenario_t));
+    if (defaults == NULL) return -1;
+    sim_reg_scenario_init(defaults);
+
+    sim_reg_scenario_t *list = NULL;
+    int count = 0, capacity = 0;
+    sim_reg_scenario_t *current = defaults;
+
+    const char *p = text;
+    int line_no = 0;
+    const char *error = NULL;
+
+    while (*p != '\0' && error == NULL) {
+        char line[MANIFEST_MAX_LINE];
+        size_t len = strcspn(p, "\n");
+        line_no++;
+
+        if (len >= sizeof(line)) {
+            error = "line too long";
+            break;
+        }
+        memcpy(line, p, len);
+        line[len] = '\0';
+        p += len;
+        if (*p == '\n') p++;
+
+        char *hash = strchr(line, '#');
+        if (hash != NULL) *hash = '\0';
+
+        char *s = trim(line);
+        if (*s == '\0') continue;
+
+        if (*s == '[') {
+            char *close = strchr(s, ']');
+            if (close == NULL || close[1] != '\0') {
+                error = "bad section header";
+                break;
+            }
+            *close = '\0';
+            char *name = trim(s + 1);
+
+            if (strcmp(name, "defaults") == 0) {
+                current = defaults;
+                continue;
+            }
+
+            if (*name == '\0' || strlen(name) >= SIM_REG_NAME_LEN) {
+                error = "bad scenario name";
+                break;
+            }
+
+            if (count == capacity) {
+                int new_capacity = (capacity == 0) ? 16 : 2 * capacity;
+                sim_reg_scenario_t *grown = realloc(list, sizeof(sim_reg_scenario_t) * (size_t)new_capacity);
+                if (grown == NULL) {
+                    error = "out of memory";
+                    break;
+                }
+                list = grown;
+                capacity = new_capacity;
+            }
+
+            current = &list[count++];
+            memcpy(current, defaults, sizeof(sim_reg_scenario_t));
+            snprintf(current->name, sizeof(current->name), "%s", name);
+            continue;
+        }
+
+        char *eq = strchr(s, '=');
+        if (eq == NULL) {
+            error = "expected key = value";
+            break;
+        }
+        *eq = '\0';
+
+        error = apply_key(current, trim(s), trim(eq + 1), base_dir);
+    }
+
+    // Every scenario needs a golden trace to compare with
+    for (int i = 0; i < count && error == NULL; i++) {
+        if (list[i].reference[0] == '\0') {
+            if (err != NULL) {
+                snprintf(err, err_len, "scenario %s: no reference", list[i].name);
+            }
+            free(list);
+            free(defaults);
+            return -1;
+        }
+    }
+
+    free(defaults);
+
+    if (error != NULL) {
+        if (err != NULL) {
+            snprintf(err, err_len, "line %d: %s", line_no, error);
+        }
+        free(list);
+        return -1;
+    }
+
+    *scenarios = list;
+    return count;
+}
+
+int sim_reg_load_manifest(const char *filename, sim_reg_scenario_t **scenarios,
+                          char *err, size_t err_len) {
+    if (filename == NULL) return -1;
+
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL) {
+        if (err != NULL) snprintf(err, err_len, "cannot open %s", filename);
+        return -1;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    char *text = (size >= 0) ? malloc((size_t)size + 1) : NULL;
+    if (text == NULL || fread(text, 1, (size_t)size, f) != (size_t)size) {
+        if (err != NULL) snprintf(err, err_len, "cannot read %s", filename);
+        free(text);
+        fclose(f);
+        return -1;
+    }
+    text[size] = '\0';
+    fclose(f);
+
+    // Reference paths are relative to the directory of the manifest
+    char base_dir[SIM_REG_PATH_LEN];
+    const char *slash = strrchr(filename, '/');
+    if (slash != NULL && (size_t)(slash - filename) < sizeof(base_dir)) {
+        memcpy(base_dir, filename, (size_t)(slash - filename));
+        base_dir[slash - filename] = '\0';
+    } else {
+        base_dir[0] = '\0';
+    }
+
+    int count = sim_reg_parse_manifest(text, base_dir, scenarios, err, err_len);
+    free(text);
+
+    return count;
+}
+
+float sim_reg_profile_eval(const sim_reg_profile_t *p, float t) {
+    if (p == NULL || p->num_points == 0) return 0.0f;
+
+    if (t < p->t[0]) return p->v[0];
+
+    int i = 0;
+    while (i + 1 < p->num_points && t >= p->t[i + 1]) i++;
+
+    if (!p->linear || i + 1 >= p->num_points) return p->v[i];
+
+    float span = p->t[i + 1] - p->t[i];
+    float x = (span > 0.0f) ? (t - p->t[i]) / span : 1.0f;
+    return p->v[i] + x * (p->v[i + 1] - p->v[i]);
+}
+
+// ==================== Comparison ====================
+
+// Error relative to the envelope, infinite for non-finite values
+static inline float envelope_ratio(const sim_reg_tolerance_t *tol, float ref, float test,
+                                   float *abs_err) {
+    float err = fabsf(test - ref);
+    *abs_err = err;
+
+    if (!isfinite(err)) return INFINITY;
+
+    float env = tol->abs_tol + tol->rel_tol * fabsf(ref);
+    return err / fmaxf(env, ENVELOPE_MIN);
+}
+
+static void compare_shifted(const float *ref, const float *test, int count, int stride,
+                            const sim_reg_tolerance_t *tol, int lag,
+                            float *worst_ratio, float *max_error) {
+    float worst = 0.0f, max_err = 0.0f;
+
+    int start = (lag < 0) ? -lag : 0;
+    int end = (lag > 0) ? count - lag : count;
+    for (int i = start; i < end; i++) {
+        float e;
+        float r = envelope_ratio(tol, ref[(size_t)i * stride], test[(size_t)(i + lag) * stride], &e);
+        if (!(r <= worst)) worst = r;
+        if (!(e <= max_err)) max_err = e;
+    }
+
+    *worst_ratio = worst;
+    *max_error = max_err;
+}
+
+// Minimax ("bottleneck") DTW: finds the monotone alignment within a band
+// of +-w samples whose largest envelope ratio is smallest, so the signal
+// passes if any such alignment stays inside the envelope.
+static void compare_dtw(const float *ref, const float *test, int count, int stride,
+                        const sim_reg_tolerance_t *tol, int w,
+                        sim_reg_signal_result_t *out) {
+    int width = 2 * w + 1;
+    float *prev = malloc(sizeof(float) * (size_t)width);
+    float *cur = malloc(sizeof(float) * (size_t)width);
+    unsigned char *dir = malloc((size_t)count * (size_t)width);
+
+    if (prev == NULL || cur == NULL || dir == NULL) {
+        free(prev);
+        free(cur);
+        free(dir);
+        out->worst_ratio = INFINITY;
+        out->max_error = INFINITY;
+        return;
+    }
+
+    // Cell k of row i is test sample j = i + k - w
+    for (int i = 0; i < count; i++) {
+        for (int k = 0; k < width; k++) {
+            int j = i + k - w;
+            if (j < 0 || j >= count) {
+                cur[k] = INFINITY;
+                continue;
+            }
+
+            float e;
+            float c = envelope_ratio(tol, ref[(size_t)i * stride], test[(size_t)j * stride], &e);
+
+            if (i == 0 && j == 0) {
+                cur[k] = c;
+                dir[k] = DTW_DIAG;
+                continue;
+            }
+
+            float best = INFINITY;
+            unsigned char d = DTW_DIAG;
+            if (i > 0 && j > 0) {
+                best = prev[k];
+            }
+            if (i > 0 && k + 1 < width && prev[k + 1] < best) {
+                best = prev[k + 1];
+                d = DTW_UP;
+            }
+            if (k > 0 && cur[k - 1] < best) {
+                best = cur[k - 1];
+                d = DTW_LEFT;
+            }
+
+            cur[k] = fmaxf(c, best);
+            dir[(size_t)i * width + k] = d;
+        }
+
+        float *tmp = prev;
+        prev = cur;
+        cur = tmp;
+    }
+
+    out->worst_ratio = prev[w];
+
+    // Walk the alignment back for the error and the largest warp
+    float max_err = 0.0f;
+    int max_warp = 0;
+    int i = count - 1, k = w;
+    for (;;) {
+        int j = i + k - w;
+        float e;
+        envelope_ratio(tol, ref[(size_t)i * stride], test[(size_t)j * stride], &e);
+        if (!(e <= max_err)) max_err = e;
+        if (abs(j - i) > max_warp) max_warp = abs(j - i);
+
+        if (i == 0 && j == 0) break;
+
+        switch (dir[(size_t)i * width + k]) {
+            case DTW_UP: i--; k++; break;
+            case DTW_LEFT: k--; break;
+            default: i--; break;
+        }
+    }
+
+    out->max_error = max_err;
+    out->lag = (float)max_warp;
+
+    free(prev);
+    free(cur);
+    free(dir);
+}
+
+void sim_reg_compare_signal(const float *ref, const float *test,
+                            int count, int stride,
+                            const sim_reg_tolerance_t *tol,
+                            sim_reg_align_e align, int max_lag, float dt,
+                            sim_reg_signal_result_t *out) {
+    if (out == NULL) return;
+
+    memset(out, 0, sizeof(sim_reg_signal_result_t));
+    if (ref == NULL || test == NULL || tol == NULL || count <= 0) return;
+
+    out->checked = true;
+
+    if (max_lag > count - 1) max_lag = count - 1;
+    if (max_lag < 0 || align == SIM_REG_ALIGN_NONE) max_lag = 0;
+
+    if (align == SIM_REG_ALIGN_DTW && max_lag > 0) {
+        compare_dtw(ref, test, count, stride, tol, max_lag, out);
+        out->lag *= dt;
+    } else {
+        // Shifts in order of size, so the smallest one wins a tie
+        out->worst_ratio = INFINITY;
+        for (int a = 0; a <= max_lag; a++) {
+            for (int sign = 1; sign >= -1; sign -= 2) {
+                int lag = sign * a;
+                float worst, max_err;
+                compare_shifted(ref, test, count, stride, tol, lag, &worst, &max_err);
+                if (worst < out->worst_ratio) {
+                    out->worst_ratio = worst;
+                    out->max_error = max_err;
+                    out->lag = (float)lag * dt;
+                }
+                if (a == 0) break;
+            }
+        }
+    }
+
+    out->pass = out->worst_ratio <= 1.0f;
+}
+
+// ==================== Runner ====================
+
+static void apply_profiles(sim_context_t *ctx, const sim_reg_scenario_t *scn, float t) {
+    float sp = sim_reg_profile_eval(&scn->setpoint, t);
+
+    switch (scn->mode) {
+        case SIM_CTRL_CURRENT: ctx->command.iq_ref = sp; break;
+        case SIM_CTRL_SPEED: ctx->command.speed_ref = sp; break;
+        case SIM_CTRL_POSITION: ctx->command.position_ref = sp; break;
+        case SIM_CTRL_DUTY: ctx->command.duty_ref = sp; break;
+        default: break;
+    }
+
+    if (scn->load.num_points > 0) {
+        sim_set_load_torque(ctx, sim_reg_profile_eval(&scn->load, t));
+    }
+}
+
+static int run_simulation(const sim_reg_scenario_t *scn, sim_reg_result_t *result) {
+    // The context holds a full mc_configuration and is too large to keep
+    // on small worker stacks
+    sim_context_t *ctx = malloc(sizeof(sim_context_t));
+    if (ctx == NULL) return -1;
+
+    sim_init(ctx);
+    sim_set_controller_params(ctx, (mc_configuration*)&scn->mc_conf);
+    sim_set_inertia(ctx, scn->inertia);
+    sim_set_integrator(ctx, scn->integrator);
+
+    // Without an explicit control_dt the controller runs at the current
+    // sample rate of the preset's PWM setup, like the firmware ISR
+    inverter_config_t cfg;
+    inverter_default_config(&cfg, &ctx->mc_conf);
+    cfg.mode = scn->inverter_mode;
+    float control_dt = scn->control_dt;
+    if (control_dt <= 0.0f) {
+        inverter_state_t inv;
+        inverter_init(&inv, &cfg);
+        control_dt = inverter_sample_period(&inv);
+    }
+    sim_set_timing(ctx, control_dt, scn->model_dt, scn->output_dt, scn->duration);
+
+    if (scn->inverter_enable) {
+        sim_set_inverter(ctx, &cfg);
+    }
+
+    ctx->command.mode = scn->mode;
+    ctx->command.id_ref = scn->id_ref;
+
+    int capacity = (int)(scn->duration / scn->output_dt) + 2;
+    result->trace = malloc(sizeof(sim_data_record_t) * (size_t)capacity);
+    if (result->trace == NULL || sim_start(ctx) < 0) {
+        free(ctx);
+        return -1;
+    }
+
+    // The model reset leaves the flux state at zero, which starts the
+    // Euler model at id = -lambda / ld. Start every scenario at rest with
+    // zero current instead, so that the traces do not depend on how the
+    // controller recovers from that initial kick.
+    ctx->vm.id_int = ctx->vm.lambda / ctx->vm.ld;
+
+    // Same output decimation as the recorder in sim_step()
+    int n = 0;
+    while (ctx->state == SIM_STATE_RUNNING) {
+        float t = ctx->time.current_time;
+        apply_profiles(ctx, scn, t);
+
+        if (sim_step(ctx) != 0) break;
+
+        if (n < capacity && (uint32_t)n <= (uint32_t)(t / scn->output_dt)) {
+            sim_get_record(ctx, &result->trace[n]);
+            result->trace[n].time = t;
+            n++;
+        }
+    }
+
+    result->trace_count = n;
+    int ret = (ctx->state == SIM_STATE_COMPLETED) ? 0 : -1;
+    free(ctx);
+
+    return ret;
+}
+
+void sim_reg_run_scenario(const sim_reg_scenario_t *scn, sim_reg_result_t *result) {
+    if (scn == NULL || result == NULL) return;
+
+    // Keep the golden trace loaded by the caller
+    sim_data_record_t *reference = result->reference;
+    int reference_count = result->reference_count;
+    bool reference_missing = result->reference_missing;
+
+    free(result->trace);
+    memset(result, 0, sizeof(sim_reg_result_t));
+    result->reference = reference;
+    result->reference_count = reference_count;
+    result->reference_missing = reference_missing;
+
+    double start = wall_time_now();
+
+    result->result = run_simulation(scn, result);
+
+    if (result->result == 0 && reference != NULL && reference_count > 0) {
+        int count = (result->trace_count < reference_count) ? result->trace_count : reference_count;
+        int max_lag = (int)(scn->max_lag / scn->output_dt + 0.5f);
+
+        result->compared_points = count;
+        result->pass = count > 0 && count >= reference_count - 1;
+
+        for (int f = 1; f < SIM_DATA_NUM_FIELDS; f++) {
+            if (!scn->tol[f].enable) continue;
+
+            const float *ref_col = (const float*)reference + f;
+            const float *test_col = (const float*)result->trace + f;
+            sim_reg_compare_signal(ref_col, test_col, count, SIM_DATA_NUM_FIELDS,
+                                   &scn->tol[f], scn->align, max_lag, scn->output_dt,
+                                   &result->signals[f]);
+
+            if (!result->signals[f].pass) result->pass = false;
+        }
+    }
+
+    result->wall_time = wall_time_now() - start;
+}
+
+// Argument of the runner tasks
+typedef struct {
+    const sim_reg_scenario_t *scenarios;
+    sim_reg_result_t *results;
+} reg_jobs_t;
+
+static void reg_task(int index, void *arg) {
+    reg_jobs_t *j = (reg_jobs_t*)arg;
+    sim_reg_run_scenario(&j->scenarios[index], &j->results[index]);
+}
+
+// The simulation_data reader is shared by the process, so the golden
+// traces are loaded up front in the calling thread
+static void load_reference(const sim_reg_scenario_t *scn, sim_reg_result_t *result) {
+    int capacity = (int)(scn->duration / scn->output_dt) + 16;
+
+    result->reference = malloc(sizeof(sim_data_record_t) * (size_t)capacity);
+    result->reference_count = 0;
+
+    if (result->reference != NULL) {
+        result->reference_count = sim_data_load_reference(scn->reference,
+                                                          result->reference, capacity);
+    }
+
+    if (result->reference_count <= 0) {
+        free(result->reference);
+        result->reference = NULL;
+        result->reference_count = 0;
+        result->reference_missing = true;
+    }
+}
+
+int sim_reg_run(const sim_reg_scenario_t *scenarios, sim_reg_result_t *results,
+                int count, int num_threads) {
+    if (scenarios == NULL || results == NULL || count < 0) return -1;
+
+    for (int i = 0; i < count; i++) {
+        memset(&results[i], 0, sizeof(sim_reg_result_t));
+        load_reference(&scenarios[i], &results[i]);
+    }
+
+    reg_jobs_t j;
+    j.scenarios = scenarios;
+    j.results = results;
+
+    if (sim_sweep_parallel_for(count, num_threads, reg_task, &j) < 0) {
+        return -1;
+    }
+
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        if (!results[i].pass) failed++;
+    }
+
+    return failed;
+}
+
+int sim_reg_save_golden(const sim_reg_scenario_t *scn, const sim_reg_result_t *result) {
+    if (scn == NULL || result == NULL || result->trace == NULL) return -1;
+
+    if (sim_data_open_write(scn->reference) < 0) return -1;
+
+    int ret = 0;
+    for (int i = 0; i < result->trace_count; i++) {
+        if (sim_data_write_record(&result->trace[i]) < 0) ret = -1;
+    }
+    sim_data_close();
+
+    return ret;
+}
+
+void sim_reg_free_results(sim_reg_result_t *results, int count) {
+    if (results == NULL) return;
+
+    for (int i = 0; i < count; i++) {
+        free(results[i].trace);
+        free(results[i].reference);
+        results[i].trace = NULL;
+        results[i].reference = NULL;
+        results[i].trace_count = 0;
+        results[i].reference_count = 0;
+    }
+}
+
+// ==================== Summary ====================
+
+static void json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s != '\0'; s++) {
+        if (*s == '"' || *s == '\\') {
+            fputc('\\', out);
+            fputc(*s, out);
+        } else if ((unsigned char)*s < 0x20) {
+            fprintf(out, "\\u%04x", (unsigned char)*s);
+        } else {
+            fputc(*s, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// JSON has no infinity or NaN
+static void json_number(FILE *out, double v) {
+    if (isfinite(v)) {
+        fprintf(out, "%.6g", v);
+    } else {
+        fputs("null", out);
+    }
+}
+
+void sim_reg_write_summary(FILE *out, const sim_reg_scenario_t *scenarios,
+                           const sim_reg_result_t *results, int count,
+                           double wall_time) {
+    if (out == NULL || scenarios == NULL || results == NULL) return;
+
+    int passed = 0;
+    for (int i = 0; i < count; i++) {
+        if (results[i].pass) passed++;
+    }
+
+    fprintf(out, "{\n  \"total\": %d,\n  \"passed\": %d,\n  \"failed\": %d,\n  \"wall_time\": ",
+            count, passed, count - passed);
+    json_number(out, wall_time);
+    fprintf(out, ",\n  \"scenarios\": [");
+
+    for (int i = 0; i < count; i++) {
+        const sim_reg_scenario_t *s = &scenarios[i];
+        const sim_reg_result_t *r = &results[i];
+
+        fprintf(out, "%s\n    {\"name\": ", (i > 0) ? "," : "");
+        json_string(out, s->name);
+        fprintf(out, ", \"pass\": %s, \"result\": %d, \"reference\": ",
+                r->pass ? "true" : "false", r->result);
+        json_string(out, s->reference);
+        fprintf(out, ", \"reference_missing\": %s, \"points\": %d, \"align\": \"%s\", \"wall_time\": ",
+                r->reference_missing ? "true" : "false", r->compared_points, align_names[s->align]);
+        json_number(out, r->wall_time);
+        fprintf(out, ",\n     \"signals\": {");
+
+        bool first = true;
+        for (int f = 1; f < SIM_DATA_NUM_FIELDS; f++) {
+            const sim_reg_signal_result_t *sig = &r->signals[f];
+            if (!sig->checked) continue;
+
+            fprintf(out, "%s\n       \"%s\": {\"pass\": %s, \"max_error\": ",
+                    first ? "" : ",", sim_data_field_name(f), sig->pass ? "true" : "false");
+            json_number(out, sig->max_error);
+            fprintf(out, ", \"worst_ratio\": ");
+            json_number(out, sig->worst_ratio);
+            fprintf(out, ", \"lag\": ");
+            json_number(out, sig->lag);
+            fprintf(out, "}");
+            first = false;
+        }
+
+        fprintf(out, "%s}}", first ? "" : "\n     ");
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+}
+
+int sim_reg_save_summary(const char *filename, const sim_reg_scenario_t *scenarios,
+                         const sim_reg_result_t *results, int count,
+                         double wall_time) {
+    if (filename == NULL) return -1;
+
+    FILE *out = fopen(filename, "w");
+    if (out == NULL) return -1;
+
+    sim_reg_write_summary(out, scenarios, results, count, wall_time);
+    fclose(out);
+
+    return 0;
+}
@@ -0,0 +1,229 @@
+/**
+ * @file simulation_regression.h
+ * @brief Manifest-driven regression runner with golden-trace comparison
+ *
+ * A manifest describes many closed-loop scenarios in one text file. Each
+ * scenario is simulated, recorded in memory at output_dt and compared
+ * signal by signal against its golden trace (a simulation_data CSV file)
+ * within a tolerance envelope:
+ *
+ *   |test - ref| <= abs + rel * |ref|
+ *
+ * The comparison can absorb small timing differences (e.g. an event that
+ * happens one control period later) either with a lag search, which
+ * shifts the whole signal by up to max_lag, or with dynamic time warping
+ * in a band of max_lag, which also absorbs local stretching. All
+ * scenarios run concurrently on the sim_sweep_parallel_for() pool.
+ *
+ * Manifest format, one "key = value" per line, '#' starts a comment:
+ *
+ *   [defaults]              # Applies to all scenarios that follow
+ *   tol.iq = 0.2 0.05       # Envelope of a signal: abs [rel]
+ *   align = lag
+ *   max_lag = 0.002
+ *
+ *   [speed_step_medium]     # Starts a scenario
+ *   preset = medium         # default | small | medium | large
+ *   mode = speed            # current | speed | position | duty
+ *   setpoint = step 0.05 2000 5000
+ *   load = ramp 0.1 0.2 0 0.05
+ *   duration = 0.2
+ *   reference = golden/speed_step_medium.csv
+ *
+ * Other keys: inertia, id_ref, control_dt, model_dt, output_dt,
+ * integrator (euler | rk4 | exact | adaptive) and
+ * inverter (off | averaged | switching). Reference paths are relative to
+ * the manifest.
+ *
+ * Profiles (setpoint in the unit of the mode: A, ERPM, deg or duty; load
+ * in Nm):
+ *
+ *   const V | V
+ *   step T V0 V1
+ *   ramp T0 T1 V0 V1
+ *   pwl t:v t:v ...         # Linear between points, held outside
+ *   steps t:v t:v ...       # Each value held from its time on
+ */
+
+#ifndef SIMULATION_REGRESSION_H_
+#define SIMULATION_REGRESSION_H_
+
+#include "simulation_driver.h"
+#include "simulation_data.h"
+#include <stdio.h>
+
+#define SIM_REG_NAME_LEN        48
+#define SIM_REG_PATH_LEN        256
+#define SIM_REG_PROFILE_POINTS  16
+
+// Time profile of a setpoint or load
+typedef struct {
+    int num_points;                     // 0 = not set
+    bool linear;                        // Interpolate, otherwise hold
+    float t[SIM_REG_PROFILE_POINTS];    // Point times [s], ascending
+    float v[SIM_REG_PROFILE_POINTS];    // Values
+} sim_reg_profile_t;
+
+// Alignment of test and reference before the envelope check
+typedef enum {
+    SIM_REG_ALIGN_NONE = 0,             // Sample by sample
+    SIM_REG_ALIGN_LAG,                  // Best constant shift within max_lag
+    SIM_REG_ALIGN_DTW                   // Dynamic time warping within max_lag
+} sim_reg_align_e;
+
+// Tolerance envelope of one signal
+typedef struct {
+    bool enable;
+    float abs_tol;
+    float rel_tol;
+} sim_reg_tolerance_t;
+
+// One regression scenario
+typedef struct {
+    char name[SIM_REG_NAME_LEN];
+    char preset[16];
+    mc_configuration mc_conf;           // Configuration of the preset
+    sim_control_mode_e mode;
+    sim_reg_profile_t setpoint;
+    sim_reg_profile_t load;
+    float id_ref;                       // [A]
+    float inertia;                      // [kg·m²]
+    float control_dt;                   // [s], 0 = current sample period of the preset
+    float model_dt;                     // [s]
+    float output_dt;                    // Record interval [s]
+    float duration;                     // [s]
+    vm_integrator_t integrator;
+    bool inverter_enable;
+    inverter_mode_e inverter_mode;
+    char reference[SIM_REG_PATH_LEN];   // Golden trace
+    sim_reg_align_e align;
+    float max_lag;                      // [s]
+    sim_reg_tolerance_t tol[SIM_DATA_NUM_FIELDS];
+} sim_reg_scenario_t;
+
+// Comparison of one signal
+typedef struct {
+    bool checked;
+    bool pass;
+    float max_error;                    // Largest absolute error after alignment
+    float worst_ratio;                  // Largest error relative to the envelope, <= 1 passes
+    float lag;                          // LAG: shift of the test trace, DTW: largest warp [s]
+} sim_reg_signal_result_t;
+
+// Result of one scenario
+typedef struct {
+    int result;                         // Simulation result, 0 = completed
+    bool pass;
+    bool reference_missing;
+    int compared_points;
+    sim_reg_signal_result_t signals[SIM_DATA_NUM_FIELDS];
+    double wall_time;                   // Simulation and comparison [s]
+
+    sim_data_record_t *trace;           // Recorded trace
+    int trace_count;
+    sim_data_record_t *reference;       // Golden trace
+    int reference_count;
+} sim_reg_result_t;
+
+// ==== Manifest ====
+
+/**
+ * @brief Scenario with the built-in defaults: default preset, current
+ * mode, control at the current sample rate of the preset, 1 kHz output,
+ * 0.1 s, lag alignment within 2 ms and no signal checked
+ */
+void sim_reg_scenario_init(sim_reg_scenario_t *scn);
+
+/**
+ * @brief Parse a manifest held in memory
+ *
+ * @param text Manifest text
+ * @param base_dir Directory that reference paths are relative to, or NULL
+ * @param scenarios Receives a malloc'ed array, free with free()
+ * @param err Receives a "line N: ..." message on error, may be NULL
+ * @param err_len Size of err
+ * @return Number of scenarios, or -1 on error
+ */
+int sim_reg_parse_manifest(const char *text, const char *base_dir,
+                           sim_reg_scenario_t **scenarios,
+                           char *err, size_t err_len);
+
+/**
+ * @brief Read and parse a manifest file
+ * @return Number of scenarios, or -1 on error
+ */
+int sim_reg_load_manifest(const char *filename, sim_reg_scenario_t **scenarios,
+                          char *err, size_t err_len);
+
+/**
+ * @brief Value of a profile at time t
+ */
+float sim_reg_profile_eval(const sim_reg_profile_t *p, float t);
+
+// ==== Comparison ====
+
+/**
+ * @brief Compare one signal against its reference
+ *
+ * @param ref Reference samples, stride floats apart
+ * @param test Test samples, stride floats apart
+ * @param count Samples in both
+ * @param stride Distance between samples [floats], 1 for plain arrays
+ * @param tol Tolerance envelope
+ * @param align Alignment method
+ * @param max_lag Largest shift or warp [samples]
+ * @param dt Sample interval, for reporting the lag [s]
+ * @param out Result
+ */
+void sim_reg_compare_signal(const float *ref, const float *test,
+                            int count, int stride,
+                            const sim_reg_tolerance_t *tol,
+                            sim_reg_align_e align, int max_lag, float dt,
+                            sim_reg_signal_result_t *out);
+
+// ==== Runner ====
+
+/**
+ * @brief Simulate one scenario and compare it with result->reference
+ *
+ * Thread safe, does not touch the simulation_data recorder. Pass/fail is
+ * only evaluated when a reference is loaded.
+ */
+void sim_reg_run_scenario(const sim_reg_scenario_t *scn, sim_reg_result_t *result);
+
+/**
+ * @brief Load the golden traces, then run all scenarios on a thread pool
+ *
+ * @param num_threads Worker threads, <= 0 to use all online CPUs
+ * @return Number of failed scenarios, or -1 on error
+ */
+int sim_reg_run(const sim_reg_scenario_t *scenarios, sim_reg_result_t *results,
+                int count, int num_threads);
+
+/**
+ * @brief Write the recorded trace of a scenario as its new golden trace
+ * @return 0 on success, -1 on error
+ */
+int sim_reg_save_golden(const sim_reg_scenario_t *scn, const sim_reg_result_t *result);
+
+/**
+ * @brief Free the traces held by results
+ */
+void sim_reg_free_results(sim_reg_result_t *results, int count);
+
+/**
+ * @brief Write the machine-readable summary of a run as JSON
+ */
+void sim_reg_write_summary(FILE *out, const sim_reg_scenario_t *scenarios,
+                           const sim_reg_result_t *results, int count,
+                           double wall_time);
+
+/**
+ * @brief Write the JSON summary to a file
+ * @return 0 on success, -1 on error
+ */
+int sim_reg_save_summary(const char *filename, const sim_reg_scenario_t *scenarios,
+                         const sim_reg_result_t *results, int count,
+                         double wall_time);
+
+#endif // SIMULATION_REGRESSION_H_
@@ -0,0 +1,209 @@
+/**
+ * @file simulation_sweep.c
+ * @brief Batch/parallel parameter sweep engine implementation
+ */
+
+#include "simulation_sweep.h"
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+// Shared state of one sim_sweep_parallel_for() call
+typedef struct {
+    sim_sweep_task_fn fn;
+    void *arg;
+    int count;
+    int next_index;
+    pthread_mutex_t lock;
+} sweep_queue_t;
+
+// Argument of sim_sweep_run() tasks
+typedef struct {
+    const sim_sweep_job_t *jobs;
+    sim_sweep_result_t *results;
+} sweep_jobs_t;
+
+static double wall_time_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+void sim_sweep_job_init(sim_sweep_job_t *job, const mc_configuration *base_conf) {
+    if (job == NULL) return;
+    
+    memset(job, 0, sizeof(sim_sweep_job_t));
+    
+    if (base_conf != NULL) {
+        memcpy(&job->mc_conf, base_conf, sizeof(mc_configuration));
+    } else {
+        mcconf_set_defaults(&job->mc_conf);
+    }
+    
+    job->command.mode = SIM_CTRL_CURRENT;
+    job->inertia = 0.0001f;
+    job->control_dt = 1.0f / 20000.0f;
+    job->model_dt = 1.0f / 100000.0f;
+    job->duration = 0.1f;
+}
+
+void sim_sweep_run_job(const sim_sweep_job_t *job, sim_sweep_result_t *result) {
+    if (job == NULL || result == NULL) return;
+    
+    memset(result, 0, sizeof(sim_sweep_result_t));
+    
+    // The context holds a full mc_configuration and is too large to keep
+    // on small worker stacks
+    sim_context_t *ctx = malloc(sizeof(sim_context_t));
+    if (ctx == NULL) {
+        result->result = -1;
+        return;
+    }
+    
+    double start = wall_time_now();
+    
+    sim_init(ctx);
+    sim_set_controller_params(ctx, (mc_configuration*)&job->mc_conf);
+    sim_set_inertia(ctx, job->inertia);
+    sim_set_timing(ctx, job->control_dt, job->model_dt, ctx->time.output_dt, job->duration);
+    sim_set_reference(ctx, (sim_command_t*)&job->command);
+    sim_set_disturbance(ctx, (sim_disturbance_t*)&job->disturbance);
+    
+    result->result = sim_run(ctx);
+    
+    sim_get_summary(ctx, &result->avg_speed, &result->avg_torque, &result->efficiency);
+    sim_get_response_metrics(ctx, &result->metrics);
+    sim_get_state(ctx, NULL, &result->final_iq, &result->final_erpm, NULL, NULL, NULL);
+    
+    result->wall_time = wall_time_now() - start;
+    
+    free(ctx);
+}
+
+static void *sweep_worker(void *arg) {
+    sweep_queue_t *q = (sweep_queue_t*)arg;
+    
+    for (;;) {
+        pthread_mutex_lock(&q->lock);
+        int ind = q->next_index++;
+        pthread_mutex_unlock(&q->lock);
+        
+        if (ind >= q->count) break;
+        
+        q->fn(ind, q->arg);
+    }
+    
+    return NULL;
+}
+
+int sim_sweep_get_num_cpus(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n < 1) ? 1 : (int)n;
+}
+
+int sim_sweep_parallel_for(int count, int num_threads, sim_sweep_task_fn fn, void *arg) {
+    if (fn == NULL || count < 0) return -1;
+    
+    if (num_threads <= 0) {
+        num_threads = sim_sweep_get_num_cpus();
+    }
+    if (num_threads > count) {
+        num_threads = count;
+    }
+    
+    sweep_queue_t q;
+    q.fn = fn;
+    q.arg = arg;
+    q.count = count;
+    q.next_index = 0;
+    pthread_mutex_init(&q.lock, NULL);
+    
+    pthread_t *threads = malloc(sizeof(pthread_t) * (size_t)(num_threads > 0 ? num_threads : 1));
+    if (threads == NULL) {
+        pthread_mutex_destroy(&q.lock);
+        return -1;
+    }
+    
+    int started = 0;
+    for (int i = 0; i < num_threads; i++) {
+        if (pthread_create(&threads[started], NULL, sweep_worker, &q) == 0) {
+            started++;
+        }
+    }
+    
+    // Run in the calling thread if no worker could be started
+    if (started == 0) {
+        sweep_worker(&q);
+    }
+    
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    
+    free(threads);
+    pthread_mutex_destroy(&q.lock);
+    
+    return 0;
+}
+
+static void sweep_job_task(int index, void *arg) {
+    sweep_jobs_t *s = (sweep_jobs_t*)arg;
+    sim_sweep_run_job(&s->jobs[index], &s->results[index]);
+}
+
+int sim_sweep_run(const sim_sweep_job_t *jobs, sim_sweep_result_t *results,
+                  int count, int num_threads) {
+    if (jobs == NULL || results == NULL || count < 0) return -1;
+    
+    sweep_jobs_t s;
+    s.jobs = jobs;
+    s.results = results;
+    
+    if (sim_sweep_parallel_for(count, num_threads, sweep_job_task, &s) < 0) {
+        return -1;
+    }
+    
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        if (results[i].result != 0) failed++;
+    }
+    
+    return failed;
+}
+
+void sim_sweep_write_summary(FILE *out,
+                             const sim_sweep_job_t *jobs,
+                             const sim_sweep_result_t *results,
+                             int count) {
+    if (out == NULL || jobs == NULL || results == NULL) return;
+    
+    fprintf(out, "job,label,result,settling_time,overshoot,rms_error,final_error,"
+            "avg_speed,avg_torque,efficiency,final_erpm,final_iq,wall_time\n");
+    
+    for (int i = 0; i < count; i++) {
+        const sim_sweep_result_t *r = &results[i];
+        fprintf(out, "%d,%s,%d,%.6f,%.3f,%.6f,%.6f,%.3f,%.6f,%.2f,%.3f,%.4f,%.4f\n",
+                i, jobs[i].label, r->result,
+                r->metrics.settling_time, r->metrics.overshoot,
+                r->metrics.rms_error, r->metrics.final_error,
+                r->avg_speed, r->avg_torque, r->efficiency,
+                r->final_erpm, r->final_iq, r->wall_time);
+    }
+}
+
+int sim_sweep_save_summary(const char *filename,
+                           const sim_sweep_job_t *jobs,
+                           const sim_sweep_result_t *results,
+                           int count) {
+    if (filename == NULL) return -1;
+    
+    FILE *out = fopen(filename, "w");
+    if (out == NULL) return -1;
+    
+    sim_sweep_write_summary(out, jobs, results, count);
+    fclose(out);
+    
+    return 0;
+}
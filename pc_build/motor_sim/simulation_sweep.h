@@ -0,0 +1,107 @@
+/**
+ * @file simulation_sweep.h
+ * @brief Batch/parallel parameter sweep engine for the motor simulator
+ * 
+ * Runs many independent simulation jobs (e.g. mc_configuration variants
+ * with different PI, observer or FW parameters) on a pool of worker
+ * threads and collects a summary row per job.
+ * 
+ * Jobs do not record traces: the data recorder in simulation_data.c is
+ * shared by the whole process, so recording is always disabled for sweep
+ * jobs and only the summary metrics are kept.
+ */
+
+#ifndef SIMULATION_SWEEP_H_
+#define SIMULATION_SWEEP_H_
+
+#include "simulation_driver.h"
+#include <stdio.h>
+
+#define SIM_SWEEP_LABEL_LEN     48
+
+// One simulation run of a sweep
+typedef struct {
+    char label[SIM_SWEEP_LABEL_LEN];  // Free-form name printed in the summary
+    mc_configuration mc_conf;         // Motor/controller configuration
+    sim_command_t command;            // Control reference
+    sim_disturbance_t disturbance;    // Disturbance profile
+    float inertia;                    // Rotor inertia [kg·m²]
+    float control_dt;                 // Control loop time step [s]
+    float model_dt;                   // Motor model time step [s]
+    float duration;                   // Simulated time [s]
+} sim_sweep_job_t;
+
+// Result of one job
+typedef struct {
+    int result;                       // Return value of sim_run()
+    float avg_speed;                  // From sim_get_summary()
+    float avg_torque;
+    float efficiency;
+    sim_response_metrics_t metrics;   // From sim_get_response_metrics()
+    float final_erpm;
+    float final_iq;
+    double wall_time;                 // Wall clock time for the job [s]
+} sim_sweep_result_t;
+
+/**
+ * @brief Initialize a job with a base configuration and default timing
+ * 
+ * @param job Job to initialize
+ * @param base_conf Configuration to copy, or NULL for mcconf_set_defaults()
+ */
+void sim_sweep_job_init(sim_sweep_job_t *job, const mc_configuration *base_conf);
+
+/**
+ * @brief Run a single job in the calling thread
+ */
+void sim_sweep_run_job(const sim_sweep_job_t *job, sim_sweep_result_t *result);
+
+/**
+ * @brief Run all jobs on a thread pool
+ * 
+ * @param jobs Array of jobs
+ * @param results Array receiving one result per job
+ * @param count Number of jobs
+ * @param num_threads Worker threads, <= 0 to use all online CPUs
+ * @return Number of jobs whose simulation failed, or -1 on error
+ */
+int sim_sweep_run(const sim_sweep_job_t *jobs, sim_sweep_result_t *results,
+                  int count, int num_threads);
+
+/**
+ * @brief Number of online host CPUs (at least 1)
+ */
+int sim_sweep_get_num_cpus(void);
+
+// Task of sim_sweep_parallel_for(), called once per index
+typedef void (*sim_sweep_task_fn)(int index, void *arg);
+
+/**
+ * @brief Call fn(0..count-1, arg) on a thread pool
+ * 
+ * Indices are handed out one at a time, so tasks of very different
+ * length still balance across the workers.
+ * 
+ * @param num_threads Worker threads, <= 0 to use all online CPUs
+ * @return 0 when all tasks ran, -1 on error
+ */
+int sim_sweep_parallel_for(int count, int num_threads, sim_sweep_task_fn fn, void *arg);
+
+/**
+ * @brief Write the combined summary table as CSV
+ */
+void sim_sweep_write_summary(FILE *out,
+                             const sim_sweep_job_t *jobs,
+                             const sim_sweep_result_t *results,
+                             int count);
+
+/**
+ * @brief Write the combined summary table as CSV to a file
+ * @return 0 on success, -1 on error
+ */
+int sim_sweep_save_summary(const char *filename,
+                           const sim_sweep_job_t *jobs,
+                           const sim_sweep_result_t *results,
+                           int count);
+
+#endif // SIMULATION_SWEEP_H_
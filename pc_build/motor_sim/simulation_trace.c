@@ -0,0 +1,606 @@
+/**
+ * @file simulation_trace.c
+ * @brief Chunked columnar trace writer and mmap reader
+ */
+
+#include "simulation_trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TRACE_MAGIC         "SIMTRC01"
+#define TRACE_CHUNK_MAGIC   "CHNK"
+#define TRACE_VERSION       1
+
+// A page fault on a file mapping also maps the cached pages around it
+// (fault-around, 64 KiB by default, more with large folios), which can
+// bring back pages of chunks that were already released. Releasing a
+// chunk therefore also drops this much of the file before it.
+#define TRACE_RELEASE_BEHIND    (256 * 1024)
+
+// On-disk layout. All members are 4-byte quantities, so there is no
+// padding and every structure keeps the 4-byte alignment of the file.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_columns;
+    uint32_t chunk_records;
+    uint32_t reserved;
+} trace_file_header_t;
+
+typedef struct {
+    char name[SIM_TRACE_NAME_LEN];
+    uint32_t codec;
+    uint32_t reserved;
+} trace_column_desc_t;
+
+typedef struct {
+    char magic[4];
+    uint32_t num_records;
+} trace_chunk_header_t;
+
+typedef struct {
+    uint32_t codec;
+    uint32_t size;      // Encoded size in bytes, before padding
+    float p0;           // QUANT16: offset
+    float p1;           // QUANT16: scale
+} trace_block_desc_t;
+
+struct sim_trace_writer {
+    FILE *file;
+    int num_columns;
+    uint32_t chunk_records;
+    uint32_t count;
+    sim_trace_codec_e codec[SIM_TRACE_MAX_COLUMNS];
+    float *columns;             // num_columns x chunk_records
+    uint8_t *encoded;           // One encode buffer per column
+    size_t encoded_stride;
+    bool failed;
+};
+
+struct sim_trace {
+    int fd;
+    const uint8_t *map;
+    size_t map_size;
+    int num_columns;
+    uint32_t chunk_records;
+    trace_column_desc_t columns[SIM_TRACE_MAX_COLUMNS];
+    int num_chunks;
+    size_t *chunk_offset;
+    uint32_t *chunk_count;
+    uint64_t num_records;
+    float *scratch[SIM_TRACE_MAX_COLUMNS];
+    int scratch_chunk[SIM_TRACE_MAX_COLUMNS];
+};
+
+static inline size_t pad4(size_t n) {
+    return (n + 3) & ~(size_t)3;
+}
+
+static inline uint32_t float_bits(float f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+static inline float bits_float(uint32_t u) {
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+// ==================== Codecs ====================
+
+// DELTA: the bit patterns of a smoothly varying float differ by small
+// integers as long as the exponent does not change, and a uniformly
+// sampled time axis has an almost constant difference. Storing the second
+// difference as a zigzag varint is lossless and brings the time column
+// down to about one byte per record.
+static size_t encode_delta(const float *in, uint32_t n, uint8_t *out) {
+    uint8_t *p = out;
+    uint32_t prev = 0;
+    uint32_t prev_d = 0;
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t u = float_bits(in[i]);
+        uint32_t d = u - prev;
+        int32_t dd = (int32_t)(d - prev_d);
+        uint32_t z = ((uint32_t)dd << 1) ^ (uint32_t)(dd >> 31);
+        prev = u;
+        prev_d = d;
+
+        while (z >= 0x80) {
+            *p++ = (uint8_t)(z | 0x80);
+            z >>= 7;
+        }
+        *p++ = (uint8_t)z;
+    }
+
+    return (size_t)(p - out);
+}
+
+static int decode_delta(const uint8_t *in, size_t size, uint32_t n, float *out) {
+    const uint8_t *p = in;
+    const uint8_t *end = in + size;
+    uint32_t prev = 0;
+    uint32_t prev_d = 0;
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t z = 0;
+        int shift = 0;
+        for (;;) {
+            if (p >= end || shift > 28) {
+                return -1;
+            }
+            uint8_t b = *p++;
+            z |= (uint32_t)(b & 0x7F) << shift;
+            if ((b & 0x80) == 0) {
+                break;
+            }
+            shift += 7;
+        }
+
+        int32_t dd = (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+        prev_d += (uint32_t)dd;
+        prev += prev_d;
+        out[i] = bits_float(prev);
+    }
+
+    return 0;
+}
+
+// QUANT16: maps the block range onto 0..65535. The error is bounded by
+// half a step, (max - min) / 131070. Blocks with non-finite values are
+// stored raw instead.
+static bool encode_quant16(const float *in, uint32_t n, uint8_t *out,
+                           size_t *size, float *offset, float *scale) {
+    float min = in[0];
+    float max = in[0];
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (!isfinite(in[i])) {
+            return false;
+        }
+        if (in[i] < min) min = in[i];
+        if (in[i] > max) max = in[i];
+    }
+
+    float s = (max - min) / 65535.0f;
+    uint16_t *q = (uint16_t*)out;
+
+    for (uint32_t i = 0; i < n; i++) {
+        long v = (s > 0.0f) ? lrintf((in[i] - min) / s) : 0;
+        if (v < 0) v = 0;
+        if (v > 65535) v = 65535;
+        q[i] = (uint16_t)v;
+    }
+
+    *size = (size_t)n * sizeof(uint16_t);
+    *offset = min;
+    *scale = s;
+    return true;
+}
+
+static void decode_quant16(const uint8_t *in, uint32_t n, float offset, float scale, float *out) {
+    const uint16_t *q = (const uint16_t*)in;
+
+    for (uint32_t i = 0; i < n; i++) {
+        out[i] = offset + (float)q[i] * scale;
+    }
+}
+
+// ==================== Writer ====================
+
+void sim_trace_default_options(sim_trace_options_t *opt) {
+    memset(opt, 0, sizeof(*opt));
+    opt->chunk_records = SIM_TRACE_DEFAULT_CHUNK;
+    for (int i = 0; i < SIM_TRACE_MAX_COLUMNS; i++) {
+        opt->codec[i] = SIM_TRACE_CODEC_RAW;
+    }
+    opt->codec[0] = SIM_TRACE_CODEC_DELTA;
+}
+
+static void writer_put(sim_trace_writer_t *w, const void *data, size_t size) {
+    if (size > 0 && fwrite(data, 1, size, w->file) != size) {
+        w->failed = true;
+    }
+}
+
+static void writer_flush_chunk(sim_trace_writer_t *w) {
+    if (w->count == 0) {
+        return;
+    }
+
+    trace_chunk_header_t hdr;
+    trace_block_desc_t desc[SIM_TRACE_MAX_COLUMNS];
+
+    memcpy(hdr.magic, TRACE_CHUNK_MAGIC, sizeof(hdr.magic));
+    hdr.num_records = w->count;
+
+    for (int c = 0; c < w->num_columns; c++) {
+        const float *col = w->columns + (size_t)c * w->chunk_records;
+        uint8_t *enc = w->encoded + (size_t)c * w->encoded_stride;
+        size_t size = 0;
+
+        desc[c].codec = w->codec[c];
+        desc[c].p0 = 0.0f;
+        desc[c].p1 = 0.0f;
+
+        switch (w->codec[c]) {
+        case SIM_TRACE_CODEC_DELTA:
+            size = encode_delta(col, w->count, enc);
+            break;
+
+        case SIM_TRACE_CODEC_QUANT16:
+            if (encode_quant16(col, w->count, enc, &size, &desc[c].p0, &desc[c].p1)) {
+                break;
+            }
+            desc[c].codec = SIM_TRACE_CODEC_RAW;
+            size = (size_t)w->count * sizeof(float);
+            break;
+
+        default:
+            size = (size_t)w->count * sizeof(float);
+            break;
+        }
+
+        desc[c].size = (uint32_t)size;
+    }
+
+    writer_put(w, &hdr, sizeof(hdr));
+    writer_put(w, desc, sizeof(desc[0]) * (size_t)w->num_columns);
+
+    static const uint8_t zeros[4] = {0};
+    for (int c = 0; c < w->num_columns; c++) {
+        const void *data = (desc[c].codec == SIM_TRACE_CODEC_RAW) ?
+                (const void*)(w->columns + (size_t)c * w->chunk_records) :
+                (const void*)(w->encoded + (size_t)c * w->encoded_stride);
+        writer_put(w, data, desc[c].size);
+        writer_put(w, zeros, pad4(desc[c].size) - desc[c].size);
+    }
+
+    w->count = 0;
+}
+
+sim_trace_writer_t *sim_trace_writer_open(const char *filename, int num_columns,
+                                          const char * const *names,
+                                          const sim_trace_options_t *opt) {
+    if (filename == NULL || num_columns < 1 || num_columns > SIM_TRACE_MAX_COLUMNS) {
+        return NULL;
+    }
+
+    sim_trace_options_t def;
+    if (opt == NULL) {
+        sim_trace_default_options(&def);
+        opt = &def;
+    }
+    if (opt->chunk_records == 0) {
+        return NULL;
+    }
+
+    sim_trace_writer_t *w = calloc(1, sizeof(sim_trace_writer_t));
+    if (w == NULL) {
+        return NULL;
+    }
+
+    w->num_columns = num_columns;
+    w->chunk_records = opt->chunk_records;
+    // Worst case is a 5-byte varint per value
+    w->encoded_stride = pad4((size_t)w->chunk_records * 5);
+    w->columns = malloc((size_t)num_columns * w->chunk_records * sizeof(float));
+    w->encoded = malloc((size_t)num_columns * w->encoded_stride);
+    w->file = fopen(filename, "wb");
+
+    if (w->columns == NULL || w->encoded == NULL || w->file == NULL) {
+        if (w->file != NULL) {
+            fclose(w->file);
+        }
+        free(w->columns);
+        free(w->encoded);
+        free(w);
+        return NULL;
+    }
+
+    trace_file_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.version = TRACE_VERSION;
+    hdr.num_columns = (uint32_t)num_columns;
+    hdr.chunk_records = w->chunk_records;
+    writer_put(w, &hdr, sizeof(hdr));
+
+    for (int c = 0; c < num_columns; c++) {
+        trace_column_desc_t desc;
+        memset(&desc, 0, sizeof(desc));
+        if (names != NULL && names[c] != NULL) {
+            strncpy(desc.name, names[c], SIM_TRACE_NAME_LEN - 1);
+        } else {
+            snprintf(desc.name, SIM_TRACE_NAME_LEN, "c%d", c);
+        }
+        w->codec[c] = opt->codec[c];
+        desc.codec = (uint32_t)opt->codec[c];
+        writer_put(w, &desc, sizeof(desc));
+    }
+
+    return w;
+}
+
+int sim_trace_writer_append(sim_trace_writer_t *w, const float *row) {
+    if (w == NULL || row == NULL) return -1;
+
+    for (int c = 0; c < w->num_columns; c++) {
+        w->columns[(size_t)c * w->chunk_records + w->count] = row[c];
+    }
+
+    if (++w->count == w->chunk_records) {
+        writer_flush_chunk(w);
+    }
+
+    return w->failed ? -1 : 0;
+}
+
+int sim_trace_writer_close(sim_trace_writer_t *w) {
+    if (w == NULL) return -1;
+
+    writer_flush_chunk(w);
+    if (fclose(w->file) != 0) {
+        w->failed = true;
+    }
+
+    int res = w->failed ? -1 : 0;
+    free(w->columns);
+    free(w->encoded);
+    free(w);
+    return res;
+}
+
+// ==================== Reader ====================
+
+static const trace_block_desc_t *chunk_blocks(const sim_trace_t *t, int chunk) {
+    return (const trace_block_desc_t*)(t->map + t->chunk_offset[chunk] +
+                                       sizeof(trace_chunk_header_t));
+}
+
+// Returns the size of the chunk at offset, or 0 if it is truncated or invalid.
+// The chunk header is read with pread() rather than through the mapping, so
+// that indexing a large trace does not fault in the neighbouring data pages.
+static size_t scan_chunk(const sim_trace_t *t, size_t offset, uint32_t *count) {
+    struct {
+        trace_chunk_header_t hdr;
+        trace_block_desc_t desc[SIM_TRACE_MAX_COLUMNS];
+    } buf;
+    size_t head = sizeof(trace_chunk_header_t) +
+            sizeof(trace_block_desc_t) * (size_t)t->num_columns;
+    size_t pos = offset + head;
+
+    if (pos > t->map_size || pread(t->fd, &buf, head, (off_t)offset) != (ssize_t)head) {
+        return 0;
+    }
+
+    const trace_chunk_header_t *hdr = &buf.hdr;
+    if (memcmp(hdr->magic, TRACE_CHUNK_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->num_records == 0 || hdr->num_records > t->chunk_records) {
+        return 0;
+    }
+
+    const trace_block_desc_t *desc = buf.desc;
+    for (int c = 0; c < t->num_columns; c++) {
+        pos += pad4(desc[c].size);
+    }
+    if (pos > t->map_size) {
+        return 0;
+    }
+
+    *count = hdr->num_records;
+    return pos - offset;
+}
+
+sim_trace_t *sim_trace_open(const char *filename) {
+    if (filename == NULL) return NULL;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(trace_file_header_t)) {
+        close(fd);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    sim_trace_t *t = calloc(1, sizeof(sim_trace_t));
+    if (t == NULL) {
+        munmap(map, (size_t)st.st_size);
+        close(fd);
+        return NULL;
+    }
+
+    t->fd = fd;
+    t->map = map;
+    t->map_size = (size_t)st.st_size;
+
+    const trace_file_header_t *hdr = (const trace_file_header_t*)t->map;
+    size_t offset = sizeof(trace_file_header_t) +
+            sizeof(trace_column_desc_t) * (size_t)hdr->num_columns;
+
+    if (memcmp(hdr->magic, TRACE_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != TRACE_VERSION ||
+        hdr->num_columns < 1 || hdr->num_columns > SIM_TRACE_MAX_COLUMNS ||
+        hdr->chunk_records == 0 || offset > t->map_size) {
+        sim_trace_close(t);
+        return NULL;
+    }
+
+    t->num_columns = (int)hdr->num_columns;
+    t->chunk_records = hdr->chunk_records;
+    memcpy(t->columns, hdr + 1, sizeof(trace_column_desc_t) * (size_t)t->num_columns);
+    for (int c = 0; c < t->num_columns; c++) {
+        t->columns[c].name[SIM_TRACE_NAME_LEN - 1] = '\0';
+        t->scratch_chunk[c] = -1;
+    }
+
+    // Index the chunks
+    int capacity = 0;
+    for (;;) {
+        uint32_t count = 0;
+        size_t size = scan_chunk(t, offset, &count);
+        if (size == 0) {
+            break;
+        }
+
+        if (t->num_chunks == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            size_t *offs = realloc(t->chunk_offset, sizeof(size_t) * (size_t)capacity);
+            uint32_t *counts = realloc(t->chunk_count, sizeof(uint32_t) * (size_t)capacity);
+            if (offs != NULL) t->chunk_offset = offs;
+            if (counts != NULL) t->chunk_count = counts;
+            if (offs == NULL || counts == NULL) {
+                sim_trace_close(t);
+                return NULL;
+            }
+        }
+
+        t->chunk_offset[t->num_chunks] = offset;
+        t->chunk_count[t->num_chunks] = count;
+        t->num_chunks++;
+        t->num_records += count;
+        offset += size;
+    }
+
+    return t;
+}
+
+void sim_trace_close(sim_trace_t *t) {
+    if (t == NULL) return;
+
+    for (int c = 0; c < SIM_TRACE_MAX_COLUMNS; c++) {
+        free(t->scratch[c]);
+    }
+    free(t->chunk_offset);
+    free(t->chunk_count);
+    munmap((void*)t->map, t->map_size);
+    close(t->fd);
+    free(t);
+}
+
+int sim_trace_num_columns(const sim_trace_t *t) {
+    return t ? t->num_columns : 0;
+}
+
+const char *sim_trace_column_name(const sim_trace_t *t, int column) {
+    if (t == NULL || column < 0 || column >= t->num_columns) return NULL;
+    return t->columns[column].name;
+}
+
+int sim_trace_find_column(const sim_trace_t *t, const char *name) {
+    if (t == NULL || name == NULL) return -1;
+
+    for (int c = 0; c < t->num_columns; c++) {
+        if (strcmp(t->columns[c].name, name) == 0) {
+            return c;
+        }
+    }
+    return -1;
+}
+
+uint64_t sim_trace_num_records(const sim_trace_t *t) {
+    return t ? t->num_records : 0;
+}
+
+int sim_trace_num_chunks(const sim_trace_t *t) {
+    return t ? t->num_chunks : 0;
+}
+
+uint32_t sim_trace_chunk_records(const sim_trace_t *t, int chunk) {
+    if (t == NULL || chunk < 0 || chunk >= t->num_chunks) return 0;
+    return t->chunk_count[chunk];
+}
+
+const float *sim_trace_column(sim_trace_t *t, int chunk, int column) {
+    if (t == NULL || chunk < 0 || chunk >= t->num_chunks ||
+        column < 0 || column >= t->num_columns) {
+        return NULL;
+    }
+
+    const trace_block_desc_t *desc = chunk_blocks(t, chunk);
+    const uint8_t *block = (const uint8_t*)(desc + t->num_columns);
+    for (int c = 0; c < column; c++) {
+        block += pad4(desc[c].size);
+    }
+
+    uint32_t n = t->chunk_count[chunk];
+    const trace_block_desc_t *d = &desc[column];
+
+    if (d->codec == SIM_TRACE_CODEC_RAW) {
+        return (d->size == n * sizeof(float)) ? (const float*)block : NULL;
+    }
+
+    if (t->scratch_chunk[column] == chunk) {
+        return t->scratch[column];
+    }
+
+    if (t->scratch[column] == NULL) {
+        t->scratch[column] = malloc(sizeof(float) * t->chunk_records);
+        if (t->scratch[column] == NULL) {
+            return NULL;
+        }
+    }
+
+    float *out = t->scratch[column];
+    t->scratch_chunk[column] = -1;
+
+    switch (d->codec) {
+    case SIM_TRACE_CODEC_DELTA:
+        if (decode_delta(block, d->size, n, out) != 0) {
+            return NULL;
+        }
+        break;
+
+    case SIM_TRACE_CODEC_QUANT16:
+        if (d->size != n * sizeof(uint16_t)) {
+            return NULL;
+        }
+        decode_quant16(block, n, d->p0, d->p1, out);
+        break;
+
+    default:
+        return NULL;
+    }
+
+    t->scratch_chunk[column] = chunk;
+    return out;
+}
+
+void sim_trace_release_chunk(sim_trace_t *t, int chunk) {
+    if (t == NULL || chunk < 0 || chunk >= t->num_chunks) return;
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = t->chunk_offset[chunk];
+    size_t end = (chunk + 1 < t->num_chunks) ? t->chunk_offset[chunk + 1] : t->map_size;
+
+    // Pages shared with a neighbouring chunk are dropped too, they are
+    // simply faulted in again if that chunk is read later.
+    start = (start > TRACE_RELEASE_BEHIND) ? start - TRACE_RELEASE_BEHIND : 0;
+    start &= ~(page - 1);
+    end = (end + page - 1) & ~(page - 1);
+    if (end > t->map_size) {
+        end = (t->map_size + page - 1) & ~(page - 1);
+    }
+
+    if (end > start) {
+        madvise((void*)(t->map + start), end - start, MADV_DONTNEED);
+    }
+}
@@ -0,0 +1,130 @@
+/**
+ * @file simulation_trace.h
+ * @brief Chunked columnar trace format with an mmap reader
+ *
+ * Long simulations are recorded column by column in fixed-size chunks
+ * instead of one text line per record:
+ *
+ *   file   = header, chunk, chunk, ...
+ *   header = magic "SIMTRC01", version, column count, records per chunk,
+ *            then one {name, codec} descriptor per column
+ *   chunk  = magic "CHNK", record count, one {codec, size, p0, p1}
+ *            block descriptor per column, then the column blocks
+ *
+ * Every block starts on a 4-byte boundary, so SIM_TRACE_CODEC_RAW blocks
+ * are handed out as float pointers straight into the mapping. Compressed
+ * blocks are decoded into one scratch buffer per column, so a reader
+ * never holds more than one chunk of decoded data regardless of trace
+ * length. All values are stored in host byte order.
+ *
+ * A trace that was not closed cleanly (e.g. a crashed run) is still
+ * readable up to the last complete chunk.
+ */
+
+#ifndef SIMULATION_TRACE_H_
+#define SIMULATION_TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SIM_TRACE_MAX_COLUMNS       32
+#define SIM_TRACE_NAME_LEN          24
+#define SIM_TRACE_DEFAULT_CHUNK     4096
+
+// Per-column block encoding
+typedef enum {
+    SIM_TRACE_CODEC_RAW = 0,    // float32, zero-copy when read
+    SIM_TRACE_CODEC_DELTA,      // Lossless: zigzag varint of the 2nd difference of the float bits
+    SIM_TRACE_CODEC_QUANT16     // Lossy: 16-bit quantization over the block range
+} sim_trace_codec_e;
+
+// Writer options
+typedef struct {
+    uint32_t chunk_records;                     // Records per chunk
+    sim_trace_codec_e codec[SIM_TRACE_MAX_COLUMNS];
+} sim_trace_options_t;
+
+typedef struct sim_trace_writer sim_trace_writer_t;
+typedef struct sim_trace sim_trace_t;
+
+// ==== Writer ====
+
+/**
+ * @brief Default options: SIM_TRACE_DEFAULT_CHUNK records per chunk,
+ * DELTA for column 0 (time) and RAW for all other columns
+ */
+void sim_trace_default_options(sim_trace_options_t *opt);
+
+/**
+ * @brief Create a trace file
+ *
+ * @param filename Output path
+ * @param num_columns Number of float columns (1..SIM_TRACE_MAX_COLUMNS)
+ * @param names Column names, or NULL for "c0", "c1", ...
+ * @param opt Options, or NULL for sim_trace_default_options()
+ * @return Writer, or NULL on error
+ */
+sim_trace_writer_t *sim_trace_writer_open(const char *filename, int num_columns,
+                                          const char * const *names,
+                                          const sim_trace_options_t *opt);
+
+/**
+ * @brief Append one record of num_columns floats
+ * @return 0 on success, -1 on error
+ */
+int sim_trace_writer_append(sim_trace_writer_t *w, const float *row);
+
+/**
+ * @brief Flush the last partial chunk and close the file
+ * @return 0 on success, -1 if any write failed
+ */
+int sim_trace_writer_close(sim_trace_writer_t *w);
+
+// ==== Reader ====
+
+/**
+ * @brief Map a trace file for reading
+ * @return Reader, or NULL if the file is missing or not a trace
+ */
+sim_trace_t *sim_trace_open(const char *filename);
+
+void sim_trace_close(sim_trace_t *t);
+
+int sim_trace_num_columns(const sim_trace_t *t);
+const char *sim_trace_column_name(const sim_trace_t *t, int column);
+
+/**
+ * @brief Column index by name, or -1 if there is no such column
+ */
+int sim_trace_find_column(const sim_trace_t *t, const char *name);
+
+uint64_t sim_trace_num_records(const sim_trace_t *t);
+int sim_trace_num_chunks(const sim_trace_t *t);
+
+/**
+ * @brief Number of records in a chunk
+ */
+uint32_t sim_trace_chunk_records(const sim_trace_t *t, int chunk);
+
+/**
+ * @brief Values of one column in one chunk
+ *
+ * RAW blocks point into the mapping. Other codecs are decoded into a
+ * per-column scratch buffer that stays valid until the same column of
+ * another chunk is requested.
+ *
+ * @return Pointer to sim_trace_chunk_records() floats, or NULL on error
+ */
+const float *sim_trace_column(sim_trace_t *t, int chunk, int column);
+
+/**
+ * @brief Drop the pages of a chunk from the process
+ *
+ * Streaming passes call this once they are done with a chunk so that the
+ * resident set stays bounded on traces larger than memory. The chunk can
+ * still be read again afterwards.
+ */
+void sim_trace_release_chunk(sim_trace_t *t, int chunk);
+
+#endif // SIMULATION_TRACE_H_
@@ -0,0 +1,187 @@
+/**
+ * @file virtual_motor_batch.c
+ * @brief Lockstep multi-motor PMSM model implementation
+ * 
+ * The loops below are kept free of branches and function calls so that
+ * they vectorize across lanes. Conditionals are written as selects and
+ * the scalar while-loops for angle wrapping are replaced by a single
+ * conditional correction, which is exact as long as the angle changes by
+ * less than 2π per step.
+ */
+
+#include "virtual_motor_batch.h"
+#include <math.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846f
+#endif
+
+#define TWO_PI_F        (2.0f * (float)M_PI)
+#define PI_F            ((float)M_PI)
+
+// Same polynomial as utils_fast_sincos_better, branch-free
+static inline float fast_sin_wrapped(float a) {
+    float s = 1.27323954f * a - 0.405284735f * a * fabsf(a);
+    return 0.225f * (s * fabsf(s) - s) + s;
+}
+
+static inline float wrap_pi(float a) {
+    a += (a < -PI_F) ? TWO_PI_F : 0.0f;
+    a -= (a > PI_F) ? TWO_PI_F : 0.0f;
+    return a;
+}
+
+void virtual_motor_batch_sincos(const float * restrict angle, float * restrict s,
+                                float * restrict c, int n) {
+    for (int i = 0; i < n; i++) {
+        float a = wrap_pi(angle[i]);
+        s[i] = fast_sin_wrapped(a);
+        
+        // cos(x) = sin(x + π/2)
+        float ac = a + 0.5f * PI_F;
+        ac -= (ac > PI_F) ? TWO_PI_F : 0.0f;
+        c[i] = fast_sin_wrapped(ac);
+    }
+}
+
+void virtual_motor_batch_init(virtual_motor_batch_t *b, int lanes, mc_configuration *conf) {
+    if (b == NULL || conf == NULL) return;
+    
+    memset(b, 0, sizeof(virtual_motor_batch_t));
+    
+    if (lanes < 1) lanes = 1;
+    if (lanes > VM_BATCH_MAX_LANES) lanes = VM_BATCH_MAX_LANES;
+    b->lanes = lanes;
+    
+    // Unused lanes get valid parameters too, so that stepping them is harmless
+    for (int i = 0; i < VM_BATCH_MAX_LANES; i++) {
+        virtual_motor_batch_set_lane_configuration(b, i, conf);
+    }
+    
+    virtual_motor_batch_reset(b);
+}
+
+void virtual_motor_batch_set_lane_configuration(virtual_motor_batch_t *b, int lane,
+                                                mc_configuration *conf) {
+    if (b == NULL || conf == NULL || lane < 0 || lane >= VM_BATCH_MAX_LANES) return;
+    
+    virtual_motor_state_t st;
+    virtual_motor_pc_state_init(&st, conf);
+    
+    b->pp[lane] = (float)st.pole_pairs;
+    b->km[lane] = st.km;
+    virtual_motor_batch_set_lane_params(b, lane, st.R, st.ld, st.lq, st.lambda, st.J);
+}
+
+void virtual_motor_batch_set_lane_params(virtual_motor_batch_t *b, int lane,
+                                         float R, float ld, float lq,
+                                         float lambda, float J) {
+    if (b == NULL || lane < 0 || lane >= VM_BATCH_MAX_LANES) return;
+    
+    if (ld < 1e-9f) ld = 1e-9f;
+    if (lq < 1e-9f) lq = 1e-9f;
+    
+    b->R[lane] = R;
+    b->ld[lane] = ld;
+    b->lq[lane] = lq;
+    b->lambda[lane] = lambda;
+    b->inv_ld[lane] = 1.0f / ld;
+    b->inv_lq[lane] = 1.0f / lq;
+    
+    // Same as the scalar model: negligible inertia freezes the rotor
+    if (J > 1e-12f) {
+        b->J[lane] = J;
+        b->inv_J[lane] = 1.0f / J;
+    } else {
+        b->J[lane] = 0.0f;
+        b->inv_J[lane] = 0.0f;
+    }
+}
+
+void virtual_motor_batch_reset(virtual_motor_batch_t *b) {
+    if (b == NULL) return;
+    
+    for (int i = 0; i < VM_BATCH_MAX_LANES; i++) {
+        b->id[i] = 0.0f;
+        b->iq[i] = 0.0f;
+        b->id_int[i] = 0.0f;
+        b->we[i] = 0.0f;
+        b->phi[i] = 0.0f;
+        b->sin_phi[i] = 0.0f;
+        b->cos_phi[i] = 1.0f;
+        b->i_alpha[i] = 0.0f;
+        b->i_beta[i] = 0.0f;
+        b->torque[i] = 0.0f;
+    }
+}
+
+void virtual_motor_batch_step(virtual_motor_batch_t *b, float dt) {
+    if (b == NULL || dt <= 0.0f) return;
+    
+    const float max_current = 500.0f;
+    const int n = b->lanes;
+    
+    // Electrical and mechanical model, see virtual_motor_pc.c for the equations
+    for (int i = 0; i < n; i++) {
+        float s = b->sin_phi[i];
+        float c = b->cos_phi[i];
+        
+        float vd = c * b->v_alpha[i] + s * b->v_beta[i];
+        float vq = c * b->v_beta[i] - s * b->v_alpha[i];
+        
+        float we_pp = b->we[i] * b->pp[i];
+        float id = b->id[i];
+        float iq = b->iq[i];
+        
+        float id_int = b->id_int[i] + (vd + we_pp * b->lq[i] * iq - b->R[i] * id) * dt * b->inv_ld[i];
+        id = id_int - b->lambda[i] * b->inv_ld[i];
+        iq += (vq - we_pp * (b->ld[i] * id + b->lambda[i]) - b->R[i] * iq) * dt * b->inv_lq[i];
+        
+        id = (id > max_current) ? max_current : id;
+        id = (id < -max_current) ? -max_current : id;
+        iq = (iq > max_current) ? max_current : iq;
+        iq = (iq < -max_current) ? -max_current : iq;
+        
+        float me = b->km[i] * (b->lambda[i] + (b->ld[i] - b->lq[i]) * id) * iq;
+        float we = b->we[i] + dt * b->inv_J[i] * (me - b->ml[i]);
+        float phi = wrap_pi(b->phi[i] + we * dt);
+        
+        b->id_int[i] = id_int;
+        b->id[i] = id;
+        b->iq[i] = iq;
+        b->we[i] = we;
+        b->phi[i] = phi;
+        b->torque[i] = me;
+    }
+    
+    virtual_motor_batch_sincos(b->phi, b->sin_phi, b->cos_phi, n);
+    
+    // Inverse Park transform
+    for (int i = 0; i < n; i++) {
+        b->i_alpha[i] = b->cos_phi[i] * b->id[i] - b->sin_phi[i] * b->iq[i];
+        b->i_beta[i] = b->sin_phi[i] * b->id[i] + b->cos_phi[i] * b->iq[i];
+    }
+}
+
+void virtual_motor_batch_get_lane(const virtual_motor_batch_t *b, int lane,
+                                  virtual_motor_state_t *state) {
+    if (b == NULL || state == NULL || lane < 0 || lane >= VM_BATCH_MAX_LANES) return;
+    
+    memset(state, 0, sizeof(virtual_motor_state_t));
+    state->J = b->J[lane];
+    state->pole_pairs = (int)b->pp[lane];
+    state->km = b->km[lane];
+    state->ld = b->ld[lane];
+    state->lq = b->lq[lane];
+    state->R = b->R[lane];
+    state->lambda = b->lambda[lane];
+    state->id = b->id[lane];
+    state->iq = b->iq[lane];
+    state->id_int = b->id_int[lane];
+    state->we = b->we[lane];
+    state->phi = b->phi[lane];
+    state->sin_phi = b->sin_phi[lane];
+    state->cos_phi = b->cos_phi[lane];
+    state->ml = b->ml[lane];
+}
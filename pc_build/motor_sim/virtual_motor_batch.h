@@ -0,0 +1,108 @@
+/**
+ * @file virtual_motor_batch.h
+ * @brief Lockstep multi-motor PMSM model in structure-of-arrays form
+ * 
+ * Advances up to VM_BATCH_MAX_LANES independent motor instances with the
+ * same equations as virtual_motor_pc_state_step(). All per-motor values are
+ * stored as separate arrays and the step loops are branch-free, so the
+ * compiler can vectorize them (SSE/AVX2 on x86, NEON on ARM). Intended for
+ * Monte-Carlo studies where R, L, lambda and J vary between lanes.
+ */
+
+#ifndef VIRTUAL_MOTOR_BATCH_H_
+#define VIRTUAL_MOTOR_BATCH_H_
+
+#include "virtual_motor_pc.h"
+
+#define VM_BATCH_MAX_LANES      16
+
+#define VM_BATCH_ALIGNED        __attribute__((aligned(64)))
+
+typedef struct {
+    int lanes;                                      ///< Number of active lanes
+    
+    // Parameters
+    float J[VM_BATCH_MAX_LANES] VM_BATCH_ALIGNED;   ///< Rotor inertia [kg·m²]
+    float km[VM_BATCH_MAX_LANES] VM_BATCH_ALIGNED;  ///< Torque constant factor (1.5 * pole_pairs)
+    float pp[VM_BATCH_MAX_LANES] VM_BATCH_ALIGNED;  ///< Pole pairs
+    float ld[VM_BATCH_MAX_LANES] VM_BATCH_ALIGNED;  ///< d-axis inductance [H]
+    float lq[VM_BATCH_MAX_LANES] VM_BATCH_ALIGNED;  ///< q-axis inductance [H]
+    float R[VM_BATCH_MAX_LANES] VM_BATCH_ALIGNED;   ///< Stator resistance [Ω]
+    float lambda[VM_BATCH_MAX_LANES] VM_BATCH_ALIGNED; ///< Flux linkage [Wb]
+    float inv_ld[VM_BATCH_MAX_LANES] VM_BATCH_ALIGNED;
+    float inv_lq[VM_BATCH_MAX_LANES] VM_BATCH_ALIGNED;
+    float inv_J[VM_BATCH_MAX_LANES] VM_BATCH_ALIGNED;
+    
+    // Inputs
+    float v_alpha[VM_BATCH_MAX_LANES] VM_BATCH_ALIGNED; ///< α-axis voltage [V]
+    float v_beta[VM_BATCH_MAX_LANES] VM_BATCH_ALIGNED;  ///< β-axis voltage [V]
+    float ml[VM_BATCH_MAX_LANES] VM_BATCH_ALIGNED;      ///< Load torque [Nm]
+    
+    // State
+    float id[VM_BATCH_MAX_LANES] VM_BATCH_ALIGNED;
+    float iq[VM_BATCH_MAX_LANES] VM_BATCH_ALIGNED;
+    float id_int[VM_BATCH_MAX_LANES] VM_BATCH_ALIGNED;
+    float we[VM_BATCH_MAX_LANES] VM_BATCH_ALIGNED;
+    float phi[VM_BATCH_MAX_LANES] VM_BATCH_ALIGNED;
+    float sin_phi[VM_BATCH_MAX_LANES] VM_BATCH_ALIGNED;
+    float cos_phi[VM_BATCH_MAX_LANES] VM_BATCH_ALIGNED;
+    
+    // Outputs
+    float i_alpha[VM_BATCH_MAX_LANES] VM_BATCH_ALIGNED; ///< α-axis current [A]
+    float i_beta[VM_BATCH_MAX_LANES] VM_BATCH_ALIGNED;  ///< β-axis current [A]
+    float torque[VM_BATCH_MAX_LANES] VM_BATCH_ALIGNED;  ///< Electromagnetic torque [Nm]
+} virtual_motor_batch_t;
+
+/**
+ * Initialize a batch with all lanes set up from the same configuration
+ * 
+ * @param b Batch to initialize
+ * @param lanes Number of lanes (1 to VM_BATCH_MAX_LANES)
+ * @param conf Motor configuration applied to every lane
+ */
+void virtual_motor_batch_init(virtual_motor_batch_t *b, int lanes, mc_configuration *conf);
+
+/**
+ * Set the electrical parameters of one lane from a configuration.
+ * Uses the same mapping as virtual_motor_pc_state_init().
+ */
+void virtual_motor_batch_set_lane_configuration(virtual_motor_batch_t *b, int lane,
+                                                mc_configuration *conf);
+
+/**
+ * Override individual parameters of one lane (e.g. tolerance studies)
+ * 
+ * @param R Stator resistance [Ω]
+ * @param ld d-axis inductance [H]
+ * @param lq q-axis inductance [H]
+ * @param lambda Flux linkage [Wb]
+ * @param J Rotor inertia [kg·m²]
+ */
+void virtual_motor_batch_set_lane_params(virtual_motor_batch_t *b, int lane,
+                                         float R, float ld, float lq,
+                                         float lambda, float J);
+
+/**
+ * Reset the state of all lanes (keeps parameters, inputs and load)
+ */
+void virtual_motor_batch_reset(virtual_motor_batch_t *b);
+
+/**
+ * Advance all lanes by dt using the v_alpha/v_beta/ml inputs
+ */
+void virtual_motor_batch_step(virtual_motor_batch_t *b, float dt);
+
+/**
+ * Copy the parameters and state of one lane into a scalar model state
+ */
+void virtual_motor_batch_get_lane(const virtual_motor_batch_t *b, int lane,
+                                  virtual_motor_state_t *state);
+
+/**
+ * Vectorizable sin/cos with the same polynomial as utils_fast_sincos_better.
+ * Input angles must be within [-3π, 3π].
+ */
+void virtual_motor_batch_sincos(const float * restrict angle, float * restrict s,
+                                float * restrict c, int n);
+
+#endif /* VIRTUAL_MOTOR_BATCH_H_ */
@@ -15,97 +15,110 @@
 #define M_PI 3.14159265358979323846f
 #endif
 
-// Internal state
-static virtual_motor_state_t vm;
-static mc_configuration *m_conf = NULL;
+// Default instance used by the legacy single-motor API
+static virtual_motor_state_t vm_default;
 
 // Forward declarations
-static inline void run_electrical_model(float v_alpha, float v_beta, float dt);
-static inline void run_mechanical_model(float dt);
-static inline void update_transformations(void);
+static inline void run_electrical_model(virtual_motor_state_t *vm, float v_alpha, float v_beta, float dt);
+static inline void run_mechanical_model(virtual_motor_state_t *vm, float dt);
+static inline void update_transformations(virtual_motor_state_t *vm);
+static void run_model_rk4(virtual_motor_state_t *vm, float v_alpha, float v_beta, float dt);
+static void run_model_exact(virtual_motor_state_t *vm, float v_alpha, float v_beta, float dt);
+static void run_model_adaptive(virtual_motor_state_t *vm, float v_alpha, float v_beta, float dt);
+static void apply_motor_parameters(virtual_motor_state_t *vm, mc_configuration *conf);
 
-void virtual_motor_pc_init(mc_configuration *conf) {
-    m_conf = conf;
-    
-    // Initialize parameters from configuration
-    vm.pole_pairs = conf->si_motor_poles / 2;
-    if (vm.pole_pairs < 1) vm.pole_pairs = 1;
+static void apply_motor_parameters(virtual_motor_state_t *vm, mc_configuration *conf) {
+    vm->pole_pairs = conf->si_motor_poles / 2;
+    if (vm->pole_pairs < 1) vm->pole_pairs = 1;
     
-    vm.km = 1.5f * (float)vm.pole_pairs;
-    vm.Ts = 1.0f / conf->foc_f_zv;
-    vm.R = conf->foc_motor_r;
-    vm.lambda = conf->foc_motor_flux_linkage;
+    vm->km = 1.5f * (float)vm->pole_pairs;
+    vm->R = conf->foc_motor_r;
+    vm->lambda = conf->foc_motor_flux_linkage;
     
     // Handle inductance with possible saliency
     if (conf->foc_motor_ld_lq_diff > 0.0f) {
-        vm.lq = conf->foc_motor_l + conf->foc_motor_ld_lq_diff / 2.0f;
-        vm.ld = conf->foc_motor_l - conf->foc_motor_ld_lq_diff / 2.0f;
+        vm->lq = conf->foc_motor_l + conf->foc_motor_ld_lq_diff / 2.0f;
+        vm->ld = conf->foc_motor_l - conf->foc_motor_ld_lq_diff / 2.0f;
     } else {
-        vm.lq = conf->foc_motor_l;
-        vm.ld = conf->foc_motor_l;
+        vm->lq = conf->foc_motor_l;
+        vm->ld = conf->foc_motor_l;
     }
     
     // Ensure minimum inductance values
-    if (vm.ld < 1e-9f) vm.ld = 1e-9f;
-    if (vm.lq < 1e-9f) vm.lq = 1e-9f;
+    if (vm->ld < 1e-9f) vm->ld = 1e-9f;
+    if (vm->lq < 1e-9f) vm->lq = 1e-9f;
+}
+
+// ==== Per-instance API ====
+
+void virtual_motor_pc_state_init(virtual_motor_state_t *vm, mc_configuration *conf) {
+    if (vm == NULL || conf == NULL) return;
+    
+    memset(vm, 0, sizeof(virtual_motor_state_t));
+    
+    // Initialize parameters from configuration
+    apply_motor_parameters(vm, conf);
+    vm->Ts = 1.0f / conf->foc_f_zv;
     
     // Default mechanical parameters
-    vm.J = 0.0001f;  // Default inertia [kg·m²]
-    vm.ml = 0.0f;    // No load torque
+    vm->J = 0.0001f;  // Default inertia [kg·m²]
+    vm->ml = 0.0f;    // No load torque
+    
+    // Original forward Euler model unless selected otherwise
+    vm->integrator = VM_INTEGRATOR_EULER;
+    vm->rel_tol = 1e-4f;
+    vm->abs_tol = 1e-3f;
     
     // Reset state
-    virtual_motor_pc_reset();
+    virtual_motor_pc_state_reset(vm);
 }
 
-void virtual_motor_pc_set_configuration(mc_configuration *conf) {
-    if (conf != NULL) {
-        m_conf = conf;
-        
-        // Update parameters
-        vm.pole_pairs = conf->si_motor_poles / 2;
-        if (vm.pole_pairs < 1) vm.pole_pairs = 1;
-        
-        vm.km = 1.5f * (float)vm.pole_pairs;
-        vm.R = conf->foc_motor_r;
-        vm.lambda = conf->foc_motor_flux_linkage;
-        
-        if (conf->foc_motor_ld_lq_diff > 0.0f) {
-            vm.lq = conf->foc_motor_l + conf->foc_motor_ld_lq_diff / 2.0f;
-            vm.ld = conf->foc_motor_l - conf->foc_motor_ld_lq_diff / 2.0f;
-        } else {
-            vm.lq = conf->foc_motor_l;
-            vm.ld = conf->foc_motor_l;
-        }
-        
-        if (vm.ld < 1e-9f) vm.ld = 1e-9f;
-        if (vm.lq < 1e-9f) vm.lq = 1e-9f;
-    }
+void virtual_motor_pc_state_set_configuration(virtual_motor_state_t *vm, mc_configuration *conf) {
+    if (vm == NULL || conf == NULL) return;
+    apply_motor_parameters(vm, conf);
 }
 
-void virtual_motor_pc_step(virtual_motor_io_t *io, float dt) {
-    if (io == NULL || dt <= 0.0f) return;
+void virtual_motor_pc_state_step(virtual_motor_state_t *vm, virtual_motor_io_t *io, float dt) {
+    if (vm == NULL || io == NULL || dt <= 0.0f) return;
     
-    vm.Ts = dt;
+    vm->Ts = dt;
     
     // Run motor model
-    run_electrical_model(io->v_alpha_in, io->v_beta_in, dt);
-    run_mechanical_model(dt);
-    update_transformations();
+    switch (vm->integrator) {
+        case VM_INTEGRATOR_RK4:
+            run_model_rk4(vm, io->v_alpha_in, io->v_beta_in, dt);
+            break;
+            
+        case VM_INTEGRATOR_EXACT:
+            run_model_exact(vm, io->v_alpha_in, io->v_beta_in, dt);
+            break;
+            
+        case VM_INTEGRATOR_ADAPTIVE:
+            run_model_adaptive(vm, io->v_alpha_in, io->v_beta_in, dt);
+            break;
+            
+        case VM_INTEGRATOR_EULER:
+        default:
+            run_electrical_model(vm, io->v_alpha_in, io->v_beta_in, dt);
+            run_mechanical_model(vm, dt);
+            break;
+    }
+    update_transformations(vm);
     
     // Inverse Park transform (d-q to α-β)
-    io->i_alpha_out = vm.cos_phi * vm.id - vm.sin_phi * vm.iq;
-    io->i_beta_out = vm.sin_phi * vm.id + vm.cos_phi * vm.iq;
-    io->angle_rad = vm.phi;
-    io->omega_e = vm.we;
+    io->i_alpha_out = vm->cos_phi * vm->id - vm->sin_phi * vm->iq;
+    io->i_beta_out = vm->sin_phi * vm->id + vm->cos_phi * vm->iq;
+    io->angle_rad = vm->phi;
+    io->omega_e = vm->we;
     
     // Calculate electromagnetic torque
-    io->torque = vm.km * (vm.lambda + (vm.ld - vm.lq) * vm.id) * vm.iq;
+    io->torque = vm->km * (vm->lambda + (vm->ld - vm->lq) * vm->id) * vm->iq;
 }
 
-static inline void run_electrical_model(float v_alpha, float v_beta, float dt) {
+static inline void run_electrical_model(virtual_motor_state_t *vm, float v_alpha, float v_beta, float dt) {
     // Park transform (α-β to d-q)
-    float vd = vm.cos_phi * v_alpha + vm.sin_phi * v_beta;
-    float vq = vm.cos_phi * v_beta - vm.sin_phi * v_alpha;
+    float vd = vm->cos_phi * v_alpha + vm->sin_phi * v_beta;
+    float vq = vm->cos_phi * v_beta - vm->sin_phi * v_alpha;
     
     // d-axis current dynamics
     // di_d/dt = (v_d - R*i_d + w_e*L_q*i_q) / L_d
@@ -114,118 +127,430 @@ static inline void run_electrical_model(float v_alpha, float v_beta, float dt) {
     // d(psi_d)/dt = v_d - R*i_d + w_e*psi_q
     // where psi_q = L_q * i_q
     
-    float we_pp = vm.we * (float)vm.pole_pairs;  // Electrical angular velocity
+    float we_pp = vm->we * (float)vm->pole_pairs;  // Electrical angular velocity
     
-    vm.id_int += ((vd + we_pp * vm.lq * vm.iq - vm.R * vm.id) * dt) / vm.ld;
-    vm.id = vm.id_int - vm.lambda / vm.ld;
+    vm->id_int += ((vd + we_pp * vm->lq * vm->iq - vm->R * vm->id) * dt) / vm->ld;
+    vm->id = vm->id_int - vm->lambda / vm->ld;
     
     // q-axis current dynamics
     // di_q/dt = (v_q - R*i_q - w_e*(L_d*i_d + lambda_pm)) / L_q
-    vm.iq += (vq - we_pp * (vm.ld * vm.id + vm.lambda) - vm.R * vm.iq) * dt / vm.lq;
+    vm->iq += (vq - we_pp * (vm->ld * vm->id + vm->lambda) - vm->R * vm->iq) * dt / vm->lq;
     
     // Current limiting (prevent numerical instability)
     const float max_current = 500.0f;
-    utils_truncate_number_abs(&vm.id, max_current);
-    utils_truncate_number_abs(&vm.iq, max_current);
+    utils_truncate_number_abs(&vm->id, max_current);
+    utils_truncate_number_abs(&vm->iq, max_current);
 }
 
-static inline void run_mechanical_model(float dt) {
+static inline void run_mechanical_model(virtual_motor_state_t *vm, float dt) {
     // Calculate electromagnetic torque
     // T_e = (3/2) * p * (lambda_pm * i_q + (L_d - L_q) * i_d * i_q)
-    float me = vm.km * (vm.lambda + (vm.ld - vm.lq) * vm.id) * vm.iq;
+    float me = vm->km * (vm->lambda + (vm->ld - vm->lq) * vm->id) * vm->iq;
     
     // Mechanical dynamics
     // J * dw/dt = T_e - T_load
-    if (vm.J > 1e-12f) {
-        float tsj = dt / vm.J;
-        vm.we += tsj * (me - vm.ml);
+    if (vm->J > 1e-12f) {
+        float tsj = dt / vm->J;
+        vm->we += tsj * (me - vm->ml);
     }
     
     // Update angle
-    vm.phi += vm.we * dt;
+    vm->phi += vm->we * dt;
     
     // Normalize angle to [-π, π]
-    while (vm.phi > M_PI) {
-        vm.phi -= 2.0f * M_PI;
+    while (vm->phi > M_PI) {
+        vm->phi -= 2.0f * M_PI;
     }
-    while (vm.phi < -M_PI) {
-        vm.phi += 2.0f * M_PI;
+    while (vm->phi < -M_PI) {
+        vm->phi += 2.0f * M_PI;
     }
 }
 
-static inline void update_transformations(void) {
+static inline void update_transformations(virtual_motor_state_t *vm) {
     // Update sin/cos for transforms
-    utils_fast_sincos_better(vm.phi, &vm.sin_phi, &vm.cos_phi);
+    utils_fast_sincos_better(vm->phi, &vm->sin_phi, &vm->cos_phi);
 }
 
-void virtual_motor_pc_set_load_torque(float torque_nm) {
-    vm.ml = torque_nm;
+// ==== Higher-order integrators ====
+//
+// These integrate the same equations as run_electrical_model() and
+// run_mechanical_model() on the state vector x = [id, iq, we, phi], in
+// double precision. The αβ voltage is held constant over the step (it is
+// what the inverter applies), so the dq voltage is re-evaluated from the
+// rotor angle at every stage.
+
+#define VM_NX   4
+
+static void model_derivatives(const virtual_motor_state_t *vm, double v_alpha, double v_beta,
+                              const double *x, double *dx) {
+    double s = sin(x[3]);
+    double c = cos(x[3]);
+    double vd = c * v_alpha + s * v_beta;
+    double vq = c * v_beta - s * v_alpha;
+    double we_pp = x[2] * (double)vm->pole_pairs;
+    
+    dx[0] = (vd + we_pp * vm->lq * x[1] - vm->R * x[0]) / vm->ld;
+    dx[1] = (vq - we_pp * (vm->ld * x[0] + vm->lambda) - vm->R * x[1]) / vm->lq;
+    
+    double me = vm->km * (vm->lambda + (vm->ld - vm->lq) * x[0]) * x[1];
+    dx[2] = (vm->J > 1e-12f) ? (me - vm->ml) / vm->J : 0.0;
+    dx[3] = x[2];
 }
 
-void virtual_motor_pc_set_inertia(float J_kgm2) {
+static inline void load_state(const virtual_motor_state_t *vm, double *x) {
+    x[0] = vm->id;
+    x[1] = vm->iq;
+    x[2] = vm->we;
+    x[3] = vm->phi;
+}
+
+static void store_state(virtual_motor_state_t *vm, const double *x) {
+    vm->id = (float)x[0];
+    vm->iq = (float)x[1];
+    vm->we = (float)x[2];
+    vm->phi = (float)remainder(x[3], 2.0 * M_PI);
+    
+    // Same limit as the Euler model
+    const float max_current = 500.0f;
+    utils_truncate_number_abs(&vm->id, max_current);
+    utils_truncate_number_abs(&vm->iq, max_current);
+    
+    // Keep the flux state consistent in case the integrator is switched back
+    vm->id_int = vm->id + vm->lambda / vm->ld;
+}
+
+static void run_model_rk4(virtual_motor_state_t *vm, float v_alpha, float v_beta, float dt) {
+    double x[VM_NX], xt[VM_NX];
+    double k1[VM_NX], k2[VM_NX], k3[VM_NX], k4[VM_NX];
+    double h = dt;
+    
+    load_state(vm, x);
+    
+    model_derivatives(vm, v_alpha, v_beta, x, k1);
+    for (int i = 0; i < VM_NX; i++) xt[i] = x[i] + 0.5 * h * k1[i];
+    model_derivatives(vm, v_alpha, v_beta, xt, k2);
+    for (int i = 0; i < VM_NX; i++) xt[i] = x[i] + 0.5 * h * k2[i];
+    model_derivatives(vm, v_alpha, v_beta, xt, k3);
+    for (int i = 0; i < VM_NX; i++) xt[i] = x[i] + h * k3[i];
+    model_derivatives(vm, v_alpha, v_beta, xt, k4);
+    
+    for (int i = 0; i < VM_NX; i++) {
+        x[i] += h / 6.0 * (k1[i] + 2.0 * k2[i] + 2.0 * k3[i] + k4[i]);
+    }
+    
+    store_state(vm, x);
+}
+
+/*
+ * Zero-order-hold discretization of dx/dt = A x + b over h for a 2x2 A:
+ * x(h) = Phi x(0) + Gamma b with Phi = e^(A h), Gamma = int_0^h e^(A t) dt.
+ * With s = tr(A) / 2 and M = A - s I, M^2 = disc I, so e^(A h) has the
+ * closed form e^(s h) (f0 I + f1 M).
+ */
+static void expm_2x2(const double *A, double h, double *Phi, double *Gamma) {
+    double s = 0.5 * (A[0] + A[3]);
+    double p = 0.5 * (A[0] - A[3]);
+    double disc = p * p + A[1] * A[2];
+    double f0, f1;
+    
+    if (disc < 0.0) {
+        double q = sqrt(-disc);
+        f0 = cos(q * h);
+        f1 = sin(q * h) / q;
+    } else if (disc > 0.0) {
+        double q = sqrt(disc);
+        f0 = cosh(q * h);
+        f1 = sinh(q * h) / q;
+    } else {
+        f0 = 1.0;
+        f1 = h;
+    }
+    
+    double e = exp(s * h);
+    Phi[0] = e * (f0 + f1 * p);
+    Phi[1] = e * f1 * A[1];
+    Phi[2] = e * f1 * A[2];
+    Phi[3] = e * (f0 - f1 * p);
+    
+    double norm = fmax(fmax(fabs(A[0]), fabs(A[1])), fmax(fabs(A[2]), fabs(A[3])));
+    double det = A[0] * A[3] - A[1] * A[2];
+    
+    if (norm * h < 1e-5 || fabs(det) < 1e-300) {
+        // Nearly a pure integrator: h I + h^2/2 A + h^3/6 A^2
+        double A2[4] = {
+            A[0] * A[0] + A[1] * A[2], A[0] * A[1] + A[1] * A[3],
+            A[2] * A[0] + A[3] * A[2], A[2] * A[1] + A[3] * A[3]
+        };
+        for (int i = 0; i < 4; i++) {
+            Gamma[i] = 0.5 * h * h * A[i] + h * h * h / 6.0 * A2[i];
+        }
+        Gamma[0] += h;
+        Gamma[3] += h;
+    } else {
+        // A^-1 (Phi - I)
+        double d0 = Phi[0] - 1.0, d1 = Phi[1], d2 = Phi[2], d3 = Phi[3] - 1.0;
+        Gamma[0] = ( A[3] * d0 - A[1] * d2) / det;
+        Gamma[1] = ( A[3] * d1 - A[1] * d3) / det;
+        Gamma[2] = (-A[2] * d0 + A[0] * d2) / det;
+        Gamma[3] = (-A[2] * d1 + A[0] * d3) / det;
+    }
+}
+
+/*
+ * The dq current equations are linear for a fixed speed, so they are
+ * stepped exactly with the speed frozen at its predicted mid-step value
+ * and the dq voltage taken at the mid-step angle. This is stable for any
+ * dt and exact for a locked rotor. Speed and angle then follow with the
+ * trapezoidal rule.
+ */
+static void run_model_exact(virtual_motor_state_t *vm, float v_alpha, float v_beta, float dt) {
+    double h = dt;
+    double id0 = vm->id;
+    double iq0 = vm->iq;
+    double we0 = vm->we;
+    double me0 = vm->km * (vm->lambda + (vm->ld - vm->lq) * id0) * iq0;
+    double acc0 = (vm->J > 1e-12f) ? (me0 - vm->ml) / vm->J : 0.0;
+    double we_mid = we0 + 0.5 * h * acc0;
+    double we_pp = we_mid * (double)vm->pole_pairs;
+    double phi_mid = vm->phi + 0.25 * h * (we0 + we_mid);
+    double s = sin(phi_mid);
+    double c = cos(phi_mid);
+    double vd = c * v_alpha + s * v_beta;
+    double vq = c * v_beta - s * v_alpha;
+    
+    double A[4] = {
+        -vm->R / vm->ld, we_pp * vm->lq / vm->ld,
+        -we_pp * vm->ld / vm->lq, -vm->R / vm->lq
+    };
+    double b[2] = {
+        vd / vm->ld,
+        (vq - we_pp * vm->lambda) / vm->lq
+    };
+    double Phi[4], Gamma[4];
+    expm_2x2(A, h, Phi, Gamma);
+    
+    double x[VM_NX];
+    x[0] = Phi[0] * id0 + Phi[1] * iq0 + Gamma[0] * b[0] + Gamma[1] * b[1];
+    x[1] = Phi[2] * id0 + Phi[3] * iq0 + Gamma[2] * b[0] + Gamma[3] * b[1];
+    
+    double me1 = vm->km * (vm->lambda + (vm->ld - vm->lq) * x[0]) * x[1];
+    x[2] = we0;
+    if (vm->J > 1e-12f) {
+        x[2] += h * (0.5 * (me0 + me1) - vm->ml) / vm->J;
+    }
+    x[3] = vm->phi + 0.5 * h * (we0 + x[2]);
+    
+    store_state(vm, x);
+}
+
+// Dormand-Prince 5(4) tableau. The model is autonomous over a call (the
+// voltage is held), so the stage times are not needed.
+static const double dp_a[7][6] = {
+    {0},
+    {1.0 / 5.0},
+    {3.0 / 40.0, 9.0 / 40.0},
+    {44.0 / 45.0, -56.0 / 15.0, 32.0 / 9.0},
+    {19372.0 / 6561.0, -25360.0 / 2187.0, 64448.0 / 6561.0, -212.0 / 729.0},
+    {9017.0 / 3168.0, -355.0 / 33.0, 46732.0 / 5247.0, 49.0 / 176.0, -5103.0 / 18656.0},
+    {35.0 / 384.0, 0.0, 500.0 / 1113.0, 125.0 / 192.0, -2187.0 / 6784.0, 11.0 / 84.0}
+};
+// 5th-order minus embedded 4th-order weights
+static const double dp_e[7] = {
+    71.0 / 57600.0, 0.0, -71.0 / 16695.0, 71.0 / 1920.0,
+    -17253.0 / 339200.0, 22.0 / 525.0, -1.0 / 40.0
+};
+
+static void run_model_adaptive(virtual_motor_state_t *vm, float v_alpha, float v_beta, float dt) {
+    double x[VM_NX], xt[VM_NX], k[7][VM_NX];
+    double t = 0.0;
+    double h = (vm->h_adapt > 0.0f) ? vm->h_adapt : dt;
+    const double h_min = dt * 1e-6;
+    
+    load_state(vm, x);
+    model_derivatives(vm, v_alpha, v_beta, x, k[0]);
+    
+    while (t < dt) {
+        double h_step = fmin(h, dt - t);
+        
+        for (int s = 1; s < 7; s++) {
+            for (int i = 0; i < VM_NX; i++) {
+                double sum = 0.0;
+                for (int j = 0; j < s; j++) {
+                    sum += dp_a[s][j] * k[j][i];
+                }
+                xt[i] = x[i] + h_step * sum;
+            }
+            model_derivatives(vm, v_alpha, v_beta, xt, k[s]);
+        }
+        
+        // Error norm over id, iq and we. The angle is the integral of we.
+        double err = 0.0;
+        for (int i = 0; i < 3; i++) {
+            double e = 0.0;
+            for (int s = 0; s < 7; s++) {
+                e += dp_e[s] * k[s][i];
+            }
+            double scale = vm->abs_tol + vm->rel_tol * fmax(fabs(x[i]), fabs(xt[i]));
+            err = fmax(err, fabs(h_step * e) / scale);
+        }
+        
+        if (err <= 1.0 || h_step <= h_min) {
+            // xt is the 5th-order solution (stage 7 is evaluated at it)
+            t += h_step;
+            memcpy(x, xt, sizeof(x));
+            memcpy(k[0], k[6], sizeof(k[0]));
+            vm->steps_accepted++;
+        } else {
+            vm->steps_rejected++;
+        }
+        
+        double fac = (err > 0.0) ? 0.9 * pow(err, -0.2) : 5.0;
+        fac = fmin(5.0, fmax(0.2, fac));
+        // Do not let the final, shortened step shrink the carried step size
+        if (h_step == h || err > 1.0) {
+            h = h_step * fac;
+        }
+        h = fmax(h, h_min);
+    }
+    
+    vm->h_adapt = (float)h;
+    store_state(vm, x);
+}
+
+void virtual_motor_pc_state_set_integrator(virtual_motor_state_t *vm, vm_integrator_t integrator) {
+    if (vm == NULL) return;
+    vm->integrator = integrator;
+    vm->h_adapt = 0.0f;
+}
+
+void virtual_motor_pc_state_set_tolerance(virtual_motor_state_t *vm, float rel_tol, float abs_tol) {
+    if (vm == NULL) return;
+    if (rel_tol > 0.0f) vm->rel_tol = rel_tol;
+    if (abs_tol > 0.0f) vm->abs_tol = abs_tol;
+}
+
+void virtual_motor_pc_state_set_load_torque(virtual_motor_state_t *vm, float torque_nm) {
+    if (vm == NULL) return;
+    vm->ml = torque_nm;
+}
+
+void virtual_motor_pc_state_set_inertia(virtual_motor_state_t *vm, float J_kgm2) {
+    if (vm == NULL) return;
     if (J_kgm2 > 1e-12f) {
-        vm.J = J_kgm2;
+        vm->J = J_kgm2;
     }
 }
 
-void virtual_motor_pc_set_angle(float angle_rad) {
-    vm.phi = angle_rad;
+void virtual_motor_pc_state_set_angle(virtual_motor_state_t *vm, float angle_rad) {
+    if (vm == NULL) return;
+    
+    vm->phi = angle_rad;
     
     // Normalize
-    while (vm.phi > M_PI) vm.phi -= 2.0f * M_PI;
-    while (vm.phi < -M_PI) vm.phi += 2.0f * M_PI;
+    while (vm->phi > M_PI) vm->phi -= 2.0f * M_PI;
+    while (vm->phi < -M_PI) vm->phi += 2.0f * M_PI;
     
-    utils_fast_sincos_better(vm.phi, &vm.sin_phi, &vm.cos_phi);
+    utils_fast_sincos_better(vm->phi, &vm->sin_phi, &vm->cos_phi);
+}
+
+void virtual_motor_pc_state_set_speed(virtual_motor_state_t *vm, float omega_rad_s) {
+    if (vm == NULL) return;
+    vm->we = omega_rad_s;
+}
+
+float virtual_motor_pc_state_get_rpm(const virtual_motor_state_t *vm) {
+    // Mechanical RPM = electrical_rad_s * 60 / (2*pi * pole_pairs)
+    return vm->we * 60.0f / (2.0f * M_PI * (float)vm->pole_pairs);
+}
+
+float virtual_motor_pc_state_get_erpm(const virtual_motor_state_t *vm) {
+    // Electrical RPM = electrical_rad_s * 60 / (2*pi)
+    return vm->we * 60.0f / (2.0f * M_PI);
+}
+
+float virtual_motor_pc_state_get_torque(const virtual_motor_state_t *vm) {
+    return vm->km * (vm->lambda + (vm->ld - vm->lq) * vm->id) * vm->iq;
+}
+
+void virtual_motor_pc_state_reset(virtual_motor_state_t *vm) {
+    if (vm == NULL) return;
+    
+    vm->id = 0.0f;
+    vm->iq = 0.0f;
+    vm->id_int = 0.0f;
+    vm->we = 0.0f;
+    vm->phi = 0.0f;
+    vm->sin_phi = 0.0f;
+    vm->cos_phi = 1.0f;
+    vm->h_adapt = 0.0f;
+}
+
+// ==== Single-motor API (default instance) ====
+
+void virtual_motor_pc_init(mc_configuration *conf) {
+    virtual_motor_pc_state_init(&vm_default, conf);
+}
+
+void virtual_motor_pc_set_configuration(mc_configuration *conf) {
+    virtual_motor_pc_state_set_configuration(&vm_default, conf);
+}
+
+void virtual_motor_pc_step(virtual_motor_io_t *io, float dt) {
+    virtual_motor_pc_state_step(&vm_default, io, dt);
+}
+
+void virtual_motor_pc_set_load_torque(float torque_nm) {
+    virtual_motor_pc_state_set_load_torque(&vm_default, torque_nm);
+}
+
+void virtual_motor_pc_set_inertia(float J_kgm2) {
+    virtual_motor_pc_state_set_inertia(&vm_default, J_kgm2);
+}
+
+void virtual_motor_pc_set_angle(float angle_rad) {
+    virtual_motor_pc_state_set_angle(&vm_default, angle_rad);
 }
 
 void virtual_motor_pc_set_speed(float omega_rad_s) {
-    vm.we = omega_rad_s;
+    virtual_motor_pc_state_set_speed(&vm_default, omega_rad_s);
 }
 
 float virtual_motor_pc_get_rpm(void) {
-    // Mechanical RPM = electrical_rad_s * 60 / (2*pi * pole_pairs)
-    return vm.we * 60.0f / (2.0f * M_PI * (float)vm.pole_pairs);
+    return virtual_motor_pc_state_get_rpm(&vm_default);
 }
 
 float virtual_motor_pc_get_erpm(void) {
-    // Electrical RPM = electrical_rad_s * 60 / (2*pi)
-    return vm.we * 60.0f / (2.0f * M_PI);
+    return virtual_motor_pc_state_get_erpm(&vm_default);
 }
 
 float virtual_motor_pc_get_id(void) {
-    return vm.id;
+    return vm_default.id;
 }
 
 float virtual_motor_pc_get_iq(void) {
-    return vm.iq;
+    return vm_default.iq;
 }
 
 float virtual_motor_pc_get_angle_rad(void) {
-    return vm.phi;
+    return vm_default.phi;
 }
 
 float virtual_motor_pc_get_angle_deg(void) {
-    return vm.phi * 180.0f / M_PI;
+    return vm_default.phi * 180.0f / M_PI;
 }
 
 float virtual_motor_pc_get_torque(void) {
-    return vm.km * (vm.lambda + (vm.ld - vm.lq) * vm.id) * vm.iq;
+    return virtual_motor_pc_state_get_torque(&vm_default);
 }
 
 float virtual_motor_pc_get_omega_e(void) {
-    return vm.we;
+    return vm_default.we;
 }
 
 const virtual_motor_state_t* virtual_motor_pc_get_state(void) {
-    return &vm;
+    return &vm_default;
 }
 
 void virtual_motor_pc_reset(void) {
-    vm.id = 0.0f;
-    vm.iq = 0.0f;
-    vm.id_int = 0.0f;
-    vm.we = 0.0f;
-    vm.phi = 0.0f;
-    vm.sin_phi = 0.0f;
-    vm.cos_phi = 1.0f;
+    virtual_motor_pc_state_reset(&vm_default);
 }
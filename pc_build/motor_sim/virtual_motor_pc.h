@@ -29,6 +29,16 @@ typedef struct {
     float torque;          ///< Output: electromagnetic torque [Nm]
 } virtual_motor_io_t;
 
+/**
+ * Integration method for the motor model
+ */
+typedef enum {
+    VM_INTEGRATOR_EULER = 0,   ///< Forward Euler, as in motor/virtual_motor.c (default)
+    VM_INTEGRATOR_RK4,         ///< Classic 4th-order Runge-Kutta
+    VM_INTEGRATOR_EXACT,       ///< Matrix exponential of the linear dq current dynamics
+    VM_INTEGRATOR_ADAPTIVE     ///< Dormand-Prince 5(4) with error control
+} vm_integrator_t;
+
 /**
  * Virtual motor state structure (for external access if needed)
  */
@@ -52,8 +62,108 @@ typedef struct {
     float sin_phi;         ///< sin(phi)
     float cos_phi;         ///< cos(phi)
     float ml;              ///< Load torque [Nm]
+    
+    // Integrator
+    vm_integrator_t integrator; ///< Integration method
+    float rel_tol;         ///< Adaptive: relative tolerance
+    float abs_tol;         ///< Adaptive: absolute tolerance [A, rad/s]
+    float h_adapt;         ///< Adaptive: step size carried over to the next call [s]
+    uint32_t steps_accepted; ///< Adaptive: accepted internal steps
+    uint32_t steps_rejected; ///< Adaptive: rejected internal steps
 } virtual_motor_state_t;
 
+// ==== Per-instance API ====
+//
+// Each virtual_motor_state_t is an independent motor, so several models can
+// be stepped in the same process (e.g. from different threads). The
+// single-motor functions further down operate on a built-in default instance.
+
+/**
+ * Initialize a virtual motor instance with motor configuration
+ * 
+ * @param vm Pointer to motor instance
+ * @param conf Pointer to motor configuration
+ */
+void virtual_motor_pc_state_init(virtual_motor_state_t *vm, mc_configuration *conf);
+
+/**
+ * Update electrical parameters of a motor instance from a configuration
+ * 
+ * @param vm Pointer to motor instance
+ * @param conf Pointer to new motor configuration
+ */
+void virtual_motor_pc_state_set_configuration(virtual_motor_state_t *vm, mc_configuration *conf);
+
+/**
+ * Execute one simulation step on a motor instance
+ * 
+ * @param vm Pointer to motor instance
+ * @param io Pointer to I/O structure (input voltages, output currents/angle)
+ * @param dt Time step [s]
+ */
+void virtual_motor_pc_state_step(virtual_motor_state_t *vm, virtual_motor_io_t *io, float dt);
+
+/**
+ * Select the integration method of a motor instance
+ * 
+ * VM_INTEGRATOR_EULER is the original model. RK4 and EXACT take one step
+ * per call and stay accurate at much larger dt, so fewer model substeps
+ * are needed. ADAPTIVE splits dt internally until the local error
+ * estimate meets the tolerances set with
+ * virtual_motor_pc_state_set_tolerance().
+ */
+void virtual_motor_pc_state_set_integrator(virtual_motor_state_t *vm, vm_integrator_t integrator);
+
+/**
+ * Set the error tolerances of VM_INTEGRATOR_ADAPTIVE
+ * 
+ * @param rel_tol Relative tolerance
+ * @param abs_tol Absolute tolerance on id, iq [A] and we [rad/s]
+ */
+void virtual_motor_pc_state_set_tolerance(virtual_motor_state_t *vm, float rel_tol, float abs_tol);
+
+/**
+ * Set the load torque applied to a motor instance [Nm]
+ */
+void virtual_motor_pc_state_set_load_torque(virtual_motor_state_t *vm, float torque_nm);
+
+/**
+ * Set the rotor inertia of a motor instance [kg·m²]
+ */
+void virtual_motor_pc_state_set_inertia(virtual_motor_state_t *vm, float J_kgm2);
+
+/**
+ * Set the electrical angle of a motor instance [rad]
+ */
+void virtual_motor_pc_state_set_angle(virtual_motor_state_t *vm, float angle_rad);
+
+/**
+ * Set the electrical angular velocity of a motor instance [rad/s]
+ */
+void virtual_motor_pc_state_set_speed(virtual_motor_state_t *vm, float omega_rad_s);
+
+/**
+ * Get mechanical RPM of a motor instance
+ */
+float virtual_motor_pc_state_get_rpm(const virtual_motor_state_t *vm);
+
+/**
+ * Get electrical RPM (ERPM) of a motor instance
+ */
+float virtual_motor_pc_state_get_erpm(const virtual_motor_state_t *vm);
+
+/**
+ * Get electromagnetic torque of a motor instance [Nm]
+ */
+float virtual_motor_pc_state_get_torque(const virtual_motor_state_t *vm);
+
+/**
+ * Reset a motor instance to initial conditions (keeps parameters)
+ */
+void virtual_motor_pc_state_reset(virtual_motor_state_t *vm);
+
+// ==== Single-motor API (default instance) ====
+
 /**
  * Initialize the PC virtual motor with motor configuration
  * 
@@ -31,6 +31,8 @@ static void init_default_conf(void) {
         app_conf.timeout_brake_current = 0.0f;
         app_conf.can_status_rate_1 = 50;
         app_conf.can_status_rate_2 = 5;
+        app_conf.can_status_on_change = false;
+        app_conf.can_status_budget = 0.25f;
         app_conf.can_baud_rate = CAN_BAUD_500K;
         app_conf.app_to_use = APP_NONE;
         
@@ -48,6 +48,8 @@
 #define APPCONF_TIMEOUT_BRAKE_CURRENT       0.0f
 #define APPCONF_CAN_STATUS_RATE_1           50
 #define APPCONF_CAN_STATUS_RATE_2           5
+#define APPCONF_CAN_STATUS_ON_CHANGE        false
+#define APPCONF_CAN_STATUS_BUDGET           0.25f
 #define APPCONF_CAN_BAUD_RATE               CAN_BAUD_500K
 #define APPCONF_APP_TO_USE                  APP_NONE
 
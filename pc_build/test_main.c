@@ -52,8 +52,6 @@ static THD_FUNCTION(testThread, arg) {
         chMtxUnlock(&g_test_mutex);
         chThdSleepMilliseconds(1);
     }
-    
-    return NULL;
 }
 
 /*===========================================================================*/
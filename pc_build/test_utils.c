@@ -158,6 +158,95 @@ static int test_utils_max_abs(void) {
     return 1;
 }
 
+// Test signal with a dc offset and the first two harmonics, like the HFI
+// inductance samples
+static void dft_test_signal(float *x, int len) {
+    for (int i = 0; i < len; i++) {
+        float a = 2.0f * (float)M_PI * (float)i / (float)len;
+        x[i] = 0.7f + 0.3f * cosf(a + 0.4f) + 0.2f * sinf(2.0f * a - 1.1f) + 0.01f * (float)(i % 5);
+    }
+}
+
+static void dft_reference(const float *x, int len, double bin, double *re, double *im) {
+    *re = 0.0;
+    *im = 0.0;
+    for (int i = 0; i < len; i++) {
+        double a = 2.0 * M_PI * bin * (double)i / (double)len;
+        *re += x[i] * cos(a);
+        *im -= x[i] * sin(a);
+    }
+    *re /= len;
+    *im /= len;
+}
+
+static int test_utils_dft_matches_fft(void) {
+    typedef void (*bin_func)(float*, float*, float*);
+    const bin_func funcs[3][3] = {
+        {utils_fft8_bin0, utils_fft8_bin1, utils_fft8_bin2},
+        {utils_fft16_bin0, utils_fft16_bin1, utils_fft16_bin2},
+        {utils_fft32_bin0, utils_fft32_bin1, utils_fft32_bin2},
+    };
+
+    for (int l = 0; l < 3; l++) {
+        int len = 8 << l;
+        float x[32];
+        dft_test_signal(x, len);
+
+        utils_dft_t dft;
+        TEST_ASSERT(utils_dft_init(&dft, len));
+        for (int bin = 0; bin < 3; bin++) {
+            float re, im, re_fft, im_fft;
+            utils_dft_bin(&dft, x, bin, &re, &im);
+            funcs[l][bin](x, &re_fft, &im_fft);
+            TEST_ASSERT_FLOAT_EQ(re, re_fft, 1e-5f);
+            TEST_ASSERT_FLOAT_EQ(im, im_fft, 1e-5f);
+        }
+    }
+    return 1;
+}
+
+static int test_utils_dft_any_length(void) {
+    const int lens[] = {5, 24, 48, 63, 64};
+
+    for (int l = 0; l < 5; l++) {
+        int len = lens[l];
+        float x[UTILS_DFT_MAX_LEN];
+        dft_test_signal(x, len);
+
+        utils_dft_t dft;
+        TEST_ASSERT(utils_dft_init(&dft, len));
+        for (int bin = 0; bin < len; bin++) {
+            float re, im;
+            double re_ref, im_ref;
+            utils_dft_bin(&dft, x, bin, &re, &im);
+            dft_reference(x, len, bin, &re_ref, &im_ref);
+            TEST_ASSERT_FLOAT_EQ(re, (float)re_ref, 1e-5f);
+            TEST_ASSERT_FLOAT_EQ(im, (float)im_ref, 1e-5f);
+        }
+    }
+
+    utils_dft_t dft;
+    TEST_ASSERT(!utils_dft_init(&dft, 0));
+    TEST_ASSERT(!utils_dft_init(&dft, UTILS_DFT_MAX_LEN + 1));
+    return 1;
+}
+
+static int test_utils_goertzel(void) {
+    const float bins[] = {0.0f, 1.0f, 2.0f, 2.5f, 7.3f};
+    float x[48];
+    dft_test_signal(x, 48);
+
+    for (int b = 0; b < 5; b++) {
+        float re, im;
+        double re_ref, im_ref;
+        utils_goertzel(x, 48, bins[b], &re, &im);
+        dft_reference(x, 48, bins[b], &re_ref, &im_ref);
+        TEST_ASSERT_FLOAT_EQ(re, (float)re_ref, 1e-4f);
+        TEST_ASSERT_FLOAT_EQ(im, (float)im_ref, 1e-4f);
+    }
+    return 1;
+}
+
 // =============================================================================
 // buffer tests
 // =============================================================================
@@ -421,6 +510,9 @@ int main(void) {
     RUN_TEST(test_utils_middle_of_3);
     RUN_TEST(test_utils_min_abs);
     RUN_TEST(test_utils_max_abs);
+    RUN_TEST(test_utils_dft_matches_fft);
+    RUN_TEST(test_utils_dft_any_length);
+    RUN_TEST(test_utils_goertzel);
     
     printf("\n[buffer]\n");
     RUN_TEST(test_buffer_int16);
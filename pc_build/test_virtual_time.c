@@ -0,0 +1,374 @@
+/**
+ * @file test_virtual_time.c
+ * @brief Tests for the deterministic virtual-time mode of the ChibiOS layer
+ *
+ * Tests:
+ * - Sleeps advance system time without wall-clock delay
+ * - Periodic threads interleave in a reproducible order
+ * - Semaphore/mailbox timeouts and wakeups in virtual time
+ * - Priority ordering of ready threads
+ * - Thread-directed events and virtual timers
+ * - Firmware code (util/worker.c) under the virtual scheduler
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ch.h"
+#include "hal.h"
+#include "worker.h"
+
+/*===========================================================================*/
+/* Test state                                                                */
+/*===========================================================================*/
+
+static int test_passed = 0;
+static int test_failed = 0;
+
+#define TEST_ASSERT(cond, msg) do { \
+    if (cond) { \
+        printf("  [PASS] %s\n", msg); \
+        test_passed++; \
+    } else { \
+        printf("  [FAIL] %s\n", msg); \
+        test_failed++; \
+    } \
+} while(0)
+
+static double wall_time_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/*===========================================================================*/
+/* Sleep                                                                     */
+/*===========================================================================*/
+
+static void test_sleep(void) {
+    printf("\n=== Sleep Test ===\n");
+
+    double wall_start = wall_time_now();
+    systime_t t0 = chVTGetSystemTime();
+    uint64_t us0 = chVTGetVirtualTimeUs();
+
+    chThdSleepSeconds(10);
+    TEST_ASSERT(chVTTimeElapsedSinceX(t0) == S2ST(10), "chThdSleepSeconds(10) advances exactly 10 s");
+
+    chThdSleepMicroseconds(250);
+    TEST_ASSERT(chVTGetVirtualTimeUs() - us0 == 10000250, "chThdSleepMicroseconds() has us resolution");
+
+    chThdSleepUntil(chTimeAddX(chVTGetSystemTime(), MS2ST(5)));
+    TEST_ASSERT(chVTGetVirtualTimeUs() - us0 == 10005000, "chThdSleepUntil() wakes at the target time");
+
+    double wall = wall_time_now() - wall_start;
+    printf("  10 s of sleeps took %.3f ms wall time\n", wall * 1e3);
+    TEST_ASSERT(wall < 0.1, "Sleeps take no wall-clock time");
+}
+
+/*===========================================================================*/
+/* Periodic threads                                                          */
+/*===========================================================================*/
+
+#define TRACE_LEN   256
+
+typedef struct {
+    int id;
+    int period_ms;
+    int count;
+} periodic_arg_t;
+
+static uint32_t trace[TRACE_LEN];
+static int trace_len = 0;
+
+static THD_WORKING_AREA(waPeriodic1, 1024);
+static THD_WORKING_AREA(waPeriodic2, 1024);
+static THD_WORKING_AREA(waPeriodic3, 1024);
+
+static THD_FUNCTION(periodic_thread, arg) {
+    periodic_arg_t *p = (periodic_arg_t*)arg;
+    systime_t next = chVTGetSystemTime();
+
+    for (int i = 0; i < p->count; i++) {
+        next = chTimeAddX(next, MS2ST(p->period_ms));
+        chThdSleepUntil(next);
+        if (trace_len < TRACE_LEN) {
+            trace[trace_len++] = (chVTGetSystemTime() << 4) | (uint32_t)p->id;
+        }
+    }
+}
+
+static int run_periodic_scenario(uint32_t *out) {
+    static periodic_arg_t args[3] = {
+        {1, 3, 20},
+        {2, 5, 12},
+        {3, 15, 4},
+    };
+
+    trace_len = 0;
+
+    thread_t *t1 = chThdCreateStatic(waPeriodic1, sizeof(waPeriodic1), NORMALPRIO, periodic_thread, &args[0]);
+    thread_t *t2 = chThdCreateStatic(waPeriodic2, sizeof(waPeriodic2), NORMALPRIO, periodic_thread, &args[1]);
+    thread_t *t3 = chThdCreateStatic(waPeriodic3, sizeof(waPeriodic3), NORMALPRIO, periodic_thread, &args[2]);
+
+    chThdWait(t1);
+    chThdWait(t2);
+    chThdWait(t3);
+
+    memcpy(out, trace, sizeof(uint32_t) * (size_t)trace_len);
+    return trace_len;
+}
+
+static void test_periodic_threads(void) {
+    printf("\n=== Periodic Threads Test ===\n");
+
+    static uint32_t run1[TRACE_LEN];
+    static uint32_t run2[TRACE_LEN];
+
+    systime_t start = chVTGetSystemTime();
+    int n1 = run_periodic_scenario(run1);
+    TEST_ASSERT(chVTTimeElapsedSinceX(start) == MS2ST(60), "Scenario ends at the last deadline (60 ms)");
+    TEST_ASSERT(n1 == 36, "All periodic wakeups recorded");
+
+    /* Relative times must not depend on when the scenario started */
+    bool ordered = true;
+    for (int i = 0; i < n1; i++) {
+        run1[i] -= start << 4;
+        if (i > 0 && (run1[i] >> 4) < (run1[i - 1] >> 4)) {
+            ordered = false;
+        }
+    }
+    TEST_ASSERT(ordered, "Wakeups are in time order");
+    TEST_ASSERT(run1[0] == ((3 << 4) | 1), "First wakeup is thread 1 at 3 ms");
+
+    chThdSleepMilliseconds(7);
+    start = chVTGetSystemTime();
+    int n2 = run_periodic_scenario(run2);
+    for (int i = 0; i < n2; i++) {
+        run2[i] -= start << 4;
+    }
+
+    TEST_ASSERT(n1 == n2 && memcmp(run1, run2, sizeof(uint32_t) * (size_t)n1) == 0,
+                "Second run reproduces the trace bit-for-bit");
+}
+
+/*===========================================================================*/
+/* Semaphores and mailboxes                                                  */
+/*===========================================================================*/
+
+#define MB_SIZE     4
+#define MB_MSGS     10
+
+static mailbox_t g_mb;
+static msg_t g_mb_buf[MB_SIZE];
+static systime_t g_consumer_timeout_at;
+static int g_consumer_sum;
+static int g_consumer_cnt;
+
+static THD_WORKING_AREA(waProducer, 1024);
+static THD_WORKING_AREA(waConsumer, 1024);
+
+static THD_FUNCTION(producer_thread, arg) {
+    (void)arg;
+    for (int i = 1; i <= MB_MSGS; i++) {
+        chThdSleepMilliseconds(2);
+        chMBPostTimeout(&g_mb, (msg_t)i, TIME_INFINITE);
+    }
+}
+
+static THD_FUNCTION(consumer_thread, arg) {
+    (void)arg;
+    for (;;) {
+        msg_t msg;
+        if (chMBFetchTimeout(&g_mb, &msg, MS2ST(10)) != MSG_OK) {
+            g_consumer_timeout_at = chVTGetSystemTime();
+            break;
+        }
+        g_consumer_sum += (int)msg;
+        g_consumer_cnt++;
+    }
+}
+
+static void test_semaphores(void) {
+    printf("\n=== Semaphore/Mailbox Test ===\n");
+
+    semaphore_t sem;
+    chSemObjectInit(&sem, 0);
+    systime_t t0 = chVTGetSystemTime();
+    TEST_ASSERT(chSemWaitTimeout(&sem, MS2ST(25)) == MSG_TIMEOUT, "chSemWaitTimeout() times out");
+    TEST_ASSERT(chVTTimeElapsedSinceX(t0) == MS2ST(25), "Timeout after exactly 25 ms");
+    TEST_ASSERT(chSemWaitTimeout(&sem, TIME_IMMEDIATE) == MSG_TIMEOUT, "TIME_IMMEDIATE does not block");
+
+    chMBObjectInit(&g_mb, g_mb_buf, MB_SIZE);
+    g_consumer_sum = 0;
+    g_consumer_cnt = 0;
+
+    t0 = chVTGetSystemTime();
+    thread_t *tc = chThdCreateStatic(waConsumer, sizeof(waConsumer), NORMALPRIO, consumer_thread, NULL);
+    thread_t *tp = chThdCreateStatic(waProducer, sizeof(waProducer), NORMALPRIO, producer_thread, NULL);
+    chThdWait(tp);
+    chThdWait(tc);
+
+    TEST_ASSERT(g_consumer_cnt == MB_MSGS, "Consumer received every message");
+    TEST_ASSERT(g_consumer_sum == MB_MSGS * (MB_MSGS + 1) / 2, "Messages received intact");
+    TEST_ASSERT(g_consumer_timeout_at - t0 == MS2ST(2 * MB_MSGS + 10),
+                "Consumer times out 10 ms after the last message");
+}
+
+/*===========================================================================*/
+/* Priorities                                                                */
+/*===========================================================================*/
+
+static char g_prio_order[8];
+static int g_prio_len;
+
+static THD_WORKING_AREA(waPrioLow, 1024);
+static THD_WORKING_AREA(waPrioNormal, 1024);
+static THD_WORKING_AREA(waPrioHigh, 1024);
+
+static THD_FUNCTION(prio_thread, arg) {
+    g_prio_order[g_prio_len++] = (char)(intptr_t)arg;
+}
+
+static void test_priorities(void) {
+    printf("\n=== Priority Test ===\n");
+
+    g_prio_len = 0;
+    memset(g_prio_order, 0, sizeof(g_prio_order));
+
+    thread_t *a = chThdCreateStatic(waPrioLow, sizeof(waPrioLow), LOWPRIO, prio_thread, (void*)'L');
+    thread_t *b = chThdCreateStatic(waPrioNormal, sizeof(waPrioNormal), NORMALPRIO, prio_thread, (void*)'N');
+    thread_t *c = chThdCreateStatic(waPrioHigh, sizeof(waPrioHigh), HIGHPRIO, prio_thread, (void*)'H');
+
+    TEST_ASSERT(g_prio_len == 0, "Created threads wait until the creator blocks");
+
+    chThdWait(a);
+    chThdWait(b);
+    chThdWait(c);
+
+    TEST_ASSERT(strcmp(g_prio_order, "HNL") == 0, "Ready threads run in priority order");
+}
+
+/*===========================================================================*/
+/* Events and virtual timers                                                 */
+/*===========================================================================*/
+
+static systime_t g_evt_woken_at;
+static eventmask_t g_evt_got;
+static semaphore_t g_vt_sem;
+static systime_t g_vt_fired_at;
+
+static THD_WORKING_AREA(waEvent, 1024);
+
+static THD_FUNCTION(event_thread, arg) {
+    (void)arg;
+    g_evt_got = chEvtWaitAnyTimeout(EVENT_MASK(0) | EVENT_MASK(3), MS2ST(50));
+    g_evt_woken_at = chVTGetSystemTime();
+}
+
+static void vt_callback(void *p) {
+    (void)p;
+    g_vt_fired_at = chVTGetSystemTime();
+    chSysLockFromISR();
+    chSemSignalI(&g_vt_sem);
+    chSysUnlockFromISR();
+}
+
+static void test_events_and_timers(void) {
+    printf("\n=== Events and Virtual Timers Test ===\n");
+
+    systime_t t0 = chVTGetSystemTime();
+    thread_t *tp = chThdCreateStatic(waEvent, sizeof(waEvent), NORMALPRIO, event_thread, NULL);
+    chThdSleepMilliseconds(20);
+    chEvtSignal(tp, EVENT_MASK(3));
+    chThdWait(tp);
+
+    TEST_ASSERT(g_evt_got == EVENT_MASK(3), "chEvtWaitAnyTimeout() returns the signalled event");
+    TEST_ASSERT(g_evt_woken_at - t0 == MS2ST(20), "Waiter wakes when signalled, not at the timeout");
+
+    virtual_timer_t vt;
+    chVTObjectInit(&vt);
+    chSemObjectInit(&g_vt_sem, 0);
+
+    t0 = chVTGetSystemTime();
+    chVTSet(&vt, MS2ST(40), vt_callback, NULL);
+    TEST_ASSERT(chVTIsArmed(&vt), "Virtual timer armed");
+
+    /* Rearming replaces the earlier expiry */
+    chVTSet(&vt, MS2ST(30), vt_callback, NULL);
+    TEST_ASSERT(chSemWaitTimeout(&g_vt_sem, MS2ST(100)) == MSG_OK, "Timer callback signalled the semaphore");
+    TEST_ASSERT(g_vt_fired_at - t0 == MS2ST(30), "Timer fired at the rearmed time");
+    TEST_ASSERT(!chVTIsArmed(&vt), "One-shot timer disarmed after firing");
+
+    chVTSet(&vt, MS2ST(5), vt_callback, NULL);
+    chVTReset(&vt);
+    TEST_ASSERT(chSemWaitTimeout(&g_vt_sem, MS2ST(20)) == MSG_TIMEOUT, "Reset timer does not fire");
+}
+
+/*===========================================================================*/
+/* Firmware code                                                             */
+/*===========================================================================*/
+
+static int g_worker_steps;
+
+static void worker_task(void *arg) {
+    int steps = *(int*)arg;
+    for (int i = 0; i < steps; i++) {
+        chThdSleepMilliseconds(100);
+        g_worker_steps++;
+    }
+}
+
+static void test_worker(void) {
+    printf("\n=== Worker Test ===\n");
+
+    static int steps = 50;
+    g_worker_steps = 0;
+
+    systime_t t0 = chVTGetSystemTime();
+    worker_execute(worker_task, &steps);
+
+    /* The worker only publishes its thread pointer once it runs. Same as on
+     * the MCU, it does not preempt a creator of the same priority. */
+    chThdYield();
+    worker_wait();
+
+    TEST_ASSERT(g_worker_steps == steps, "worker_execute() task completed");
+    TEST_ASSERT(chVTTimeElapsedSinceX(t0) == MS2ST(100 * steps), "Task took 5 s of virtual time");
+}
+
+/*===========================================================================*/
+/* Main                                                                      */
+/*===========================================================================*/
+
+int main(void) {
+    printf("========================================\n");
+    printf("VESC Firmware PC Build - Virtual Time Test\n");
+    printf("========================================\n");
+
+    chSysInitVirtual();
+    halInit();
+
+    TEST_ASSERT(chSysIsVirtual(), "Virtual time mode enabled");
+    TEST_ASSERT(chVTGetSystemTime() == 0, "Virtual time starts at 0");
+
+    test_sleep();
+    test_periodic_threads();
+    test_semaphores();
+    test_priorities();
+    test_events_and_timers();
+    test_worker();
+
+    printf("\n========================================\n");
+    printf("Virtual Time Test Results: %d passed, %d failed\n", test_passed, test_failed);
+    printf("========================================\n");
+
+    if (test_failed > 0) {
+        printf("\nVirtual time test: FAILED\n");
+        return 1;
+    }
+
+    printf("\nVirtual time test: OK\n");
+    return 0;
+}
@@ -0,0 +1,685 @@
+/**
+ * @file bench_foc_math.c
+ * @brief Microbenchmark of the FOC kernels that run in every ADC interrupt
+ *
+ * Usage: bench_foc_math [-o results.json] [-b baseline.json] [-t percent]
+ *                       [-n calls] [-s samples]
+ *
+ * Times foc_observer_update(), foc_pll_run(), foc_svm(), utils_fast_atan2(),
+ * utils_fast_sincos_better() and foc_run_pid_control_speed() over
+ * randomized but realistic inputs (a rotating motor with random speed and
+ * current segments). Every kernel is measured once per branch path, e.g.
+ * per observer type, or with angles that need wrapping, so that the slowest
+ * path shows up next to the common one.
+ *
+ * Each path is run for a number of samples of n calls. ns/call and
+ * cycles/call are the medians over the samples, the max column is the
+ * slowest sample. Cycles come from the core cycle counter (perf events)
+ * when the kernel allows it, otherwise from the TSC, which counts at the
+ * nominal clock.
+ *
+ * The JSON output has one line per path so that two runs can be diffed.
+ * With -b, the run is compared against an earlier JSON file and the exit
+ * status is 1 if any path got slower than the threshold (default 10 %).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "../motor_sim/foc_control_core.h"
+#include "../motor_sim/mcconf_stub.h"
+#include "utils_math.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846f
+#endif
+
+#define BENCH_INPUTS            1024    // Input set, cycled through
+#define BENCH_SEGMENT           64      // Inputs per random operating point
+#define BENCH_DEFAULT_CALLS     32768
+#define BENCH_DEFAULT_SAMPLES   51
+#define BENCH_WARMUP            2
+#define BENCH_MAX_SAMPLES       1001
+
+// ==================== Timing ====================
+
+static int perf_fd = -1;
+
+static const char *cycles_init(void) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    perf_fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (perf_fd >= 0) return "core";
+
+#if defined(__x86_64__) || defined(__i386__)
+    return "tsc";
+#else
+    return "none";
+#endif
+}
+
+static uint64_t cycles_now(void) {
+    if (perf_fd >= 0) {
+        uint64_t v;
+        if (read(perf_fd, &v, sizeof(v)) == (ssize_t)sizeof(v)) return v;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static double time_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// ==================== Inputs ====================
+
+typedef struct {
+    float a[BENCH_INPUTS];
+    float b[BENCH_INPUTS];
+    float c[BENCH_INPUTS];
+    float d[BENCH_INPUTS];
+} bench_inputs_t;
+
+static uint32_t rng_state = 0x12345678u;
+
+static float rand_uniform(float lo, float hi) {
+    // xorshift32, fixed seed so that every run sees the same inputs
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return lo + (hi - lo) * (float)(rng_state >> 8) * (1.0f / 16777216.0f);
+}
+
+static mc_configuration conf;
+static motor_all_state_t motor;
+static float dt;
+
+// Rotating motor: a = v_alpha, b = v_beta, c = i_alpha, d = i_beta, with a
+// new random speed, current and load angle every segment
+static void prepare_motor(bench_inputs_t *in) {
+    float theta = 0.0f;
+    float we = 0.0f, i_mag = 0.0f, i_angle = 0.0f;
+
+    for (int i = 0; i < BENCH_INPUTS; i++) {
+        if (i % BENCH_SEGMENT == 0) {
+            we = rand_uniform(-3000.0f, 3000.0f);
+            i_mag = rand_uniform(0.0f, 60.0f);
+            i_angle = rand_uniform(0.5f * M_PI, 1.0f * M_PI) - 0.25f * M_PI;
+        }
+        theta += we * dt;
+        utils_norm_angle_rad(&theta);
+
+        float ia = i_mag * cosf(theta + i_angle);
+        float ib = i_mag * sinf(theta + i_angle);
+        float emf = we * conf.foc_motor_flux_linkage;
+
+        in->a[i] = conf.foc_motor_r * ia - emf * sinf(theta) + rand_uniform(-0.2f, 0.2f);
+        in->b[i] = conf.foc_motor_r * ib + emf * cosf(theta) + rand_uniform(-0.2f, 0.2f);
+        in->c[i] = ia + rand_uniform(-0.5f, 0.5f);
+        in->d[i] = ib + rand_uniform(-0.5f, 0.5f);
+    }
+}
+
+// a = angle of a vector rotating at a random speed per segment,
+// b = magnitude
+static void prepare_rotating(bench_inputs_t *in) {
+    float theta = 0.0f, we = 0.0f, mag = 0.0f;
+
+    for (int i = 0; i < BENCH_INPUTS; i++) {
+        if (i % BENCH_SEGMENT == 0) {
+            we = rand_uniform(-3000.0f, 3000.0f);
+            mag = rand_uniform(0.05f, 0.55f);
+        }
+        theta += we * dt;
+        utils_norm_angle_rad(&theta);
+        in->a[i] = theta;
+        in->b[i] = mag;
+    }
+}
+
+// Same, but every input at a random angle, so branches on the angle are
+// not predictable
+static void prepare_random(bench_inputs_t *in) {
+    for (int i = 0; i < BENCH_INPUTS; i++) {
+        in->a[i] = rand_uniform(-M_PI, M_PI);
+        in->b[i] = rand_uniform(0.05f, 0.55f);
+    }
+}
+
+// Angles up to two turns outside [-pi, pi], which the wrap loops handle
+static void prepare_unwrapped(bench_inputs_t *in) {
+    for (int i = 0; i < BENCH_INPUTS; i++) {
+        in->a[i] = rand_uniform(-5.0f * M_PI, 5.0f * M_PI);
+        in->b[i] = rand_uniform(0.05f, 0.55f);
+    }
+}
+
+// a = speed command [ERPM], b = measured speed [rad/s]
+static void prepare_speed(bench_inputs_t *in) {
+    float cmd = 0.0f, speed = 0.0f;
+
+    for (int i = 0; i < BENCH_INPUTS; i++) {
+        if (i % BENCH_SEGMENT == 0) {
+            cmd = rand_uniform(-20000.0f, 20000.0f);
+            speed = RPM2RADPS_f(cmd + rand_uniform(-500.0f, 500.0f));
+        }
+        in->a[i] = cmd;
+        in->b[i] = speed + rand_uniform(-5.0f, 5.0f);
+    }
+}
+
+// Command and speed far apart, so the output saturates
+static void prepare_speed_saturated(bench_inputs_t *in) {
+    for (int i = 0; i < BENCH_INPUTS; i++) {
+        in->a[i] = rand_uniform(-50000.0f, 50000.0f);
+        in->b[i] = RPM2RADPS_f(-in->a[i]);
+    }
+}
+
+// ==================== Kernels ====================
+
+static volatile float sink_f;
+static volatile uint32_t sink_u;
+
+static void setup_observer(int variant) {
+    mcconf_set_defaults(&conf);
+    conf.foc_observer_type = (mc_foc_observer_type)variant;
+    foc_motor_state_init(&motor, &conf);
+    motor.m_motor_state.id = -5.0f;
+    motor.m_motor_state.iq = 20.0f;
+}
+
+static void run_observer(const bench_inputs_t *in, int calls) {
+    observer_state obs;
+    memset(&obs, 0, sizeof(obs));
+    obs.lambda_est = conf.foc_motor_flux_linkage;
+    float phase = 0.0f;
+
+    for (int i = 0; i < calls; i++) {
+        int k = i & (BENCH_INPUTS - 1);
+        foc_observer_update(in->a[k], in->b[k], in->c[k], in->d[k], dt, &obs, &phase, &motor);
+    }
+    sink_f = phase;
+}
+
+static void setup_defaults(int variant) {
+    (void)variant;
+    mcconf_set_defaults(&conf);
+    foc_motor_state_init(&motor, &conf);
+}
+
+static void run_pll(const bench_inputs_t *in, int calls) {
+    float phase = in->a[0];
+    float speed = 0.0f;
+
+    for (int i = 0; i < calls; i++) {
+        foc_pll_run(in->a[i & (BENCH_INPUTS - 1)], dt, &phase, &speed, &conf);
+    }
+    sink_f = phase + speed;
+}
+
+static void run_svm(const bench_inputs_t *in, int calls) {
+    uint32_t t1 = 0, t2 = 0, t3 = 0, sector = 0;
+
+    for (int i = 0; i < calls; i++) {
+        int k = i & (BENCH_INPUTS - 1);
+        foc_svm(in->c[k], in->d[k], conf.l_max_duty, FOC_PWM_PERIOD_DEFAULT,
+                &t1, &t2, &t3, &sector);
+    }
+    sink_u = t1 + t2 + t3 + sector;
+}
+
+static void run_atan2(const bench_inputs_t *in, int calls) {
+    float acc = 0.0f;
+
+    for (int i = 0; i < calls; i++) {
+        int k = i & (BENCH_INPUTS - 1);
+        acc += utils_fast_atan2(in->d[k], in->c[k]);
+    }
+    sink_f = acc;
+}
+
+static void run_sincos(const bench_inputs_t *in, int calls) {
+    float acc = 0.0f;
+
+    for (int i = 0; i < calls; i++) {
+        float s, c;
+        utils_fast_sincos_better(in->a[i & (BENCH_INPUTS - 1)], &s, &c);
+        acc += s + c;
+    }
+    sink_f = acc;
+}
+
+static void setup_speed(int variant) {
+    mcconf_set_defaults(&conf);
+    conf.s_pid_allow_braking = (variant == 0);
+    foc_motor_state_init(&motor, &conf);
+    motor.m_control_mode = CONTROL_MODE_SPEED;
+}
+
+static void run_speed_pid(const bench_inputs_t *in, int calls) {
+    motor.m_speed_i_term = 0.0f;
+    motor.m_speed_prev_error = 0.0f;
+    motor.m_speed_d_filter = 0.0f;
+    motor.m_speed_pid_set_rpm = in->a[0];
+
+    for (int i = 0; i < calls; i++) {
+        int k = i & (BENCH_INPUTS - 1);
+        motor.m_speed_command_rpm = in->a[k];
+        motor.m_pll_speed = in->b[k];
+        foc_run_pid_control_speed(true, dt, &motor);
+    }
+    sink_f = motor.m_iq_set;
+}
+
+// The angle and magnitude inputs as a vector, c = x and d = y, computed
+// outside the timed loop
+static void prepare_vector(bench_inputs_t *in, void (*angles)(bench_inputs_t *in)) {
+    angles(in);
+    for (int i = 0; i < BENCH_INPUTS; i++) {
+        in->c[i] = in->b[i] * cosf(in->a[i]);
+        in->d[i] = in->b[i] * sinf(in->a[i]);
+    }
+}
+
+static void prepare_vector_rotating(bench_inputs_t *in) {
+    prepare_vector(in, prepare_rotating);
+}
+
+static void prepare_vector_random(bench_inputs_t *in) {
+    prepare_vector(in, prepare_random);
+}
+
+// a = current command [A], b = bus voltage [V], c = electrical speed [rad/s]
+static void prepare_mtpa(bench_inputs_t *in) {
+    float we = 0.0f;
+
+    for (int i = 0; i < BENCH_INPUTS; i++) {
+        if (i % BENCH_SEGMENT == 0) {
+            we = rand_uniform(-8000.0f, 8000.0f);
+        }
+        in->a[i] = rand_uniform(-conf.l_current_max, conf.l_current_max);
+        in->b[i] = rand_uniform(44.0f, 50.0f);
+        in->c[i] = we;
+    }
+}
+
+static void setup_mtpa(int variant) {
+    mcconf_set_defaults(&conf);
+    conf.foc_motor_ld_lq_diff = 0.3f * conf.foc_motor_l;
+    conf.foc_mtpa_mode = variant == 0 ? MTPA_MODE_IQ_TARGET : MTPA_MODE_TABLE;
+    foc_motor_state_init(&motor, &conf);
+    foc_precalc_values(&motor);
+}
+
+// The MTPA block of the current controller, either the closed form or
+// the table with the voltage limit
+static void run_mtpa(const bench_inputs_t *in, int calls) {
+    const float ld_lq_diff = conf.foc_motor_ld_lq_diff;
+    const float lambda = conf.foc_motor_flux_linkage;
+    float acc = 0.0f;
+
+    for (int i = 0; i < calls; i++) {
+        int k = i & (BENCH_INPUTS - 1);
+        float id, iq = in->a[k];
+
+        if (conf.foc_mtpa_mode == MTPA_MODE_TABLE) {
+            const float i_ref = fabsf(iq);
+            const float v_avail = motor.p_mtpa_v_scale * in->b[k] - conf.foc_motor_r * i_ref;
+            float iq_table;
+            foc_mtpa_table_lookup(&motor.m_mtpa_table, i_ref, v_avail, in->c[k], &id, &iq_table);
+            iq = SIGN(iq) * iq_table;
+        } else {
+            id = (lambda - sqrtf(SQ(lambda) + 8.0f * SQ(ld_lq_diff * iq))) / (4.0f * ld_lq_diff);
+            iq = SIGN(iq) * sqrtf(SQ(iq) - SQ(id));
+        }
+        acc += id + iq;
+    }
+    sink_f = acc;
+}
+
+static void setup_dt_comp(int variant) {
+    mcconf_set_defaults(&conf);
+    foc_motor_state_init(&motor, &conf);
+    foc_dt_comp_reset(&motor.m_dt_comp, conf.l_current_max * FOC_DT_COMP_RANGE_FACTOR,
+                      conf.foc_dt_us * 1e-6f * conf.foc_f_zv);
+    motor.m_dt_comp.learn = variant == 1;
+}
+
+// Dead time compensation of the current controller, on the phase currents
+// of prepare_motor, with or without learning from the voltage residual
+static void run_dt_comp(const bench_inputs_t *in, int calls) {
+    float acc = 0.0f;
+
+    for (int i = 0; i < calls; i++) {
+        int k = i & (BENCH_INPUTS - 1);
+        const float ia = in->c[k];
+        const float ib = -0.5f * in->c[k] + SQRT3_BY_2 * in->d[k];
+        const float ic = -0.5f * in->c[k] - SQRT3_BY_2 * in->d[k];
+
+        if (motor.m_dt_comp.learn) {
+            foc_dt_comp_learn(&motor.m_dt_comp, ia, ib, ic, 1e-3f * in->a[k], 1e-3f * in->b[k], 1e-3f);
+        }
+
+        float mod_alpha, mod_beta;
+        foc_dt_comp_get(&motor.m_dt_comp, ia, ib, ic, &mod_alpha, &mod_beta);
+        acc += mod_alpha + mod_beta;
+    }
+    sink_f = acc;
+}
+
+#define HFI_BENCH_FFT           (1 << 8)
+#define HFI_BENCH_GOERTZEL      (2 << 8)
+
+static int hfi_len;
+static int hfi_impl;
+static utils_dft_t hfi_dft;
+
+// a = inverse inductance samples of the HFI buffer, a dc offset with a
+// second harmonic from the saliency and noise
+static void prepare_hfi(bench_inputs_t *in) {
+    for (int i = 0; i < BENCH_INPUTS; i++) {
+        in->a[i] = 1e5f + 2e4f * cosf(4.0f * M_PI * (float)i / 64.0f + 0.3f) + rand_uniform(-1e3f, 1e3f);
+    }
+}
+
+// Variant: buffer length, or'ed with the implementation
+static void setup_hfi(int variant) {
+    hfi_len = variant & 0xFF;
+    hfi_impl = variant & ~0xFF;
+    utils_dft_init(&hfi_dft, hfi_len);
+}
+
+// Bin 1 and bin 2 of one HFI buffer, like the HFI thread. The unrolled
+// functions only exist for 8, 16 and 32 samples.
+static void run_hfi(const bench_inputs_t *in, int calls) {
+    float acc = 0.0f;
+
+    for (int i = 0; i < calls; i++) {
+        float *buf = (float*)&in->a[(i & 15) * UTILS_DFT_MAX_LEN];
+        float re1, im1, re2, im2;
+
+        if (hfi_impl == HFI_BENCH_FFT) {
+            if (hfi_len == 16) {
+                utils_fft16_bin1(buf, &re1, &im1);
+                utils_fft16_bin2(buf, &re2, &im2);
+            } else {
+                utils_fft32_bin1(buf, &re1, &im1);
+                utils_fft32_bin2(buf, &re2, &im2);
+            }
+        } else if (hfi_impl == HFI_BENCH_GOERTZEL) {
+            utils_goertzel(buf, hfi_len, 1.0f, &re1, &im1);
+            utils_goertzel(buf, hfi_len, 2.0f, &re2, &im2);
+        } else {
+            utils_dft_bin(&hfi_dft, buf, 1, &re1, &im1);
+            utils_dft_bin(&hfi_dft, buf, 2, &re2, &im2);
+        }
+        acc += re1 + im1 + re2 + im2;
+    }
+    sink_f = acc;
+}
+
+typedef struct {
+    const char *kernel;
+    const char *path;
+    int variant;
+    void (*setup)(int variant);
+    void (*prepare)(bench_inputs_t *in);
+    void (*run)(const bench_inputs_t *in, int calls);
+} bench_case_t;
+
+static const bench_case_t cases[] = {
+    {"foc_observer_update", "ortega_original",       FOC_OBSERVER_ORTEGA_ORIGINAL,       setup_observer, prepare_motor, run_observer},
+    {"foc_observer_update", "mxlemming",             FOC_OBSERVER_MXLEMMING,             setup_observer, prepare_motor, run_observer},
+    {"foc_observer_update", "ortega_lambda_comp",    FOC_OBSERVER_ORTEGA_LAMBDA_COMP,    setup_observer, prepare_motor, run_observer},
+    {"foc_observer_update", "mxlemming_lambda_comp", FOC_OBSERVER_MXLEMMING_LAMBDA_COMP, setup_observer, prepare_motor, run_observer},
+    {"foc_observer_update", "mxv",                   FOC_OBSERVER_MXV,                   setup_observer, prepare_motor, run_observer},
+    {"foc_observer_update", "mxv_lambda_comp",       FOC_OBSERVER_MXV_LAMBDA_COMP,       setup_observer, prepare_motor, run_observer},
+    {"foc_observer_update", "mxv_lambda_comp_lin",   FOC_OBSERVER_MXV_LAMBDA_COMP_LIN,   setup_observer, prepare_motor, run_observer},
+    {"foc_observer_update", "ekf",                   FOC_OBSERVER_EKF,                   setup_observer, prepare_motor, run_observer},
+    {"foc_pll_run",         "tracking",              0, setup_defaults, prepare_rotating,  run_pll},
+    {"foc_pll_run",         "phase_jumps",           0, setup_defaults, prepare_random,    run_pll},
+    {"foc_svm",             "rotating",              0, setup_defaults, prepare_vector_rotating, run_svm},
+    {"foc_svm",             "random_sector",         0, setup_defaults, prepare_vector_random,   run_svm},
+    {"utils_fast_atan2",    "rotating",              0, setup_defaults, prepare_vector_rotating, run_atan2},
+    {"utils_fast_atan2",    "random_quadrant",       0, setup_defaults, prepare_vector_random,   run_atan2},
+    {"utils_fast_sincos_better", "rotating",         0, setup_defaults, prepare_rotating,  run_sincos},
+    {"utils_fast_sincos_better", "random",           0, setup_defaults, prepare_random,    run_sincos},
+    {"utils_fast_sincos_better", "unwrapped",        0, setup_defaults, prepare_unwrapped, run_sincos},
+    {"foc_run_pid_control_speed", "tracking",        0, setup_speed, prepare_speed,           run_speed_pid},
+    {"foc_run_pid_control_speed", "saturated",       0, setup_speed, prepare_speed_saturated, run_speed_pid},
+    {"foc_run_pid_control_speed", "no_braking",      1, setup_speed, prepare_speed_saturated, run_speed_pid},
+    {"mtpa",                "formula",               0, setup_mtpa,  prepare_mtpa,            run_mtpa},
+    {"mtpa",                "table",                 1, setup_mtpa,  prepare_mtpa,            run_mtpa},
+    {"foc_dt_comp",         "get",                   0, setup_dt_comp, prepare_motor,         run_dt_comp},
+    {"foc_dt_comp",         "learn_get",             1, setup_dt_comp, prepare_motor,         run_dt_comp},
+    {"hfi_bins",            "fft16_unrolled",        16 | HFI_BENCH_FFT, setup_hfi, prepare_hfi, run_hfi},
+    {"hfi_bins",            "dft16",                 16,                 setup_hfi, prepare_hfi, run_hfi},
+    {"hfi_bins",            "fft32_unrolled",        32 | HFI_BENCH_FFT, setup_hfi, prepare_hfi, run_hfi},
+    {"hfi_bins",            "dft32",                 32,                 setup_hfi, prepare_hfi, run_hfi},
+    {"hfi_bins",            "goertzel32",            32 | HFI_BENCH_GOERTZEL, setup_hfi, prepare_hfi, run_hfi},
+    {"hfi_bins",            "dft24",                 24,                 setup_hfi, prepare_hfi, run_hfi},
+    {"hfi_bins",            "dft48",                 48,                 setup_hfi, prepare_hfi, run_hfi},
+    {"hfi_bins",            "dft64",                 64,                 setup_hfi, prepare_hfi, run_hfi},
+};
+
+#define NUM_CASES ((int)(sizeof(cases) / sizeof(cases[0])))
+
+// ==================== Measurement ====================
+
+typedef struct {
+    double ns_median;
+    double ns_min;
+    double ns_max;
+    double cycles_median;
+} bench_result_t;
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void measure(const bench_case_t *bc, int calls, int samples, bench_result_t *res) {
+    static bench_inputs_t in;
+    static double ns[BENCH_MAX_SAMPLES];
+    static double cyc[BENCH_MAX_SAMPLES];
+
+    bc->setup(bc->variant);
+    dt = 1.0f / conf.foc_f_zv;
+    rng_state = 0x12345678u;
+    memset(&in, 0, sizeof(in));
+    bc->prepare(&in);
+
+    for (int s = -BENCH_WARMUP; s < samples; s++) {
+        uint64_t c0 = cycles_now();
+        double t0 = time_now();
+        bc->run(&in, calls);
+        double t1 = time_now();
+        uint64_t c1 = cycles_now();
+
+        if (s >= 0) {
+            ns[s] = (t1 - t0) * 1e9 / (double)calls;
+            cyc[s] = (double)(c1 - c0) / (double)calls;
+        }
+    }
+
+    qsort(ns, (size_t)samples, sizeof(double), cmp_double);
+    qsort(cyc, (size_t)samples, sizeof(double), cmp_double);
+
+    res->ns_median = ns[samples / 2];
+    res->ns_min = ns[0];
+    res->ns_max = ns[samples - 1];
+    res->cycles_median = cyc[samples / 2];
+}
+
+// ==================== Output ====================
+
+static void write_json(FILE *out, const char *counter, int calls, int samples,
+                       const bench_result_t *res) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"benchmark\": \"foc_math\",\n");
+    fprintf(out, "  \"cycle_counter\": \"%s\",\n", counter);
+    fprintf(out, "  \"calls_per_sample\": %d,\n", calls);
+    fprintf(out, "  \"samples\": %d,\n", samples);
+    fprintf(out, "  \"results\": [\n");
+    for (int i = 0; i < NUM_CASES; i++) {
+        fprintf(out, "    {\"kernel\": \"%s\", \"path\": \"%s\", \"ns_per_call\": %.3f, "
+                "\"ns_min\": %.3f, \"ns_max\": %.3f, \"cycles_per_call\": %.1f}%s\n",
+                cases[i].kernel, cases[i].path, res[i].ns_median, res[i].ns_min,
+                res[i].ns_max, res[i].cycles_median, (i < NUM_CASES - 1) ? "," : "");
+    }
+    fprintf(out, "  ],\n");
+
+    // Slowest path of every kernel
+    fprintf(out, "  \"worst_case\": [\n");
+    bool first = true;
+    for (int i = 0; i < NUM_CASES; i++) {
+        if (i > 0 && strcmp(cases[i].kernel, cases[i - 1].kernel) == 0) continue;
+
+        int worst = i;
+        for (int j = i + 1; j < NUM_CASES && strcmp(cases[j].kernel, cases[i].kernel) == 0; j++) {
+            if (res[j].ns_median > res[worst].ns_median) worst = j;
+        }
+
+        fprintf(out, "%s    {\"kernel\": \"%s\", \"path\": \"%s\", \"ns_per_call\": %.3f, "
+                "\"cycles_per_call\": %.1f}", first ? "" : ",\n", cases[worst].kernel,
+                cases[worst].path, res[worst].ns_median, res[worst].cycles_median);
+        first = false;
+    }
+    fprintf(out, "\n  ]\n}\n");
+}
+
+// Compares against the "results" lines of an earlier run. Returns the
+// number of paths that got slower than threshold percent, or -1.
+static int compare_baseline(const char *filename, const bench_result_t *res, double threshold) {
+    FILE *f = fopen(filename, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Could not open baseline %s\n", filename);
+        return -1;
+    }
+
+    printf("\nComparison with %s (threshold %.1f %%):\n", filename, threshold);
+
+    int regressions = 0;
+    char line[512];
+    bool in_results = false;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (strstr(line, "\"results\"") != NULL) {
+            in_results = true;
+            continue;
+        }
+        if (!in_results) continue;
+        if (strchr(line, ']') != NULL && strchr(line, '{') == NULL) break;
+
+        char kernel[64], path[64];
+        double ns;
+        if (sscanf(line, " {\"kernel\": \"%63[^\"]\", \"path\": \"%63[^\"]\", \"ns_per_call\": %lf",
+                   kernel, path, &ns) != 3) {
+            continue;
+        }
+
+        for (int i = 0; i < NUM_CASES; i++) {
+            if (strcmp(cases[i].kernel, kernel) != 0 || strcmp(cases[i].path, path) != 0) continue;
+
+            double change = (ns > 0.0) ? 100.0 * (res[i].ns_median - ns) / ns : 0.0;
+            bool slower = change > threshold;
+            if (slower) regressions++;
+            printf("  %-4s %-26s %-22s %8.2f -> %8.2f ns  %+6.1f %%\n",
+                   slower ? "SLOW" : "ok", kernel, path, ns, res[i].ns_median, change);
+        }
+    }
+    fclose(f);
+
+    return regressions;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-o results.json] [-b baseline.json] [-t percent] [-n calls] [-s samples]\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    const char *output = NULL;
+    const char *baseline = NULL;
+    double threshold = 10.0;
+    int calls = BENCH_DEFAULT_CALLS;
+    int samples = BENCH_DEFAULT_SAMPLES;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            baseline = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            calls = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            samples = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (calls < 1 || samples < 1 || samples > BENCH_MAX_SAMPLES) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    const char *counter = cycles_init();
+    static bench_result_t res[NUM_CASES];
+
+    printf("FOC kernel microbenchmark: %d samples of %d calls, cycles from %s counter\n\n",
+           samples, calls, counter);
+    printf("  %-26s %-22s %9s %9s %9s %10s\n", "kernel", "path", "ns/call", "min", "max", "cycles");
+
+    for (int i = 0; i < NUM_CASES; i++) {
+        measure(&cases[i], calls, samples, &res[i]);
+        printf("  %-26s %-22s %9.2f %9.2f %9.2f %10.1f\n", cases[i].kernel, cases[i].path,
+               res[i].ns_median, res[i].ns_min, res[i].ns_max, res[i].cycles_median);
+    }
+
+    if (output != NULL) {
+        FILE *f = fopen(output, "w");
+        if (f == NULL) {
+            fprintf(stderr, "Could not write %s\n", output);
+            return 2;
+        }
+        write_json(f, counter, calls, samples, res);
+        fclose(f);
+        printf("\nResults written to %s\n", output);
+    }
+
+    if (baseline != NULL) {
+        int regressions = compare_baseline(baseline, res, threshold);
+        if (regressions < 0) return 2;
+        printf("%d path(s) slower than %.1f %%\n", regressions, threshold);
+        return (regressions > 0) ? 1 : 0;
+    }
+
+    return 0;
+}
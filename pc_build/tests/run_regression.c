@@ -0,0 +1,132 @@
+/**
+ * @file run_regression.c
+ * @brief Command-line runner for regression scenario manifests
+ *
+ * Usage: run_regression [-j threads] [-o summary.json] [--update] manifest
+ *
+ * Runs all scenarios of the manifest in parallel, prints one line per
+ * scenario and writes the JSON summary. With --update the recorded
+ * traces are written as the new golden traces instead. The exit status
+ * is the number of failed scenarios (capped at 100), so a CI job fails
+ * on any regression.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../motor_sim/simulation_regression.h"
+#include "../motor_sim/simulation_sweep.h"
+
+static double time_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-j threads] [-o summary.json] [--update] manifest\n", prog);
+}
+
+// Signal with the largest envelope ratio, or -1
+static int worst_signal(const sim_reg_result_t *r) {
+    int worst = -1;
+    for (int f = 1; f < SIM_DATA_NUM_FIELDS; f++) {
+        if (!r->signals[f].checked) continue;
+        if (worst < 0 || !(r->signals[f].worst_ratio <= r->signals[worst].worst_ratio)) {
+            worst = f;
+        }
+    }
+    return worst;
+}
+
+int main(int argc, char **argv) {
+    const char *manifest = NULL;
+    const char *summary = NULL;
+    int threads = 0;
+    bool update = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            summary = argv[++i];
+        } else if (strcmp(argv[i], "--update") == 0) {
+            update = true;
+        } else if (argv[i][0] != '-' && manifest == NULL) {
+            manifest = argv[i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (manifest == NULL) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    sim_reg_scenario_t *scenarios = NULL;
+    char err[256];
+    int count = sim_reg_load_manifest(manifest, &scenarios, err, sizeof(err));
+    if (count < 0) {
+        fprintf(stderr, "%s: %s\n", manifest, err);
+        return 2;
+    }
+
+    sim_reg_result_t *results = calloc((size_t)(count > 0 ? count : 1), sizeof(sim_reg_result_t));
+    if (results == NULL) {
+        free(scenarios);
+        return 2;
+    }
+
+    if (threads <= 0) threads = sim_sweep_get_num_cpus();
+
+    double start = time_now();
+    int failed = sim_reg_run(scenarios, results, count, threads);
+    double wall = time_now() - start;
+
+    if (update) {
+        int written = 0;
+        for (int i = 0; i < count; i++) {
+            if (results[i].result != 0 || sim_reg_save_golden(&scenarios[i], &results[i]) < 0) {
+                fprintf(stderr, "%s: could not update %s\n", scenarios[i].name, scenarios[i].reference);
+                continue;
+            }
+            written++;
+        }
+        printf("Updated %d/%d golden traces\n", written, count);
+        failed = count - written;
+    } else {
+        for (int i = 0; i < count; i++) {
+            const sim_reg_result_t *r = &results[i];
+            int f = worst_signal(r);
+
+            printf("%-4s %-32s", r->pass ? "PASS" : "FAIL", scenarios[i].name);
+            if (r->reference_missing) {
+                printf(" missing %s", scenarios[i].reference);
+            } else if (r->result != 0) {
+                printf(" simulation failed");
+            } else if (f > 0) {
+                printf(" worst %-8s %6.3f of tolerance, lag %+.4f s",
+                       sim_data_field_name(f), r->signals[f].worst_ratio, r->signals[f].lag);
+            }
+            printf("\n");
+        }
+
+        printf("\n%d scenarios, %d passed, %d failed in %.2f s on %d threads\n",
+               count, count - failed, failed, wall, threads);
+
+        if (summary != NULL && sim_reg_save_summary(summary, scenarios, results, count, wall) < 0) {
+            fprintf(stderr, "Could not write %s\n", summary);
+        }
+    }
+
+    sim_reg_free_results(results, count);
+    free(results);
+    free(scenarios);
+
+    if (failed < 0) return 2;
+    return (failed > 100) ? 100 : failed;
+}
@@ -0,0 +1,433 @@
+/**
+ * @file test_comm_can.c
+ * @brief CAN-FD paths of comm/comm_can.c on the virtual board
+ *
+ * comm_can.c is built for hil/hw_hil.h with HW_HIL_CAN, which gives it a
+ * CAN controller with CAN-FD. Its threads run in virtual time, the FD
+ * frames it sends end up in hw_hil_can_fd_transmit here and are looped
+ * back through comm_can_fd_frame_received as if another node sent them.
+ * The other node is a can_fd_t of this test. Everything else around
+ * comm_can.c comes from hil/hil_can_stubs.c.
+ *
+ * Validates:
+ * - Enabling FD frames programs the controller with both bit timings
+ * - Without FD frames nothing is sent in FD frames
+ * - The status messages go out merged in CAN_PACKET_STATUS_FD frames
+ * - Merged status frames from another node are decoded message by message
+ * - Without can_status_on_change all messages are sent at every tick
+ * - An FD buffer from another node is delivered to commands_process_packet
+ * - Buffers to that node go out in FD frames and arrive unchanged
+ * - Buffers to nodes without FD support are not sent in FD frames
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+
+// Test framework
+#define TEST_ASSERT(cond, msg) do { \
+    if (!(cond)) { \
+        printf("  FAIL: %s (line %d)\n", msg, __LINE__); \
+        test_failures++; \
+        return false; \
+    } \
+} while(0)
+
+#define RUN_TEST(test_func) do { \
+    printf("Running %s...\n", #test_func); \
+    total_tests++; \
+    if (test_func()) { \
+        printf("  PASS\n"); \
+        passed_tests++; \
+    } \
+} while(0)
+
+static int test_failures = 0;
+static int total_tests = 0;
+static int passed_tests = 0;
+
+#include "ch.h"
+#include "hal.h"
+#include "comm_can.h"
+#include "commands.h"
+#include "mc_interface.h"
+#include "app.h"
+#include "app_stub.h"
+
+#define LOCAL_ID        10
+#define REMOTE_ID       20
+#define TX_FRAMES       64
+
+typedef struct {
+    uint32_t eid;
+    uint8_t data[CAN_FD_FRAME_LEN];
+    uint8_t len;
+} tx_frame_t;
+
+// FD frames sent by comm_can.c
+static tx_frame_t tx[TX_FRAMES];
+static int tx_frames = 0;
+static bool tx_bad_len = false;
+
+// Controller settings
+static bool mode_fd = false;
+static bool mode_brs = false;
+static can_fd_timing mode_nominal;
+static can_fd_timing mode_data;
+static int mode_calls = 0;
+
+// Buffers comm_can.c passed to commands_process_packet
+static uint8_t rx_data[CAN_FD_MAX_LEN];
+static unsigned int rx_len = 0;
+static int rx_count = 0;
+
+// The other node
+static can_fd_t remote;
+static uint8_t remote_data[CAN_FD_MAX_LEN];
+static unsigned int remote_len = 0;
+static uint8_t remote_src = 0;
+static uint8_t remote_send = 0;
+static int remote_count = 0;
+
+// Motor values in the status messages
+static struct {
+    float rpm;
+    float current;
+    float duty;
+    float amp_hours;
+    float amp_hours_charged;
+    float watt_hours;
+    float watt_hours_charged;
+    float temp_fet;
+    float temp_motor;
+    float current_in;
+    float pid_pos;
+    int tacho;
+    float v_in;
+} motor;
+
+void hw_hil_can_fd_set_mode(bool fd, bool brs, const can_fd_timing *nominal, const can_fd_timing *data) {
+    mode_fd = fd;
+    mode_brs = brs;
+    mode_nominal = *nominal;
+    mode_data = *data;
+    mode_calls++;
+}
+
+msg_t hw_hil_can_fd_transmit(uint32_t eid, const uint8_t *data, uint8_t len) {
+    if (comm_can_fd_frame_len(len) != len) {
+        tx_bad_len = true;
+    }
+
+    if (tx_frames < TX_FRAMES) {
+        tx_frame_t *f = &tx[tx_frames++];
+        f->eid = eid;
+        f->len = len;
+        memcpy(f->data, data, len);
+    }
+
+    return MSG_OK;
+}
+
+void commands_process_packet(unsigned char *data, unsigned int len,
+        void(*reply_func)(unsigned char *data, unsigned int len)) {
+    (void)reply_func;
+    memcpy(rx_data, data, len);
+    rx_len = len;
+    rx_count++;
+}
+
+float mc_interface_get_rpm(void) { return motor.rpm; }
+float mc_interface_get_tot_current_filtered(void) { return motor.current; }
+float mc_interface_get_duty_cycle_now(void) { return motor.duty; }
+float mc_interface_get_amp_hours(bool reset) { (void)reset; return motor.amp_hours; }
+float mc_interface_get_amp_hours_charged(bool reset) { (void)reset; return motor.amp_hours_charged; }
+float mc_interface_get_watt_hours(bool reset) { (void)reset; return motor.watt_hours; }
+float mc_interface_get_watt_hours_charged(bool reset) { (void)reset; return motor.watt_hours_charged; }
+float mc_interface_temp_fet_filtered(void) { return motor.temp_fet; }
+float mc_interface_temp_motor_filtered(void) { return motor.temp_motor; }
+float mc_interface_get_tot_current_in_filtered(void) { return motor.current_in; }
+float mc_interface_get_pid_pos_now(void) { return motor.pid_pos; }
+int mc_interface_get_tachometer_value(bool reset) { (void)reset; return motor.tacho; }
+float mc_interface_get_input_voltage_filtered(void) { return motor.v_in; }
+
+static void remote_deliver(uint8_t src, uint8_t send, uint8_t *data, unsigned int len, void *arg) {
+    (void)arg;
+    memcpy(remote_data, data, len);
+    remote_len = len;
+    remote_src = src;
+    remote_send = send;
+    remote_count++;
+}
+
+// Frames from the other node, received by the driver of this one
+static void remote_send_frame(uint32_t eid, const uint8_t *data, uint8_t len, void *arg) {
+    (void)arg;
+    comm_can_fd_frame_received(eid, data, len);
+}
+
+static void set_status(uint8_t msgs, bool on_change) {
+    app_configuration conf = *app_get_configuration();
+    conf.can_status_msgs_r1 = msgs;
+    conf.can_status_on_change = on_change;
+    app_set_configuration(&conf);
+}
+
+static void tx_reset(void) {
+    tx_frames = 0;
+    tx_bad_len = false;
+}
+
+static int tx_count(CAN_PACKET_ID cmd) {
+    int cnt = 0;
+    for (int i = 0;i < tx_frames;i++) {
+        if ((tx[i].eid >> 8) == cmd) {
+            cnt++;
+        }
+    }
+    return cnt;
+}
+
+static void fill(uint8_t *data, unsigned int len, unsigned int seed) {
+    for (unsigned int i = 0;i < len;i++) {
+        data[i] = (uint8_t)(i * 7 + seed);
+    }
+}
+
+// =============================================================================
+// Test Cases
+// =============================================================================
+
+static bool test_fd_off(void) {
+    set_status(0x3F, true);
+    tx_reset();
+    chThdSleepMilliseconds(100);
+
+    TEST_ASSERT(!comm_can_fd_active(), "FD frames off");
+    TEST_ASSERT(tx_frames == 0, "No FD frames");
+
+    uint8_t data[100];
+    fill(data, sizeof(data), 1);
+    comm_can_send_buffer(REMOTE_ID, data, sizeof(data), 2);
+    TEST_ASSERT(tx_frames == 0, "Buffer not sent in FD frames");
+
+    return true;
+}
+
+static bool test_fd_enable(void) {
+    TEST_ASSERT(comm_can_set_fd(true, 2000, true), "FD frames on");
+    TEST_ASSERT(comm_can_fd_active(), "FD frames active");
+    TEST_ASSERT(mode_calls > 0 && mode_fd && mode_brs, "Controller in FD mode with BRS");
+
+    // 80 MHz to 500 kbit/s and 2 Mbit/s
+    const unsigned int nominal_tq = 1 + mode_nominal.ts1 + mode_nominal.ts2;
+    const unsigned int data_tq = 1 + mode_data.ts1 + mode_data.ts2;
+    TEST_ASSERT(mode_nominal.brp * nominal_tq == 160, "Nominal bit rate");
+    TEST_ASSERT(mode_data.brp * data_tq == 40, "Data bit rate");
+
+    int data_kbits = 0;
+    bool brs = false;
+    comm_can_get_fd(&data_kbits, &brs);
+    TEST_ASSERT(data_kbits == 2000 && brs, "Settings read back");
+
+    TEST_ASSERT(!comm_can_set_fd(true, 100, true), "Data rate below nominal refused");
+    TEST_ASSERT(comm_can_fd_active(), "Still active");
+    comm_can_get_fd(&data_kbits, 0);
+    TEST_ASSERT(data_kbits == 2000, "Old settings kept");
+
+    return true;
+}
+
+static bool test_status_merge(void) {
+    // Scaled to integers they are exact, as the sender truncates
+    motor.rpm = 12345.0f;
+    motor.current = 23.5f;
+    motor.duty = 0.625f;
+    motor.amp_hours = 1.25f;
+    motor.amp_hours_charged = 0.5f;
+    motor.watt_hours = 60.125f;
+    motor.watt_hours_charged = 24.5f;
+    motor.temp_fet = 45.5f;
+    motor.temp_motor = 67.5f;
+    motor.current_in = 8.5f;
+    motor.pid_pos = 90.0f;
+    motor.tacho = 5678;
+    motor.v_in = 48.5f;
+
+    // Longer than the refresh interval of STATUS_6, which does not change
+    set_status(0x3F, true);
+    tx_reset();
+    chThdSleepMilliseconds(300);
+
+    const int fd_status = tx_count(CAN_PACKET_STATUS_FD);
+    TEST_ASSERT(fd_status > 0, "Status sent in FD frames");
+    TEST_ASSERT(fd_status == tx_frames, "Only status frames");
+    TEST_ASSERT(!tx_bad_len, "Valid FD lengths");
+
+    bool seen[CAN_FD_STATUS_MSGS] = {false};
+    for (int i = 0;i < tx_frames;i++) {
+        TEST_ASSERT((tx[i].eid & 0xFF) == LOCAL_ID, "Sent with own id");
+        for (int m = 0;m < CAN_FD_STATUS_MSGS;m++) {
+            if (comm_can_fd_status_get(tx[i].data, tx[i].len, m)) {
+                seen[m] = true;
+            }
+        }
+    }
+
+    for (int m = 0;m < CAN_FD_STATUS_MSGS;m++) {
+        TEST_ASSERT(seen[m], "All messages sent");
+    }
+
+    // Back as the status of the other node
+    for (int i = 0;i < tx_frames;i++) {
+        comm_can_fd_frame_received(REMOTE_ID | ((uint32_t)CAN_PACKET_STATUS_FD << 8),
+                tx[i].data, tx[i].len);
+        chThdSleepMilliseconds(1);
+    }
+    chThdSleepMilliseconds(10);
+
+    can_status_msg *s1 = comm_can_get_status_msg_id(REMOTE_ID);
+    can_status_msg_2 *s2 = comm_can_get_status_msg_2_id(REMOTE_ID);
+    can_status_msg_3 *s3 = comm_can_get_status_msg_3_id(REMOTE_ID);
+    can_status_msg_4 *s4 = comm_can_get_status_msg_4_id(REMOTE_ID);
+    can_status_msg_5 *s5 = comm_can_get_status_msg_5_id(REMOTE_ID);
+    can_status_msg_6 *s6 = comm_can_get_status_msg_6_id(REMOTE_ID);
+
+    TEST_ASSERT(s1 && s2 && s3 && s4 && s5 && s6, "All messages of the node decoded");
+    TEST_ASSERT(fabsf(s1->rpm - 12345.0f) < 1.0f, "RPM");
+    TEST_ASSERT(fabsf(s1->current - 23.5f) < 1e-3f, "Current");
+    TEST_ASSERT(fabsf(s1->duty - 0.625f) < 1e-4f, "Duty");
+    TEST_ASSERT(fabsf(s2->amp_hours - 1.25f) < 1e-3f, "Amp hours");
+    TEST_ASSERT(fabsf(s2->amp_hours_charged - 0.5f) < 1e-3f, "Amp hours charged");
+    TEST_ASSERT(fabsf(s3->watt_hours - 60.125f) < 1e-3f, "Watt hours");
+    TEST_ASSERT(fabsf(s3->watt_hours_charged - 24.5f) < 1e-3f, "Watt hours charged");
+    TEST_ASSERT(fabsf(s4->temp_fet - 45.5f) < 1e-3f, "FET temperature");
+    TEST_ASSERT(fabsf(s4->temp_motor - 67.5f) < 1e-3f, "Motor temperature");
+    TEST_ASSERT(fabsf(s4->current_in - 8.5f) < 1e-3f, "Input current");
+    TEST_ASSERT(fabsf(s4->pid_pos_now - 90.0f) < 1e-3f, "PID position");
+    TEST_ASSERT(s5->tacho_value == 5678, "Tachometer");
+    TEST_ASSERT(fabsf(s5->v_in - 48.5f) < 1e-3f, "Input voltage");
+
+    TEST_ASSERT(comm_can_get_status_msg_id(LOCAL_ID) == 0, "Nothing stored for the own id");
+
+    return true;
+}
+
+static bool test_status_every_tick(void) {
+    // Unchanged values are held back with sending on change
+    set_status(0x3F, true);
+    chThdSleepMilliseconds(100);
+    tx_reset();
+    chThdSleepMilliseconds(200);
+    const int on_change = tx_count(CAN_PACKET_STATUS_FD);
+
+    int full = 0;
+    for (int i = 0;i < tx_frames;i++) {
+        if (comm_can_fd_status_get(tx[i].data, tx[i].len, 0) &&
+                comm_can_fd_status_get(tx[i].data, tx[i].len, 5)) {
+            full++;
+        }
+    }
+    TEST_ASSERT(full < on_change, "Slow messages held back");
+
+    set_status(0x3F, false);
+    chThdSleepMilliseconds(20);
+    tx_reset();
+    chThdSleepMilliseconds(200);
+
+    // 50 Hz for 200 ms
+    const int every_tick = tx_count(CAN_PACKET_STATUS_FD);
+    TEST_ASSERT(every_tick >= 9 && every_tick <= 11, "One frame per tick");
+
+    for (int i = 0;i < tx_frames;i++) {
+        for (int m = 0;m < CAN_FD_STATUS_MSGS;m++) {
+            TEST_ASSERT(comm_can_fd_status_get(tx[i].data, tx[i].len, m), "All messages in every frame");
+        }
+    }
+
+    printf("  Status frames in 200 ms: %d on change, %d at every tick\n", on_change, every_tick);
+
+    set_status(0, true);
+    return true;
+}
+
+static bool test_buffer_rx(void) {
+    set_status(0, true);
+    rx_count = 0;
+
+    uint8_t data[300];
+    fill(data, sizeof(data), 3);
+    TEST_ASSERT(comm_can_fd_send_buffer(&remote, REMOTE_ID, LOCAL_ID, 2, data, sizeof(data)),
+            "Buffer sent by the other node");
+    chThdSleepMilliseconds(10);
+
+    TEST_ASSERT(rx_count == 1, "Buffer delivered");
+    TEST_ASSERT(rx_len == sizeof(data), "Length");
+    TEST_ASSERT(memcmp(rx_data, data, sizeof(data)) == 0, "Data");
+
+    can_fd_stats_t stats = comm_can_get_fd_stats(0);
+    TEST_ASSERT(stats.rx_done == 1 && stats.rx_crc_errors == 0, "Receive statistics");
+
+    return true;
+}
+
+static bool test_buffer_tx(void) {
+    set_status(0, true);
+    tx_reset();
+    remote_count = 0;
+
+    // The other node sent FD frames in test_buffer_rx, so it decodes them
+    uint8_t data[CAN_FD_MAX_LEN];
+    fill(data, sizeof(data), 5);
+    comm_can_send_buffer(REMOTE_ID, data, sizeof(data), 0);
+
+    TEST_ASSERT(tx_frames > 0 && tx_frames == tx_count(CAN_PACKET_BUFFER_FD), "Sent in FD buffer frames");
+    TEST_ASSERT(tx_frames <= 9, "512 bytes in few frames");
+    TEST_ASSERT(!tx_bad_len, "Valid FD lengths");
+
+    for (int i = 0;i < tx_frames;i++) {
+        TEST_ASSERT((tx[i].eid & 0xFF) == REMOTE_ID, "Addressed to the other node");
+        comm_can_fd_rx_frame(&remote, tx[i].eid, tx[i].data, tx[i].len);
+    }
+
+    TEST_ASSERT(remote_count == 1, "Buffer arrived");
+    TEST_ASSERT(remote_src == LOCAL_ID && remote_send == 0, "Source and send mode");
+    TEST_ASSERT(remote_len == sizeof(data), "Length");
+    TEST_ASSERT(memcmp(remote_data, data, sizeof(data)) == 0, "Data");
+
+    // A node that has not told that it decodes FD frames
+    tx_reset();
+    comm_can_send_buffer(REMOTE_ID + 1, data, 100, 2);
+    TEST_ASSERT(tx_count(CAN_PACKET_BUFFER_FD) == 0, "No FD frames to other nodes");
+
+    return true;
+}
+
+int main(void) {
+    printf("========================================\n");
+    printf("CAN-FD Paths of comm_can.c\n");
+    printf("========================================\n\n");
+
+    chSysInitVirtual();
+    halInit();
+
+    app_stub_reset();
+    app_stub_set_controller_id(LOCAL_ID);
+    comm_can_fd_init(&remote, remote_send_frame, remote_deliver, 0);
+    comm_can_init();
+
+    RUN_TEST(test_fd_off);
+    RUN_TEST(test_fd_enable);
+    RUN_TEST(test_status_merge);
+    RUN_TEST(test_status_every_tick);
+    RUN_TEST(test_buffer_rx);
+    RUN_TEST(test_buffer_tx);
+
+    printf("\n========================================\n");
+    printf("Total: %d, Passed: %d, Failed: %d\n", total_tests, passed_tests, test_failures);
+    printf("========================================\n");
+
+    return test_failures > 0 ? 1 : 0;
+}
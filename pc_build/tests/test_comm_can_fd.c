@@ -0,0 +1,489 @@
+/**
+ * @file test_comm_can_fd.c
+ * @brief CAN-FD framing loopback (comm/comm_can_fd.c)
+ *
+ * Two nodes are connected through a software bus that queues the frames
+ * one node sends and hands them to the other, with frames lost or damaged
+ * on request. The bus time of a buffer is estimated from the frame formats
+ * and compared with the classic fill/process frames comm_can_send_buffer
+ * falls back to.
+ *
+ * Validates:
+ * - DLC mapping and padding of frames
+ * - Buffers of all lengths arrive unchanged, in the expected frame count
+ * - Buffers from different nodes can be interleaved
+ * - A lost frame drops the buffer and the next buffer still arrives
+ * - Damaged data is caught by the CRC
+ * - Status messages are merged into one frame and read back
+ * - Bit timings for common controller clocks and bit rates
+ * - A 512 byte buffer takes a fraction of the classic bus time
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+
+// Test framework
+#define TEST_ASSERT(cond, msg) do { \
+    if (!(cond)) { \
+        printf("  FAIL: %s (line %d)\n", msg, __LINE__); \
+        test_failures++; \
+        return false; \
+    } \
+} while(0)
+
+#define RUN_TEST(test_func) do { \
+    printf("Running %s...\n", #test_func); \
+    total_tests++; \
+    if (test_func()) { \
+        printf("  PASS\n"); \
+        passed_tests++; \
+    } \
+} while(0)
+
+static int test_failures = 0;
+static int total_tests = 0;
+static int passed_tests = 0;
+
+#include "comm_can_fd.h"
+#include "datatypes.h"
+
+#define BUS_FRAMES      64
+
+typedef struct {
+    uint32_t eid;
+    uint8_t data[CAN_FD_FRAME_LEN];
+    uint8_t len;
+} bus_frame_t;
+
+typedef struct {
+    uint8_t id;
+    can_fd_t fd;
+    uint8_t rx_data[CAN_FD_MAX_LEN];
+    unsigned int rx_len;
+    uint8_t rx_src;
+    uint8_t rx_send;
+    int rx_count;
+} node_t;
+
+// Software bus
+static bus_frame_t bus[BUS_FRAMES];
+static int bus_frames = 0;
+static int bus_sent = 0;
+static int bus_drop = -1;       // Frame number to lose
+static int bus_corrupt = -1;    // Frame number to damage
+static bool bus_bad_len = false;
+
+static void bus_reset(void) {
+    bus_frames = 0;
+    bus_sent = 0;
+    bus_drop = -1;
+    bus_corrupt = -1;
+    bus_bad_len = false;
+}
+
+static void bus_send(uint32_t eid, const uint8_t *data, uint8_t len, void *arg) {
+    (void)arg;
+
+    if (comm_can_fd_frame_len(len) != len) {
+        bus_bad_len = true;
+    }
+
+    int num = bus_sent++;
+    if (num == bus_drop || bus_frames >= BUS_FRAMES) {
+        return;
+    }
+
+    bus_frame_t *f = &bus[bus_frames++];
+    f->eid = eid;
+    f->len = len;
+    memcpy(f->data, data, len);
+
+    if (num == bus_corrupt) {
+        f->data[len - 1] ^= 0x10;
+    }
+}
+
+static void node_deliver(uint8_t src, uint8_t send, uint8_t *data, unsigned int len, void *arg) {
+    node_t *n = (node_t*)arg;
+    memcpy(n->rx_data, data, len);
+    n->rx_len = len;
+    n->rx_src = src;
+    n->rx_send = send;
+    n->rx_count++;
+}
+
+static void node_init(node_t *n, uint8_t id) {
+    memset(n, 0, sizeof(node_t));
+    n->id = id;
+    comm_can_fd_init(&n->fd, bus_send, node_deliver, n);
+}
+
+// Hand the queued frames to the node they are addressed to
+static void bus_run(node_t *n) {
+    for (int i = 0;i < bus_frames;i++) {
+        bus_frame_t *f = &bus[i];
+        if ((f->eid >> 8) == CAN_PACKET_BUFFER_FD && (f->eid & 0xFF) == n->id) {
+            comm_can_fd_rx_frame(&n->fd, f->eid, f->data, f->len);
+        }
+    }
+
+    bus_frames = 0;
+}
+
+static void fill(uint8_t *data, unsigned int len, unsigned int seed) {
+    for (unsigned int i = 0;i < len;i++) {
+        data[i] = (uint8_t)(i * 31 + seed * 7 + (i >> 8));
+    }
+}
+
+// Frames a buffer takes with the FD framing
+static int fd_frames(unsigned int len) {
+    const unsigned int first = CAN_FD_FRAME_LEN - CAN_FD_HEADER_LEN;
+    const unsigned int next = CAN_FD_FRAME_LEN - CAN_FD_DATA_HEADER_LEN;
+
+    if (len <= first) {
+        return 1;
+    }
+
+    return 1 + (len - first + next - 1) / next;
+}
+
+static bool test_dlc(void) {
+    static const unsigned int lens[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64};
+
+    for (int dlc = 0;dlc < 16;dlc++) {
+        TEST_ASSERT(comm_can_fd_dlc_to_len(dlc) == lens[dlc], "DLC to length");
+        TEST_ASSERT(comm_can_fd_len_to_dlc(lens[dlc]) == dlc, "Length to DLC");
+    }
+
+    TEST_ASSERT(comm_can_fd_frame_len(9) == 12, "9 padded to 12");
+    TEST_ASSERT(comm_can_fd_frame_len(33) == 48, "33 padded to 48");
+    TEST_ASSERT(comm_can_fd_frame_len(49) == 64, "49 padded to 64");
+    TEST_ASSERT(comm_can_fd_frame_len(64) == 64, "64 not padded");
+
+    return true;
+}
+
+static bool test_loopback(void) {
+    node_t a, b;
+    node_init(&a, 1);
+    node_init(&b, 2);
+    bus_reset();
+
+    static uint8_t data[CAN_FD_MAX_LEN];
+    int frames_total = 0;
+
+    for (unsigned int len = 1;len <= CAN_FD_MAX_LEN;len++) {
+        fill(data, len, len);
+
+        const int sent_before = bus_sent;
+        TEST_ASSERT(comm_can_fd_send_buffer(&a.fd, a.id, b.id, 1, data, len), "Buffer sent");
+        TEST_ASSERT((bus_sent - sent_before) == fd_frames(len), "Frame count");
+        frames_total += bus_sent - sent_before;
+
+        bus_run(&b);
+
+        TEST_ASSERT(b.rx_count == (int)len, "Buffer delivered");
+        TEST_ASSERT(b.rx_len == len, "Buffer length");
+        TEST_ASSERT(b.rx_src == a.id && b.rx_send == 1, "Source and send mode");
+        TEST_ASSERT(memcmp(b.rx_data, data, len) == 0, "Buffer contents");
+    }
+
+    TEST_ASSERT(!bus_bad_len, "All frames have valid DLC lengths");
+    TEST_ASSERT(a.fd.stats.tx_buffers == CAN_FD_MAX_LEN, "TX buffer count");
+    TEST_ASSERT(a.fd.stats.tx_frames == (uint32_t)frames_total, "TX frame count");
+    TEST_ASSERT(b.fd.stats.rx_done == CAN_FD_MAX_LEN, "RX buffer count");
+    TEST_ASSERT(b.fd.stats.rx_dropped == 0 && b.fd.stats.rx_crc_errors == 0, "No errors");
+
+    TEST_ASSERT(!comm_can_fd_send_buffer(&a.fd, a.id, b.id, 0, data, 0), "Empty buffer rejected");
+    TEST_ASSERT(!comm_can_fd_send_buffer(&a.fd, a.id, b.id, 0, data, CAN_FD_MAX_LEN + 1),
+            "Too long buffer rejected");
+
+    printf("  1..%d bytes: %d frames, %d for %d bytes\n",
+            CAN_FD_MAX_LEN, frames_total, fd_frames(CAN_FD_MAX_LEN), CAN_FD_MAX_LEN);
+
+    return true;
+}
+
+static bool test_interleaved(void) {
+    node_t a, b, c;
+    node_init(&a, 1);
+    node_init(&b, 2);
+    node_init(&c, 3);
+    bus_reset();
+
+    static uint8_t data_a[300], data_c[200];
+    fill(data_a, sizeof(data_a), 1);
+    fill(data_c, sizeof(data_c), 2);
+
+    // Send both, then mix the frames on the bus one by one
+    comm_can_fd_send_buffer(&a.fd, a.id, b.id, 0, data_a, sizeof(data_a));
+    const int frames_a = bus_frames;
+    comm_can_fd_send_buffer(&c.fd, c.id, b.id, 0, data_c, sizeof(data_c));
+    const int frames_c = bus_frames - frames_a;
+
+    bus_frame_t mixed[BUS_FRAMES];
+    int ind = 0;
+    for (int i = 0;i < frames_a || i < frames_c;i++) {
+        if (i < frames_c) {
+            mixed[ind++] = bus[frames_a + i];
+        }
+        if (i < frames_a) {
+            mixed[ind++] = bus[i];
+        }
+    }
+    memcpy(bus, mixed, sizeof(bus_frame_t) * ind);
+
+    bus_run(&b);
+
+    TEST_ASSERT(b.rx_count == 2, "Both buffers delivered");
+    TEST_ASSERT(b.rx_src == a.id && b.rx_len == sizeof(data_a), "Longer buffer last");
+    TEST_ASSERT(memcmp(b.rx_data, data_a, sizeof(data_a)) == 0, "Contents of interleaved buffer");
+    TEST_ASSERT(b.fd.stats.rx_dropped == 0 && b.fd.stats.rx_crc_errors == 0, "No errors");
+
+    return true;
+}
+
+static bool test_lost_frame(void) {
+    node_t a, b;
+    node_init(&a, 1);
+    node_init(&b, 2);
+    bus_reset();
+
+    static uint8_t data[400];
+    fill(data, sizeof(data), 3);
+
+    // Lose the second frame. The rest of that buffer is dropped.
+    bus_drop = 1;
+    comm_can_fd_send_buffer(&a.fd, a.id, b.id, 0, data, sizeof(data));
+    bus_run(&b);
+
+    TEST_ASSERT(b.rx_count == 0, "Incomplete buffer not delivered");
+    TEST_ASSERT(b.fd.stats.rx_dropped == (uint32_t)(fd_frames(sizeof(data)) - 2),
+            "Frames after the gap dropped");
+
+    fill(data, sizeof(data), 4);
+    comm_can_fd_send_buffer(&a.fd, a.id, b.id, 0, data, sizeof(data));
+    bus_run(&b);
+
+    TEST_ASSERT(b.rx_count == 1, "Next buffer delivered");
+    TEST_ASSERT(memcmp(b.rx_data, data, sizeof(data)) == 0, "Next buffer contents");
+
+    // Lose the last frame. The next buffer starts over the unfinished one.
+    bus_reset();
+    bus_drop = fd_frames(sizeof(data)) - 1;
+    comm_can_fd_send_buffer(&a.fd, a.id, b.id, 0, data, sizeof(data));
+    bus_run(&b);
+    TEST_ASSERT(b.rx_count == 1, "Buffer without last frame not delivered");
+
+    fill(data, 100, 5);
+    comm_can_fd_send_buffer(&a.fd, a.id, b.id, 0, data, 100);
+    bus_run(&b);
+    TEST_ASSERT(b.rx_count == 2 && b.rx_len == 100, "Buffer after unfinished one delivered");
+    TEST_ASSERT(memcmp(b.rx_data, data, 100) == 0, "Buffer after unfinished one contents");
+
+    return true;
+}
+
+static bool test_crc(void) {
+    node_t a, b;
+    node_init(&a, 1);
+    node_init(&b, 2);
+    bus_reset();
+
+    static uint8_t data[200];
+    fill(data, sizeof(data), 6);
+
+    bus_corrupt = 2;
+    comm_can_fd_send_buffer(&a.fd, a.id, b.id, 0, data, sizeof(data));
+    bus_run(&b);
+
+    TEST_ASSERT(b.rx_count == 0, "Damaged buffer not delivered");
+    TEST_ASSERT(b.fd.stats.rx_crc_errors == 1, "CRC error counted");
+
+    return true;
+}
+
+static bool test_status(void) {
+    uint8_t status[CAN_FD_STATUS_MSGS][CAN_FD_STATUS_MSG_LEN];
+    uint8_t frame[CAN_FD_FRAME_LEN];
+
+    for (int m = 0;m < CAN_FD_STATUS_MSGS;m++) {
+        for (int i = 0;i < CAN_FD_STATUS_MSG_LEN;i++) {
+            status[m][i] = m * 16 + i;
+        }
+    }
+
+    unsigned int len = comm_can_fd_status_pack(frame, 0x3F, status);
+    TEST_ASSERT(len == 64, "All six padded to 64");
+    TEST_ASSERT(frame[0] == 0x3F, "Mask");
+    for (unsigned int i = 49;i < len;i++) {
+        TEST_ASSERT(frame[i] == 0, "Zero padding");
+    }
+
+    const uint8_t masks[] = {0x01, 0x02, 0x05, 0x20, 0x2A, 0x1F};
+    for (unsigned int k = 0;k < sizeof(masks);k++) {
+        len = comm_can_fd_status_pack(frame, masks[k], status);
+        TEST_ASSERT(len == comm_can_fd_frame_len(1 + 8 * __builtin_popcount(masks[k])), "Frame length");
+
+        for (int m = 0;m < CAN_FD_STATUS_MSGS;m++) {
+            const uint8_t *d = comm_can_fd_status_get(frame, len, m);
+            if ((masks[k] >> m) & 1) {
+                TEST_ASSERT(d && memcmp(d, status[m], CAN_FD_STATUS_MSG_LEN) == 0, "Message read back");
+            } else {
+                TEST_ASSERT(d == 0, "Message not in frame");
+            }
+        }
+    }
+
+    // Truncated frames and unused mask bits
+    len = comm_can_fd_status_pack(frame, 0x3F, status);
+    TEST_ASSERT(comm_can_fd_status_get(frame, 20, 5) == 0, "Truncated frame");
+    len = comm_can_fd_status_pack(frame, 0xC1, status);
+    TEST_ASSERT(frame[0] == 0x01 && len == 12, "Unused mask bits cleared");
+    TEST_ASSERT(comm_can_fd_status_get(frame, len, 6) == 0, "Message out of range");
+
+    return true;
+}
+
+static bool test_timing(void) {
+    const uint32_t clocks[] = {40000000, 80000000};
+    const uint32_t nominal[] = {500000, 1000000};
+    const uint32_t data[] = {2000000, 4000000, 5000000, 8000000};
+
+    for (int c = 0;c < 2;c++) {
+        for (int n = 0;n < 2;n++) {
+            can_fd_timing t;
+            TEST_ASSERT(comm_can_fd_calc_timing(clocks[c], nominal[n], 0.8, false, &t), "Nominal timing");
+
+            const uint32_t tq = 1 + t.ts1 + t.ts2;
+            TEST_ASSERT(clocks[c] / (t.brp * tq) == nominal[n], "Nominal bit rate");
+            const float sp = (float)(1 + t.ts1) / (float)tq;
+            TEST_ASSERT(fabsf(sp - 0.8f) < 0.05f, "Nominal sample point");
+        }
+
+        for (int d = 0;d < 4;d++) {
+            can_fd_timing t;
+            TEST_ASSERT(comm_can_fd_calc_timing(clocks[c], data[d], 0.75, true, &t), "Data timing");
+
+            const uint32_t tq = 1 + t.ts1 + t.ts2;
+            TEST_ASSERT(clocks[c] / (t.brp * tq) == data[d], "Data bit rate");
+            TEST_ASSERT(t.ts1 <= 32 && t.ts2 <= 16 && t.brp <= 32, "Data phase limits");
+            const float sp = (float)(1 + t.ts1) / (float)tq;
+            TEST_ASSERT(fabsf(sp - 0.75f) < 0.1f, "Data sample point");
+
+            printf("  %2u MHz, %u Mbit/s: brp %u, ts1 %u, ts2 %u, sample point %.1f %%\n",
+                    (unsigned int)(clocks[c] / 1000000), (unsigned int)(data[d] / 1000000),
+                    t.brp, t.ts1, t.ts2, (double)(sp * 100.0f));
+        }
+    }
+
+    can_fd_timing t;
+    TEST_ASSERT(!comm_can_fd_calc_timing(40000000, 3000000, 0.75, true, &t), "Indivisible rate rejected");
+    TEST_ASSERT(!comm_can_fd_calc_timing(40000000, 20000000, 0.75, true, &t), "Too few time quanta rejected");
+    TEST_ASSERT(!comm_can_fd_calc_timing(40000000, 0, 0.75, true, &t), "Zero rate rejected");
+
+    return true;
+}
+
+// Estimated time of a classic extended frame, with a stuff bit for about
+// every ten bits
+static double classic_frame_time(int len, double bitrate) {
+    return (67.0 + 8.0 * len + (54.0 + 8.0 * len) / 10.0) / bitrate;
+}
+
+// Estimated time of an FD extended frame. The arbitration field and the end
+// of the frame run at the nominal rate, the rest at the data rate.
+static double fd_frame_time(int len, double nominal, double data) {
+    const double arb_bits = 1.0 + 32.0 + 1.0 + 1.0 + 1.0;
+    const double end_bits = 1.0 + 1.0 + 7.0 + 3.0;
+    const double crc_bits = len > 16 ? 21.0 : 17.0;
+    const double stuff = 4.0 + crc_bits / 4.0;
+    const double data_bits = 1.0 + 4.0 + 8.0 * len + stuff + crc_bits + 1.0 +
+            (8.0 * len + 5.0) / 10.0;
+    return (arb_bits + end_bits) / nominal + data_bits / data;
+}
+
+static bool test_bus_time(void) {
+    const unsigned int len = CAN_FD_MAX_LEN;
+    const double nominal = 500e3;
+    const double data_rate = 2e6;
+
+    // Classic fill/process frames of comm_can_send_buffer
+    double t_classic = 0.0;
+    int frames_classic = 0;
+    unsigned int end_a = 0;
+    for (unsigned int i = 0;i < len && i <= 255;i += 7) {
+        end_a = i + 7;
+        t_classic += classic_frame_time(1 + ((i + 7) <= len ? 7 : len - i), nominal);
+        frames_classic++;
+    }
+    for (unsigned int i = end_a;i < len;i += 6) {
+        t_classic += classic_frame_time(2 + ((i + 6) <= len ? 6 : len - i), nominal);
+        frames_classic++;
+    }
+    t_classic += classic_frame_time(8, nominal);
+    frames_classic++;
+
+    // The FD frames as the loopback sends them
+    node_t a, b;
+    node_init(&a, 1);
+    node_init(&b, 2);
+    bus_reset();
+
+    static uint8_t buffer[CAN_FD_MAX_LEN];
+    fill(buffer, len, 7);
+    comm_can_fd_send_buffer(&a.fd, a.id, b.id, 0, buffer, len);
+
+    double t_fd = 0.0, t_fd_nobrs = 0.0;
+    for (int i = 0;i < bus_frames;i++) {
+        t_fd += fd_frame_time(bus[i].len, nominal, data_rate);
+        t_fd_nobrs += fd_frame_time(bus[i].len, nominal, nominal);
+    }
+    const int frames_fd = bus_frames;
+    bus_run(&b);
+    TEST_ASSERT(b.rx_count == 1, "Buffer delivered");
+
+    // Status 1-6 as six classic frames or one FD frame
+    const double t_status_classic = 6.0 * classic_frame_time(8, nominal);
+    const double t_status_fd = fd_frame_time(64, nominal, data_rate);
+
+    printf("  %u byte buffer, %.0f kbit/s nominal, %.0f Mbit/s data:\n",
+            len, nominal * 1e-3, data_rate * 1e-6);
+    printf("    Classic: %3d frames, %6.2f ms\n", frames_classic, t_classic * 1e3);
+    printf("    FD:      %3d frames, %6.2f ms (%.1fx), without BRS %6.2f ms (%.1fx)\n",
+            frames_fd, t_fd * 1e3, t_classic / t_fd, t_fd_nobrs * 1e3, t_classic / t_fd_nobrs);
+    printf("  Status 1-6: classic %.0f us, FD %.0f us (%.1fx)\n",
+            t_status_classic * 1e6, t_status_fd * 1e6, t_status_classic / t_status_fd);
+
+    TEST_ASSERT(frames_fd == 9, "512 bytes in 9 frames");
+    TEST_ASSERT(t_classic / t_fd > 3.0, "FD with BRS over 3x faster");
+    TEST_ASSERT(t_fd_nobrs < t_classic, "FD without BRS still faster");
+    TEST_ASSERT(t_status_fd < 0.5 * t_status_classic, "Merged status takes under half the time");
+
+    return true;
+}
+
+int main(void) {
+    printf("========================================\n");
+    printf("CAN-FD Framing Loopback Tests\n");
+    printf("========================================\n\n");
+
+    RUN_TEST(test_dlc);
+    RUN_TEST(test_loopback);
+    RUN_TEST(test_interleaved);
+    RUN_TEST(test_lost_frame);
+    RUN_TEST(test_crc);
+    RUN_TEST(test_status);
+    RUN_TEST(test_timing);
+    RUN_TEST(test_bus_time);
+
+    printf("\n========================================\n");
+    printf("Total: %d, Passed: %d, Failed: %d\n", total_tests, passed_tests, test_failures);
+    printf("========================================\n");
+
+    return test_failures > 0 ? 1 : 0;
+}
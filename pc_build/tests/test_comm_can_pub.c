@@ -0,0 +1,378 @@
+/**
+ * @file test_comm_can_pub.c
+ * @brief CAN status message publish scheduler (comm/comm_can_pub.c)
+ *
+ * The scheduler is checked at the rates of the status threads with the
+ * fields of the status messages, using the same settings as comm_can.c.
+ * The bus load is measured over a riding profile with a stop, an
+ * acceleration and a cruise.
+ *
+ * Validates:
+ * - The first check sends, changes within the deadband do not
+ * - No field gets older than its max interval, also without changes
+ * - Changes wait for the min interval
+ * - Changes are held back over the budget, refreshes are not
+ * - The status load at standstill and cruise is well below the fixed rates
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+
+// Test framework
+#define TEST_ASSERT(cond, msg) do { \
+    if (!(cond)) { \
+        printf("  FAIL: %s (line %d)\n", msg, __LINE__); \
+        test_failures++; \
+        return false; \
+    } \
+} while(0)
+
+#define RUN_TEST(test_func) do { \
+    printf("Running %s...\n", #test_func); \
+    total_tests++; \
+    if (test_func()) { \
+        printf("  PASS\n"); \
+        passed_tests++; \
+    } \
+} while(0)
+
+static int test_failures = 0;
+static int total_tests = 0;
+static int passed_tests = 0;
+
+#include "comm_can_pub.h"
+
+#define FAST        0.05
+#define SLOW        0.25
+#define RATE        50      // can_status_rate_1 [Hz]
+#define PERIOD_US   (1000000 / RATE)
+#define BITRATE     500e3
+
+// Same as status_pub_conf in comm_can.c
+static const can_pub_msg_conf status_conf[CAN_PUB_MSGS] = {
+        {3, 8, {{0.0, FAST, 20}, {0.0, FAST, 2}, {0.0, FAST, 2}}},
+        {2, 8, {{0.0, FAST, 10}, {0.0, FAST, 10}}},
+        {2, 8, {{0.0, FAST, 100}, {0.0, FAST, 100}}},
+        {4, 8, {{0.1, FAST, 5}, {0.1, FAST, 5}, {0.0, FAST, 2}, {0.0, FAST, 25}}},
+        {2, 8, {{0.0, SLOW, 6}, {0.0, SLOW, 2}}},
+        {4, 8, {{0.0, SLOW, 10}, {0.0, SLOW, 10}, {0.0, SLOW, 10}, {0.0, SLOW, 5}}},
+};
+
+static can_pub_t pub;
+
+// Start at a time close to the wrap around of the microsecond counter
+#define T0          (0xFFFFFFFFu - 3000000u)
+
+static float noise(float amp) {
+    return amp * ((float)rand() / (float)RAND_MAX * 2.0 - 1.0);
+}
+
+static bool test_deadband(void) {
+    comm_can_pub_init(&pub, status_conf, 0.0, T0);
+
+    // Checks 5 ms apart, well within the max interval
+    int32_t v[CAN_PUB_FIELDS] = {1000, 50, 100, 0};
+    uint32_t t = T0;
+
+    TEST_ASSERT(comm_can_pub_check(&pub, 0, 0, v, 0.005, t), "First check sends");
+
+    t += 5000;
+    v[0] += 20;
+    TEST_ASSERT(!comm_can_pub_check(&pub, 0, 0, v, 0.005, t), "Change within the deadband");
+
+    t += 5000;
+    v[0] += 1;
+    TEST_ASSERT(comm_can_pub_check(&pub, 0, 0, v, 0.005, t), "Change over the deadband");
+
+    t += 5000;
+    v[2] -= 3;
+    TEST_ASSERT(comm_can_pub_check(&pub, 0, 0, v, 0.005, t), "Other field over its deadband");
+
+    // The reference is the value that was sent, so slow drifts add up
+    for (int i = 0;i < 2;i++) {
+        t += 5000;
+        v[1] += 1;
+        TEST_ASSERT(!comm_can_pub_check(&pub, 0, 0, v, 0.005, t), "Drift within the deadband");
+    }
+
+    t += 5000;
+    v[1] += 1;
+    TEST_ASSERT(comm_can_pub_check(&pub, 0, 0, v, 0.005, t), "Drift over the deadband");
+
+    t += 5000;
+    TEST_ASSERT(comm_can_pub_check(&pub, 1, 0, v, 0.005, t), "Second motor has its own state");
+    TEST_ASSERT(!comm_can_pub_check(&pub, 0, 0, v, 0.005, t), "First motor unchanged");
+
+    return true;
+}
+
+static bool test_max_interval(void) {
+    const int rates[] = {10, 20, 30, 50, 100, 500};
+
+    for (unsigned int r = 0;r < sizeof(rates) / sizeof(rates[0]);r++) {
+        comm_can_pub_init(&pub, status_conf, 0.0, T0);
+
+        const uint32_t step = 1000000 / rates[r];
+        const float period = 1.0 / (float)rates[r];
+        const int32_t v[CAN_PUB_FIELDS] = {0};
+        uint32_t last[CAN_PUB_MSGS];
+        float gap_max[CAN_PUB_MSGS] = {0};
+        int sent[CAN_PUB_MSGS] = {0};
+
+        for (uint32_t i = 0;i < 5 * (uint32_t)rates[r];i++) {
+            // Up to 0.5 ms of jitter, as the thread sleeps after sending
+            const uint32_t t = T0 + i * step + (uint32_t)(rand() % 500);
+
+            for (int m = 0;m < CAN_PUB_MSGS;m++) {
+                if (comm_can_pub_check(&pub, 0, m, v, period, t)) {
+                    if (sent[m] > 0) {
+                        gap_max[m] = fmaxf(gap_max[m], (float)(t - last[m]) * 1e-6);
+                    }
+                    last[m] = t;
+                    sent[m]++;
+                }
+            }
+        }
+
+        for (int m = 0;m < CAN_PUB_MSGS;m++) {
+            const float max = status_conf[m].field[0].max_interval;
+            // Slower checks than the max interval send at every check, as
+            // the fixed rates did
+            TEST_ASSERT(gap_max[m] <= fmaxf(max, period) + 0.001, "Max interval kept");
+        }
+
+        printf("  %3d Hz: STATUS gap %.0f ms, STATUS_5 gap %.0f ms, %d of %d STATUS sent\n",
+                rates[r], (double)(gap_max[0] * 1e3), (double)(gap_max[4] * 1e3),
+                sent[0], 5 * rates[r]);
+    }
+
+    return true;
+}
+
+static bool test_min_interval(void) {
+    comm_can_pub_init(&pub, status_conf, 0.0, T0);
+
+    int32_t v[CAN_PUB_FIELDS] = {250, 300, 0, 0};
+    int sent = 0;
+
+    // The temperatures change by a degree at every check, but only one of
+    // them, so no other field asks for the message
+    for (uint32_t i = 0;i < 100;i++) {
+        v[0] += 10;
+        if (comm_can_pub_check(&pub, 0, 3, v, 0.005, T0 + i * 5000)) {
+            sent++;
+        }
+    }
+
+    // 0.5 s at 200 Hz. The temperature may only send every 0.1 s, but the
+    // max interval of 50 ms is shorter, so the refreshes carry it.
+    TEST_ASSERT(sent >= 10 && sent <= 11, "Max interval rate");
+
+    can_pub_msg_conf conf[CAN_PUB_MSGS];
+    memcpy(conf, status_conf, sizeof(conf));
+    conf[3].field[0].max_interval = 1.0;
+    conf[3].field[1].max_interval = 1.0;
+    conf[3].field[2].max_interval = 1.0;
+    conf[3].field[3].max_interval = 1.0;
+    comm_can_pub_init(&pub, conf, 0.0, T0);
+
+    sent = 0;
+    for (uint32_t i = 0;i < 100;i++) {
+        v[0] += 10;
+        if (comm_can_pub_check(&pub, 0, 3, v, 0.005, T0 + i * 5000)) {
+            sent++;
+        }
+    }
+
+    TEST_ASSERT(sent == 5, "Changes at the min interval");
+
+    return true;
+}
+
+static bool test_budget(void) {
+    // The changes of all messages at 500 Hz would take about 800 kbit/s
+    const float budget = 0.1 * BITRATE;
+    comm_can_pub_init(&pub, status_conf, budget, T0);
+
+    int32_t v[CAN_PUB_FIELDS] = {0};
+    uint32_t last[CAN_PUB_MSGS] = {0};
+    float gap_max = 0.0;
+    for (int i = 0;i < 5000;i++) {
+        const uint32_t t = T0 + (uint32_t)i * 2000;
+
+        for (int m = 0;m < CAN_PUB_MSGS;m++) {
+            for (int f = 0;f < CAN_PUB_FIELDS;f++) {
+                v[f] += 1000;
+            }
+
+            if (comm_can_pub_check(&pub, 0, m, v, 0.002, t)) {
+                if (i > 0) {
+                    gap_max = fmaxf(gap_max, (float)(t - last[m]) * 1e-6);
+                }
+                last[m] = t;
+            }
+        }
+    }
+
+    // The last window ended at 9 s
+    const float load = pub.stats.load;
+    printf("  Budget %.0f kbit/s: %.1f kbit/s sent, %.1f kbit/s at the fixed rate, %u changes held back\n",
+            (double)(budget * 1e-3), (double)(load * 1e-3), (double)(pub.stats.load_fixed * 1e-3),
+            (unsigned int)pub.stats.over_budget);
+
+    TEST_ASSERT(load <= budget * 1.05, "Load within the budget");
+    TEST_ASSERT(load >= budget * 0.9, "Budget used");
+    TEST_ASSERT(pub.stats.over_budget > 0, "Changes held back");
+    TEST_ASSERT(gap_max <= SLOW + 0.001, "Refreshes not held back");
+
+    // A budget below the refresh load still sends the refreshes
+    comm_can_pub_init(&pub, status_conf, 1000.0, T0);
+    int sent = 0;
+
+    for (int i = 0;i < 500;i++) {
+        for (int f = 0;f < CAN_PUB_FIELDS;f++) {
+            v[f] += 1000;
+        }
+
+        if (comm_can_pub_check(&pub, 0, 0, v, 0.002, T0 + (uint32_t)i * 2000)) {
+            sent++;
+        }
+    }
+
+    TEST_ASSERT(sent >= 20, "Refreshes over the budget");
+
+    return true;
+}
+
+typedef struct {
+    float erpm, current, duty, ah, wh, temp_fet, temp_motor, current_in, v_in;
+    int32_t tacho;
+} ride_t;
+
+static void ride_values(const ride_t *r, int msg, int32_t *v) {
+    memset(v, 0, sizeof(int32_t) * CAN_PUB_FIELDS);
+
+    switch (msg) {
+    case 0:
+        v[0] = (int32_t)r->erpm;
+        v[1] = (int16_t)(r->current * 10.0);
+        v[2] = (int16_t)(r->duty * 1000.0);
+        break;
+    case 1:
+        v[0] = (int32_t)(r->ah * 1e4);
+        break;
+    case 2:
+        v[0] = (int32_t)(r->wh * 1e4);
+        break;
+    case 3:
+        v[0] = (int16_t)(r->temp_fet * 10.0);
+        v[1] = (int16_t)(r->temp_motor * 10.0);
+        v[2] = (int16_t)(r->current_in * 10.0);
+        break;
+    case 4:
+        v[0] = r->tacho;
+        v[1] = (int16_t)(r->v_in * 10.0);
+        break;
+    default:
+        // ADC inputs not in use
+        v[0] = (int16_t)(noise(0.003) * 1e3);
+        break;
+    }
+}
+
+/*
+ * 10 s of standstill, 10 s of acceleration and 20 s of cruise, with all
+ * six messages at 50 Hz.
+ */
+static bool test_ride_load(void) {
+    srand(3);
+    comm_can_pub_init(&pub, status_conf, 0.25 * BITRATE, T0);
+
+    ride_t r;
+    memset(&r, 0, sizeof(r));
+    r.temp_fet = 30.0;
+    r.temp_motor = 35.0;
+    r.v_in = 50.0;
+
+    float load[3], load_fixed[3];
+    const float dt = 1.0 / RATE;
+    int phase = 0;
+
+    for (int i = 0;i <= 40 * RATE;i++) {
+        const float time = (float)i * dt;
+
+        if (time < 10.0) {
+            r.erpm = 0.0;
+            r.current = noise(0.05);
+        } else if (time < 20.0) {
+            r.erpm = 2000.0 * (time - 10.0) + noise(30.0);
+            r.current = 30.0 + noise(1.0);
+        } else {
+            r.erpm = 20000.0 + noise(30.0);
+            r.current = 8.0 + noise(0.5);
+        }
+
+        r.duty = r.erpm / 40000.0;
+        r.current_in = r.current * r.duty;
+        r.ah += fabsf(r.current) * dt / 3600.0;
+        r.wh += fabsf(r.current_in) * r.v_in * dt / 3600.0;
+        r.temp_fet += (r.current * r.current * 0.002 - (r.temp_fet - 30.0) * 0.01) * dt + noise(0.02);
+        r.temp_motor += (r.current * r.current * 0.001 - (r.temp_motor - 35.0) * 0.005) * dt + noise(0.02);
+        r.v_in = 50.0 - r.current_in * 0.05 + noise(0.03);
+        r.tacho += (int32_t)(r.erpm / 60.0 * 6.0 * dt);
+
+        const uint32_t t = T0 + (uint32_t)i * PERIOD_US;
+        for (int m = 0;m < CAN_PUB_MSGS;m++) {
+            int32_t v[CAN_PUB_FIELDS];
+            ride_values(&r, m, v);
+            comm_can_pub_check(&pub, 0, m, v, dt, t);
+        }
+
+        // The load of the last second of every phase
+        if (i == 10 * RATE || i == 20 * RATE || i == 40 * RATE) {
+            load[phase] = pub.stats.load;
+            load_fixed[phase] = pub.stats.load_fixed;
+            phase++;
+        }
+    }
+
+    const char *names[] = {"Standstill", "Acceleration", "Cruise"};
+    for (int p = 0;p < 3;p++) {
+        printf("  %-12s %5.1f kbit/s (%4.1f %%), fixed rates %5.1f kbit/s (%4.1f %%)\n",
+                names[p], (double)(load[p] * 1e-3), (double)(load[p] / BITRATE * 100.0),
+                (double)(load_fixed[p] * 1e-3), (double)(load_fixed[p] / BITRATE * 100.0));
+    }
+
+    for (int m = 0;m < CAN_PUB_MSGS;m++) {
+        printf("  STATUS_%d: %u sent, %u suppressed\n", m + 1,
+                (unsigned int)pub.stats.sent[m], (unsigned int)pub.stats.suppressed[m]);
+    }
+
+    TEST_ASSERT(load_fixed[0] > 30e3 && load_fixed[0] < 50e3, "Fixed rate load");
+    TEST_ASSERT(load[0] < 0.5 * load_fixed[0], "Standstill load halved");
+    TEST_ASSERT(load[2] < 0.75 * load_fixed[2], "Cruise load reduced");
+    TEST_ASSERT(pub.stats.sent[0] > pub.stats.sent[4], "Changing messages sent more often");
+
+    return true;
+}
+
+int main(void) {
+    printf("========================================\n");
+    printf("CAN Status Publish Scheduler Tests\n");
+    printf("========================================\n\n");
+
+    RUN_TEST(test_deadband);
+    RUN_TEST(test_max_interval);
+    RUN_TEST(test_min_interval);
+    RUN_TEST(test_budget);
+    RUN_TEST(test_ride_load);
+
+    printf("\n========================================\n");
+    printf("Total: %d, Passed: %d, Failed: %d\n", total_tests, passed_tests, test_failures);
+    printf("========================================\n");
+
+    return test_failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,454 @@
+/**
+ * @file test_comm_can_xfer.c
+ * @brief Windowed CAN buffer transfers (comm/comm_can_xfer.c)
+ *
+ * Two nodes are connected through a simulated 1 Mbit/s bus. Frames are
+ * serialized in the order they are queued, with the length of an extended
+ * frame and about 10 % stuffing, and every node has three transmit
+ * mailboxes, so sending blocks like comm_can_transmit_eid does. Frames are
+ * dropped at random at the receiver.
+ *
+ * Node A streams buffers to node B and the effective throughput is
+ * compared with the legacy FILL_RX_BUFFER transport. Legacy transfers
+ * carry no acknowledgement, so a reliable stream over them has to wait for
+ * a reply from the application and send the whole buffer again after a
+ * timeout.
+ *
+ * Validates:
+ * - Every buffer is delivered intact and exactly once, at up to 10 % loss
+ * - Several transfers in flight and selective retransmission beat the
+ *   legacy transport with and without loss
+ * - A buffer that fails the CRC is sent again
+ * - A transfer to a node that does not answer is given up and reported
+ *   with its destination
+ * - Slot limits, length limits and the frame IDs
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+
+// Test framework
+#define TEST_ASSERT(cond, msg) do { \
+    if (!(cond)) { \
+        printf("  FAIL: %s (line %d)\n", msg, __LINE__); \
+        test_failures++; \
+        return false; \
+    } \
+} while(0)
+
+#define RUN_TEST(test_func) do { \
+    printf("Running %s...\n", #test_func); \
+    total_tests++; \
+    if (test_func()) { \
+        printf("  PASS\n"); \
+        passed_tests++; \
+    } \
+} while(0)
+
+static int test_failures = 0;
+static int total_tests = 0;
+static int passed_tests = 0;
+
+#include "comm_can_xfer.h"
+#include "datatypes.h"
+#include "crc.h"
+
+#define BUS_BIT_US          1.0     // 1 Mbit/s
+#define STUFFING            1.1
+#define MAILBOXES           3
+#define POLL_US             5000.0  // Process thread timeout in comm_can.c
+#define PACKETS             200
+#define PACKET_LEN          512
+#define LEGACY_TIMEOUT_US   20000.0 // About twice the time a buffer takes
+#define BUS_QUEUE_LEN       4096
+#define TIME_LIMIT_US       60e6
+
+#define ID_A                1
+#define ID_B                2
+
+typedef struct {
+    uint32_t eid;
+    uint8_t data[8];
+    uint8_t len;
+    int to;
+    double end;
+} bus_frame_t;
+
+typedef struct {
+    can_xfer_t x;
+    uint8_t id;
+    int other;
+    double clock;
+    double mb_end[MAILBOXES];
+    int mb_ind;
+} node_t;
+
+static node_t nodes[2];
+static bus_frame_t bus_queue[BUS_QUEUE_LEN];
+static int bus_head, bus_tail;
+static double bus_free;
+static double bus_loss;
+static int corrupt_next;
+static int received[PACKETS];
+static int received_bad;
+
+static double frame_us(int len) {
+    return (67.0 + 8.0 * len) * STUFFING * BUS_BIT_US;
+}
+
+static double rand_uniform(void) {
+    return (double)rand() / ((double)RAND_MAX + 1.0);
+}
+
+static void fill_packet(uint8_t *data, int ind) {
+    data[0] = ind >> 8;
+    data[1] = ind & 0xFF;
+    for (int i = 2; i < PACKET_LEN; i++) {
+        data[i] = (ind * 31 + i * 7) & 0xFF;
+    }
+}
+
+static uint32_t node_time(void *arg) {
+    return (uint32_t)((node_t*)arg)->clock;
+}
+
+// Queued after the oldest of the last MAILBOXES frames from the node has left
+static void node_send(uint32_t eid, const uint8_t *data, uint8_t len, void *arg) {
+    node_t *n = (node_t*)arg;
+
+    if (n->mb_end[n->mb_ind] > n->clock) {
+        n->clock = n->mb_end[n->mb_ind];
+    }
+
+    const double start = fmax(n->clock, bus_free);
+    bus_frame_t *f = &bus_queue[bus_tail];
+    f->eid = eid;
+    memcpy(f->data, data, len);
+    f->len = len;
+    f->to = n->other;
+    f->end = start + frame_us(len);
+    bus_tail = (bus_tail + 1) % BUS_QUEUE_LEN;
+    bus_free = f->end;
+
+    n->mb_end[n->mb_ind] = f->end;
+    n->mb_ind = (n->mb_ind + 1) % MAILBOXES;
+}
+
+static void node_deliver(uint8_t src, uint8_t dest, uint8_t send,
+        uint8_t *data, unsigned int len, void *arg) {
+    (void)arg;
+
+    uint8_t ref[PACKET_LEN];
+    const int ind = data[0] << 8 | data[1];
+    if (src != ID_A || dest != ID_B || send != 0 || len != PACKET_LEN || ind >= PACKETS) {
+        received_bad++;
+        return;
+    }
+
+    fill_packet(ref, ind);
+    if (memcmp(ref, data, len) != 0) {
+        received_bad++;
+        return;
+    }
+
+    received[ind]++;
+}
+
+static void sim_init(double loss) {
+    memset(nodes, 0, sizeof(nodes));
+    memset(received, 0, sizeof(received));
+    received_bad = 0;
+    bus_head = 0;
+    bus_tail = 0;
+    bus_free = 0.0;
+    bus_loss = loss;
+    corrupt_next = 0;
+
+    for (int i = 0; i < 2; i++) {
+        nodes[i].id = i == 0 ? ID_A : ID_B;
+        nodes[i].other = 1 - i;
+        comm_can_xfer_init(&nodes[i].x, node_time, node_send, node_deliver, &nodes[i]);
+    }
+}
+
+// Hand the next frame on the bus to its receiver
+static void bus_step(void) {
+    bus_frame_t f = bus_queue[bus_head];
+    bus_head = (bus_head + 1) % BUS_QUEUE_LEN;
+
+    if (rand_uniform() < bus_loss) {
+        return;
+    }
+
+    const uint8_t type = (f.eid >> 8) & 0xFF;
+    if (corrupt_next && type == CAN_PACKET_BUFFER_XFER_DATA && (f.data[0] & 0x7F) == 1) {
+        f.data[3] ^= 0x10;
+        corrupt_next--;
+    }
+
+    node_t *n = &nodes[f.to];
+    n->clock = fmax(n->clock, f.end);
+
+    if (type == CAN_PACKET_BUFFER_XFER_DATA) {
+        comm_can_xfer_rx_frame(&n->x, f.eid, f.data, f.len);
+    } else if (type == CAN_PACKET_BUFFER_XFER_ACK) {
+        comm_can_xfer_tx_ack(&n->x, f.eid, f.data, f.len);
+    }
+}
+
+/*
+ * Stream PACKETS buffers from A to B with at most in_flight transfers at
+ * the same time.
+ *
+ * @return
+ * Effective throughput [bytes/s].
+ */
+static double run_xfer(double loss, int in_flight, unsigned int seed) {
+    srand(seed);
+    sim_init(loss);
+
+    node_t *a = &nodes[0];
+    node_t *b = &nodes[1];
+    uint8_t data[PACKET_LEN];
+    int next_packet = 0;
+    double now = 0.0;
+    double next_poll = POLL_US;
+
+    while (now < TIME_LIMIT_US) {
+        a->clock = fmax(a->clock, now);
+        while (next_packet < PACKETS && comm_can_xfer_in_flight(&a->x) < in_flight) {
+            fill_packet(data, next_packet);
+            if (!comm_can_xfer_send(&a->x, ID_A, ID_B, 0, data, PACKET_LEN)) {
+                break;
+            }
+            next_packet++;
+        }
+
+        if (next_packet == PACKETS && comm_can_xfer_in_flight(&a->x) == 0) {
+            break;
+        }
+
+        if (bus_head != bus_tail && bus_queue[bus_head].end <= next_poll) {
+            now = bus_queue[bus_head].end;
+            bus_step();
+        } else {
+            now = next_poll;
+            next_poll += POLL_US;
+            a->clock = fmax(a->clock, now);
+            b->clock = fmax(b->clock, now);
+            comm_can_xfer_tx_poll(&a->x, 0);
+        }
+    }
+
+    return (double)PACKETS * PACKET_LEN / (fmax(now, a->clock) * 1e-6);
+}
+
+/*
+ * Stop and wait over the legacy transport: the frames of
+ * comm_can_send_buffer, then a reply in one short buffer frame. Any lost
+ * frame means that the buffer is sent again after the timeout.
+ */
+static double run_legacy(double loss, unsigned int seed) {
+    srand(seed);
+
+    double t = 0.0;
+    for (int p = 0; p < PACKETS; p++) {
+        for (;;) {
+            const double start = t;
+            bool lost = false;
+
+            unsigned int end_a = 0;
+            for (unsigned int i = 0; i < PACKET_LEN && i <= 255; i += 7) {
+                end_a = i + 7;
+                t += frame_us(1 + ((i + 7) <= PACKET_LEN ? 7 : PACKET_LEN - i));
+                lost |= rand_uniform() < loss;
+            }
+
+            for (unsigned int i = end_a; i < PACKET_LEN; i += 6) {
+                t += frame_us(2 + ((i + 6) <= PACKET_LEN ? 6 : PACKET_LEN - i));
+                lost |= rand_uniform() < loss;
+            }
+
+            // Process frame and reply
+            t += frame_us(6);
+            lost |= rand_uniform() < loss;
+            t += frame_us(8);
+            lost |= rand_uniform() < loss;
+
+            if (!lost) {
+                break;
+            }
+
+            t = fmax(t, start + LEGACY_TIMEOUT_US);
+        }
+    }
+
+    return (double)PACKETS * PACKET_LEN / (t * 1e-6);
+}
+
+static bool all_received_once(void) {
+    if (received_bad != 0) {
+        return false;
+    }
+
+    for (int i = 0; i < PACKETS; i++) {
+        if (received[i] != 1) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// =============================================================================
+// Tests
+// =============================================================================
+
+static bool test_frame_ids(void) {
+    const uint32_t eid = ID_B | ((uint32_t)CAN_PACKET_BUFFER_XFER_DATA << 8) | (ID_A << 16) | (3 << 24) | (7 << 26);
+    TEST_ASSERT(comm_can_xfer_is_frame(eid), "Data frame");
+    TEST_ASSERT(comm_can_xfer_is_frame(ID_A | ((uint32_t)CAN_PACKET_BUFFER_XFER_ACK << 8)), "ACK from node 0, slot 0");
+    TEST_ASSERT(!comm_can_xfer_is_frame(ID_B | ((uint32_t)CAN_PACKET_FILL_RX_BUFFER << 8)), "Legacy buffer frame");
+    TEST_ASSERT(!comm_can_xfer_is_frame(ID_B | ((uint32_t)CAN_PACKET_PING << 8)), "Ping");
+
+    // Old nodes see an unknown packet type
+    TEST_ASSERT((eid >> 8) > 0xFF, "Upper bits make the legacy type unknown");
+    TEST_ASSERT(eid < (1 << 29), "Fits in an extended ID");
+
+    return true;
+}
+
+static bool test_slots(void) {
+    sim_init(0.0);
+    uint8_t data[CAN_XFER_MAX_LEN + 1];
+    memset(data, 0, sizeof(data));
+
+    TEST_ASSERT(!comm_can_xfer_send(&nodes[0].x, ID_A, ID_B, 0, data, 0), "Empty buffer refused");
+    TEST_ASSERT(!comm_can_xfer_send(&nodes[0].x, ID_A, ID_B, 0, data, CAN_XFER_MAX_LEN + 1), "Long buffer refused");
+
+    for (int i = 0; i < CAN_XFER_SLOTS; i++) {
+        TEST_ASSERT(comm_can_xfer_send(&nodes[0].x, ID_A, ID_B, 0, data, 100), "Transfer started");
+    }
+
+    TEST_ASSERT(comm_can_xfer_in_flight(&nodes[0].x) == CAN_XFER_SLOTS, "All slots in flight");
+    TEST_ASSERT(!comm_can_xfer_send(&nodes[0].x, ID_A, ID_B, 0, data, 100), "No free slot");
+
+    while (bus_head != bus_tail) {
+        bus_step();
+    }
+
+    TEST_ASSERT(comm_can_xfer_in_flight(&nodes[0].x) == 0, "Slots free after the ACKs");
+    TEST_ASSERT(nodes[0].x.stats.tx_done == CAN_XFER_SLOTS, "All done");
+    TEST_ASSERT(nodes[1].x.stats.rx_done == CAN_XFER_SLOTS, "All received");
+
+    return true;
+}
+
+static bool test_crc_failure(void) {
+    srand(7);
+    sim_init(0.0);
+    corrupt_next = 1;
+
+    uint8_t data[PACKET_LEN];
+    fill_packet(data, 3);
+    TEST_ASSERT(comm_can_xfer_send(&nodes[0].x, ID_A, ID_B, 0, data, PACKET_LEN), "Transfer started");
+
+    while (bus_head != bus_tail) {
+        bus_step();
+    }
+
+    TEST_ASSERT(nodes[1].x.stats.rx_crc_errors == 1, "CRC error found");
+    TEST_ASSERT(received[3] == 1 && received_bad == 0, "Delivered once, intact");
+    TEST_ASSERT(nodes[0].x.stats.tx_done == 1, "Sender done");
+
+    return true;
+}
+
+static bool test_give_up(void) {
+    sim_init(1.0);
+
+    uint8_t data[PACKET_LEN];
+    fill_packet(data, 0);
+    TEST_ASSERT(comm_can_xfer_send(&nodes[0].x, ID_A, ID_B, 0, data, PACKET_LEN), "Transfer started");
+
+    uint8_t failed[CAN_XFER_SLOTS];
+    int failed_num = 0;
+    int polls = 0;
+    while (failed_num == 0 && polls < 100) {
+        nodes[0].clock += POLL_US;
+        while (bus_head != bus_tail) {
+            bus_step();
+        }
+        failed_num = comm_can_xfer_tx_poll(&nodes[0].x, failed);
+        polls++;
+    }
+
+    TEST_ASSERT(failed_num == 1 && failed[0] == ID_B, "Given up with the destination");
+    TEST_ASSERT(nodes[0].x.stats.tx_failed == 1, "Counted as failed");
+    TEST_ASSERT(comm_can_xfer_in_flight(&nodes[0].x) == 0, "Slot free");
+    TEST_ASSERT(comm_can_xfer_tx_poll(&nodes[0].x, failed) == 0, "Reported once");
+
+    return true;
+}
+
+static bool test_throughput(void) {
+    const double losses[] = {0.0, 0.01, 0.05, 0.10};
+
+    printf("  Loss   Legacy [B/s]  1 in flight [B/s]  %d in flight [B/s]  Resent\n", CAN_XFER_SLOTS);
+
+    for (unsigned int i = 0; i < sizeof(losses) / sizeof(losses[0]); i++) {
+        const double legacy = run_legacy(losses[i], 100 + i);
+
+        const double single = run_xfer(losses[i], 1, 100 + i);
+        TEST_ASSERT(all_received_once(), "All buffers delivered once with one in flight");
+        TEST_ASSERT(nodes[0].x.stats.tx_failed == 0, "No transfer given up");
+
+        const double windowed = run_xfer(losses[i], CAN_XFER_SLOTS, 100 + i);
+        TEST_ASSERT(all_received_once(), "All buffers delivered once with all slots in flight");
+        TEST_ASSERT(nodes[0].x.stats.tx_failed == 0, "No transfer given up");
+
+        printf("  %3.0f %%  %12.0f  %17.0f  %17.0f  %6u\n", losses[i] * 100.0,
+                legacy, single, windowed, (unsigned int)nodes[0].x.stats.tx_resent);
+
+        TEST_ASSERT(windowed > legacy, "Faster than legacy");
+
+        // Without loss the bus is the limit already with one in flight, and
+        // polls for ACKs that wait behind the other transfers cost a bit
+        TEST_ASSERT(windowed > 0.95 * single, "More in flight is not much slower");
+
+        if (losses[i] >= 0.01) {
+            TEST_ASSERT(windowed > 2.0 * legacy, "Much faster than legacy with loss");
+        }
+
+        if (losses[i] >= 0.1) {
+            TEST_ASSERT(windowed > 1.1 * single, "More in flight is faster with loss");
+        }
+    }
+
+    return true;
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+int main(void) {
+    printf("========================================\n");
+    printf("CAN Buffer Transfer Tests\n");
+    printf("========================================\n\n");
+
+    RUN_TEST(test_frame_ids);
+    RUN_TEST(test_slots);
+    RUN_TEST(test_crc_failure);
+    RUN_TEST(test_give_up);
+    RUN_TEST(test_throughput);
+
+    printf("\n========================================\n");
+    printf("Total: %d, Passed: %d, Failed: %d\n", total_tests, passed_tests, test_failures);
+    printf("========================================\n");
+
+    return test_failures > 0 ? 1 : 0;
+}
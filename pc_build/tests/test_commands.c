@@ -0,0 +1,197 @@
+/**
+ * @file test_commands.c
+ * @brief Packet decoding in comm/commands.c
+ *
+ * Packets are fed through commands_process_packet() the way the USB, UART
+ * and CAN interfaces do it, with the packet id as the first byte. The
+ * functions a packet ends up in are defined here, everything else around
+ * commands.c comes from hil/hil_cmd_stubs.c.
+ *
+ * Validates:
+ * - COMM_CAPTURE_ARM parses all fields and replies with the result
+ * - A too short COMM_CAPTURE_ARM is dropped without a reply
+ * - A configuration that does not fit the buffer is refused
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+
+// Test framework
+#define TEST_ASSERT(cond, msg) do { \
+    if (!(cond)) { \
+        printf("  FAIL: %s (line %d)\n", msg, __LINE__); \
+        test_failures++; \
+        return false; \
+    } \
+} while(0)
+
+#define RUN_TEST(test_func) do { \
+    printf("Running %s...\n", #test_func); \
+    total_tests++; \
+    if (test_func()) { \
+        printf("  PASS\n"); \
+        passed_tests++; \
+    } \
+} while(0)
+
+static int test_failures = 0;
+static int total_tests = 0;
+static int passed_tests = 0;
+
+#include "commands.h"
+#include "mc_interface.h"
+#include "mc_capture.h"
+#include "buffer.h"
+
+#define CAPTURE_BUFFER_LEN  1024
+
+static int16_t capture_buffer[CAPTURE_BUFFER_LEN];
+static mc_capture_t capture;
+static int arm_calls = 0;
+
+static uint8_t reply[64];
+static unsigned int reply_len = 0;
+static int reply_cnt = 0;
+
+// Same as in mc_interface.c, on a capture of this test
+bool mc_interface_capture_arm(const mc_capture_config *conf) {
+    arm_calls++;
+    mc_capture_disarm(&capture);
+    return mc_capture_arm(&capture, conf);
+}
+
+void mc_interface_capture_send(uint16_t offset, uint16_t count,
+        void(*reply_func)(unsigned char *data, unsigned int len)) {
+    (void)offset;
+    (void)count;
+    (void)reply_func;
+}
+
+static void reply_func(unsigned char *data, unsigned int len) {
+    memcpy(reply, data, len < sizeof(reply) ? len : sizeof(reply));
+    reply_len = len;
+    reply_cnt++;
+}
+
+static void reset(void) {
+    mc_capture_init(&capture, capture_buffer, CAPTURE_BUFFER_LEN);
+    arm_calls = 0;
+    reply_len = 0;
+    reply_cnt = 0;
+}
+
+// COMM_CAPTURE_ARM as the tools send it
+static int32_t arm_packet(uint8_t *buffer, const mc_capture_config *conf) {
+    int32_t ind = 0;
+    buffer[ind++] = COMM_CAPTURE_ARM;
+    buffer_append_uint16(buffer, conf->conditions, &ind);
+    buffer_append_uint16(buffer, conf->channels, &ind);
+    buffer_append_uint16(buffer, conf->pre_samples, &ind);
+    buffer_append_uint16(buffer, conf->post_samples, &ind);
+    buffer[ind++] = conf->decimation;
+    buffer_append_float32_auto(buffer, conf->current_above, &ind);
+    buffer_append_float32_auto(buffer, conf->erpm_below, &ind);
+    buffer_append_float32_auto(buffer, conf->erpm_above, &ind);
+    buffer_append_float32_auto(buffer, conf->angle_jump, &ind);
+    buffer[ind++] = conf->fault_code;
+    return ind;
+}
+
+static mc_capture_config test_config(void) {
+    mc_capture_config conf;
+    memset(&conf, 0, sizeof(conf));
+    conf.conditions = (1 << MC_CAPTURE_COND_CURRENT_ABOVE) | (1 << MC_CAPTURE_COND_ERPM_ABOVE);
+    conf.channels = (1 << DEBUG_SAMPLING_CH_CURR0) | (1 << DEBUG_SAMPLING_CH_CURR1);
+    conf.pre_samples = 100;
+    conf.post_samples = 50;
+    conf.decimation = 2;
+    conf.current_above = 42.5f;
+    conf.erpm_below = 100.0f;
+    conf.erpm_above = 12000.0f;
+    conf.angle_jump = 30.0f;
+    conf.fault_code = FAULT_CODE_ABS_OVER_CURRENT;
+    return conf;
+}
+
+// =============================================================================
+// Test Cases
+// =============================================================================
+
+static bool test_capture_arm(void) {
+    reset();
+    mc_capture_config conf = test_config();
+    uint8_t packet[64];
+    int32_t len = arm_packet(packet, &conf);
+
+    TEST_ASSERT(len == 27, "Packet id and 26 bytes");
+
+    commands_process_packet(packet, len, reply_func);
+
+    TEST_ASSERT(arm_calls == 1, "Capture armed");
+    TEST_ASSERT(reply_cnt == 1 && reply_len == 2, "One reply");
+    TEST_ASSERT(reply[0] == COMM_CAPTURE_ARM && reply[1] == 1, "Reply ok");
+    TEST_ASSERT(capture.state == MC_CAPTURE_ARMED, "Capture recording");
+
+    const mc_capture_config *c = &capture.conf;
+    TEST_ASSERT(c->conditions == conf.conditions, "Conditions");
+    TEST_ASSERT(c->channels == conf.channels, "Channels");
+    TEST_ASSERT(c->pre_samples == 100 && c->post_samples == 50, "Window");
+    TEST_ASSERT(c->decimation == 2, "Decimation");
+    TEST_ASSERT(fabsf(c->current_above - 42.5f) < 1e-3f, "Current above");
+    TEST_ASSERT(fabsf(c->erpm_below - 100.0f) < 1e-3f, "ERPM below");
+    TEST_ASSERT(fabsf(c->erpm_above - 12000.0f) < 1e-1f, "ERPM above");
+    TEST_ASSERT(fabsf(c->angle_jump - 30.0f) < 1e-3f, "Angle jump");
+    TEST_ASSERT(c->fault_code == FAULT_CODE_ABS_OVER_CURRENT, "Fault code");
+
+    return true;
+}
+
+static bool test_capture_arm_short(void) {
+    reset();
+    mc_capture_config conf = test_config();
+    uint8_t packet[64];
+    int32_t len = arm_packet(packet, &conf);
+
+    commands_process_packet(packet, len - 1, reply_func);
+
+    TEST_ASSERT(arm_calls == 0, "Not armed");
+    TEST_ASSERT(reply_cnt == 0, "No reply");
+
+    return true;
+}
+
+static bool test_capture_arm_too_large(void) {
+    reset();
+    mc_capture_config conf = test_config();
+    conf.channels = 0x3F;
+    conf.pre_samples = 1000;
+    uint8_t packet[64];
+    int32_t len = arm_packet(packet, &conf);
+
+    commands_process_packet(packet, len, reply_func);
+
+    TEST_ASSERT(arm_calls == 1, "Arm attempted");
+    TEST_ASSERT(reply_cnt == 1 && reply[0] == COMM_CAPTURE_ARM && reply[1] == 0, "Reply refused");
+    TEST_ASSERT(capture.state == MC_CAPTURE_IDLE, "Capture idle");
+
+    return true;
+}
+
+int main(void) {
+    printf("========================================\n");
+    printf("Command Packet Tests\n");
+    printf("========================================\n\n");
+
+    RUN_TEST(test_capture_arm);
+    RUN_TEST(test_capture_arm_short);
+    RUN_TEST(test_capture_arm_too_large);
+
+    printf("\n========================================\n");
+    printf("Total: %d, Passed: %d, Failed: %d\n", total_tests, passed_tests, test_failures);
+    printf("========================================\n");
+
+    return test_failures > 0 ? 1 : 0;
+}
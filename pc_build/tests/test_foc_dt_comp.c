@@ -0,0 +1,325 @@
+/**
+ * @file test_foc_dt_comp.c
+ * @brief Dead time and switch voltage drop compensation (motor/foc_dt_comp.c)
+ *
+ * The closed loop runs the current controller on the true rotor angle at
+ * low speed against the switching inverter model, which loses the dead
+ * time and the diode drop depending on the direction of each phase
+ * current. The voltage the observer is given is compared with what the
+ * inverter really applied, once with the fixed dead time model that
+ * update_valpha_vbeta uses and once with the learned map in the output.
+ *
+ * Validates:
+ * - A reset map reproduces the fixed dead time model
+ * - Learning from voltage residuals converges to a per phase error curve
+ * - With the learned map in the loop the observer sees the applied
+ *   voltage more accurately than with the fixed model, also when the
+ *   fixed model uses the true dead time
+ * - The observer angle error drops against the default foc_dt_us. At this
+ *   speed the angle error of the observer does not follow the voltage
+ *   error alone, so it is only printed for the true dead time case
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+
+// Test framework
+#define TEST_ASSERT(cond, msg) do { \
+    if (!(cond)) { \
+        printf("  FAIL: %s (line %d)\n", msg, __LINE__); \
+        test_failures++; \
+        return false; \
+    } \
+} while(0)
+
+#define RUN_TEST(test_func) do { \
+    printf("Running %s...\n", #test_func); \
+    total_tests++; \
+    if (test_func()) { \
+        printf("  PASS\n"); \
+        passed_tests++; \
+    } \
+} while(0)
+
+static int test_failures = 0;
+static int total_tests = 0;
+static int passed_tests = 0;
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846f
+#endif
+
+#include "../motor_sim/virtual_motor_pc.h"
+#include "../motor_sim/inverter_model.h"
+#include "../motor_sim/foc_control_core.h"
+#include "../motor_sim/mcconf_stub.h"
+#include "foc_math.h"
+#include "foc_dt_comp.h"
+#include "utils_math.h"
+
+#define V_BUS           48.0f
+#define DEAD_TIME       0.5e-6f // Dead time of the simulated inverter [s]
+#define CC_BANDWIDTH    3000.0f // Current controller bandwidth [rad/s]
+#define LEARN_TIME      2.0f
+#define SETTLE_TIME     0.3f    // Observer settling after the restart
+#define MEASURE_TIME    0.2f
+#define LEARN_TC        0.05f   // DT_COMP_LEARN_TIME in mcpwm_foc.c
+
+// Same split into phases as update_valpha_vbeta
+static void phase_currents(float id, float iq, float s, float c, float *ia, float *ib, float *ic) {
+    const float i_alpha = c * id - s * iq;
+    const float i_beta = c * iq + s * id;
+    *ia = i_alpha;
+    *ib = -0.5f * i_alpha + SQRT3_BY_2 * i_beta;
+    *ic = -0.5f * i_alpha - SQRT3_BY_2 * i_beta;
+}
+
+// =============================================================================
+// Test Cases
+// =============================================================================
+
+static bool test_reset_matches_fixed_model(void) {
+    static foc_dt_comp_t map;
+    const float fact = 0.08e-6f * 30000.0f;
+    foc_dt_comp_reset(&map, 15.0f, fact);
+
+    for (float th = 0.05f; th < 2.0f * M_PI; th += 0.1f) {
+        float ia, ib, ic;
+        phase_currents(0.0f, 20.0f, sinf(th), cosf(th), &ia, &ib, &ic);
+        if (fabsf(ia) < 2.0f || fabsf(ib) < 2.0f || fabsf(ic) < 2.0f) {
+            continue; // Within the ramp around zero current
+        }
+
+        float ma, mb;
+        foc_dt_comp_get(&map, ia, ib, ic, &ma, &mb);
+        const float ref_a = (1.0f / 3.0f) * (2.0f * SIGN(ia) - SIGN(ib) - SIGN(ic)) * fact;
+        const float ref_b = ONE_BY_SQRT3 * (SIGN(ib) - SIGN(ic)) * fact;
+        TEST_ASSERT(fabsf(ma - ref_a) < 1e-6f && fabsf(mb - ref_b) < 1e-6f, "Same as the fixed model");
+    }
+
+    TEST_ASSERT(map.hits[0][3] == 0, "No updates after reset");
+    return true;
+}
+
+// Error curve of phase ph: dead time with a soft zero crossing, plus a
+// phase dependent switch drop
+static float phase_error(int ph, float i) {
+    return -0.01f * tanhf(i / 3.0f) - 0.001f * (float)(ph + 1) * i / 15.0f;
+}
+
+static bool test_learn_synthetic(void) {
+    static foc_dt_comp_t map;
+    foc_dt_comp_reset(&map, 15.0f, 0.0f);
+
+    double err_first = 0.0, err_last = 0.0;
+    const float dt = 1.0f / 30000.0f;
+    for (int k = 0; k < 60000; k++) {
+        const float th = 2.0f * M_PI * 20.0f * (float)k * dt;
+        const float mag = 5.0f + 10.0f * fabsf(sinf(0.37f * th));
+        float ia, ib, ic;
+        phase_currents(0.0f, mag, sinf(th), cosf(th), &ia, &ib, &ic);
+
+        const float ea = phase_error(0, ia), eb = phase_error(1, ib), ec = phase_error(2, ic);
+        const float e_alpha = (1.0f / 3.0f) * (2.0f * ea - eb - ec);
+        const float e_beta = ONE_BY_SQRT3 * (eb - ec);
+
+        float comp_a, comp_b;
+        foc_dt_comp_get(&map, ia, ib, ic, &comp_a, &comp_b);
+        const float res_a = e_alpha + comp_a;
+        const float res_b = e_beta + comp_b;
+
+        // RMS over the first and the last revolution
+        if (k < 1500) {
+            err_first += (SQ(res_a) + SQ(res_b)) / 1500.0;
+        } else if (k >= 58500) {
+            err_last += (SQ(res_a) + SQ(res_b)) / 1500.0;
+        }
+
+        foc_dt_comp_learn(&map, ia, ib, ic, res_a, res_b, dt / LEARN_TC);
+    }
+
+    err_first = sqrt(err_first);
+    err_last = sqrt(err_last);
+    printf("    RMS residual before %.5f, after %.5f\n", err_first, err_last);
+    TEST_ASSERT(err_last < 0.2f * err_first, "Residual reduced by 5x");
+    TEST_ASSERT(map.hits[0][FOC_DT_COMP_POINTS / 2] > 0 && map.hits[2][0] > 0, "Updates counted");
+
+    return true;
+}
+
+typedef enum {
+    COMP_FIXED = 0,     // Fixed model on the observer voltage only, as without the map
+    COMP_LEARNED        // Learned map in the output
+} comp_mode_t;
+
+typedef struct {
+    float v_err_rms;    // Observer voltage minus applied voltage [V]
+    float angle_rms;    // Observer angle error [deg]
+} loop_result_t;
+
+static void run_loop(comp_mode_t mode, float dt_us_conf, loop_result_t *res) {
+    static mc_configuration conf;
+    static motor_all_state_t motor;
+    static virtual_motor_state_t vm;
+    static inverter_state_t inv;
+    static foc_dt_comp_t map;
+    inverter_config_t icfg;
+    virtual_motor_io_t io;
+
+    mcconf_set_defaults(&conf);
+    // The plant advances the angle with we but scales the back EMF with the
+    // pole pairs, one pole pair keeps both electrical
+    conf.si_motor_poles = 2;
+    conf.foc_dt_us = dt_us_conf;
+    foc_motor_state_init(&motor, &conf);
+
+    virtual_motor_pc_state_init(&vm, &conf);
+    virtual_motor_pc_state_set_integrator(&vm, VM_INTEGRATOR_EXACT);
+    virtual_motor_pc_state_set_inertia(&vm, 1e3f);
+    virtual_motor_pc_state_set_speed(&vm, 150.0f);
+    memset(&io, 0, sizeof(io));
+
+    inverter_default_config(&icfg, &conf);
+    icfg.dead_time = DEAD_TIME;
+    inverter_init(&inv, &icfg);
+    const float dt = inverter_sample_period(&inv);
+
+    foc_dt_comp_reset(&map, conf.l_current_max * FOC_DT_COMP_RANGE_FACTOR,
+                      conf.foc_dt_us * 1e-6f * conf.foc_f_zv);
+
+    const float R = conf.foc_motor_r;
+    const float L = conf.foc_motor_l;
+    const float lambda = conf.foc_motor_flux_linkage;
+    const float kp = CC_BANDWIDTH * L;
+    const float ki = CC_BANDWIDTH * R;
+    const float voltage_normalize = 1.5f / V_BUS;
+    const float max_v_mag = ONE_BY_SQRT3 * conf.l_max_duty * V_BUS;
+    const float mod_comp_fact = conf.foc_dt_us * 1e-6f * conf.foc_f_zv;
+
+    float vd_int = 0.0f, vq_int = 0.0f;
+    float id_filter = 0.0f, iq_filter = 0.0f;
+    float v_obs_alpha = 0.0f, v_obs_beta = 0.0f;
+    double v_err_sq = 0.0, angle_sq = 0.0;
+    int samples = 0;
+
+    const int steps = (int)((LEARN_TIME + SETTLE_TIME + MEASURE_TIME) / dt);
+    const int restart_step = (int)(LEARN_TIME / dt);
+    for (int k = 0; k < steps; k++) {
+        // Start the observer over once the map is learned, so that its
+        // state does not remember the error of the seed
+        if (k == restart_step) {
+            memset(&motor.m_observer_state, 0, sizeof(observer_state));
+            motor.m_observer_state.lambda_est = conf.foc_motor_flux_linkage;
+        }
+
+        const float i_alpha = inv.i_alpha_meas;
+        const float i_beta = inv.i_beta_meas;
+
+        // The observer gets the voltage it believes was applied over the last period
+        float phase;
+        foc_observer_update(v_obs_alpha, v_obs_beta, i_alpha, i_beta, dt,
+                            &motor.m_observer_state, &phase, &motor);
+
+        if (k * dt >= LEARN_TIME + SETTLE_TIME) {
+            v_err_sq += SQ(v_obs_alpha - inv.v_alpha_avg) + SQ(v_obs_beta - inv.v_beta_avg);
+            angle_sq += SQ(utils_angle_difference_rad(phase, vm.phi) * 180.0f / M_PI);
+            samples++;
+        }
+
+        // Current control on the true angle, as control_current
+        float s, c;
+        utils_fast_sincos_better(vm.phi, &s, &c);
+        const float id = c * i_alpha + s * i_beta;
+        const float iq = c * i_beta - s * i_alpha;
+        UTILS_LP_FAST(id_filter, id, conf.foc_current_filter_const);
+        UTILS_LP_FAST(iq_filter, iq, conf.foc_current_filter_const);
+        motor.m_motor_state.id = id;
+        motor.m_motor_state.iq = iq;
+
+        const float iq_target = 20.0f;
+        vd_int += ki * (0.0f - id) * dt;
+        vq_int += ki * (iq_target - iq) * dt;
+        float vd = kp * (0.0f - id) + vd_int - vm.we * L * iq_filter;
+        float vq = kp * (iq_target - iq) + vq_int + vm.we * (L * id_filter + lambda);
+        utils_saturate_vector_2d(&vd, &vq, max_v_mag);
+
+        float mod_alpha = (c * vd - s * vq) * voltage_normalize;
+        float mod_beta = (c * vq + s * vd) * voltage_normalize;
+
+        float ia, ib, ic;
+        phase_currents(id_filter, iq_filter, s, c, &ia, &ib, &ic);
+
+        if (mode == COMP_LEARNED) {
+            if (NORM2_f(vd, vq) < 0.9f * max_v_mag) {
+                const float res_d = (R * id_filter - vm.we * L * iq_filter - vd) * voltage_normalize;
+                const float res_q = (R * iq_filter + vm.we * (L * id_filter + lambda) - vq) * voltage_normalize;
+                foc_dt_comp_learn(&map, ia, ib, ic, c * res_d - s * res_q, c * res_q + s * res_d, dt / LEARN_TC);
+            }
+
+            // The output gets the compensation, the observer the voltage before it
+            float comp_a, comp_b;
+            foc_dt_comp_get(&map, ia, ib, ic, &comp_a, &comp_b);
+            v_obs_alpha = mod_alpha / voltage_normalize;
+            v_obs_beta = mod_beta / voltage_normalize;
+            mod_alpha += comp_a;
+            mod_beta += comp_b;
+        } else {
+            const float sgn_a = (1.0f / 3.0f) * (2.0f * SIGN(ia) - SIGN(ib) - SIGN(ic));
+            const float sgn_b = ONE_BY_SQRT3 * (SIGN(ib) - SIGN(ic));
+            v_obs_alpha = (mod_alpha - sgn_a * mod_comp_fact) / voltage_normalize;
+            v_obs_beta = (mod_beta - sgn_b * mod_comp_fact) / voltage_normalize;
+        }
+
+        uint32_t d1, d2, d3, sector;
+        foc_svm(mod_alpha, mod_beta, conf.l_max_duty, FOC_PWM_PERIOD_DEFAULT, &d1, &d2, &d3, &sector);
+        inverter_set_duty(&inv, (float)d1 / FOC_PWM_PERIOD_DEFAULT,
+                          (float)d2 / FOC_PWM_PERIOD_DEFAULT, (float)d3 / FOC_PWM_PERIOD_DEFAULT);
+        inverter_step(&inv, &vm, &io, V_BUS, dt, 2e-6f);
+    }
+
+    res->v_err_rms = sqrtf(v_err_sq / samples);
+    res->angle_rms = sqrtf(angle_sq / samples);
+}
+
+static bool test_closed_loop(void) {
+    loop_result_t fixed_conf, fixed_true, learned;
+
+    // Configured dead time as in the default configuration, and matching the inverter
+    run_loop(COMP_FIXED, 0.08f, &fixed_conf);
+    run_loop(COMP_FIXED, DEAD_TIME * 1e6f, &fixed_true);
+    run_loop(COMP_LEARNED, 0.08f, &learned);
+
+    printf("    %-28s %14s %14s\n", "", "V error [V]", "Angle [deg]");
+    printf("    %-28s %14.3f %14.2f\n", "Fixed, configured dead time", (double)fixed_conf.v_err_rms, (double)fixed_conf.angle_rms);
+    printf("    %-28s %14.3f %14.2f\n", "Fixed, true dead time", (double)fixed_true.v_err_rms, (double)fixed_true.angle_rms);
+    printf("    %-28s %14.3f %14.2f\n", "Learned map", (double)learned.v_err_rms, (double)learned.angle_rms);
+
+    TEST_ASSERT(learned.v_err_rms < 0.5f * fixed_conf.v_err_rms, "Voltage error halved against the configured model");
+    TEST_ASSERT(learned.v_err_rms < fixed_true.v_err_rms, "Voltage error below the true dead time model");
+    TEST_ASSERT(learned.angle_rms < fixed_conf.angle_rms, "Observer angle error reduced");
+
+    return true;
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+int main(void) {
+    printf("========================================\n");
+    printf("Dead Time Compensation Tests\n");
+    printf("========================================\n\n");
+
+    RUN_TEST(test_reset_matches_fixed_model);
+    RUN_TEST(test_learn_synthetic);
+    RUN_TEST(test_closed_loop);
+
+    printf("\n========================================\n");
+    printf("Total: %d, Passed: %d, Failed: %d\n", total_tests, passed_tests, test_failures);
+    printf("========================================\n");
+
+    return test_failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,210 @@
+/**
+ * @file test_foc_fsw_adapt.c
+ * @brief Switching frequency from a learned inverter loss model (motor/foc_fsw_adapt.c)
+ *
+ * The FET temperature comes from a first order thermal model driven by the
+ * conduction and switching losses of the loss model in foc_fsw_adapt.h,
+ * with coefficients the estimator does not know. The operating point moves
+ * between random currents and bus voltages at f_max, as the frequency does
+ * not move before there is a model. Conduction rising with the square of
+ * the current and switching rising linearly with it is what separates them.
+ *
+ * Validates:
+ * - No model is used before it is learned, and f_max is kept then
+ * - The learned model gives the analytic loss optimum at several currents
+ * - Light load runs at f_max and very high current at f_min
+ * - Small changes are ignored, changes are held for a while, and the
+ *   frequency floor is followed right away
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+
+// Test framework
+#define TEST_ASSERT(cond, msg) do { \
+    if (!(cond)) { \
+        printf("  FAIL: %s (line %d)\n", msg, __LINE__); \
+        test_failures++; \
+        return false; \
+    } \
+} while(0)
+
+#define RUN_TEST(test_func) do { \
+    printf("Running %s...\n", #test_func); \
+    total_tests++; \
+    if (test_func()) { \
+        printf("  PASS\n"); \
+        passed_tests++; \
+    } \
+} while(0)
+
+static int test_failures = 0;
+static int total_tests = 0;
+static int passed_tests = 0;
+
+#include "foc_fsw_adapt.h"
+
+#define F_MIN           12e3f
+#define F_MAX           30e3f
+#define I_REF           100.0f
+#define V_REF           60.0f
+#define TAU             2.0f    // FSW_ADAPT_THERMAL_TAU in mcpwm_foc.c
+#define L_MOTOR         20e-6f
+#define K_COND          2e-3f   // [Ohm]
+#define K_SW            3e-8f   // [J / (V * A)]
+#define RDS_TEMPCO      0.005f
+#define R_TH            5.0f    // [degC / W]
+#define T_AMB           30.0f
+#define T_NOISE         0.05f   // Standard deviation of the temperature reading [degC]
+#define DT              0.01f
+
+static float rand_uniform(float lo, float hi) {
+    return lo + (hi - lo) * ((float)rand() / (float)RAND_MAX);
+}
+
+static float rand_normal(float sigma) {
+    float u1 = rand_uniform(1e-6f, 1.0f);
+    float u2 = rand_uniform(0.0f, 1.0f);
+    return sigma * sqrtf(-2.0f * logf(u1)) * cosf(2.0f * (float)M_PI * u2);
+}
+
+static float plant_loss(float i, float v, float f, float temp) {
+    const float ripple = v / (2.0f * L_MOTOR * f);
+    return K_COND * (1.0f + RDS_TEMPCO * (temp - 25.0f)) * (i * i + ripple * ripple / 12.0f) +
+            K_SW * v * i * f;
+}
+
+static float analytic_optimum(float i, float v, float temp) {
+    const float ripple_f = v / (2.0f * L_MOTOR);
+    float f = cbrtf(K_COND * (1.0f + RDS_TEMPCO * (temp - 25.0f)) * ripple_f * ripple_f /
+            (6.0f * K_SW * v * i));
+    return fminf(fmaxf(f, F_MIN), F_MAX);
+}
+
+// Runs the thermal plant through random operating points held for a few
+// seconds each, and returns the final temperature.
+static float learn(foc_fsw_adapt_t *fa, float time) {
+    const float f = F_MAX;
+    float temp = T_AMB;
+    float i = 0.0f, v = 48.0f;
+    float hold = 0.0f;
+
+    for (float t = 0.0f; t < time; t += DT) {
+        if (hold <= 0.0f) {
+            i = rand_uniform(0.0f, 80.0f);
+            v = rand_uniform(40.0f, 50.0f);
+            hold = rand_uniform(1.0f, 6.0f);
+        }
+        hold -= DT;
+
+        const float t_ss = T_AMB + R_TH * plant_loss(i, v, f, temp);
+        temp += (t_ss - temp) * DT / TAU;
+
+        foc_fsw_adapt_learn(fa, i, v, L_MOTOR, f, temp + rand_normal(T_NOISE), DT);
+    }
+
+    return temp;
+}
+
+// =============================================================================
+// Tests
+// =============================================================================
+
+static bool test_no_model(void) {
+    srand(1);
+    foc_fsw_adapt_t fa;
+    foc_fsw_adapt_init(&fa, F_MIN, F_MAX, I_REF, V_REF, TAU);
+
+    TEST_ASSERT(!foc_fsw_adapt_model_valid(&fa), "No model at the start");
+    TEST_ASSERT(foc_fsw_adapt_optimum(&fa, 60.0f, 48.0f, L_MOTOR, 60.0f) == F_MAX, "f_max without a model");
+
+    learn(&fa, 2.0f);
+    TEST_ASSERT(!foc_fsw_adapt_model_valid(&fa), "Not valid after a few updates");
+    TEST_ASSERT(foc_fsw_adapt_optimum(&fa, 60.0f, 48.0f, L_MOTOR, 60.0f) == F_MAX, "Still f_max");
+
+    return true;
+}
+
+static bool test_learn_optimum(void) {
+    srand(2);
+    foc_fsw_adapt_t fa;
+    foc_fsw_adapt_init(&fa, F_MIN, F_MAX, I_REF, V_REF, TAU);
+
+    learn(&fa, 900.0f);
+
+    const float ratio_true = (K_COND * I_REF * I_REF) / (K_SW * V_REF * I_REF * F_MAX);
+    printf("  %u updates, t_amb %.2f, k_cond %.3f, k_sw %.3f, ratio %.3f (true %.3f)\n",
+            (unsigned int)fa.updates, (double)fa.theta[0], (double)fa.theta[1], (double)fa.theta[2],
+            (double)(fa.theta[1] / fa.theta[2]), (double)ratio_true);
+
+    TEST_ASSERT(foc_fsw_adapt_model_valid(&fa), "Model valid");
+    TEST_ASSERT(fabsf(fa.theta[0] - T_AMB) < 1.0f, "Ambient temperature");
+
+    const float currents[] = {20.0f, 40.0f, 60.0f, 80.0f};
+    for (int k = 0; k < 4; k++) {
+        const float temp = 60.0f;
+        const float f = foc_fsw_adapt_optimum(&fa, currents[k], 48.0f, L_MOTOR, temp);
+        const float f_true = analytic_optimum(currents[k], 48.0f, temp);
+        printf("  %.0f A: %.0f Hz (analytic %.0f Hz)\n", (double)currents[k], (double)f, (double)f_true);
+        TEST_ASSERT(fabsf(f - f_true) < 0.05f * f_true, "Optimum matches the analytic one");
+
+        // The losses at the chosen frequency are close to the lowest ones
+        const float p = plant_loss(currents[k], 48.0f, f, temp);
+        const float p_best = plant_loss(currents[k], 48.0f, f_true, temp);
+        TEST_ASSERT(p < 1.01f * p_best, "Losses within 1 % of the lowest");
+    }
+
+    TEST_ASSERT(foc_fsw_adapt_optimum(&fa, 1.0f, 48.0f, L_MOTOR, 40.0f) == F_MAX, "Light load at f_max");
+    TEST_ASSERT(foc_fsw_adapt_optimum(&fa, 0.0f, 48.0f, L_MOTOR, 40.0f) == F_MAX, "No current at f_max");
+    TEST_ASSERT(foc_fsw_adapt_optimum(&fa, 5000.0f, 48.0f, L_MOTOR, 40.0f) == F_MIN, "Very high current at f_min");
+
+    return true;
+}
+
+static bool test_hysteresis_hold(void) {
+    foc_fsw_adapt_t fa;
+    foc_fsw_adapt_init(&fa, F_MIN, F_MAX, I_REF, V_REF, TAU);
+
+    TEST_ASSERT(foc_fsw_adapt_update(&fa, 28e3f, 0.0f, 0.001f) == F_MAX, "Small change ignored");
+    TEST_ASSERT(foc_fsw_adapt_update(&fa, 20e3f, 0.0f, 0.001f) == 20e3f, "Large change taken");
+    TEST_ASSERT(foc_fsw_adapt_update(&fa, 14e3f, 0.0f, 0.1f) == 20e3f, "Held after a change");
+
+    float f = 0.0f;
+    for (int i = 0; i < 20; i++) {
+        f = foc_fsw_adapt_update(&fa, 14e3f, 0.0f, 0.01f);
+    }
+    TEST_ASSERT(f == 14e3f, "Taken after the hold time");
+
+    TEST_ASSERT(foc_fsw_adapt_update(&fa, 14e3f, 25e3f, 0.001f) == 25e3f, "Floor followed during the hold");
+    TEST_ASSERT(foc_fsw_adapt_update(&fa, 5e3f, 0.0f, 1.0f) == F_MIN, "Limited to f_min");
+
+    // The limits can move below the present frequency
+    fa.f_max = 10e3f;
+    fa.f_min = 5e3f;
+    TEST_ASSERT(foc_fsw_adapt_update(&fa, 30e3f, 0.0f, 0.001f) == 10e3f, "Follows a lower f_max right away");
+
+    return true;
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+int main(void) {
+    printf("========================================\n");
+    printf("Switching Frequency Adaptation Tests\n");
+    printf("========================================\n\n");
+
+    RUN_TEST(test_no_model);
+    RUN_TEST(test_learn_optimum);
+    RUN_TEST(test_hysteresis_hold);
+
+    printf("\n========================================\n");
+    printf("Total: %d, Passed: %d, Failed: %d\n", total_tests, passed_tests, test_failures);
+    printf("========================================\n");
+
+    return test_failures > 0 ? 1 : 0;
+}
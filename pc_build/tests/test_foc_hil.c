@@ -0,0 +1,688 @@
+/**
+ * @file test_foc_hil.c
+ * @brief Hardware-in-the-loop tests for the production FOC ISR
+ * 
+ * Runs motor/mcpwm_foc.c (ADC ISR, timer, HFI and PID thread bodies)
+ * against the virtual motor in simulated time.
+ * 
+ * Validates:
+ * - ISR timing derived from the TIM1 setup matches foc_f_zv
+ * - Current control tracks the commanded current
+ * - Speed control reaches and holds the set point under load
+ * - Releasing the motor floats the bridge and the rotor coasts
+ * - Simulated time runs much faster than real time
+ * - The ISR stage profiler accounts for every ISR and stage, and counts the
+ *   records dropped since the last reset
+ * - A new configuration starts the dead time map over when the current
+ *   range, the dead time or the switching frequency changed, and keeps
+ *   what was learned otherwise
+ * - The capture hook of mc_interface costs one check while no capture is
+ *   recording and only reads the channels of decimated samples
+ * - The ISR scheduler spreads the slower tasks over the cycles, runs them
+ *   at their rates and counts the runs over the declared cost
+ * - The online parameter estimator finds the resistance of a heated motor
+ *   and the flux linkage from the running ISR, and applies what it is
+ *   confident about. The frame of the sensorless observer is a bit off the
+ *   rotor, by more at higher current, which costs the resistance some
+ *   accuracy.
+ * - The switching frequency changes while running without upsetting the
+ *   control, a loss model is learned from the FET temperature, and the
+ *   frequency drops to the loss optimum under load and comes back at light
+ *   load
+ * - The inductance estimate is the average of Ld and Lq, from the mean and
+ *   the 2nd harmonic of the HFI samples
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+#include <time.h>
+
+// Test framework
+#define TEST_ASSERT(cond, msg) do { \
+    if (!(cond)) { \
+        printf("  FAIL: %s (line %d)\n", msg, __LINE__); \
+        test_failures++; \
+        return false; \
+    } \
+} while(0)
+
+#define RUN_TEST(test_func) do { \
+    printf("Running %s...\n", #test_func); \
+    total_tests++; \
+    if (test_func()) { \
+        printf("  PASS\n"); \
+        passed_tests++; \
+    } \
+} while(0)
+
+static int test_failures = 0;
+static int total_tests = 0;
+static int passed_tests = 0;
+
+#include "foc_hil.h"
+#include "mcpwm_foc.h"
+#include "mcconf_stub.h"
+#include "foc_stage_prof.h"
+#include "foc_isr_sched.h"
+
+#define V_BUS           24.0f
+
+static mc_configuration conf;
+static foc_hil_t hil;
+
+static double time_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void setup(float f_zv) {
+    mcconf_set_defaults(&conf);
+    conf.foc_f_zv = f_zv;
+    foc_hil_init(&hil, &conf, V_BUS);
+}
+
+static void teardown(void) {
+    mcpwm_foc_stop_pwm(false);
+    foc_hil_deinit(&hil);
+}
+
+// =============================================================================
+// Test Cases
+// =============================================================================
+
+static bool test_isr_timing(void) {
+    const float rates[] = {20000.0f, 25000.0f, 30000.0f};
+
+    for (int i = 0; i < 3; i++) {
+        setup(rates[i]);
+
+        float period = foc_hil_get_isr_period(&hil);
+        printf("  f_zv=%.0f Hz: ISR period %.3f us, Ts %.3f us\n",
+               rates[i], period * 1e6f, mcpwm_foc_get_ts() * 1e6f);
+        TEST_ASSERT(fabsf(period * rates[i] - 1.0f) < 0.001f, "ISR period matches f_zv");
+
+        foc_hil_run(&hil, 0.1f);
+        float expected = 0.1f * rates[i];
+        TEST_ASSERT(fabsf((float)hil.isr_count - expected) <= 1.0f, "ISR count over 100 ms");
+        TEST_ASSERT(foc_hil_get_fault_count() == 0, "No faults while idle");
+
+        teardown();
+    }
+
+    return true;
+}
+
+static bool test_current_control(void) {
+    setup(30000.0f);
+    foc_hil_set_inertia(&hil, 0.01f);
+
+    // Sensorless: let the observer lock before comparing frames
+    mcpwm_foc_set_current(10.0f);
+    foc_hil_run(&hil, 0.2f);
+
+    float iq = mcpwm_foc_get_iq_filter();
+    printf("  iq_set=10.0 A, firmware iq=%.2f A, model iq=%.2f A at %.0f ERPM\n",
+           iq, hil.vm.iq, virtual_motor_pc_state_get_erpm(&hil.vm));
+
+    TEST_ASSERT(foc_hil_get_fault_count() == 0, "No faults");
+    TEST_ASSERT(mcpwm_foc_get_state() == MC_STATE_RUNNING, "Running");
+    TEST_ASSERT(fabsf(iq - 10.0f) < 1.0f, "Firmware iq tracks set point");
+    TEST_ASSERT(fabsf(hil.vm.iq - 10.0f) < 2.0f, "Model iq tracks set point");
+
+    teardown();
+    return true;
+}
+
+static bool test_speed_control(void) {
+    setup(25000.0f);
+
+    const float erpm_set = 10000.0f;
+    mcpwm_foc_set_pid_speed(erpm_set);
+    foc_hil_run(&hil, 1.0f);
+
+    float erpm_fw = mcpwm_foc_get_rpm();
+    float erpm_model = virtual_motor_pc_state_get_erpm(&hil.vm);
+    printf("  set=%.0f ERPM, firmware=%.0f ERPM, model=%.0f ERPM\n",
+           erpm_set, erpm_fw, erpm_model);
+
+    TEST_ASSERT(foc_hil_get_fault_count() == 0, "No faults during spin-up");
+    TEST_ASSERT(fabsf(erpm_model - erpm_set) < 0.05f * erpm_set, "Model speed reaches set point");
+    TEST_ASSERT(fabsf(erpm_fw - erpm_model) < 0.05f * erpm_set, "Observer speed matches model");
+
+    // Load step
+    foc_hil_set_load_torque(&hil, 0.05f);
+    foc_hil_run(&hil, 0.5f);
+
+    erpm_model = virtual_motor_pc_state_get_erpm(&hil.vm);
+    printf("  with load: model=%.0f ERPM, iq=%.2f A\n", erpm_model, mcpwm_foc_get_iq_filter());
+    TEST_ASSERT(fabsf(erpm_model - erpm_set) < 0.05f * erpm_set, "Speed held under load");
+    TEST_ASSERT(mcpwm_foc_get_iq_filter() > 0.5f, "Load is carried by iq");
+
+    teardown();
+    return true;
+}
+
+static bool test_release_coast(void) {
+    setup(30000.0f);
+
+    mcpwm_foc_set_pid_speed(8000.0f);
+    foc_hil_run(&hil, 0.5f);
+    float erpm_before = virtual_motor_pc_state_get_erpm(&hil.vm);
+
+    mcpwm_foc_set_current(0.0f);
+    foc_hil_run(&hil, 0.1f);
+
+    printf("  before=%.0f ERPM, after release=%.0f ERPM, state=%d\n",
+           erpm_before, virtual_motor_pc_state_get_erpm(&hil.vm), mcpwm_foc_get_state());
+
+    TEST_ASSERT(erpm_before > 6000.0f, "Motor was spinning");
+    TEST_ASSERT(hil.outputs_floating, "Bridge floats after release");
+    TEST_ASSERT(fabsf(hil.vm.iq) < 1e-3f, "No phase current while floating");
+    TEST_ASSERT(virtual_motor_pc_state_get_erpm(&hil.vm) > 0.9f * erpm_before, "Rotor coasts");
+    TEST_ASSERT(fabsf(mcpwm_foc_get_rpm() - virtual_motor_pc_state_get_erpm(&hil.vm)) <
+                0.1f * erpm_before, "Observer keeps tracking while floating");
+
+    teardown();
+    return true;
+}
+
+static bool test_faster_than_real_time(void) {
+    setup(30000.0f);
+
+    mcpwm_foc_set_pid_speed(12000.0f);
+
+    double t0 = time_now();
+    foc_hil_run(&hil, 2.0f);
+    double wall = time_now() - t0;
+
+    printf("  2.0 s simulated (%llu ISRs) in %.1f ms wall (%.0fx real time)\n",
+           (unsigned long long)hil.isr_count, wall * 1e3, 2.0 / wall);
+
+    TEST_ASSERT(foc_hil_get_fault_count() == 0, "No faults over the drive cycle");
+    TEST_ASSERT(wall < 2.0, "Faster than real time");
+
+    teardown();
+    return true;
+}
+
+static bool test_isr_stage_profile(void) {
+    setup(30000.0f);
+
+    mcpwm_foc_set_pid_speed(8000.0f);
+    foc_hil_run(&hil, 0.2f);
+
+    foc_stage_prof_reset();
+    uint64_t isr_start = hil.isr_count;
+    foc_hil_run(&hil, 0.1f);
+    foc_stage_prof_process();
+
+    foc_stage_prof_info_t info;
+    foc_stage_prof_get_info(1, &info);
+    uint64_t isrs = hil.isr_count - isr_start;
+
+    foc_stage_stats_t total;
+    foc_stage_prof_get_stats(1, FOC_STAGE_TOTAL, &total);
+
+    printf("  %u samples of %llu ISRs, %u dropped, avg ISR %.2f us\n",
+           (unsigned int)info.samples, (unsigned long long)isrs, (unsigned int)info.dropped,
+           (double)total.sum / (double)info.samples * 1e6 / FOC_STAGE_PROF_TICKS_PER_SEC);
+
+    TEST_ASSERT(foc_stage_prof_enabled(), "Profiling is built in");
+    TEST_ASSERT(info.dropped == 0, "The timer thread keeps up with the ISR");
+    // The V7 half of each period returns early and is not recorded
+    TEST_ASSERT(fabs((double)info.samples - (double)isrs / 2.0) <= 2.0, "One sample per control period");
+    TEST_ASSERT(info.elapsed > 0 && total.sum < info.elapsed, "ISR load below 100 %");
+
+    uint64_t stage_sum = 0;
+    for (int i = 0; i < FOC_STAGE_NUM; i++) {
+        foc_stage_stats_t s;
+        foc_stage_prof_get_stats(1, i, &s);
+
+        uint64_t hist_sum = 0;
+        for (int j = 0; j < FOC_STAGE_PROF_HIST_BINS; j++) {
+            hist_sum += s.hist[j];
+        }
+
+        TEST_ASSERT(hist_sum == info.samples, "Histogram holds every sample");
+        TEST_ASSERT(s.min <= s.max, "min <= max");
+        TEST_ASSERT(s.max <= total.max, "No stage exceeds the whole ISR");
+
+        if (i != FOC_STAGE_TOTAL) {
+            stage_sum += s.sum;
+        }
+    }
+
+    foc_stage_stats_t s;
+    foc_stage_prof_get_stats(1, FOC_STAGE_OBSERVER, &s);
+    TEST_ASSERT(s.sum > 0, "Observer is timed");
+    foc_stage_prof_get_stats(1, FOC_STAGE_SVM, &s);
+    TEST_ASSERT(s.sum > 0, "SVM is timed");
+
+    // Stages are contiguous, up to the saturation of preempted samples
+    TEST_ASSERT(stage_sum <= total.sum && stage_sum > total.sum * 0.99, "Stages add up to the ISR");
+
+    foc_stage_prof_reset();
+    foc_stage_prof_get_info(1, &info);
+    TEST_ASSERT(info.samples == 0, "Reset clears the statistics");
+
+    // Records past a full ring, with the timer thread not running
+    for (int i = 0; i < FOC_STAGE_PROF_RING_LEN + 10; i++) {
+        foc_stage_prof_begin();
+        foc_stage_prof_end(1);
+    }
+    foc_stage_prof_process();
+    foc_stage_prof_get_info(1, &info);
+    TEST_ASSERT(info.dropped == 10, "Records past a full ring are dropped");
+
+    foc_stage_prof_reset();
+    foc_stage_prof_process();
+    foc_stage_prof_get_info(1, &info);
+    TEST_ASSERT(info.dropped == 0, "Reset clears the dropped count");
+
+    for (int i = 0; i < FOC_STAGE_PROF_RING_LEN + 3; i++) {
+        foc_stage_prof_begin();
+        foc_stage_prof_end(1);
+    }
+    foc_stage_prof_process();
+    foc_stage_prof_get_info(1, &info);
+    TEST_ASSERT(info.dropped == 3, "Drops are counted from the reset");
+
+    teardown();
+    return true;
+}
+
+static bool test_dt_comp_conf(void) {
+    setup(30000.0f);
+
+    // Something learned on top of the fixed model
+    foc_dt_comp_t *map = (foc_dt_comp_t*)mcpwm_foc_get_dt_comp();
+    const float err_fixed = -map->err[0][0];
+    map->err[0][0] -= 0.01f;
+
+    conf.foc_motor_r *= 1.1f;
+    mcpwm_foc_set_configuration(&conf);
+    TEST_ASSERT(fabsf(map->err[0][0] + err_fixed + 0.01f) < 1e-6f, "Other parameters keep the map");
+
+    conf.foc_dt_us *= 2.0f;
+    mcpwm_foc_set_configuration(&conf);
+    TEST_ASSERT(fabsf(map->err[0][0] + 2.0f * err_fixed) < 1e-6f, "Dead time resets the map");
+
+    conf.l_current_max *= 0.5f;
+    mcpwm_foc_set_configuration(&conf);
+    TEST_ASSERT(fabs(map->i_range - conf.l_current_max * FOC_DT_COMP_RANGE_FACTOR) < 1e-3,
+            "Current range follows l_current_max");
+
+    map->err[0][0] -= 0.01f;
+    conf.foc_f_zv = 20000.0f;
+    mcpwm_foc_set_configuration(&conf);
+    TEST_ASSERT(fabsf(map->err[0][0] + 2.0f * err_fixed * 20000.0f / 30000.0f) < 1e-6f,
+            "Switching frequency resets the map");
+
+    printf("  Fixed error %.4f, %.4f after doubling the dead time and lowering f_zv\n",
+           (double)err_fixed, (double)-map->err[0][0]);
+
+    teardown();
+    return true;
+}
+
+// Average time of the mc_interface hook per control period in ns
+static double capture_hook_ns(void) {
+    foc_stage_prof_reset();
+    foc_hil_run(&hil, 0.05f);
+    foc_stage_prof_process();
+
+    foc_stage_prof_info_t info;
+    foc_stage_prof_get_info(1, &info);
+    foc_stage_stats_t s;
+    foc_stage_prof_get_stats(1, FOC_STAGE_MC_IF, &s);
+
+    if (info.samples == 0) {
+        return 0.0;
+    }
+
+    return (double)s.sum / (double)info.samples * 1e9 / FOC_STAGE_PROF_TICKS_PER_SEC;
+}
+
+static bool test_capture_cost(void) {
+    setup(30000.0f);
+
+    mcpwm_foc_set_pid_speed(8000.0f);
+    foc_hil_run(&hil, 0.2f);
+
+    mc_capture_config cc;
+    memset(&cc, 0, sizeof(cc));
+    cc.conditions = 1 << MC_CAPTURE_COND_FAULT;
+    cc.channels = 0x3F;
+    cc.pre_samples = 256;
+    cc.post_samples = 64;
+    cc.decimation = 1;
+
+    foc_hil_capture_disarm();
+    double idle = capture_hook_ns();
+
+    TEST_ASSERT(foc_hil_capture_arm(&cc), "Capture armed");
+    double dec1 = capture_hook_ns();
+    uint32_t filled = foc_hil_capture()->filled;
+
+    cc.decimation = 8;
+    TEST_ASSERT(foc_hil_capture_arm(&cc), "Capture armed with decimation");
+    double dec8 = capture_hook_ns();
+
+    cc.decimation = 1;
+    cc.channels = 1 << DEBUG_SAMPLING_CH_CURR0;
+    TEST_ASSERT(foc_hil_capture_arm(&cc), "Capture armed with one channel");
+    double one_ch = capture_hook_ns();
+
+    foc_hil_capture_disarm();
+
+    printf("  Hook per ISR: idle %.1f ns, 6 ch %.1f ns, 6 ch / 8 %.1f ns, 1 ch %.1f ns\n",
+           idle, dec1, dec8, one_ch);
+
+    TEST_ASSERT(filled > 0, "The ISR feeds the capture");
+    TEST_ASSERT(foc_hil_capture()->state == MC_CAPTURE_IDLE, "Disarmed");
+    TEST_ASSERT(idle < dec1, "An idle capture costs less than a recording one");
+    TEST_ASSERT(dec8 < dec1, "Decimated samples skip the channel read");
+    TEST_ASSERT(foc_hil_get_fault_count() == 0, "No faults");
+
+    teardown();
+    return true;
+}
+
+static int sched_task_runs[4];
+static float sched_task_dt[4];
+
+static void sched_task(void *arg, float dt) {
+    int i = *(int*)arg;
+    sched_task_runs[i]++;
+    sched_task_dt[i] = dt;
+}
+
+static void sched_task_slow(void *arg, float dt) {
+    (void)arg;
+    (void)dt;
+    double start = time_now();
+    while (time_now() - start < 20e-6) {
+    }
+}
+
+static bool test_isr_scheduler(void) {
+    // Four tasks at the same rate take one cycle each
+    static foc_isr_sched_t sched;
+    static int arg = 0;
+    foc_isr_sched_init(&sched, 5.0f);
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT(foc_isr_sched_add(&sched, "task", sched_task, 4, 1.0f) == i, "Task added");
+        TEST_ASSERT(sched.tasks[i].phase == i, "Phases spread over the period");
+    }
+    TEST_ASSERT(foc_isr_sched_worst_slot(&sched) == foc_isr_sched_slot_cost(&sched, 0), "Even load");
+    TEST_ASSERT(foc_isr_sched_add(&sched, "task", sched_task, 3, 1.0f) == -1, "Period must be a power of two");
+
+    memset(sched_task_runs, 0, sizeof(sched_task_runs));
+    foc_isr_sched_t single;
+    foc_isr_sched_init(&single, 5.0f);
+    foc_isr_sched_add(&single, "task", sched_task, 8, 1.0f);
+    for (int i = 0; i < 80; i++) {
+        foc_isr_sched_run(&single, &arg, 1e-4f);
+    }
+    TEST_ASSERT(sched_task_runs[0] == 10 && single.tasks[0].runs == 10, "Runs every period cycles");
+    TEST_ASSERT(fabsf(sched_task_dt[0] - 8e-4f) < 1e-9f, "Gets the time since its last run");
+
+    // A task over its declared cost, and over the budget of the cycle
+    foc_isr_sched_init(&single, 10.0f);
+    foc_isr_sched_add(&single, "slow", sched_task_slow, 1, 5.0f);
+    for (int i = 0; i < 5; i++) {
+        foc_isr_sched_run(&single, 0, 1e-4f);
+    }
+    TEST_ASSERT(single.tasks[0].overruns == 5 && single.overruns == 5, "Overruns counted");
+    TEST_ASSERT(foc_isr_sched_ticks_to_us(single.max) >= 20.0f, "Longest cycle recorded");
+    foc_isr_sched_reset_stats(&single);
+    TEST_ASSERT(single.tasks[0].runs == 0 && single.overruns == 0, "Reset clears the statistics");
+
+    // The tasks of the firmware, with the map learning at low speed
+    setup(30000.0f);
+    foc_hil_set_inertia(&hil, 1.0f);
+    mcpwm_foc_set_dt_comp(true, true);
+    mcpwm_foc_set_current(10.0f);
+    foc_hil_run(&hil, 0.2f);
+
+    const foc_isr_sched_t *fw = mcpwm_foc_get_isr_sched(false);
+    printf("  %u control cycles, worst declared cycle %.2f us of %.2f us\n",
+           (unsigned int)fw->cycle, (double)foc_isr_sched_ticks_to_us(foc_isr_sched_worst_slot(fw)),
+           (double)foc_isr_sched_ticks_to_us(fw->budget));
+
+    TEST_ASSERT(foc_hil_get_fault_count() == 0, "No faults");
+    TEST_ASSERT(foc_isr_sched_worst_slot(fw) <= fw->budget, "Schedule fits the budget");
+    for (int i = 0; i < fw->task_num; i++) {
+        const foc_isr_task_t *t = &fw->tasks[i];
+        printf("  %-14s period %u phase %u, %u runs, max %.2f us\n", t->name, (unsigned int)t->period,
+               (unsigned int)t->phase, (unsigned int)t->runs, (double)foc_isr_sched_ticks_to_us(t->max));
+        TEST_ASSERT(abs((int)t->runs - (int)(fw->cycle / t->period)) <= 1, "Task runs at its rate");
+    }
+
+    const foc_dt_comp_t *map = mcpwm_foc_get_dt_comp();
+    uint32_t hits = 0;
+    for (int i = 0; i < FOC_DT_COMP_POINTS; i++) {
+        hits += map->hits[0][i];
+    }
+    printf("  %u map updates at %.0f ERPM\n", (unsigned int)hits, virtual_motor_pc_state_get_erpm(&hil.vm));
+    TEST_ASSERT(hits > 0 && hits <= fw->cycle / 2 + 1, "The map is learned at the task rate");
+
+    mcpwm_foc_set_dt_comp(false, false);
+    teardown();
+    return true;
+}
+
+static bool test_param_est(void) {
+    setup(30000.0f);
+    // The plant has no dead time
+    conf.foc_dt_us = 0.0f;
+
+    // Copper 60 degC above the configuration
+    const float r_hot = conf.foc_motor_r * (1.0f + 0.00386f * 60.0f);
+    hil.vm.R = r_hot;
+
+    // Speed control with a changing load, estimating from when the speed
+    // has settled
+    mcpwm_foc_set_pid_speed(10000.0f);
+    foc_hil_set_load_torque(&hil, 0.3f);
+    foc_hil_run(&hil, 0.3f);
+    mcpwm_foc_set_param_est(true, false);
+    for (int i = 0; i < 6; i++) {
+        foc_hil_set_load_torque(&hil, (i & 1) ? 0.8f : 0.3f);
+        foc_hil_run(&hil, 0.2f);
+        printf("  iq %.2f A\n", hil.vm.iq);
+    }
+
+    const foc_param_est_t *est = mcpwm_foc_get_param_est();
+    const float truth[FOC_PARAM_EST_NUM] = {r_hot, hil.vm.ld, hil.vm.lq, hil.vm.lambda, 0.0f};
+    const char *names[FOC_PARAM_EST_NUM] = {"R", "Ld", "Lq", "lambda", "lambda_q"};
+    printf("  %u samples, %u dropped, at %.0f ERPM\n", (unsigned int)est->updates,
+           (unsigned int)mcpwm_foc_get_param_est_dropped(), virtual_motor_pc_state_get_erpm(&hil.vm));
+    for (int i = 0; i < FOC_PARAM_EST_NUM; i++) {
+        float bound;
+        float v = foc_param_est_get(est, i, &bound);
+        printf("  %-8s true %.4g, configured %.4g, estimate %.4g +- %.2g\n", names[i],
+               (double)truth[i], (double)est->scale[i], (double)v, (double)bound);
+    }
+
+    float bound;
+    float r = foc_param_est_get(est, FOC_PARAM_EST_R, &bound);
+    TEST_ASSERT(foc_hil_get_fault_count() == 0, "No faults");
+    TEST_ASSERT(mcpwm_foc_get_param_est_dropped() == 0, "The timer thread keeps up with the ISR");
+    TEST_ASSERT(fabsf(r - r_hot) < 0.15f * r_hot, "Resistance of the heated motor");
+    TEST_ASSERT(fabsf(r - r_hot) < bound, "Resistance within its bound");
+    float lambda = foc_param_est_get(est, FOC_PARAM_EST_LAMBDA, &bound);
+    TEST_ASSERT(fabsf(lambda - hil.vm.lambda) < 0.03f * hil.vm.lambda, "Flux linkage");
+    TEST_ASSERT(bound < 0.01f * hil.vm.lambda, "Flux linkage confident");
+    foc_param_est_point point;
+    TEST_ASSERT(!mcpwm_foc_get_param_est_applied(&point), "Not applied when only estimating");
+
+    mcpwm_foc_set_param_est(true, true);
+    foc_hil_run(&hil, 0.1f);
+    TEST_ASSERT(mcpwm_foc_get_param_est_applied(&point), "Applied");
+    const foc_param_est_point *applied = &point;
+    printf("  applied R %.4g, ki %.4g of %.4g\n", (double)applied->r, (double)applied->ki,
+           (double)conf.foc_current_ki);
+    // The resistance is only used once it is confident enough
+    TEST_ASSERT(fabsf(applied->lambda - hil.vm.lambda) < 0.03f * hil.vm.lambda,
+                "The observer uses the estimated flux linkage");
+    TEST_ASSERT(applied->r == conf.foc_motor_r || fabsf(applied->r - r_hot) < 0.15f * r_hot,
+                "Resistance either configured or estimated");
+    TEST_ASSERT(fabsf(applied->ki - conf.foc_current_ki * applied->r / conf.foc_motor_r) <
+                1e-3f * conf.foc_current_ki, "Integral gain follows the resistance");
+    TEST_ASSERT(mcpwm_foc_get_state() == MC_STATE_RUNNING && foc_hil_get_fault_count() == 0,
+            "Still running with the applied parameters");
+
+    mcpwm_foc_set_param_est(false, false);
+    teardown();
+    return true;
+}
+
+// Inverter losses in the form of the model in foc_fsw_adapt.h, heating the
+// FETs through a first order thermal model
+#define FSW_K_COND      3e-3f   // [Ohm]
+#define FSW_K_SW        1.3e-7f // [J / (V * A)]
+#define FSW_R_TH        5.0f    // [degC / W]
+#define FSW_TAU         2.0f    // [s]
+#define FSW_T_AMB       25.0f
+
+static float fsw_loss(float i_abs, float f, float temp) {
+    const float ripple = V_BUS / (2.0f * conf.foc_motor_l * f);
+    return FSW_K_COND * (1.0f + 0.005f * (temp - 25.0f)) * (i_abs * i_abs + ripple * ripple / 12.0f) +
+            FSW_K_SW * V_BUS * i_abs * f;
+}
+
+static float fsw_optimum(float i_abs, float temp) {
+    const float ripple_f = V_BUS / (2.0f * conf.foc_motor_l);
+    return cbrtf(FSW_K_COND * (1.0f + 0.005f * (temp - 25.0f)) * ripple_f * ripple_f /
+            (6.0f * FSW_K_SW * V_BUS * i_abs));
+}
+
+static void run_thermal(float seconds) {
+    for (float t = 0.0f; t < seconds; t += 0.01f) {
+        foc_hil_run(&hil, 0.01f);
+        const float i_abs = sqrtf(hil.vm.id * hil.vm.id + hil.vm.iq * hil.vm.iq);
+        const float f = 1.0f / foc_hil_get_isr_period(&hil);
+        const float t_ss = FSW_T_AMB + FSW_R_TH * fsw_loss(i_abs, f, hil.temp_fet);
+        hil.temp_fet += (t_ss - hil.temp_fet) * 0.01f / FSW_TAU;
+    }
+}
+
+static bool test_fsw_adapt(void) {
+    const float f_max = 25000.0f;
+
+    setup(30000.0f);
+    hil.temp_fet = FSW_T_AMB;
+    mcpwm_foc_set_pid_speed(10000.0f);
+    foc_hil_set_load_torque(&hil, 0.05f);
+    run_thermal(1.0f);
+    const float erpm_before = virtual_motor_pc_state_get_erpm(&hil.vm);
+
+    // Without a model it runs at f_max, which is switched to while running
+    TEST_ASSERT(mcpwm_foc_set_fsw_adapt(true, 0.0f, f_max), "Supported");
+    run_thermal(0.1f);
+    printf("  ISR period %.2f us, %.0f ERPM before, %.0f ERPM after\n",
+           (double)(foc_hil_get_isr_period(&hil) * 1e6f), (double)erpm_before,
+           (double)virtual_motor_pc_state_get_erpm(&hil.vm));
+    TEST_ASSERT(fabsf(foc_hil_get_isr_period(&hil) * f_max - 1.0f) < 0.001f, "At f_max without a model");
+    TEST_ASSERT(mcpwm_foc_get_switching_frequency_now() == f_max, "The control uses the new frequency");
+    TEST_ASSERT(fabsf(virtual_motor_pc_state_get_erpm(&hil.vm) - erpm_before) < 500.0f, "Speed held over the change");
+
+    // Learning while the load changes
+    for (int i = 0; i < 16; i++) {
+        foc_hil_set_load_torque(&hil, (i & 1) ? 0.05f : (1.0f + 0.5f * (float)(i % 5)));
+        run_thermal(3.0f);
+    }
+
+    const foc_fsw_adapt_t *fa = mcpwm_foc_get_fsw_model();
+    printf("  %u updates, t_amb %.1f, k_cond %.2f, k_sw %.2f degC\n", (unsigned int)fa->updates,
+           (double)fa->theta[0], (double)fa->theta[1], (double)fa->theta[2]);
+    TEST_ASSERT(foc_fsw_adapt_model_valid(fa), "Loss model learned");
+
+    // Heavy load
+    foc_hil_set_load_torque(&hil, 2.0f);
+    run_thermal(2.0f);
+    float i_abs = sqrtf(hil.vm.id * hil.vm.id + hil.vm.iq * hil.vm.iq);
+    float f = mcpwm_foc_get_switching_frequency_now();
+    float f_opt = fsw_optimum(i_abs, hil.temp_fet);
+    printf("  %.1f A, %.0f degC: %.0f Hz (optimum %.0f Hz), %.0f ERPM\n", (double)i_abs,
+           (double)hil.temp_fet, (double)f, (double)f_opt, (double)virtual_motor_pc_state_get_erpm(&hil.vm));
+    TEST_ASSERT(f < 0.9f * f_max, "Lower frequency under load");
+    TEST_ASSERT(fabsf(f - f_opt) < 0.15f * f_opt, "Close to the loss optimum");
+    TEST_ASSERT(fsw_loss(i_abs, f, hil.temp_fet) < fsw_loss(i_abs, f_max, hil.temp_fet), "Lower losses than at f_max");
+    TEST_ASSERT(fabsf(virtual_motor_pc_state_get_erpm(&hil.vm) - 10000.0f) < 1000.0f, "Speed held");
+
+    // Light load
+    foc_hil_set_load_torque(&hil, 0.02f);
+    run_thermal(2.0f);
+    f = mcpwm_foc_get_switching_frequency_now();
+    printf("  light load: %.0f Hz\n", (double)f);
+    TEST_ASSERT(f == f_max, "Back at f_max at light load");
+
+    mcpwm_foc_set_fsw_adapt(false, 0.0f, 0.0f);
+    run_thermal(0.1f);
+    TEST_ASSERT(fabsf(foc_hil_get_isr_period(&hil) * 30000.0f - 1.0f) < 0.001f, "Back at foc_f_zv when disabled");
+    TEST_ASSERT(mcpwm_foc_get_state() == MC_STATE_RUNNING && foc_hil_get_fault_count() == 0,
+            "Running without faults");
+
+    teardown();
+    return true;
+}
+
+static bool test_est_ind(void) {
+    setup(30000.0f);
+
+    // HFI samples of a rotor with Ld = 10 uH and Lq = 15 uH, which see the
+    // inverse inductance with the 2nd harmonic of the injection angle
+    const float ld = 10e-6f, lq = 15e-6f;
+    const float offset = (1.0f / ld + 1.0f / lq) / 2.0f;
+    const float amplitude = (1.0f / ld - 1.0f / lq) / 2.0f;
+
+    hfi_state_t *hfi = (hfi_state_t*)mcpwm_foc_get_hfi_state();
+    const int n = hfi->samples;
+    for (int i = 0; i < n; i++) {
+        hfi->buffer[i] = offset + amplitude * cosf(2.0f * 2.0f * (float)M_PI * (float)i / (float)n);
+    }
+
+    float ind = mcpwm_foc_get_est_ind();
+    printf("  %d samples: %.3f uH, average of Ld and Lq %.3f uH\n",
+           n, (double)ind * 1e6, (double)(ld + lq) / 2.0 * 1e6);
+    TEST_ASSERT(n > 4, "HFI DFT set up");
+    TEST_ASSERT(fabsf(ind - (ld + lq) / 2.0f) < 1e-9f, "Average of Ld and Lq from bins 0 and 2");
+
+    teardown();
+    return true;
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+int main(void) {
+    printf("========================================\n");
+    printf("FOC Hardware-in-the-Loop Tests\n");
+    printf("========================================\n\n");
+
+    RUN_TEST(test_isr_timing);
+    RUN_TEST(test_current_control);
+    RUN_TEST(test_speed_control);
+    RUN_TEST(test_release_coast);
+    RUN_TEST(test_faster_than_real_time);
+    RUN_TEST(test_isr_stage_profile);
+    RUN_TEST(test_dt_comp_conf);
+    RUN_TEST(test_capture_cost);
+    RUN_TEST(test_isr_scheduler);
+    RUN_TEST(test_param_est);
+    RUN_TEST(test_fsw_adapt);
+    RUN_TEST(test_est_ind);
+
+    printf("\n========================================\n");
+    printf("Total: %d, Passed: %d, Failed: %d\n", total_tests, passed_tests, total_tests - passed_tests);
+    printf("========================================\n");
+
+    return (passed_tests == total_tests) ? 0 : 1;
+}
@@ -0,0 +1,280 @@
+/**
+ * @file test_foc_motor_lut.c
+ * @brief Unit tests for the saturation-aware motor model (motor/foc_motor_lut.c)
+ *
+ * Validates:
+ * - Stored tables survive quantization and corrupted tables are rejected
+ * - Bilinear interpolation, edge clamping and iq symmetry of the lookup
+ * - Current controller gains follow the local inductance
+ * - The inductance probe measures the incremental inductance of a
+ *   saturating RL plant while a PI controller holds the bias current
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+
+// Test framework
+#define TEST_ASSERT(cond, msg) do { \
+    if (!(cond)) { \
+        printf("  FAIL: %s (line %d)\n", msg, __LINE__); \
+        test_failures++; \
+        return false; \
+    } \
+} while(0)
+
+#define RUN_TEST(test_func) do { \
+    printf("Running %s...\n", #test_func); \
+    total_tests++; \
+    if (test_func()) { \
+        printf("  PASS\n"); \
+        passed_tests++; \
+    } \
+} while(0)
+
+static int test_failures = 0;
+static int total_tests = 0;
+static int passed_tests = 0;
+
+#include "foc_motor_lut.h"
+#include "../motor_sim/mcconf_stub.h"
+
+#define I_MAX           100.0f
+#define L0              100e-6f     // Unsaturated inductance [H]
+#define I_SAT           60.0f       // Current where the incremental inductance halves [A]
+#define LAMBDA          0.01f
+#define DT              (1.0f / 30000.0f)
+
+typedef float lut_table[MOTOR_LUT_ID_POINTS][MOTOR_LUT_IQ_POINTS];
+
+// A table that is bilinear in id and |iq|, so interpolation reproduces it exactly
+static float model_ld(float id, float iq) {
+    return L0 * (1.0f + 0.004f * id - 0.002f * fabsf(iq) - 1e-5f * id * fabsf(iq));
+}
+
+static float model_lq(float id, float iq) {
+    return 1.5f * L0 * (1.0f + 0.001f * id - 0.004f * fabsf(iq));
+}
+
+static float model_lambda(float id, float iq) {
+    return LAMBDA * (1.0f + 0.001f * id - 0.0005f * fabsf(iq));
+}
+
+static void fill_tables(lut_table ld, lut_table lq, lut_table lambda) {
+    for (int i = 0; i < MOTOR_LUT_ID_POINTS; i++) {
+        for (int j = 0; j < MOTOR_LUT_IQ_POINTS; j++) {
+            const float id = foc_motor_lut_grid_id(I_MAX, i);
+            const float iq = foc_motor_lut_grid_iq(I_MAX, j);
+            ld[i][j] = model_ld(id, iq);
+            lq[i][j] = model_lq(id, iq);
+            lambda[i][j] = model_lambda(id, iq);
+        }
+    }
+}
+
+static bool rel_close(float a, float b, float tol) {
+    return fabsf(a - b) <= tol * fabsf(b);
+}
+
+// =============================================================================
+// Test Cases
+// =============================================================================
+
+static bool test_pack_check(void) {
+    lut_table ld, lq, lambda;
+    fill_tables(ld, lq, lambda);
+
+    motor_lut_data data;
+    foc_motor_lut_pack(&data, I_MAX, ld, lq, lambda);
+    TEST_ASSERT(foc_motor_lut_check(&data), "Packed table is valid");
+
+    for (int i = 0; i < MOTOR_LUT_ID_POINTS; i++) {
+        for (int j = 0; j < MOTOR_LUT_IQ_POINTS; j++) {
+            TEST_ASSERT(rel_close((float)data.ld[i][j] * data.l_scale, ld[i][j], 1e-3f), "Ld quantization");
+            TEST_ASSERT(rel_close((float)data.lq[i][j] * data.l_scale, lq[i][j], 1e-3f), "Lq quantization");
+            TEST_ASSERT(rel_close((float)data.lambda[i][j] * data.lambda_scale, lambda[i][j], 1e-3f),
+                        "Lambda quantization");
+        }
+    }
+
+    motor_lut_data bad = data;
+    bad.lq[2][3]++;
+    TEST_ASSERT(!foc_motor_lut_check(&bad), "Corrupted table rejected");
+
+    memset(&bad, 0, sizeof(bad));
+    TEST_ASSERT(!foc_motor_lut_check(&bad), "Cleared table rejected");
+
+    bad = data;
+    bad.init_flag = 0;
+    TEST_ASSERT(!foc_motor_lut_check(&bad), "Table without init flag rejected");
+
+    return true;
+}
+
+static bool test_lookup(void) {
+    static mc_configuration conf;
+    mcconf_set_defaults(&conf);
+
+    lut_table ld, lq, lambda;
+    fill_tables(ld, lq, lambda);
+    motor_lut_data data;
+    foc_motor_lut_pack(&data, I_MAX, ld, lq, lambda);
+
+    foc_motor_lut_t lut;
+    foc_motor_lut_precalc(&lut, &data, &conf);
+    TEST_ASSERT(lut.valid, "Table enabled");
+
+    // Inside the grid, including points between grid lines
+    foc_motor_lut_point p;
+    for (float id = -I_MAX; id <= 0.0f; id += 7.3f) {
+        for (float iq = -I_MAX; iq <= I_MAX; iq += 11.1f) {
+            foc_motor_lut_lookup(&lut, id, iq, &p);
+            TEST_ASSERT(rel_close(p.ld, model_ld(id, iq), 1e-3f), "Ld interpolation");
+            TEST_ASSERT(rel_close(p.lq, model_lq(id, iq), 1e-3f), "Lq interpolation");
+            TEST_ASSERT(rel_close(p.lambda, model_lambda(id, iq), 1e-3f), "Lambda interpolation");
+        }
+    }
+
+    // Outside the grid the edge is used
+    foc_motor_lut_point edge;
+    foc_motor_lut_lookup(&lut, 0.0f, I_MAX, &edge);
+    foc_motor_lut_lookup(&lut, 20.0f, 3.0f * I_MAX, &p);
+    TEST_ASSERT(p.ld == edge.ld && p.lq == edge.lq, "Clamped above id = 0 and iq = i_max");
+
+    foc_motor_lut_lookup(&lut, -I_MAX, 0.0f, &edge);
+    foc_motor_lut_lookup(&lut, -2.0f * I_MAX, 0.0f, &p);
+    TEST_ASSERT(p.ld == edge.ld && p.lq == edge.lq, "Clamped below id = -i_max");
+
+    // Negative iq is the same operating point
+    foc_motor_lut_point neg;
+    foc_motor_lut_lookup(&lut, -30.0f, 42.0f, &p);
+    foc_motor_lut_lookup(&lut, -30.0f, -42.0f, &neg);
+    TEST_ASSERT(p.ld == neg.ld && p.lq == neg.lq && p.lambda == neg.lambda, "Symmetric in iq");
+
+    return true;
+}
+
+static bool test_precalc_gains(void) {
+    static mc_configuration conf;
+    mcconf_set_defaults(&conf);
+
+    lut_table ld, lq, lambda;
+    fill_tables(ld, lq, lambda);
+    motor_lut_data data;
+    foc_motor_lut_pack(&data, I_MAX, ld, lq, lambda);
+
+    foc_motor_lut_t lut;
+    foc_motor_lut_precalc(&lut, &data, &conf);
+
+    foc_motor_lut_point p;
+    foc_motor_lut_lookup(&lut, -55.0f, 63.0f, &p);
+    const float kp_per_l = conf.foc_current_kp / conf.foc_motor_l;
+    TEST_ASSERT(rel_close(p.kp_d, kp_per_l * p.ld, 1e-4f), "D axis gain scales with Ld");
+    TEST_ASSERT(rel_close(p.kp_q, kp_per_l * p.lq, 1e-4f), "Q axis gain scales with Lq");
+
+    // A table at the configured inductance keeps the configured gain
+    for (int i = 0; i < MOTOR_LUT_ID_POINTS; i++) {
+        for (int j = 0; j < MOTOR_LUT_IQ_POINTS; j++) {
+            ld[i][j] = conf.foc_motor_l;
+            lq[i][j] = conf.foc_motor_l;
+        }
+    }
+    foc_motor_lut_pack(&data, I_MAX, ld, lq, lambda);
+    foc_motor_lut_precalc(&lut, &data, &conf);
+    foc_motor_lut_lookup(&lut, -10.0f, 10.0f, &p);
+    TEST_ASSERT(rel_close(p.kp_d, conf.foc_current_kp, 1e-3f), "Nominal d axis gain");
+    TEST_ASSERT(rel_close(p.kp_q, conf.foc_current_kp, 1e-3f), "Nominal q axis gain");
+
+    // Invalid data leaves the table disabled
+    memset(&data, 0, sizeof(data));
+    foc_motor_lut_precalc(&lut, &data, &conf);
+    TEST_ASSERT(!lut.valid, "Invalid table disabled");
+
+    return true;
+}
+
+// Saturating inductor, flux psi = L0 * I_SAT * atan(i / I_SAT)
+static float plant_current(float psi) {
+    return I_SAT * tanf(psi / (L0 * I_SAT));
+}
+
+static float plant_l_inc(float i) {
+    return L0 / (1.0f + (i / I_SAT) * (i / I_SAT));
+}
+
+// Hold i_bias with a PI controller and probe the inductance
+static bool probe_at(float i_bias, float *l_meas) {
+    const float R = 0.02f;
+    const float bw = 3000.0f;
+    const float kp = bw * L0;
+    const float ki = bw * R;
+    const int substeps = 10;
+
+    float psi = L0 * I_SAT * atanf(i_bias / I_SAT);
+    float i = i_bias;
+    float v = R * i_bias;
+    float v_int = v;
+
+    foc_motor_lut_probe_t probe;
+    const float v_inj = 0.05f * I_MAX * L0 / (4.0f * DT);
+    foc_motor_lut_probe_start(&probe, v_inj, 4, 1);
+
+    for (int k = 0; k < 100000 && foc_motor_lut_probe_samples(&probe) < 3000; k++) {
+        // Same order as control_current: probe on the voltage of the last period
+        const float inj = foc_motor_lut_probe_step(&probe, i, v, DT);
+
+        const float err = i_bias - i;
+        v_int += ki * err * DT;
+        v = v_int + kp * err + inj;
+
+        for (int s = 0; s < substeps; s++) {
+            psi += (v - R * plant_current(psi)) * DT / (float)substeps;
+        }
+        i = plant_current(psi);
+    }
+
+    return foc_motor_lut_probe_result(&probe, l_meas);
+}
+
+static bool test_probe(void) {
+    const float bias[] = {0.0f, 30.0f, 60.0f, 90.0f};
+
+    for (unsigned int n = 0; n < sizeof(bias) / sizeof(bias[0]); n++) {
+        float l = 0.0f;
+        TEST_ASSERT(probe_at(bias[n], &l), "Probe result");
+        const float l_true = plant_l_inc(bias[n]);
+        printf("    bias %5.1f A: L %6.2f uH, true %6.2f uH\n", bias[n], l * 1e6f, l_true * 1e6f);
+        TEST_ASSERT(rel_close(l, l_true, 0.03f), "Incremental inductance within 3 %");
+    }
+
+    // Nothing collected yet
+    foc_motor_lut_probe_t probe;
+    foc_motor_lut_probe_start(&probe, 1.0f, 4, 1);
+    float l;
+    TEST_ASSERT(!foc_motor_lut_probe_result(&probe, &l), "No result without samples");
+
+    return true;
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+int main(void) {
+    printf("========================================\n");
+    printf("Motor Model Table Tests\n");
+    printf("========================================\n\n");
+
+    RUN_TEST(test_pack_check);
+    RUN_TEST(test_lookup);
+    RUN_TEST(test_precalc_gains);
+    RUN_TEST(test_probe);
+
+    printf("\n========================================\n");
+    printf("Total: %d, Passed: %d, Failed: %d\n", total_tests, passed_tests, test_failures);
+    printf("========================================\n");
+
+    return test_failures > 0 ? 1 : 0;
+}
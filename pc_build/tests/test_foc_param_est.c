@@ -0,0 +1,286 @@
+/**
+ * @file test_foc_param_est.c
+ * @brief Online estimation of R, Ld, Lq and the flux linkage (motor/foc_param_est.c)
+ *
+ * The samples come from the exact motor equations at random operating
+ * points, with noise on the voltage. Each sample is built the way the ISR
+ * builds it: the currents at both ends of a control period and the
+ * voltage, in the rotor frames the current controller uses.
+ *
+ * Validates:
+ * - The ring hands the samples over in order and drops them when full
+ * - All four parameters and the flux on the q axis of a frame that is a
+ *   bit off the rotor converge from 25 % off, and the truth is within the
+ *   confidence bounds
+ * - A resistance rise like from heating is followed
+ * - Ld keeps a wide bound when id never changes, while the excited
+ *   parameters converge
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+
+// Test framework
+#define TEST_ASSERT(cond, msg) do { \
+    if (!(cond)) { \
+        printf("  FAIL: %s (line %d)\n", msg, __LINE__); \
+        test_failures++; \
+        return false; \
+    } \
+} while(0)
+
+#define RUN_TEST(test_func) do { \
+    printf("Running %s...\n", #test_func); \
+    total_tests++; \
+    if (test_func()) { \
+        printf("  PASS\n"); \
+        passed_tests++; \
+    } \
+} while(0)
+
+static int test_failures = 0;
+static int total_tests = 0;
+static int passed_tests = 0;
+
+#include "foc_param_est.h"
+
+#define R_TRUE          0.030f
+#define LD_TRUE         40e-6f
+#define LQ_TRUE         60e-6f
+#define LAMBDA_TRUE     8e-3f
+#define LAMBDA_Q_TRUE   0.4e-3f // Frame 50 mrad off the rotor
+#define SAMPLE_DT       (1.0f / 15000.0f)
+#define V_NOISE         0.02f   // Standard deviation of the voltage noise [V]
+#define FORGET          0.9998f // PARAM_EST_FORGET in mcpwm_foc.c
+#define SAMPLES         20000
+
+static const char *names[FOC_PARAM_EST_NUM] = {"R", "Ld", "Lq", "lambda", "lambda_q"};
+
+typedef struct {
+    float r, ld, lq, lambda, lambda_q;
+} motor_t;
+
+static float rand_uniform(float lo, float hi) {
+    return lo + (hi - lo) * ((float)rand() / (float)RAND_MAX);
+}
+
+static float rand_normal(float sigma) {
+    float u1 = rand_uniform(1e-6f, 1.0f);
+    float u2 = rand_uniform(0.0f, 1.0f);
+    return sigma * sqrtf(-2.0f * logf(u1)) * cosf(2.0f * (float)M_PI * u2);
+}
+
+// A period from id0, iq0 to id1, iq1 at speed we, with the currents in the
+// rotor frame at their sampling instants. The ISR sees them in the frame
+// half a period later, like the voltage, which the model gives at the
+// middle of the period.
+static foc_param_est_sample_t make_sample(const motor_t *m, float id0, float iq0,
+        float id1, float iq1, float we) {
+    foc_param_est_sample_t s;
+    const float half = 0.5f * we * SAMPLE_DT;
+    const float c = cosf(half);
+    const float sn = sinf(half);
+    s.id0 = c * id0 + sn * iq0;
+    s.iq0 = c * iq0 - sn * id0;
+    s.id1 = c * id1 + sn * iq1;
+    s.iq1 = c * iq1 - sn * id1;
+    s.we = we;
+    s.dt = SAMPLE_DT;
+
+    const float id = 0.5f * (id0 + id1);
+    const float iq = 0.5f * (iq0 + iq1);
+    const float did = (id1 - id0) / SAMPLE_DT;
+    const float diq = (iq1 - iq0) / SAMPLE_DT;
+    s.vd = m->r * id + m->ld * did - we * (m->lq * iq + m->lambda_q) + rand_normal(V_NOISE);
+    s.vq = m->r * iq + m->lq * diq + we * (m->ld * id + m->lambda) + rand_normal(V_NOISE);
+    return s;
+}
+
+// Operating points like a drive cycle: varying torque with MTPA d current,
+// current ripple from the controller and changing speed
+static foc_param_est_sample_t drive_sample(const motor_t *m, bool excite_d) {
+    const float iq = rand_uniform(-40.0f, 40.0f);
+    const float id = excite_d ? -0.3f * fabsf(iq) : 0.0f;
+    const float ripple_d = excite_d ? rand_uniform(-1.0f, 1.0f) : 0.0f;
+    const float ripple_q = rand_uniform(-1.0f, 1.0f);
+    const float we = rand_uniform(-3000.0f, 3000.0f);
+    return make_sample(m, id - ripple_d, iq - ripple_q, id + ripple_d, iq + ripple_q, we);
+}
+
+static void get_truth(const motor_t *m, float *truth, float *ref) {
+    truth[FOC_PARAM_EST_R] = m->r;
+    truth[FOC_PARAM_EST_LD] = m->ld;
+    truth[FOC_PARAM_EST_LQ] = m->lq;
+    truth[FOC_PARAM_EST_LAMBDA] = m->lambda;
+    truth[FOC_PARAM_EST_LAMBDA_Q] = m->lambda_q;
+
+    // Errors relative to the parameter, and to lambda for lambda_q
+    for (int i = 0; i < FOC_PARAM_EST_NUM; i++) {
+        ref[i] = truth[i];
+    }
+    ref[FOC_PARAM_EST_LAMBDA_Q] = m->lambda;
+}
+
+static void print_est(const foc_param_est_t *est, const motor_t *m) {
+    float truth[FOC_PARAM_EST_NUM], ref[FOC_PARAM_EST_NUM];
+    get_truth(m, truth, ref);
+    for (int i = 0; i < FOC_PARAM_EST_NUM; i++) {
+        float bound;
+        float v = foc_param_est_get(est, i, &bound);
+        printf("  %-8s true %.4g, estimate %.4g +- %.2g (%.2f %%)\n", names[i],
+               (double)truth[i], (double)v, (double)bound,
+               (double)(100.0f * (v - truth[i]) / ref[i]));
+    }
+}
+
+// =============================================================================
+// Test Cases
+// =============================================================================
+
+static bool test_ring(void) {
+    static foc_param_est_ring_t ring;
+    memset(&ring, 0, sizeof(ring));
+
+    foc_param_est_sample_t s;
+    memset(&s, 0, sizeof(s));
+    for (int i = 0; i < FOC_PARAM_EST_RING_LEN + 3; i++) {
+        s.we = (float)i;
+        bool pushed = foc_param_est_ring_push(&ring, &s);
+        TEST_ASSERT(pushed == (i < FOC_PARAM_EST_RING_LEN), "Push until full");
+    }
+    TEST_ASSERT(ring.dropped == 3, "Samples over the length dropped");
+
+    for (int i = 0; i < FOC_PARAM_EST_RING_LEN; i++) {
+        TEST_ASSERT(foc_param_est_ring_pop(&ring, &s), "Pop");
+        TEST_ASSERT(s.we == (float)i, "In order");
+    }
+    TEST_ASSERT(!foc_param_est_ring_pop(&ring, &s), "Empty");
+
+    foc_param_est_ring_push(&ring, &s);
+    foc_param_est_ring_reset(&ring);
+    TEST_ASSERT(!foc_param_est_ring_pop(&ring, &s), "Reset empties the ring");
+    TEST_ASSERT(ring.dropped == 3 && foc_param_est_ring_dropped(&ring) == 0,
+                "Reset restarts the dropped count without writing it");
+
+    return true;
+}
+
+static bool test_converge(void) {
+    srand(1);
+    const motor_t m = {R_TRUE, LD_TRUE, LQ_TRUE, LAMBDA_TRUE, LAMBDA_Q_TRUE};
+    static foc_param_est_t est;
+    foc_param_est_init(&est, R_TRUE * 1.25f, LD_TRUE * 0.75f, LQ_TRUE * 1.25f, LAMBDA_TRUE * 0.75f,
+            FORGET, 1.0f);
+
+    for (int i = 0; i < SAMPLES; i++) {
+        foc_param_est_sample_t s = drive_sample(&m, true);
+        foc_param_est_update(&est, &s);
+    }
+
+    print_est(&est, &m);
+    TEST_ASSERT(est.updates == SAMPLES, "Every sample counted");
+
+    float truth[FOC_PARAM_EST_NUM], ref[FOC_PARAM_EST_NUM];
+    get_truth(&m, truth, ref);
+    for (int i = 0; i < FOC_PARAM_EST_NUM; i++) {
+        float bound;
+        float v = foc_param_est_get(&est, i, &bound);
+        TEST_ASSERT(fabsf(v - truth[i]) < 0.02f * ref[i], "Within 2 %");
+        TEST_ASSERT(fabsf(v - truth[i]) < bound, "Truth within the bound");
+        TEST_ASSERT(bound < 0.05f * ref[i], "Bound tight with excitation");
+    }
+
+    return true;
+}
+
+static bool test_track_resistance(void) {
+    srand(2);
+    motor_t m = {R_TRUE, LD_TRUE, LQ_TRUE, LAMBDA_TRUE, LAMBDA_Q_TRUE};
+    static foc_param_est_t est;
+    foc_param_est_init(&est, R_TRUE, LD_TRUE, LQ_TRUE, LAMBDA_TRUE, FORGET, 1.0f);
+
+    for (int i = 0; i < SAMPLES; i++) {
+        foc_param_est_sample_t s = drive_sample(&m, true);
+        foc_param_est_update(&est, &s);
+    }
+
+    // Copper from 25 to 105 degC, then held
+    for (int i = 0; i < 2 * SAMPLES; i++) {
+        float heat = i < SAMPLES ? (float)i / (float)SAMPLES : 1.0f;
+        m.r = R_TRUE * (1.0f + 0.00386f * 80.0f * heat);
+        foc_param_est_sample_t s = drive_sample(&m, true);
+        foc_param_est_update(&est, &s);
+    }
+
+    print_est(&est, &m);
+    float bound;
+    float r = foc_param_est_get(&est, FOC_PARAM_EST_R, &bound);
+    TEST_ASSERT(fabsf(r - m.r) < 0.02f * m.r, "Resistance follows the heating");
+    TEST_ASSERT(fabsf(foc_param_est_get(&est, FOC_PARAM_EST_LAMBDA, 0) - LAMBDA_TRUE) < 0.02f * LAMBDA_TRUE,
+            "Flux linkage unaffected");
+
+    return true;
+}
+
+static bool test_unexcited_bound(void) {
+    srand(3);
+    const motor_t m = {R_TRUE, LD_TRUE, LQ_TRUE, LAMBDA_TRUE, LAMBDA_Q_TRUE};
+    static foc_param_est_t est;
+    foc_param_est_init(&est, R_TRUE * 1.25f, LD_TRUE * 0.75f, LQ_TRUE * 1.25f, LAMBDA_TRUE * 0.75f,
+            FORGET, 1.0f);
+
+    for (int i = 0; i < SAMPLES; i++) {
+        foc_param_est_sample_t s = drive_sample(&m, false);
+        foc_param_est_update(&est, &s);
+    }
+
+    print_est(&est, &m);
+
+    float bound;
+    float ld = foc_param_est_get(&est, FOC_PARAM_EST_LD, &bound);
+    TEST_ASSERT(bound > 0.5f * LD_TRUE, "Ld stays uncertain without d current");
+    TEST_ASSERT(fabsf(ld - LD_TRUE * 0.75f) < 0.01f * LD_TRUE, "Ld stays where it started");
+
+    float truth[FOC_PARAM_EST_NUM], ref[FOC_PARAM_EST_NUM];
+    get_truth(&m, truth, ref);
+    for (int i = 0; i < FOC_PARAM_EST_NUM; i++) {
+        if (i == FOC_PARAM_EST_LD) {
+            continue;
+        }
+        float v = foc_param_est_get(&est, i, &bound);
+        TEST_ASSERT(fabsf(v - truth[i]) < 0.02f * ref[i], "Excited parameters converge");
+        TEST_ASSERT(bound < 0.05f * ref[i], "and are confident");
+    }
+
+    for (int i = 0; i < FOC_PARAM_EST_NUM; i++) {
+        for (int j = 0; j < FOC_PARAM_EST_NUM; j++) {
+            TEST_ASSERT(isfinite(est.P[i][j]) && fabsf(est.P[i][j]) <= 4.0f, "Covariance bounded");
+        }
+    }
+
+    return true;
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+int main(void) {
+    printf("========================================\n");
+    printf("Online Parameter Estimation Tests\n");
+    printf("========================================\n\n");
+
+    RUN_TEST(test_ring);
+    RUN_TEST(test_converge);
+    RUN_TEST(test_track_resistance);
+    RUN_TEST(test_unexcited_bound);
+
+    printf("\n========================================\n");
+    printf("Total: %d, Passed: %d, Failed: %d\n", total_tests, passed_tests, test_failures);
+    printf("========================================\n");
+
+    return test_failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,310 @@
+/**
+ * @file test_inverter_model.c
+ * @brief Tests for the inverter and PWM plant model
+ *
+ * Validates:
+ * - Averaged mode applies the Clarke transform of the duties
+ * - Switching mode has the same period average, plus current ripple
+ * - Dead-time voltage loss against the analytic value, in both modes
+ * - Phase-shunt saturation of the sampled currents
+ * - Closed-loop current control through the inverter
+ * - Throughput of averaged vs switching mode
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+#include <time.h>
+
+// Test framework
+#define TEST_ASSERT(cond, msg) do { \
+    if (!(cond)) { \
+        printf("  FAIL: %s (line %d)\n", msg, __LINE__); \
+        test_failures++; \
+        return false; \
+    } \
+} while(0)
+
+#define RUN_TEST(test_func) do { \
+    printf("Running %s...\n", #test_func); \
+    total_tests++; \
+    if (test_func()) { \
+        printf("  PASS\n"); \
+        passed_tests++; \
+    } \
+} while(0)
+
+static int test_failures = 0;
+static int total_tests = 0;
+static int passed_tests = 0;
+
+#include "../motor_sim/inverter_model.h"
+#include "../motor_sim/simulation_driver.h"
+#include "../motor_sim/mcconf_stub.h"
+
+#define V_BUS           48.0f
+
+static double time_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+typedef struct {
+    mc_configuration conf;
+    virtual_motor_state_t vm;
+    virtual_motor_io_t io;
+    inverter_config_t cfg;
+    inverter_state_t inv;
+} bench_t;
+
+// Medium motor held at standstill, driven through an inverter
+static void bench_init(bench_t *b, inverter_mode_e mode, float dead_time) {
+    mcconf_set_medium_motor(&b->conf);
+    virtual_motor_pc_state_init(&b->vm, &b->conf);
+    virtual_motor_pc_state_set_inertia(&b->vm, 1e6f);
+    memset(&b->io, 0, sizeof(b->io));
+
+    // Start from zero current instead of id = -lambda / ld
+    b->vm.id_int = b->vm.lambda / b->vm.ld;
+
+    inverter_default_config(&b->cfg, &b->conf);
+    b->cfg.mode = mode;
+    b->cfg.dead_time = dead_time;
+    inverter_init(&b->inv, &b->cfg);
+}
+
+// Run whole PWM periods and return the average αβ voltage of the last one
+static void bench_run(bench_t *b, int periods, int steps_per_period,
+                      float *v_alpha, float *v_beta) {
+    float T = inverter_pwm_period(&b->inv);
+    float dt = T / (float)steps_per_period;
+    double va = 0.0, vb = 0.0;
+
+    for (int p = 0; p < periods; p++) {
+        va = 0.0;
+        vb = 0.0;
+        for (int s = 0; s < steps_per_period; s++) {
+            inverter_step(&b->inv, &b->vm, &b->io, V_BUS, dt, 1e-6f);
+            va += b->inv.v_alpha_avg * dt;
+            vb += b->inv.v_beta_avg * dt;
+        }
+    }
+
+    *v_alpha = (float)(va / T);
+    *v_beta = (float)(vb / T);
+}
+
+// ==================== Voltage Tests ====================
+
+bool test_averaged_voltage(void) {
+    bench_t b;
+    bench_init(&b, INVERTER_MODE_AVERAGED, 0.0f);
+    inverter_set_duty(&b.inv, 0.7f, 0.4f, 0.3f);
+
+    float va, vb;
+    bench_run(&b, 1, 1, &va, &vb);
+
+    // Common mode of the duties does not reach the motor
+    float va_exp = (2.0f * 0.7f - 0.4f - 0.3f) / 3.0f * V_BUS;
+    float vb_exp = (0.4f - 0.3f) / sqrtf(3.0f) * V_BUS;
+    printf("    v_alpha = %.4f V (expected %.4f), v_beta = %.4f V (expected %.4f)\n",
+           va, va_exp, vb, vb_exp);
+    TEST_ASSERT(fabsf(va - va_exp) < 1e-4f, "v_alpha");
+    TEST_ASSERT(fabsf(vb - vb_exp) < 1e-4f, "v_beta");
+
+    return true;
+}
+
+bool test_switching_average_and_ripple(void) {
+    bench_t sw, av;
+    bench_init(&sw, INVERTER_MODE_SWITCHING, 0.0f);
+    bench_init(&av, INVERTER_MODE_AVERAGED, 0.0f);
+    inverter_set_duty(&sw.inv, 0.55f, 0.45f, 0.45f);
+    inverter_set_duty(&av.inv, 0.55f, 0.45f, 0.45f);
+
+    float va_sw, vb_sw, va_av, vb_av;
+    bench_run(&sw, 1, 1, &va_sw, &vb_sw);
+    bench_run(&av, 1, 1, &va_av, &vb_av);
+    TEST_ASSERT(fabsf(va_sw - va_av) < 1e-3f, "Same period average");
+    TEST_ASSERT(fabsf(vb_sw - vb_av) < 1e-3f, "Same period average");
+
+    // Let the current settle, then look at one period in fine steps
+    bench_run(&sw, 2000, 1, &va_sw, &vb_sw);
+    bench_run(&av, 2000, 1, &va_av, &vb_av);
+
+    float min_sw = 1e6f, max_sw = -1e6f, min_av = 1e6f, max_av = -1e6f;
+    float T = inverter_pwm_period(&sw.inv);
+    for (int s = 0; s < 100; s++) {
+        inverter_step(&sw.inv, &sw.vm, &sw.io, V_BUS, T / 100.0f, 1e-6f);
+        inverter_step(&av.inv, &av.vm, &av.io, V_BUS, T / 100.0f, 1e-6f);
+        min_sw = fminf(min_sw, sw.vm.id);
+        max_sw = fmaxf(max_sw, sw.vm.id);
+        min_av = fminf(min_av, av.vm.id);
+        max_av = fmaxf(max_av, av.vm.id);
+    }
+
+    printf("    id ripple: switching %.3f A p-p, averaged %.5f A p-p\n",
+           max_sw - min_sw, max_av - min_av);
+    TEST_ASSERT(max_sw - min_sw > 0.1f, "Switching ripple present");
+    TEST_ASSERT(max_av - min_av < 1e-3f, "No ripple in averaged mode");
+
+    // Centered sampling sees the average current, not the ripple peaks
+    printf("    sampled %.3f A, averaged model %.3f A\n", sw.inv.i_alpha_meas, av.vm.id);
+    TEST_ASSERT(fabsf(sw.inv.i_alpha_meas - av.vm.id) < 0.1f * (max_sw - min_sw),
+                "Sample at V0 center matches the average");
+
+    return true;
+}
+
+bool test_dead_time_loss(void) {
+    const float td = 1e-6f;
+    const inverter_mode_e modes[] = {INVERTER_MODE_AVERAGED, INVERTER_MODE_SWITCHING};
+
+    for (int m = 0; m < 2; m++) {
+        bench_t ideal, dead;
+        bench_init(&ideal, modes[m], 0.0f);
+        bench_init(&dead, modes[m], td);
+        inverter_set_duty(&ideal.inv, 0.6f, 0.45f, 0.45f);
+        inverter_set_duty(&dead.inv, 0.6f, 0.45f, 0.45f);
+
+        float va_i, vb_i, va_d, vb_d;
+        bench_run(&ideal, 2000, 1, &va_i, &vb_i);
+        bench_run(&dead, 2000, 1, &va_d, &vb_d);
+
+        // Phase A sources current, B and C sink it: each phase loses
+        // td / T of (v_bus + v_diode) in the direction of its current
+        float w = td / inverter_pwm_period(&dead.inv);
+        float expected = 4.0f / 3.0f * w * (V_BUS + dead.cfg.v_diode);
+        float loss = va_i - va_d;
+
+        printf("    %-9s v_alpha loss %.4f V (expected %.4f), ia %.2f A\n",
+               m == 0 ? "averaged" : "switching", loss, expected, dead.vm.id);
+        TEST_ASSERT(dead.vm.id > 0.5f, "Positive phase A current");
+        TEST_ASSERT(fabsf(loss - expected) < 0.02f * expected, "Dead-time loss");
+        TEST_ASSERT(fabsf(vb_d) < 1e-3f, "No β error with symmetric B and C");
+    }
+
+    return true;
+}
+
+// ==================== Sampling Tests ====================
+
+bool test_sample_period(void) {
+    bench_t b;
+    bench_init(&b, INVERTER_MODE_SWITCHING, 0.0f);
+
+    float T = 2.0f / b.conf.foc_f_zv;
+    TEST_ASSERT(fabsf(inverter_pwm_period(&b.inv) - T) < 1e-9f, "PWM period");
+
+    b.cfg.sample_v0_v7 = false;
+    inverter_init(&b.inv, &b.cfg);
+    TEST_ASSERT(fabsf(inverter_sample_period(&b.inv) - T) < 1e-9f, "V0 sampling");
+    for (int i = 0; i < 10; i++) {
+        inverter_step(&b.inv, &b.vm, &b.io, V_BUS, inverter_sample_period(&b.inv), 1e-6f);
+    }
+    TEST_ASSERT(b.inv.samples == 10, "One sample per step");
+
+    b.cfg.sample_v0_v7 = true;
+    inverter_init(&b.inv, &b.cfg);
+    TEST_ASSERT(fabsf(inverter_sample_period(&b.inv) - 0.5f * T) < 1e-9f, "V0/V7 sampling");
+    inverter_step(&b.inv, &b.vm, &b.io, V_BUS, T, 1e-6f);
+    TEST_ASSERT(b.inv.samples == 2, "Two samples per period");
+
+    return true;
+}
+
+bool test_adc_saturation(void) {
+    bench_t b;
+    bench_init(&b, INVERTER_MODE_SWITCHING, 0.0f);
+    b.cfg.i_adc_max = 2.0f;
+    b.cfg.i_adc_lsb = 0.01f;
+    inverter_init(&b.inv, &b.cfg);
+    inverter_set_duty(&b.inv, 0.6f, 0.45f, 0.45f);
+
+    float va, vb;
+    bench_run(&b, 2000, 1, &va, &vb);
+
+    printf("    true ia %.2f A, sampled %.2f A, %u/%u samples clipped\n",
+           b.vm.id, b.inv.i_phase[0], b.inv.adc_saturations, b.inv.samples);
+    TEST_ASSERT(b.vm.id > 2.5f, "Current beyond the shunt range");
+    TEST_ASSERT(fabsf(b.inv.i_phase[0] - 2.0f) < 1e-6f, "Sample clipped to the range");
+    TEST_ASSERT(b.inv.adc_saturations > 0, "Saturation counted");
+
+    float q = b.inv.i_phase[1] / 0.01f;
+    TEST_ASSERT(fabsf(q - roundf(q)) < 1e-3f, "Sample quantized");
+
+    return true;
+}
+
+// ==================== Closed Loop Tests ====================
+
+static bool run_closed_loop(inverter_mode_e mode, float *iq, double *wall) {
+    static sim_context_t ctx;
+    sim_command_t cmd;
+    inverter_config_t cfg;
+
+    sim_init(&ctx);
+    sim_set_timing(&ctx, 1.0f/20000.0f, 1.0f/100000.0f, 1.0f/1000.0f, 0.05f);
+
+    // Locked rotor, so that the PI loop is not chasing a rising back-EMF
+    sim_set_inertia(&ctx, 1e6f);
+    inverter_default_config(&cfg, &ctx.mc_conf);
+    cfg.mode = mode;
+    sim_set_inverter(&ctx, &cfg);
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.mode = SIM_CTRL_CURRENT;
+    cmd.iq_ref = 5.0f;
+    sim_set_reference(&ctx, &cmd);
+
+    double t0 = time_now();
+    int result = sim_run(&ctx);
+    *wall = time_now() - t0;
+
+    sim_get_state(&ctx, NULL, iq, NULL, NULL, NULL, NULL);
+    return result == 0 && fabsf(ctx.time.control_dt - inverter_sample_period(&ctx.inverter)) < 1e-9f;
+}
+
+bool test_closed_loop_current(void) {
+    float iq_sw, iq_av;
+    double wall_sw, wall_av;
+
+    TEST_ASSERT(run_closed_loop(INVERTER_MODE_SWITCHING, &iq_sw, &wall_sw), "Switching run");
+    TEST_ASSERT(run_closed_loop(INVERTER_MODE_AVERAGED, &iq_av, &wall_av), "Averaged run");
+
+    printf("    iq: switching %.3f A, averaged %.3f A (ref 5 A)\n", iq_sw, iq_av);
+    printf("    wall time: switching %.1f ms, averaged %.1f ms (%.1fx)\n",
+           wall_sw * 1e3, wall_av * 1e3, wall_sw / wall_av);
+    TEST_ASSERT(fabsf(iq_sw - 5.0f) < 0.1f, "Switching mode tracks iq");
+    TEST_ASSERT(fabsf(iq_av - 5.0f) < 0.1f, "Averaged mode tracks iq");
+    TEST_ASSERT(wall_av < wall_sw, "Averaged mode is faster");
+
+    return true;
+}
+
+// ==================== Main ====================
+
+int main(void) {
+    printf("=== Inverter Model Tests ===\n\n");
+
+    printf("--- Voltage Tests ---\n");
+    RUN_TEST(test_averaged_voltage);
+    RUN_TEST(test_switching_average_and_ripple);
+    RUN_TEST(test_dead_time_loss);
+
+    printf("\n--- Sampling Tests ---\n");
+    RUN_TEST(test_sample_period);
+    RUN_TEST(test_adc_saturation);
+
+    printf("\n--- Closed Loop Tests ---\n");
+    RUN_TEST(test_closed_loop_current);
+
+    printf("\n=== Test Summary ===\n");
+    printf("Total: %d, Passed: %d, Failed: %d\n",
+           total_tests, passed_tests, total_tests - passed_tests);
+
+    return (passed_tests == total_tests) ? 0 : 1;
+}
@@ -0,0 +1,278 @@
+/**
+ * @file test_mc_capture.c
+ * @brief Unit tests for the pre-trigger ring capture (motor/mc_capture.c)
+ *
+ * Validates:
+ * - Pre/post window around the trigger, with and without a full ring
+ * - Compound conditions only trigger when all of them hold
+ * - Observer angle jumps relative to the speed prediction
+ * - Fault trigger with a specific and with any fault code
+ * - Decimation, channel selection and configuration checks
+ * - A frozen capture ignores further samples until re-armed
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+
+// Test framework
+#define TEST_ASSERT(cond, msg) do { \
+    if (!(cond)) { \
+        printf("  FAIL: %s (line %d)\n", msg, __LINE__); \
+        test_failures++; \
+        return false; \
+    } \
+} while(0)
+
+#define RUN_TEST(test_func) do { \
+    printf("Running %s...\n", #test_func); \
+    total_tests++; \
+    if (test_func()) { \
+        printf("  PASS\n"); \
+        passed_tests++; \
+    } \
+} while(0)
+
+static int test_failures = 0;
+static int total_tests = 0;
+static int passed_tests = 0;
+
+#include "mc_capture.h"
+
+#define BUFFER_LEN      1024
+#define DT              (1.0f / 30000.0f)
+
+static int16_t buffer[BUFFER_LEN];
+static mc_capture_t cap;
+
+static mc_capture_config default_config(void) {
+    mc_capture_config conf;
+    memset(&conf, 0, sizeof(conf));
+    conf.channels = (1 << DEBUG_SAMPLING_CH_CURR0) | (1 << DEBUG_SAMPLING_CH_PH1);
+    conf.pre_samples = 20;
+    conf.post_samples = 10;
+    conf.decimation = 1;
+    conf.fault_code = FAULT_CODE_NONE;
+    return conf;
+}
+
+// Feed one sample whose channels all hold the sample number
+static void feed(int n, float current, float erpm, float angle) {
+    int16_t ch[DEBUG_SAMPLING_CH_NUM];
+    for (int i = 0; i < DEBUG_SAMPLING_CH_NUM; i++) {
+        ch[i] = (int16_t)(n * 10 + i);
+    }
+
+    mc_capture_input in = {current, erpm, angle, DT};
+    mc_capture_sample(&cap, ch, &in);
+}
+
+// =============================================================================
+// Test Cases
+// =============================================================================
+
+static bool test_pre_post_window(void) {
+    mc_capture_init(&cap, buffer, BUFFER_LEN);
+    mc_capture_config conf = default_config();
+    conf.conditions = 1 << MC_CAPTURE_COND_CURRENT_ABOVE;
+    conf.current_above = 50.0f;
+    TEST_ASSERT(mc_capture_arm(&cap, &conf), "Arm");
+
+    // Trigger at sample 100, long after the ring wrapped
+    int n = 0;
+    for (; n < 100; n++) {
+        feed(n, 10.0f, 0.0f, 0.0f);
+    }
+    TEST_ASSERT(cap.state == MC_CAPTURE_ARMED, "Armed before the trigger");
+
+    for (; cap.state != MC_CAPTURE_DONE && n < 200; n++) {
+        feed(n, n == 100 ? 60.0f : 10.0f, 0.0f, 0.0f);
+    }
+
+    TEST_ASSERT(n == 110, "Frozen after post_samples including the trigger");
+    TEST_ASSERT(mc_capture_get_len(&cap) == 30, "pre + post frames");
+    TEST_ASSERT(mc_capture_get_trigger_index(&cap) == 20, "Trigger after pre_samples");
+
+    int16_t frame[DEBUG_SAMPLING_CH_NUM];
+    for (uint32_t i = 0; i < 30; i++) {
+        TEST_ASSERT(mc_capture_get_frame(&cap, i, frame), "Frame readable");
+        int sample = 80 + (int)i;
+        TEST_ASSERT(frame[0] == sample * 10 + DEBUG_SAMPLING_CH_CURR0, "Oldest first, CURR0");
+        TEST_ASSERT(frame[1] == sample * 10 + DEBUG_SAMPLING_CH_PH1, "Only selected channels, PH1");
+    }
+    TEST_ASSERT(!mc_capture_get_frame(&cap, 30, frame), "Out of range");
+
+    // Frozen: more samples change nothing
+    feed(500, 100.0f, 0.0f, 0.0f);
+    mc_capture_get_frame(&cap, 0, frame);
+    TEST_ASSERT(frame[0] == 800 && mc_capture_get_len(&cap) == 30, "Frozen capture ignores samples");
+
+    // Early trigger: fewer pre samples
+    TEST_ASSERT(mc_capture_arm(&cap, &conf), "Re-arm");
+    TEST_ASSERT(mc_capture_get_trigger_index(&cap) == -1, "No trigger after re-arm");
+    for (n = 0; cap.state != MC_CAPTURE_DONE; n++) {
+        feed(n, n == 5 ? 60.0f : 10.0f, 0.0f, 0.0f);
+    }
+    TEST_ASSERT(mc_capture_get_len(&cap) == 15, "5 pre + 10 post frames");
+    TEST_ASSERT(mc_capture_get_trigger_index(&cap) == 5, "Trigger index");
+    mc_capture_get_frame(&cap, 0, frame);
+    TEST_ASSERT(frame[0] == 0, "Starts at the first sample");
+
+    return true;
+}
+
+static bool test_compound_conditions(void) {
+    mc_capture_init(&cap, buffer, BUFFER_LEN);
+    mc_capture_config conf = default_config();
+    conf.conditions = (1 << MC_CAPTURE_COND_CURRENT_ABOVE) | (1 << MC_CAPTURE_COND_ERPM_BELOW);
+    conf.current_above = 50.0f;
+    conf.erpm_below = 500.0f;
+    TEST_ASSERT(mc_capture_arm(&cap, &conf), "Arm");
+
+    // High current at speed and low speed without current: no trigger
+    int n = 0;
+    for (; n < 50; n++) {
+        feed(n, 80.0f, 5000.0f, 0.0f);
+        feed(n, -10.0f, 100.0f, 0.0f);
+    }
+    TEST_ASSERT(cap.state == MC_CAPTURE_ARMED, "One condition alone does not trigger");
+
+    // Stalled with high (negative) current
+    feed(n++, -80.0f, -100.0f, 0.0f);
+    TEST_ASSERT(cap.state == MC_CAPTURE_TRIGGERED, "Both conditions trigger");
+
+    return true;
+}
+
+static bool test_angle_jump(void) {
+    mc_capture_init(&cap, buffer, BUFFER_LEN);
+    mc_capture_config conf = default_config();
+    conf.conditions = 1 << MC_CAPTURE_COND_ANGLE_JUMP;
+    conf.angle_jump = 20.0f;
+    TEST_ASSERT(mc_capture_arm(&cap, &conf), "Arm");
+
+    // 30000 ERPM advances 6 deg per 30 kHz sample, across the wrap at 360
+    const float erpm = 30000.0f;
+    float angle = 300.0f;
+    for (int n = 0; n < 200; n++) {
+        feed(n, 0.0f, erpm, angle);
+        angle = fmodf(angle + erpm * 6.0f * DT, 360.0f);
+    }
+    TEST_ASSERT(cap.state == MC_CAPTURE_ARMED, "Steady rotation does not trigger");
+
+    feed(200, 0.0f, erpm, fmodf(angle + 90.0f, 360.0f));
+    TEST_ASSERT(cap.state == MC_CAPTURE_TRIGGERED, "90 deg jump triggers");
+
+    return true;
+}
+
+static bool test_fault_trigger(void) {
+    mc_capture_init(&cap, buffer, BUFFER_LEN);
+    mc_capture_config conf = default_config();
+    conf.conditions = 1 << MC_CAPTURE_COND_FAULT;
+    conf.fault_code = FAULT_CODE_ABS_OVER_CURRENT;
+    TEST_ASSERT(mc_capture_arm(&cap, &conf), "Arm");
+
+    feed(0, 0.0f, 0.0f, 0.0f);
+    mc_capture_fault(&cap, FAULT_CODE_OVER_VOLTAGE);
+    feed(1, 0.0f, 0.0f, 0.0f);
+    TEST_ASSERT(cap.state == MC_CAPTURE_ARMED, "Other fault code ignored");
+
+    mc_capture_fault(&cap, FAULT_CODE_ABS_OVER_CURRENT);
+    TEST_ASSERT(cap.state == MC_CAPTURE_ARMED, "Evaluated with the next sample");
+    feed(2, 0.0f, 0.0f, 0.0f);
+    TEST_ASSERT(cap.state == MC_CAPTURE_TRIGGERED, "Selected fault triggers");
+    TEST_ASSERT(cap.trigger_fault == FAULT_CODE_ABS_OVER_CURRENT, "Trigger fault recorded");
+
+    // Any fault
+    conf.fault_code = FAULT_CODE_NONE;
+    TEST_ASSERT(mc_capture_arm(&cap, &conf), "Re-arm");
+    feed(0, 0.0f, 0.0f, 0.0f);
+    mc_capture_fault(&cap, FAULT_CODE_DRV);
+    feed(1, 0.0f, 0.0f, 0.0f);
+    TEST_ASSERT(cap.state == MC_CAPTURE_TRIGGERED && cap.trigger_fault == FAULT_CODE_DRV,
+                "Any fault triggers");
+
+    return true;
+}
+
+static bool test_decimation(void) {
+    mc_capture_init(&cap, buffer, BUFFER_LEN);
+    mc_capture_config conf = default_config();
+    conf.conditions = 1 << MC_CAPTURE_COND_ERPM_ABOVE;
+    conf.erpm_above = 1000.0f;
+    conf.decimation = 4;
+    TEST_ASSERT(mc_capture_arm(&cap, &conf), "Arm");
+
+    int n = 0;
+    for (; cap.state != MC_CAPTURE_DONE && n < 1000; n++) {
+        feed(n, 0.0f, n >= 200 ? 2000.0f : 0.0f, 0.0f);
+    }
+
+    // Samples 3, 7, 11, ... are recorded, the first one at or after 200 is 203
+    int16_t frame[DEBUG_SAMPLING_CH_NUM];
+    mc_capture_get_frame(&cap, (uint32_t)mc_capture_get_trigger_index(&cap), frame);
+    TEST_ASSERT(frame[0] == 2030, "Trigger on the first decimated sample");
+    mc_capture_get_frame(&cap, 0, frame);
+    TEST_ASSERT(frame[0] == 2030 - 20 * 40, "Pre samples are decimated");
+    TEST_ASSERT(n == 203 + 9 * 4 + 1, "Post samples are decimated");
+
+    return true;
+}
+
+static bool test_config_checks(void) {
+    mc_capture_init(&cap, buffer, BUFFER_LEN);
+    mc_capture_config conf = default_config();
+    conf.conditions = 1 << MC_CAPTURE_COND_FAULT;
+
+    TEST_ASSERT(cap.state == MC_CAPTURE_IDLE && !mc_capture_is_recording(&cap), "Idle after init");
+
+    conf.pre_samples = 500;
+    conf.post_samples = 13;
+    TEST_ASSERT(!mc_capture_arm(&cap, &conf), "Does not fit in the buffer");
+    conf.post_samples = 12;
+    TEST_ASSERT(mc_capture_arm(&cap, &conf), "Exactly fits");
+
+    conf = default_config();
+    TEST_ASSERT(!mc_capture_arm(&cap, &conf), "No condition");
+    conf.conditions = 1 << MC_CAPTURE_COND_FAULT;
+    conf.channels = 0;
+    TEST_ASSERT(!mc_capture_arm(&cap, &conf), "No channel");
+    conf.channels = 1;
+    conf.post_samples = 0;
+    TEST_ASSERT(!mc_capture_arm(&cap, &conf), "No post samples");
+
+    conf.post_samples = 1;
+    TEST_ASSERT(mc_capture_arm(&cap, &conf), "Arm");
+    mc_capture_disarm(&cap);
+    mc_capture_fault(&cap, FAULT_CODE_DRV);
+    feed(0, 0.0f, 0.0f, 0.0f);
+    TEST_ASSERT(cap.state == MC_CAPTURE_IDLE && mc_capture_get_len(&cap) == 0, "Disarmed capture records nothing");
+
+    return true;
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+int main(void) {
+    printf("========================================\n");
+    printf("Pre-Trigger Capture Tests\n");
+    printf("========================================\n\n");
+
+    RUN_TEST(test_pre_post_window);
+    RUN_TEST(test_compound_conditions);
+    RUN_TEST(test_angle_jump);
+    RUN_TEST(test_fault_trigger);
+    RUN_TEST(test_decimation);
+    RUN_TEST(test_config_checks);
+
+    printf("\n========================================\n");
+    printf("Total: %d, Passed: %d, Failed: %d\n", total_tests, passed_tests, test_failures);
+    printf("========================================\n");
+
+    return test_failures > 0 ? 1 : 0;
+}
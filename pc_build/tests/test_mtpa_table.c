@@ -0,0 +1,375 @@
+/**
+ * @file test_mtpa_table.c
+ * @brief MTPA table (motor/foc_mtpa_table.c) against the online MTPA and field weakening
+ *
+ * An IPM motor on the simulator plant is held at a constant electrical speed
+ * by a large inertia while an ideal dq current controller on the true angle
+ * follows the current references. The references come either from the
+ * closed form MTPA of the current controller together with the duty cycle
+ * based field weakening in foc_run_fw, or from the precomputed table. Torque,
+ * copper loss and efficiency are compared at the same current command from
+ * the MTPA region over field weakening into MTPV.
+ *
+ * Validates:
+ * - The solver finds MTPA, field weakening and MTPV points
+ * - Table interpolation stays close to the solver between grid points
+ * - The table matches the online path below base speed and gives more
+ *   torque per ampere and a higher efficiency above it, without exceeding
+ *   the commanded current
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+
+// Test framework
+#define TEST_ASSERT(cond, msg) do { \
+    if (!(cond)) { \
+        printf("  FAIL: %s (line %d)\n", msg, __LINE__); \
+        test_failures++; \
+        return false; \
+    } \
+} while(0)
+
+#define RUN_TEST(test_func) do { \
+    printf("Running %s...\n", #test_func); \
+    total_tests++; \
+    if (test_func()) { \
+        printf("  PASS\n"); \
+        passed_tests++; \
+    } \
+} while(0)
+
+static int test_failures = 0;
+static int total_tests = 0;
+static int passed_tests = 0;
+
+#include "../motor_sim/virtual_motor_pc.h"
+#include "../motor_sim/foc_control_core.h"
+#include "../motor_sim/mcconf_stub.h"
+#include "foc_math.h"
+#include "foc_mtpa_table.h"
+#include "utils_math.h"
+
+#define DT              (1.0f / 30000.0f)
+#define FW_DT           0.001f  // foc_run_fw runs from the 1 kHz timer
+#define SETTLE_TIME     0.6f    // Longer than the FW ramp
+#define MEASURE_TIME    0.1f
+#define CC_BANDWIDTH    3000.0f // Current controller bandwidth [rad/s]
+
+// IPM motor
+#define MOTOR_L         100e-6f
+#define MOTOR_LD_LQ     60e-6f  // Ld = 70 uH, Lq = 130 uH
+#define MOTOR_LAMBDA    0.006f
+#define MOTOR_R         0.02f
+#define I_MAX           100.0f
+#define V_BUS           48.0f
+
+typedef struct {
+    const char *name;
+    float omega_e;      // [rad/s]
+    float current;      // Commanded current magnitude [A]
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+    {"MTPA",              1500.0f, 80.0f},
+    {"field weakening",   3000.0f, 80.0f},
+    {"deep FW",           5000.0f, 80.0f},
+    {"MTPV",              9000.0f, 80.0f},
+    {"FW, light load",    4000.0f, 30.0f},
+};
+#define NUM_SCENARIOS   (int)(sizeof(scenarios) / sizeof(scenarios[0]))
+
+typedef struct {
+    float torque;       // [Nm]
+    float p_cu;         // Copper loss [W]
+    float eff;          // Mechanical power over mechanical power and copper loss
+    float i_abs;        // [A]
+} result_t;
+
+static void setup_conf(mc_configuration *conf, MTPA_MODE mode) {
+    mcconf_set_defaults(conf);
+    // The plant advances the angle with we but scales the back EMF with the
+    // pole pairs, one pole pair keeps both electrical
+    conf->si_motor_poles = 2;
+    conf->foc_motor_l = MOTOR_L;
+    conf->foc_motor_ld_lq_diff = MOTOR_LD_LQ;
+    conf->foc_motor_flux_linkage = MOTOR_LAMBDA;
+    conf->foc_motor_r = MOTOR_R;
+    conf->l_current_max = I_MAX;
+    conf->lo_current_max = I_MAX;
+    conf->lo_current_min = -I_MAX;
+    conf->foc_fw_current_max = 60.0f;
+    conf->foc_mtpa_mode = mode;
+}
+
+static void run_scenario(const scenario_t *sc, MTPA_MODE mode, result_t *res) {
+    static mc_configuration conf;
+    static motor_all_state_t motor;
+    static virtual_motor_state_t vm;
+    virtual_motor_io_t io;
+
+    setup_conf(&conf, mode);
+    foc_motor_state_init(&motor, &conf);
+    foc_precalc_values(&motor);
+    motor.m_state = MC_STATE_RUNNING;
+    motor.m_control_mode = CONTROL_MODE_CURRENT;
+
+    virtual_motor_pc_state_init(&vm, &conf);
+    virtual_motor_pc_state_set_integrator(&vm, VM_INTEGRATOR_EXACT);
+    virtual_motor_pc_state_set_inertia(&vm, 1e3f);
+    virtual_motor_pc_state_set_speed(&vm, sc->omega_e);
+    memset(&io, 0, sizeof(io));
+
+    const float ld = motor.p_ld;
+    const float lq = motor.p_lq;
+    const float kp_d = CC_BANDWIDTH * ld;
+    const float kp_q = CC_BANDWIDTH * lq;
+    const float ki = CC_BANDWIDTH * MOTOR_R;
+    const float v_max = ONE_BY_SQRT3 * conf.l_max_duty * V_BUS * conf.foc_overmod_factor;
+    const int fw_steps = (int)(FW_DT / DT + 0.5f);
+
+    float vd_int = 0.0f, vq_int = 0.0f;
+    float mod_q_filter = 0.0f;
+    double torque_sum = 0.0, p_cu_sum = 0.0, p_mech_sum = 0.0, i_sum = 0.0;
+    int samples = 0;
+
+    const int steps = (int)((SETTLE_TIME + MEASURE_TIME) / DT);
+    for (int k = 0; k < steps; k++) {
+        if (k % fw_steps == 0) {
+            foc_run_fw(&motor, FW_DT);
+        }
+
+        // Current references as in the current control mode of the ISR
+        float id_set = 0.0f;
+        float iq_set = sc->current;
+        if (mode == MTPA_MODE_TABLE) {
+            const float i_ref = fabsf(iq_set);
+            const float v_avail = motor.p_mtpa_v_scale * V_BUS - MOTOR_R * i_ref;
+            float iq_table;
+            foc_mtpa_table_lookup(&motor.m_mtpa_table, i_ref, v_avail, vm.we, &id_set, &iq_table);
+            iq_set = SIGN(iq_set) * iq_table;
+        } else {
+            const float ld_lq_diff = conf.foc_motor_ld_lq_diff;
+            const float lambda = conf.foc_motor_flux_linkage;
+            id_set = (lambda - sqrtf(SQ(lambda) + 8.0f * SQ(ld_lq_diff * iq_set))) / (4.0f * ld_lq_diff);
+            iq_set = SIGN(iq_set) * sqrtf(SQ(iq_set) - SQ(id_set));
+        }
+
+        id_set -= motor.m_i_fw_set;
+        iq_set -= SIGN(mod_q_filter) * motor.m_i_fw_set * conf.foc_fw_q_current_factor;
+        utils_truncate_number_abs(&id_set, I_MAX);
+        utils_truncate_number_abs(&iq_set, sqrtf(SQ(I_MAX) - SQ(id_set)));
+
+        // Current control on the true angle with decoupling, saturated to the
+        // voltage circle with d axis priority
+        float s, c;
+        utils_fast_sincos_better(vm.phi, &s, &c);
+        const float id = c * io.i_alpha_out + s * io.i_beta_out;
+        const float iq = c * io.i_beta_out - s * io.i_alpha_out;
+
+        const float err_d = id_set - id;
+        const float err_q = iq_set - iq;
+        float vd = kp_d * err_d + vd_int - vm.we * lq * iq;
+        float vq = kp_q * err_q + vq_int + vm.we * (ld * id + MOTOR_LAMBDA);
+
+        utils_truncate_number_abs(&vd, v_max);
+        const float vq_max = sqrtf(SQ(v_max) - SQ(vd));
+        const bool saturated = fabsf(vq) > vq_max;
+        utils_truncate_number_abs(&vq, vq_max);
+        if (!saturated) {
+            vd_int += ki * err_d * DT;
+            vq_int += ki * err_q * DT;
+        }
+
+        // The duty cycle as in the ISR, 1 at the largest voltage without overmodulation
+        const float duty = NORM2_f(vd, vq) / (ONE_BY_SQRT3 * V_BUS);
+        UTILS_LP_FAST(motor.m_duty_abs_filtered, duty, 0.01f);
+        utils_truncate_number_abs((float*)&motor.m_duty_abs_filtered, 1.0f);
+        UTILS_LP_FAST(mod_q_filter, vq / V_BUS, 0.2f);
+
+        // The plant holds the voltage over the period while the rotor turns,
+        // apply it at the mid-period angle as the ISR does
+        utils_fast_sincos_better(vm.phi + 0.5f * vm.we * DT, &s, &c);
+        io.v_alpha_in = c * vd - s * vq;
+        io.v_beta_in = s * vd + c * vq;
+        virtual_motor_pc_state_step(&vm, &io, DT);
+
+        if (k * DT >= SETTLE_TIME) {
+            const float p_cu = 1.5f * MOTOR_R * (SQ(vm.id) + SQ(vm.iq));
+            torque_sum += io.torque;
+            p_cu_sum += p_cu;
+            p_mech_sum += io.torque * vm.we / (float)vm.pole_pairs;
+            i_sum += NORM2_f(vm.id, vm.iq);
+            samples++;
+        }
+    }
+
+    res->torque = torque_sum / samples;
+    res->p_cu = p_cu_sum / samples;
+    res->i_abs = i_sum / samples;
+    res->eff = p_mech_sum > 0.0 ? p_mech_sum / (p_mech_sum + p_cu_sum) : 0.0f;
+}
+
+// =============================================================================
+// Test Cases
+// =============================================================================
+
+static float torque(float ld, float lq, float id, float iq) {
+    return 1.5f * iq * (MOTOR_LAMBDA + (ld - lq) * id);
+}
+
+static float flux(float ld, float lq, float id, float iq) {
+    return sqrtf(SQ(ld * id + MOTOR_LAMBDA) + SQ(lq * iq));
+}
+
+static bool test_solve_regions(void) {
+    const float ld = MOTOR_L - 0.5f * MOTOR_LD_LQ;
+    const float lq = MOTOR_L + 0.5f * MOTOR_LD_LQ;
+    float id, iq;
+
+    // Enough voltage: the closed form MTPA point
+    const float id_mtpa = (MOTOR_LAMBDA - sqrtf(SQ(MOTOR_LAMBDA) + 8.0f * SQ(MOTOR_LD_LQ * 80.0f))) /
+            (4.0f * MOTOR_LD_LQ);
+    foc_mtpa_table_solve(ld, lq, MOTOR_LAMBDA, 80.0f, 1.0f, &id, &iq);
+    TEST_ASSERT(fabsf(id - id_mtpa) < 1e-3f, "MTPA d axis current");
+    TEST_ASSERT(fabsf(NORM2_f(id, iq) - 80.0f) < 1e-3f, "MTPA on the current limit");
+
+    // Field weakening: on both limits, with less d current than the flux allows
+    const float psi_fw = 0.7f * flux(ld, lq, id, iq);
+    foc_mtpa_table_solve(ld, lq, MOTOR_LAMBDA, 80.0f, psi_fw, &id, &iq);
+    TEST_ASSERT(fabsf(NORM2_f(id, iq) - 80.0f) < 0.01f, "FW on the current limit");
+    TEST_ASSERT(fabsf(flux(ld, lq, id, iq) - psi_fw) < 1e-5f, "FW on the voltage limit");
+    TEST_ASSERT(id < id_mtpa, "FW adds negative d axis current");
+
+    // MTPV: inside the current limit, and no point on the voltage limit has
+    // more torque
+    const float psi_mtpv = 0.002f;
+    foc_mtpa_table_solve(ld, lq, MOTOR_LAMBDA, 100.0f, psi_mtpv, &id, &iq);
+    TEST_ASSERT(NORM2_f(id, iq) < 99.0f, "MTPV inside the current limit");
+    TEST_ASSERT(fabsf(flux(ld, lq, id, iq) - psi_mtpv) < 1e-5f, "MTPV on the voltage limit");
+    const float t_mtpv = torque(ld, lq, id, iq);
+    for (float t = 0.0f; t < (float)M_PI; t += 0.01f) {
+        const float id_t = (psi_mtpv * cosf(t) - MOTOR_LAMBDA) / ld;
+        const float iq_t = psi_mtpv * sinf(t) / lq;
+        TEST_ASSERT(torque(ld, lq, id_t, iq_t) <= t_mtpv * 1.0001f, "MTPV has the most torque");
+    }
+
+    // No current
+    foc_mtpa_table_solve(ld, lq, MOTOR_LAMBDA, 0.0f, psi_mtpv, &id, &iq);
+    TEST_ASSERT(id == 0.0f && iq == 0.0f, "Zero current");
+
+    return true;
+}
+
+static bool test_interpolation(void) {
+    const float ld = MOTOR_L - 0.5f * MOTOR_LD_LQ;
+    const float lq = MOTOR_L + 0.5f * MOTOR_LD_LQ;
+
+    static foc_mtpa_table_t table;
+    memset(&table, 0, sizeof(table));
+    foc_mtpa_table_generate(&table, ld, lq, MOTOR_LAMBDA, I_MAX);
+    TEST_ASSERT(table.valid, "Table generated");
+
+    // Between grid points the torque and current stay close to the solution
+    float err_max = 0.0f;
+    for (float i = 3.0f; i < I_MAX; i += 6.7f) {
+        for (float psi = 0.0003f; psi < table.psi_max; psi += 0.00071f) {
+            float id_s, iq_s, id_t, iq_t;
+            foc_mtpa_table_solve(ld, lq, MOTOR_LAMBDA, i, psi, &id_s, &iq_s);
+            foc_mtpa_table_lookup_psi(&table, i, psi, &id_t, &iq_t);
+
+            const float t_ref = torque(ld, lq, id_s, iq_s);
+            const float err = fabsf(torque(ld, lq, id_t, iq_t) - t_ref);
+            if (err > err_max) {
+                err_max = err;
+            }
+            TEST_ASSERT(NORM2_f(id_t, iq_t) <= i + 0.02f * I_MAX, "Interpolated current within the limit");
+        }
+    }
+
+    const float t_max = torque(ld, lq, table.id[FOC_MTPA_TABLE_I_POINTS - 1][FOC_MTPA_TABLE_PSI_POINTS - 1],
+            table.iq[FOC_MTPA_TABLE_I_POINTS - 1][FOC_MTPA_TABLE_PSI_POINTS - 1]);
+    printf("    Max torque interpolation error: %.3f Nm (%.1f %% of max)\n",
+           (double)err_max, (double)(100.0f * err_max / t_max));
+    TEST_ASSERT(err_max < 0.05f * t_max, "Torque interpolation error below 5 % of max");
+
+    // The same parameters are not generated again, others are
+    table.id[3][3] = 1234.0f;
+    foc_mtpa_table_generate(&table, ld, lq, MOTOR_LAMBDA, I_MAX);
+    TEST_ASSERT(table.id[3][3] == 1234.0f, "Unchanged parameters keep the table");
+    foc_mtpa_table_generate(&table, ld, lq, MOTOR_LAMBDA, 0.9f * I_MAX);
+    TEST_ASSERT(table.valid && table.id[3][3] != 1234.0f, "New parameters regenerate the table");
+
+    foc_mtpa_table_generate(&table, ld, lq, 0.0f, I_MAX);
+    TEST_ASSERT(!table.valid, "Invalid parameters disable the table");
+
+    // Only generated in table mode
+    static mc_configuration conf;
+    static motor_all_state_t motor;
+    setup_conf(&conf, MTPA_MODE_IQ_TARGET);
+    foc_motor_state_init(&motor, &conf);
+    foc_precalc_values(&motor);
+    TEST_ASSERT(!motor.m_mtpa_table.valid, "No table in the other MTPA modes");
+    conf.foc_mtpa_mode = MTPA_MODE_TABLE;
+    foc_precalc_values(&motor);
+    TEST_ASSERT(motor.m_mtpa_table.valid, "Table in table mode");
+
+    return true;
+}
+
+static bool test_efficiency(void) {
+    result_t online[NUM_SCENARIOS], table[NUM_SCENARIOS];
+
+    printf("    %-16s %7s | %8s %8s %6s %6s | %8s %8s %6s %6s\n", "", "we",
+           "T onl", "Pcu onl", "I onl", "eff", "T tab", "Pcu tab", "I tab", "eff");
+    for (int s = 0; s < NUM_SCENARIOS; s++) {
+        run_scenario(&scenarios[s], MTPA_MODE_IQ_TARGET, &online[s]);
+        run_scenario(&scenarios[s], MTPA_MODE_TABLE, &table[s]);
+        printf("    %-16s %7.0f | %8.3f %8.1f %6.1f %5.1f%% | %8.3f %8.1f %6.1f %5.1f%%\n",
+               scenarios[s].name, (double)scenarios[s].omega_e,
+               (double)online[s].torque, (double)online[s].p_cu, (double)online[s].i_abs,
+               (double)(100.0f * online[s].eff),
+               (double)table[s].torque, (double)table[s].p_cu, (double)table[s].i_abs,
+               (double)(100.0f * table[s].eff));
+    }
+
+    // Below base speed both are the same MTPA point
+    TEST_ASSERT(fabsf(table[0].torque - online[0].torque) < 0.01f * online[0].torque,
+                "Same torque in the MTPA region");
+    TEST_ASSERT(fabsf(table[0].eff - online[0].eff) < 0.002f, "Same efficiency in the MTPA region");
+
+    for (int s = 1; s < NUM_SCENARIOS; s++) {
+        // The duty cycle based field weakening adds its current on top of the
+        // command, so the paths are compared per ampere
+        TEST_ASSERT(table[s].torque > 0.0f, "Table produces torque");
+        TEST_ASSERT(table[s].torque / table[s].i_abs >= online[s].torque / online[s].i_abs,
+                    "Table torque per ampere not below online");
+        TEST_ASSERT(table[s].eff >= online[s].eff, "Table efficiency not below online");
+        TEST_ASSERT(table[s].i_abs <= scenarios[s].current * 1.02f, "Table stays within the commanded current");
+    }
+
+    return true;
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+int main(void) {
+    printf("========================================\n");
+    printf("MTPA Table Tests\n");
+    printf("========================================\n\n");
+
+    RUN_TEST(test_solve_regions);
+    RUN_TEST(test_interpolation);
+    RUN_TEST(test_efficiency);
+
+    printf("\n========================================\n");
+    printf("Total: %d, Passed: %d, Failed: %d\n", total_tests, passed_tests, test_failures);
+    printf("========================================\n");
+
+    return test_failures > 0 ? 1 : 0;
+}
@@ -50,6 +50,7 @@ static int passed_tests = 0;
 
 #include "../motor_sim/simulation_driver.h"
 #include "../motor_sim/simulation_data.h"
+#include "../motor_sim/simulation_regression.h"
 #include <stddef.h>
 
 // Maximum records to load
@@ -441,6 +442,204 @@ bool test_statistics_calculation(void) {
     return true;
 }
 
+// ==================== Manifest Regression Tests ====================
+
+bool test_manifest_parse(void) {
+    const char *text =
+        "# comment\n"
+        "[defaults]\n"
+        "tol.iq = 0.2 0.05\n"
+        "duration = 0.05\n"
+        "\n"
+        "[first]\n"
+        "preset = medium\n"
+        "mode = speed\n"
+        "setpoint = step 0.01 0 2000  # inline comment\n"
+        "load = ramp 0.02 0.04 0 0.1\n"
+        "inverter = averaged\n"
+        "reference = golden/first.csv\n"
+        "\n"
+        "[second]\n"
+        "align = dtw\n"
+        "tol.iq = 0.5\n"
+        "setpoint = pwl 0:0 0.01:5 0.02:5\n"
+        "reference = /tmp/second.csv\n";
+    
+    sim_reg_scenario_t *scn = NULL;
+    char err[128];
+    int n = sim_reg_parse_manifest(text, "reference", &scn, err, sizeof(err));
+    TEST_ASSERT(n == 2, "Two scenarios parsed");
+    
+    TEST_ASSERT(strcmp(scn[0].name, "first") == 0, "Scenario name");
+    TEST_ASSERT(scn[0].mode == SIM_CTRL_SPEED, "Mode");
+    TEST_ASSERT(scn[0].inverter_enable && scn[0].inverter_mode == INVERTER_MODE_AVERAGED, "Inverter");
+    TEST_ASSERT(strcmp(scn[0].reference, "reference/golden/first.csv") == 0, "Reference relative to manifest");
+    TEST_ASSERT_FLOAT_NEAR(scn[0].duration, 0.05f, 1e-7f, "Duration from defaults");
+    TEST_ASSERT(scn[0].tol[SIM_DATA_FIELD_INDEX(iq)].enable, "Tolerance from defaults");
+    TEST_ASSERT_FLOAT_NEAR(scn[0].tol[SIM_DATA_FIELD_INDEX(iq)].rel_tol, 0.05f, 1e-7f, "Relative tolerance");
+    TEST_ASSERT(!scn[0].tol[SIM_DATA_FIELD_INDEX(id)].enable, "Unlisted signal not checked");
+    
+    // Keys of one scenario do not leak into the next
+    TEST_ASSERT(scn[1].mode == SIM_CTRL_CURRENT, "Default mode");
+    TEST_ASSERT(!scn[1].inverter_enable, "Default inverter");
+    TEST_ASSERT(scn[1].align == SIM_REG_ALIGN_DTW, "Alignment");
+    TEST_ASSERT_FLOAT_NEAR(scn[1].tol[SIM_DATA_FIELD_INDEX(iq)].abs_tol, 0.5f, 1e-7f, "Overridden tolerance");
+    TEST_ASSERT_FLOAT_NEAR(scn[1].tol[SIM_DATA_FIELD_INDEX(iq)].rel_tol, 0.0f, 1e-7f, "Overridden relative tolerance");
+    TEST_ASSERT(strcmp(scn[1].reference, "/tmp/second.csv") == 0, "Absolute reference kept");
+    free(scn);
+    
+    // Errors report the line
+    const char *bad[] = {
+        "[a]\nmode = fast\n",
+        "[a]\nsetpoint = step 0.01 0\n",
+        "[a]\ntol.nothing = 1\n",
+        "[a]\nduration = -1\n",
+        "[a]\nreference\n",
+    };
+    for (int i = 0; i < 5; i++) {
+        scn = NULL;
+        err[0] = '\0';
+        n = sim_reg_parse_manifest(bad[i], NULL, &scn, err, sizeof(err));
+        TEST_ASSERT(n < 0, "Bad manifest rejected");
+        TEST_ASSERT(strncmp(err, "line ", 5) == 0, "Error names the line");
+        free(scn);
+    }
+    
+    return true;
+}
+
+bool test_manifest_profiles(void) {
+    sim_reg_profile_t p;
+    char text[96];
+    sim_reg_scenario_t *scn = NULL;
+    char err[128];
+    
+    snprintf(text, sizeof(text), "[a]\nsetpoint = ramp 0.1 0.2 0 10\nreference = a.csv\n");
+    TEST_ASSERT(sim_reg_parse_manifest(text, NULL, &scn, err, sizeof(err)) == 1, "Ramp parsed");
+    p = scn[0].setpoint;
+    free(scn);
+    TEST_ASSERT_FLOAT_NEAR(sim_reg_profile_eval(&p, 0.0f), 0.0f, 1e-6f, "Ramp before start");
+    TEST_ASSERT_FLOAT_NEAR(sim_reg_profile_eval(&p, 0.15f), 5.0f, 1e-4f, "Ramp midpoint");
+    TEST_ASSERT_FLOAT_NEAR(sim_reg_profile_eval(&p, 1.0f), 10.0f, 1e-6f, "Ramp after end");
+    
+    snprintf(text, sizeof(text), "[a]\nsetpoint = steps 0:1 0.1:2 0.2:-3\nreference = a.csv\n");
+    TEST_ASSERT(sim_reg_parse_manifest(text, NULL, &scn, err, sizeof(err)) == 1, "Steps parsed");
+    p = scn[0].setpoint;
+    free(scn);
+    TEST_ASSERT_FLOAT_NEAR(sim_reg_profile_eval(&p, 0.05f), 1.0f, 1e-6f, "First step held");
+    TEST_ASSERT_FLOAT_NEAR(sim_reg_profile_eval(&p, 0.15f), 2.0f, 1e-6f, "Second step held");
+    TEST_ASSERT_FLOAT_NEAR(sim_reg_profile_eval(&p, 0.5f), -3.0f, 1e-6f, "Last step held");
+    
+    snprintf(text, sizeof(text), "[a]\nsetpoint = 7\nreference = a.csv\n");
+    TEST_ASSERT(sim_reg_parse_manifest(text, NULL, &scn, err, sizeof(err)) == 1, "Constant parsed");
+    p = scn[0].setpoint;
+    free(scn);
+    TEST_ASSERT_FLOAT_NEAR(sim_reg_profile_eval(&p, 0.3f), 7.0f, 1e-6f, "Constant");
+    
+    return true;
+}
+
+bool test_compare_lag(void) {
+    const int n = 200;
+    float ref[200], test[200];
+    
+    // Test trace delayed by 3 samples
+    for (int i = 0; i < n; i++) {
+        ref[i] = (i >= 50) ? 5.0f : 0.0f;
+        test[i] = (i >= 53) ? 5.0f : 0.0f;
+    }
+    
+    sim_reg_tolerance_t tol = {true, 0.1f, 0.0f};
+    sim_reg_signal_result_t r;
+    
+    sim_reg_compare_signal(ref, test, n, 1, &tol, SIM_REG_ALIGN_NONE, 0, 0.001f, &r);
+    TEST_ASSERT(r.checked && !r.pass, "Delay fails without alignment");
+    TEST_ASSERT_FLOAT_NEAR(r.max_error, 5.0f, 1e-6f, "Error of the delayed edge");
+    
+    sim_reg_compare_signal(ref, test, n, 1, &tol, SIM_REG_ALIGN_LAG, 5, 0.001f, &r);
+    TEST_ASSERT(r.pass, "Delay passes with lag search");
+    TEST_ASSERT_FLOAT_NEAR(r.lag, 0.003f, 1e-6f, "Detected lag");
+    
+    sim_reg_compare_signal(ref, test, n, 1, &tol, SIM_REG_ALIGN_LAG, 2, 0.001f, &r);
+    TEST_ASSERT(!r.pass, "Delay beyond max_lag fails");
+    
+    return true;
+}
+
+bool test_compare_dtw(void) {
+    const int n = 200;
+    float ref[200], test[200];
+    
+    // Same ramp, but the test trace is locally stretched: it reaches the
+    // ramp later and catches up by the end, so no constant shift fits
+    for (int i = 0; i < n; i++) {
+        ref[i] = (i < 40) ? 0.0f : (i < 140) ? (float)(i - 40) * 0.1f : 10.0f;
+        test[i] = (i < 46) ? 0.0f : (i < 140) ? (float)(i - 46) * (10.0f / 94.0f) : 10.0f;
+    }
+    
+    sim_reg_tolerance_t tol = {true, 0.1f, 0.0f};
+    sim_reg_signal_result_t r;
+    
+    sim_reg_compare_signal(ref, test, n, 1, &tol, SIM_REG_ALIGN_LAG, 8, 0.001f, &r);
+    TEST_ASSERT(!r.pass, "Stretch fails with lag search");
+    
+    sim_reg_compare_signal(ref, test, n, 1, &tol, SIM_REG_ALIGN_DTW, 8, 0.001f, &r);
+    TEST_ASSERT(r.pass, "Stretch passes with time warping");
+    TEST_ASSERT(r.lag > 0.0f && r.lag <= 0.008f + 1e-6f, "Warp within band");
+    
+    // A real amplitude difference is not absorbed
+    test[160] += 1.0f;
+    sim_reg_compare_signal(ref, test, n, 1, &tol, SIM_REG_ALIGN_DTW, 8, 0.001f, &r);
+    TEST_ASSERT(!r.pass, "Amplitude error fails with time warping");
+    
+    return true;
+}
+
+bool test_manifest_run(void) {
+    sim_reg_scenario_t *scn = NULL;
+    char err[256];
+    int n = sim_reg_load_manifest("reference/scenarios.manifest", &scn, err, sizeof(err));
+    if (n < 0) printf("  %s\n", err);
+    TEST_ASSERT(n > 10, "Manifest loaded");
+    
+    sim_reg_result_t *serial = calloc((size_t)n, sizeof(sim_reg_result_t));
+    sim_reg_result_t *parallel = calloc((size_t)n, sizeof(sim_reg_result_t));
+    TEST_ASSERT(serial != NULL && parallel != NULL, "Allocate results");
+    
+    int failed = sim_reg_run(scn, parallel, n, 4);
+    for (int i = 0; i < n; i++) {
+        if (!parallel[i].pass) printf("  %s failed\n", scn[i].name);
+    }
+    TEST_ASSERT(failed == 0, "All scenarios match their golden traces");
+    
+    // Scenarios run concurrently must not influence each other
+    TEST_ASSERT(sim_reg_run(scn, serial, n, 1) == 0, "Serial run passes");
+    for (int i = 0; i < n; i++) {
+        TEST_ASSERT(serial[i].trace_count == parallel[i].trace_count, "Same trace length");
+        TEST_ASSERT(memcmp(serial[i].trace, parallel[i].trace,
+                           sizeof(sim_data_record_t) * (size_t)serial[i].trace_count) == 0,
+                    "Identical traces on 1 and 4 threads");
+    }
+    
+    TEST_ASSERT(sim_reg_save_summary("results/regression_test_summary.json",
+                                     scn, parallel, n, 0.0) == 0, "Summary written");
+    FILE *f = fopen("results/regression_test_summary.json", "r");
+    TEST_ASSERT(f != NULL, "Summary exists");
+    char buf[256];
+    size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[len] = '\0';
+    TEST_ASSERT(strchr(buf, '{') != NULL && strstr(buf, "\"scenarios\"") != NULL, "Summary is JSON");
+    
+    sim_reg_free_results(serial, n);
+    sim_reg_free_results(parallel, n);
+    free(serial);
+    free(parallel);
+    free(scn);
+    
+    return true;
+}
+
 // ==================== Main ====================
 
 int main(int argc, char **argv) {
@@ -463,6 +662,14 @@ int main(int argc, char **argv) {
     RUN_TEST(test_torque_step_regression);
     RUN_TEST(test_hfi_operation_regression);
     
+    // Manifest regression tests
+    printf("\n--- Manifest Regression Tests ---\n");
+    RUN_TEST(test_manifest_parse);
+    RUN_TEST(test_manifest_profiles);
+    RUN_TEST(test_compare_lag);
+    RUN_TEST(test_compare_dtw);
+    RUN_TEST(test_manifest_run);
+    
     // Summary
     printf("\n========================================\n");
     printf("Regression Test Results: %d/%d passed\n", passed_tests, total_tests);
@@ -0,0 +1,189 @@
+/**
+ * @file test_sim_sweep.c
+ * @brief Tests for the parallel parameter sweep engine
+ * 
+ * Validates:
+ * - Independent simulation contexts (no shared motor state)
+ * - Parallel sweep results identical to serial execution
+ * - Step response metrics and summary table output
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+
+// Test framework
+#define TEST_ASSERT(cond, msg) do { \
+    if (!(cond)) { \
+        printf("  FAIL: %s (line %d)\n", msg, __LINE__); \
+        test_failures++; \
+        return false; \
+    } \
+} while(0)
+
+#define RUN_TEST(test_func) do { \
+    printf("Running %s...\n", #test_func); \
+    total_tests++; \
+    if (test_func()) { \
+        printf("  PASS\n"); \
+        passed_tests++; \
+    } \
+} while(0)
+
+static int test_failures = 0;
+static int total_tests = 0;
+static int passed_tests = 0;
+
+#include "../motor_sim/simulation_sweep.h"
+
+#define SWEEP_JOBS  16
+
+static void make_kp_sweep(sim_sweep_job_t *jobs, int count) {
+    for (int i = 0; i < count; i++) {
+        sim_sweep_job_init(&jobs[i], NULL);
+        jobs[i].mc_conf.foc_current_kp = 0.005f + 0.005f * (float)i;
+        jobs[i].command.mode = SIM_CTRL_CURRENT;
+        jobs[i].command.iq_ref = 5.0f;
+        jobs[i].duration = 0.02f;
+        snprintf(jobs[i].label, SIM_SWEEP_LABEL_LEN, "kp_%.3f", jobs[i].mc_conf.foc_current_kp);
+    }
+}
+
+// ==================== Context Isolation Tests ====================
+
+bool test_contexts_are_independent(void) {
+    static sim_context_t a, b, ref;
+    
+    sim_init(&ref);
+    sim_set_timing(&ref, 1.0f/20000.0f, 1.0f/100000.0f, 1.0f/1000.0f, 0.01f);
+    sim_command_t cmd = {0};
+    cmd.mode = SIM_CTRL_CURRENT;
+    cmd.iq_ref = 5.0f;
+    sim_set_reference(&ref, &cmd);
+    TEST_ASSERT(sim_run(&ref) == 0, "Reference run completed");
+    
+    // Step two contexts interleaved, one of them with a different load
+    sim_init(&a);
+    sim_init(&b);
+    sim_set_timing(&a, 1.0f/20000.0f, 1.0f/100000.0f, 1.0f/1000.0f, 0.01f);
+    sim_set_timing(&b, 1.0f/20000.0f, 1.0f/100000.0f, 1.0f/1000.0f, 0.01f);
+    sim_set_reference(&a, &cmd);
+    cmd.iq_ref = -3.0f;
+    sim_set_reference(&b, &cmd);
+    sim_set_load_torque(&b, 0.01f);
+    
+    sim_start(&a);
+    sim_start(&b);
+    while (a.state == SIM_STATE_RUNNING || b.state == SIM_STATE_RUNNING) {
+        sim_step(&a);
+        sim_step(&b);
+    }
+    
+    TEST_ASSERT(a.vm.id == ref.vm.id && a.vm.iq == ref.vm.iq, "Currents unaffected by other context");
+    TEST_ASSERT(a.vm.we == ref.vm.we && a.vm.phi == ref.vm.phi, "Mechanics unaffected by other context");
+    TEST_ASSERT(b.vm.iq < 0.0f, "Second context followed its own reference");
+    
+    return true;
+}
+
+// ==================== Sweep Tests ====================
+
+bool test_parallel_matches_serial(void) {
+    sim_sweep_job_t *jobs = malloc(sizeof(sim_sweep_job_t) * SWEEP_JOBS);
+    sim_sweep_result_t *serial = malloc(sizeof(sim_sweep_result_t) * SWEEP_JOBS);
+    sim_sweep_result_t *parallel = malloc(sizeof(sim_sweep_result_t) * SWEEP_JOBS);
+    TEST_ASSERT(jobs && serial && parallel, "Allocation");
+    
+    make_kp_sweep(jobs, SWEEP_JOBS);
+    
+    for (int i = 0; i < SWEEP_JOBS; i++) {
+        sim_sweep_run_job(&jobs[i], &serial[i]);
+    }
+    
+    int failed = sim_sweep_run(jobs, parallel, SWEEP_JOBS, 4);
+    
+    bool same = true;
+    for (int i = 0; i < SWEEP_JOBS; i++) {
+        if (serial[i].result != parallel[i].result ||
+            serial[i].final_iq != parallel[i].final_iq ||
+            serial[i].final_erpm != parallel[i].final_erpm ||
+            serial[i].metrics.rms_error != parallel[i].metrics.rms_error) {
+            printf("    Job %d differs: iq %.6f vs %.6f\n", i,
+                   serial[i].final_iq, parallel[i].final_iq);
+            same = false;
+        }
+    }
+    
+    free(jobs);
+    free(serial);
+    free(parallel);
+    
+    TEST_ASSERT(failed == 0, "All sweep jobs completed");
+    TEST_ASSERT(same, "Parallel results identical to serial");
+    
+    return true;
+}
+
+bool test_response_metrics(void) {
+    sim_sweep_job_t job;
+    sim_sweep_result_t res;
+    
+    sim_sweep_job_init(&job, NULL);
+    job.command.iq_ref = 5.0f;
+    job.duration = 0.05f;
+    sim_sweep_run_job(&job, &res);
+    
+    printf("    settling=%.5f s, overshoot=%.2f %%, rms=%.4f A\n",
+           res.metrics.settling_time, res.metrics.overshoot, res.metrics.rms_error);
+    
+    TEST_ASSERT(res.result == 0, "Job completed");
+    TEST_ASSERT(!isnan(res.metrics.rms_error) && res.metrics.rms_error > 0.0f, "RMS error valid");
+    TEST_ASSERT(res.metrics.overshoot >= 0.0f, "Overshoot non-negative");
+    TEST_ASSERT(res.metrics.settling_time <= job.duration, "Settling time within run");
+    
+    return true;
+}
+
+bool test_summary_table(void) {
+    sim_sweep_job_t jobs[4];
+    sim_sweep_result_t results[4];
+    
+    make_kp_sweep(jobs, 4);
+    TEST_ASSERT(sim_sweep_run(jobs, results, 4, 0) == 0, "Sweep on all CPUs completed");
+    TEST_ASSERT(sim_sweep_save_summary("results/sweep_summary.csv", jobs, results, 4) == 0,
+                "Summary written");
+    
+    FILE *f = fopen("results/sweep_summary.csv", "r");
+    TEST_ASSERT(f != NULL, "Summary readable");
+    
+    char line[512];
+    int lines = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        lines++;
+    }
+    fclose(f);
+    
+    TEST_ASSERT(lines == 5, "Header plus one row per job");
+    
+    return true;
+}
+
+// ==================== Main ====================
+
+int main(void) {
+    printf("=== Simulation Sweep Tests ===\n\n");
+    printf("Host CPUs: %d\n\n", sim_sweep_get_num_cpus());
+    
+    RUN_TEST(test_contexts_are_independent);
+    RUN_TEST(test_parallel_matches_serial);
+    RUN_TEST(test_response_metrics);
+    RUN_TEST(test_summary_table);
+    
+    printf("\n=== Test Summary ===\n");
+    printf("Total: %d, Passed: %d, Failed: %d\n", 
+           total_tests, passed_tests, total_tests - passed_tests);
+    
+    return (passed_tests == total_tests) ? 0 : 1;
+}
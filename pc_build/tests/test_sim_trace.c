@@ -0,0 +1,377 @@
+/**
+ * @file test_sim_trace.c
+ * @brief Tests for the chunked columnar trace format
+ *
+ * Validates:
+ * - Roundtrip through the sim_data_* API (.simt files)
+ * - Lossless DELTA and bounded-error QUANT16 codecs
+ * - Zero-copy RAW columns and recovery of truncated traces
+ * - Streaming statistics/comparison match the in-memory functions
+ * - Bounded resident memory on a large trace, and read speed vs CSV
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+// Test framework
+#define TEST_ASSERT(cond, msg) do { \
+    if (!(cond)) { \
+        printf("  FAIL: %s (line %d)\n", msg, __LINE__); \
+        test_failures++; \
+        return false; \
+    } \
+} while(0)
+
+#define RUN_TEST(test_func) do { \
+    printf("Running %s...\n", #test_func); \
+    total_tests++; \
+    if (test_func()) { \
+        printf("  PASS\n"); \
+        passed_tests++; \
+    } \
+} while(0)
+
+static int test_failures = 0;
+static int total_tests = 0;
+static int passed_tests = 0;
+
+#include "../motor_sim/simulation_data.h"
+
+#define TRACE_FILE      "results/trace_test.simt"
+#define TRACE_FILE_B    "results/trace_test_b.simt"
+#define TRACE_CSV       "results/trace_test.csv"
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static long max_rss_kb(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+// Motor-like synthetic record
+static void make_record(int i, sim_data_record_t *rec) {
+    float t = (float)i * 50e-6f;
+    rec->time = t;
+    rec->id = 0.5f * sinf(t * 37.0f);
+    rec->iq = 10.0f + 2.0f * sinf(t * 11.0f);
+    rec->vd = -1.0f + 0.1f * cosf(t * 37.0f);
+    rec->vq = 12.0f + 0.01f * (float)(i % 100);
+    rec->theta_e = fmodf(t * 2000.0f, 6.2831853f);
+    rec->omega_e = 2000.0f + 50.0f * sinf(t);
+    rec->omega_m = rec->omega_e / 7.0f;
+    rec->torque = 0.1f * rec->iq;
+}
+
+static int write_trace(const char *file, int count, uint32_t chunk) {
+    sim_trace_options_t opt;
+    sim_trace_default_options(&opt);
+    opt.chunk_records = chunk;
+
+    sim_trace_writer_t *w = sim_trace_writer_open(file, SIM_DATA_NUM_FIELDS, NULL, &opt);
+    if (w == NULL) return -1;
+
+    for (int i = 0; i < count; i++) {
+        sim_data_record_t rec;
+        make_record(i, &rec);
+        sim_trace_writer_append(w, (const float*)&rec);
+    }
+    return sim_trace_writer_close(w);
+}
+
+// ==================== Format Tests ====================
+
+bool test_sim_data_roundtrip(void) {
+    const int n = 10000;
+
+    TEST_ASSERT(sim_data_open_write(TRACE_FILE) == 0, "Open trace for writing");
+    for (int i = 0; i < n; i++) {
+        sim_data_record_t rec;
+        make_record(i, &rec);
+        TEST_ASSERT(sim_data_write_record(&rec) == 0, "Write record");
+    }
+    sim_data_close();
+
+    TEST_ASSERT(sim_data_open_read(TRACE_FILE) == n, "Record count from header");
+    for (int i = 0; i < n; i++) {
+        sim_data_record_t rec, exp;
+        make_record(i, &exp);
+        TEST_ASSERT(sim_data_read_record(&rec) == 0, "Read record");
+        TEST_ASSERT(memcmp(&rec, &exp, sizeof(rec)) == 0, "Bit-exact record");
+    }
+    sim_data_record_t rec;
+    TEST_ASSERT(sim_data_read_record(&rec) == 1, "EOF after last record");
+    sim_data_close_read();
+
+    sim_trace_t *t = sim_trace_open(TRACE_FILE);
+    TEST_ASSERT(t != NULL, "Open with trace reader");
+    TEST_ASSERT(sim_trace_find_column(t, "omega_m") == SIM_DATA_FIELD_INDEX(omega_m),
+                "Schema column names");
+    TEST_ASSERT(sim_trace_num_chunks(t) == (n + SIM_TRACE_DEFAULT_CHUNK - 1) / SIM_TRACE_DEFAULT_CHUNK,
+                "Chunk count");
+    sim_trace_close(t);
+
+    return true;
+}
+
+bool test_codecs(void) {
+    const int n = 3000;
+    const char *names[3] = {"delta", "quant", "quant_nan"};
+    sim_trace_options_t opt;
+    sim_trace_default_options(&opt);
+    opt.chunk_records = 1000;
+    opt.codec[0] = SIM_TRACE_CODEC_DELTA;
+    opt.codec[1] = SIM_TRACE_CODEC_QUANT16;
+    opt.codec[2] = SIM_TRACE_CODEC_QUANT16;
+
+    // Awkward values for the lossless codec: sign changes, zeros, specials
+    float special[] = {0.0f, -0.0f, INFINITY, -INFINITY, NAN, 1e-40f, -3.4e38f};
+
+    sim_trace_writer_t *w = sim_trace_writer_open(TRACE_FILE, 3, names, &opt);
+    TEST_ASSERT(w != NULL, "Open writer");
+    for (int i = 0; i < n; i++) {
+        float row[3];
+        row[0] = (i % 10 == 0) ? special[(i / 10) % 7] : sinf((float)i * 0.01f) * (float)i;
+        row[1] = 100.0f * sinf((float)i * 0.003f);
+        row[2] = (i == 1500) ? NAN : row[1];
+        TEST_ASSERT(sim_trace_writer_append(w, row) == 0, "Append");
+    }
+    TEST_ASSERT(sim_trace_writer_close(w) == 0, "Close writer");
+
+    sim_trace_t *t = sim_trace_open(TRACE_FILE);
+    TEST_ASSERT(t != NULL, "Open reader");
+    TEST_ASSERT(sim_trace_num_records(t) == (uint64_t)n, "Record count");
+
+    float max_err = 0.0f;
+    int i = 0;
+    for (int c = 0; c < sim_trace_num_chunks(t); c++) {
+        const float *d = sim_trace_column(t, c, 0);
+        const float *q = sim_trace_column(t, c, 1);
+        const float *qn = sim_trace_column(t, c, 2);
+        TEST_ASSERT(d != NULL && q != NULL && qn != NULL, "Decode columns");
+
+        for (uint32_t k = 0; k < sim_trace_chunk_records(t, c); k++, i++) {
+            float exp = (i % 10 == 0) ? special[(i / 10) % 7] : sinf((float)i * 0.01f) * (float)i;
+            float expq = 100.0f * sinf((float)i * 0.003f);
+            TEST_ASSERT(memcmp(&d[k], &exp, sizeof(float)) == 0, "DELTA is lossless");
+
+            float err = fabsf(q[k] - expq);
+            if (err > max_err) max_err = err;
+
+            if (i == 1500) {
+                TEST_ASSERT(isnan(qn[k]), "NaN block falls back to RAW");
+            } else if (c == 1) {
+                TEST_ASSERT(qn[k] == expq, "RAW fallback is exact");
+            }
+        }
+    }
+
+    printf("    QUANT16 max error %.5f (bound %.5f)\n", max_err, 200.0f / 131070.0f);
+    TEST_ASSERT(max_err <= 200.0f / 131070.0f * 1.01f, "QUANT16 error within half a step");
+    sim_trace_close(t);
+
+    return true;
+}
+
+bool test_zero_copy_and_truncation(void) {
+    TEST_ASSERT(write_trace(TRACE_FILE, 2500, 1000) == 0, "Write trace");
+
+    sim_trace_t *t = sim_trace_open(TRACE_FILE);
+    TEST_ASSERT(t != NULL, "Open reader");
+
+    // RAW blocks live in the mapping, decoded blocks share one scratch buffer
+    const float *raw0 = sim_trace_column(t, 0, 1);
+    const float *raw1 = sim_trace_column(t, 1, 1);
+    const float *dec0 = sim_trace_column(t, 0, 0);
+    const float *dec1 = sim_trace_column(t, 1, 0);
+    TEST_ASSERT(raw0 != NULL && raw1 != NULL && raw0 != raw1, "RAW blocks are distinct views");
+    TEST_ASSERT(((uintptr_t)raw0 & 3) == 0, "RAW blocks are float aligned");
+    TEST_ASSERT(dec0 == dec1, "Decoded blocks reuse the scratch buffer");
+    TEST_ASSERT(sim_trace_chunk_records(t, 2) == 500, "Partial last chunk");
+    sim_trace_close(t);
+
+    // Cut the file in the middle of the last chunk
+    FILE *f = fopen(TRACE_FILE, "rb");
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    TEST_ASSERT(truncate(TRACE_FILE, size - 100) == 0, "Truncate");
+
+    t = sim_trace_open(TRACE_FILE);
+    TEST_ASSERT(t != NULL, "Truncated trace opens");
+    TEST_ASSERT(sim_trace_num_records(t) == 2000, "Complete chunks kept");
+    sim_trace_close(t);
+
+    f = fopen(TRACE_FILE_B, "w");
+    fprintf(f, "time,id,iq,vd,vq,theta_e,omega_e,omega_m,torque\n0,0,0,0,0,0,0,0,0\n");
+    fclose(f);
+    TEST_ASSERT(sim_trace_open(TRACE_FILE_B) == NULL, "Non-trace rejected");
+    TEST_ASSERT(sim_trace_open("results/does_not_exist.simt") == NULL, "Missing file rejected");
+
+    return true;
+}
+
+// ==================== Streaming Tests ====================
+
+bool test_streaming_matches_arrays(void) {
+    const int n = 20000;
+    sim_data_record_t *ref = malloc(sizeof(sim_data_record_t) * n);
+    sim_data_record_t *test = malloc(sizeof(sim_data_record_t) * n);
+    TEST_ASSERT(ref != NULL && test != NULL, "Allocate");
+
+    for (int i = 0; i < n; i++) {
+        make_record(i, &ref[i]);
+        test[i] = ref[i];
+    }
+    test[123].iq += 1.0f;
+    test[4096].torque += 1.0f;
+    test[19999].vd += 1.0f;
+
+    // Different chunk sizes on both sides exercise the span logic
+    sim_trace_options_t opt;
+    sim_trace_default_options(&opt);
+    opt.chunk_records = 1000;
+    sim_trace_writer_t *w = sim_trace_writer_open(TRACE_FILE, SIM_DATA_NUM_FIELDS, NULL, &opt);
+    opt.chunk_records = 777;
+    sim_trace_writer_t *wb = sim_trace_writer_open(TRACE_FILE_B, SIM_DATA_NUM_FIELDS, NULL, &opt);
+    TEST_ASSERT(w != NULL && wb != NULL, "Open writers");
+    for (int i = 0; i < n; i++) {
+        sim_trace_writer_append(w, (const float*)&ref[i]);
+        sim_trace_writer_append(wb, (const float*)&test[i]);
+    }
+    TEST_ASSERT(sim_trace_writer_close(w) == 0 && sim_trace_writer_close(wb) == 0, "Close writers");
+
+    sim_trace_t *tr = sim_trace_open(TRACE_FILE);
+    sim_trace_t *tt = sim_trace_open(TRACE_FILE_B);
+    TEST_ASSERT(tr != NULL && tt != NULL, "Open readers");
+
+    for (int j = 0; j < SIM_DATA_NUM_FIELDS; j++) {
+        sim_data_stats_t sa, st;
+        TEST_ASSERT(sim_data_calc_stats(ref, n, j * (int)sizeof(float), &sa) == 0, "Array stats");
+        TEST_ASSERT(sim_data_calc_stats_trace(tr, j, &st) == 0, "Trace stats");
+        TEST_ASSERT(sa.min_value == st.min_value && sa.max_value == st.max_value, "Min/max match");
+        TEST_ASSERT(sa.mean_value == st.mean_value && sa.rms_value == st.rms_value &&
+                    sa.std_dev == st.std_dev, "Moments match");
+    }
+
+    int ea = sim_data_compare(ref, test, n, NULL, 100);
+    int et = sim_data_compare_trace(tr, tt, NULL, 100);
+    TEST_ASSERT(ea == 3 && et == 3, "Both find the injected mismatches");
+    TEST_ASSERT(sim_data_compare_trace(tr, tt, NULL, 2) == 2, "Error limit respected");
+    TEST_ASSERT(sim_data_compare_trace(tr, tr, NULL, 100) == 0, "Trace equals itself");
+
+    sim_trace_close(tr);
+    sim_trace_close(tt);
+    free(ref);
+    free(test);
+    return true;
+}
+
+bool test_large_trace_bounded_memory(void) {
+    const int n = 2000000;
+
+    double t0 = now_s();
+    TEST_ASSERT(write_trace(TRACE_FILE, n, SIM_TRACE_DEFAULT_CHUNK) == 0, "Write large trace");
+    double t_write = now_s() - t0;
+
+    FILE *f = fopen(TRACE_FILE, "rb");
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+
+    long rss_before = max_rss_kb();
+    sim_trace_t *t = sim_trace_open(TRACE_FILE);
+    TEST_ASSERT(t != NULL, "Open large trace");
+
+    t0 = now_s();
+    sim_data_stats_t stats;
+    for (int j = 0; j < SIM_DATA_NUM_FIELDS; j++) {
+        TEST_ASSERT(sim_data_calc_stats_trace(t, j, &stats) == 0, "Stream stats");
+    }
+    TEST_ASSERT(sim_data_compare_trace(t, t, NULL, 10) == 0, "Stream compare");
+    double t_read = now_s() - t0;
+    long rss_growth = max_rss_kb() - rss_before;
+    sim_trace_close(t);
+
+    printf("    %d records, %.1f MB (%.1f B/record), write %.3f s, 9 stats + compare %.3f s\n",
+           n, (double)size / 1e6, (double)size / n, t_write, t_read);
+    printf("    peak RSS growth while streaming: %ld kB\n", rss_growth);
+
+    TEST_ASSERT(size < (long)n * (long)sizeof(sim_data_record_t), "Time column compressed");
+    TEST_ASSERT(rss_growth * 1024L < size / 4, "Resident memory stays well below trace size");
+
+    return true;
+}
+
+bool test_read_speed_vs_csv(void) {
+    const int n = 200000;
+
+    TEST_ASSERT(sim_data_open_write(TRACE_CSV) == 0, "Open CSV");
+    for (int i = 0; i < n; i++) {
+        sim_data_record_t rec;
+        make_record(i, &rec);
+        sim_data_write_record(&rec);
+    }
+    sim_data_close();
+    TEST_ASSERT(write_trace(TRACE_FILE, n, SIM_TRACE_DEFAULT_CHUNK) == 0, "Write trace");
+
+    sim_data_stats_t s_csv, s_col;
+    sim_data_record_t *recs = malloc(sizeof(sim_data_record_t) * n);
+    TEST_ASSERT(recs != NULL, "Allocate");
+
+    double t0 = now_s();
+    sim_data_open_read(TRACE_CSV);
+    int count = sim_data_read_all(recs, n);
+    sim_data_close_read();
+    sim_data_calc_stats(recs, count, SIM_DATA_FIELD_INDEX(iq) * (int)sizeof(float), &s_csv);
+    double t_csv = now_s() - t0;
+    free(recs);
+
+    t0 = now_s();
+    sim_trace_t *t = sim_trace_open(TRACE_FILE);
+    sim_data_calc_stats_trace(t, SIM_DATA_FIELD_INDEX(iq), &s_col);
+    sim_trace_close(t);
+    double t_col = now_s() - t0;
+
+    printf("    iq stats over %d records: CSV %.3f s, columnar %.4f s (%.0fx)\n",
+           n, t_csv, t_col, t_csv / t_col);
+
+    TEST_ASSERT(count == n, "CSV read back");
+    TEST_ASSERT(fabsf(s_csv.mean_value - s_col.mean_value) < 1e-4f, "Same result");
+    TEST_ASSERT(t_col < t_csv, "Columnar faster than CSV");
+
+    return true;
+}
+
+// ==================== Main ====================
+
+int main(void) {
+    printf("=== Simulation Trace Tests ===\n\n");
+
+    RUN_TEST(test_sim_data_roundtrip);
+    RUN_TEST(test_codecs);
+    RUN_TEST(test_zero_copy_and_truncation);
+    RUN_TEST(test_streaming_matches_arrays);
+    RUN_TEST(test_large_trace_bounded_memory);
+    RUN_TEST(test_read_speed_vs_csv);
+
+    remove(TRACE_FILE);
+    remove(TRACE_FILE_B);
+    remove(TRACE_CSV);
+
+    printf("\n=== Test Summary ===\n");
+    printf("Total: %d, Passed: %d, Failed: %d\n",
+           total_tests, passed_tests, total_tests - passed_tests);
+
+    return (passed_tests == total_tests) ? 0 : 1;
+}
@@ -0,0 +1,236 @@
+/**
+ * @file test_virtual_motor_batch.c
+ * @brief Tests and benchmark for the lockstep multi-motor model
+ * 
+ * Validates:
+ * - Vectorized sincos against utils_fast_sincos_better
+ * - Per-lane equivalence with the scalar virtual_motor_pc_state_step
+ * - Throughput in motor-steps per second (scalar vs batch)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+#include <time.h>
+
+// Test framework
+#define TEST_ASSERT(cond, msg) do { \
+    if (!(cond)) { \
+        printf("  FAIL: %s (line %d)\n", msg, __LINE__); \
+        test_failures++; \
+        return false; \
+    } \
+} while(0)
+
+#define RUN_TEST(test_func) do { \
+    printf("Running %s...\n", #test_func); \
+    total_tests++; \
+    if (test_func()) { \
+        printf("  PASS\n"); \
+        passed_tests++; \
+    } \
+} while(0)
+
+static int test_failures = 0;
+static int total_tests = 0;
+static int passed_tests = 0;
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846f
+#endif
+
+#include "../motor_sim/virtual_motor_batch.h"
+#include "../motor_sim/mcconf_stub.h"
+#include "utils_math.h"
+
+#define DT              (1.0f / 100000.0f)
+
+static double time_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Deterministic pseudo-random value in [-1, 1]
+static float rand_sym(unsigned int *seed) {
+    *seed = *seed * 1103515245u + 12345u;
+    return (float)((*seed >> 8) & 0xFFFF) / 32767.5f - 1.0f;
+}
+
+// Apply parameter tolerances to each lane of a batch and a matching scalar model
+static void setup_tolerance_lanes(virtual_motor_batch_t *b, virtual_motor_state_t *scalar,
+                                  int lanes, mc_configuration *conf) {
+    unsigned int seed = 1234;
+    
+    virtual_motor_batch_init(b, lanes, conf);
+    
+    for (int i = 0; i < lanes; i++) {
+        virtual_motor_pc_state_init(&scalar[i], conf);
+        
+        float R = scalar[i].R * (1.0f + 0.1f * rand_sym(&seed));
+        float l = scalar[i].ld * (1.0f + 0.1f * rand_sym(&seed));
+        float lambda = scalar[i].lambda * (1.0f + 0.05f * rand_sym(&seed));
+        float J = 0.0001f * (1.0f + 0.2f * rand_sym(&seed));
+        
+        virtual_motor_batch_set_lane_params(b, i, R, l, l, lambda, J);
+        scalar[i].R = R;
+        scalar[i].ld = l;
+        scalar[i].lq = l;
+        scalar[i].lambda = lambda;
+        scalar[i].J = J;
+    }
+}
+
+// Rotating voltage vector at a fixed frequency
+static void voltage_at(int step, float *va, float *vb) {
+    float ang = 2.0f * (float)M_PI * 50.0f * (float)step * DT;
+    *va = 2.0f * cosf(ang);
+    *vb = 2.0f * sinf(ang);
+}
+
+// ==================== Accuracy Tests ====================
+
+bool test_batch_sincos(void) {
+    float ang[64], s[64], c[64];
+    
+    for (int i = 0; i < 64; i++) {
+        ang[i] = -3.0f * (float)M_PI + 6.0f * (float)M_PI * (float)i / 63.0f;
+    }
+    
+    virtual_motor_batch_sincos(ang, s, c, 64);
+    
+    float max_err = 0.0f;
+    for (int i = 0; i < 64; i++) {
+        float s_ref, c_ref;
+        utils_fast_sincos_better(ang[i], &s_ref, &c_ref);
+        max_err = fmaxf(max_err, fabsf(s[i] - s_ref));
+        max_err = fmaxf(max_err, fabsf(c[i] - c_ref));
+    }
+    
+    printf("    Max deviation from utils_fast_sincos_better: %.2e\n", max_err);
+    TEST_ASSERT(max_err < 1e-5f, "Batch sincos matches scalar polynomial");
+    
+    return true;
+}
+
+bool test_batch_matches_scalar(void) {
+    static virtual_motor_batch_t b;
+    virtual_motor_state_t scalar[VM_BATCH_MAX_LANES];
+    mc_configuration conf;
+    mcconf_set_small_motor(&conf);
+    
+    setup_tolerance_lanes(&b, scalar, VM_BATCH_MAX_LANES, &conf);
+    
+    for (int i = 0; i < VM_BATCH_MAX_LANES; i++) {
+        b.ml[i] = 0.001f * (float)i;
+        virtual_motor_pc_state_set_load_torque(&scalar[i], b.ml[i]);
+    }
+    
+    float max_i_err = 0.0f;
+    float max_w_err = 0.0f;
+    float max_i = 0.0f;
+    
+    for (int step = 0; step < 5000; step++) {
+        float va, vb;
+        voltage_at(step, &va, &vb);
+        
+        for (int i = 0; i < VM_BATCH_MAX_LANES; i++) {
+            b.v_alpha[i] = va;
+            b.v_beta[i] = vb;
+        }
+        virtual_motor_batch_step(&b, DT);
+        
+        for (int i = 0; i < VM_BATCH_MAX_LANES; i++) {
+            virtual_motor_io_t io = {0};
+            io.v_alpha_in = va;
+            io.v_beta_in = vb;
+            virtual_motor_pc_state_step(&scalar[i], &io, DT);
+            
+            max_i_err = fmaxf(max_i_err, fabsf(io.i_alpha_out - b.i_alpha[i]));
+            max_i_err = fmaxf(max_i_err, fabsf(io.i_beta_out - b.i_beta[i]));
+            max_w_err = fmaxf(max_w_err, fabsf(scalar[i].we - b.we[i]) /
+                              fmaxf(fabsf(scalar[i].we), 1.0f));
+            max_i = fmaxf(max_i, fabsf(scalar[i].iq));
+        }
+    }
+    
+    printf("    Max current error: %.2e A (peak |iq| %.2f A), max rel. speed error: %.2e\n",
+           max_i_err, max_i, max_w_err);
+    
+    TEST_ASSERT(max_i > 0.1f, "Lanes were excited");
+    TEST_ASSERT(max_i_err < 1e-3f * fmaxf(max_i, 1.0f), "Per-lane currents match scalar model");
+    TEST_ASSERT(max_w_err < 1e-3f, "Per-lane speeds match scalar model");
+    
+    virtual_motor_state_t lane;
+    virtual_motor_batch_get_lane(&b, 3, &lane);
+    TEST_ASSERT(lane.R == scalar[3].R && lane.pole_pairs == scalar[3].pole_pairs,
+                "Lane extraction returns lane parameters");
+    
+    return true;
+}
+
+// ==================== Benchmark ====================
+
+bool test_batch_throughput(void) {
+    static virtual_motor_batch_t b;
+    virtual_motor_state_t scalar[VM_BATCH_MAX_LANES];
+    mc_configuration conf;
+    mcconf_set_medium_motor(&conf);
+    
+    setup_tolerance_lanes(&b, scalar, VM_BATCH_MAX_LANES, &conf);
+    
+    const int steps = 200000;
+    
+    double start = time_now();
+    for (int step = 0; step < steps; step++) {
+        for (int i = 0; i < VM_BATCH_MAX_LANES; i++) {
+            virtual_motor_io_t io = {0};
+            io.v_alpha_in = 1.0f;
+            io.v_beta_in = 0.5f;
+            virtual_motor_pc_state_step(&scalar[i], &io, DT);
+        }
+    }
+    double t_scalar = time_now() - start;
+    
+    for (int i = 0; i < VM_BATCH_MAX_LANES; i++) {
+        b.v_alpha[i] = 1.0f;
+        b.v_beta[i] = 0.5f;
+    }
+    
+    start = time_now();
+    for (int step = 0; step < steps; step++) {
+        virtual_motor_batch_step(&b, DT);
+    }
+    double t_batch = time_now() - start;
+    
+    double motor_steps = (double)steps * VM_BATCH_MAX_LANES;
+    printf("    Scalar: %.1f M motor-steps/s\n", motor_steps / t_scalar * 1e-6);
+    printf("    Batch:  %.1f M motor-steps/s (%d lanes, %.2fx)\n",
+           motor_steps / t_batch * 1e-6, VM_BATCH_MAX_LANES, t_scalar / t_batch);
+    
+    // Keep the results alive
+    TEST_ASSERT(!isnan(b.iq[0]) && !isnan(scalar[0].iq), "Models stayed finite");
+    
+    return true;
+}
+
+// ==================== Main ====================
+
+int main(void) {
+    printf("=== Virtual Motor Batch Tests ===\n\n");
+    
+    printf("--- Accuracy Tests ---\n");
+    RUN_TEST(test_batch_sincos);
+    RUN_TEST(test_batch_matches_scalar);
+    
+    printf("\n--- Performance Tests ---\n");
+    RUN_TEST(test_batch_throughput);
+    
+    printf("\n=== Test Summary ===\n");
+    printf("Total: %d, Passed: %d, Failed: %d\n", 
+           total_tests, passed_tests, total_tests - passed_tests);
+    
+    return (passed_tests == total_tests) ? 0 : 1;
+}
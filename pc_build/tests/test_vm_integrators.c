@@ -0,0 +1,246 @@
+/**
+ * @file test_vm_integrators.c
+ * @brief Tests and accuracy-vs-cost benchmark for the motor model integrators
+ *
+ * Validates:
+ * - Euler stays the default integrator
+ * - Exact discretization against the analytic locked-rotor step response
+ * - RK4, exact and adaptive against a fine-step reference on the small,
+ *   medium and large presets from mcconf_stub.c, and the cost of each
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+#include <time.h>
+
+// Test framework
+#define TEST_ASSERT(cond, msg) do { \
+    if (!(cond)) { \
+        printf("  FAIL: %s (line %d)\n", msg, __LINE__); \
+        test_failures++; \
+        return false; \
+    } \
+} while(0)
+
+#define RUN_TEST(test_func) do { \
+    printf("Running %s...\n", #test_func); \
+    total_tests++; \
+    if (test_func()) { \
+        printf("  PASS\n"); \
+        passed_tests++; \
+    } \
+} while(0)
+
+static int test_failures = 0;
+static int total_tests = 0;
+static int passed_tests = 0;
+
+#include "../motor_sim/virtual_motor_pc.h"
+#include "../motor_sim/mcconf_stub.h"
+
+#define CONTROL_DT      (1.0f / 20000.0f)
+#define SCENARIO_STEPS  400             // 20 ms
+#define REF_SUBSTEPS    50              // RK4 at 1 us
+
+static double time_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+typedef struct {
+    const char *name;
+    void (*set_conf)(mc_configuration *conf);
+    float vq;               // Step voltage [V], about 10x rated current at standstill
+    float J;                // Inertia [kg·m²]
+} preset_t;
+
+static const preset_t presets[] = {
+    {"small",  mcconf_set_small_motor,  2.0f,  0.00002f},
+    {"medium", mcconf_set_medium_motor, 1.0f,  0.0005f},
+    {"large",  mcconf_set_large_motor,  0.5f,  0.002f},
+};
+#define NUM_PRESETS     ((int)(sizeof(presets) / sizeof(presets[0])))
+
+typedef struct {
+    float iq[SCENARIO_STEPS];
+    float we[SCENARIO_STEPS];
+} trajectory_t;
+
+/*
+ * Start-up from standstill with ideal commutation: every control period
+ * the voltage vector is placed on the q axis of the rotor angle seen at
+ * the start of the period and held for the period, like a PWM update.
+ */
+static void run_scenario(const preset_t *p, vm_integrator_t integ, int substeps,
+                         trajectory_t *out) {
+    mc_configuration conf;
+    virtual_motor_state_t vm;
+    virtual_motor_io_t io;
+
+    p->set_conf(&conf);
+    virtual_motor_pc_state_init(&vm, &conf);
+    virtual_motor_pc_state_set_inertia(&vm, p->J);
+    virtual_motor_pc_state_set_integrator(&vm, integ);
+    memset(&io, 0, sizeof(io));
+
+    // The reset leaves the d-axis flux state at zero, as in the firmware
+    // model, which starts Euler with id = -lambda / ld. Start every method
+    // from id = 0 so that only the integration error is compared.
+    vm.id_int = vm.lambda / vm.ld;
+
+    float h = CONTROL_DT / (float)substeps;
+    for (int k = 0; k < SCENARIO_STEPS; k++) {
+        float s = sinf(vm.phi);
+        float c = cosf(vm.phi);
+        io.v_alpha_in = -s * p->vq;
+        io.v_beta_in = c * p->vq;
+
+        for (int i = 0; i < substeps; i++) {
+            virtual_motor_pc_state_step(&vm, &io, h);
+        }
+
+        if (out != NULL) {
+            out->iq[k] = vm.iq;
+            out->we[k] = vm.we;
+        }
+    }
+}
+
+// Max error relative to the peak of the reference
+static float traj_error(const trajectory_t *ref, const trajectory_t *t) {
+    float peak_iq = 0.0f, peak_we = 0.0f;
+    float err_iq = 0.0f, err_we = 0.0f;
+
+    for (int k = 0; k < SCENARIO_STEPS; k++) {
+        peak_iq = fmaxf(peak_iq, fabsf(ref->iq[k]));
+        peak_we = fmaxf(peak_we, fabsf(ref->we[k]));
+        err_iq = fmaxf(err_iq, fabsf(ref->iq[k] - t->iq[k]));
+        err_we = fmaxf(err_we, fabsf(ref->we[k] - t->we[k]));
+    }
+
+    float e = fmaxf(err_iq / peak_iq, err_we / peak_we);
+    return isfinite(e) ? e : INFINITY;
+}
+
+// Wall time per control period [ns]
+static double time_scenario(const preset_t *p, vm_integrator_t integ, int substeps) {
+    int reps = 0;
+    double t0 = time_now();
+    double t;
+    do {
+        run_scenario(p, integ, substeps, NULL);
+        reps++;
+        t = time_now() - t0;
+    } while (t < 0.02);
+
+    return t / ((double)reps * SCENARIO_STEPS) * 1e9;
+}
+
+// ==================== Basic Tests ====================
+
+bool test_euler_is_default(void) {
+    mc_configuration conf;
+    virtual_motor_state_t vm;
+
+    mcconf_set_defaults(&conf);
+    virtual_motor_pc_state_init(&vm, &conf);
+    TEST_ASSERT(vm.integrator == VM_INTEGRATOR_EULER, "Euler by default");
+
+    return true;
+}
+
+bool test_exact_locked_rotor(void) {
+    mc_configuration conf;
+    virtual_motor_state_t vm;
+    virtual_motor_io_t io;
+
+    mcconf_set_medium_motor(&conf);
+    virtual_motor_pc_state_init(&vm, &conf);
+    virtual_motor_pc_state_set_inertia(&vm, 1e6f);
+    virtual_motor_pc_state_set_integrator(&vm, VM_INTEGRATOR_EXACT);
+    memset(&io, 0, sizeof(io));
+    io.v_alpha_in = 0.5f;
+
+    // Steps of five time constants, far beyond what Euler could take
+    float tau = vm.ld / vm.R;
+    float h = 5.0f * tau;
+    float max_err = 0.0f;
+    for (int k = 1; k <= 4; k++) {
+        virtual_motor_pc_state_step(&vm, &io, h);
+        float expected = 0.5f / vm.R * (1.0f - expf(-(float)k * h / tau));
+        max_err = fmaxf(max_err, fabsf(vm.id - expected) / expected);
+    }
+
+    printf("    id relative error at h = 5 tau: %.2e\n", max_err);
+    TEST_ASSERT(max_err < 1e-5f, "Exact step response");
+    TEST_ASSERT(fabsf(vm.iq) < 1e-3f, "No q current at standstill");
+
+    return true;
+}
+
+// ==================== Accuracy vs Cost ====================
+
+bool test_accuracy_vs_cost(void) {
+    static trajectory_t ref, traj;
+    const int substeps[] = {1, 2, 5, 10, 20};
+    const int num_sub = (int)(sizeof(substeps) / sizeof(substeps[0]));
+    const struct {
+        vm_integrator_t integ;
+        const char *name;
+    } integrators[] = {
+        {VM_INTEGRATOR_EULER, "euler"},
+        {VM_INTEGRATOR_RK4, "rk4"},
+        {VM_INTEGRATOR_EXACT, "exact"},
+    };
+
+    printf("    %-7s %-9s %8s %12s %12s\n", "preset", "method", "substeps", "max rel err", "ns/period");
+
+    for (int p = 0; p < NUM_PRESETS; p++) {
+        run_scenario(&presets[p], VM_INTEGRATOR_RK4, REF_SUBSTEPS, &ref);
+
+        float err[3][5];
+        for (int m = 0; m < 3; m++) {
+            for (int n = 0; n < num_sub; n++) {
+                run_scenario(&presets[p], integrators[m].integ, substeps[n], &traj);
+                err[m][n] = traj_error(&ref, &traj);
+                printf("    %-7s %-9s %8d %12.2e %12.0f\n", presets[p].name, integrators[m].name,
+                       substeps[n], err[m][n],
+                       time_scenario(&presets[p], integrators[m].integ, substeps[n]));
+            }
+        }
+
+        run_scenario(&presets[p], VM_INTEGRATOR_ADAPTIVE, 1, &traj);
+        float err_adaptive = traj_error(&ref, &traj);
+        printf("    %-7s %-9s %8s %12.2e %12.0f\n", presets[p].name, "adaptive", "auto",
+               err_adaptive, time_scenario(&presets[p], VM_INTEGRATOR_ADAPTIVE, 1));
+
+        // RK4 at one and exact at two steps per control period beat Euler at 20
+        TEST_ASSERT(err[1][0] < err[0][num_sub - 1], "RK4 x1 more accurate than Euler x20");
+        TEST_ASSERT(err[2][1] < err[0][num_sub - 1], "Exact x2 more accurate than Euler x20");
+        TEST_ASSERT(err[2][num_sub - 1] < 1e-4f, "Exact converges");
+        TEST_ASSERT(err[1][num_sub - 1] < 1e-4f, "RK4 converges");
+        TEST_ASSERT(err_adaptive < 1e-3f, "Adaptive within tolerance");
+    }
+
+    return true;
+}
+
+// ==================== Main ====================
+
+int main(void) {
+    printf("=== Virtual Motor Integrator Tests ===\n\n");
+
+    RUN_TEST(test_euler_is_default);
+    RUN_TEST(test_exact_locked_rotor);
+    RUN_TEST(test_accuracy_vs_cost);
+
+    printf("\n=== Test Summary ===\n");
+    printf("Total: %d, Passed: %d, Failed: %d\n",
+           total_tests, passed_tests, total_tests - passed_tests);
+
+    return (passed_tests == total_tests) ? 0 : 1;
+}
@@ -381,6 +381,347 @@ __attribute__((section(".text2"))) void terminal_process_string(char *str) {
 		} else {
 			commands_printf("This command requires one argument. [duty]\n");
 		}
+	} else if (strcmp(argv[0], "measure_ind_lut") == 0) {
+		if (argc == 2) {
+			float i_max = -1.0;
+			sscanf(argv[1], "%f", &i_max);
+
+			mc_configuration *mcconf = mempools_alloc_mcconf();
+			*mcconf = *mc_interface_get_configuration();
+			mc_configuration *mcconf_old = mempools_alloc_mcconf();
+			*mcconf_old = *mc_interface_get_configuration();
+
+			if (i_max > 0.0 && i_max <= mcconf->l_current_max) {
+				commands_printf("Measuring inductance table, make sure that the rotor is locked after the alignment...");
+				mcconf->motor_type = MOTOR_TYPE_FOC;
+				mc_interface_set_configuration(mcconf);
+
+				motor_lut_data lut;
+				int fault = mcpwm_foc_measure_inductance_lut(i_max, &lut);
+				mc_interface_set_configuration(mcconf_old);
+
+				if (fault == FAULT_CODE_NONE) {
+					mcpwm_foc_set_motor_lut(&lut);
+					if (conf_general_store_motor_lut(&lut, mc_interface_get_motor_thread() == 2)) {
+						commands_printf("Inductance table measured and stored. Print it with motor_lut.\n");
+					} else {
+						commands_printf("Inductance table measured, but could not be stored.\n");
+					}
+				} else {
+					commands_printf("Inductance table measurement failed due to fault: %s", mc_interface_fault_to_string(fault));
+					commands_printf("For more info type \"faults\" to view all logged faults\n");
+				}
+			} else {
+				commands_printf("Invalid argument. i_max must be between 0.0 and %.2f\n", (double)mcconf->l_current_max);
+			}
+
+			mempools_free_mcconf(mcconf);
+			mempools_free_mcconf(mcconf_old);
+		} else {
+			commands_printf("This command requires one argument. [i_max]\n");
+		}
+	} else if (strcmp(argv[0], "motor_lut") == 0) {
+		const motor_lut_data *lut = mcpwm_foc_get_motor_lut();
+		if (foc_motor_lut_check(lut)) {
+			commands_printf("Ld / Lq [uH] at id (rows) and iq (columns)");
+			for (int i = 0;i < MOTOR_LUT_ID_POINTS;i++) {
+				char line[128];
+				int pos = snprintf(line, sizeof(line), "%7.1f A:", (double)foc_motor_lut_grid_id(lut->i_max, i));
+				for (int j = 0;j < MOTOR_LUT_IQ_POINTS && pos < (int)sizeof(line);j++) {
+					pos += snprintf(line + pos, sizeof(line) - pos, " %6.1f/%-6.1f",
+							(double)((float)lut->ld[i][j] * lut->l_scale * 1e6),
+							(double)((float)lut->lq[i][j] * lut->l_scale * 1e6));
+				}
+				commands_printf("%s", line);
+			}
+			commands_printf("iq columns from 0 to %.1f A\n", (double)lut->i_max);
+		} else {
+			commands_printf("No inductance table, the configured motor parameters are used.\n");
+		}
+	} else if (strcmp(argv[0], "motor_lut_clear") == 0) {
+		motor_lut_data lut;
+		memset(&lut, 0, sizeof(lut));
+		mcpwm_foc_set_motor_lut(&lut);
+		if (conf_general_store_motor_lut(&lut, mc_interface_get_motor_thread() == 2)) {
+			commands_printf("Inductance table cleared.\n");
+		} else {
+			commands_printf("Could not clear the stored inductance table.\n");
+		}
+	} else if (strcmp(argv[0], "dt_comp") == 0) {
+		const foc_dt_comp_t *map = mcpwm_foc_get_dt_comp();
+		const float v_per_mod = mc_interface_get_input_voltage_filtered() * (2.0 / 3.0);
+		commands_printf("Dead time compensation: %s, learning: %s",
+				map->enabled ? "on" : "off", map->learn ? "on" : "off");
+		commands_printf("Voltage error [V] at %.1f V bus and learning updates per phase current", (double)(v_per_mod * 1.5));
+		commands_printf("   Current      Phase A          Phase B          Phase C");
+		for (int i = 0;i < FOC_DT_COMP_POINTS;i++) {
+			commands_printf("%8.2f A: %7.3f (%6u) %7.3f (%6u) %7.3f (%6u)",
+					(double)foc_dt_comp_grid_current(map, i),
+					(double)(map->err[0][i] * v_per_mod), (unsigned int)map->hits[0][i],
+					(double)(map->err[1][i] * v_per_mod), (unsigned int)map->hits[1][i],
+					(double)(map->err[2][i] * v_per_mod), (unsigned int)map->hits[2][i]);
+		}
+		commands_printf(" ");
+	} else if (strcmp(argv[0], "dt_comp_mode") == 0) {
+		if (argc == 2) {
+			int mode = -1;
+			sscanf(argv[1], "%d", &mode);
+
+			if (mode >= 0 && mode <= 2) {
+				mcpwm_foc_set_dt_comp(mode >= 1, mode == 2);
+				commands_printf("Dead time compensation %s\n",
+						mode == 0 ? "off" : (mode == 1 ? "on" : "on and learning"));
+			} else {
+				commands_printf("Invalid argument(s).\n");
+			}
+		} else {
+			commands_printf("This command requires one argument.\n");
+		}
+	} else if (strcmp(argv[0], "dt_comp_reset") == 0) {
+		mcpwm_foc_reset_dt_comp();
+		commands_printf("Dead time compensation map reset to the configured dead time.\n");
+	} else if (strcmp(argv[0], "param_est") == 0) {
+		const foc_param_est_t *est = mcpwm_foc_get_param_est();
+		foc_param_est_point point;
+		const bool applied = mcpwm_foc_get_param_est_applied(&point);
+		const char *names[FOC_PARAM_EST_NUM] = {"R", "Ld", "Lq", "Lambda", "Lam_q"};
+		const char *units[FOC_PARAM_EST_NUM] = {"mOhm", "uH", "uH", "mWb", "mWb"};
+		const float scales[FOC_PARAM_EST_NUM] = {1e3, 1e6, 1e6, 1e3, 1e3};
+		float used[FOC_PARAM_EST_NUM] = {0};
+		if (applied) {
+			used[FOC_PARAM_EST_R] = point.r;
+			used[FOC_PARAM_EST_LD] = point.ld;
+			used[FOC_PARAM_EST_LQ] = point.lq;
+			used[FOC_PARAM_EST_LAMBDA] = point.lambda;
+		}
+
+		commands_printf("Online parameter estimation: %u samples, %u dropped, estimates %s",
+				(unsigned int)est->updates, (unsigned int)mcpwm_foc_get_param_est_dropped(),
+				applied ? "applied" : "not applied");
+		commands_printf("Parameter     Configured     Estimate    +- 2 sigma     Applied");
+		for (int i = 0;i < FOC_PARAM_EST_NUM;i++) {
+			float bound;
+			const float value = foc_param_est_get(est, i, &bound);
+			// Lambda_q is the flux seen on the q axis of an inexact frame
+			const float configured = i == FOC_PARAM_EST_LAMBDA_Q ? 0.0 : est->scale[i];
+			commands_printf("%-6s %4s %11.3f %12.3f %12.3f %11.3f",
+					names[i], units[i], (double)(configured * scales[i]),
+					(double)(value * scales[i]), (double)(bound * scales[i]),
+					(double)(used[i] * scales[i]));
+		}
+		commands_printf(" ");
+	} else if (strcmp(argv[0], "param_est_mode") == 0) {
+		if (argc == 2) {
+			int mode = -1;
+			sscanf(argv[1], "%d", &mode);
+
+			if (mode >= 0 && mode <= 2) {
+				mcpwm_foc_set_param_est(mode >= 1, mode == 2);
+				commands_printf("Online parameter estimation %s\n",
+						mode == 0 ? "off" : (mode == 1 ? "on" : "on and applied"));
+			} else {
+				commands_printf("Invalid argument(s).\n");
+			}
+		} else {
+			commands_printf("This command requires one argument.\n");
+		}
+	} else if (strcmp(argv[0], "param_est_reset") == 0) {
+		mcpwm_foc_reset_param_est();
+		commands_printf("Online parameter estimates reset to the configuration.\n");
+	} else if (strcmp(argv[0], "fsw_adapt") == 0) {
+		const foc_fsw_adapt_t *fa = mcpwm_foc_get_fsw_model();
+		commands_printf("Switching frequency adaptation: %s",
+				mcpwm_foc_get_fsw_adapt() ? "on" : "off");
+		commands_printf("Zero vector frequency: %.0f Hz, range %.0f - %.0f Hz",
+				(double)mcpwm_foc_get_switching_frequency_now(), (double)fa->f_min, (double)fa->f_max);
+		commands_printf("Loss model: %u updates, %s",
+				(unsigned int)fa->updates, foc_fsw_adapt_model_valid(fa) ? "valid" : "not valid yet");
+		commands_printf("Ambient: %.1f degC, conduction: %.2f degC, switching: %.2f degC",
+				(double)fa->theta[0], (double)fa->theta[1], (double)fa->theta[2]);
+		commands_printf(" ");
+	} else if (strcmp(argv[0], "fsw_adapt_mode") == 0) {
+		if (argc >= 2 && argc <= 4) {
+			int mode = -1;
+			float f_min = 0.0;
+			float f_max = 0.0;
+			sscanf(argv[1], "%d", &mode);
+			if (argc >= 3) {
+				sscanf(argv[2], "%f", &f_min);
+			}
+			if (argc == 4) {
+				sscanf(argv[3], "%f", &f_max);
+			}
+
+			if (mode >= 0 && mode <= 1 && f_min >= 0.0 && f_max >= 0.0) {
+				if (mcpwm_foc_set_fsw_adapt(mode == 1, f_min, f_max)) {
+					commands_printf("Switching frequency adaptation %s\n", mode == 0 ? "off" : "on");
+				} else {
+					commands_printf("Not supported on this hardware.\n");
+				}
+			} else {
+				commands_printf("Invalid argument(s).\n");
+			}
+		} else {
+			commands_printf("This command requires one to three arguments.\n");
+		}
+	} else if (strcmp(argv[0], "foc_isr_sched") == 0) {
+#ifdef HW_HAS_DUAL_MOTORS
+		const int motors = 2;
+#else
+		const int motors = 1;
+#endif
+		for (int m = 0;m < motors;m++) {
+			const foc_isr_sched_t *sched = mcpwm_foc_get_isr_sched(m == 1);
+			commands_printf("Motor %d: budget %.2f us, worst declared cycle %.2f us, longest cycle %.2f us, %u of %u cycles over budget",
+					m + 1,
+					(double)foc_isr_sched_ticks_to_us(sched->budget),
+					(double)foc_isr_sched_ticks_to_us(foc_isr_sched_worst_slot(sched)),
+					(double)foc_isr_sched_ticks_to_us(sched->max),
+					(unsigned int)sched->overruns, (unsigned int)sched->cycles);
+			commands_printf("Task            Period Phase Cost [us] Max [us]       Runs Overruns");
+			for (int i = 0;i < sched->task_num;i++) {
+				const foc_isr_task_t *t = &sched->tasks[i];
+				commands_printf("%-15s %6u %5u %9.2f %8.2f %10u %8u",
+						t->name, (unsigned int)t->period, (unsigned int)t->phase,
+						(double)foc_isr_sched_ticks_to_us(t->cost),
+						(double)foc_isr_sched_ticks_to_us(t->max),
+						(unsigned int)t->runs, (unsigned int)t->overruns);
+			}
+			commands_printf(" ");
+		}
+
+		if (argc == 2 && strcmp(argv[1], "1") == 0) {
+			mcpwm_foc_reset_isr_sched_stats();
+			commands_printf("Statistics reset\n");
+		}
+	} else if (strcmp(argv[0], "can_rx_stats") == 0) {
+#ifdef HW_CAN2_DEV
+		const int interfaces = 2;
+#else
+		const int interfaces = 1;
+#endif
+
+		commands_printf("Hardware filters: %s",
+				comm_can_rx_filter_active() ? "decoded frames only" : "all frames");
+		for (int i = 1;i <= interfaces;i++) {
+			can_rx_stats stats = comm_can_get_rx_stats(i);
+			commands_printf("CAN%d: %u frames, %u control commands in the read thread, %u overflows",
+					i, (unsigned int)stats.frames, (unsigned int)stats.fast, (unsigned int)stats.overflows);
+		}
+
+		can_xfer_stats_t xfer = comm_can_get_xfer_stats();
+		commands_printf("Buffer transfers sent: %u done, %u failed, %u frames, %u frames resent",
+				(unsigned int)xfer.tx_done, (unsigned int)xfer.tx_failed,
+				(unsigned int)xfer.tx_frames, (unsigned int)xfer.tx_resent);
+		commands_printf("Buffer transfers received: %u done, %u CRC errors, %u refused",
+				(unsigned int)xfer.rx_done, (unsigned int)xfer.rx_crc_errors, (unsigned int)xfer.rx_busy);
+		commands_printf(" ");
+	} else if (strcmp(argv[0], "can_status_on_change") == 0) {
+		if (argc == 2) {
+			int on_change = -1;
+			sscanf(argv[1], "%d", &on_change);
+
+			if (on_change == 0 || on_change == 1) {
+				app_configuration *appconf = mempools_alloc_appconf();
+				*appconf = *app_get_configuration();
+				appconf->can_status_on_change = on_change;
+				conf_general_store_app_configuration(appconf);
+				app_set_configuration(appconf);
+				mempools_free_appconf(appconf);
+			} else {
+				commands_printf("Invalid argument, use 0 or 1");
+			}
+		}
+
+		commands_printf("Sending status messages on change: %s\n",
+				app_get_configuration()->can_status_on_change ? "on" : "off");
+	} else if (strcmp(argv[0], "can_status_load") == 0) {
+		if (argc == 2) {
+			float budget = -1.0;
+			sscanf(argv[1], "%f", &budget);
+
+			if (budget >= 0.0 && budget <= 100.0) {
+				app_configuration *appconf = mempools_alloc_appconf();
+				*appconf = *app_get_configuration();
+				appconf->can_status_budget = budget / 100.0;
+				conf_general_store_app_configuration(appconf);
+				app_set_configuration(appconf);
+				mempools_free_appconf(appconf);
+			} else {
+				commands_printf("Invalid budget, it must be between 0 and 100 %%");
+			}
+		}
+
+		const app_configuration *appconf = app_get_configuration();
+		const float bitrate = (float)comm_can_baud_to_kbits(appconf->can_baud_rate) * 1000.0;
+		const float budget = appconf->can_status_budget;
+		can_pub_stats_t stats = comm_can_get_status_pub_stats();
+
+		if (!appconf->can_status_on_change) {
+			commands_printf("Sending on change is off, all status messages are sent at their rates\n");
+			return;
+		}
+
+		if (budget > 0.0) {
+			commands_printf("Budget: %.1f %% of the bus", (double)(budget * 100.0));
+		} else {
+			commands_printf("Budget: none");
+		}
+
+		if (bitrate > 0.0) {
+			commands_printf("Status messages: %.0f bit/s, %.2f %% of the bus",
+					(double)stats.load, (double)(stats.load / bitrate * 100.0));
+			commands_printf("At the fixed rates: %.0f bit/s, %.2f %% of the bus",
+					(double)stats.load_fixed, (double)(stats.load_fixed / bitrate * 100.0));
+		}
+
+		for (int i = 0;i < CAN_PUB_MSGS;i++) {
+			commands_printf("STATUS_%d: %u sent, %u suppressed", i + 1,
+					(unsigned int)stats.sent[i], (unsigned int)stats.suppressed[i]);
+		}
+
+		commands_printf("Changes held back by the budget: %u\n", (unsigned int)stats.over_budget);
+	} else if (strcmp(argv[0], "can_fd") == 0) {
+		if (argc >= 2) {
+			int data_kbits = -1;
+			int brs = 1;
+			sscanf(argv[1], "%d", &data_kbits);
+			if (argc >= 3) {
+				sscanf(argv[2], "%d", &brs);
+			}
+
+			if (data_kbits == 0) {
+				comm_can_set_fd(false, 0, false);
+			} else if (data_kbits > 0) {
+				if (!comm_can_set_fd(true, data_kbits, brs != 0)) {
+					commands_printf("This hardware has no CAN-FD, or its clock cannot make %d kbit/s", data_kbits);
+				}
+			} else {
+				commands_printf("Invalid argument(s).");
+			}
+		}
+
+		if (comm_can_fd_active()) {
+			int data_kbits;
+			bool brs;
+			comm_can_get_fd(&data_kbits, &brs);
+
+			if (brs) {
+				commands_printf("CAN-FD: on, data phase at %d kbit/s", data_kbits);
+			} else {
+				commands_printf("CAN-FD: on, without bit rate switching");
+			}
+		} else {
+			commands_printf("CAN-FD: off");
+		}
+
+		uint32_t overflows;
+		can_fd_stats_t fd = comm_can_get_fd_stats(&overflows);
+		commands_printf("Buffers sent: %u in %u frames",
+				(unsigned int)fd.tx_buffers, (unsigned int)fd.tx_frames);
+		commands_printf("Buffers received: %u done, %u CRC errors, %u frames dropped, %u overflows\n",
+				(unsigned int)fd.rx_done, (unsigned int)fd.rx_crc_errors,
+				(unsigned int)fd.rx_dropped, (unsigned int)overflows);
 	} else if (strcmp(argv[0], "measure_linkage") == 0) {
 		if (argc == 5) {
 			float current = -1.0;
@@ -1204,6 +1545,61 @@ __attribute__((section(".text2"))) void terminal_process_string(char *str) {
 		commands_printf("measure_ind [duty]");
 		commands_printf("  Send short voltage pulses, measure the current and calculate the motor inductance");
 
+		commands_printf("measure_ind_lut [i_max]");
+		commands_printf("  Measure Ld and Lq over id and iq up to i_max and store them as the motor model");
+		commands_printf("  The rotor must be locked after aligning, as the measurement produces full torque");
+
+		commands_printf("motor_lut");
+		commands_printf("  Print the measured Ld and Lq table");
+
+		commands_printf("motor_lut_clear");
+		commands_printf("  Remove the measured table and use the configured motor parameters again");
+
+		commands_printf("dt_comp");
+		commands_printf("  Print the dead time and switch voltage drop compensation map");
+
+		commands_printf("dt_comp_mode [mode]");
+		commands_printf("  0: Off, 1: Apply the map, 2: Apply the map and learn it at low speed");
+
+		commands_printf("dt_comp_reset");
+		commands_printf("  Forget the learned map and start over from the configured dead time");
+
+		commands_printf("param_est");
+		commands_printf("  Print the online R, Ld, Lq and flux linkage estimates with their confidence bounds");
+
+		commands_printf("param_est_mode [mode]");
+		commands_printf("  0: Off, 1: Estimate while running, 2: Estimate and use confident estimates for control");
+
+		commands_printf("param_est_reset");
+		commands_printf("  Forget the estimates and start over from the configured motor parameters");
+
+		commands_printf("fsw_adapt");
+		commands_printf("  Print the switching frequency and the learned inverter loss model");
+
+		commands_printf("fsw_adapt_mode [mode] [f_min] [f_max]");
+		commands_printf("  0: Run at foc_f_zv, 1: Run at the frequency with the lowest losses. The limits in Hz are optional.");
+
+		commands_printf("foc_isr_sched [reset]");
+		commands_printf("  Print the schedule and overruns of the slower FOC ISR tasks. Add 1 to reset the statistics afterwards.");
+
+		commands_printf("can_rx_stats");
+		commands_printf("  Print the received frames and receive ring overflows of each CAN interface,");
+		commands_printf("  and the windowed buffer transfer counters");
+
+		commands_printf("can_status_on_change [0/1]");
+		commands_printf("  Print or set if the status messages are only sent on change, within their deadbands");
+		commands_printf("  and the budget. Stored in the app configuration, off by default.");
+
+		commands_printf("can_status_load [budget]");
+		commands_printf("  Print the bus load of the status messages and how many the deadbands suppressed.");
+		commands_printf("  The optional budget in percent of the bus limits changes that are sent, 0 for no limit.");
+		commands_printf("  The budget is stored in the app configuration. Only used with can_status_on_change.");
+
+		commands_printf("can_fd [data_kbits] [brs]");
+		commands_printf("  Print the CAN-FD state and buffer counters. data_kbits switches FD frames on with");
+		commands_printf("  that data phase rate, 0 switches them off. brs 0 runs the whole frame at the");
+		commands_printf("  arbitration rate. Only use FD when all nodes on the bus support it.");
+
 		commands_printf("measure_linkage [current] [duty] [min_erpm] [motor_res]");
 		commands_printf("  Run the motor in BLDC delay mode and measure the flux linkage");
 		commands_printf("  example measure_linkage 5 0.5 700 0.076");
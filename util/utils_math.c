@@ -637,6 +637,138 @@ void utils_fft8_bin2(float *real_in, float *real, float *imag) {
 	*imag /= 8.0;
 }
 
+/**
+ * Precompute the twiddle factors of a transform length for utils_dft_bin.
+ *
+ * @param len
+ * Number of samples, up to UTILS_DFT_MAX_LEN.
+ *
+ * @return
+ * False if the length is not supported.
+ */
+bool utils_dft_init(utils_dft_t *dft, int len) {
+	if (len < 1 || len > UTILS_DFT_MAX_LEN) {
+		return false;
+	}
+
+	dft->len = len;
+	for (int i = 0;i < len;i++) {
+		const float angle = 2.0 * M_PI * (float)i / (float)len;
+		dft->cos_tab[i] = cosf(angle);
+		dft->sin_tab[i] = sinf(angle);
+	}
+
+	return true;
+}
+
+/**
+ * One bin of the DFT of dft->len real samples, normalized to the length
+ * like utils_fft32_bin1 and the others.
+ *
+ * The loops add into several partial sums, so that consecutive
+ * multiply-adds do not wait for each other. Bin 0 and bin 1 have their own
+ * loops, as they need no or consecutive twiddle factors.
+ *
+ * @param bin
+ * The bin, from 0 to len - 1.
+ */
+void utils_dft_bin(const utils_dft_t *dft, const float *real_in, int bin, float *real, float *imag) {
+	const int len = dft->len;
+	const float *c = dft->cos_tab;
+	const float *s = dft->sin_tab;
+	float re0 = 0.0, re1 = 0.0, re2 = 0.0, re3 = 0.0;
+	float im0 = 0.0, im1 = 0.0, im2 = 0.0, im3 = 0.0;
+	int i = 0;
+
+	if (bin == 0) {
+		for (;i <= (len - 4);i += 4) {
+			re0 += real_in[i];
+			re1 += real_in[i + 1];
+			re2 += real_in[i + 2];
+			re3 += real_in[i + 3];
+		}
+		for (;i < len;i++) {
+			re0 += real_in[i];
+		}
+	} else if (bin == 1) {
+		// The twiddle factors are in the same order as the samples
+		for (;i <= (len - 4);i += 4) {
+			re0 += real_in[i] * c[i];
+			im0 -= real_in[i] * s[i];
+			re1 += real_in[i + 1] * c[i + 1];
+			im1 -= real_in[i + 1] * s[i + 1];
+			re2 += real_in[i + 2] * c[i + 2];
+			im2 -= real_in[i + 2] * s[i + 2];
+			re3 += real_in[i + 3] * c[i + 3];
+			im3 -= real_in[i + 3] * s[i + 3];
+		}
+		for (;i < len;i++) {
+			re0 += real_in[i] * c[i];
+			im0 -= real_in[i] * s[i];
+		}
+	} else {
+		// Every bin-th twiddle factor, wrapped around the table
+		int ind = 0;
+		for (;i <= (len - 2);i += 2) {
+			int ind1 = ind + bin;
+			if (ind1 >= len) {
+				ind1 -= len;
+			}
+
+			re0 += real_in[i] * c[ind];
+			im0 -= real_in[i] * s[ind];
+			re1 += real_in[i + 1] * c[ind1];
+			im1 -= real_in[i + 1] * s[ind1];
+
+			ind = ind1 + bin;
+			if (ind >= len) {
+				ind -= len;
+			}
+		}
+		for (;i < len;i++) {
+			re0 += real_in[i] * c[ind];
+			im0 -= real_in[i] * s[ind];
+		}
+	}
+
+	const float len_inv = 1.0 / (float)len;
+	*real = ((re0 + re1) + (re2 + re3)) * len_inv;
+	*imag = ((im0 + im1) + (im2 + im3)) * len_inv;
+}
+
+/**
+ * The DFT of len real samples at any frequency, also between the bins,
+ * with the Goertzel algorithm. Normalized like utils_dft_bin. It needs no
+ * table, but runs one sample after the other.
+ *
+ * @param bin
+ * Frequency in cycles per len samples.
+ */
+void utils_goertzel(const float *real_in, int len, float bin, float *real, float *imag) {
+	const float w = 2.0 * M_PI * bin / (float)len;
+	const float cw = cosf(w);
+	const float sw = sinf(w);
+	const float coeff = 2.0 * cw;
+	float s1 = 0.0, s2 = 0.0;
+
+	for (int i = 0;i < len;i++) {
+		const float s0 = real_in[i] + coeff * s1 - s2;
+		s2 = s1;
+		s1 = s0;
+	}
+
+	// The result is referred to the last sample, turn it back to the first
+	const float y_re = s1 - cw * s2;
+	const float y_im = sw * s2;
+	const float back = w * (float)(len - 1);
+	const float cb = cosf(back);
+	const float sb = sinf(back);
+	const float len_inv = 1.0 / (float)len;
+
+	*real = (y_re * cb + y_im * sb) * len_inv;
+	*imag = (y_im * cb - y_re * sb) * len_inv;
+}
+
 // A mapping of a samsung 30q cell for % remaining capacity vs. voltage from
 // 4.2 to 3.2, note that the you lose 15% of the 3Ah rated capacity in this range
 float utils_batt_liion_norm_v_to_capacity(float norm_v) {
@@ -24,6 +24,15 @@
 #include <stdint.h>
 #include <math.h>
 
+#define UTILS_DFT_MAX_LEN		64
+
+// Twiddle factors of one transform length, for utils_dft_bin
+typedef struct {
+	int len;
+	float cos_tab[UTILS_DFT_MAX_LEN];
+	float sin_tab[UTILS_DFT_MAX_LEN];
+} utils_dft_t;
+
 float utils_map_angle(float angle, float min, float max);
 void utils_deadband(float *value, float tres, float max);
 float utils_angle_difference(float angle1, float angle2);
@@ -51,6 +60,9 @@ void utils_fft16_bin2(float *real_in, float *real, float *imag);
 void utils_fft8_bin0(float *real_in, float *real, float *imag);
 void utils_fft8_bin1(float *real_in, float *real, float *imag);
 void utils_fft8_bin2(float *real_in, float *real, float *imag);
+bool utils_dft_init(utils_dft_t *dft, int len);
+void utils_dft_bin(const utils_dft_t *dft, const float *real_in, int bin, float *real, float *imag);
+void utils_goertzel(const float *real_in, int len, float bin, float *real, float *imag);
 float utils_batt_liion_norm_v_to_capacity(float norm_v);
 uint16_t utils_median_filter_uint16_run(uint16_t *buffer,
 		unsigned int *buffer_index, unsigned int filter_len, uint16_t sample);